@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/libninja-re2c.dir/src/depfile_parser.cc.o"
+  "CMakeFiles/libninja-re2c.dir/src/depfile_parser.cc.o.d"
+  "CMakeFiles/libninja-re2c.dir/src/lexer.cc.o"
+  "CMakeFiles/libninja-re2c.dir/src/lexer.cc.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/libninja-re2c.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
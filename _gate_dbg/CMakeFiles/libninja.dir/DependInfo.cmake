@@ -0,0 +1,63 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/action_cache.cc" "CMakeFiles/libninja.dir/src/action_cache.cc.o" "gcc" "CMakeFiles/libninja.dir/src/action_cache.cc.o.d"
+  "/root/repo/src/affected.cc" "CMakeFiles/libninja.dir/src/affected.cc.o" "gcc" "CMakeFiles/libninja.dir/src/affected.cc.o.d"
+  "/root/repo/src/affinity.cc" "CMakeFiles/libninja.dir/src/affinity.cc.o" "gcc" "CMakeFiles/libninja.dir/src/affinity.cc.o.d"
+  "/root/repo/src/arena.cc" "CMakeFiles/libninja.dir/src/arena.cc.o" "gcc" "CMakeFiles/libninja.dir/src/arena.cc.o.d"
+  "/root/repo/src/build.cc" "CMakeFiles/libninja.dir/src/build.cc.o" "gcc" "CMakeFiles/libninja.dir/src/build.cc.o.d"
+  "/root/repo/src/build_dir_lock.cc" "CMakeFiles/libninja.dir/src/build_dir_lock.cc.o" "gcc" "CMakeFiles/libninja.dir/src/build_dir_lock.cc.o.d"
+  "/root/repo/src/build_log.cc" "CMakeFiles/libninja.dir/src/build_log.cc.o" "gcc" "CMakeFiles/libninja.dir/src/build_log.cc.o.d"
+  "/root/repo/src/clean.cc" "CMakeFiles/libninja.dir/src/clean.cc.o" "gcc" "CMakeFiles/libninja.dir/src/clean.cc.o.d"
+  "/root/repo/src/clparser.cc" "CMakeFiles/libninja.dir/src/clparser.cc.o" "gcc" "CMakeFiles/libninja.dir/src/clparser.cc.o.d"
+  "/root/repo/src/daemon.cc" "CMakeFiles/libninja.dir/src/daemon.cc.o" "gcc" "CMakeFiles/libninja.dir/src/daemon.cc.o.d"
+  "/root/repo/src/debug_flags.cc" "CMakeFiles/libninja.dir/src/debug_flags.cc.o" "gcc" "CMakeFiles/libninja.dir/src/debug_flags.cc.o.d"
+  "/root/repo/src/deps_log.cc" "CMakeFiles/libninja.dir/src/deps_log.cc.o" "gcc" "CMakeFiles/libninja.dir/src/deps_log.cc.o.d"
+  "/root/repo/src/deps_printer.cc" "CMakeFiles/libninja.dir/src/deps_printer.cc.o" "gcc" "CMakeFiles/libninja.dir/src/deps_printer.cc.o.d"
+  "/root/repo/src/digest_log.cc" "CMakeFiles/libninja.dir/src/digest_log.cc.o" "gcc" "CMakeFiles/libninja.dir/src/digest_log.cc.o.d"
+  "/root/repo/src/disk_interface.cc" "CMakeFiles/libninja.dir/src/disk_interface.cc.o" "gcc" "CMakeFiles/libninja.dir/src/disk_interface.cc.o.d"
+  "/root/repo/src/dyndep.cc" "CMakeFiles/libninja.dir/src/dyndep.cc.o" "gcc" "CMakeFiles/libninja.dir/src/dyndep.cc.o.d"
+  "/root/repo/src/dyndep_parser.cc" "CMakeFiles/libninja.dir/src/dyndep_parser.cc.o" "gcc" "CMakeFiles/libninja.dir/src/dyndep_parser.cc.o.d"
+  "/root/repo/src/edit_distance.cc" "CMakeFiles/libninja.dir/src/edit_distance.cc.o" "gcc" "CMakeFiles/libninja.dir/src/edit_distance.cc.o.d"
+  "/root/repo/src/eval_env.cc" "CMakeFiles/libninja.dir/src/eval_env.cc.o" "gcc" "CMakeFiles/libninja.dir/src/eval_env.cc.o.d"
+  "/root/repo/src/graph.cc" "CMakeFiles/libninja.dir/src/graph.cc.o" "gcc" "CMakeFiles/libninja.dir/src/graph.cc.o.d"
+  "/root/repo/src/graph_json.cc" "CMakeFiles/libninja.dir/src/graph_json.cc.o" "gcc" "CMakeFiles/libninja.dir/src/graph_json.cc.o.d"
+  "/root/repo/src/graphviz.cc" "CMakeFiles/libninja.dir/src/graphviz.cc.o" "gcc" "CMakeFiles/libninja.dir/src/graphviz.cc.o.d"
+  "/root/repo/src/jobserver.cc" "CMakeFiles/libninja.dir/src/jobserver.cc.o" "gcc" "CMakeFiles/libninja.dir/src/jobserver.cc.o.d"
+  "/root/repo/src/line_printer.cc" "CMakeFiles/libninja.dir/src/line_printer.cc.o" "gcc" "CMakeFiles/libninja.dir/src/line_printer.cc.o.d"
+  "/root/repo/src/log_writer.cc" "CMakeFiles/libninja.dir/src/log_writer.cc.o" "gcc" "CMakeFiles/libninja.dir/src/log_writer.cc.o.d"
+  "/root/repo/src/manifest_cache.cc" "CMakeFiles/libninja.dir/src/manifest_cache.cc.o" "gcc" "CMakeFiles/libninja.dir/src/manifest_cache.cc.o.d"
+  "/root/repo/src/manifest_parser.cc" "CMakeFiles/libninja.dir/src/manifest_parser.cc.o" "gcc" "CMakeFiles/libninja.dir/src/manifest_parser.cc.o.d"
+  "/root/repo/src/mapped_file.cc" "CMakeFiles/libninja.dir/src/mapped_file.cc.o" "gcc" "CMakeFiles/libninja.dir/src/mapped_file.cc.o.d"
+  "/root/repo/src/metrics.cc" "CMakeFiles/libninja.dir/src/metrics.cc.o" "gcc" "CMakeFiles/libninja.dir/src/metrics.cc.o.d"
+  "/root/repo/src/missing_deps.cc" "CMakeFiles/libninja.dir/src/missing_deps.cc.o" "gcc" "CMakeFiles/libninja.dir/src/missing_deps.cc.o.d"
+  "/root/repo/src/parallel.cc" "CMakeFiles/libninja.dir/src/parallel.cc.o" "gcc" "CMakeFiles/libninja.dir/src/parallel.cc.o.d"
+  "/root/repo/src/parser.cc" "CMakeFiles/libninja.dir/src/parser.cc.o" "gcc" "CMakeFiles/libninja.dir/src/parser.cc.o.d"
+  "/root/repo/src/remote_launcher.cc" "CMakeFiles/libninja.dir/src/remote_launcher.cc.o" "gcc" "CMakeFiles/libninja.dir/src/remote_launcher.cc.o.d"
+  "/root/repo/src/resume_log.cc" "CMakeFiles/libninja.dir/src/resume_log.cc.o" "gcc" "CMakeFiles/libninja.dir/src/resume_log.cc.o.d"
+  "/root/repo/src/session.cc" "CMakeFiles/libninja.dir/src/session.cc.o" "gcc" "CMakeFiles/libninja.dir/src/session.cc.o.d"
+  "/root/repo/src/shard.cc" "CMakeFiles/libninja.dir/src/shard.cc.o" "gcc" "CMakeFiles/libninja.dir/src/shard.cc.o.d"
+  "/root/repo/src/simulate.cc" "CMakeFiles/libninja.dir/src/simulate.cc.o" "gcc" "CMakeFiles/libninja.dir/src/simulate.cc.o.d"
+  "/root/repo/src/state.cc" "CMakeFiles/libninja.dir/src/state.cc.o" "gcc" "CMakeFiles/libninja.dir/src/state.cc.o.d"
+  "/root/repo/src/status_events.cc" "CMakeFiles/libninja.dir/src/status_events.cc.o" "gcc" "CMakeFiles/libninja.dir/src/status_events.cc.o.d"
+  "/root/repo/src/string_piece_util.cc" "CMakeFiles/libninja.dir/src/string_piece_util.cc.o" "gcc" "CMakeFiles/libninja.dir/src/string_piece_util.cc.o.d"
+  "/root/repo/src/subprocess-posix.cc" "CMakeFiles/libninja.dir/src/subprocess-posix.cc.o" "gcc" "CMakeFiles/libninja.dir/src/subprocess-posix.cc.o.d"
+  "/root/repo/src/trace.cc" "CMakeFiles/libninja.dir/src/trace.cc.o" "gcc" "CMakeFiles/libninja.dir/src/trace.cc.o.d"
+  "/root/repo/src/util.cc" "CMakeFiles/libninja.dir/src/util.cc.o" "gcc" "CMakeFiles/libninja.dir/src/util.cc.o.d"
+  "/root/repo/src/version.cc" "CMakeFiles/libninja.dir/src/version.cc.o" "gcc" "CMakeFiles/libninja.dir/src/version.cc.o.d"
+  "/root/repo/src/watch.cc" "CMakeFiles/libninja.dir/src/watch.cc.o" "gcc" "CMakeFiles/libninja.dir/src/watch.cc.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,97 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/libninja.dir/src/action_cache.cc.o"
+  "CMakeFiles/libninja.dir/src/action_cache.cc.o.d"
+  "CMakeFiles/libninja.dir/src/affected.cc.o"
+  "CMakeFiles/libninja.dir/src/affected.cc.o.d"
+  "CMakeFiles/libninja.dir/src/affinity.cc.o"
+  "CMakeFiles/libninja.dir/src/affinity.cc.o.d"
+  "CMakeFiles/libninja.dir/src/arena.cc.o"
+  "CMakeFiles/libninja.dir/src/arena.cc.o.d"
+  "CMakeFiles/libninja.dir/src/build.cc.o"
+  "CMakeFiles/libninja.dir/src/build.cc.o.d"
+  "CMakeFiles/libninja.dir/src/build_dir_lock.cc.o"
+  "CMakeFiles/libninja.dir/src/build_dir_lock.cc.o.d"
+  "CMakeFiles/libninja.dir/src/build_log.cc.o"
+  "CMakeFiles/libninja.dir/src/build_log.cc.o.d"
+  "CMakeFiles/libninja.dir/src/clean.cc.o"
+  "CMakeFiles/libninja.dir/src/clean.cc.o.d"
+  "CMakeFiles/libninja.dir/src/clparser.cc.o"
+  "CMakeFiles/libninja.dir/src/clparser.cc.o.d"
+  "CMakeFiles/libninja.dir/src/daemon.cc.o"
+  "CMakeFiles/libninja.dir/src/daemon.cc.o.d"
+  "CMakeFiles/libninja.dir/src/debug_flags.cc.o"
+  "CMakeFiles/libninja.dir/src/debug_flags.cc.o.d"
+  "CMakeFiles/libninja.dir/src/deps_log.cc.o"
+  "CMakeFiles/libninja.dir/src/deps_log.cc.o.d"
+  "CMakeFiles/libninja.dir/src/deps_printer.cc.o"
+  "CMakeFiles/libninja.dir/src/deps_printer.cc.o.d"
+  "CMakeFiles/libninja.dir/src/digest_log.cc.o"
+  "CMakeFiles/libninja.dir/src/digest_log.cc.o.d"
+  "CMakeFiles/libninja.dir/src/disk_interface.cc.o"
+  "CMakeFiles/libninja.dir/src/disk_interface.cc.o.d"
+  "CMakeFiles/libninja.dir/src/dyndep.cc.o"
+  "CMakeFiles/libninja.dir/src/dyndep.cc.o.d"
+  "CMakeFiles/libninja.dir/src/dyndep_parser.cc.o"
+  "CMakeFiles/libninja.dir/src/dyndep_parser.cc.o.d"
+  "CMakeFiles/libninja.dir/src/edit_distance.cc.o"
+  "CMakeFiles/libninja.dir/src/edit_distance.cc.o.d"
+  "CMakeFiles/libninja.dir/src/eval_env.cc.o"
+  "CMakeFiles/libninja.dir/src/eval_env.cc.o.d"
+  "CMakeFiles/libninja.dir/src/graph.cc.o"
+  "CMakeFiles/libninja.dir/src/graph.cc.o.d"
+  "CMakeFiles/libninja.dir/src/graph_json.cc.o"
+  "CMakeFiles/libninja.dir/src/graph_json.cc.o.d"
+  "CMakeFiles/libninja.dir/src/graphviz.cc.o"
+  "CMakeFiles/libninja.dir/src/graphviz.cc.o.d"
+  "CMakeFiles/libninja.dir/src/jobserver.cc.o"
+  "CMakeFiles/libninja.dir/src/jobserver.cc.o.d"
+  "CMakeFiles/libninja.dir/src/line_printer.cc.o"
+  "CMakeFiles/libninja.dir/src/line_printer.cc.o.d"
+  "CMakeFiles/libninja.dir/src/log_writer.cc.o"
+  "CMakeFiles/libninja.dir/src/log_writer.cc.o.d"
+  "CMakeFiles/libninja.dir/src/manifest_cache.cc.o"
+  "CMakeFiles/libninja.dir/src/manifest_cache.cc.o.d"
+  "CMakeFiles/libninja.dir/src/manifest_parser.cc.o"
+  "CMakeFiles/libninja.dir/src/manifest_parser.cc.o.d"
+  "CMakeFiles/libninja.dir/src/mapped_file.cc.o"
+  "CMakeFiles/libninja.dir/src/mapped_file.cc.o.d"
+  "CMakeFiles/libninja.dir/src/metrics.cc.o"
+  "CMakeFiles/libninja.dir/src/metrics.cc.o.d"
+  "CMakeFiles/libninja.dir/src/missing_deps.cc.o"
+  "CMakeFiles/libninja.dir/src/missing_deps.cc.o.d"
+  "CMakeFiles/libninja.dir/src/parallel.cc.o"
+  "CMakeFiles/libninja.dir/src/parallel.cc.o.d"
+  "CMakeFiles/libninja.dir/src/parser.cc.o"
+  "CMakeFiles/libninja.dir/src/parser.cc.o.d"
+  "CMakeFiles/libninja.dir/src/remote_launcher.cc.o"
+  "CMakeFiles/libninja.dir/src/remote_launcher.cc.o.d"
+  "CMakeFiles/libninja.dir/src/resume_log.cc.o"
+  "CMakeFiles/libninja.dir/src/resume_log.cc.o.d"
+  "CMakeFiles/libninja.dir/src/session.cc.o"
+  "CMakeFiles/libninja.dir/src/session.cc.o.d"
+  "CMakeFiles/libninja.dir/src/shard.cc.o"
+  "CMakeFiles/libninja.dir/src/shard.cc.o.d"
+  "CMakeFiles/libninja.dir/src/simulate.cc.o"
+  "CMakeFiles/libninja.dir/src/simulate.cc.o.d"
+  "CMakeFiles/libninja.dir/src/state.cc.o"
+  "CMakeFiles/libninja.dir/src/state.cc.o.d"
+  "CMakeFiles/libninja.dir/src/status_events.cc.o"
+  "CMakeFiles/libninja.dir/src/status_events.cc.o.d"
+  "CMakeFiles/libninja.dir/src/string_piece_util.cc.o"
+  "CMakeFiles/libninja.dir/src/string_piece_util.cc.o.d"
+  "CMakeFiles/libninja.dir/src/subprocess-posix.cc.o"
+  "CMakeFiles/libninja.dir/src/subprocess-posix.cc.o.d"
+  "CMakeFiles/libninja.dir/src/trace.cc.o"
+  "CMakeFiles/libninja.dir/src/trace.cc.o.d"
+  "CMakeFiles/libninja.dir/src/util.cc.o"
+  "CMakeFiles/libninja.dir/src/util.cc.o.d"
+  "CMakeFiles/libninja.dir/src/version.cc.o"
+  "CMakeFiles/libninja.dir/src/version.cc.o.d"
+  "CMakeFiles/libninja.dir/src/watch.cc.o"
+  "CMakeFiles/libninja.dir/src/watch.cc.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/libninja.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
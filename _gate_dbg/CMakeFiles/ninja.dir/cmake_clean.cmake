@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/ninja.dir/src/ninja.cc.o"
+  "CMakeFiles/ninja.dir/src/ninja.cc.o.d"
+  "ninja"
+  "ninja.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/ninja.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
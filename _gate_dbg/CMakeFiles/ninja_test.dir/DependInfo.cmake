@@ -0,0 +1,61 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/action_cache_test.cc" "CMakeFiles/ninja_test.dir/src/action_cache_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/action_cache_test.cc.o.d"
+  "/root/repo/src/affected_test.cc" "CMakeFiles/ninja_test.dir/src/affected_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/affected_test.cc.o.d"
+  "/root/repo/src/affinity_test.cc" "CMakeFiles/ninja_test.dir/src/affinity_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/affinity_test.cc.o.d"
+  "/root/repo/src/arena_test.cc" "CMakeFiles/ninja_test.dir/src/arena_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/arena_test.cc.o.d"
+  "/root/repo/src/build_dir_lock_test.cc" "CMakeFiles/ninja_test.dir/src/build_dir_lock_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/build_dir_lock_test.cc.o.d"
+  "/root/repo/src/build_log_test.cc" "CMakeFiles/ninja_test.dir/src/build_log_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/build_log_test.cc.o.d"
+  "/root/repo/src/build_test.cc" "CMakeFiles/ninja_test.dir/src/build_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/build_test.cc.o.d"
+  "/root/repo/src/clean_test.cc" "CMakeFiles/ninja_test.dir/src/clean_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/clean_test.cc.o.d"
+  "/root/repo/src/clparser_test.cc" "CMakeFiles/ninja_test.dir/src/clparser_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/clparser_test.cc.o.d"
+  "/root/repo/src/daemon_test.cc" "CMakeFiles/ninja_test.dir/src/daemon_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/daemon_test.cc.o.d"
+  "/root/repo/src/depfile_parser_test.cc" "CMakeFiles/ninja_test.dir/src/depfile_parser_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/depfile_parser_test.cc.o.d"
+  "/root/repo/src/deps_log_test.cc" "CMakeFiles/ninja_test.dir/src/deps_log_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/deps_log_test.cc.o.d"
+  "/root/repo/src/deps_printer_test.cc" "CMakeFiles/ninja_test.dir/src/deps_printer_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/deps_printer_test.cc.o.d"
+  "/root/repo/src/digest_log_test.cc" "CMakeFiles/ninja_test.dir/src/digest_log_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/digest_log_test.cc.o.d"
+  "/root/repo/src/disk_interface_test.cc" "CMakeFiles/ninja_test.dir/src/disk_interface_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/disk_interface_test.cc.o.d"
+  "/root/repo/src/dyndep_parser_test.cc" "CMakeFiles/ninja_test.dir/src/dyndep_parser_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/dyndep_parser_test.cc.o.d"
+  "/root/repo/src/edit_distance_test.cc" "CMakeFiles/ninja_test.dir/src/edit_distance_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/edit_distance_test.cc.o.d"
+  "/root/repo/src/graph_json_test.cc" "CMakeFiles/ninja_test.dir/src/graph_json_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/graph_json_test.cc.o.d"
+  "/root/repo/src/graph_test.cc" "CMakeFiles/ninja_test.dir/src/graph_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/graph_test.cc.o.d"
+  "/root/repo/src/hash_map_test.cc" "CMakeFiles/ninja_test.dir/src/hash_map_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/hash_map_test.cc.o.d"
+  "/root/repo/src/jobserver_test.cc" "CMakeFiles/ninja_test.dir/src/jobserver_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/jobserver_test.cc.o.d"
+  "/root/repo/src/lexer_test.cc" "CMakeFiles/ninja_test.dir/src/lexer_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/lexer_test.cc.o.d"
+  "/root/repo/src/log_writer_test.cc" "CMakeFiles/ninja_test.dir/src/log_writer_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/log_writer_test.cc.o.d"
+  "/root/repo/src/manifest_cache_test.cc" "CMakeFiles/ninja_test.dir/src/manifest_cache_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/manifest_cache_test.cc.o.d"
+  "/root/repo/src/manifest_parser_test.cc" "CMakeFiles/ninja_test.dir/src/manifest_parser_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/manifest_parser_test.cc.o.d"
+  "/root/repo/src/mapped_file_test.cc" "CMakeFiles/ninja_test.dir/src/mapped_file_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/mapped_file_test.cc.o.d"
+  "/root/repo/src/metrics_test.cc" "CMakeFiles/ninja_test.dir/src/metrics_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/metrics_test.cc.o.d"
+  "/root/repo/src/missing_deps_test.cc" "CMakeFiles/ninja_test.dir/src/missing_deps_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/missing_deps_test.cc.o.d"
+  "/root/repo/src/ninja_test.cc" "CMakeFiles/ninja_test.dir/src/ninja_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/ninja_test.cc.o.d"
+  "/root/repo/src/parallel_test.cc" "CMakeFiles/ninja_test.dir/src/parallel_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/parallel_test.cc.o.d"
+  "/root/repo/src/remote_launcher_test.cc" "CMakeFiles/ninja_test.dir/src/remote_launcher_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/remote_launcher_test.cc.o.d"
+  "/root/repo/src/resume_log_test.cc" "CMakeFiles/ninja_test.dir/src/resume_log_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/resume_log_test.cc.o.d"
+  "/root/repo/src/session_test.cc" "CMakeFiles/ninja_test.dir/src/session_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/session_test.cc.o.d"
+  "/root/repo/src/shard_test.cc" "CMakeFiles/ninja_test.dir/src/shard_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/shard_test.cc.o.d"
+  "/root/repo/src/simulate_test.cc" "CMakeFiles/ninja_test.dir/src/simulate_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/simulate_test.cc.o.d"
+  "/root/repo/src/state_test.cc" "CMakeFiles/ninja_test.dir/src/state_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/state_test.cc.o.d"
+  "/root/repo/src/status_events_test.cc" "CMakeFiles/ninja_test.dir/src/status_events_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/status_events_test.cc.o.d"
+  "/root/repo/src/string_piece_util_test.cc" "CMakeFiles/ninja_test.dir/src/string_piece_util_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/string_piece_util_test.cc.o.d"
+  "/root/repo/src/subprocess_test.cc" "CMakeFiles/ninja_test.dir/src/subprocess_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/subprocess_test.cc.o.d"
+  "/root/repo/src/test.cc" "CMakeFiles/ninja_test.dir/src/test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/test.cc.o.d"
+  "/root/repo/src/trace_test.cc" "CMakeFiles/ninja_test.dir/src/trace_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/trace_test.cc.o.d"
+  "/root/repo/src/util_test.cc" "CMakeFiles/ninja_test.dir/src/util_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/util_test.cc.o.d"
+  "/root/repo/src/watch_test.cc" "CMakeFiles/ninja_test.dir/src/watch_test.cc.o" "gcc" "CMakeFiles/ninja_test.dir/src/watch_test.cc.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,95 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/ninja_test.dir/src/action_cache_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/action_cache_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/affected_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/affected_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/affinity_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/affinity_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/arena_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/arena_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/build_dir_lock_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/build_dir_lock_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/build_log_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/build_log_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/build_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/build_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/clean_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/clean_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/clparser_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/clparser_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/daemon_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/daemon_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/depfile_parser_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/depfile_parser_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/deps_log_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/deps_log_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/deps_printer_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/deps_printer_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/digest_log_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/digest_log_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/disk_interface_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/disk_interface_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/dyndep_parser_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/dyndep_parser_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/edit_distance_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/edit_distance_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/graph_json_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/graph_json_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/graph_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/graph_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/hash_map_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/hash_map_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/jobserver_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/jobserver_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/lexer_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/lexer_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/log_writer_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/log_writer_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/manifest_cache_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/manifest_cache_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/manifest_parser_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/manifest_parser_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/mapped_file_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/mapped_file_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/metrics_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/metrics_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/missing_deps_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/missing_deps_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/ninja_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/ninja_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/parallel_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/parallel_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/remote_launcher_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/remote_launcher_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/resume_log_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/resume_log_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/session_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/session_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/shard_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/shard_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/simulate_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/simulate_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/state_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/state_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/status_events_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/status_events_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/string_piece_util_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/string_piece_util_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/subprocess_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/subprocess_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/trace_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/trace_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/util_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/util_test.cc.o.d"
+  "CMakeFiles/ninja_test.dir/src/watch_test.cc.o"
+  "CMakeFiles/ninja_test.dir/src/watch_test.cc.o.d"
+  "ninja_test"
+  "ninja_test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/ninja_test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,8 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo
+# Build directory: /root/repo/_gate_dbg
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+add_test(NinjaTest "ninja_test")
+set_tests_properties(NinjaTest PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/CMakeLists.txt;154;add_test;/root/repo/CMakeLists.txt;0;")
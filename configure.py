@@ -109,6 +109,9 @@ class Platform(object):
         return self._platform in ('freebsd', 'linux', 'openbsd', 'bitrig',
                                   'dragonfly')
 
+    def supports_epoll(self):
+        return self._platform == 'linux'
+
     def supports_ninja_browse(self):
         return (not self.is_windows()
                 and not self.is_solaris()
@@ -386,8 +389,15 @@ else:
         cflags.append('-fno-omit-frame-pointer')
         libs.extend(['-Wl,--no-as-needed', '-lprofiler'])
 
+if not platform.is_windows():
+    # parallel.cc uses std::thread.
+    cflags.append('-pthread')
+    ldflags.append('-pthread')
+
 if platform.supports_ppoll() and not options.force_pselect:
     cflags.append('-DUSE_PPOLL')
+if platform.supports_epoll() and not options.force_pselect:
+    cflags.append('-DUSE_EPOLL')
 if platform.supports_ninja_browse():
     cflags.append('-DNINJA_HAVE_BROWSE')
 
@@ -493,29 +503,52 @@ n.comment('Core source files all build into ninja library.')
 cxxvariables = []
 if platform.is_msvc():
     cxxvariables = [('pdb', 'ninja.pdb')]
-for name in ['build',
+for name in ['action_cache',
+             'affected',
+             'affinity',
+             'arena',
+             'build',
+             'build_dir_lock',
              'build_log',
              'clean',
              'clparser',
+             'daemon',
              'debug_flags',
              'depfile_parser',
              'deps_log',
+             'deps_printer',
+             'digest_log',
              'disk_interface',
              'dyndep',
              'dyndep_parser',
              'edit_distance',
              'eval_env',
              'graph',
+             'graph_json',
              'graphviz',
+             'jobserver',
              'lexer',
              'line_printer',
+             'log_writer',
+             'manifest_cache',
              'manifest_parser',
+             'mapped_file',
              'metrics',
+             'missing_deps',
+             'parallel',
              'parser',
+             'remote_launcher',
+             'resume_log',
+             'session',
+             'shard',
+             'simulate',
              'state',
+             'status_events',
              'string_piece_util',
+             'trace',
              'util',
-             'version']:
+             'version',
+             'watch']:
     objs += cxx(name, variables=cxxvariables)
 if platform.is_windows():
     for name in ['subprocess-win32',
@@ -565,24 +598,49 @@ objs = []
 if platform.is_msvc():
     cxxvariables = [('pdb', 'ninja_test.pdb')]
 
-for name in ['build_log_test',
+for name in ['action_cache_test',
+             'affected_test',
+             'affinity_test',
+             'arena_test',
+             'build_dir_lock_test',
+             'build_log_test',
              'build_test',
              'clean_test',
              'clparser_test',
+             'daemon_test',
              'depfile_parser_test',
              'deps_log_test',
+             'deps_printer_test',
+             'digest_log_test',
              'dyndep_parser_test',
              'disk_interface_test',
              'edit_distance_test',
              'graph_test',
+             'graph_json_test',
+             'hash_map_test',
+             'jobserver_test',
              'lexer_test',
+             'log_writer_test',
+             'manifest_cache_test',
              'manifest_parser_test',
+             'mapped_file_test',
+             'metrics_test',
+             'missing_deps_test',
              'ninja_test',
+             'parallel_test',
+             'remote_launcher_test',
+             'resume_log_test',
+             'session_test',
+             'shard_test',
+             'simulate_test',
              'state_test',
+             'status_events_test',
              'string_piece_util_test',
              'subprocess_test',
              'test',
-             'util_test']:
+             'trace_test',
+             'util_test',
+             'watch_test']:
     objs += cxx(name, variables=cxxvariables)
 if platform.is_windows():
     for name in ['includes_normalize_test', 'msvc_helper_test']:
@@ -600,6 +658,7 @@ for name in ['build_log_perftest',
              'canon_perftest',
              'depfile_parser_perftest',
              'hash_collision_bench',
+             'hash_map_perftest',
              'manifest_parser_perftest',
              'clparser_perftest']:
   if platform.is_msvc():
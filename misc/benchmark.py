@@ -0,0 +1,318 @@
+#!/usr/bin/env python
+
+# Copyright 2019 Google Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""End-to-end benchmarks of a ninja binary on synthetic builds.
+
+The builds are generated by write_fake_manifests.py with --fake-commands, at
+each requested scale and both with and without chdir subninjas.  For each
+one this measures:
+
+  full     a clean build, which also fills in the build and deps logs
+  load     loading the manifest only (ninja -t targets rule ...)
+  noop     a build with nothing to do, which loads the logs and stats
+  touch    the rebuild after touching a single header
+
+and reports the best wall time over the repetitions along with the peak RSS
+and, on Linux when a C compiler is around, the number of heap allocations.
+The manifests use a fixed seed, so numbers from two ninja binaries on the
+same machine can be compared directly; --json writes them for scripts.
+
+Usage:
+  misc/benchmark.py --ninja path/to/ninja --scales 10000,100000,1000000
+"""
+
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import platform
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+MISC = os.path.dirname(os.path.abspath(__file__))
+
+# Roughly how many edges write_fake_manifests.py makes per target.
+EDGES_PER_TARGET = 45
+
+# Counts the heap allocations of the ninja process, not of its commands: it
+# takes itself out of the environment before ninja spawns anything.
+ALLOC_COUNTER = r'''
+#include <stdio.h>
+#include <stdlib.h>
+
+extern void* __libc_malloc(size_t);
+extern void* __libc_calloc(size_t, size_t);
+extern void* __libc_realloc(void*, size_t);
+
+static unsigned long long count;
+
+void* malloc(size_t n) {
+  __atomic_fetch_add(&count, 1, __ATOMIC_RELAXED);
+  return __libc_malloc(n);
+}
+void* calloc(size_t n, size_t size) {
+  __atomic_fetch_add(&count, 1, __ATOMIC_RELAXED);
+  return __libc_calloc(n, size);
+}
+void* realloc(void* p, size_t n) {
+  __atomic_fetch_add(&count, 1, __ATOMIC_RELAXED);
+  return __libc_realloc(p, n);
+}
+
+static char path[4096];
+
+__attribute__((constructor)) static void start(void) {
+  const char* p = getenv("NINJA_BENCHMARK_ALLOCS");
+  if (p)
+    snprintf(path, sizeof(path), "%s", p);
+  unsetenv("LD_PRELOAD");
+  unsetenv("NINJA_BENCHMARK_ALLOCS");
+}
+
+__attribute__((destructor)) static void report(void) {
+  FILE* f;
+  if (!path[0] || !(f = fopen(path, "w")))
+    return;
+  fprintf(f, "%llu\n", count);
+  fclose(f);
+}
+'''
+
+
+def build_alloc_counter(work_dir):
+    """Returns the path of a library to LD_PRELOAD for counting allocations,
+    or None where that isn't possible."""
+    if platform.system() != 'Linux':
+        return None
+    src = os.path.join(work_dir, 'alloc_counter.c')
+    lib = os.path.join(work_dir, 'alloc_counter.so')
+    with open(src, 'w') as f:
+        f.write(ALLOC_COUNTER)
+    cc = os.environ.get('CC', 'cc')
+    try:
+        if subprocess.call([cc, '-shared', '-fPIC', '-O2', '-o', lib, src]):
+            return None
+    except OSError:
+        return None
+    return lib
+
+
+class Sample(object):
+    def __init__(self, wall_ms, max_rss_kib, allocs, output):
+        self.wall_ms = wall_ms
+        self.max_rss_kib = max_rss_kib
+        self.allocs = allocs
+        self.output = output
+
+
+def run(cmd, cwd, alloc_counter=None):
+    """Runs |cmd| to completion in |cwd| and returns a Sample of it."""
+    env = dict(os.environ)
+    # Keep the status output plain and parseable.
+    env['NINJA_STATUS'] = '[%f/%t] '
+    allocs_path = None
+    if alloc_counter:
+        fd, allocs_path = tempfile.mkstemp(prefix='ninja_allocs')
+        os.close(fd)
+        env['LD_PRELOAD'] = alloc_counter
+        env['NINJA_BENCHMARK_ALLOCS'] = allocs_path
+    with tempfile.TemporaryFile() as out:
+        start = time.time()
+        proc = subprocess.Popen(cmd, cwd=cwd, env=env, stdout=out,
+                                stderr=subprocess.STDOUT)
+        _, status, usage = os.wait4(proc.pid, 0)
+        wall_ms = (time.time() - start) * 1000
+        proc.returncode = status
+        out.seek(0)
+        output = out.read().decode('utf-8', 'replace')
+    if status != 0:
+        sys.exit('%s failed in %s:\n%s' % (' '.join(cmd), cwd, output))
+    # ru_maxrss is in KiB on Linux but bytes on macOS.
+    max_rss_kib = usage.ru_maxrss
+    if sys.platform == 'darwin':
+        max_rss_kib //= 1024
+    allocs = None
+    if allocs_path:
+        with open(allocs_path) as f:
+            text = f.read().strip()
+        os.unlink(allocs_path)
+        allocs = int(text) if text else None
+    return Sample(wall_ms, max_rss_kib, allocs, output)
+
+
+def best_of(samples):
+    """Summarizes repeated runs: the best time and the worst memory use."""
+    allocs = [s.allocs for s in samples if s.allocs is not None]
+    return {
+        'wall_ms': min(s.wall_ms for s in samples),
+        'max_rss_kib': max(s.max_rss_kib for s in samples),
+        'allocs': max(allocs) if allocs else None,
+    }
+
+
+def stats_total_ms(output, metric):
+    """Returns the total time ninja -d stats reported for |metric|."""
+    for line in output.splitlines():
+        fields = [f.strip() for f in line.split('\t')]
+        if len(fields) == 4 and fields[0] == metric:
+            return float(fields[3])
+    return None
+
+
+def edges_run(output):
+    """Returns how many commands a build's status lines say it ran."""
+    counts = re.findall(r'^\[(\d+)/\d+\] ', output, re.M)
+    return int(counts[-1]) if counts else 0
+
+
+def generate(build_dir, edges, chdir):
+    if os.path.exists(os.path.join(build_dir, 'build.ninja')):
+        return
+    targets = max(2, edges // EDGES_PER_TARGET)
+    cmd = [sys.executable, os.path.join(MISC, 'write_fake_manifests.py'),
+           '--fake-commands', '-t', str(targets), build_dir]
+    if chdir:
+        cmd.insert(-1, '--chdir')
+    print('generating %s...' % build_dir)
+    sys.stdout.flush()
+    if subprocess.call(cmd):
+        sys.exit('write_fake_manifests.py failed')
+
+
+def find_header(build_dir):
+    """Picks a header to touch, the same one on every run."""
+    for root, dirs, files in os.walk(build_dir):
+        dirs.sort()
+        for name in sorted(files):
+            if name.endswith('.h'):
+                return os.path.join(root, name)
+    sys.exit('no headers in %s' % build_dir)
+
+
+def benchmark(ninja, build_dir, args, alloc_counter):
+    results = {}
+
+    # Start from scratch so the full build and the logs are the same every
+    # time.
+    run([ninja, '-t', 'clean'], build_dir)
+    for log in ('.ninja_log', '.ninja_deps'):
+        path = os.path.join(build_dir, log)
+        if os.path.exists(path):
+            os.unlink(path)
+    full = run([ninja, '-j', str(args.jobs)], build_dir, alloc_counter)
+    results['full'] = best_of([full])
+    results['full']['edges'] = edges_run(full.output)
+
+    samples = [run([ninja, '-t', 'targets', 'rule', 'ninja_benchmark_none'],
+                   build_dir, alloc_counter) for _ in range(args.repeat)]
+    results['load'] = best_of(samples)
+
+    samples = [run([ninja, '-d', 'stats'], build_dir, alloc_counter)
+               for _ in range(args.repeat)]
+    results['noop'] = best_of(samples)
+    for metric in ('.ninja_log load', '.ninja_deps load'):
+        times = [stats_total_ms(s.output, metric) for s in samples]
+        times = [t for t in times if t is not None]
+        if times:
+            results['noop'][metric.strip('.').replace(' ', '_') + '_ms'] = \
+                min(times)
+
+    header = find_header(build_dir)
+    samples = []
+    for _ in range(args.repeat):
+        os.utime(header, None)
+        samples.append(run([ninja, '-j', str(args.jobs)], build_dir,
+                           alloc_counter))
+    results['touch'] = best_of(samples)
+    results['touch']['edges'] = edges_run(samples[-1].output)
+    return results
+
+
+def report(name, results):
+    print(name)
+    print('  %-6s %10s %10s %12s  %s' % ('step', 'wall ms', 'rss MiB',
+                                          'allocs', 'notes'))
+    for step in ('full', 'load', 'noop', 'touch'):
+        r = results[step]
+        notes = ['%s=%s' % (k, v) for k, v in sorted(r.items())
+                 if k not in ('wall_ms', 'max_rss_kib', 'allocs')]
+        allocs = '-' if r['allocs'] is None else str(r['allocs'])
+        print('  %-6s %10.0f %10.1f %12s  %s' % (
+            step, r['wall_ms'], r['max_rss_kib'] / 1024.0, allocs,
+            ' '.join(notes)))
+    sys.stdout.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Benchmark ninja on generated builds.')
+    parser.add_argument('--ninja', default='ninja',
+                        help='ninja binary to measure (default: ninja)')
+    parser.add_argument('--scales', default='10000,100000,1000000',
+                        help='comma-separated edge counts '
+                        '(default: 10000,100000,1000000)')
+    parser.add_argument('--layouts', default='flat,chdir',
+                        help='comma-separated subset of flat,chdir')
+    parser.add_argument('--work-dir', default='benchmark_builds',
+                        help='where to generate the builds, which are kept '
+                        'for later runs (default: benchmark_builds)')
+    parser.add_argument('-j', '--jobs', type=int, default=16,
+                        help='parallelism of the builds (default: 16)')
+    parser.add_argument('-r', '--repeat', type=int, default=5,
+                        help='runs of each step but the full build '
+                        '(default: 5)')
+    parser.add_argument('--no-allocs', action='store_true',
+                        help="don't count allocations")
+    parser.add_argument('--json', metavar='FILE',
+                        help='also write the results to FILE')
+    args = parser.parse_args()
+
+    ninja = args.ninja
+    if os.path.sep in ninja:
+        ninja = os.path.abspath(ninja)
+    work_dir = os.path.abspath(args.work_dir)
+    if not os.path.isdir(work_dir):
+        os.makedirs(work_dir)
+
+    alloc_counter = None
+    if not args.no_allocs:
+        alloc_counter = build_alloc_counter(work_dir)
+        if not alloc_counter:
+            print('not counting allocations on this system')
+
+    all_results = {}
+    for edges in [int(s) for s in args.scales.split(',')]:
+        for layout in args.layouts.split(','):
+            if layout not in ('flat', 'chdir'):
+                sys.exit('unknown layout %r' % layout)
+            name = '%d-%s' % (edges, layout)
+            build_dir = os.path.join(work_dir, name)
+            generate(build_dir, edges, layout == 'chdir')
+            all_results[name] = benchmark(ninja, build_dir, args,
+                                          alloc_counter)
+            report(name, all_results[name])
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(all_results, f, indent=2, sort_keys=True)
+
+
+if __name__ == '__main__':
+    main()
@@ -5,6 +5,7 @@
 In order to simulate a smart terminal it uses the 'script' command.
 """
 
+import json
 import os
 import platform
 import subprocess
@@ -99,5 +100,55 @@ red
 \x1b[31mred\x1b[0m
 ''')
 
+    def test_query_from_stdin(self):
+        build_ninja = '''rule cat
+  command = cat $in > $out
+
+build out: cat in | dep || order
+build final: cat out
+'''
+        def query(flags, targets):
+            with tempfile.NamedTemporaryFile('w') as f:
+                f.write(build_ninja)
+                f.flush()
+                proc = subprocess.Popen(
+                    './ninja -f {} -t query {}'.format(f.name, flags),
+                    shell=True, env=default_env, stdin=subprocess.PIPE,
+                    stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+                out, err = proc.communicate(targets.encode('utf-8'))
+            return proc.returncode, out.decode('utf-8'), err.decode('utf-8')
+
+        # An unknown target is reported without ending the session, but
+        # fails it in the end.  Its name, with a tab in it, is escaped.
+        status, out, err = query('-j -i', 'out\nx\tunknown_target_name\nin\n')
+        self.assertEqual(status, 1)
+        self.assertEqual([json.loads(line) for line in out.splitlines()], [
+            {'target': 'out',
+             'input': {'rule': 'cat', 'explicit': ['in'],
+                       'implicit': ['dep'], 'order_only': ['order']},
+             'outputs': ['final']},
+            {'target': 'x\tunknown_target_name',
+             'error': "unknown target 'x\tunknown_target_name'"},
+            {'target': 'in', 'outputs': ['out']},
+        ])
+        self.assertEqual(err, '')
+
+        status, out, err = query('-i', 'in\r\n\nunknown_target_name\n')
+        self.assertEqual(status, 1)
+        self.assertEqual(out, '''in:
+  outputs:
+    out
+''')
+        self.assertEqual(
+            err, "ninja: error: unknown target 'unknown_target_name'\n")
+
+        status, out, err = query('-j final', '')
+        self.assertEqual(status, 0)
+        self.assertEqual(json.loads(out), {
+            'target': 'final',
+            'input': {'rule': 'cat', 'explicit': ['out'], 'implicit': [],
+                      'order_only': []},
+            'outputs': []})
+
 if __name__ == '__main__':
     unittest.main()
@@ -8,6 +8,12 @@ ones used in the Chromium project.
 Usage:
   python misc/write_fake_manifests.py outdir  # Will run for about 5s.
 
+With --fake-commands the manifests can be built without a compiler: each
+command just touches its outputs, and compiles write a depfile naming the
+headers the sources would include, so builds also fill in a deps log.
+With --chdir every target gets a directory of its own that its subninja
+is loaded into with 'chdir'.
+
 The program contains a hardcoded random seed, so it will generate the same
 output every time it runs.  By changing the seed, it's easy to generate many
 different sets of manifest files.
@@ -65,7 +71,7 @@ class GenRandom(object):
     def _n_unique_strings(self, n):
         seen = set([None])
         return [self._unique_string(seen, avg_options=3, p_suffix=0.4)
-                for _ in xrange(n)]
+                for _ in range(n)]
 
     def target_name(self):
         return self._unique_string(p_suffix=0, seen=self.seen_names)
@@ -73,7 +79,7 @@ class GenRandom(object):
     def path(self):
         return os.path.sep.join([
             self._unique_string(self.seen_names, avg_options=1, p_suffix=0)
-            for _ in xrange(1 + paretoint(0.6, alpha=4))])
+            for _ in range(1 + paretoint(0.6, alpha=4))])
 
     def src_obj_pairs(self, path, name):
         num_sources = paretoint(55, alpha=2) + 1
@@ -84,14 +90,16 @@ class GenRandom(object):
     def defines(self):
         return [
             '-DENABLE_' + self._unique_string(self.seen_defines).upper()
-            for _ in xrange(paretoint(20, alpha=3))]
+            for _ in range(paretoint(20, alpha=3))]
 
 
 LIB, EXE = 0, 1
 class Target(object):
-    def __init__(self, gen, kind):
+    def __init__(self, gen, kind, chdir=False):
         self.name = gen.target_name()
         self.dir_path = gen.path()
+        # Paths in a chdir'd subninja are relative to its directory.
+        self.chdir = os.path.join('chdir', self.name) if chdir else None
         self.ninja_file_path = os.path.join(
             'obj', self.dir_path, self.name + '.ninja')
         self.src_obj_pairs = gen.src_obj_pairs(self.dir_path, self.name)
@@ -104,8 +112,25 @@ class Target(object):
         self.kind = kind
         self.has_compile_depends = random.random() < 0.4
 
+    def path_from(self, other, path):
+        """Returns |path|, relative to this target's directory, as seen from
+        the manifest of |other|, or from the top level if that's None."""
+        if self.chdir is None:
+            return path
+        if other is None:
+            return os.path.join(self.chdir, path)
+        return os.path.join('..', self.name, path)
+
+    def headers(self):
+        return [os.path.splitext(src)[0] + '.h'
+                for src, _ in self.src_obj_pairs]
+
+
+def write_target_ninja(ninja, target, src_dir, fake_commands=False):
+    if target.chdir:
+        ninja.include(os.path.join('..', '..', 'rules.ninja'))
+        ninja.newline()
 
-def write_target_ninja(ninja, target, src_dir):
     compile_depends = None
     if target.has_compile_depends:
       compile_depends = os.path.join(
@@ -116,14 +141,22 @@ def write_target_ninja(ninja, target, src_dir):
     ninja.variable('defines', target.defines)
     ninja.variable('includes', '-I' + src_dir)
     ninja.variable('cflags', ['-Wall', '-fno-rtti', '-fno-exceptions'])
+    if fake_commands:
+        # What the depfiles list: the target's own headers and one of each
+        # dependency's, bounded to keep command lines reasonable.
+        headers = target.headers()
+        for dep in target.deps[:100]:
+            headers.append(dep.path_from(target, dep.headers()[0]))
+        ninja.variable('headers', headers)
     ninja.newline()
 
     for src, obj in target.src_obj_pairs:
         ninja.build(obj, 'cxx', src, implicit=compile_depends)
     ninja.newline()
 
-    deps = [dep.output for dep in target.deps]
-    libs = [dep.output for dep in target.deps if dep.kind == LIB]
+    deps = [dep.path_from(target, dep.output) for dep in target.deps]
+    libs = [dep.path_from(target, dep.output)
+            for dep in target.deps if dep.kind == LIB]
     if target.kind == EXE:
         ninja.variable('libs', libs)
         if sys.platform == "darwin":
@@ -133,7 +166,21 @@ def write_target_ninja(ninja, target, src_dir):
                 implicit=deps)
 
 
-def write_sources(target, root_dir):
+def write_sources(target, root_dir, fake_commands=False):
+    if target.chdir:
+        root_dir = os.path.join(root_dir, target.chdir)
+    if fake_commands:
+        # Nothing reads them; they only need to exist.
+        for cc_filename, _ in target.src_obj_pairs:
+            cc_path = os.path.join(root_dir, cc_filename)
+            try:
+                os.makedirs(os.path.dirname(cc_path))
+            except OSError:
+                pass
+            open(cc_path, 'w').close()
+            open(os.path.splitext(cc_path)[0] + '.h', 'w').close()
+        return
+
     need_main = target.kind == EXE
 
     includes = []
@@ -174,43 +221,70 @@ def write_sources(target, root_dir):
                 f.write('int main(int argc, char **argv) {}\n')
                 need_main = False
 
-def write_master_ninja(master_ninja, targets):
+def write_master_ninja(master_ninja, targets, fake_commands=False):
     """Writes master build.ninja file, referencing all given subninjas."""
-    master_ninja.variable('cxx', 'c++')
-    master_ninja.variable('ld', '$cxx')
-    if sys.platform == 'darwin':
-        master_ninja.variable('alink', 'libtool -static')
-    else:
-        master_ninja.variable('alink', 'ar rcs')
-    master_ninja.newline()
-
     master_ninja.pool('link_pool', depth=4)
     master_ninja.newline()
 
-    master_ninja.rule('cxx', description='CXX $out',
-      command='$cxx -MMD -MF $out.d $defines $includes $cflags -c $in -o $out',
-      depfile='$out.d', deps='gcc')
-    master_ninja.rule('alink', description='ARCHIVE $out',
-      command='rm -f $out && $alink -o $out $in')
-    master_ninja.rule('link', description='LINK $out', pool='link_pool',
-      command='$ld $ldflags -o $out $in $libs')
-    master_ninja.rule('stamp', description='STAMP $out', command='touch $out')
-    master_ninja.newline()
+    # A chdir'd subninja doesn't see the rules of its parent, so they are
+    # shared through a file of their own instead.
+    if any(target.chdir for target in targets):
+        master_ninja.include('rules.ninja')
+        master_ninja.newline()
+    else:
+        write_rules(master_ninja, fake_commands)
 
     for target in targets:
         master_ninja.subninja(target.ninja_file_path)
+        if target.chdir:
+            master_ninja.variable('chdir', target.chdir, indent=1)
     master_ninja.newline()
 
     master_ninja.comment('Short names for targets.')
     for target in targets:
         if target.name != target.output:
-            master_ninja.build(target.name, 'phony', target.output)
+            master_ninja.build(target.name, 'phony',
+                               target.path_from(None, target.output))
     master_ninja.newline()
 
-    master_ninja.build('all', 'phony', [target.output for target in targets])
+    master_ninja.build('all', 'phony',
+                       [target.path_from(None, target.output)
+                        for target in targets])
     master_ninja.default('all')
 
 
+def write_rules(ninja, fake_commands=False):
+    if fake_commands:
+        ninja.rule('cxx', description='CXX $out',
+          command='printf \'%s: %s %s\\n\' $out $in "$headers" > $out.d && '
+                  'touch $out',
+          depfile='$out.d', deps='gcc')
+        ninja.rule('alink', description='ARCHIVE $out', command='touch $out')
+        ninja.rule('link', description='LINK $out', pool='link_pool',
+          command='touch $out')
+        ninja.rule('stamp', description='STAMP $out', command='touch $out')
+        ninja.newline()
+        return
+
+    ninja.variable('cxx', 'c++')
+    ninja.variable('ld', '$cxx')
+    if sys.platform == 'darwin':
+        ninja.variable('alink', 'libtool -static')
+    else:
+        ninja.variable('alink', 'ar rcs')
+    ninja.newline()
+
+    ninja.rule('cxx', description='CXX $out',
+      command='$cxx -MMD -MF $out.d $defines $includes $cflags -c $in -o $out',
+      depfile='$out.d', deps='gcc')
+    ninja.rule('alink', description='ARCHIVE $out',
+      command='rm -f $out && $alink -o $out $in')
+    ninja.rule('link', description='LINK $out', pool='link_pool',
+      command='$ld $ldflags -o $out $in $libs')
+    ninja.rule('stamp', description='STAMP $out', command='touch $out')
+    ninja.newline()
+
+
 @contextlib.contextmanager
 def FileWriter(path):
     """Context manager for a ninja_syntax object writing to a file."""
@@ -223,15 +297,15 @@ def FileWriter(path):
     f.close()
 
 
-def random_targets(num_targets, src_dir):
+def random_targets(num_targets, src_dir, chdir=False):
     gen = GenRandom(src_dir)
 
     # N-1 static libraries, and 1 executable depending on all of them.
-    targets = [Target(gen, LIB) for i in xrange(num_targets - 1)]
+    targets = [Target(gen, LIB, chdir) for i in range(num_targets - 1)]
     for i in range(len(targets)):
         targets[i].deps = [t for t in targets[0:i] if random.random() < 0.05]
 
-    last_target = Target(gen, EXE)
+    last_target = Target(gen, EXE, chdir)
     last_target.deps = targets[:]
     last_target.src_obj_pairs = last_target.src_obj_pairs[0:10]  # Trim.
     targets.append(last_target)
@@ -246,26 +320,36 @@ def main():
                         help='number of targets (default: 1500)')
     parser.add_argument('-S', '--seed', type=int, help='random seed',
                         default=12345)
+    parser.add_argument('--fake-commands', action='store_true',
+                        help='run commands that only touch their outputs '
+                        '(implies writing empty sources)')
+    parser.add_argument('--chdir', action='store_true',
+                        help='load each target\'s subninja with chdir')
     parser.add_argument('outdir', help='output directory')
     args = parser.parse_args()
     root_dir = args.outdir
 
     random.seed(args.seed)
 
-    do_write_sources = args.sources is not None
-    src_dir = args.sources if do_write_sources else "src"
+    do_write_sources = args.sources is not None or args.fake_commands
+    src_dir = args.sources if args.sources is not None else "src"
 
-    targets = random_targets(args.targets, src_dir)
+    targets = random_targets(args.targets, src_dir, args.chdir)
     for target in targets:
-        with FileWriter(os.path.join(root_dir, target.ninja_file_path)) as n:
-            write_target_ninja(n, target, src_dir)
+        target_dir = os.path.join(root_dir, target.chdir or '')
+        with FileWriter(os.path.join(target_dir, target.ninja_file_path)) as n:
+            write_target_ninja(n, target, src_dir, args.fake_commands)
 
         if do_write_sources:
-            write_sources(target, root_dir)
+            write_sources(target, root_dir, args.fake_commands)
+
+    if args.chdir:
+        with FileWriter(os.path.join(root_dir, 'rules.ninja')) as n:
+            write_rules(n, args.fake_commands)
 
     with FileWriter(os.path.join(root_dir, 'build.ninja')) as master_ninja:
         master_ninja.width = 120
-        write_master_ninja(master_ninja, targets)
+        write_master_ninja(master_ninja, targets, args.fake_commands)
 
 
 if __name__ == '__main__':
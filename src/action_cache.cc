@@ -0,0 +1,443 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "action_cache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <set>
+
+#include "build_log.h"
+#include "digest_log.h"
+#include "graph.h"
+#include "metrics.h"
+
+namespace {
+
+string Hex(uint64_t value) {
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016" PRIx64, value);
+  return buf;
+}
+
+string Hex(const Hash128& value) {
+  return Hex(value.high) + Hex(value.low);
+}
+
+/// Write |contents| to |path| as they are, with the permissions of |mode_of|
+/// if that's given and exists.
+bool WriteBinaryFile(const string& path, const string& contents,
+                     const string* mode_of, string* err) {
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) {
+    *err = "writing " + path + ": " + strerror(errno);
+    return false;
+  }
+  bool written =
+      fwrite(contents.data(), 1, contents.size(), f) == contents.size();
+  if (fclose(f) < 0 || !written) {
+    *err = "writing " + path + ": " + strerror(errno);
+    return false;
+  }
+#ifndef _WIN32
+  // Linked outputs have to stay executable.
+  struct stat st;
+  if (mode_of && stat(mode_of->c_str(), &st) == 0)
+    chmod(path.c_str(), st.st_mode & 07777);
+#endif
+  return true;
+}
+
+/// The inputs of |edge| the outputs depend on.
+size_t DependedOnInputs(const Edge* edge) {
+  return edge->inputs_.size() - edge->order_only_deps_;
+}
+
+/// How many runs of an edge with the same explicit inputs are remembered.
+const size_t kMaxRuns = 16;
+
+/// Split an inputs file into its records of runs, which end in a blank line.
+vector<string> SplitRecords(const string& records) {
+  vector<string> runs;
+  for (size_t start = 0, end; start < records.size(); start = end + 2) {
+    end = records.find("\n\n", start);
+    if (end == string::npos)
+      break;  // Cut short.
+    runs.push_back(records.substr(start, end + 1 - start));
+  }
+  return runs;
+}
+
+/// Whether every input named in |record| still has the digest it had, and
+/// every input |edge| is known to have now is named.
+bool Matches(const string& record, const Edge* edge, DigestLog* digests,
+             DiskInterface* disk) {
+  set<string> named;
+  for (size_t start = 0, end; start < record.size(); start = end + 1) {
+    end = record.find('\n', start);
+    size_t tab = record.find('\t', start);
+    if (end == string::npos || tab == string::npos || tab > end)
+      return false;
+    string path = record.substr(tab + 1, end - tab - 1);
+    uint64_t digest;
+    if (!digests->FileDigest(path, disk, &digest) ||
+        Hex(digest) != record.substr(start, tab - start))
+      return false;
+    named.insert(path);
+  }
+  for (size_t i = 0; i < DependedOnInputs(edge); ++i) {
+    if (!named.count(edge->inputs_[i]->path()))
+      return false;
+  }
+  return true;
+}
+
+}  // anonymous namespace
+
+// static
+bool ActionCache::Cacheable(const Edge* edge) {
+  return !edge->is_phony() && edge->GetBindingBool("hash_inputs") &&
+      !edge->GetBindingBool("generator") &&
+      (edge->GetBinding("depfile").empty() ||
+       !edge->GetBinding("deps").empty());
+}
+
+bool ActionCache::Restore(const Edge* edge, DigestLog* digests,
+                          DiskInterface* disk, string* output,
+                          vector<string>* deps, LazyDiskInterface* lazy) {
+  METRIC_RECORD("action cache restore");
+  Hash128 key;
+  if (!InputsKey(edge, digests, disk, &key))
+    return false;
+  string records, err;
+  if (::ReadFile(PathFor(key, ".inputs"), &records, &err) < 0)
+    return false;
+  vector<string> runs = SplitRecords(records);
+  vector<string>::iterator run = runs.begin();
+  while (run != runs.end() && !Matches(*run, edge, digests, disk))
+    ++run;
+  if (run == runs.end())
+    return false;
+
+  CommandHasher hasher;
+  hasher.Update(Hex(key));
+  hasher.Update(*run);
+  string entry = PathFor(hasher.Finish128(), "");
+  string deps_list;
+  if (::ReadFile(entry + "/output", output, &err) < 0 ||
+      ::ReadFile(entry + "/deps", &deps_list, &err) < 0)
+    return false;
+  // A promised output is as new as the newest input, so that neither it
+  // nor what depends on it looks out of date.
+  TimeStamp newest_input = 1;
+  for (size_t i = 0; lazy && i < DependedOnInputs(edge); ++i)
+    newest_input = max(newest_input, edge->inputs_[i]->mtime());
+  for (size_t i = 0; i < edge->outputs_.size(); ++i) {
+    const string& path = edge->outputs_[i]->path();
+    string cached = entry + "/" + Hex(i), contents;
+    if (lazy) {
+      FileIdentity id;
+      uint64_t digest;
+      if (!cache_disk_.Identify(cached, &id) ||
+          !digests->FileDigest(cached, &cache_disk_, &digest))
+        return false;
+      id.device = id.inode = 0;
+      id.mtime = newest_input;
+      if (!lazy->Promise(path, cached, id, digest, &err)) {
+        Warning("action cache: %s", err.c_str());
+        return false;
+      }
+      continue;
+    }
+    if (::ReadFile(cached, &contents, &err) < 0 ||
+        !WriteBinaryFile(path, contents, &cached, &err)) {
+      // Outputs restored so far get written again by the command.
+      return false;
+    }
+    disk->Invalidate(path);
+  }
+
+  deps->clear();
+  for (size_t start = 0, end; start < deps_list.size(); start = end + 1) {
+    end = deps_list.find('\n', start);
+    if (end == string::npos)
+      end = deps_list.size();
+    deps->push_back(deps_list.substr(start, end - start));
+  }
+  return true;
+}
+
+bool ActionCache::Store(const Edge* edge, const string& output,
+                        const vector<Node*>& deps, DigestLog* digests,
+                        DiskInterface* disk, string* err) {
+  METRIC_RECORD("action cache store");
+  Hash128 key;
+  if (!InputsKey(edge, digests, disk, &key))
+    return true;  // Nothing to key it on, so nothing to store.
+
+  vector<Node*> inputs(edge->inputs_.begin(),
+                       edge->inputs_.begin() + DependedOnInputs(edge));
+  inputs.insert(inputs.end(), deps.begin(), deps.end());
+  set<string> seen;
+  string record;
+  for (vector<Node*>::iterator i = inputs.begin(); i != inputs.end(); ++i) {
+    const string& path = (*i)->path();
+    if (!seen.insert(path).second)
+      continue;
+    uint64_t digest;
+    if (!digests->FileDigest(path, disk, &digest))
+      return true;  // An input went away, so the run can't be described.
+    record += Hex(digest) + "\t" + path + "\n";
+  }
+  if (record.empty())
+    return true;  // Without inputs there's nothing to tell runs apart.
+
+  if (!cache_disk_.MakeDirs(dir_ + "/."))
+    return false;
+
+  CommandHasher hasher;
+  hasher.Update(Hex(key));
+  hasher.Update(record);
+  Hash128 entry_key = hasher.Finish128();
+  string entry = PathFor(entry_key, "");
+  string ignored;
+  if (cache_disk_.Stat(entry + "/output", &ignored) <= 0) {
+    // Fill a directory of our own and move it in place in one go, so that
+    // builds looking the entry up never see half of it.
+#ifdef _WIN32
+    int pid = _getpid();
+#else
+    int pid = getpid();
+#endif
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".tmp%d", pid);
+    string temp = entry + suffix;
+    string deps_list;
+    for (vector<Node*>::const_iterator d = deps.begin(); d != deps.end(); ++d)
+      deps_list += (d == deps.begin() ? "" : "\n") + (*d)->path();
+    bool written = cache_disk_.MakeDir(temp) &&
+        WriteBinaryFile(temp + "/output", output, NULL, err) &&
+        WriteBinaryFile(temp + "/deps", deps_list, NULL, err);
+    for (size_t i = 0; written && i < edge->outputs_.size(); ++i) {
+      const string& path = edge->outputs_[i]->path();
+      string contents;
+      written = ::ReadFile(path, &contents, err) >= 0 &&
+          WriteBinaryFile(temp + "/" + Hex(i), contents, &path, err);
+    }
+    if (!written || rename(temp.c_str(), entry.c_str()) < 0) {
+      // Another build may have stored the same entry meanwhile.
+      bool raced = written && cache_disk_.Stat(entry + "/output", &ignored) > 0;
+      if (written && !raced)
+        *err = "storing " + entry + ": " + strerror(errno);
+      cache_disk_.RemoveFile(temp + "/output");
+      cache_disk_.RemoveFile(temp + "/deps");
+      for (size_t i = 0; i < edge->outputs_.size(); ++i)
+        cache_disk_.RemoveFile(temp + "/" + Hex(i));
+#ifdef _WIN32
+      _rmdir(temp.c_str());
+#else
+      rmdir(temp.c_str());
+#endif
+      if (!raced)
+        return false;
+    }
+  }
+
+  // Keep the runs recorded before, so that builds going back and forth
+  // between versions of a header keep hitting.
+  string record_path = PathFor(key, ".inputs");
+  string records = record + "\n", old_records, ignored_err;
+  if (::ReadFile(record_path, &old_records, &ignored_err) == 0) {
+    vector<string> runs = SplitRecords(old_records);
+    for (size_t i = 0; i < runs.size() && i + 1 < kMaxRuns; ++i) {
+      if (runs[i] != record)
+        records += runs[i] + "\n";
+    }
+  }
+  string temp = record_path + ".tmp";
+  if (!WriteBinaryFile(temp, records, NULL, err))
+    return false;
+#ifdef _WIN32
+  unlink(record_path.c_str());
+#endif
+  if (rename(temp.c_str(), record_path.c_str()) < 0) {
+    *err = "storing " + record_path + ": " + strerror(errno);
+    unlink(temp.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool ActionCache::InputsKey(const Edge* edge, DigestLog* digests,
+                            DiskInterface* disk, Hash128* key) {
+  CommandHasher hasher;
+  hasher.Update(Hex(edge->CommandHash()) + "\n");
+  for (vector<Node*>::const_iterator o = edge->outputs_.begin();
+       o != edge->outputs_.end(); ++o)
+    hasher.Update("out\t" + (*o)->path() + "\n");
+  size_t explicit_count =
+      edge->inputs_.size() - edge->implicit_deps_ - edge->order_only_deps_;
+  for (size_t i = 0; i < explicit_count; ++i) {
+    const string& path = edge->inputs_[i]->path();
+    uint64_t digest;
+    if (!digests->FileDigest(path, disk, &digest))
+      return false;
+    hasher.Update("in\t" + Hex(digest) + "\t" + path + "\n");
+  }
+  *key = hasher.Finish128();
+  return true;
+}
+
+string ActionCache::PathFor(const Hash128& key, const char* suffix) const {
+  return dir_ + "/" + Hex(key) + suffix;
+}
+
+bool LazyDiskInterface::Promise(const string& path, const string& source,
+                                const FileIdentity& id, uint64_t digest,
+                                string* err) {
+  if (disk_->RemoveFile(path) < 0) {
+    *err = "removing " + path + " for its promise";
+    return false;
+  }
+  if (!digests_->RecordLazy(path, source, id, digest)) {
+    *err = string("writing to digest log: ") + strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool LazyDiskInterface::Materialize(const string& path, string* err) {
+  string source;
+  FileIdentity id;
+  if (!LookupPromise(path, &source, &id))
+    return true;
+  string ignored;
+  if (disk_->Stat(path, &ignored) > 0) {
+    Forget(path);
+    return true;
+  }
+  METRIC_RECORD("action cache materialize");
+  string contents;
+  if (!disk_->MakeDirs(path) ||
+      ::ReadFile(source, &contents, err) < 0 ||
+      !WriteBinaryFile(path, contents, &source, err)) {
+    *err = "materializing " + path + ": " + *err;
+    return false;
+  }
+  disk_->Invalidate(path);
+  Forget(path);
+  return true;
+}
+
+void LazyDiskInterface::Forget(const string& path) {
+  if (!digests_->ForgetLazy(path))
+    Warning("writing to digest log: %s", strerror(errno));
+}
+
+bool LazyDiskInterface::LookupPromise(const string& path, string* source,
+                                      FileIdentity* id) const {
+  if (!digests_->LookupLazy(path, source, id))
+    return false;
+  string err;
+  return cache_disk_.Stat(*source, &err) > 0;
+}
+
+TimeStamp LazyDiskInterface::Stat(const string& path, string* err) const {
+  TimeStamp mtime = disk_->Stat(path, err);
+  string source;
+  FileIdentity id;
+  if (mtime == 0 && LookupPromise(path, &source, &id))
+    return id.mtime;
+  return mtime;
+}
+
+void LazyDiskInterface::StatMany(const vector<const string*>& paths,
+                                 vector<TimeStamp>* mtimes) const {
+  disk_->StatMany(paths, mtimes);
+  string source;
+  FileIdentity id;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if ((*mtimes)[i] == 0 && LookupPromise(*paths[i], &source, &id))
+      (*mtimes)[i] = id.mtime;
+  }
+}
+
+bool LazyDiskInterface::MakeDir(const string& path) {
+  return disk_->MakeDir(path);
+}
+
+bool LazyDiskInterface::WriteFile(const string& path,
+                                  const string& contents) {
+  Forget(path);
+  return disk_->WriteFile(path, contents);
+}
+
+FileReader::Status LazyDiskInterface::ReadFile(const string& path,
+                                               string* contents,
+                                               string* err) {
+  if (!Materialize(path, err))
+    return OtherError;
+  return disk_->ReadFile(path, contents, err);
+}
+
+FileReader::Status LazyDiskInterface::ReadFileTerminated(const string& path,
+                                                         MappedFile* file,
+                                                         string* err) {
+  if (!Materialize(path, err))
+    return OtherError;
+  return disk_->ReadFileTerminated(path, file, err);
+}
+
+FileReader::Status LazyDiskInterface::Chdir(const string& path, string* err) {
+  return disk_->Chdir(path, err);
+}
+
+FileReader::Status LazyDiskInterface::Getcwd(string* path, string* err) {
+  return disk_->Getcwd(path, err);
+}
+
+int LazyDiskInterface::RemoveFile(const string& path) {
+  string source;
+  FileIdentity id;
+  bool promised = LookupPromise(path, &source, &id);
+  Forget(path);
+  int status = disk_->RemoveFile(path);
+  return promised && status == 1 ? 0 : status;
+}
+
+int LazyDiskInterface::RemoveEmptyDir(const string& path) {
+  return disk_->RemoveEmptyDir(path);
+}
+
+void LazyDiskInterface::Invalidate(const string& path) {
+  disk_->Invalidate(path);
+}
+
+bool LazyDiskInterface::Identify(const string& path, FileIdentity* id) const {
+  if (disk_->Identify(path, id))
+    return true;
+  string source, err;
+  return disk_->Stat(path, &err) == 0 && LookupPromise(path, &source, id);
+}
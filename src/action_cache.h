@@ -0,0 +1,141 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_ACTION_CACHE_H_
+#define NINJA_ACTION_CACHE_H_
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "disk_interface.h"
+#include "hash_map.h"
+#include "util.h"  // uint64_t
+
+struct DigestLog;
+struct Edge;
+struct LazyDiskInterface;
+struct Node;
+
+/// A cache of the outputs of commands, kept in a directory that other
+/// builds, of this tree or of copies of it elsewhere, can share.  An edge
+/// whose command and inputs are the same as those of an earlier run gets
+/// its outputs copied from the cache instead of running.
+///
+/// Only edges whose inputs are hashed ("hash_inputs = 1") are cached, and
+/// of those only the ones that either discover no dependencies or have
+/// Ninja record them ("deps"): the others don't say what they read.
+///
+/// Since the dependencies an edge discovers are only known once it ran,
+/// looking it up takes two steps.  The command, the outputs and the
+/// explicit inputs with their contents make the key of the records of the
+/// last runs, each listing every input of the run and its digest.  If all
+/// of those still match for one run, they make the key of the entry that
+/// holds its outputs.  Cache layout:
+///   <key>.inputs   lines of "<digest>\t<path>", a blank line after each run
+///   <key>/output   what the command printed
+///   <key>/deps     the dependencies it discovered, one per line
+///   <key>/<n>      the n-th output of the edge
+struct ActionCache {
+  explicit ActionCache(const string& dir) : dir_(dir) {}
+
+  const string& dir() const { return dir_; }
+
+  /// Whether |edge| can be cached at all.
+  static bool Cacheable(const Edge* edge);
+
+  /// Write the outputs of |edge| from the cache, if it has them, filling
+  /// |output| with what the command printed and |deps| with the paths of
+  /// the dependencies it discovered.  Returns false on a miss.  With |lazy|
+  /// the outputs are only promised to it, to be written once needed.
+  bool Restore(const Edge* edge, DigestLog* digests, DiskInterface* disk,
+               string* output, vector<string>* deps,
+               LazyDiskInterface* lazy = NULL);
+
+  /// Add the outputs of |edge|, which just ran successfully, printing |output|
+  /// and discovering |deps|.  Returns false, filling |err|, if the cache
+  /// can't be written to.
+  bool Store(const Edge* edge, const string& output, const vector<Node*>& deps,
+             DigestLog* digests, DiskInterface* disk, string* err);
+
+ private:
+  /// Compute the key of the inputs record of |edge|.
+  bool InputsKey(const Edge* edge, DigestLog* digests, DiskInterface* disk,
+                 Hash128* key);
+
+  string PathFor(const Hash128& key, const char* suffix) const;
+
+  /// Where the cache itself is: always on disk, even when the build runs
+  /// against another DiskInterface.
+  RealDiskInterface cache_disk_;
+  string dir_;
+};
+
+/// A DiskInterface that takes the outputs the action cache promised it to
+/// be there already, with the contents of the cache's copy, and only
+/// writes them out when something reads them: an edge that runs, or the
+/// user asking for the file.  An output only the next edge reads, or that
+/// nothing does when the edge after it is a cache hit too, is never copied.
+///
+/// The promises are kept in the digest log, so that later builds see them,
+/// along with the identity and digest of the contents they stand for: the
+/// action cache keys edges on the digests of their inputs without reading
+/// them.  A file on disk always wins over a promise, and a promise whose
+/// cache copy went away is forgotten, which makes the output missing.
+///
+/// The promises are only used from one thread, so AllowsConcurrentAccess()
+/// is false whatever the wrapped interface says.
+struct LazyDiskInterface : public DiskInterface {
+  LazyDiskInterface(DiskInterface* disk, DigestLog* digests)
+      : disk_(disk), digests_(digests) {}
+
+  /// Take |path| to have the contents of the cache file |source|, with
+  /// digest |digest| and identity |id|, removing whatever is on disk now.
+  bool Promise(const string& path, const string& source,
+               const FileIdentity& id, uint64_t digest, string* err);
+
+  /// Write out |path| if it is a promise.
+  bool Materialize(const string& path, string* err);
+
+  /// Forget the promise of |path|, which something else now writes.
+  void Forget(const string& path);
+
+  // DiskInterface
+  virtual TimeStamp Stat(const string& path, string* err) const;
+  virtual void StatMany(const vector<const string*>& paths,
+                        vector<TimeStamp>* mtimes) const;
+  virtual bool MakeDir(const string& path);
+  virtual bool WriteFile(const string& path, const string& contents);
+  virtual Status ReadFile(const string& path, string* contents, string* err);
+  virtual Status ReadFileTerminated(const string& path, MappedFile* file,
+                                    string* err);
+  virtual Status Chdir(const string& path, string* err);
+  virtual Status Getcwd(string* path, string* err);
+  virtual int RemoveFile(const string& path);
+  virtual int RemoveEmptyDir(const string& path);
+  virtual void Invalidate(const string& path);
+  virtual bool Identify(const string& path, FileIdentity* id) const;
+
+ private:
+  /// Whether |path| is a promise whose cache copy is still there, filling
+  /// |source| and |id| if so.
+  bool LookupPromise(const string& path, string* source,
+                     FileIdentity* id) const;
+
+  DiskInterface* disk_;
+  DigestLog* digests_;
+  RealDiskInterface cache_disk_;
+};
+
+#endif  // NINJA_ACTION_CACHE_H_
@@ -0,0 +1,215 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "action_cache.h"
+
+#include "digest_log.h"
+#include "graph.h"
+#include "state.h"
+#include "test.h"
+
+namespace {
+
+struct ActionCacheTest : public StateTestWithBuiltinRules {
+  ActionCacheTest() : cache_("cache") {}
+
+  virtual void SetUp() {
+    // These tests do real disk accesses, so create a temp dir.
+    temp_dir_.CreateAndEnter("Ninja-ActionCacheTest");
+  }
+
+  virtual void TearDown() {
+    temp_dir_.Cleanup();
+  }
+
+  Edge* AddEdge(const char* manifest) {
+    AssertParse(&state_, manifest);
+    return state_.edges_.back();
+  }
+
+  string Contents(const string& path) {
+    string contents, err;
+    EXPECT_EQ(0, ReadFile(path, &contents, &err));
+    return contents;
+  }
+
+  ScopedTempDir temp_dir_;
+  RealDiskInterface disk_;
+  ActionCache cache_;
+};
+
+TEST_F(ActionCacheTest, Cacheable) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"rule hashed\n"
+"  command = cc $in -o $out\n"
+"  hash_inputs = 1\n"
+"rule hashed_depfile\n"
+"  command = cc $in -o $out\n"
+"  hash_inputs = 1\n"
+"  depfile = $out.d\n"
+"rule hashed_deps\n"
+"  command = cc $in -o $out\n"
+"  hash_inputs = 1\n"
+"  depfile = $out.d\n"
+"  deps = gcc\n"
+"rule hashed_generator\n"
+"  command = cc $in -o $out\n"
+"  hash_inputs = 1\n"
+"  generator = 1\n"
+"build a: hashed in\n"
+"build b: cat in\n"
+"build c: hashed_depfile in\n"
+"build d: hashed_deps in\n"
+"build e: hashed_generator in\n"
+"build f: phony in\n"));
+  EXPECT_TRUE(ActionCache::Cacheable(GetNode("a")->in_edge()));
+  EXPECT_FALSE(ActionCache::Cacheable(GetNode("b")->in_edge()));
+  // A depfile that Ninja doesn't read leaves the inputs unknown.
+  EXPECT_FALSE(ActionCache::Cacheable(GetNode("c")->in_edge()));
+  EXPECT_TRUE(ActionCache::Cacheable(GetNode("d")->in_edge()));
+  EXPECT_FALSE(ActionCache::Cacheable(GetNode("e")->in_edge()));
+  EXPECT_FALSE(ActionCache::Cacheable(GetNode("f")->in_edge()));
+}
+
+TEST_F(ActionCacheTest, StoreRestore) {
+  Edge* edge = AddEdge(
+"rule hashed\n"
+"  command = cc $in -o $out\n"
+"  hash_inputs = 1\n"
+"build out1 out2: hashed in || oo\n");
+  ASSERT_TRUE(disk_.WriteFile("in", "input"));
+  ASSERT_TRUE(disk_.WriteFile("out1", "first"));
+  ASSERT_TRUE(disk_.WriteFile("out2", "second"));
+
+  DigestLog digests;
+  string output;
+  vector<string> deps;
+  EXPECT_FALSE(cache_.Restore(edge, &digests, &disk_, &output, &deps));
+
+  string err;
+  ASSERT_TRUE(cache_.Store(edge, "warning\n", vector<Node*>(), &digests,
+                           &disk_, &err));
+  ASSERT_EQ("", err);
+
+  disk_.RemoveFile("out1");
+  disk_.RemoveFile("out2");
+  ASSERT_TRUE(cache_.Restore(edge, &digests, &disk_, &output, &deps));
+  EXPECT_EQ("warning\n", output);
+  EXPECT_TRUE(deps.empty());
+  EXPECT_EQ("first", Contents("out1"));
+  EXPECT_EQ("second", Contents("out2"));
+
+  // Other contents are another entry.
+  ASSERT_TRUE(disk_.WriteFile("in", "other input"));
+  EXPECT_FALSE(cache_.Restore(edge, &digests, &disk_, &output, &deps));
+
+  // And so is another command.
+  ASSERT_TRUE(disk_.WriteFile("in", "input"));
+  Edge* other = AddEdge(
+"rule hashed2\n"
+"  command = cc -O2 $in -o $out\n"
+"  hash_inputs = 1\n"
+"build out3 out4: hashed2 in\n");
+  EXPECT_FALSE(cache_.Restore(other, &digests, &disk_, &output, &deps));
+  EXPECT_TRUE(cache_.Restore(edge, &digests, &disk_, &output, &deps));
+}
+
+TEST_F(ActionCacheTest, DiscoveredDeps) {
+  Edge* edge = AddEdge(
+"rule hashed\n"
+"  command = cc $in -o $out\n"
+"  hash_inputs = 1\n"
+"  depfile = $out.d\n"
+"  deps = gcc\n"
+"build out: hashed in.c\n");
+  ASSERT_TRUE(disk_.WriteFile("in.c", "#include \"in.h\"\n"));
+  ASSERT_TRUE(disk_.WriteFile("in.h", "header"));
+  ASSERT_TRUE(disk_.WriteFile("out", "object"));
+
+  DigestLog digests;
+  string err;
+  vector<Node*> deps_nodes(1, state_.GetNode("in.h", &state_.bindings_, 0));
+  ASSERT_TRUE(cache_.Store(edge, "", deps_nodes, &digests, &disk_, &err));
+  ASSERT_EQ("", err);
+
+  string output;
+  vector<string> deps;
+  ASSERT_TRUE(cache_.Restore(edge, &digests, &disk_, &output, &deps));
+  ASSERT_EQ(1u, deps.size());
+  EXPECT_EQ("in.h", deps[0]);
+
+  // A change to the header alone misses too.
+  ASSERT_TRUE(disk_.WriteFile("in.h", "another header"));
+  EXPECT_FALSE(cache_.Restore(edge, &digests, &disk_, &output, &deps));
+
+  // Until that run is stored as well, next to the first one.
+  ASSERT_TRUE(disk_.WriteFile("out", "another object"));
+  ASSERT_TRUE(cache_.Store(edge, "", deps_nodes, &digests, &disk_, &err));
+  ASSERT_TRUE(disk_.WriteFile("out", ""));
+  ASSERT_TRUE(cache_.Restore(edge, &digests, &disk_, &output, &deps));
+  EXPECT_EQ("another object", Contents("out"));
+
+  // Going back to the first header finds the first run.
+  ASSERT_TRUE(disk_.WriteFile("in.h", "header"));
+  ASSERT_TRUE(cache_.Restore(edge, &digests, &disk_, &output, &deps));
+  EXPECT_EQ("object", Contents("out"));
+}
+
+TEST_F(ActionCacheTest, LazyRestore) {
+  Edge* edge = AddEdge(
+"rule hashed\n"
+"  command = cc $in -o $out\n"
+"  hash_inputs = 1\n"
+"build out1 out2: hashed in\n");
+  ASSERT_TRUE(disk_.WriteFile("in", "input"));
+  ASSERT_TRUE(disk_.WriteFile("out1", "first"));
+  ASSERT_TRUE(disk_.WriteFile("out2", "second"));
+  DigestLog digests;
+  string err;
+  ASSERT_TRUE(cache_.Store(edge, "", vector<Node*>(), &digests, &disk_,
+                           &err));
+  uint64_t first_digest;
+  ASSERT_TRUE(digests.FileDigest("out1", &disk_, &first_digest));
+
+  // The outputs are promised, not written: the old ones go away.
+  ASSERT_TRUE(disk_.WriteFile("out1", "stale"));
+  GetNode("in")->set_mtime(100);
+  LazyDiskInterface lazy(&disk_, &digests);
+  string output;
+  vector<string> deps;
+  ASSERT_TRUE(cache_.Restore(edge, &digests, &lazy, &output, &deps, &lazy));
+  EXPECT_EQ(0, disk_.Stat("out1", &err));
+  EXPECT_EQ(0, disk_.Stat("out2", &err));
+  EXPECT_EQ(100, lazy.Stat("out1", &err));
+
+  // Digests of promises come without reading them.
+  uint64_t digest;
+  ASSERT_TRUE(digests.FileDigest("out1", &lazy, &digest));
+  EXPECT_EQ(first_digest, digest);
+  EXPECT_EQ(0, disk_.Stat("out1", &err));
+
+  // Reading one writes it out.
+  string contents;
+  ASSERT_EQ(FileReader::Okay, lazy.ReadFile("out1", &contents, &err));
+  EXPECT_EQ("first", contents);
+  EXPECT_EQ("first", Contents("out1"));
+  ASSERT_TRUE(lazy.Materialize("out2", &err));
+  EXPECT_EQ("second", Contents("out2"));
+
+  // Once written out, the file is no longer promised.
+  disk_.RemoveFile("out1");
+  EXPECT_EQ(0, lazy.Stat("out1", &err));
+}
+
+}  // anonymous namespace
@@ -0,0 +1,124 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "affected.h"
+
+#include <algorithm>
+
+#include "deps_log.h"
+#include "graph.h"
+#include "state.h"
+#include "util.h"
+
+bool AffectedScanner::AddChanged(const string& path, string* err) {
+  string canonical = path;
+  uint64_t slash_bits;
+  if (!CanonicalizePath(&canonical, &slash_bits, err))
+    return false;
+  changed_.push_back(canonical);
+  return true;
+}
+
+bool AffectedScanner::AddChangedFrom(FILE* f, string* err) {
+  char buf[1024];
+  string line;
+  while (fgets(buf, sizeof(buf), f)) {
+    line += buf;
+    if (line[line.size() - 1] != '\n' && !feof(f))
+      continue;
+    while (!line.empty() &&
+           (line[line.size() - 1] == '\n' || line[line.size() - 1] == '\r'))
+      line.resize(line.size() - 1);
+    if (!line.empty() && !AddChanged(line, err))
+      return false;
+    line.clear();
+  }
+  return true;
+}
+
+void AffectedScanner::IndexReaders(vector<vector<Node*> >* readers) {
+  // This also creates the nodes of files that only the log mentions.
+  const vector<Node*>& log_nodes = deps_log_->nodes();
+  const vector<DepsLog::Deps*>& log_deps = deps_log_->deps();
+  readers->resize(log_nodes.size());
+  for (size_t id = 0; id < log_deps.size(); ++id) {
+    DepsLog::Deps* deps = log_deps[id];
+    if (!deps || !deps_log_->IsDepsEntryLiveFor(log_nodes[id]))
+      continue;
+    for (int i = 0; i < deps->node_count; ++i)
+      (*readers)[deps->nodes[i]->id()].push_back(log_nodes[id]);
+  }
+}
+
+bool AffectedScanner::Find(bool defaults_only, vector<string>* paths,
+                           string* err) {
+  vector<vector<Node*> > readers;
+  IndexReaders(&readers);
+
+  vector<Node*> queue;
+  for (vector<string>::iterator p = changed_.begin(); p != changed_.end();
+       ++p) {
+    Node* node = state_->LookupNode(*p);
+    if (!node) {
+      Warning("'%s' is not part of the build", p->c_str());
+      continue;
+    }
+    queue.push_back(node);
+  }
+
+  // Go through the edges that name a node as an input, and through the
+  // outputs that the deps log says read it.  Either way every output of
+  // the edge that reruns is affected.
+  while (!queue.empty()) {
+    Node* node = queue.back();
+    queue.pop_back();
+    vector<Edge*> edges = node->out_edges();
+    if (node->id() >= 0 && node->id() < (int)readers.size()) {
+      for (vector<Node*>::iterator r = readers[node->id()].begin();
+           r != readers[node->id()].end(); ++r) {
+        if ((*r)->in_edge())
+          edges.push_back((*r)->in_edge());
+      }
+    }
+    for (vector<Edge*>::iterator e = edges.begin(); e != edges.end(); ++e) {
+      if (!seen_edges_.insert(*e).second)
+        continue;
+      for (vector<Node*>::iterator o = (*e)->outputs_.begin();
+           o != (*e)->outputs_.end(); ++o) {
+        if (affected_.insert(*o).second)
+          queue.push_back(*o);
+      }
+    }
+  }
+
+  vector<Node*> targets;
+  if (defaults_only) {
+    vector<Node*> defaults = state_->DefaultNodes(err);
+    if (!err->empty())
+      return false;
+    for (vector<Node*>::iterator n = defaults.begin(); n != defaults.end();
+         ++n) {
+      if (affected_.count(*n))
+        targets.push_back(*n);
+    }
+  } else {
+    targets.assign(affected_.begin(), affected_.end());
+  }
+
+  paths->clear();
+  for (vector<Node*>::iterator n = targets.begin(); n != targets.end(); ++n)
+    paths->push_back((*n)->path());
+  sort(paths->begin(), paths->end());
+  return true;
+}
@@ -0,0 +1,68 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_AFFECTED_H_
+#define NINJA_AFFECTED_H_
+
+#include <stdio.h>
+
+#include <set>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct DepsLog;
+struct Edge;
+struct Node;
+struct State;
+
+/// Finds the outputs that changes to some files affect, for "-t affected":
+/// those of the edges that read a changed file, or another affected output,
+/// whether the manifest or the deps log says they do.
+///
+/// The deps log is the only record of which outputs read a header, so it is
+/// inverted up front, by node id, in a single pass over its records.  The
+/// walk then goes forward from all of the changed files at once.
+struct AffectedScanner {
+  AffectedScanner(DepsLog* deps_log, State* state)
+      : deps_log_(deps_log), state_(state) {}
+
+  /// Note that the file at |path| changed.  Returns false, filling |err|,
+  /// if |path| isn't a valid path.
+  bool AddChanged(const string& path, string* err);
+  /// Note that the files listed in |f|, one per line, changed.
+  bool AddChangedFrom(FILE* f, string* err);
+  bool empty() const { return changed_.empty(); }
+
+  /// Find the outputs that the changed files affect, or only the default
+  /// targets among them if |defaults_only|, and return their paths in
+  /// order.  Changed files the build doesn't know are warned about.
+  bool Find(bool defaults_only, vector<string>* paths, string* err);
+
+  /// Every output affected, once Find() is done.
+  const set<Node*>& affected() const { return affected_; }
+
+ private:
+  /// Outputs that the deps log says read each node, by node id.
+  void IndexReaders(vector<vector<Node*> >* readers);
+
+  DepsLog* deps_log_;
+  State* state_;
+  /// Canonical paths of the changed files.
+  vector<string> changed_;
+  set<Node*> affected_;
+  set<Edge*> seen_edges_;
+};
+
+#endif  // NINJA_AFFECTED_H_
@@ -0,0 +1,125 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "affected.h"
+
+#include "deps_log.h"
+#include "graph.h"
+#include "state.h"
+#include "test.h"
+
+namespace {
+
+struct AffectedScannerTest : public StateTestWithBuiltinRules {
+  virtual void SetUp() {
+    temp_dir_.CreateAndEnter("AffectedScannerTest");
+    ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"rule cc\n"
+"  command = cc $in -o $out\n"
+"  deps = gcc\n"
+"build a.o: cc a.c\n"
+"build b.o: cc b.c\n"
+"build app: cat a.o b.o\n"
+"build tool: cat b.o\n"
+"build other: cat other.c\n"
+"default app other\n"));
+    string err;
+    ASSERT_TRUE(deps_log_.OpenForWrite("ninja_deps", &err));
+    ASSERT_EQ("", err);
+  }
+  virtual void TearDown() {
+    deps_log_.Close();
+    temp_dir_.Cleanup();
+  }
+
+  /// Record in the deps log that |out| read |input|.
+  void RecordDep(const string& out, const string& input) {
+    vector<Node*> nodes(1, GetNode(input));
+    ASSERT_TRUE(deps_log_.RecordDeps(GetNode(out), 1, nodes));
+  }
+
+  /// The paths affected by a change to |path|, joined by spaces.
+  string Affected(const string& path, bool defaults_only) {
+    AffectedScanner scanner(&deps_log_, &state_);
+    string err;
+    EXPECT_TRUE(scanner.AddChanged(path, &err));
+    vector<string> paths;
+    EXPECT_TRUE(scanner.Find(defaults_only, &paths, &err));
+    EXPECT_EQ("", err);
+    return Join(paths);
+  }
+
+  static string Join(const vector<string>& paths) {
+    string joined;
+    for (size_t i = 0; i < paths.size(); ++i)
+      joined += (i ? " " : "") + paths[i];
+    return joined;
+  }
+
+  ScopedTempDir temp_dir_;
+  DepsLog deps_log_;
+};
+
+TEST_F(AffectedScannerTest, ThroughManifest) {
+  EXPECT_EQ("app b.o tool", Affected("b.c", false));
+  EXPECT_EQ("app", Affected("./b.c", true));
+  EXPECT_EQ("", Affected("app", false));
+}
+
+TEST_F(AffectedScannerTest, ThroughDepsLog) {
+  // Only the deps log says that a.o reads the header.
+  RecordDep("a.o", "header.h");
+  EXPECT_EQ("a.o app", Affected("header.h", false));
+  EXPECT_EQ("app", Affected("header.h", true));
+
+  // Nor is an output that the manifest no longer builds affected.
+  RecordDep("gone.o", "header.h");
+  EXPECT_EQ("a.o app", Affected("header.h", false));
+}
+
+TEST_F(AffectedScannerTest, FromFile) {
+  RecordDep("a.o", "header.h");
+  FILE* f = fopen("changed", "wb");
+  ASSERT_TRUE(f != NULL);
+  fputs("header.h\r\n\nother.c", f);
+  fclose(f);
+
+  AffectedScanner scanner(&deps_log_, &state_);
+  EXPECT_TRUE(scanner.empty());
+  string err;
+  f = fopen("changed", "rb");
+  ASSERT_TRUE(f != NULL);
+  EXPECT_TRUE(scanner.AddChangedFrom(f, &err));
+  fclose(f);
+  EXPECT_FALSE(scanner.empty());
+  vector<string> paths;
+  EXPECT_TRUE(scanner.Find(false, &paths, &err));
+  EXPECT_EQ("a.o app other", Join(paths));
+  EXPECT_TRUE(scanner.Find(true, &paths, &err));
+  EXPECT_EQ("app other", Join(paths));
+}
+
+TEST_F(AffectedScannerTest, Unknown) {
+  AffectedScanner scanner(&deps_log_, &state_);
+  string err;
+  EXPECT_FALSE(scanner.AddChanged("", &err));
+  EXPECT_EQ("empty path", err);
+  err.clear();
+  EXPECT_TRUE(scanner.AddChanged("missing.c", &err));
+  vector<string> paths;
+  EXPECT_TRUE(scanner.Find(false, &paths, &err));
+  EXPECT_TRUE(paths.empty());
+}
+
+}  // anonymous namespace
@@ -0,0 +1,162 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "affinity.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <set>
+
+#include "util.h"
+
+bool CpuPlacer::Init(Policy policy, string* err) {
+#ifdef __linux__
+  // Only the processors ninja is allowed on, by taskset or a cgroup.
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+    *err = string("sched_getaffinity: ") + strerror(errno);
+    return false;
+  }
+
+  vector<vector<int> > nodes;
+  set<int> on_a_node;
+  for (int node = 0;; ++node) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+             node);
+    string list, read_err;
+    if (ReadFile(path, &list, &read_err) < 0)
+      break;
+    vector<int> cpus, usable;
+    if (!ParseCpuList(list, &cpus)) {
+      *err = string("can't parse ") + path;
+      return false;
+    }
+    for (vector<int>::iterator c = cpus.begin(); c != cpus.end(); ++c) {
+      if (*c < CPU_SETSIZE && CPU_ISSET(*c, &allowed)) {
+        usable.push_back(*c);
+        on_a_node.insert(*c);
+      }
+    }
+    if (!usable.empty())
+      nodes.push_back(usable);
+  }
+
+  // Without NUMA support in the kernel, the machine is one node.
+  if (nodes.empty()) {
+    nodes.push_back(vector<int>());
+    for (int c = 0; c < CPU_SETSIZE; ++c) {
+      if (CPU_ISSET(c, &allowed))
+        nodes.back().push_back(c);
+    }
+  }
+  SetNodes(policy, nodes);
+  return true;
+#else
+  (void)policy;
+  *err = "placing commands on processors is only supported on Linux";
+  return false;
+#endif
+}
+
+void CpuPlacer::SetNodes(Policy policy, const vector<vector<int> >& nodes) {
+  policy_ = policy;
+  nodes_ = nodes;
+  node_use_.assign(nodes_.size(), 0);
+  cpu_use_.clear();
+  pool_use_.clear();
+}
+
+CpuPlacer::Placement CpuPlacer::Place(const Pool* pool, vector<int>* cpus) {
+  Placement placement;
+  cpus->clear();
+  if (!enabled())
+    return placement;
+
+  // The node running the fewest commands of the pool, and of those the
+  // one running the fewest commands at all.
+  vector<int>& pool_use = pool_use_[pool];
+  pool_use.resize(nodes_.size());
+  int best = 0;
+  for (int n = 1; n < (int)nodes_.size(); ++n) {
+    if (pool_use[n] < pool_use[best] ||
+        (pool_use[n] == pool_use[best] && node_use_[n] < node_use_[best]))
+      best = n;
+  }
+  placement.node = best;
+  placement.pool = pool;
+  ++pool_use[best];
+  ++node_use_[best];
+
+  const vector<int>& node_cpus = nodes_[best];
+  if (policy_ == kCores) {
+    int cpu = node_cpus[0];
+    for (vector<int>::const_iterator c = node_cpus.begin();
+         c != node_cpus.end(); ++c) {
+      if (cpu_use_[*c] < cpu_use_[cpu])
+        cpu = *c;
+    }
+    ++cpu_use_[cpu];
+    placement.cpu = cpu;
+    cpus->push_back(cpu);
+  } else {
+    *cpus = node_cpus;
+  }
+  return placement;
+}
+
+void CpuPlacer::Release(const Placement& placement) {
+  if (placement.node < 0)
+    return;
+  --node_use_[placement.node];
+  --pool_use_[placement.pool][placement.node];
+  if (placement.cpu >= 0)
+    --cpu_use_[placement.cpu];
+}
+
+// static
+bool CpuPlacer::ParseCpuList(const string& list, vector<int>* cpus) {
+  cpus->clear();
+  const char* p = list.c_str();
+  while (*p && *p != '\n') {
+    char* end;
+    long first = strtol(p, &end, 10);
+    if (end == p || first < 0)
+      return false;
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      ++p;
+      last = strtol(p, &end, 10);
+      if (end == p || last < first)
+        return false;
+      p = end;
+    }
+    for (long c = first; c <= last; ++c)
+      cpus->push_back((int)c);
+    if (*p == ',')
+      ++p;
+    else if (*p && *p != '\n')
+      return false;
+  }
+  return true;
+}
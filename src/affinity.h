@@ -0,0 +1,79 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_AFFINITY_H_
+#define NINJA_AFFINITY_H_
+
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct Pool;
+
+/// Chooses the processors each command may run on, so that on machines
+/// with several NUMA nodes the commands spread over the nodes rather than
+/// wherever the kernel first puts them.  The commands of each pool are
+/// spread on their own, so that the few heavy commands of a pool of links
+/// don't end up reading memory through the same node.
+struct CpuPlacer {
+  enum Policy {
+    /// Leave it to the system.
+    kNone,
+    /// Each command runs on all the processors of one node.
+    kNuma,
+    /// Each command runs on one processor, of the least busy node.
+    kCores
+  };
+
+  /// Where a command was placed, to give back with Release().
+  struct Placement {
+    Placement() : node(-1), cpu(-1), pool(NULL) {}
+    int node;
+    int cpu;
+    const Pool* pool;
+  };
+
+  CpuPlacer() : policy_(kNone) {}
+
+  /// Learn the nodes of this machine and the processors ninja may use.
+  /// Returns false, filling |err|, if the system doesn't tell.
+  bool Init(Policy policy, string* err);
+
+  /// Use |nodes|, each a list of processors, as the machine.  Used by
+  /// tests.
+  void SetNodes(Policy policy, const vector<vector<int> >& nodes);
+
+  bool enabled() const { return policy_ != kNone && !nodes_.empty(); }
+
+  /// Choose the processors for a command of |pool|, filling |cpus|.
+  Placement Place(const Pool* pool, vector<int>* cpus);
+
+  /// A command placed by Place() is done.
+  void Release(const Placement& placement);
+
+  /// Parse a Linux list of processors such as "0-3,8,10-11" into |cpus|.
+  static bool ParseCpuList(const string& list, vector<int>* cpus);
+
+ private:
+  Policy policy_;
+  vector<vector<int> > nodes_;
+  /// How many commands run on each node, and on each processor.
+  vector<int> node_use_;
+  map<int, int> cpu_use_;
+  /// How many commands of each pool run on each node.
+  map<const Pool*, vector<int> > pool_use_;
+};
+
+#endif  // NINJA_AFFINITY_H_
@@ -0,0 +1,105 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "affinity.h"
+
+#include "state.h"
+#include "test.h"
+
+namespace {
+
+TEST(CpuPlacer, ParseCpuList) {
+  vector<int> cpus;
+  ASSERT_TRUE(CpuPlacer::ParseCpuList("0-2,5,7-8\n", &cpus));
+  ASSERT_EQ(6u, cpus.size());
+  EXPECT_EQ(0, cpus[0]);
+  EXPECT_EQ(2, cpus[2]);
+  EXPECT_EQ(5, cpus[3]);
+  EXPECT_EQ(8, cpus[5]);
+
+  ASSERT_TRUE(CpuPlacer::ParseCpuList("\n", &cpus));
+  EXPECT_TRUE(cpus.empty());
+  EXPECT_FALSE(CpuPlacer::ParseCpuList("3-1", &cpus));
+  EXPECT_FALSE(CpuPlacer::ParseCpuList("1;2", &cpus));
+}
+
+vector<vector<int> > TwoNodes() {
+  vector<vector<int> > nodes(2);
+  nodes[0].push_back(0);
+  nodes[0].push_back(1);
+  nodes[1].push_back(2);
+  nodes[1].push_back(3);
+  return nodes;
+}
+
+TEST(CpuPlacer, SpreadsPoolsOverNodes) {
+  CpuPlacer placer;
+  placer.SetNodes(CpuPlacer::kNuma, TwoNodes());
+  Pool compile("compile", 0);
+  Pool link("link", 2);
+
+  vector<int> cpus;
+  // Three compiles take node 0, node 1, then node 0 again.
+  CpuPlacer::Placement c1 = placer.Place(&compile, &cpus);
+  EXPECT_EQ(0, c1.node);
+  ASSERT_EQ(2u, cpus.size());
+  EXPECT_EQ(0, cpus[0]);
+  CpuPlacer::Placement c2 = placer.Place(&compile, &cpus);
+  EXPECT_EQ(1, c2.node);
+  EXPECT_EQ(2, cpus[0]);
+  CpuPlacer::Placement c3 = placer.Place(&compile, &cpus);
+  EXPECT_EQ(0, c3.node);
+
+  // The links spread over the nodes on their own, the first going to the
+  // node less busy with compiles.
+  CpuPlacer::Placement l1 = placer.Place(&link, &cpus);
+  EXPECT_EQ(1, l1.node);
+  CpuPlacer::Placement l2 = placer.Place(&link, &cpus);
+  EXPECT_EQ(0, l2.node);
+
+  placer.Release(l1);
+  CpuPlacer::Placement l3 = placer.Place(&link, &cpus);
+  EXPECT_EQ(1, l3.node);
+}
+
+TEST(CpuPlacer, Cores) {
+  CpuPlacer placer;
+  placer.SetNodes(CpuPlacer::kCores, TwoNodes());
+  Pool pool("pool", 0);
+
+  vector<int> cpus;
+  vector<CpuPlacer::Placement> placements;
+  int expected[] = { 0, 2, 1, 3, 0 };
+  for (int i = 0; i < 5; ++i) {
+    placements.push_back(placer.Place(&pool, &cpus));
+    ASSERT_EQ(1u, cpus.size());
+    EXPECT_EQ(expected[i], cpus[0]);
+  }
+
+  // A freed processor is the next one used on its node.
+  placer.Release(placements[3]);
+  placer.Place(&pool, &cpus);
+  EXPECT_EQ(3, cpus[0]);
+}
+
+TEST(CpuPlacer, Disabled) {
+  CpuPlacer placer;
+  vector<int> cpus(1, 7);
+  CpuPlacer::Placement placement = placer.Place(NULL, &cpus);
+  EXPECT_EQ(-1, placement.node);
+  EXPECT_TRUE(cpus.empty());
+  placer.Release(placement);
+}
+
+}  // anonymous namespace
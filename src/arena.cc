@@ -0,0 +1,82 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "arena.h"
+
+#include <stdlib.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "debug_flags.h"
+#include "util.h"
+
+Arena::~Arena() {
+  for (vector<char*>::iterator i = slabs_.begin(); i != slabs_.end(); ++i)
+    free(*i);
+}
+
+char* Arena::NewSlab(size_t* size) {
+  char* slab = NULL;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  if (g_huge_pages && *size >= kHugePageSize) {
+    // Only whole huge pages, aligned to them, can be backed by them.
+    *size = (*size + kHugePageSize - 1) & ~(kHugePageSize - 1);
+    void* aligned;
+    if (posix_memalign(&aligned, kHugePageSize, *size) == 0) {
+      slab = (char*)aligned;
+      // This is advice: where the kernel doesn't take it, small pages do.
+      madvise(slab, *size, MADV_HUGEPAGE);
+      huge_capacity_ += *size;
+    }
+  }
+#endif
+  if (!slab)
+    slab = (char*)malloc(*size);
+  if (!slab)
+    Fatal("out of memory");
+  slabs_.push_back(slab);
+  capacity_ += *size;
+  return slab;
+}
+
+void* Arena::AllocateSlow(size_t size) {
+  // Oversized requests get a slab of their own, so that the current slab
+  // keeps serving small ones.
+  if (size > slab_size_ / 4)
+    return NewSlab(&size);
+
+  wasted_ += end_ - next_;
+  size_t slab_size = slab_size_;
+  char* slab = NewSlab(&slab_size);
+  next_ = slab + size;
+  end_ = slab + slab_size;
+  // Small States stay small, big ones quickly get big slabs.
+  size_t max_slab_size = g_huge_pages ? kHugePageSize : kMaxSlabSize;
+  if (slab_size_ < max_slab_size)
+    slab_size_ *= 2;
+  return slab;
+}
+
+void Arena::Adopt(Arena* other) {
+  slabs_.insert(slabs_.end(), other->slabs_.begin(), other->slabs_.end());
+  capacity_ += other->capacity_;
+  huge_capacity_ += other->huge_capacity_;
+  // The other's slabs are used as far as they are.
+  wasted_ += other->wasted_ + (other->end_ - other->next_);
+  other->slabs_.clear();
+  other->next_ = other->end_ = NULL;
+  other->slab_size_ = kMinSlabSize;
+  other->capacity_ = other->huge_capacity_ = other->wasted_ = 0;
+}
@@ -0,0 +1,82 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_ARENA_H_
+#define NINJA_ARENA_H_
+
+#include <stddef.h>
+
+#include <vector>
+using namespace std;
+
+/// A bump allocator for objects that live as long as their owner, such as
+/// the nodes and edges of a State.  Memory is handed out from large slabs
+/// and released all at once when the Arena is destroyed; destructors of the
+/// objects placed in it are not run.
+///
+/// With "-d hugepages", slabs grow to the size of a huge page, and those
+/// that big are aligned to one and, on Linux, advised to be backed by
+/// transparent huge pages, so walking a large graph takes fewer TLB misses.
+struct Arena {
+  Arena()
+      : next_(NULL), end_(NULL), slab_size_(kMinSlabSize), capacity_(0),
+        huge_capacity_(0), wasted_(0) {}
+  ~Arena();
+
+  /// Return |size| bytes suitably aligned for any object.
+  void* Allocate(size_t size) {
+    size = (size + kAlignment - 1) & ~(kAlignment - 1);
+    if ((size_t)(end_ - next_) < size)
+      return AllocateSlow(size);
+    void* result = next_;
+    next_ += size;
+    return result;
+  }
+
+  /// Take over all memory of |other|, leaving it empty.
+  void Adopt(Arena* other);
+
+  /// Total bytes in slabs, used or not.
+  size_t capacity() const { return capacity_; }
+  /// The bytes of those that were advised to be on huge pages.
+  size_t huge_capacity() const { return huge_capacity_; }
+  /// The bytes handed out, and lost to alignment.
+  size_t used() const { return capacity_ - wasted_ - (end_ - next_); }
+  size_t slabs() const { return slabs_.size(); }
+
+ private:
+  static const size_t kAlignment = 16;
+  static const size_t kMinSlabSize = 4096;
+  static const size_t kMaxSlabSize = 1 << 20;
+  static const size_t kHugePageSize = 2 << 20;
+
+  void* AllocateSlow(size_t size);
+  /// A new slab of at least |*size| bytes, updating |*size| to its size.
+  char* NewSlab(size_t* size);
+
+  vector<char*> slabs_;
+  char* next_;
+  char* end_;
+  size_t slab_size_;
+  size_t capacity_;
+  size_t huge_capacity_;
+  /// The bytes left at the ends of slabs that were moved on from.
+  size_t wasted_;
+
+  // Not copyable.
+  Arena(const Arena&);
+  void operator=(const Arena&);
+};
+
+#endif  // NINJA_ARENA_H_
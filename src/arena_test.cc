@@ -0,0 +1,87 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "arena.h"
+
+#include <string.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "debug_flags.h"
+#include "test.h"
+
+namespace {
+
+TEST(ArenaTest, Allocate) {
+  Arena arena;
+  char* a = (char*)arena.Allocate(3);
+  char* b = (char*)arena.Allocate(5);
+  EXPECT_EQ(0u, (size_t)a % 16);
+  EXPECT_EQ(0u, (size_t)b % 16);
+  EXPECT_TRUE(b >= a + 3);
+  memset(a, 'a', 3);
+  memset(b, 'b', 5);
+  EXPECT_EQ('a', a[2]);
+
+  // Allocations bigger than a slab still work.
+  char* big = (char*)arena.Allocate(1 << 21);
+  memset(big, 0, 1 << 21);
+  char* c = (char*)arena.Allocate(1);
+  EXPECT_EQ(b + 16, c);
+}
+
+TEST(ArenaTest, Adopt) {
+  Arena arena;
+  Arena other;
+  char* a = (char*)other.Allocate(10);
+  memset(a, 'x', 10);
+  size_t capacity = other.capacity();
+  arena.Adopt(&other);
+  EXPECT_EQ(0u, other.capacity());
+  EXPECT_EQ(capacity, arena.capacity());
+  EXPECT_EQ('x', a[9]);
+}
+
+TEST(ArenaTest, Used) {
+  Arena arena;
+  arena.Allocate(10);
+  EXPECT_EQ(16u, arena.used());
+  // The rest of the first slab is lost once its successor takes over.
+  arena.Allocate(1000);
+  arena.Allocate(1000);
+  arena.Allocate(1000);
+  arena.Allocate(1100);
+  EXPECT_EQ(16u + 3 * 1008 + 1104, arena.used());
+  EXPECT_EQ(2u, arena.slabs());
+  EXPECT_EQ(0u, arena.huge_capacity());
+}
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+TEST(ArenaTest, HugePages) {
+  g_huge_pages = true;
+  Arena arena;
+  // Slabs as big as a huge page are aligned to it.
+  char* big = (char*)arena.Allocate(3 << 20);
+  EXPECT_EQ(0u, (size_t)big % (2 << 20));
+  EXPECT_EQ(4u << 20, arena.huge_capacity());
+  memset(big, 0, 3 << 20);
+  // Small slabs are not.
+  arena.Allocate(10);
+  EXPECT_EQ(4u << 20, arena.huge_capacity());
+  g_huge_pages = false;
+}
+#endif
+
+}  // anonymous namespace
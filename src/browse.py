@@ -30,6 +30,7 @@ except ImportError:
     import SocketServer as socketserver
 import argparse
 import cgi
+import json
 import os
 import socket
 import subprocess
@@ -56,50 +57,57 @@ Node = namedtuple('Node', ['inputs', 'rule', 'target', 'outputs'])
 # This means there's no single view that shows you all inputs and outputs
 # of an edge.  But I think it's less confusing than alternatives.
 
-def match_strip(line, prefix):
-    if not line.startswith(prefix):
-        return (False, line)
-    return (True, line[len(prefix):])
-
 def html_escape(text):
     return cgi.escape(text, quote=True)
 
-def parse(text):
-    lines = iter(text.split('\n'))
-
-    target = None
-    rule = None
-    inputs = []
-    outputs = []
-
-    try:
-        target = next(lines)[:-1]  # strip trailing colon
-
-        line = next(lines)
-        (match, rule) = match_strip(line, '  input: ')
-        if match:
-            (match, line) = match_strip(next(lines), '    ')
-            while match:
+def load_graph():
+    """Read the whole graph from ninja once, as -t graph --format=json
+    writes it, and index it by path."""
+    cmd = [args.ninja_command, '-f', args.f, '-t', 'graph', '--format=json']
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE,
+                            universal_newlines=True)
+    paths = {}
+    built_by = {}  # Output path -> (rule, [(input, type)], [outputs]).
+    dependents = {}  # Input path -> set of the outputs built from it.
+    for line in proc.stdout:
+        record = json.loads(line)
+        if 'node' in record:
+            paths[record['node']] = record['path']
+        elif 'edge' in record:
+            inputs = [paths[i] for i in record['inputs']]
+            outputs = [paths[o] for o in record['outputs']]
+            explicit = len(inputs) - record['implicit'] - record['order_only']
+            typed = []
+            for n, input in enumerate(inputs):
                 type = None
-                (match, line) = match_strip(line, '| ')
-                if match:
-                    type = 'implicit'
-                (match, line) = match_strip(line, '|| ')
-                if match:
+                if n >= len(inputs) - record['order_only']:
                     type = 'order-only'
-                inputs.append((line, type))
-                (match, line) = match_strip(next(lines), '    ')
-
-        match, _ = match_strip(line, '  outputs:')
-        if match:
-            (match, line) = match_strip(next(lines), '    ')
-            while match:
-                outputs.append(line)
-                (match, line) = match_strip(next(lines), '    ')
-    except StopIteration:
-        pass
-
-    return Node(inputs, rule, target, outputs)
+                elif n >= explicit:
+                    type = 'implicit'
+                typed.append((input, type))
+                dependents.setdefault(input, set()).update(outputs)
+            for output in outputs:
+                built_by[output] = (record['rule'], typed, outputs)
+        elif 'deps' in record:
+            rule, typed, outputs = built_by[paths[record['deps']]]
+            known = set(input for input, _ in typed)
+            for i in record['inputs']:
+                input = paths[i]
+                if input not in known:
+                    typed.append((input, 'deps'))
+                    known.add(input)
+                dependents.setdefault(input, set()).update(outputs)
+    if proc.wait() != 0:
+        sys.exit(1)
+    return set(paths.values()), built_by, dependents
+
+def lookup(target):
+    if target not in graph_paths:
+        return None
+    rule, inputs = None, []
+    if target in graph_built_by:
+        rule, inputs, _ = graph_built_by[target]
+    return Node(inputs, rule, target, graph_dependents.get(target, ()))
 
 def create_page(body):
     return '''<!DOCTYPE html>
@@ -137,7 +145,7 @@ def generate_html(node):
                         html_escape(node.rule))
         if len(node.inputs) > 0:
             document.append('<div class=filelist>')
-            for input, type in sorted(node.inputs):
+            for input, type in sorted(node.inputs, key=lambda i: i[0]):
                 extra = ''
                 if type:
                     extra = ' (%s)' % html_escape(type)
@@ -155,12 +163,6 @@ def generate_html(node):
 
     return '\n'.join(document)
 
-def ninja_dump(target):
-    cmd = [args.ninja_command, '-f', args.f, '-t', 'query', target]
-    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
-                            universal_newlines=True)
-    return proc.communicate() + (proc.returncode,)
-
 class RequestHandler(httpserver.BaseHTTPRequestHandler):
     def do_GET(self):
         assert self.path[0] == '/'
@@ -178,12 +180,12 @@ class RequestHandler(httpserver.BaseHTTPRequestHandler):
             return
         target = target[1:]
 
-        ninja_output, ninja_error, exit_code = ninja_dump(target)
-        if exit_code == 0:
-            page_body = generate_html(parse(ninja_output.strip()))
+        node = lookup(target)
+        if node:
+            page_body = generate_html(node)
         else:
-            # Relay ninja's error message.
-            page_body = '<h1><tt>%s</tt></h1>' % html_escape(ninja_error)
+            page_body = ("<h1><tt>unknown target '%s'</tt></h1>" %
+                         html_escape(target))
 
         self.send_response(200)
         self.end_headers()
@@ -212,6 +214,7 @@ class HTTPServer(socketserver.ThreadingMixIn, httpserver.HTTPServer):
     daemon_threads = True
 
 args = parser.parse_args()
+graph_paths, graph_built_by, graph_dependents = load_graph()
 port = args.port
 hostname = args.hostname
 httpd = HTTPServer((hostname,port), RequestHandler)
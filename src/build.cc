@@ -18,30 +18,48 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
 #include <functional>
 
 #ifdef _WIN32
 #include <fcntl.h>
 #include <io.h>
+#else
+#include <unistd.h>
 #endif
 
 #if defined(__SVR4) && defined(__sun)
 #include <sys/termios.h>
 #endif
 
+#include "action_cache.h"
+#include "build_dir_lock.h"
 #include "build_log.h"
 #include "clparser.h"
 #include "debug_flags.h"
 #include "depfile_parser.h"
 #include "deps_log.h"
+#include "digest_log.h"
 #include "disk_interface.h"
+#include "dyndep.h"
+#include "dyndep_parser.h"
 #include "graph.h"
+#include "jobserver.h"
+#include "mapped_file.h"
+#include "metrics.h"
+#include "remote_launcher.h"
+#include "resume_log.h"
 #include "state.h"
 #include "subprocess.h"
+#include "trace.h"
 #include "util.h"
 
 namespace {
 
+/// How often to see whether other processes are done with the outputs of
+/// the edges waiting for them.
+const int kElsewhereCheckMillis = 100;
+
 /// A CommandRunner that doesn't actually run the commands.
 struct DryRunCommandRunner : public CommandRunner {
   virtual ~DryRunCommandRunner() {}
@@ -49,7 +67,7 @@ struct DryRunCommandRunner : public CommandRunner {
   // Overridden from CommandRunner:
   virtual bool CanRunMore() const;
   virtual bool StartCommand(Edge* edge);
-  virtual bool WaitForCommand(Result* result);
+  virtual bool WaitForCommand(Result* result, int timeout_millis);
 
  private:
   queue<Edge*> finished_;
@@ -64,7 +82,8 @@ bool DryRunCommandRunner::StartCommand(Edge* edge) {
   return true;
 }
 
-bool DryRunCommandRunner::WaitForCommand(Result* result) {
+bool DryRunCommandRunner::WaitForCommand(Result* result,
+                                          int /*timeout_millis*/) {
    if (finished_.empty())
      return false;
 
@@ -79,7 +98,10 @@ bool DryRunCommandRunner::WaitForCommand(Result* result) {
 BuildStatus::BuildStatus(const BuildConfig& config)
     : config_(config),
       start_time_millis_(GetTimeMillis()),
-      started_edges_(0), finished_edges_(0), total_edges_(0),
+      last_status_millis_(0), last_edge_(NULL),
+      last_edge_status_(kEdgeStarted), refresh_pending_(false),
+      status_lines_(0),
+      started_edges_(0), finished_edges_(0), total_edges_(0), plan_(NULL),
       progress_status_format_(NULL),
       overall_rate_(), current_rate_(config.parallelism) {
 
@@ -90,10 +112,17 @@ BuildStatus::BuildStatus(const BuildConfig& config)
   progress_status_format_ = getenv("NINJA_STATUS");
   if (!progress_status_format_)
     progress_status_format_ = "[%f/%t] ";
+
+  if (printer_.is_smart_terminal()) {
+    if (const char* lines = getenv("NINJA_STATUS_LINES"))
+      status_lines_ = max(atoi(lines), 0);
+  }
 }
 
 void BuildStatus::PlanHasTotalEdges(int total) {
   total_edges_ = total;
+  if (config_.observer)
+    config_.observer->EdgesPlanned(total);
 }
 
 void BuildStatus::BuildEdgeStarted(Edge* edge) {
@@ -101,17 +130,33 @@ void BuildStatus::BuildEdgeStarted(Edge* edge) {
   int start_time = (int)(GetTimeMillis() - start_time_millis_);
   running_edges_.insert(make_pair(edge, start_time));
   ++started_edges_;
+  if (g_trace)
+    g_trace->EdgeStarted(edge);
+  if (config_.observer)
+    config_.observer->EdgeStarted(edge, started_edges_, total_edges_);
 
   if (edge->use_console() || printer_.is_smart_terminal())
-    PrintStatus(edge, kEdgeStarted);
+    PrintStatus(edge, kEdgeStarted, edge->use_console());
 
   if (edge->use_console())
     printer_.SetConsoleLocked(true);
 }
 
+void BuildStatus::BuildEdgeDiscarded(Edge* edge) {
+  running_edges_.erase(edge);
+  --started_edges_;
+  if (g_trace)
+    g_trace->EdgeFinished(edge, false);
+  if (config_.observer)
+    config_.observer->EdgeDiscarded(edge);
+  if (edge->use_console())
+    printer_.SetConsoleLocked(false);
+}
+
 void BuildStatus::BuildEdgeFinished(Edge* edge,
                                     bool success,
                                     const string& output,
+                                    FILE* output_spill,
                                     int* start_time,
                                     int* end_time) {
   int64_t now = GetTimeMillis();
@@ -122,62 +167,129 @@ void BuildStatus::BuildEdgeFinished(Edge* edge,
   *start_time = i->second;
   *end_time = (int)(now - start_time_millis_);
   running_edges_.erase(i);
+  if (g_trace)
+    g_trace->EdgeFinished(edge, success);
 
   if (edge->use_console())
     printer_.SetConsoleLocked(false);
 
+  if (config_.observer) {
+    if (output_spill) {
+      // Hand over all of the output, and put the file back for printing.
+      string all = output;
+      long start = ftell(output_spill);
+      char buf[64 << 10];
+      size_t len;
+      while ((len = fread(buf, 1, sizeof(buf), output_spill)) > 0)
+        all.append(buf, len);
+      fseek(output_spill, start, SEEK_SET);
+      config_.observer->EdgeFinished(edge, success, all, finished_edges_,
+                                     total_edges_);
+    } else {
+      config_.observer->EdgeFinished(edge, success, output, finished_edges_,
+                                     total_edges_);
+    }
+  }
+
   if (config_.verbosity == BuildConfig::QUIET)
     return;
 
+  bool has_output = !output.empty() || output_spill;
+
+  // The status line above any output must name the edge it came from.
   if (!edge->use_console())
-    PrintStatus(edge, kEdgeFinished);
+    PrintStatus(edge, kEdgeFinished, !success || has_output);
 
   // Print the command that is spewing before printing its output.
+  string to_print;
   if (!success) {
-    string outputs;
+    if (printer_.supports_color())
+      to_print = "\x1B[31m" "FAILED: " "\x1B[0m";
+    else
+      to_print = "FAILED: ";
     for (vector<Node*>::const_iterator o = edge->outputs_.begin();
          o != edge->outputs_.end(); ++o)
-      outputs += (*o)->path() + " ";
+      to_print += (*o)->path() + " ";
+    to_print += "\n";
+    to_print += edge->EvaluateCommand() + "\n";
+  }
 
-    if (printer_.supports_color()) {
-        printer_.PrintOnNewLine("\x1B[31m" "FAILED: " "\x1B[0m" + outputs + "\n");
-    } else {
-        printer_.PrintOnNewLine("FAILED: " + outputs + "\n");
+  if (has_output) {
+#ifdef _WIN32
+    // The output is written in binary mode below, so the header can't
+    // share its write.
+    if (!to_print.empty()) {
+      printer_.PrintOnNewLine(to_print);
+      to_print.clear();
     }
-    printer_.PrintOnNewLine(edge->EvaluateCommand() + "\n");
-  }
-
-  if (!output.empty()) {
-    // ninja sets stdout and stderr of subprocesses to a pipe, to be able to
-    // check if the output is empty. Some compilers, e.g. clang, check
-    // isatty(stderr) to decide if they should print colored output.
-    // To make it possible to use colored output with ninja, subprocesses should
-    // be run with a flag that forces them to always print color escape codes.
-    // To make sure these escape codes don't show up in a file if ninja's output
-    // is piped to a file, ninja strips ansi escape codes again if it's not
-    // writing to a |smart_terminal_|.
-    // (Launching subprocesses in pseudo ttys doesn't work because there are
-    // only a few hundred available on some systems, and ninja can launch
-    // thousands of parallel compile commands.)
-    string final_output;
-    if (!printer_.supports_color())
-      final_output = StripAnsiEscapeCodes(output);
-    else
-      final_output = output;
 
-#ifdef _WIN32
     // Fix extra CR being added on Windows, writing out CR CR LF (#773)
     _setmode(_fileno(stdout), _O_BINARY);  // Begin Windows extra CR fix
 #endif
 
-    printer_.PrintOnNewLine(final_output);
+    if (printer_.supports_color()) {
+      // With nothing to strip, the output goes out as it is, without
+      // joining it to what comes before it, and what didn't fit in memory
+      // straight from its file.
+      vector<StringPiece> pieces;
+      pieces.push_back(to_print);
+      pieces.push_back(output);
+      printer_.PrintOnNewLine(pieces);
+      if (output_spill)
+        printer_.PrintFile(output_spill);
+      to_print.clear();
+    } else {
+      to_print += output;
+      if (output_spill) {
+        // Output that didn't fit in memory is streamed from its file, in
+        // pieces that end at a line break so escape codes stay whole.  Lines
+        // that don't end in a good while are broken up anyway.
+        const size_t kMaxPending = 1 << 20;
+        char buf[64 << 10];
+        size_t len;
+        while ((len = fread(buf, 1, sizeof(buf), output_spill)) > 0) {
+          to_print.append(buf, len);
+          size_t end = to_print.rfind('\n');
+          if (end != string::npos)
+            ++end;
+          else if (to_print.size() >= kMaxPending)
+            end = to_print.size();
+          else
+            continue;
+          PrintOutput(to_print.substr(0, end));
+          to_print.erase(0, end);
+        }
+      }
+    }
+    if (!to_print.empty())
+      PrintOutput(to_print);
 
 #ifdef _WIN32
     _setmode(_fileno(stdout), _O_TEXT);  // End Windows extra CR fix
 #endif
+  } else if (!to_print.empty()) {
+    printer_.PrintOnNewLine(to_print);
   }
 }
 
+void BuildStatus::PrintOutput(const string& output) {
+  // ninja sets stdout and stderr of subprocesses to a pipe, to be able to
+  // check if the output is empty. Some compilers, e.g. clang, check
+  // isatty(stderr) to decide if they should print colored output.
+  // To make it possible to use colored output with ninja, subprocesses should
+  // be run with a flag that forces them to always print color escape codes.
+  // To make sure these escape codes don't show up in a file if ninja's output
+  // is piped to a file, ninja strips ansi escape codes again if it's not
+  // writing to a |smart_terminal_|.
+  // (Launching subprocesses in pseudo ttys doesn't work because there are
+  // only a few hundred available on some systems, and ninja can launch
+  // thousands of parallel compile commands.)
+  if (!printer_.supports_color())
+    printer_.PrintOnNewLine(StripAnsiEscapeCodes(output));
+  else
+    printer_.PrintOnNewLine(output);
+}
+
 void BuildStatus::BuildLoadDyndeps() {
   // The DependencyScan calls EXPLAIN() to print lines explaining why
   // it considers a portion of the graph to be out of date.  Normally
@@ -188,20 +300,92 @@ void BuildStatus::BuildLoadDyndeps() {
   // line.  Start a new line so that the first explanation does not
   // append to the status line.  After the explanations are done a
   // new build status line will appear.
-  if (g_explaining)
+  if (g_explaining) {
+    Refresh();
     printer_.PrintOnNewLine("");
+  }
 }
 
 void BuildStatus::BuildStarted() {
   overall_rate_.Restart();
   current_rate_.Restart();
+  if (config_.observer)
+    config_.observer->BuildStarted();
 }
 
 void BuildStatus::BuildFinished() {
+  if (config_.observer)
+    config_.observer->BuildFinished();
   printer_.SetConsoleLocked(false);
+  Refresh();
   printer_.PrintOnNewLine("");
 }
 
+int BuildStatus::MillisUntilRefresh() const {
+  int64_t due;
+  if (refresh_pending_)
+    due = last_status_millis_ + kRefreshMillis;
+  else if (status_lines_ && last_edge_ && !running_edges_.empty())
+    due = last_status_millis_ + kTickMillis;
+  else
+    return -1;
+  int64_t wait = due - GetTimeMillis();
+  return wait > 0 ? (int)wait : 0;
+}
+
+void BuildStatus::Refresh() {
+  if (refresh_pending_ || MillisUntilRefresh() == 0)
+    PrintStatus(last_edge_, last_edge_status_, true);
+}
+
+vector<string> BuildStatus::FormatRunningEdges() const {
+  vector<pair<int, Edge*> > running;
+  running.reserve(running_edges_.size());
+  for (RunningEdgeMap::const_iterator i = running_edges_.begin();
+       i != running_edges_.end(); ++i)
+    running.push_back(make_pair(i->second, i->first));
+  size_t shown = min(running.size(), (size_t)status_lines_);
+  partial_sort(running.begin(), running.begin() + shown, running.end());
+
+  vector<string> lines;
+  int now = (int)(GetTimeMillis() - start_time_millis_);
+  char buf[32];
+  for (size_t i = 0; i < shown; ++i) {
+    Edge* edge = running[i].second;
+    string description = edge->GetBinding("description");
+    if (description.empty())
+      description = edge->GetBinding("command");
+    snprintf(buf, sizeof(buf), "%7.1fs ", (now - running[i].first) / 1e3);
+    lines.push_back(buf + description);
+  }
+  if (shown < running.size()) {
+    snprintf(buf, sizeof(buf), "%9s... and %d more", "",
+             (int)(running.size() - shown));
+    lines.push_back(buf);
+  }
+
+  // A full pool is where a build serializes, so show how full each one
+  // in use is.
+  map<string, const Pool*> pools;
+  for (RunningEdgeMap::const_iterator i = running_edges_.begin();
+       i != running_edges_.end(); ++i) {
+    const Pool* pool = i->first->pool();
+    if (pool && pool->depth() > 0)
+      pools[pool->name()] = pool;
+  }
+  if (!pools.empty()) {
+    string line = "   pools:";
+    for (map<string, const Pool*>::const_iterator p = pools.begin();
+         p != pools.end(); ++p) {
+      snprintf(buf, sizeof(buf), " %d/%d", p->second->current_use(),
+               p->second->depth());
+      line += " " + p->first + buf;
+    }
+    lines.push_back(line);
+  }
+  return lines;
+}
+
 string BuildStatus::FormatProgressStatus(
     const char* progress_status_format, EdgeStatus status) const {
   string out;
@@ -278,6 +462,16 @@ string BuildStatus::FormatProgressStatus(
         break;
       }
 
+        // Estimated time left.
+      case 'E':
+        if (plan_) {
+          snprintf(buf, sizeof(buf), "%.1f", EstimateRemainingSeconds());
+          out += buf;
+        } else {
+          out += "?";
+        }
+        break;
+
       default:
         Fatal("unknown placeholder '%%%c' in $NINJA_STATUS", *s);
         return "";
@@ -290,10 +484,41 @@ string BuildStatus::FormatProgressStatus(
   return out;
 }
 
-void BuildStatus::PrintStatus(Edge* edge, EdgeStatus status) {
+double BuildStatus::EstimateRemainingSeconds() const {
+  // The running edges are taken to be as far along as they have run, or to
+  // be about to finish if they have run longer than expected.
+  int64_t now = GetTimeMillis() - start_time_millis_;
+  int64_t remaining = plan_->remaining_millis();
+  int64_t critical = plan_->NextWeight();
+  for (RunningEdgeMap::const_iterator i = running_edges_.begin();
+       i != running_edges_.end(); ++i) {
+    int64_t done = min(now - i->second, plan_->PredictedMillis(i->first));
+    remaining -= done;
+    critical = max(critical, i->first->critical_path_weight() - done);
+  }
+  if (config_.parallelism > 0)
+    critical = max(critical, remaining / config_.parallelism);
+  return max(critical, (int64_t)0) / 1000.0;
+}
+
+void BuildStatus::PrintStatus(Edge* edge, EdgeStatus status, bool force) {
   if (config_.verbosity == BuildConfig::QUIET)
     return;
 
+  // A smart terminal overprints each status line with the next, so most
+  // of them are never seen when edges finish quickly.  Keep only the
+  // latest until it is due; a dumb terminal keeps every line.
+  int64_t now = GetTimeMillis();
+  last_edge_ = edge;
+  last_edge_status_ = status;
+  if (printer_.is_smart_terminal() && !force &&
+      now - last_status_millis_ < kRefreshMillis) {
+    refresh_pending_ = true;
+    return;
+  }
+  refresh_pending_ = false;
+  last_status_millis_ = now;
+
   bool force_full_command = config_.verbosity == BuildConfig::VERBOSE;
 
   string to_print = edge->GetBinding("description");
@@ -302,12 +527,20 @@ void BuildStatus::PrintStatus(Edge* edge, EdgeStatus status) {
 
   to_print = FormatProgressStatus(progress_status_format_, status) + to_print;
 
+  if (status_lines_) {
+    printer_.PrintMultiLine(to_print, FormatRunningEdges());
+    return;
+  }
   printer_.Print(to_print,
                  force_full_command ? LinePrinter::FULL : LinePrinter::ELIDE);
 }
 
 Plan::Plan(Builder* builder)
-  : builder_(builder)
+  : prepared_(false)
+  , remaining_millis_(0)
+  , speculate_(false)
+  , finished_edges_(0)
+  , builder_(builder)
   , command_edges_(0)
   , wanted_edges_(0)
 {}
@@ -316,7 +549,17 @@ void Plan::Reset() {
   command_edges_ = 0;
   wanted_edges_ = 0;
   ready_.clear();
+  ready_micros_.clear();
   want_.clear();
+  planned_.clear();
+  prepared_ = false;
+  predicted_millis_.clear();
+  remaining_millis_ = 0;
+  started_early_.clear();
+  early_start_failed_.clear();
+  finished_at_.clear();
+  finished_edges_ = 0;
+  failed_.clear();
 }
 
 bool Plan::AddTarget(Node* node, string* err) {
@@ -329,8 +572,20 @@ bool Plan::AddSubTarget(Node* node, Node* dependent, string* err,
   if (!edge) {  // Leaf node.
     if (node->dirty()) {
       string referenced;
-      if (dependent)
+      if (dependent) {
+        // Through collapsed phony edges, name the one that lists the file.
+        const vector<Node*>& inputs = dependent->in_edge()->inputs_;
+        if (find(inputs.begin(), inputs.end(), node) == inputs.end()) {
+          for (vector<Edge*>::const_iterator oe = node->out_edges().begin();
+               oe != node->out_edges().end(); ++oe) {
+            if ((*oe)->is_phony()) {
+              dependent = (*oe)->outputs_[0];
+              break;
+            }
+          }
+        }
         referenced = ", needed by '" + dependent->path() + "',";
+      }
       *err = "'" + node->path() + "'" + referenced + " missing "
              "and no known rule to make it";
     }
@@ -340,11 +595,14 @@ bool Plan::AddSubTarget(Node* node, Node* dependent, string* err,
   if (edge->outputs_ready())
     return false;  // Don't need to do anything.
 
-  // If an entry in want_ does not already exist for edge, create an entry which
-  // maps to kWantNothing, indicating that we do not want to build this entry itself.
-  pair<map<Edge*, Want>::iterator, bool> want_ins =
-    want_.insert(make_pair(edge, kWantNothing));
-  Want& want = want_ins.first->second;
+  // If the edge is not in the plan yet, add it as kWantNothing, indicating
+  // that we do not want to build this entry itself.
+  Want& want = WantFor(edge);
+  bool added = want == kNotInPlan;
+  if (added) {
+    want = kWantNothing;
+    planned_.push_back(edge);
+  }
 
   if (dyndep_walk && want == kWantToFinish)
     return false;  // Don't need to do anything with already-scheduled edge.
@@ -354,18 +612,19 @@ bool Plan::AddSubTarget(Node* node, Node* dependent, string* err,
   if (node->dirty() && want == kWantNothing) {
     want = kWantToStart;
     EdgeWanted(edge);
-    if (!dyndep_walk && edge->AllInputsReady())
-      ScheduleWork(want_ins.first);
+    if (!dyndep_walk && prepared_ && CanStart(edge))
+      ScheduleWork(edge);
   }
 
   if (dyndep_walk)
     dyndep_walk->insert(edge);
 
-  if (!want_ins.second)
+  if (!added)
     return true;  // We've already processed the inputs.
 
-  for (vector<Node*>::iterator i = edge->inputs_.begin();
-       i != edge->inputs_.end(); ++i) {
+  const vector<Node*>& inputs = edge->PlanInputs();
+  for (vector<Node*>::const_iterator i = inputs.begin(); i != inputs.end();
+       ++i) {
     if (!AddSubTarget(*i, node, err, dyndep_walk) && !err->empty())
       return false;
   }
@@ -373,47 +632,178 @@ bool Plan::AddSubTarget(Node* node, Node* dependent, string* err,
   return true;
 }
 
+Plan::Want& Plan::WantFor(const Edge* edge) {
+  assert(edge->id() >= 0 && "edge must belong to a State");
+  if ((size_t)edge->id() >= want_.size())
+    want_.resize(edge->id() + 1, kNotInPlan);
+  return want_[edge->id()];
+}
+
 void Plan::EdgeWanted(const Edge* edge) {
   ++wanted_edges_;
   if (!edge->is_phony())
     ++command_edges_;
 }
 
+void Plan::PrepareQueue(BuildLog* build_log, const ResumeLog* resume_log) {
+  // Weights can't change once edges are queued in order of them.
+  if (prepared_)
+    return;
+  ComputeCriticalPath(build_log, resume_log);
+  prepared_ = true;
+
+  // Schedule the heaviest edges first, so that they also get first claim
+  // on their pools.
+  vector<Edge*> ready;
+  for (vector<Edge*>::iterator e = planned_.begin(); e != planned_.end(); ++e) {
+    if (want_[(*e)->id()] == kWantToStart && CanStart(*e))
+      ready.push_back(*e);
+  }
+  sort(ready.begin(), ready.end(), EdgePriorityLess());
+  for (vector<Edge*>::iterator e = ready.begin(); e != ready.end(); ++e)
+    ScheduleWork(*e);
+}
+
+void Plan::ComputeCriticalPath(BuildLog* build_log,
+                               const ResumeLog* resume_log) {
+  METRIC_RECORD("critical path");
+  TRACE_PHASE("critical path");
+
+  // Sort the wanted edges so that every edge comes after the wanted edges
+  // producing its inputs.  A weight of -1 marks an edge not yet visited.
+  for (vector<Edge*>::iterator e = planned_.begin(); e != planned_.end(); ++e) {
+    (*e)->set_critical_path_weight(-1);
+    (*e)->set_fail_first(false);
+  }
+  vector<Edge*> sorted;
+  sorted.reserve(planned_.size());
+  vector<pair<Edge*, size_t> > stack;
+  for (vector<Edge*>::iterator e = planned_.begin(); e != planned_.end(); ++e) {
+    if (!Planned(*e) || (*e)->critical_path_weight() != -1)
+      continue;
+    (*e)->set_critical_path_weight(0);
+    stack.push_back(make_pair(*e, 0));
+    while (!stack.empty()) {
+      Edge* edge = stack.back().first;
+      size_t i = stack.back().second++;
+      const vector<Node*>& inputs = edge->PlanInputs();
+      if (i == inputs.size()) {
+        sorted.push_back(edge);
+        stack.pop_back();
+        continue;
+      }
+      Edge* in_edge = inputs[i]->in_edge();
+      if (!in_edge || in_edge->critical_path_weight() != -1 ||
+          !Planned(in_edge))
+        continue;
+      in_edge->set_critical_path_weight(0);
+      stack.push_back(make_pair(in_edge, 0));
+    }
+  }
+
+  // Estimate how long each edge takes from its last run.  Edges that won't
+  // run cost nothing, and edges that never ran are assumed to be average.
+  vector<int64_t> durations(sorted.size(), -1);
+  int64_t total_duration = 0;
+  int known = 0;
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    Edge* edge = sorted[i];
+    if (edge->is_phony() || want_[edge->id()] == kWantNothing) {
+      durations[i] = 0;
+      continue;
+    }
+    BuildLog::LogEntry* entry = NULL;
+    if (build_log && !edge->outputs_.empty())
+      entry = build_log->LookupByNode(edge->outputs_[0]);
+    if (entry && entry->end_time >= entry->start_time) {
+      durations[i] = entry->end_time - entry->start_time;
+      total_duration += durations[i];
+      ++known;
+    }
+  }
+  int64_t default_duration = known ? total_duration / known : 1;
+  if (default_duration < 1)
+    default_duration = 1;
+
+  // Walk from the targets down, so that each edge has seen all of its
+  // dependents by the time it is reached.
+  predicted_millis_.assign(want_.size(), 0);
+  remaining_millis_ = 0;
+  for (size_t i = sorted.size(); i-- > 0; ) {
+    Edge* edge = sorted[i];
+    int64_t duration = durations[i] < 0 ? default_duration : durations[i];
+    predicted_millis_[edge->id()] = duration;
+    remaining_millis_ += duration;
+    int64_t weight = edge->critical_path_weight() + duration;
+    edge->set_critical_path_weight(weight);
+    if (resume_log && want_[edge->id()] != kWantNothing &&
+        resume_log->Failed(edge)) {
+      EXPLAIN("%s failed last time, so it goes first",
+              edge->outputs_[0]->path().c_str());
+      edge->set_fail_first(true);
+    }
+    const vector<Node*>& inputs = edge->PlanInputs();
+    for (vector<Node*>::const_iterator in = inputs.begin();
+         in != inputs.end(); ++in) {
+      Edge* in_edge = (*in)->in_edge();
+      if (!in_edge || !Planned(in_edge))
+        continue;
+      if (in_edge->critical_path_weight() < weight)
+        in_edge->set_critical_path_weight(weight);
+      if (edge->fail_first())
+        in_edge->set_fail_first(true);
+    }
+  }
+}
+
 Edge* Plan::FindWork() {
+  if (!prepared_)
+    PrepareQueue(NULL);
   if (ready_.empty())
     return NULL;
-  set<Edge*>::iterator e = ready_.begin();
-  Edge* edge = *e;
-  ready_.erase(e);
+  Edge* edge = ready_.top();
+  ready_.pop();
   return edge;
 }
 
-void Plan::ScheduleWork(map<Edge*, Want>::iterator want_e) {
-  if (want_e->second == kWantToFinish) {
+void Plan::EdgeStarted(const Edge* edge) {
+  map<const Edge*, int64_t>::iterator ready = ready_micros_.find(edge);
+  if (ready == ready_micros_.end())
+    return;
+  METRIC_RECORD_VALUE("edge scheduling latency", kMicros,
+                      GetTimeMicros() - ready->second);
+  ready_micros_.erase(ready);
+}
+
+void Plan::ScheduleWork(Edge* edge) {
+  Want& want = WantFor(edge);
+  if (want == kWantToFinish) {
     // This edge has already been scheduled.  We can get here again if an edge
     // and one of its dependencies share an order-only input, or if a node
     // duplicates an out edge (see https://github.com/ninja-build/ninja/pull/519).
     // Avoid scheduling the work again.
     return;
   }
-  assert(want_e->second == kWantToStart);
-  want_e->second = kWantToFinish;
+  assert(want == kWantToStart);
+  want = kWantToFinish;
+  if (!edge->AllInputsReady())
+    started_early_[edge] = finished_edges_;
+  if (g_metrics)
+    ready_micros_[edge] = GetTimeMicros();
 
-  Edge* edge = want_e->first;
   Pool* pool = edge->pool();
   if (pool->ShouldDelayEdge()) {
     pool->DelayEdge(edge);
     pool->RetrieveReadyEdges(&ready_);
   } else {
     pool->EdgeScheduled(*edge);
-    ready_.insert(edge);
+    ready_.push(edge);
   }
 }
 
 bool Plan::EdgeFinished(Edge* edge, EdgeResult result, string* err) {
-  map<Edge*, Want>::iterator e = want_.find(edge);
-  assert(e != want_.end());
-  bool directly_wanted = e->second != kWantNothing;
+  assert(Planned(edge));
+  bool directly_wanted = want_[edge->id()] != kWantNothing;
 
   // See if this job frees up any delayed jobs.
   if (directly_wanted)
@@ -421,13 +811,23 @@ bool Plan::EdgeFinished(Edge* edge, EdgeResult result, string* err) {
   edge->pool()->RetrieveReadyEdges(&ready_);
 
   // The rest of this function only applies to successful commands.
-  if (result != kEdgeSucceeded)
+  if (result != kEdgeSucceeded) {
+    if ((size_t)edge->id() >= failed_.size())
+      failed_.resize(edge->id() + 1);
+    failed_[edge->id()] = true;
     return true;
+  }
 
-  if (directly_wanted)
+  if (directly_wanted) {
     --wanted_edges_;
-  want_.erase(e);
+    remaining_millis_ -= PredictedMillis(edge);
+  }
+  want_[edge->id()] = kNotInPlan;
   edge->outputs_ready_ = true;
+  started_early_.erase(edge);
+  if ((size_t)edge->id() >= finished_at_.size())
+    finished_at_.resize(edge->id() + 1, 0);
+  finished_at_[edge->id()] = ++finished_edges_;
 
   // Check off any nodes we were waiting for with this edge.
   for (vector<Node*>::iterator o = edge->outputs_.begin();
@@ -450,60 +850,146 @@ bool Plan::NodeFinished(Node* node, string* err) {
   // See if we we want any edges from this node.
   for (vector<Edge*>::const_iterator oe = node->out_edges().begin();
        oe != node->out_edges().end(); ++oe) {
-    map<Edge*, Want>::iterator want_e = want_.find(*oe);
-    if (want_e == want_.end())
+    if (!Planned(*oe))
       continue;
 
     // See if the edge is now ready.
-    if (!EdgeMaybeReady(want_e, err))
+    if (!EdgeMaybeReady(*oe, err))
+      return false;
+  }
+  for (vector<Edge*>::const_iterator oe = node->phony_out_edges().begin();
+       oe != node->phony_out_edges().end(); ++oe) {
+    if (Planned(*oe) && !EdgeMaybeReady(*oe, err))
       return false;
   }
   return true;
 }
 
-bool Plan::EdgeMaybeReady(map<Edge*, Want>::iterator want_e, string* err) {
-  Edge* edge = want_e->first;
+bool Plan::EdgeMaybeReady(Edge* edge, string* err) {
+  // A dyndep file that is still being loaded may add inputs to the edge.
+  if (edge->dyndep_ && edge->dyndep_->dyndep_pending())
+    return true;
   if (edge->AllInputsReady()) {
-    if (want_e->second != kWantNothing) {
-      ScheduleWork(want_e);
+    if (want_[edge->id()] != kWantNothing) {
+      ScheduleWork(edge);
     } else {
       // We do not need to build this edge, but we might need to build one of
       // its dependents.
       if (!EdgeFinished(edge, kEdgeSucceeded, err))
         return false;
     }
+  } else if (want_[edge->id()] == kWantToStart && CanStart(edge)) {
+    ScheduleWork(edge);
   }
   return true;
 }
 
-bool Plan::CleanNode(DependencyScan* scan, Node* node, string* err) {
-  node->set_dirty(false);
+bool Plan::CanStart(const Edge* edge) const {
+  if (edge->AllInputsReady())
+    return true;
+  // The deps log is what says the edge doesn't read what its order-only
+  // inputs make, and those dependencies are among its implicit inputs, so
+  // it can start once the inputs before the order-only ones are ready.  An
+  // edge with a dyndep file may yet get inputs.
+  if (!speculate_ || edge->order_only_deps_ == 0 || edge->is_phony() ||
+      edge->use_console() || edge->dyndep_ || edge->deps_missing_ ||
+      edge->GetBinding("deps").empty() || early_start_failed_.count(edge))
+    return false;
+  // The order-only inputs come last, so the count of ready inputs runs past
+  // the others if they are all ready.
+  return edge->ReadyInputs() >= edge->inputs_.size() - edge->order_only_deps_;
+}
 
-  for (vector<Edge*>::const_iterator oe = node->out_edges().begin();
-       oe != node->out_edges().end(); ++oe) {
-    // Don't process edges that we don't actually want.
-    map<Edge*, Want>::iterator want_e = want_.find(*oe);
-    if (want_e == want_.end() || want_e->second == kWantNothing)
+bool Plan::EarlyStartHeld(const Edge* edge, const vector<Node*>& deps) const {
+  map<const Edge*, int>::const_iterator started = started_early_.find(edge);
+  assert(started != started_early_.end());
+  for (vector<Node*>::const_iterator d = deps.begin(); d != deps.end(); ++d) {
+    Edge* in_edge = (*d)->in_edge();
+    if (!in_edge)
       continue;
+    if (!in_edge->outputs_ready())
+      return false;
+    // An edge that finished after this one started may have written the
+    // file while it was being read.
+    if ((size_t)in_edge->id() < finished_at_.size() &&
+        finished_at_[in_edge->id()] > started->second)
+      return false;
+  }
+  return true;
+}
 
-    // Don't attempt to clean an edge if it failed to load deps.
-    if ((*oe)->deps_missing_)
-      continue;
+void Plan::RetryEarlyStart(Edge* edge) {
+  assert(want_[edge->id()] == kWantToFinish);
+  started_early_.erase(edge);
+  early_start_failed_.insert(edge);
+  edge->pool()->EdgeFinished(*edge);
+  edge->pool()->RetrieveReadyEdges(&ready_);
+  want_[edge->id()] = kWantToStart;
+  // The edge runs twice, and the status counts both.
+  ++command_edges_;
+  remaining_millis_ += PredictedMillis(edge);
+  if (edge->AllInputsReady())
+    ScheduleWork(edge);
+}
+
+bool Plan::CleanNode(DependencyScan* scan, Node* node, string* err) {
+  return CleanNodes(scan, vector<Node*>(1, node), err);
+}
+
+bool Plan::CleanNodes(DependencyScan* scan, const vector<Node*>& nodes,
+                      string* err) {
+  // Clean a whole wave of nodes before looking at the edges that read them,
+  // so that an edge reading many of them, like the outputs of a generator,
+  // is looked at once rather than once for each.  The outputs of the edges
+  // that turn out clean make the next wave.
+  vector<Node*> wave(nodes);
+  vector<Edge*> edges;
+  set<Edge*> seen;
+  while (!wave.empty()) {
+    edges.clear();
+    seen.clear();
+    for (vector<Node*>::iterator n = wave.begin(); n != wave.end(); ++n) {
+      (*n)->set_dirty(false);
+      for (vector<Edge*>::const_iterator oe = (*n)->out_edges().begin();
+           oe != (*n)->out_edges().end(); ++oe) {
+        if (seen.insert(*oe).second)
+          edges.push_back(*oe);
+      }
+      for (vector<Edge*>::const_iterator oe = (*n)->phony_out_edges().begin();
+           oe != (*n)->phony_out_edges().end(); ++oe) {
+        if (seen.insert(*oe).second)
+          edges.push_back(*oe);
+      }
+    }
+    wave.clear();
+
+    for (vector<Edge*>::iterator oe = edges.begin(); oe != edges.end(); ++oe) {
+      // Don't process edges that we don't actually want.
+      if (!Planned(*oe) || want_[(*oe)->id()] == kWantNothing)
+        continue;
 
-    // If all non-order-only inputs for this edge are now clean,
-    // we might have changed the dirty state of the outputs.
-    vector<Node*>::iterator
-        begin = (*oe)->inputs_.begin(),
-        end = (*oe)->inputs_.end() - (*oe)->order_only_deps_;
+      // Don't attempt to clean an edge if it failed to load deps.
+      if ((*oe)->deps_missing_)
+        continue;
+
+      // If all non-order-only inputs for this edge are now clean,
+      // we might have changed the dirty state of the outputs.  Collapsed
+      // phony edges have none that are order-only.
+      const vector<Node*>& inputs = (*oe)->PlanInputs();
+      vector<Node*>::const_iterator
+          begin = inputs.begin(),
+          end = inputs.end() - (*oe)->order_only_deps_;
 #if __cplusplus < 201703L
 #define MEM_FN mem_fun
 #else
 #define MEM_FN mem_fn  // mem_fun was removed in C++17.
 #endif
-    if (find_if(begin, end, MEM_FN(&Node::dirty)) == end) {
+      if (find_if(begin, end, MEM_FN(&Node::dirty)) != end)
+        continue;
+
       // Recompute most_recent_input.
       Node* most_recent_input = NULL;
-      for (vector<Node*>::iterator i = begin; i != end; ++i) {
+      for (vector<Node*>::const_iterator i = begin; i != end; ++i) {
         if (!most_recent_input || (*i)->mtime() > most_recent_input->mtime())
           most_recent_input = *i;
       }
@@ -517,14 +1003,11 @@ bool Plan::CleanNode(DependencyScan* scan, Node* node, string* err) {
         return false;
       }
       if (!outputs_dirty) {
-        for (vector<Node*>::iterator o = (*oe)->outputs_.begin();
-             o != (*oe)->outputs_.end(); ++o) {
-          if (!CleanNode(scan, *o, err))
-            return false;
-        }
-
-        want_e->second = kWantNothing;
+        wave.insert(wave.end(), (*oe)->outputs_.begin(),
+                    (*oe)->outputs_.end());
+        want_[(*oe)->id()] = kWantNothing;
         --wanted_edges_;
+        remaining_millis_ -= PredictedMillis(*oe);
         if (!(*oe)->is_phony())
           --command_edges_;
       }
@@ -535,9 +1018,16 @@ bool Plan::CleanNode(DependencyScan* scan, Node* node, string* err) {
 
 bool Plan::DyndepsLoaded(DependencyScan* scan, Node* node,
                          const DyndepFile& ddf, string* err) {
+  return DyndepsLoaded(scan, vector<Node*>(1, node),
+                       vector<const DyndepFile*>(1, &ddf), err);
+}
+
+bool Plan::DyndepsLoaded(DependencyScan* scan, const vector<Node*>& nodes,
+                         const vector<const DyndepFile*>& files,
+                         string* err) {
   // Recompute the dirty state of all our direct and indirect dependents now
   // that our dyndep information has been loaded.
-  if (!RefreshDyndepDependents(scan, node, err))
+  if (!RefreshDyndepDependents(scan, nodes, err))
     return false;
 
   // We loaded dyndep information for those out_edges of the dyndep node that
@@ -547,22 +1037,25 @@ bool Plan::DyndepsLoaded(DependencyScan* scan, Node* node,
 
   // Find edges in the the build plan for which we have new dyndep info.
   std::vector<DyndepFile::const_iterator> dyndep_roots;
-  for (DyndepFile::const_iterator oe = ddf.begin(); oe != ddf.end(); ++oe) {
-    Edge* edge = oe->first;
-
-    // If the edge outputs are ready we do not need to consider it here.
-    if (edge->outputs_ready())
-      continue;
-
-    map<Edge*, Want>::iterator want_e = want_.find(edge);
+  for (vector<const DyndepFile*>::const_iterator f = files.begin();
+       f != files.end(); ++f) {
+    const DyndepFile& ddf = **f;
+    for (DyndepFile::const_iterator oe = ddf.begin(); oe != ddf.end(); ++oe) {
+      Edge* edge = oe->first;
+
+      // If the edge outputs are ready we do not need to consider it here.
+      if (edge->outputs_ready())
+        continue;
 
-    // If the edge has not been encountered before then nothing already in the
-    // plan depends on it so we do not need to consider the edge yet either.
-    if (want_e == want_.end())
-      continue;
+      // If the edge has not been encountered before then nothing already in
+      // the plan depends on it so we do not need to consider the edge yet
+      // either.
+      if (!Planned(edge))
+        continue;
 
-    // This edge is already in the plan so queue it for the walk.
-    dyndep_roots.push_back(oe);
+      // This edge is already in the plan so queue it for the walk.
+      dyndep_roots.push_back(oe);
+    }
   }
 
   // Walk dyndep-discovered portion of the graph to add it to the build plan.
@@ -578,35 +1071,43 @@ bool Plan::DyndepsLoaded(DependencyScan* scan, Node* node,
     }
   }
 
-  // Add out edges from this node that are in the plan (just as
+  // Add out edges from these nodes that are in the plan (just as
   // Plan::NodeFinished would have without taking the dyndep code path).
-  for (vector<Edge*>::const_iterator oe = node->out_edges().begin();
-       oe != node->out_edges().end(); ++oe) {
-    map<Edge*, Want>::iterator want_e = want_.find(*oe);
-    if (want_e == want_.end())
-      continue;
-    dyndep_walk.insert(want_e->first);
+  for (vector<Node*>::const_iterator n = nodes.begin(); n != nodes.end();
+       ++n) {
+    for (vector<Edge*>::const_iterator oe = (*n)->out_edges().begin();
+         oe != (*n)->out_edges().end(); ++oe) {
+      if (!Planned(*oe))
+        continue;
+      dyndep_walk.insert(*oe);
+    }
+    for (vector<Edge*>::const_iterator oe = (*n)->phony_out_edges().begin();
+         oe != (*n)->phony_out_edges().end(); ++oe) {
+      if (Planned(*oe))
+        dyndep_walk.insert(*oe);
+    }
   }
 
   // See if any encountered edges are now ready.
   for (set<Edge*>::iterator wi = dyndep_walk.begin();
        wi != dyndep_walk.end(); ++wi) {
-    map<Edge*, Want>::iterator want_e = want_.find(*wi);
-    if (want_e == want_.end())
+    if (!Planned(*wi))
       continue;
-    if (!EdgeMaybeReady(want_e, err))
+    if (!EdgeMaybeReady(*wi, err))
       return false;
   }
 
   return true;
 }
 
-bool Plan::RefreshDyndepDependents(DependencyScan* scan, Node* node,
-                                   string* err) {
+bool Plan::RefreshDyndepDependents(DependencyScan* scan,
+                                   const vector<Node*>& nodes, string* err) {
   // Collect the transitive closure of dependents and mark their edges
-  // as not yet visited by RecomputeDirty.
+  // as not yet visited by RecomputeDirty.  A dependent shared by several
+  // of |nodes| is only rescanned once.
   set<Node*> dependents;
-  UnmarkDependents(node, &dependents);
+  for (vector<Node*>::const_iterator n = nodes.begin(); n != nodes.end(); ++n)
+    UnmarkDependents(*n, &dependents);
 
   // Update the dirty state of all dependents and check if their edges
   // have become wanted.
@@ -625,10 +1126,13 @@ bool Plan::RefreshDyndepDependents(DependencyScan* scan, Node* node,
     // information an output is now known to be dirty, so we want the edge.
     Edge* edge = n->in_edge();
     assert(edge && !edge->outputs_ready());
-    map<Edge*, Want>::iterator want_e = want_.find(edge);
-    assert(want_e != want_.end());
-    if (want_e->second == kWantNothing) {
-      want_e->second = kWantToStart;
+    if (!Planned(edge)) {
+      // The plan waits for the inputs of the phony edge instead.
+      assert(edge->collapsible());
+      continue;
+    }
+    if (want_[edge->id()] == kWantNothing) {
+      want_[edge->id()] = kWantToStart;
       EdgeWanted(edge);
     }
   }
@@ -640,8 +1144,9 @@ void Plan::UnmarkDependents(Node* node, set<Node*>* dependents) {
        oe != node->out_edges().end(); ++oe) {
     Edge* edge = *oe;
 
-    map<Edge*, Want>::iterator want_e = want_.find(edge);
-    if (want_e == want_.end())
+    // The phony edges that the plan collapsed, which the scan went
+    // through, still lead to their dependents.
+    if (!Planned(edge) && !edge->collapsible())
       continue;
 
     if (edge->mark_ != Edge::VisitNone) {
@@ -656,29 +1161,51 @@ void Plan::UnmarkDependents(Node* node, set<Node*>* dependents) {
 }
 
 void Plan::Dump() {
-  printf("pending: %d\n", (int)want_.size());
-  for (map<Edge*, Want>::iterator e = want_.begin(); e != want_.end(); ++e) {
-    if (e->second != kWantNothing)
+  int pending = 0;
+  for (vector<Edge*>::iterator e = planned_.begin(); e != planned_.end(); ++e)
+    pending += Planned(*e);
+  printf("pending: %d\n", pending);
+  for (vector<Edge*>::iterator e = planned_.begin(); e != planned_.end(); ++e) {
+    if (!Planned(*e))
+      continue;
+    if (want_[(*e)->id()] != kWantNothing)
       printf("want ");
-    e->first->Dump();
+    (*e)->Dump();
   }
   printf("ready: %d\n", (int)ready_.size());
 }
 
 struct RealCommandRunner : public CommandRunner {
-  explicit RealCommandRunner(const BuildConfig& config) : config_(config) {}
-  virtual ~RealCommandRunner() {}
+  explicit RealCommandRunner(const BuildConfig& config);
+  virtual ~RealCommandRunner() { ReleaseTokens(0); }
   virtual bool CanRunMore() const;
   virtual bool StartCommand(Edge* edge);
-  virtual bool WaitForCommand(Result* result);
+  virtual bool WaitForCommand(Result* result, int timeout_millis);
+  virtual bool HasFinishedCommand() const;
   virtual vector<Edge*> GetActiveEdges();
   virtual void Abort();
 
+  /// Give jobserver tokens back until we hold at most |keep|.
+  void ReleaseTokens(size_t keep);
+
   const BuildConfig& config_;
   SubprocessSet subprocs_;
   map<Subprocess*, Edge*> subproc_to_edge_;
+  CpuPlacer placer_;
+  map<Subprocess*, CpuPlacer::Placement> placements_;
+  mutable CpuPressure cpu_pressure_;
 };
 
+RealCommandRunner::RealCommandRunner(const BuildConfig& config)
+    : config_(config) {
+  string err;
+  if (config_.affinity != CpuPlacer::kNone &&
+      !placer_.Init(config_.affinity, &err))
+    Warning("not placing commands on processors: %s", err.c_str());
+  if (config_.max_cpu_pressure > 0 && !cpu_pressure_.available())
+    Warning("CPU pressure is unknown here; not limiting commands by it");
+}
+
 vector<Edge*> RealCommandRunner::GetActiveEdges() {
   vector<Edge*> edges;
   for (map<Subprocess*, Edge*>::iterator e = subproc_to_edge_.begin();
@@ -689,119 +1216,572 @@ vector<Edge*> RealCommandRunner::GetActiveEdges() {
 
 void RealCommandRunner::Abort() {
   subprocs_.Clear();
+  for (map<Subprocess*, CpuPlacer::Placement>::iterator p =
+           placements_.begin(); p != placements_.end(); ++p)
+    placer_.Release(p->second);
+  placements_.clear();
+  ReleaseTokens(0);
+}
+
+void RealCommandRunner::ReleaseTokens(size_t keep) {
+  if (!config_.jobserver)
+    return;
+  while (config_.jobserver->tokens() > keep)
+    config_.jobserver->Release();
 }
 
 bool RealCommandRunner::CanRunMore() const {
   size_t subproc_number =
       subprocs_.running_.size() + subprocs_.finished_.size();
-  return (int)subproc_number < config_.parallelism
-    && ((subprocs_.running_.empty() || config_.max_load_average <= 0.0f)
-        || GetLoadAverage() < config_.max_load_average);
+  if (!((int)subproc_number < config_.parallelism
+        && ((subprocs_.running_.empty() || config_.max_load_average <= 0.0f)
+            || GetLoadAverage() < config_.max_load_average)))
+    return false;
+  // The pressure follows the commands started within a second or so, so
+  // that the build settles near it rather than swinging about it as with
+  // the load average, which trails by a minute.
+  if (!subprocs_.running_.empty() && config_.max_cpu_pressure > 0 &&
+      cpu_pressure_.Read() >= config_.max_cpu_pressure)
+    return false;
+  // Memory goes quickly, and is read afresh for every command, so that a
+  // burst of starts stops as soon as the commands running use it up.
+  if (!subprocs_.running_.empty() && config_.min_available_memory > 0) {
+    int64_t available = GetAvailableMemory();
+    if (available >= 0 && available < config_.min_available_memory)
+      return false;
+  }
+  // The first command runs on the token we implicitly hold; each further
+  // one needs a token of its own.
+  Jobserver* jobserver = config_.jobserver;
+  if (jobserver && jobserver->tokens() < subproc_number)
+    return jobserver->Acquire();
+  return true;
 }
 
 bool RealCommandRunner::StartCommand(Edge* edge) {
-  string command = edge->EvaluateCommand();
-  Subprocess* subproc = subprocs_.Add(command, edge->use_console());
-  if (!subproc)
+  string command;
+  if (config_.remote && !RemoteLauncher::RunsLocally(edge)) {
+    string err;
+    if (!config_.remote->WrapCommand(edge, &command, &err)) {
+      Error("%s", err.c_str());
+      return false;
+    }
+  } else {
+    command = edge->EvaluateCommand();
+  }
+  // Remote commands don't use the processors here.
+  vector<int> cpus;
+  CpuPlacer::Placement placement;
+  if (placer_.enabled() &&
+      (!config_.remote || RemoteLauncher::RunsLocally(edge)))
+    placement = placer_.Place(edge->pool(), &cpus);
+  Subprocess* subproc = subprocs_.Add(command, edge->use_console(), cpus);
+  if (!subproc) {
+    placer_.Release(placement);
     return false;
+  }
   subproc_to_edge_.insert(make_pair(subproc, edge));
+  if (placement.node >= 0)
+    placements_[subproc] = placement;
 
   return true;
 }
 
-bool RealCommandRunner::WaitForCommand(Result* result) {
+bool RealCommandRunner::WaitForCommand(Result* result,
+                                       int timeout_millis) {
+  // Don't sit on tokens acquired for commands that never started.
+  size_t subproc_number =
+      subprocs_.running_.size() + subprocs_.finished_.size();
+  ReleaseTokens(subproc_number ? subproc_number - 1 : 0);
+
+  int64_t deadline = GetTimeMillis() + timeout_millis;
   Subprocess* subproc;
   while ((subproc = subprocs_.NextFinished()) == NULL) {
-    bool interrupted = subprocs_.DoWork();
+    int wait = -1;
+    if (timeout_millis >= 0) {
+      int64_t left = deadline - GetTimeMillis();
+      if (left <= 0)
+        return true;
+      wait = (int)left;
+    }
+    bool interrupted = subprocs_.DoWork(wait);
     if (interrupted)
       return false;
   }
 
   result->status = subproc->Finish();
-  result->output = subproc->GetOutput();
+  subproc->TakeOutput(&result->output);
+  result->output_spill = subproc->TakeOutputSpill();
+  result->usage = subproc->usage();
 
   map<Subprocess*, Edge*>::iterator e = subproc_to_edge_.find(subproc);
   result->edge = e->second;
   subproc_to_edge_.erase(e);
+  map<Subprocess*, CpuPlacer::Placement>::iterator p =
+      placements_.find(subproc);
+  if (p != placements_.end()) {
+    placer_.Release(p->second);
+    placements_.erase(p);
+  }
+  if (config_.remote && !RemoteLauncher::RunsLocally(result->edge))
+    config_.remote->CommandFinished(result->edge);
 
   delete subproc;
+  // Keep the finished command's token for the next one to start.
+  subproc_number = subprocs_.running_.size() + subprocs_.finished_.size();
+  ReleaseTokens(subproc_number);
   return true;
 }
 
-Builder::Builder(State* state, const BuildConfig& config,
-                 BuildLog* build_log, DepsLog* deps_log,
-                 DiskInterface* disk_interface)
-    : state_(state), config_(config),
-      plan_(this), disk_interface_(disk_interface),
-      scan_(state, build_log, deps_log, disk_interface,
-            &config_.depfile_parser_options) {
-  status_ = new BuildStatus(config);
-}
-
-Builder::~Builder() {
-  Cleanup();
+bool RealCommandRunner::HasFinishedCommand() const {
+  return !subprocs_.finished_.empty();
 }
 
-void Builder::Cleanup() {
-  if (command_runner_.get()) {
-    vector<Edge*> active_edges = command_runner_->GetActiveEdges();
-    command_runner_->Abort();
-
-    for (vector<Edge*>::iterator e = active_edges.begin();
-         e != active_edges.end(); ++e) {
-      // The depfile will not have current chdir and must be fixed up.
-      string depfile = (*e)->GetUnescapedDepfile();
-      // First detect whether depfile was absent.
-      bool noDepfile = depfile.empty();
-      // Apply chdir fixup.
-      depfile = (*e)->env_->ApplyChdir(depfile);
-      for (vector<Node*>::iterator o = (*e)->outputs_.begin();
-           o != (*e)->outputs_.end(); ++o) {
-        // Only delete this output if it was actually modified.  This is
-        // important for things like the generator where we don't want to
-        // delete the manifest file if we can avoid it.  But if the rule
-        // uses a depfile, always delete.  (Consider the case where we
-        // need to rebuild an output because of a modified header file
-        // mentioned in a depfile, and the command touches its depfile
-        // but is interrupted before it touches its output file.)
-        string err;
-        TimeStamp new_mtime = disk_interface_->Stat((*o)->path(), &err);
-        if (new_mtime == -1)  // Log and ignore Stat() errors.
-          Error("%s", err.c_str());
-        if (!noDepfile || (*o)->mtime() != new_mtime)
-          disk_interface_->RemoveFile((*o)->path());
-      }
-      if (!noDepfile)
-        disk_interface_->RemoveFile(depfile);
-    }
+/// Reads the dependencies of a finished command.  It leaves the graph
+/// alone, so that it may run on another thread; the paths it finds are
+/// turned into nodes once it is done.
+struct Builder::DepsReader : public BackgroundTask {
+  DepsReader(CommandRunner::Result* result, DiskInterface* disk_interface,
+             const DepfileParserOptions& options,
+             IncludesCache* includes_cache);
+  virtual ~DepsReader() {
+    if (result_.output_spill)
+      fclose(result_.output_spill);
   }
-}
 
-Node* Builder::AddTarget(const string& name, string* err) {
-  Node* node = state_->LookupNode(name);
-  if (!node) {
-    *err = "unknown target: '" + name + "'";
-    return NULL;
+  virtual void Run() { success_ = Read(&err_); }
+
+  bool Read(string* err);
+
+  CommandRunner::Result result_;
+  string deps_type_;
+  string deps_prefix_;
+  string depfile_;
+  DiskInterface* disk_interface_;
+  DepfileParserOptions options_;
+  IncludesCache* includes_cache_;
+  /// Whether the depfile was read, and is to be removed.
+  bool remove_depfile_;
+
+  /// Where each dependency found ends in |dep_paths_|, with its slash
+  /// bits.  The paths are all kept in one string so that reading them
+  /// takes no allocation per path.
+  vector<pair<size_t, uint64_t> > deps_;
+  string dep_paths_;
+  bool success_;
+  string err_;
+};
+
+Builder::DepsReader::DepsReader(CommandRunner::Result* result,
+                                DiskInterface* disk_interface,
+                                const DepfileParserOptions& options,
+                                IncludesCache* includes_cache)
+    : disk_interface_(disk_interface), options_(options),
+      includes_cache_(includes_cache), remove_depfile_(false),
+      success_(false) {
+  Edge* edge = result->edge;
+  result_.edge = edge;
+  result_.status = result->status;
+  result_.output.swap(result->output);
+  result_.output_spill = result->output_spill;
+  result->output_spill = NULL;
+  result_.usage = result->usage;
+  deps_type_ = edge->GetBinding("deps");
+  deps_prefix_ = edge->GetBinding("msvc_deps_prefix");
+  if (deps_type_ == "gcc") {
+    // The depfile will not have current chdir and must be fixed up.
+    depfile_ = edge->GetUnescapedDepfile();
+    if (!depfile_.empty())
+      depfile_ = edge->env_->ApplyChdir(depfile_);
   }
-  if (!AddTarget(node, err))
-    return NULL;
-  return node;
 }
 
-bool Builder::AddTarget(Node* node, string* err) {
-  if (!scan_.RecomputeDirty(node, err))
-    return false;
+bool Builder::DepsReader::Read(string* err) {
+  TRACE_PHASE("deps extraction");
+  if (deps_type_ == "msvc") {
+    // The /showIncludes lines must all be filtered out, so the output has
+    // to be read back in, however long.
+    if (result_.output_spill) {
+      char buf[64 << 10];
+      size_t len;
+      while ((len = fread(buf, 1, sizeof(buf), result_.output_spill)) > 0)
+        result_.output.append(buf, len);
+      fclose(result_.output_spill);
+      result_.output_spill = NULL;
+    }
+    CLParser parser(includes_cache_);
+    string output;
+    if (!parser.Parse(result_.output, deps_prefix_, &output, err))
+      return false;
+    result_.output = output;
+    for (set<string>::iterator i = parser.includes_.begin();
+         i != parser.includes_.end(); ++i) {
+      // ~0 is assuming that with MSVC-parsed headers, it's ok to always make
+      // all backslashes (as some of the slashes will certainly be backslashes
+      // anyway). This could be fixed if necessary with some additional
+      // complexity in IncludesNormalize::Relativize.
+      dep_paths_.append(*i);
+      deps_.push_back(make_pair(dep_paths_.size(), (uint64_t)~0u));
+    }
+  } else
+  if (deps_type_ == "gcc") {
+    if (depfile_.empty()) {
+      *err = string("edge with deps=gcc but no depfile makes no sense");
+      return false;
+    }
 
-  if (Edge* in_edge = node->in_edge()) {
-    if (in_edge->outputs_ready())
-      return true;  // Nothing to do.
-  }
+    // Read depfile content.  Treat a missing depfile as empty.
+    string content;
+    switch (disk_interface_->ReadFile(depfile_, &content, err)) {
+    case DiskInterface::Okay:
+      break;
+    case DiskInterface::NotFound:
+      err->clear();
+      break;
+    case DiskInterface::OtherError:
+      return false;
+    }
+    if (content.empty())
+      return true;
 
-  if (!plan_.AddTarget(node, err))
-    return false;
+    DepfileParser deps(options_);
+    if (!deps.Parse(&content, err))
+      return false;
 
-  return true;
-}
+    // XXX check depfile matches expected output.
+    deps_.reserve(deps.ins_.size());
+    for (vector<StringPiece>::iterator i = deps.ins_.begin();
+         i != deps.ins_.end(); ++i) {
+      uint64_t slash_bits;
+      if (!CanonicalizePath(const_cast<char*>(i->str_), &i->len_, &slash_bits,
+                            err))
+        return false;
+      result_.edge->env_->AppendChdir(*i, &dep_paths_);
+      deps_.push_back(make_pair(dep_paths_.size(), slash_bits));
+    }
+
+    remove_depfile_ = !g_keep_depfile;
+  } else {
+    Fatal("unknown deps type '%s'", deps_type_.c_str());
+  }
+
+  return true;
+}
+
+/// Reads and parses a dyndep file without touching the graph, so that it
+/// may run on another thread; FinishDyndeps() looks up what it names.
+struct Builder::DyndepReader : public BackgroundTask {
+  DyndepReader(Node* node, DiskInterface* disk_interface)
+      : node_(node), path_(node->path()), disk_interface_(disk_interface),
+        success_(false) {}
+
+  virtual void Run() {
+    DyndepParser parser(disk_interface_, &statements_);
+    success_ = parser.Load(path_, &contents_, &err_);
+  }
+
+  Node* node_;
+  string path_;
+  DiskInterface* disk_interface_;
+  /// The file, which the lexers of |statements_| point into.
+  MappedFile contents_;
+  DyndepStatements statements_;
+  bool success_;
+  string err_;
+};
+
+struct Builder::RspfileWriter : public BackgroundTask {
+  RspfileWriter(Edge* edge, const string& path, DiskInterface* disk_interface)
+      : edge_(edge), path_(path),
+        content_(edge->GetBinding("rspfile_content")),
+        disk_interface_(disk_interface), success_(false) {}
+
+  virtual void Run() {
+    success_ = disk_interface_->WriteFile(path_, content_);
+  }
+
+  Edge* edge_;
+  string path_;
+  string content_;
+  DiskInterface* disk_interface_;
+  bool success_;
+};
+
+BuildLoopProfile::BuildLoopProfile()
+    : current_(kLoop), running_(false), since_(0), start_(0), end_(0),
+      sampled_at_(0) {
+  for (int p = 0; p < kParts; ++p)
+    micros_[p] = sampled_[p] = 0;
+}
+
+void BuildLoopProfile::Start() {
+  for (int p = 0; p < kParts; ++p)
+    micros_[p] = sampled_[p] = 0;
+  current_ = kLoop;
+  running_ = true;
+  start_ = end_ = since_ = sampled_at_ = GetTimeMicros();
+}
+
+void BuildLoopProfile::Stop() {
+  if (!running_)
+    return;
+  Enter(kLoop);
+  running_ = false;
+  end_ = since_;
+}
+
+BuildLoopProfile::Part BuildLoopProfile::Enter(Part part) {
+  Part previous = current_;
+  if (!running_)
+    return previous;
+  int64_t now = GetTimeMicros();
+  micros_[current_] += now - since_;
+  since_ = now;
+  current_ = part;
+  return previous;
+}
+
+int64_t BuildLoopProfile::total_micros() const {
+  return (running_ ? GetTimeMicros() : end_) - start_;
+}
+
+double BuildLoopProfile::overhead_percent() const {
+  int64_t total = total_micros();
+  if (total <= 0)
+    return 0;
+  return 100.0 * (total - micros_[kWait]) / total;
+}
+
+string BuildLoopProfile::Summary() const {
+  int64_t total = max<int64_t>(total_micros(), 1);
+  char buf[96];
+  snprintf(buf, sizeof(buf), "build loop %.3f s, %.1f%% scheduler overhead:",
+           total / 1e6, overhead_percent());
+  string summary = buf;
+  for (int p = kStart; p < kParts; ++p) {
+    snprintf(buf, sizeof(buf), " %s %.1f%%,", PartName((Part)p),
+             100.0 * micros_[p] / total);
+    summary += buf;
+  }
+  snprintf(buf, sizeof(buf), " %s %.1f%%", PartName(kLoop),
+           100.0 * micros_[kLoop] / total);
+  return summary + buf;
+}
+
+bool BuildLoopProfile::Sample(int64_t interval_micros,
+                              vector<pair<const char*, double> >* shares) {
+  if (!running_)
+    return false;
+  Enter(current_);
+  int64_t elapsed = since_ - sampled_at_;
+  if (elapsed < interval_micros || elapsed <= 0)
+    return false;
+  shares->clear();
+  for (int p = 0; p < kParts; ++p) {
+    shares->push_back(make_pair(PartName((Part)p),
+                                100.0 * (micros_[p] - sampled_[p]) / elapsed));
+    sampled_[p] = micros_[p];
+  }
+  sampled_at_ = since_;
+  return true;
+}
+
+// static
+const char* BuildLoopProfile::PartName(Part part) {
+  switch (part) {
+  case kLoop: return "other";
+  case kWait: return "wait";
+  case kStart: return "start";
+  case kFinish: return "finish";
+  case kDeps: return "deps";
+  case kPlan: return "plan";
+  case kLogs: return "logs";
+  case kStatus: return "status";
+  case kParts: break;
+  }
+  return "";
+}
+
+namespace {
+
+bool IsPathSeparator(char c) {
+#ifdef _WIN32
+  return c == '/' || c == '\\';
+#else
+  return c == '/';
+#endif
+}
+
+/// The length of the directory part of |path|, as DiskInterface::MakeDirs
+/// sees it: without the name, or the separators before it.
+size_t DirLength(StringPiece path) {
+  size_t len = path.size();
+  while (len > 0 && !IsPathSeparator(path.str_[len - 1]))
+    --len;
+  while (len > 1 && IsPathSeparator(path.str_[len - 1]))
+    --len;
+  return len > 0 && IsPathSeparator(path.str_[len - 1]) ? 0 : len;
+}
+
+/// How often the trace gets a sample of where the build loop's time went.
+const int64_t kLoopSampleMicros = 500 * 1000;
+
+/// Counts the time of Builder::Build() to its profile, whichever way it
+/// returns.
+struct ScopedLoopProfile {
+  explicit ScopedLoopProfile(BuildLoopProfile* profile) : profile_(profile) {
+    profile_->Start();
+  }
+  ~ScopedLoopProfile() { profile_->Stop(); }
+
+ private:
+  BuildLoopProfile* profile_;
+};
+
+/// Removes a batch of files.
+struct RemoveFilesTask : public ParallelTask {
+  RemoveFilesTask(const vector<string>& paths, DiskInterface* disk_interface)
+      : paths_(paths), disk_interface_(disk_interface) {}
+
+  virtual void Run(size_t index) {
+    disk_interface_->RemoveFile(paths_[index]);
+  }
+
+  const vector<string>& paths_;
+  DiskInterface* disk_interface_;
+};
+
+/// Removes a batch of files on another thread.
+struct RemoveFilesInBackground : public BackgroundTask {
+  RemoveFilesInBackground(vector<string>* paths, DiskInterface* disk_interface)
+      : disk_interface_(disk_interface) {
+    paths_.swap(*paths);
+  }
+
+  virtual void Run() {
+    for (vector<string>::iterator p = paths_.begin(); p != paths_.end(); ++p)
+      disk_interface_->RemoveFile(*p);
+  }
+
+  vector<string> paths_;
+  DiskInterface* disk_interface_;
+};
+
+/// How many depfiles are removed at once in the background.
+const size_t kDepfileBatch = 64;
+
+}  // anonymous namespace
+
+Builder::Builder(State* state, const BuildConfig& config,
+                 BuildLog* build_log, DepsLog* deps_log,
+                 DiskInterface* disk_interface)
+    : state_(state), config_(config),
+      plan_(this), disk_interface_(disk_interface),
+      scan_(state, build_log, deps_log, disk_interface,
+            &config_.depfile_parser_options),
+      deps_readers_(ParallelismFor(config.parallelism, 8)),
+      read_deps_in_background_(false),
+      dyndep_readers_(ParallelismFor(config.parallelism, 8)),
+      rspfile_writers_(ParallelismFor(config.parallelism, 8)),
+      depfile_removers_(1),
+      lazy_outputs_(NULL), elsewhere_checked_millis_(0) {
+  status_ = new BuildStatus(config);
+  status_->set_plan(&plan_);
+  plan_.set_scheduling(config.scheduling);
+  plan_.set_speculate(config.speculate);
+}
+
+Builder::~Builder() {
+  Cleanup();
+}
+
+void Builder::Cleanup() {
+  // Commands whose dependencies are still being read did finish, but won't
+  // be recorded; the next build runs them again.
+  while (BackgroundTask* reader = deps_readers_.NextFinished(true))
+    delete reader;
+  while (BackgroundTask* reader = dyndep_readers_.NextFinished(true))
+    delete reader;
+  while (BackgroundTask* writer = rspfile_writers_.NextFinished(true))
+    delete writer;
+  RemoveRspfiles();
+  RemoveDepfiles();
+
+  if (command_runner_.get()) {
+    vector<Edge*> active_edges = command_runner_->GetActiveEdges();
+    command_runner_->Abort();
+
+    for (vector<Edge*>::iterator e = active_edges.begin();
+         e != active_edges.end(); ++e) {
+      // The depfile will not have current chdir and must be fixed up.
+      string depfile = (*e)->GetUnescapedDepfile();
+      // First detect whether depfile was absent.
+      bool noDepfile = depfile.empty();
+      // Apply chdir fixup.
+      depfile = (*e)->env_->ApplyChdir(depfile);
+      for (vector<Node*>::iterator o = (*e)->outputs_.begin();
+           o != (*e)->outputs_.end(); ++o) {
+        // Only delete this output if it was actually modified.  This is
+        // important for things like the generator where we don't want to
+        // delete the manifest file if we can avoid it.  But if the rule
+        // uses a depfile, always delete.  (Consider the case where we
+        // need to rebuild an output because of a modified header file
+        // mentioned in a depfile, and the command touches its depfile
+        // but is interrupted before it touches its output file.)
+        string err;
+        disk_interface_->Invalidate((*o)->path());
+        TimeStamp new_mtime = disk_interface_->Stat((*o)->path(), &err);
+        if (new_mtime == -1)  // Log and ignore Stat() errors.
+          Error("%s", err.c_str());
+        if (!noDepfile || (*o)->mtime() != new_mtime)
+          disk_interface_->RemoveFile((*o)->path());
+      }
+      if (!noDepfile)
+        disk_interface_->RemoveFile(depfile);
+    }
+  }
+
+  // Let other processes have the outputs of the edges not run.
+  if (config_.build_dir_lock)
+    config_.build_dir_lock->UnlockAllOutputs();
+  elsewhere_.clear();
+
+  // Write out what the logs hold back, so that an interrupted build keeps
+  // the record of what it did build.
+  if (scan_.build_log() && !scan_.build_log()->Flush())
+    Error("writing to build log: %s", strerror(errno));
+  if (scan_.deps_log() && !scan_.deps_log()->Flush())
+    Error("writing to deps log: %s", strerror(errno));
+  if (scan_.digest_log() && !scan_.digest_log()->Flush())
+    Error("writing to digest log: %s", strerror(errno));
+}
+
+Node* Builder::AddTarget(const string& name, string* err) {
+  Node* node = state_->LookupNode(name);
+  if (!node) {
+    *err = "unknown target: '" + name + "'";
+    return NULL;
+  }
+  if (!AddTarget(node, err))
+    return NULL;
+  return node;
+}
+
+bool Builder::AddTarget(Node* node, string* err) {
+  scan_.PrefetchStats(node);
+  if (!scan_.RecomputeDirty(node, err))
+    return false;
+
+  if (Edge* in_edge = node->in_edge()) {
+    if (in_edge->outputs_ready())
+      return true;  // Nothing to do.
+  }
+
+  if (!plan_.AddTarget(node, err))
+    return false;
+
+  return true;
+}
 
 bool Builder::AlreadyUpToDate() const {
   return !plan_.more_to_do();
@@ -809,7 +1789,10 @@ bool Builder::AlreadyUpToDate() const {
 
 bool Builder::Build(string* err) {
   assert(!AlreadyUpToDate());
+  ScopedLoopProfile profile(&loop_profile_);
+  vector<pair<const char*, double> > loop_shares;
 
+  plan_.PrepareQueue(scan_.build_log(), scan_.resume_log());
   status_->PlanHasTotalEdges(plan_.command_edge_count());
   int pending_commands = 0;
   int failures_allowed = config_.failures_allowed;
@@ -822,6 +1805,11 @@ bool Builder::Build(string* err) {
       command_runner_.reset(new RealCommandRunner(config_));
   }
 
+  // With more than one command running at a time, reading what a command
+  // depends on, or a dyndep file, shouldn't hold up starting the next one.
+  read_deps_in_background_ = config_.parallelism > 1 && !config_.dry_run &&
+      disk_interface_->AllowsConcurrentAccess();
+
   // We are about to start the build process.
   status_->BuildStarted();
 
@@ -830,17 +1818,71 @@ bool Builder::Build(string* err) {
   // First, we attempt to start as many commands as allowed by the
   // command runner.
   // Second, we attempt to wait for / reap the next finished command.
-  while (plan_.more_to_do()) {
+  while (plan_.more_to_do() || dyndep_readers_.pending()) {
+    if (g_trace && loop_profile_.Sample(kLoopSampleMicros, &loop_shares))
+      g_trace->AddCounter("build loop %", loop_shares);
+
+    if (!elsewhere_.empty()) {
+      size_t waiting = elsewhere_.size();
+      if (!CheckEdgesElsewhere(err)) {
+        Cleanup();
+        status_->BuildFinished();
+        return false;
+      }
+      // Some are done with, which may have been all that was left.
+      if (elsewhere_.size() < waiting)
+        continue;
+    }
+
+    // Take in the dyndep files read since the last time around, together,
+    // before deciding what to start.
+    if (dyndep_readers_.pending() && !FinishDyndeps(false, err)) {
+      Cleanup();
+      status_->BuildFinished();
+      return false;
+    }
+    if (rspfile_writers_.pending() && !FinishRspfiles(false, err)) {
+      Cleanup();
+      status_->BuildFinished();
+      return false;
+    }
+
     // See if we can start any more commands.
     if (failures_allowed && command_runner_->CanRunMore()) {
-      if (Edge* edge = plan_.FindWork()) {
-        if (!StartEdge(edge, err)) {
+      Edge* edge;
+      {
+        ScopedLoopPart part(&loop_profile_, BuildLoopProfile::kPlan);
+        edge = plan_.FindWork();
+      }
+      if (edge && pending_commands && !FitsInMemory(edge)) {
+        // Wait for a running command to give some memory back.
+        plan_.ReturnWork(edge);
+        edge = NULL;
+      }
+      if (edge && !LeavesRoomForCriticalPath(edge, pending_commands)) {
+        plan_.ReturnWork(edge);
+        edge = NULL;
+      }
+      if (edge && !edge->is_phony() && config_.build_dir_lock &&
+          !config_.build_dir_lock->LockOutputs(edge)) {
+        // Another process is running it; see what comes of that.
+        elsewhere_[edge] = config_.build_dir_lock->ListEnd();
+        continue;
+      }
+      if (edge) {
+        bool started;
+        {
+          ScopedLoopPart part(&loop_profile_, BuildLoopProfile::kStart);
+          started = StartEdge(edge, err);
+        }
+        if (!started) {
           Cleanup();
           status_->BuildFinished();
           return false;
         }
 
         if (edge->is_phony()) {
+          ScopedLoopPart part(&loop_profile_, BuildLoopProfile::kPlan);
           if (!plan_.EdgeFinished(edge, Plan::kEdgeSucceeded, err)) {
             Cleanup();
             status_->BuildFinished();
@@ -855,11 +1897,45 @@ bool Builder::Build(string* err) {
       }
     }
 
-    // See if we can reap any finished commands.
-    if (pending_commands) {
+    // See if we can reap any finished commands.  While dependencies are
+    // being read, only do so if it won't block: recording those may let
+    // more commands start.
+    if (!cached_commands_.empty()) {
+      CachedCommand command = cached_commands_.front();
+      cached_commands_.pop_front();
+      --pending_commands;
+      if (!FinishCommand(&command.result,
+                         command.result.edge->GetBinding("deps"),
+                         command.deps_nodes, err)) {
+        Cleanup();
+        status_->BuildFinished();
+        return false;
+      }
+      continue;
+    }
+
+    if (pending_commands && ((!deps_readers_.pending() &&
+                              !dyndep_readers_.pending() &&
+                              !rspfile_writers_.pending()) ||
+                             command_runner_->HasFinishedCommand())) {
       CommandRunner::Result result;
-      if (!command_runner_->WaitForCommand(&result) ||
-          result.status == ExitInterrupted) {
+      int timeout_millis = status_->MillisUntilRefresh();
+      if (!elsewhere_.empty() &&
+          (timeout_millis < 0 || timeout_millis > kElsewhereCheckMillis))
+        timeout_millis = kElsewhereCheckMillis;
+      bool interrupted;
+      {
+        ScopedLoopPart part(&loop_profile_, BuildLoopProfile::kWait);
+        interrupted = !command_runner_->WaitForCommand(&result,
+                                                       timeout_millis);
+      }
+      if (!interrupted && !result.edge) {
+        // Nothing finished before the status line was due.
+        ScopedLoopPart part(&loop_profile_, BuildLoopProfile::kStatus);
+        status_->Refresh();
+        continue;
+      }
+      if (interrupted || result.status == ExitInterrupted) {
         Cleanup();
         status_->BuildFinished();
         *err = "interrupted by user";
@@ -867,6 +1943,8 @@ bool Builder::Build(string* err) {
       }
 
       --pending_commands;
+      if (ReadDepsInBackground(&result))
+        continue;
       if (!FinishCommand(&result, err)) {
         Cleanup();
         status_->BuildFinished();
@@ -882,6 +1960,58 @@ bool Builder::Build(string* err) {
       continue;
     }
 
+    // Dyndep files being read hold up the edges that use them.
+    if (dyndep_readers_.pending()) {
+      if (!FinishDyndeps(true, err)) {
+        Cleanup();
+        status_->BuildFinished();
+        return false;
+      }
+      continue;
+    }
+
+    if (rspfile_writers_.pending()) {
+      if (!FinishRspfiles(true, err)) {
+        Cleanup();
+        status_->BuildFinished();
+        return false;
+      }
+      continue;
+    }
+
+    // See if the dependencies of a finished command have been read.
+    BackgroundTask* task;
+    {
+      ScopedLoopPart part(&loop_profile_, BuildLoopProfile::kDeps);
+      task = deps_readers_.NextFinished(true);
+    }
+    if (task) {
+      DepsReader* reader = static_cast<DepsReader*>(task);
+      bool finished = FinishCommand(reader, err);
+      bool success = reader->result_.success();
+      delete reader;
+      if (!finished) {
+        Cleanup();
+        status_->BuildFinished();
+        return false;
+      }
+
+      if (!success) {
+        if (failures_allowed)
+          failures_allowed--;
+      }
+      continue;
+    }
+
+    // Nothing but other processes to wait for.
+    if (!elsewhere_.empty() && failures_allowed) {
+#ifndef _WIN32
+      ScopedLoopPart part(&loop_profile_, BuildLoopProfile::kWait);
+      usleep(kElsewhereCheckMillis * 1000);
+#endif
+      continue;
+    }
+
     // If we get here, we cannot make any more progress.
     status_->BuildFinished();
     if (failures_allowed == 0) {
@@ -897,38 +2027,188 @@ bool Builder::Build(string* err) {
     return false;
   }
 
+  RemoveRspfiles();
+  RemoveDepfiles();
   status_->BuildFinished();
   return true;
 }
 
+bool Builder::CheckEdgesElsewhere(string* err) {
+  int64_t now = GetTimeMillis();
+  if (now - elsewhere_checked_millis_ < kElsewhereCheckMillis)
+    return true;
+  elsewhere_checked_millis_ = now;
+
+  BuildDirLock* lock = config_.build_dir_lock;
+  for (map<Edge*, int64_t>::iterator i = elsewhere_.begin();
+       i != elsewhere_.end();) {
+    Edge* edge = i->first;
+    if (!lock->LockOutputs(edge)) {
+      ++i;
+      continue;
+    }
+    bool built = lock->SucceededSince(edge, i->second);
+    elsewhere_.erase(i++);
+    if (!built) {
+      // It failed or was interrupted there; run it here.
+      plan_.ReturnWork(edge);
+      continue;
+    }
+
+    EXPLAIN("%s was built by another ninja process",
+            edge->outputs_[0]->path().c_str());
+    lock->UnlockOutputs(edge);
+    for (vector<Node*>::iterator o = edge->outputs_.begin();
+         o != edge->outputs_.end(); ++o) {
+      disk_interface_->Invalidate((*o)->path());
+      if (!(*o)->Stat(disk_interface_, err))
+        return false;
+    }
+    plan_.EdgeStarted(edge);
+    status_->BuildEdgeStarted(edge);
+    int start_time, end_time;
+    status_->BuildEdgeFinished(edge, true, string(), NULL, &start_time,
+                               &end_time);
+    if (!plan_.EdgeFinished(edge, Plan::kEdgeSucceeded, err))
+      return false;
+  }
+  return true;
+}
+
+bool Builder::StatAll(const vector<const string*>& paths,
+                      vector<TimeStamp>* mtimes, string* err) {
+  disk_interface_->StatMany(paths, mtimes);
+  for (size_t i = 0; i < paths.size(); ++i) {
+    // Stat() again to learn what went wrong.
+    if ((*mtimes)[i] == -1 &&
+        ((*mtimes)[i] = disk_interface_->Stat(*paths[i], err)) == -1)
+      return false;
+  }
+  return true;
+}
+
+bool Builder::LeavesRoomForCriticalPath(const Edge* edge,
+                                        int running) const {
+  if (config_.critical_reserve <= 0 || config_.parallelism <= 0 ||
+      running < config_.parallelism - config_.critical_reserve)
+    return true;
+  vector<Edge*> active = command_runner_->GetActiveEdges();
+  for (vector<Edge*>::iterator e = active.begin(); e != active.end(); ++e) {
+    if ((*e)->critical_path_weight() > edge->critical_path_weight())
+      return false;
+  }
+  return true;
+}
+
+bool Builder::FitsInMemory(const Edge* edge) const {
+  if (config_.min_available_memory <= 0 || !scan_.build_log() ||
+      edge->outputs_.empty())
+    return true;
+  BuildLog::LogEntry* entry =
+      scan_.build_log()->LookupByNode(edge->outputs_[0]);
+  if (!entry || entry->usage.max_rss_kib <= 0)
+    return true;
+  int64_t available = GetAvailableMemory();
+  return available < 0 ||
+      available - (entry->usage.max_rss_kib << 10) >=
+          config_.min_available_memory;
+}
+
 bool Builder::StartEdge(Edge* edge, string* err) {
   METRIC_RECORD("StartEdge");
+  plan_.EdgeStarted(edge);
   if (edge->is_phony())
     return true;
 
   status_->BuildEdgeStarted(edge);
 
-  // Create directories necessary for outputs.
-  // XXX: this will block; do we care?
-  for (vector<Node*>::iterator o = edge->outputs_.begin();
-       o != edge->outputs_.end(); ++o) {
-    if (!disk_interface_->MakeDirs((*o)->path()))
-      return false;
-  }
+  if (!MakeOutputDirs(edge))
+    return false;
 
-  // Create response file, if needed
-  // XXX: this may also block; do we care?
+  // Create response file, if needed.  Large ones take a while to write,
+  // so while other commands run that happens on another thread, and the
+  // command starts once it's done.
   // The rspfile will not have current chdir and must be fixed up.
   // But first detect whether rspfile was absent.
   string rspfile = edge->GetUnescapedRspfile();
   if (!rspfile.empty()) {
     // Apply chdir fixup.
     rspfile = edge->env_->ApplyChdir(rspfile);
+    if (read_deps_in_background_) {
+      rspfile_writers_.Post(new RspfileWriter(edge, rspfile, disk_interface_));
+      return true;
+    }
     string content = edge->GetBinding("rspfile_content");
     if (!disk_interface_->WriteFile(rspfile, content))
       return false;
   }
 
+  return StartEdgeCommand(edge, err);
+}
+
+bool Builder::MakeOutputDirs(const Edge* edge) {
+  // Most edges put their outputs where others already did, so the
+  // directories are only looked at once.
+  for (vector<Node*>::const_iterator o = edge->outputs_.begin();
+       o != edge->outputs_.end(); ++o) {
+    const string& path = (*o)->path();
+    StringPiece dir(path.data(), DirLength(path));
+    if (!dir.size() || known_dirs_.count(dir))
+      continue;
+    // An output there is still from the stat that found it dirty.
+    if ((*o)->exists()) {
+      known_dirs_[dir] = true;
+      continue;
+    }
+
+    // As DiskInterface::MakeDirs() does, go up to a directory that is
+    // there and make those below it, but stop at one known to be there.
+    vector<StringPiece> missing;
+    for (; dir.size() && !known_dirs_.count(dir);
+         dir = StringPiece(path.data(), DirLength(dir))) {
+      string err;
+      TimeStamp mtime = disk_interface_->Stat(dir.AsString(), &err);
+      if (mtime < 0) {
+        Error("%s", err.c_str());
+        return false;
+      }
+      if (mtime > 0) {
+        known_dirs_[dir] = true;
+        break;
+      }
+      missing.push_back(dir);
+    }
+    for (vector<StringPiece>::reverse_iterator d = missing.rbegin();
+         d != missing.rend(); ++d) {
+      if (!disk_interface_->MakeDir(d->AsString()))
+        return false;
+      known_dirs_[*d] = true;
+    }
+  }
+  return true;
+}
+
+bool Builder::StartEdgeCommand(Edge* edge, string* err) {
+  // Take the inputs digest before the command gets a chance to change the
+  // inputs.  An input that can't be read just goes unrecorded.
+  uint64_t digest;
+  if (scan_.digest_log() && !config_.dry_run &&
+      edge->GetBindingBool("hash_inputs") &&
+      scan_.digest_log()->InputsDigest(edge, disk_interface_, &digest))
+    input_digests_[edge] = digest;
+
+  if (RestoreFromCache(edge))
+    return true;
+
+  // The command reads its inputs from disk.
+  if (lazy_outputs_ && !config_.dry_run) {
+    for (vector<Node*>::iterator i = edge->inputs_.begin();
+         i != edge->inputs_.end(); ++i) {
+      if (!lazy_outputs_->Materialize((*i)->path(), err))
+        return false;
+    }
+  }
+
   // start command computing and run it
   if (!command_runner_->StartCommand(edge)) {
     err->assign("command '" + edge->EvaluateCommand() + "' failed.");
@@ -938,37 +2218,223 @@ bool Builder::StartEdge(Edge* edge, string* err) {
   return true;
 }
 
-bool Builder::FinishCommand(CommandRunner::Result* result, string* err) {
-  METRIC_RECORD("FinishCommand");
+bool Builder::FinishRspfiles(bool wait, string* err) {
+  while (BackgroundTask* task = rspfile_writers_.NextFinished(wait)) {
+    RspfileWriter* writer = static_cast<RspfileWriter*>(task);
+    Edge* edge = writer->edge_;
+    bool success = writer->success_;
+    delete writer;
+    // WriteFile() printed why it failed.
+    if (!success || !StartEdgeCommand(edge, err))
+      return false;
+    wait = false;
+  }
+  return true;
+}
 
-  Edge* edge = result->edge;
+void Builder::RemoveRspfiles() {
+  if (finished_rspfiles_.empty())
+    return;
+  METRIC_RECORD("remove rspfiles");
+  RemoveFilesTask task(finished_rspfiles_, disk_interface_);
+  RunInParallel(&task, finished_rspfiles_.size(),
+                disk_interface_->AllowsConcurrentAccess() ?
+                    ParallelismFor(finished_rspfiles_.size(), 64) : 1);
+  finished_rspfiles_.clear();
+}
+
+void Builder::RemoveDepfile(const string& path) {
+  finished_depfiles_.push_back(path);
+  while (BackgroundTask* remover = depfile_removers_.NextFinished(false))
+    delete remover;
+  if (finished_depfiles_.size() < kDepfileBatch || config_.dry_run ||
+      !disk_interface_->AllowsConcurrentAccess())
+    return;
+  depfile_removers_.Post(
+      new RemoveFilesInBackground(&finished_depfiles_, disk_interface_));
+}
+
+void Builder::RemoveDepfiles() {
+  while (BackgroundTask* remover = depfile_removers_.NextFinished(true))
+    delete remover;
+  if (finished_depfiles_.empty())
+    return;
+  METRIC_RECORD("remove depfiles");
+  RemoveFilesTask task(finished_depfiles_, disk_interface_);
+  RunInParallel(&task, finished_depfiles_.size(),
+                disk_interface_->AllowsConcurrentAccess() ?
+                    ParallelismFor(finished_depfiles_.size(), 64) : 1);
+  finished_depfiles_.clear();
+}
+
+bool Builder::RestoreFromCache(Edge* edge) {
+  ActionCache* cache = config_.action_cache;
+  if (!cache || config_.dry_run || !scan_.digest_log() ||
+      !ActionCache::Cacheable(edge))
+    return false;
+
+  CachedCommand command;
+  vector<string> deps;
+  if (!cache->Restore(edge, scan_.digest_log(), disk_interface_,
+                      &command.result.output, &deps, lazy_outputs_))
+    return false;
+  command.result.edge = edge;
+  command.result.status = ExitSuccess;
+  for (vector<string>::iterator d = deps.begin(); d != deps.end(); ++d)
+    command.deps_nodes.push_back(state_->GetNode(*d, &state_->bindings_, 0));
+  cached_commands_.push_back(command);
+  restored_edges_.insert(edge);
+  return true;
+}
 
+bool Builder::FinishCommand(CommandRunner::Result* result, string* err) {
   // First try to extract dependencies from the result, if any.
   // This must happen first as it filters the command output (we want
   // to filter /showIncludes output, even on compile failure) and
   // extraction itself can fail, which makes the command fail from a
   // build perspective.
+  if (!result->edge->GetBinding("deps").empty()) {
+    DepsReader reader(result, disk_interface_, config_.depfile_parser_options,
+                      &includes_cache_);
+    {
+      ScopedLoopPart part(&loop_profile_, BuildLoopProfile::kDeps);
+      reader.Run();
+    }
+    bool finished = FinishCommand(&reader, err);
+    result->status = reader.result_.status;
+    result->output.swap(reader.result_.output);
+    return finished;
+  }
+  return FinishCommand(result, string(), vector<Node*>(), err);
+}
+
+bool Builder::ReadDepsInBackground(CommandRunner::Result* result) {
+  if (!read_deps_in_background_ || result->edge->GetBinding("deps").empty())
+    return false;
+  deps_readers_.Post(new DepsReader(result, disk_interface_,
+                                    config_.depfile_parser_options,
+                                    &includes_cache_));
+  return true;
+}
+
+bool Builder::FinishCommand(DepsReader* reader, string* err) {
+  ScopedLoopPart part(&loop_profile_, BuildLoopProfile::kDeps);
+  CommandRunner::Result* result = &reader->result_;
+  if (!reader->success_ && result->success()) {
+    // The error goes after all of the output, even what is in a file.
+    string err_output = reader->err_;
+    if (!result->output.empty() || result->output_spill)
+      err_output.insert(0, "\n");
+    if (!result->output_spill ||
+        fseek(result->output_spill, 0, SEEK_END) != 0 ||
+        fwrite(err_output.data(), 1, err_output.size(),
+               result->output_spill) != err_output.size() ||
+        fseek(result->output_spill, 0, SEEK_SET) != 0)
+      result->output.append(err_output);
+    result->status = ExitFailure;
+  }
+
   vector<Node*> deps_nodes;
-  string deps_type = edge->GetBinding("deps");
-  const string deps_prefix = edge->GetBinding("msvc_deps_prefix");
-  if (!deps_type.empty()) {
-    string extract_err;
-    if (!ExtractDeps(result, deps_type, deps_prefix, &deps_nodes,
-                     &extract_err) &&
-        result->success()) {
-      if (!result->output.empty())
-        result->output.append("\n");
-      result->output.append(extract_err);
-      result->status = ExitFailure;
+  deps_nodes.reserve(reader->deps_.size());
+  size_t begin = 0;
+  for (vector<pair<size_t, uint64_t> >::iterator i = reader->deps_.begin();
+       i != reader->deps_.end(); ++i) {
+    StringPiece path(reader->dep_paths_.data() + begin, i->first - begin);
+    deps_nodes.push_back(state_->GetNode(path, &state_->bindings_,
+                                         i->second));
+    begin = i->first;
+  }
+  Edge* edge = result->edge;
+  bool finished = FinishCommand(result, reader->deps_type_, deps_nodes, err);
+  if (reader->remove_depfile_) {
+    // A run thrown away is followed by another, whose depfile mustn't be
+    // removed before it is read.
+    if (plan_.LeftToRun(edge) && !plan_.Failed(edge))
+      disk_interface_->RemoveFile(reader->depfile_);
+    else
+      RemoveDepfile(reader->depfile_);
+  }
+  return finished;
+}
+
+bool Builder::FinishCommand(CommandRunner::Result* result,
+                            const string& deps_type,
+                            const vector<Node*>& deps_nodes, string* err) {
+  METRIC_RECORD("FinishCommand");
+  ScopedLoopPart part(&loop_profile_, BuildLoopProfile::kFinish);
+
+  Edge* edge = result->edge;
+
+  // A command started before its order-only inputs were ready is only
+  // good if it read none of the files still being built when it started.
+  // If it failed, that may be for want of one of them.  Either way it runs
+  // again once they are all there, and nothing of this run is kept.
+  if (plan_.StartedEarly(edge) &&
+      (!result->success() || !plan_.EarlyStartHeld(edge, deps_nodes))) {
+    EXPLAIN("%s started before its order-only inputs were ready and read "
+            "one of them, running it again", edge->outputs_[0]->path().c_str());
+    status_->BuildEdgeDiscarded(edge);
+    if (result->output_spill) {
+      fclose(result->output_spill);
+      result->output_spill = NULL;
+    }
+    result->output.clear();
+    result->status = ExitSuccess;
+    // Don't leave outputs that look newer than what they were made from,
+    // in case the build stops before the edge runs again.
+    if (!config_.dry_run) {
+      for (vector<Node*>::iterator o = edge->outputs_.begin();
+           o != edge->outputs_.end(); ++o)
+        disk_interface_->RemoveFile((*o)->path());
     }
+    input_digests_.erase(edge);
+    restored_edges_.erase(edge);
+    plan_.RetryEarlyStart(edge);
+    status_->PlanHasTotalEdges(plan_.command_edge_count());
+    return true;
+  }
+
+  int64_t output_size = result->output.size();
+  bool output_spilled = result->output_spill != NULL;
+  if (output_spilled &&
+      fseek(result->output_spill, 0, SEEK_END) == 0) {
+    output_size += ftell(result->output_spill);
+    rewind(result->output_spill);
   }
+  METRIC_RECORD_VALUE("command output", kBytes, output_size);
 
   int start_time, end_time;
+  loop_profile_.Enter(BuildLoopProfile::kStatus);
   status_->BuildEdgeFinished(edge, result->success(), result->output,
-                             &start_time, &end_time);
+                             result->output_spill, &start_time, &end_time);
+  loop_profile_.Enter(BuildLoopProfile::kFinish);
+  if (config_.build_dir_lock)
+    config_.build_dir_lock->UnlockOutputs(edge, result->success());
+  if (output_spilled) {
+    fclose(result->output_spill);
+    result->output_spill = NULL;
+  }
+
+  uint64_t input_digest = 0;
+  bool has_input_digest = false;
+  map<const Edge*, uint64_t>::iterator digest = input_digests_.find(edge);
+  if (digest != input_digests_.end()) {
+    input_digest = digest->second;
+    has_input_digest = true;
+    input_digests_.erase(digest);
+  }
+  bool restored = restored_edges_.erase(edge) > 0;
+
+  // What the command wrote replaces what the cache promised.
+  if (lazy_outputs_ && !restored) {
+    for (vector<Node*>::iterator o = edge->outputs_.begin();
+         o != edge->outputs_.end(); ++o)
+      lazy_outputs_->Forget((*o)->path());
+  }
 
   // The rest of this function only applies to successful commands.
   if (!result->success()) {
+    loop_profile_.Enter(BuildLoopProfile::kPlan);
     return plan_.EdgeFinished(edge, Plan::kEdgeFailed, err);
   }
 
@@ -976,36 +2442,48 @@ bool Builder::FinishCommand(CommandRunner::Result* result, string* err) {
   TimeStamp output_mtime = 0;
   bool restat = edge->GetBindingBool("restat");
   if (!config_.dry_run) {
-    bool node_cleaned = false;
-
+    // The command has just written its outputs.  Stat them all at once.
+    vector<const string*> paths;
+    paths.reserve(edge->outputs_.size());
     for (vector<Node*>::iterator o = edge->outputs_.begin();
          o != edge->outputs_.end(); ++o) {
-      TimeStamp new_mtime = disk_interface_->Stat((*o)->path(), err);
-      if (new_mtime == -1)
-        return false;
-      if (new_mtime > output_mtime)
-        output_mtime = new_mtime;
-      if ((*o)->mtime() == new_mtime && restat) {
-        // The rule command did not change the output.  Propagate the clean
-        // state through the build graph.
-        // Note that this also applies to nonexistent outputs (mtime == 0).
-        if (!plan_.CleanNode(&scan_, *o, err))
-          return false;
-        node_cleaned = true;
-      }
+      disk_interface_->Invalidate((*o)->path());
+      paths.push_back(&(*o)->path());
     }
+    vector<TimeStamp> mtimes;
+    if (!StatAll(paths, &mtimes, err))
+      return false;
+
+    vector<Node*> unchanged;
+    for (size_t i = 0; i < edge->outputs_.size(); ++i) {
+      Node* o = edge->outputs_[i];
+      if (mtimes[i] > output_mtime)
+        output_mtime = mtimes[i];
+      // The rule command did not change the output.  Propagate the clean
+      // state through the build graph.
+      // Note that this also applies to nonexistent outputs (mtime == 0).
+      if (o->mtime() == mtimes[i] && restat)
+        unchanged.push_back(o);
+    }
+
+    if (!unchanged.empty()) {
+      loop_profile_.Enter(BuildLoopProfile::kPlan);
+      if (!plan_.CleanNodes(&scan_, unchanged, err))
+        return false;
+      loop_profile_.Enter(BuildLoopProfile::kFinish);
 
-    if (node_cleaned) {
-      TimeStamp restat_mtime = 0;
       // If any output was cleaned, find the most recent mtime of any
       // (existing) non-order-only input or the depfile.
+      paths.clear();
       for (vector<Node*>::iterator i = edge->inputs_.begin();
-           i != edge->inputs_.end() - edge->order_only_deps_; ++i) {
-        TimeStamp input_mtime = disk_interface_->Stat((*i)->path(), err);
-        if (input_mtime == -1)
-          return false;
-        if (input_mtime > restat_mtime)
-          restat_mtime = input_mtime;
+           i != edge->inputs_.end() - edge->order_only_deps_; ++i)
+        paths.push_back(&(*i)->path());
+      if (!StatAll(paths, &mtimes, err))
+        return false;
+      TimeStamp restat_mtime = 0;
+      for (size_t i = 0; i < mtimes.size(); ++i) {
+        if (mtimes[i] > restat_mtime)
+          restat_mtime = mtimes[i];
       }
 
       // The depfile will not have current chdir and must be fixed up.
@@ -1014,6 +2492,7 @@ bool Builder::FinishCommand(CommandRunner::Result* result, string* err) {
       if (restat_mtime != 0 && deps_type.empty() && !depfile.empty()) {
         // Apply chdir fixup.
         depfile = edge->env_->ApplyChdir(depfile);
+        disk_interface_->Invalidate(depfile);
         TimeStamp depfile_mtime = disk_interface_->Stat(depfile, err);
         if (depfile_mtime == -1)
           return false;
@@ -1029,27 +2508,37 @@ bool Builder::FinishCommand(CommandRunner::Result* result, string* err) {
     }
   }
 
+  loop_profile_.Enter(BuildLoopProfile::kPlan);
   if (!plan_.EdgeFinished(edge, Plan::kEdgeSucceeded, err))
     return false;
+  loop_profile_.Enter(BuildLoopProfile::kFinish);
 
-  // Delete any left over response file.
+  // Delete any left over response file, along with the rest at the end.
   // The rspfile will not have current chdir and must be fixed up.
   // But first detect whether rspfile was absent.
   string rspfile = edge->GetUnescapedRspfile();
   if (!rspfile.empty() && !g_keep_rsp) {
     // Apply chdir fixup.
-    rspfile = edge->env_->ApplyChdir(rspfile);
-    disk_interface_->RemoveFile(rspfile);
+    finished_rspfiles_.push_back(edge->env_->ApplyChdir(rspfile));
   }
 
-  if (scan_.build_log()) {
+  // A dry run has no times to record, and mustn't replace those there, which
+  // -t simulate goes by.
+  loop_profile_.Enter(BuildLoopProfile::kLogs);
+  if (scan_.build_log() && !config_.dry_run) {
     if (!scan_.build_log()->RecordCommand(edge, start_time, end_time,
-                                          output_mtime)) {
+                                          output_mtime, result->usage)) {
       *err = string("Error writing to build log: ") + strerror(errno);
       return false;
     }
   }
 
+  if (has_input_digest &&
+      !scan_.digest_log()->RecordOutputs(edge, input_digest)) {
+    *err = string("Error writing to digest log: ") + strerror(errno);
+    return false;
+  }
+
   if (!deps_type.empty() && !config_.dry_run) {
     assert(edge->outputs_.size() == 1 && "should have been rejected by parser");
     Node* out = edge->outputs_[0];
@@ -1061,80 +2550,28 @@ bool Builder::FinishCommand(CommandRunner::Result* result, string* err) {
       return false;
     }
   }
-  return true;
-}
-
-bool Builder::ExtractDeps(CommandRunner::Result* result,
-                          const string& deps_type,
-                          const string& deps_prefix,
-                          vector<Node*>* deps_nodes,
-                          string* err) {
-  if (deps_type == "msvc") {
-    CLParser parser;
-    string output;
-    if (!parser.Parse(result->output, deps_prefix, &output, err))
-      return false;
-    result->output = output;
-    for (set<string>::iterator i = parser.includes_.begin();
-         i != parser.includes_.end(); ++i) {
-      // ~0 is assuming that with MSVC-parsed headers, it's ok to always make
-      // all backslashes (as some of the slashes will certainly be backslashes
-      // anyway). This could be fixed if necessary with some additional
-      // complexity in IncludesNormalize::Relativize.
-      deps_nodes->push_back(state_->GetNode(*i, &state_->bindings_, ~0u));
-    }
-  } else
-  if (deps_type == "gcc") {
-    string depfile = result->edge->GetUnescapedDepfile();
-    if (depfile.empty()) {
-      *err = string("edge with deps=gcc but no depfile makes no sense");
-      return false;
-    }
-
-    // Read depfile content.  Treat a missing depfile as empty.
-    string content;
-    switch (disk_interface_->ReadFile(depfile, &content, err)) {
-    case DiskInterface::Okay:
-      break;
-    case DiskInterface::NotFound:
-      err->clear();
-      break;
-    case DiskInterface::OtherError:
-      return false;
-    }
-    if (content.empty())
-      return true;
-
-    DepfileParser deps(config_.depfile_parser_options);
-    if (!deps.Parse(&content, err))
-      return false;
-
-    // XXX check depfile matches expected output.
-    deps_nodes->reserve(deps.ins_.size());
-    for (vector<StringPiece>::iterator i = deps.ins_.begin();
-         i != deps.ins_.end(); ++i) {
-      uint64_t slash_bits;
-      if (!CanonicalizePath(const_cast<char*>(i->str_), &i->len_, &slash_bits,
-                            err))
-        return false;
-      string s = result->edge->env_->ApplyChdir(i->AsString());
-      deps_nodes->push_back(state_->GetNode(s, &state_->bindings_, slash_bits));
-    }
 
-    if (!g_keep_depfile) {
-      if (disk_interface_->RemoveFile(depfile) < 0) {
-        *err = string("deleting depfile: ") + strerror(errno) + string("\n");
-        return false;
-      }
-    }
-  } else {
-    Fatal("unknown deps type '%s'", deps_type.c_str());
+  loop_profile_.Enter(BuildLoopProfile::kFinish);
+
+  // Output that had to go to a file is too big to be worth caching.
+  if (!restored && !output_spilled && !config_.dry_run &&
+      config_.action_cache && scan_.digest_log() &&
+      ActionCache::Cacheable(edge)) {
+    string cache_err;
+    if (!config_.action_cache->Store(edge, result->output, deps_nodes,
+                                     scan_.digest_log(), disk_interface_,
+                                     &cache_err))
+      Warning("action cache: %s", cache_err.c_str());
   }
-
   return true;
 }
 
 bool Builder::LoadDyndeps(Node* node, string* err) {
+  if (read_deps_in_background_) {
+    dyndep_readers_.Post(new DyndepReader(node, disk_interface_));
+    return true;
+  }
+
   status_->BuildLoadDyndeps();
 
   // Load the dyndep information provided by this node.
@@ -1151,3 +2588,52 @@ bool Builder::LoadDyndeps(Node* node, string* err) {
 
   return true;
 }
+
+bool Builder::FinishDyndeps(bool wait, string* err) {
+  vector<DyndepReader*> readers;
+  while (BackgroundTask* task = dyndep_readers_.NextFinished(wait)) {
+    readers.push_back(static_cast<DyndepReader*>(task));
+    wait = false;
+  }
+  if (readers.empty())
+    return true;
+
+  status_->BuildLoadDyndeps();
+
+  // Update the graph with every file before rescanning, so that dependents
+  // of several of them are rescanned once.
+  DyndepLoader loader(state_, disk_interface_);
+  vector<DyndepFile> files(readers.size());
+  vector<Node*> nodes;
+  vector<const DyndepFile*> loaded;
+  bool success = true;
+  for (size_t i = 0; i < readers.size(); ++i) {
+    DyndepReader* reader = readers[i];
+    if (success) {
+      EXPLAIN("loading dyndep file '%s'", reader->path_.c_str());
+      if (!reader->success_) {
+        *err = reader->err_;
+        success = false;
+      } else if (!DyndepParser::Resolve(state_, reader->statements_,
+                                        &files[i], err)) {
+        success = false;
+      } else if (reader->node_->dyndep_pending() &&  // Else rescanned since.
+                 !loader.UpdateEdges(reader->node_, &files[i], err)) {
+        success = false;
+      }
+      nodes.push_back(reader->node_);
+      loaded.push_back(&files[i]);
+    }
+    delete reader;
+  }
+  if (!success)
+    return false;
+
+  // Update the build plan to account for dyndep modifications to the graph.
+  if (!plan_.DyndepsLoaded(&scan_, nodes, loaded, err))
+    return false;
+
+  // New command edges may have been added to the plan.
+  status_->PlanHasTotalEdges(plan_.command_edge_count());
+  return true;
+}
@@ -16,6 +16,7 @@
 #define NINJA_BUILD_H_
 
 #include <cstdio>
+#include <deque>
 #include <map>
 #include <memory>
 #include <queue>
@@ -23,19 +24,31 @@
 #include <string>
 #include <vector>
 
+#include "affinity.h"
+#include "clparser.h"  // IncludesCache
 #include "depfile_parser.h"
 #include "graph.h"  // XXX needed for DependencyScan; should rearrange.
 #include "exit_status.h"
+#include "hash_map.h"
 #include "line_printer.h"
 #include "metrics.h"
+#include "parallel.h"
+#include "state.h"  // EdgePriorityQueue
 #include "util.h"  // int64_t
 
+struct BuildDirLock;
 struct BuildLog;
 struct BuildStatus;
+struct ActionCache;
 struct Builder;
+struct DigestLog;
 struct DiskInterface;
 struct Edge;
+struct Jobserver;
+struct LazyDiskInterface;
 struct Node;
+struct RemoteLauncher;
+struct ResumeLog;
 struct State;
 
 /// Plan stores the state of a build plan: what we intend to build,
@@ -48,16 +61,86 @@ struct Plan {
   /// fill in |err| with an error message if there's a problem.
   bool AddTarget(Node* node, string* err);
 
+  /// Weigh every wanted edge by its critical path, using the durations
+  /// recorded in |build_log| (which may be NULL), and queue the edges that
+  /// are ready to run.  The edges that |resume_log| (which may be NULL)
+  /// lists as failed, and those they need, go ahead of the others.  Edges
+  /// added by AddTarget() are not scheduled until this runs; FindWork()
+  /// calls it with no logs if nobody else has.  Only the first call after
+  /// construction or Reset() has any effect.
+  void PrepareQueue(BuildLog* build_log, const ResumeLog* resume_log = NULL);
+
   // Pop a ready edge off the queue of edges to build.
   // Returns NULL if there's no work to do.
   Edge* FindWork();
 
+  /// Put back an edge FindWork() returned, to be started later.
+  void ReturnWork(Edge* edge) { ready_.push(edge); }
+
+  /// Choose how FindWork() picks among the ready edges; see
+  /// EdgePriorityQueue.  Only before edges are scheduled.
+  void set_scheduling(EdgePriorityQueue::Policy policy) {
+    ready_.set_policy(policy);
+  }
+
+  /// Let edges that read their dependencies into the deps log start before
+  /// their order-only inputs are ready, when none of the dependencies
+  /// recorded the last time they ran are still to be built.  Only before
+  /// edges are scheduled.
+  void set_speculate(bool speculate) { speculate_ = speculate; }
+
+  /// Whether |edge| was started before its order-only inputs were ready.
+  bool StartedEarly(const Edge* edge) const {
+    return started_early_.count(edge) > 0;
+  }
+
+  /// Whether |edge|, started early, read only the files among |deps| that
+  /// were there when it started.
+  bool EarlyStartHeld(const Edge* edge, const vector<Node*>& deps) const;
+
+  /// Throw away the run of |edge| that was started early, and run it again
+  /// once all of its inputs are ready.
+  void RetryEarlyStart(Edge* edge);
+
+  /// Count the time |edge| waited to start since it was ready to, under
+  /// -d stats.
+  void EdgeStarted(const Edge* edge);
+
+  /// How long the wanted commands that haven't finished are expected to
+  /// take in all, in milliseconds, from the durations PrepareQueue() had.
+  int64_t remaining_millis() const { return remaining_millis_; }
+
+  /// How long |edge| is expected to take, in milliseconds.
+  int64_t PredictedMillis(const Edge* edge) const {
+    return (size_t)edge->id() < predicted_millis_.size() ?
+        predicted_millis_[edge->id()] : 0;
+  }
+
+  /// The critical path weight of the edge FindWork() would return next, or
+  /// 0 if there is none.
+  int64_t NextWeight() const {
+    return ready_.empty() ? 0 : ready_.top()->critical_path_weight();
+  }
+
   /// Returns true if there's more work to be done.
   bool more_to_do() const { return wanted_edges_ > 0 && command_edges_ > 0; }
 
   /// Dumps the current state of the plan.
   void Dump();
 
+  /// Every edge that joined the plan, in the order it did.
+  const vector<Edge*>& planned() const { return planned_; }
+
+  /// Whether |edge| is wanted, and hasn't finished.
+  bool LeftToRun(const Edge* edge) const {
+    return Planned(edge) && want_[edge->id()] != kWantNothing;
+  }
+
+  /// Whether the command of |edge| failed in this plan.
+  bool Failed(const Edge* edge) const {
+    return (size_t)edge->id() < failed_.size() && failed_[edge->id()];
+  }
+
   enum EdgeResult {
     kEdgeFailed,
     kEdgeSucceeded
@@ -73,6 +156,11 @@ struct Plan {
   /// Return false on error.
   bool CleanNode(DependencyScan* scan, Node* node, string* err);
 
+  /// CleanNode() for each of |nodes|, looking at each edge that reads some
+  /// of them once.
+  bool CleanNodes(DependencyScan* scan, const vector<Node*>& nodes,
+                  string* err);
+
   /// Number of edges with commands to run.
   int command_edge_count() const { return command_edges_; }
 
@@ -83,8 +171,14 @@ struct Plan {
   /// by information loaded from a dyndep file.
   bool DyndepsLoaded(DependencyScan* scan, Node* node,
                      const DyndepFile& ddf, string* err);
+
+  /// Like DyndepsLoaded(), for the dyndep files of |nodes|, loaded into the
+  /// corresponding |files|.  Their dependents are rescanned in one pass.
+  bool DyndepsLoaded(DependencyScan* scan, const vector<Node*>& nodes,
+                     const vector<const DyndepFile*>& files, string* err);
 private:
-  bool RefreshDyndepDependents(DependencyScan* scan, Node* node, string* err);
+  bool RefreshDyndepDependents(DependencyScan* scan,
+                               const vector<Node*>& nodes, string* err);
   void UnmarkDependents(Node* node, set<Node*>* dependents);
   bool AddSubTarget(Node* node, Node* dependent, string* err,
                     set<Edge*>* dyndep_walk);
@@ -95,9 +189,17 @@ private:
   /// Returns 'false' if loading dyndep info fails and 'true' otherwise.
   bool NodeFinished(Node* node, string* err);
 
+  /// Set the critical path weight of every edge in want_: its expected
+  /// duration plus the heaviest weight among the wanted edges that depend
+  /// on it.  Set Edge::fail_first() of the edges |resume_log| lists as
+  /// failed and of the wanted edges they depend on.
+  void ComputeCriticalPath(BuildLog* build_log, const ResumeLog* resume_log);
+
   /// Enumerate possible steps we want for an edge.
   enum Want
   {
+    /// The edge is not in the plan: we want neither it nor its dependents.
+    kNotInPlan,
     /// We do not want to build the edge, but we might want to build one of
     /// its dependents.
     kWantNothing,
@@ -109,20 +211,60 @@ private:
   };
 
   void EdgeWanted(const Edge* edge);
-  bool EdgeMaybeReady(map<Edge*, Want>::iterator want_e, string* err);
+  bool EdgeMaybeReady(Edge* edge, string* err);
+
+  /// Whether the wanted |edge| can be scheduled: all of its inputs are
+  /// ready, or all but the order-only ones are and set_speculate() lets it
+  /// start early.
+  bool CanStart(const Edge* edge) const;
 
   /// Submits a ready edge as a candidate for execution.
   /// The edge may be delayed from running, for example if it's a member of a
   /// currently-full pool.
-  void ScheduleWork(map<Edge*, Want>::iterator want_e);
+  void ScheduleWork(Edge* edge);
+
+  /// What we want for |edge|, which joins the plan if it's given a value
+  /// other than kNotInPlan.
+  Want& WantFor(const Edge* edge);
+
+  /// Whether |edge| is in the plan.
+  bool Planned(const Edge* edge) const {
+    return (size_t)edge->id() < want_.size() && want_[edge->id()] != kNotInPlan;
+  }
+
+  /// Keep track of which edges we want to build in this plan, indexed by
+  /// edge id.  The enumeration indicates what we want for the edge.
+  vector<Want> want_;
+
+  /// Every edge that joined the plan, in the order it did; those that
+  /// finished since are kNotInPlan again.
+  vector<Edge*> planned_;
 
-  /// Keep track of which edges we want to build in this plan.  If this map does
-  /// not contain an entry for an edge, we do not want to build the entry or its
-  /// dependents.  If it does contain an entry, the enumeration indicates what
-  /// we want for the edge.
-  map<Edge*, Want> want_;
+  /// Edges ready to run, in the order FindWork() hands them out.
+  EdgePriorityQueue ready_;
 
-  set<Edge*> ready_;
+  /// When each edge that hasn't started yet became ready to, under -d stats.
+  map<const Edge*, int64_t> ready_micros_;
+
+  /// Whether PrepareQueue() has run since the last Reset().
+  bool prepared_;
+
+  /// The expected duration of each wanted edge, by edge id, and the total
+  /// of those that haven't finished.
+  vector<int64_t> predicted_millis_;
+  int64_t remaining_millis_;
+
+  bool speculate_;
+  /// Edges started early, with the value of finished_edges_ when they were.
+  map<const Edge*, int> started_early_;
+  /// Edges that failed their early start, which wait for all their inputs.
+  set<const Edge*> early_start_failed_;
+  /// The value of finished_edges_ once each edge finished, by edge id, or 0
+  /// for the edges that didn't finish in this plan.
+  vector<int> finished_at_;
+  int finished_edges_;
+  /// Whether the command of each edge failed, by edge id.
+  vector<bool> failed_;
 
   Builder* builder_;
 
@@ -143,23 +285,62 @@ struct CommandRunner {
 
   /// The result of waiting for a command.
   struct Result {
-    Result() : edge(NULL) {}
+    Result() : edge(NULL), output_spill(NULL) {}
     Edge* edge;
     ExitStatus status;
     string output;
+    /// The output that came after |output|, in a temporary file, for
+    /// commands that printed a lot.  Whoever finishes the command closes it.
+    FILE* output_spill;
+    ResourceUsage usage;
     bool success() const { return status == ExitSuccess; }
   };
   /// Wait for a command to complete, or return false if interrupted.
-  virtual bool WaitForCommand(Result* result) = 0;
+  /// If |timeout_millis| is non-negative and no command completes in that
+  /// time, return true and leave |result->edge| NULL.
+  virtual bool WaitForCommand(Result* result, int timeout_millis) = 0;
+
+  /// Whether a command has completed, so that WaitForCommand() won't block.
+  virtual bool HasFinishedCommand() const { return false; }
 
   virtual vector<Edge*> GetActiveEdges() { return vector<Edge*>(); }
   virtual void Abort() {}
 };
 
+/// Told how a build goes, for a program that runs builds in its own
+/// process and shows them its own way, rather than scraping the status
+/// lines; see BuildConfig::observer.  Called on the thread that builds.
+struct BuildObserver {
+  virtual ~BuildObserver() {}
+  /// The build started.
+  virtual void BuildStarted() {}
+  /// The build has |total| edges to run, which changes as it goes when
+  /// dyndep files add edges to it, or edges run again.
+  virtual void EdgesPlanned(int /*total*/) {}
+  /// |edge| started, the |started|th of the |total| edges to run so far.
+  virtual void EdgeStarted(const Edge* /*edge*/, int /*started*/,
+                           int /*total*/) {}
+  /// |edge| ended, the |finished|th of |total|, printing |output|.
+  virtual void EdgeFinished(const Edge* /*edge*/, bool /*success*/,
+                            const string& /*output*/, int /*finished*/,
+                            int /*total*/) {}
+  /// The run of |edge| that started last is thrown away, not to be
+  /// reported as finished; the edge starts again later.
+  virtual void EdgeDiscarded(const Edge* /*edge*/) {}
+  /// The build stopped, done or not.
+  virtual void BuildFinished() {}
+};
+
 /// Options (e.g. verbosity, parallelism) passed to a build.
 struct BuildConfig {
   BuildConfig() : verbosity(NORMAL), dry_run(false), parallelism(1),
-                  failures_allowed(1), max_load_average(-0.0f) {}
+                  failures_allowed(1), max_load_average(-0.0f),
+                  max_cpu_pressure(0), min_available_memory(0),
+                  scheduling(EdgePriorityQueue::kCriticalPath),
+                  critical_reserve(0), speculate(false),
+                  affinity(CpuPlacer::kNone), jobserver(NULL),
+                  action_cache(NULL), lazy_outputs(false), remote(NULL),
+                  observer(NULL), build_dir_lock(NULL) {}
 
   enum Verbosity {
     NORMAL,
@@ -173,9 +354,111 @@ struct BuildConfig {
   /// The maximum load average we must not exceed. A negative value
   /// means that we do not have any limit.
   double max_load_average;
+  /// The share of the time, from 0 to 1, that tasks may wait for a CPU,
+  /// as CpuPressure tells, for another command to start while others run.
+  /// Zero means no limit.
+  double max_cpu_pressure;
+  /// The number of bytes of memory that must remain available to start
+  /// another command while others run. Zero means no limit.
+  int64_t min_available_memory;
+  /// How to choose the next command among those ready to run.
+  EdgePriorityQueue::Policy scheduling;
+  /// How many of the |parallelism| slots are kept for the edges on the
+  /// critical path: an edge lighter than one already running doesn't start
+  /// while that many slots or fewer are free.  Zero keeps none.
+  int critical_reserve;
+  /// Whether to start commands before their order-only inputs are ready
+  /// when the deps log says they don't read them; see Plan::set_speculate().
+  bool speculate;
+  /// Which processors each local command runs on.
+  CpuPlacer::Policy affinity;
+  /// If set, every command beyond the first needs a token from this
+  /// jobserver, on top of the other limits.
+  Jobserver* jobserver;
+  /// If set, the edges it can cache take their outputs from it when it
+  /// has them, and put them there when they ran.
+  ActionCache* action_cache;
+  /// Whether the outputs of cache hits are only promised, to be written
+  /// once needed; see LazyDiskInterface.
+  bool lazy_outputs;
+  /// If set, the commands of edges that don't have to run locally run
+  /// through it instead.
+  RemoteLauncher* remote;
+  /// If set, told of every edge that starts and ends, on top of the status
+  /// output; QUIET leaves out the latter.
+  BuildObserver* observer;
+  /// If set, the outputs of each command are locked while it runs, and a
+  /// command whose outputs another process has locked waits for it.
+  BuildDirLock* build_dir_lock;
   DepfileParserOptions depfile_parser_options;
 };
 
+/// Where the time of Builder::Build() goes: waiting for commands, or the
+/// work Ninja does between them, which at a high -j can be what keeps
+/// commands from starting.  The parts don't overlap: a part that counts
+/// inside another, like writing the logs for a finished command, has the
+/// time counted to it alone, and what no part has is the loop's own.
+struct BuildLoopProfile {
+  enum Part {
+    kLoop,
+    kWait,    // For commands to finish.
+    kStart,   // Starting commands.
+    kFinish,  // Taking in finished commands, besides:
+    kDeps,    // the dependencies they found,
+    kPlan,    // updating the plan, and finding the next work,
+    kLogs,    // writing the build, deps and digest logs,
+    kStatus,  // printing the status and their output.
+    kParts
+  };
+
+  BuildLoopProfile();
+
+  /// Start counting, to kLoop, or stop.
+  void Start();
+  void Stop();
+
+  /// Count the time from now on to |part|, returning the part it was
+  /// counted to before.  Does nothing while stopped.
+  Part Enter(Part part);
+
+  int64_t micros(Part part) const { return micros_[part]; }
+  /// How long the loop ran.
+  int64_t total_micros() const;
+  /// The share of total_micros() not spent waiting for commands, in
+  /// percent.
+  double overhead_percent() const;
+  /// A line of the overhead and what it went to, as -d stats prints it.
+  string Summary() const;
+
+  /// If |interval_micros| passed since the last sample, fill in the share
+  /// of the time since then that each part took, in percent, and return
+  /// true.
+  bool Sample(int64_t interval_micros,
+              vector<pair<const char*, double> >* shares);
+
+  static const char* PartName(Part part);
+
+ private:
+  int64_t micros_[kParts];
+  Part current_;
+  bool running_;
+  int64_t since_;
+  int64_t start_, end_;
+  int64_t sampled_[kParts];
+  int64_t sampled_at_;
+};
+
+/// Counts the time of a scope to a part of a BuildLoopProfile.
+struct ScopedLoopPart {
+  ScopedLoopPart(BuildLoopProfile* profile, BuildLoopProfile::Part part)
+      : profile_(profile), previous_(profile->Enter(part)) {}
+  ~ScopedLoopPart() { profile_->Enter(previous_); }
+
+ private:
+  BuildLoopProfile* profile_;
+  BuildLoopProfile::Part previous_;
+};
+
 /// Builder wraps the build process: starting commands, updating status.
 struct Builder {
   Builder(State* state, const BuildConfig& config,
@@ -210,9 +493,33 @@ struct Builder {
     scan_.set_build_log(log);
   }
 
-  /// Load the dyndep information provided by the given node.
+  /// Record the inputs of the edges that ask for it in |log|, and check
+  /// them against it; see DigestLog.
+  void SetDigestLog(DigestLog* log) {
+    scan_.set_digest_log(log);
+  }
+
+  /// Take the edges that |log| lists as left to run by an earlier build to
+  /// be dirty still; see ResumeLog.
+  void SetResumeLog(const ResumeLog* log) {
+    scan_.set_resume_log(log);
+  }
+
+  /// Promise the outputs the action cache restores to |lazy|, which must
+  /// be the DiskInterface the builder works through, and write out the
+  /// promised inputs of the commands that run.
+  void SetLazyOutputs(LazyDiskInterface* lazy) {
+    lazy_outputs_ = lazy;
+  }
+
+  /// Load the dyndep information provided by the given node.  While
+  /// commands run in parallel this only starts reading it, and the build
+  /// loop applies it later.
   bool LoadDyndeps(Node* node, string* err);
 
+  /// Where the time of the last Build() went.
+  const BuildLoopProfile& loop_profile() const { return loop_profile_; }
+
   State* state_;
   const BuildConfig& config_;
   Plan plan_;
@@ -224,13 +531,119 @@ struct Builder {
   BuildStatus* status_;
 
  private:
-   bool ExtractDeps(CommandRunner::Result* result, const string& deps_type,
-                    const string& deps_prefix, vector<Node*>* deps_nodes,
-                    string* err);
+  struct DepsReader;
+  struct DyndepReader;
+  struct RspfileWriter;
+
+  /// Start the command of |edge|, whose rspfile, if any, is written.
+  bool StartEdgeCommand(Edge* edge, string* err);
+
+  /// Create the directories the outputs of |edge| go in, where they
+  /// aren't known to exist already.
+  bool MakeOutputDirs(const Edge* edge);
+  /// The directories known to exist, as prefixes of the paths of the
+  /// outputs they were found for.
+  ExternalStringHashMap<bool>::Type known_dirs_;
+
+  /// Start the commands whose rspfiles have been written, waiting for one
+  /// first if |wait|.
+  bool FinishRspfiles(bool wait, string* err);
+
+  /// Remove the rspfiles of the commands that succeeded.
+  void RemoveRspfiles();
+
+  /// Remove the depfile |path|, whose dependencies have been recorded,
+  /// with others in a batch on another thread once there are enough of
+  /// them, or when the build ends.
+  void RemoveDepfile(const string& path);
+
+  /// Remove the depfiles still queued, and wait for those being removed.
+  void RemoveDepfiles();
+
+  /// Start reading the dependencies of the command in |result| on another
+  /// thread, if they are to be read that way.
+  bool ReadDepsInBackground(CommandRunner::Result* result);
+
+  /// Record a command whose dependencies have been read.
+  bool FinishCommand(DepsReader* reader, string* err);
+
+  bool FinishCommand(CommandRunner::Result* result, const string& deps_type,
+                     const vector<Node*>& deps_nodes, string* err);
+
+  /// Whether the memory |edge| used when it last ran, according to the
+  /// build log, is available now without going below
+  /// BuildConfig::min_available_memory.
+  bool FitsInMemory(const Edge* edge) const;
+
+  /// Stat every one of |paths| into |mtimes|, several at once if the disk
+  /// interface can.  Returns false with |err| set if a stat fails.
+  bool StatAll(const vector<const string*>& paths, vector<TimeStamp>* mtimes,
+               string* err);
+
+  /// Whether |edge| may start with |running| commands running, keeping
+  /// BuildConfig::critical_reserve slots for edges at least as heavy as
+  /// the heaviest of them.
+  bool LeavesRoomForCriticalPath(const Edge* edge, int running) const;
 
   DiskInterface* disk_interface_;
   DependencyScan scan_;
 
+  BuildLoopProfile loop_profile_;
+
+  /// Normalized /showIncludes paths, shared by the deps=msvc edges.
+  IncludesCache includes_cache_;
+
+  /// Reads dependencies of finished commands while more commands start.
+  TaskQueue deps_readers_;
+  bool read_deps_in_background_;
+
+  /// Reads dyndep files as they are built, while the build goes on.
+  TaskQueue dyndep_readers_;
+
+  /// Writes rspfiles while other commands start.
+  TaskQueue rspfile_writers_;
+
+  /// The rspfiles of the commands that succeeded, removed all at once when
+  /// the build ends.
+  vector<string> finished_rspfiles_;
+
+  /// Removes batches of finished_depfiles_ while the build goes on, where
+  /// the disk interface allows it.
+  TaskQueue depfile_removers_;
+  /// The depfiles read, waiting for a batch.
+  vector<string> finished_depfiles_;
+
+  /// Update the graph and the plan with every dyndep file that has been
+  /// read, waiting for one first if |wait|.
+  bool FinishDyndeps(bool wait, string* err);
+
+  /// The inputs digests of the running commands that record one, taken
+  /// when they started.
+  map<const Edge*, uint64_t> input_digests_;
+
+  /// A command whose outputs came from the action cache, to be finished
+  /// as though it had run.
+  struct CachedCommand {
+    CommandRunner::Result result;
+    vector<Node*> deps_nodes;
+  };
+  /// Restore the outputs of |edge| from the action cache, if it can.
+  bool RestoreFromCache(Edge* edge);
+  deque<CachedCommand> cached_commands_;
+  /// The edges of cached_commands_ and of those being finished, which
+  /// aren't stored again.
+  set<const Edge*> restored_edges_;
+  LazyDiskInterface* lazy_outputs_;
+
+  /// Take back the edges that waited for another process to be done with
+  /// their outputs, once it is.  The edges it built are finished, the
+  /// others go back to the plan.
+  bool CheckEdgesElsewhere(string* err);
+  /// The edges whose outputs another process has locked, with the end of
+  /// the lock's list of edges that succeeded when they were found so.
+  map<Edge*, int64_t> elsewhere_;
+  int64_t elsewhere_checked_millis_;
+
   // Unimplemented copy ctor and operator= ensure we don't copy the auto_ptr.
   Builder(const Builder &other);        // DO NOT IMPLEMENT
   void operator=(const Builder &other); // DO NOT IMPLEMENT
@@ -242,11 +655,25 @@ struct BuildStatus {
   void PlanHasTotalEdges(int total);
   void BuildEdgeStarted(Edge* edge);
   void BuildEdgeFinished(Edge* edge, bool success, const string& output,
+                         FILE* output_spill,
                          int* start_time, int* end_time);
+  /// Forget the run of |edge| that just ended, without reporting it, for an
+  /// edge that is going to run again.
+  void BuildEdgeDiscarded(Edge* edge);
+  /// Take the expected durations of the remaining edges from |plan|, for
+  /// the %E placeholder.
+  void set_plan(const Plan* plan) { plan_ = plan; }
   void BuildLoadDyndeps();
   void BuildStarted();
   void BuildFinished();
 
+  /// Milliseconds until a status line held back by rate limiting is due,
+  /// or -1 if there is none.
+  int MillisUntilRefresh() const;
+
+  /// Print the status line held back by rate limiting, if any.
+  void Refresh();
+
   enum EdgeStatus {
     kEdgeStarted,
     kEdgeFinished,
@@ -260,16 +687,53 @@ struct BuildStatus {
   string FormatProgressStatus(const char* progress_status_format,
                               EdgeStatus status) const;
 
+  /// How often a smart terminal's status line is redrawn, at most.
+  static const int kRefreshMillis = 50;
+
+  /// How often the list of running edges is redrawn when nothing else
+  /// changes, to keep their elapsed times current.
+  static const int kTickMillis = 1000;
+
  private:
-  void PrintStatus(Edge* edge, EdgeStatus status);
+  /// Print the status line for |edge|.  On a smart terminal this is held
+  /// back if the line was redrawn less than kRefreshMillis ago, unless
+  /// |force| is set; Refresh() prints it later.
+  void PrintStatus(Edge* edge, EdgeStatus status, bool force = false);
+
+  /// Print some of a command's output on a new line, without the escape
+  /// codes the terminal can't show.
+  void PrintOutput(const string& output);
 
   const BuildConfig& config_;
 
   /// Time the build started.
   int64_t start_time_millis_;
 
+  /// When the status line was last printed, the edge and status it was
+  /// (or is next to be) printed for, and whether that is held back.
+  int64_t last_status_millis_;
+  Edge* last_edge_;
+  EdgeStatus last_edge_status_;
+  bool refresh_pending_;
+
+  /// How many running edges to list below the status line, from
+  /// $NINJA_STATUS_LINES.  Zero shows just the status line.
+  int status_lines_;
+
+  /// The lines listing the running edges, oldest first, and the pools
+  /// they fill.
+  vector<string> FormatRunningEdges() const;
+
   int started_edges_, finished_edges_, total_edges_;
 
+  /// The plan of the build, if there is one to estimate its end from.
+  const Plan* plan_;
+
+  /// Seconds until the build is expected to finish: the longest of the
+  /// heaviest critical path left and the remaining work spread over the
+  /// parallelism.
+  double EstimateRemainingSeconds() const;
+
   /// Map of running edge to time the edge started running.
   typedef map<Edge*, int> RunningEdgeMap;
   RunningEdgeMap running_edges_;
@@ -0,0 +1,262 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "build_dir_lock.h"
+
+#include <algorithm>
+#include <set>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "build_log.h"
+#include "graph.h"
+
+namespace {
+
+// The bytes of the lock file: the first is held by the process that owns
+// the logs, the next kMaxPid by the processes writing side logs, each at
+// its pid, and the rest by the outputs of running edges, each at a hash of
+// its path.
+const int64_t kLogsOffset = 0;
+const int64_t kMaxPid = 1 << 22;  // Linux's limit.
+const int64_t kOutputsOffset = 1 + kMaxPid;
+const int64_t kOutputsRange = (int64_t)1 << 40;
+
+int64_t SideLogsOffset(int pid) {
+  return 1 + pid % kMaxPid;
+}
+
+int64_t OutputOffset(const Node* node) {
+  uint64_t hash = BuildLog::LogEntry::HashCommand(node->path()).low;
+  return kOutputsOffset + (int64_t)(hash % kOutputsRange);
+}
+
+}  // anonymous namespace
+
+BuildDirLock::BuildDirLock() : fd_(-1), owns_logs_(true) {}
+
+BuildDirLock::~BuildDirLock() {
+  Close();
+}
+
+#ifndef _WIN32
+
+bool BuildDirLock::Open(const string& prefix, string* err) {
+  Close();
+  prefix_ = prefix;
+  string path = prefix + ".ninja_lock";
+  fd_ = open(path.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+  if (fd_ < 0) {
+    *err = "opening " + path + ": " + strerror(errno);
+    return false;
+  }
+  owns_logs_ = Lock(kLogsOffset);
+  if (owns_logs_) {
+    // With nobody else about, the list of edges that succeeded can start
+    // over.
+    if (!IsLocked(1, kMaxPid) && ftruncate(fd_, 0) < 0) {
+      *err = "truncating " + path + ": " + strerror(errno);
+      Close();
+      return false;
+    }
+    return true;
+  }
+
+  // Side logs left by an earlier process with the same pid may not have
+  // been merged yet; don't add to those.
+  int pid = getpid();
+  if (!Lock(SideLogsOffset(pid))) {
+    *err = string("locking ") + path + ": " + strerror(errno);
+    Close();
+    return false;
+  }
+  for (int n = 0; ; ++n) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%d.%d", pid, n);
+    struct stat st;
+    if (stat((prefix + ".ninja_log" + suffix).c_str(), &st) < 0 &&
+        stat((prefix + ".ninja_deps" + suffix).c_str(), &st) < 0) {
+      side_suffix_ = suffix;
+      break;
+    }
+  }
+  return true;
+}
+
+void BuildDirLock::Close() {
+  if (fd_ >= 0)
+    close(fd_);  // Which drops all of the locks.
+  fd_ = -1;
+  owns_logs_ = true;
+  side_suffix_.clear();
+  locked_.clear();
+}
+
+vector<string> BuildDirLock::FinishedSideLogs() const {
+  static const char* const kLogs[] = {
+    ".ninja_log.", ".ninja_deps.", ".ninja_digests."
+  };
+  set<string> suffixes;
+  if (DIR* dir = opendir(prefix_.empty() ? "." : prefix_.c_str())) {
+    while (struct dirent* entry = readdir(dir)) {
+      for (size_t i = 0; i < sizeof(kLogs) / sizeof(kLogs[0]); ++i) {
+        size_t len = strlen(kLogs[i]);
+        if (strncmp(entry->d_name, kLogs[i], len) == 0)
+          suffixes.insert(entry->d_name + len - 1);
+      }
+    }
+    closedir(dir);
+  }
+  vector<string> finished;
+  for (set<string>::iterator s = suffixes.begin(); s != suffixes.end(); ++s) {
+    int pid = atoi(s->c_str() + 1);
+    if (pid > 0 && !IsLocked(SideLogsOffset(pid)))
+      finished.push_back(*s);
+  }
+  return finished;
+}
+
+bool BuildDirLock::LockOutputs(const Edge* edge) {
+  if (fd_ < 0)
+    return true;
+  vector<int64_t>& offsets = locked_[edge];
+  for (vector<Node*>::const_iterator o = edge->outputs_.begin();
+       o != edge->outputs_.end(); ++o) {
+    int64_t offset = OutputOffset(*o);
+    // Outputs whose hashes collide just share the byte.
+    if (find(offsets.begin(), offsets.end(), offset) != offsets.end())
+      continue;
+    if (!Lock(offset)) {
+      UnlockOutputs(edge);
+      return false;
+    }
+    offsets.push_back(offset);
+  }
+  return true;
+}
+
+void BuildDirLock::UnlockOutputs(const Edge* edge, bool succeeded) {
+  map<const Edge*, vector<int64_t> >::iterator i = locked_.find(edge);
+  if (i == locked_.end())
+    return;
+  if (succeeded && !edge->outputs_.empty()) {
+    // One write to a file opened for appending goes in whole.  Failing to
+    // list the edge just means that whoever waits for it runs it again.
+    string line = edge->outputs_[0]->path() + "\n";
+    ssize_t written = write(fd_, line.data(), line.size());
+    (void)written;
+  }
+  for (vector<int64_t>::iterator o = i->second.begin(); o != i->second.end();
+       ++o)
+    Unlock(*o);
+  locked_.erase(i);
+}
+
+void BuildDirLock::UnlockAllOutputs() {
+  while (!locked_.empty())
+    UnlockOutputs(locked_.begin()->first);
+}
+
+int64_t BuildDirLock::ListEnd() const {
+  struct stat st;
+  return fd_ >= 0 && fstat(fd_, &st) == 0 ? st.st_size : 0;
+}
+
+bool BuildDirLock::SucceededSince(const Edge* edge, int64_t position) const {
+  if (fd_ < 0 || edge->outputs_.empty())
+    return false;
+  int64_t end = ListEnd();
+  // The list started over since.
+  if (position > end)
+    position = 0;
+  string list(end - position, '\0');
+  ssize_t len = list.empty() ? 0 : pread(fd_, &list[0], list.size(), position);
+  if (len < 0)
+    return false;
+  list.resize(len);
+  string line = "\n" + edge->outputs_[0]->path() + "\n";
+  list.insert(0, "\n");
+  return list.find(line) != string::npos;
+}
+
+bool BuildDirLock::Lock(int64_t offset) {
+  struct flock lock;
+  memset(&lock, 0, sizeof(lock));
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = offset;
+  lock.l_len = 1;
+  return fcntl(fd_, F_SETLK, &lock) == 0;
+}
+
+void BuildDirLock::Unlock(int64_t offset) {
+  struct flock lock;
+  memset(&lock, 0, sizeof(lock));
+  lock.l_type = F_UNLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = offset;
+  lock.l_len = 1;
+  fcntl(fd_, F_SETLK, &lock);
+}
+
+bool BuildDirLock::IsLocked(int64_t offset, int64_t length) const {
+  // F_GETLK doesn't see this process's own locks.
+  struct flock lock;
+  memset(&lock, 0, sizeof(lock));
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = offset;
+  lock.l_len = length;
+  return fd_ >= 0 && fcntl(fd_, F_GETLK, &lock) == 0 &&
+      lock.l_type != F_UNLCK;
+}
+
+#else  // _WIN32
+
+bool BuildDirLock::Open(const string& prefix, string* err) {
+  return true;
+}
+
+void BuildDirLock::Close() {}
+
+vector<string> BuildDirLock::FinishedSideLogs() const {
+  return vector<string>();
+}
+
+bool BuildDirLock::LockOutputs(const Edge* edge) {
+  return true;
+}
+
+void BuildDirLock::UnlockOutputs(const Edge* edge, bool succeeded) {}
+
+void BuildDirLock::UnlockAllOutputs() {}
+
+int64_t BuildDirLock::ListEnd() const {
+  return 0;
+}
+
+bool BuildDirLock::SucceededSince(const Edge* edge, int64_t position) const {
+  return false;
+}
+
+#endif  // _WIN32
@@ -0,0 +1,96 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_BUILD_DIR_LOCK_H_
+#define NINJA_BUILD_DIR_LOCK_H_
+
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "util.h"  // int64_t
+
+struct Edge;
+
+/// Lets several ninja processes build in one build directory at once,
+/// through the parts of its lock file, .ninja_lock, that they lock.
+///
+/// The first process to come owns the logs and appends to them.  The
+/// others append what they record to side logs of their own, the logs'
+/// paths with side_suffix() added, which the next process to own the logs
+/// merges in once the one that wrote them is gone (see NinjaMain).
+///
+/// While an edge runs, its outputs are locked, so that another process
+/// wanting to run it waits for it to finish instead and then only runs it
+/// if it failed (see Builder).  The file itself lists the edges that
+/// succeeded, by their first output, for the processes waiting on them.
+///
+/// The locks are POSIX record locks on single bytes of the file, which go
+/// with the process that held them, however it ends.  On Windows nothing
+/// is locked, and every process owns the logs.
+struct BuildDirLock {
+  BuildDirLock();
+  ~BuildDirLock();
+
+  /// Open the lock file in the directory that |prefix| is, "" or ending in
+  /// a slash, and take the logs if no other process owns them.
+  bool Open(const string& prefix, string* err);
+  void Close();
+
+  bool is_open() const { return fd_ >= 0; }
+
+  /// Whether this process appends to the logs themselves.
+  bool owns_logs() const { return owns_logs_; }
+
+  /// What the side logs of this process add to the paths of the logs,
+  /// when it doesn't own them.
+  const string& side_suffix() const { return side_suffix_; }
+
+  /// The suffixes of the side logs in the directory whose process is gone,
+  /// to merge in.
+  vector<string> FinishedSideLogs() const;
+
+  /// Lock the outputs of |edge|, or return false, locking none of them, if
+  /// another process holds one.
+  bool LockOutputs(const Edge* edge);
+
+  /// Unlock the outputs of |edge| if they are locked, noting first if it
+  /// |succeeded|.
+  void UnlockOutputs(const Edge* edge, bool succeeded = false);
+
+  /// Unlock the outputs of every edge.
+  void UnlockAllOutputs();
+
+  /// Where the list of the edges that succeeded ends.
+  int64_t ListEnd() const;
+
+  /// Whether |edge| was listed as having succeeded past |position|.
+  bool SucceededSince(const Edge* edge, int64_t position) const;
+
+ private:
+  bool Lock(int64_t offset);
+  void Unlock(int64_t offset);
+  bool IsLocked(int64_t offset, int64_t length = 1) const;
+
+  /// The directory, as given to Open().
+  string prefix_;
+  int fd_;
+  bool owns_logs_;
+  string side_suffix_;
+  /// The bytes locked for each edge.
+  map<const Edge*, vector<int64_t> > locked_;
+};
+
+#endif  // NINJA_BUILD_DIR_LOCK_H_
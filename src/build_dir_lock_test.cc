@@ -0,0 +1,136 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "build_dir_lock.h"
+
+#include <stdio.h>
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "graph.h"
+#include "test.h"
+
+namespace {
+
+#ifndef _WIN32
+
+struct BuildDirLockTest : public StateTestWithBuiltinRules {
+  virtual void SetUp() {
+    temp_dir_.CreateAndEnter("BuildDirLockTest");
+    ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"build out: cat in\n"
+"build other: cat in\n"));
+  }
+  virtual void TearDown() {
+    temp_dir_.Cleanup();
+  }
+
+  /// Run |check| in another process, as the locks of this one don't
+  /// conflict with each other, and return its exit code.
+  int InOtherProcess(int (*check)(Edge* out, Edge* other)) {
+    pid_t pid = fork();
+    if (pid == 0)
+      _exit(check(GetNode("out")->in_edge(), GetNode("other")->in_edge()));
+    int status = 0;
+    waitpid(pid, &status, 0);
+    last_pid_ = pid;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+  }
+
+  ScopedTempDir temp_dir_;
+  pid_t last_pid_;
+};
+
+int CheckAsGuest(Edge* out, Edge* other) {
+  BuildDirLock lock;
+  string err;
+  if (!lock.Open("", &err))
+    return 1;
+  if (lock.owns_logs() || lock.side_suffix().empty())
+    return 2;
+  if (lock.LockOutputs(out))
+    return 3;
+  if (!lock.LockOutputs(other))
+    return 4;
+  return 0;
+}
+
+int CheckAsOwner(Edge* /*out*/, Edge* /*other*/) {
+  BuildDirLock lock;
+  string err;
+  if (!lock.Open("", &err))
+    return 1;
+  return lock.owns_logs() ? 0 : 2;
+}
+
+TEST_F(BuildDirLockTest, OwnsLogsAndOutputs) {
+  BuildDirLock lock;
+  string err;
+  ASSERT_TRUE(lock.Open("", &err));
+  EXPECT_TRUE(lock.owns_logs());
+  EXPECT_EQ("", lock.side_suffix());
+
+  Edge* out = GetNode("out")->in_edge();
+  ASSERT_TRUE(lock.LockOutputs(out));
+  EXPECT_EQ(0, InOtherProcess(CheckAsGuest));
+
+  // The edge is listed once it succeeded.
+  int64_t position = lock.ListEnd();
+  EXPECT_FALSE(lock.SucceededSince(out, position));
+  lock.UnlockOutputs(out, true);
+  EXPECT_TRUE(lock.SucceededSince(out, position));
+  EXPECT_FALSE(lock.SucceededSince(out, lock.ListEnd()));
+  EXPECT_FALSE(lock.SucceededSince(GetNode("other")->in_edge(), position));
+
+  // A failure isn't.
+  ASSERT_TRUE(lock.LockOutputs(out));
+  position = lock.ListEnd();
+  lock.UnlockOutputs(out, false);
+  EXPECT_FALSE(lock.SucceededSince(out, position));
+
+  lock.Close();
+  EXPECT_EQ(0, InOtherProcess(CheckAsOwner));
+}
+
+TEST_F(BuildDirLockTest, FinishedSideLogs) {
+  BuildDirLock lock;
+  string err;
+  ASSERT_TRUE(lock.Open("", &err));
+  // Another process, gone now, that didn't own the logs.
+  EXPECT_EQ(2, InOtherProcess(CheckAsOwner));
+
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%d.0", (int)last_pid_);
+  string gone = suffix;
+  FILE* f = fopen((".ninja_log" + gone).c_str(), "w");
+  ASSERT_TRUE(f != NULL);
+  fclose(f);
+  f = fopen((".ninja_deps" + gone).c_str(), "w");
+  ASSERT_TRUE(f != NULL);
+  fclose(f);
+  // Not a side log.
+  f = fopen(".ninja_log.recompact", "w");
+  ASSERT_TRUE(f != NULL);
+  fclose(f);
+
+  vector<string> finished = lock.FinishedSideLogs();
+  ASSERT_EQ(1u, finished.size());
+  EXPECT_EQ(gone, finished[0]);
+}
+
+#endif  // _WIN32
+
+}  // anonymous namespace
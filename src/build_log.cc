@@ -25,6 +25,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 
 #ifndef _WIN32
 #include <inttypes.h>
@@ -34,6 +35,7 @@
 #include "build.h"
 #include "graph.h"
 #include "metrics.h"
+#include "trace.h"
 #include "util.h"
 #if defined(_MSC_VER) && (_MSC_VER < 1800)
 #define strtoll _strtoi64
@@ -45,13 +47,45 @@
 // older runs.
 // Once the number of redundant entries exceeds a threshold, we write
 // out a new file and replace the existing one with it.
+//
+// Since version 6, the rewritten file has a hash index of its entries
+// right after the header, written as comment lines of fixed width:
+//   # index <slots> <entries> <end>
+//   # <hash> <offset>          (once per slot)
+// where <hash> is the MurmurHash64A of an entry's output, <offset> the
+// position of its line in the file and <end> the offset where the
+// indexed entries stop.  Empty slots have offset 0, and collisions are
+// resolved by probing the next slot.  Only the entries appended after
+// <end> are parsed when loading; the indexed ones are decoded as they're
+// looked up.
+//
+// Since version 7, command hashes come from CommandHasher rather than
+// MurmurHash64A, so that commands can be hashed as they're evaluated.
+// The hashes of older logs don't match, and their commands run again.
+//
+// Since version 8, the hash is followed by the resources the command
+// used: user and system CPU time in microseconds, peak RSS in KiB, blocks
+// read and written, and voluntary and involuntary context switches.
+// Lines without them, e.g. in the index of a log being upgraded, read as
+// having used nothing.
+//
+// Since version 9, command hashes are 128 bits, written as 32 hex digits,
+// from a CommandHasher that mixes four lanes at a time.  Older hashes read
+// as their low half, don't match, and their commands run again.
 
 namespace {
 
 const char kFileSignature[] = "# ninja log v%d\n";
-const char kFileColumnLabels[] = "# start_time end_time mtime command hash\n";
+const char kFileColumnLabels[] =
+    "# start_time end_time mtime command hash user_us sys_us max_rss_kib "
+    "in_blocks out_blocks nvcsw nivcsw\n";
 const int kOldestSupportedVersion = 4;
-const int kCurrentVersion = 5;
+const int kCurrentVersion = 9;
+
+const char kIndexHeader[] = "# index %08x %08x %016" PRIx64 "\n";
+const char kIndexSlot[] = "# %016" PRIx64 " %016" PRIx64 "\n";
+const size_t kIndexHeaderSize = 43;
+const size_t kIndexSlotSize = 36;
 
 // 64bit MurmurHash2, by Austin Appleby
 #if defined(_MSC_VER)
@@ -59,21 +93,30 @@ const int kCurrentVersion = 5;
 #else   // defined(_MSC_VER)
 #define BIG_CONSTANT(x) (x##LLU)
 #endif // !defined(_MSC_VER)
+const uint64_t kMurmurSeed = 0xDECAFBADDECAFBADull;
+const uint64_t kMurmurM = BIG_CONSTANT(0xc6a4a7935bd1e995);
+const int kMurmurR = 47;
+
+/// Mix the 8-byte block at |data| into |h|.
+inline uint64_t MurmurMixBlock(uint64_t h, const unsigned char* data) {
+  uint64_t k;
+  memcpy(&k, data, sizeof k);
+  k *= kMurmurM;
+  k ^= k >> kMurmurR;
+  k *= kMurmurM;
+  h ^= k;
+  h *= kMurmurM;
+  return h;
+}
+
 inline
 uint64_t MurmurHash64A(const void* key, size_t len) {
-  static const uint64_t seed = 0xDECAFBADDECAFBADull;
-  const uint64_t m = BIG_CONSTANT(0xc6a4a7935bd1e995);
-  const int r = 47;
-  uint64_t h = seed ^ (len * m);
+  const uint64_t m = kMurmurM;
+  const int r = kMurmurR;
+  uint64_t h = kMurmurSeed ^ (len * m);
   const unsigned char* data = (const unsigned char*)key;
   while (len >= 8) {
-    uint64_t k;
-    memcpy(&k, data, sizeof k);
-    k *= m;
-    k ^= k >> r;
-    k *= m;
-    h ^= k;
-    h *= m;
+    h = MurmurMixBlock(h, data);
     data += 8;
     len -= 8;
   }
@@ -101,52 +144,296 @@ uint64_t MurmurHash64A(const void* key, size_t len) {
 }
 #undef BIG_CONSTANT
 
+inline uint64_t HashPath(StringPiece path) {
+  return MurmurHash64A(path.str_, path.len_);
+}
+
+/// Parse the decimal number at the start of [s, e), as atoi() would.
+int64_t ParseDecimal(const char* s, const char* e) {
+  bool negative = s < e && *s == '-';
+  if (negative)
+    ++s;
+  int64_t value = 0;
+  for (; s < e && *s >= '0' && *s <= '9'; ++s)
+    value = value * 10 + (*s - '0');
+  return negative ? -value : value;
+}
+
+/// Parse the hexadecimal number at the start of [s, e) into |value|.
+/// Returns a pointer past its last digit.
+const char* ParseHex(const char* s, const char* e, uint64_t* value) {
+  *value = 0;
+  for (; s < e; ++s) {
+    int digit;
+    if (*s >= '0' && *s <= '9')
+      digit = *s - '0';
+    else if (*s >= 'a' && *s <= 'f')
+      digit = *s - 'a' + 10;
+    else if (*s >= 'A' && *s <= 'F')
+      digit = *s - 'A' + 10;
+    else
+      break;
+    *value = (*value << 4) | digit;
+  }
+  return s;
+}
+
+/// Parse the fixed-width hexadecimal field [s, e).
+bool ParseHexField(const char* s, const char* e, uint64_t* value) {
+  return ParseHex(s, e, value) == e;
+}
+
+/// Parse the hexadecimal number of up to 32 digits at the start of [s, e)
+/// into |value|; shorter numbers, like the hashes of older logs, only fill
+/// its low half.
+void ParseHex128(const char* s, const char* e, Hash128* value) {
+  const char* low_start = max(s, e - 16);
+  uint64_t high = 0;
+  if (low_start > s)
+    ParseHex(s, low_start, &high);
+  value->high = high;
+  ParseHex(low_start, e, &value->low);
+}
+
+// The primes of xxHash64, by Yann Collet.
+const uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+const uint64_t kPrime3 = 0x165667B19E3779F9ull;
+const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+const uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+inline uint64_t RotateLeft(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t Read64(const unsigned char* p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof v);
+  return v;
+}
+
+/// Mix the 8 bytes |input| into the lane |acc|.
+inline uint64_t MixLane(uint64_t acc, uint64_t input) {
+  acc += input * kPrime2;
+  acc = RotateLeft(acc, 31);
+  return acc * kPrime1;
+}
+
+/// Fold the lane |lane| into the hash |h|.
+inline uint64_t MergeLane(uint64_t h, uint64_t lane) {
+  h ^= MixLane(0, lane);
+  return h * kPrime1 + kPrime4;
+}
+
+/// Mix the 32-byte stripe at |p| into |lanes|.  The lanes don't depend on
+/// each other.
+inline void MixStripe(uint64_t* lanes, const unsigned char* p) {
+  lanes[0] = MixLane(lanes[0], Read64(p));
+  lanes[1] = MixLane(lanes[1], Read64(p + 8));
+  lanes[2] = MixLane(lanes[2], Read64(p + 16));
+  lanes[3] = MixLane(lanes[3], Read64(p + 24));
+}
+
+/// Mix the last |len| bytes at |p|, fewer than 32, and the |total| length
+/// into |h|, and scramble the result.
+uint64_t FinishHalf(uint64_t h, uint64_t total, const unsigned char* p,
+                    size_t len) {
+  h += total;
+  for (; len >= 8; p += 8, len -= 8) {
+    h ^= MixLane(0, Read64(p));
+    h = RotateLeft(h, 27) * kPrime1 + kPrime4;
+  }
+  if (len >= 4) {
+    uint32_t k;
+    memcpy(&k, p, sizeof k);
+    h ^= uint64_t(k) * kPrime1;
+    h = RotateLeft(h, 23) * kPrime2 + kPrime3;
+    p += 4;
+    len -= 4;
+  }
+  for (; len > 0; ++p, --len) {
+    h ^= (*p) * kPrime5;
+    h = RotateLeft(h, 11) * kPrime1;
+  }
+  h ^= h >> 33;
+  h *= kPrime2;
+  h ^= h >> 29;
+  h *= kPrime3;
+  h ^= h >> 32;
+  return h;
+}
 
 }  // namespace
 
+CommandHasher::CommandHasher() : len_(0), tail_len_(0) {
+  lanes_[0] = kPrime1 + kPrime2;
+  lanes_[1] = kPrime2;
+  lanes_[2] = 0;
+  lanes_[3] = 0 - kPrime1;
+}
+
+void CommandHasher::Update(const char* data, size_t len) {
+  const unsigned char* p = (const unsigned char*)data;
+  len_ += len;
+  if (tail_len_ > 0) {
+    size_t n = min(len, sizeof(tail_) - tail_len_);
+    memcpy(tail_ + tail_len_, p, n);
+    tail_len_ += n;
+    p += n;
+    len -= n;
+    if (tail_len_ < sizeof(tail_))
+      return;
+    MixStripe(lanes_, tail_);
+    tail_len_ = 0;
+  }
+  for (; len >= sizeof(tail_); p += sizeof(tail_), len -= sizeof(tail_))
+    MixStripe(lanes_, p);
+  memcpy(tail_, p, len);
+  tail_len_ = len;
+}
+
+Hash128 CommandHasher::Finish128() const {
+  // The halves fold the lanes in with different rotations, and start off
+  // short inputs differently, so that neither follows from the other.
+  uint64_t low = kPrime5, high = kPrime4;
+  if (len_ >= sizeof(tail_)) {
+    low = RotateLeft(lanes_[0], 1) + RotateLeft(lanes_[1], 7) +
+        RotateLeft(lanes_[2], 12) + RotateLeft(lanes_[3], 18);
+    high = RotateLeft(lanes_[0], 18) + RotateLeft(lanes_[1], 12) +
+        RotateLeft(lanes_[2], 7) + RotateLeft(lanes_[3], 1);
+    for (int i = 0; i < 4; ++i) {
+      low = MergeLane(low, lanes_[i]);
+      high = MergeLane(high, lanes_[3 - i]);
+    }
+  }
+  return Hash128(FinishHalf(low, len_, tail_, tail_len_),
+                 FinishHalf(high ^ kPrime3, len_, tail_, tail_len_));
+}
+
 // static
-uint64_t BuildLog::LogEntry::HashCommand(StringPiece command) {
-  return MurmurHash64A(command.str_, command.len_);
+Hash128 BuildLog::LogEntry::HashCommand(StringPiece command) {
+  CommandHasher hasher;
+  hasher.Update(command);
+  return hasher.Finish128();
 }
 
 BuildLog::LogEntry::LogEntry(const string& output)
   : output(output) {}
 
-BuildLog::LogEntry::LogEntry(const string& output, uint64_t command_hash,
+BuildLog::LogEntry::LogEntry(const string& output, Hash128 command_hash,
   int start_time, int end_time, TimeStamp restat_mtime)
   : output(output), command_hash(command_hash),
     start_time(start_time), end_time(end_time), mtime(restat_mtime)
 {}
 
+// static
+bool BuildLog::ParseLine(const char* start, const char* end, int log_version,
+                         LogLine* line) {
+  const char kFieldSeparator = '\t';
+  const char* fields[4];
+  for (int i = 0; i < 4; ++i) {
+    const char* sep = (const char*)memchr(start, kFieldSeparator, end - start);
+    if (!sep)
+      return false;
+    fields[i] = start;
+    start = sep + 1;
+  }
+  line->start_time = (int)ParseDecimal(fields[0], fields[1]);
+  line->end_time = (int)ParseDecimal(fields[1], fields[2]);
+  line->mtime = ParseDecimal(fields[2], fields[3]);
+  line->output = StringPiece(fields[3], start - 1 - fields[3]);
+  line->usage = ResourceUsage();
+  if (log_version >= 5) {
+    const char* hash_end =
+        (const char*)memchr(start, kFieldSeparator, end - start);
+    if (!hash_end)
+      hash_end = end;
+    ParseHex128(start, hash_end, &line->command_hash);
+    int64_t* usage[] = {
+      &line->usage.user_micros, &line->usage.system_micros,
+      &line->usage.max_rss_kib, &line->usage.input_blocks,
+      &line->usage.output_blocks, &line->usage.voluntary_switches,
+      &line->usage.involuntary_switches
+    };
+    const char* field = hash_end;
+    for (size_t i = 0; i < sizeof(usage) / sizeof(usage[0]) && field < end;
+         ++i) {
+      const char* field_end =
+          (const char*)memchr(field + 1, kFieldSeparator, end - field - 1);
+      if (!field_end)
+        field_end = end;
+      *usage[i] = ParseDecimal(field + 1, field_end);
+      field = field_end;
+    }
+  } else
+    line->command_hash = LogEntry::HashCommand(
+        StringPiece(start, end - start));
+  return true;
+}
+
 BuildLog::BuildLog()
-  : log_file_(NULL), needs_recompaction_(false) {}
+  : added_(0), index_(NULL), index_slots_(0), index_end_(0),
+    needs_recompaction_(false), recompaction_(NULL) {}
 
 BuildLog::~BuildLog() {
   Close();
 }
 
+/// A rewrite of the log running on a thread of its own.
+struct BuildLog::Recompaction : public BackgroundTask {
+  explicit Recompaction(const string& path)
+      : path(path), temp_path(path + ".recompact"), success(false) {}
+
+  virtual void Run() {
+    success = WriteCompacted(temp_path, entries, &err);
+  }
+
+  string path;
+  string temp_path;
+  /// The live entries when the recompaction started.
+  vector<LogEntry> entries;
+  bool success;
+  string err;
+};
+
 bool BuildLog::OpenForWrite(const string& path, const BuildLogUser& user,
                             string* err) {
   if (needs_recompaction_) {
-    if (!Recompact(path, user, err))
-      return false;
+    // The rewrite runs while we build; the entries recorded in the
+    // meantime are added to it once it's done.
+    needs_recompaction_ = false;
+    StartRecompaction(path, user);
   }
 
-  log_file_ = fopen(path.c_str(), "ab");
-  if (!log_file_) {
-    *err = strerror(errno);
+  if (!OpenLogFile(path, err))
     return false;
+
+  // Without threads the recompaction is done already.
+  string recompact_err;
+  if (!FinishRecompaction(false, &recompact_err)) {
+    if (!log_file_.is_open()) {
+      *err = recompact_err;
+      return false;
+    }
+    Warning("recompacting build log: %s", recompact_err.c_str());
   }
-  setvbuf(log_file_, NULL, _IOLBF, BUFSIZ);
-  SetCloseOnExec(fileno(log_file_));
+  return true;
+}
 
-  // Opening a file in append mode doesn't set the file pointer to the file's
-  // end on Windows. Do that explicitly.
-  fseek(log_file_, 0, SEEK_END);
+bool BuildLog::OpenSideLog(const string& path, string* err) {
+  needs_recompaction_ = false;
+  return OpenLogFile(path, err);
+}
+
+bool BuildLog::OpenLogFile(const string& path, string* err) {
+  if (!log_file_.Open(path, err))
+    return false;
 
-  if (ftell(log_file_) == 0) {
-    if (fprintf(log_file_, kFileSignature, kCurrentVersion) < 0 ||
-        fprintf(log_file_, kFileColumnLabels) < 0) {
+  if (log_file_.empty()) {
+    char signature[sizeof(kFileSignature) + 16];
+    snprintf(signature, sizeof(signature), kFileSignature, kCurrentVersion);
+    if (!log_file_.Append(string(signature) + kFileColumnLabels) ||
+        !log_file_.Flush()) {
       *err = strerror(errno);
       return false;
     }
@@ -156,204 +443,176 @@ bool BuildLog::OpenForWrite(const string& path, const BuildLogUser& user,
 }
 
 bool BuildLog::RecordCommand(Edge* edge, int start_time, int end_time,
-                             TimeStamp mtime) {
-  string command = edge->EvaluateCommand(true);
-  uint64_t command_hash = LogEntry::HashCommand(command);
+                             TimeStamp mtime, const ResourceUsage& usage) {
+  string err;
+  if (!FinishRecompaction(false, &err))
+    Warning("recompacting build log: %s", err.c_str());
+
+  Hash128 command_hash = edge->CommandHash();
   for (vector<Node*>::iterator out = edge->outputs_.begin();
        out != edge->outputs_.end(); ++out) {
-    const string& path = (*out)->path();
-    Entries::iterator i = entries_.find(path);
-    LogEntry* log_entry;
-    if (i != entries_.end()) {
-      log_entry = i->second;
-    } else {
-      log_entry = new LogEntry(path);
-      entries_.insert(Entries::value_type(log_entry->output, log_entry));
-    }
+    LogEntry* log_entry = EntryFor((*out)->path());
     log_entry->command_hash = command_hash;
     log_entry->start_time = start_time;
     log_entry->end_time = end_time;
     log_entry->mtime = mtime;
-
-    if (log_file_) {
-      if (!WriteEntry(log_file_, *log_entry))
-        return false;
-      if (fflush(log_file_) != 0) {
-          return false;
-      }
-    }
+    log_entry->usage = usage;
+    if (!Recorded(log_entry))
+      return false;
   }
   return true;
 }
 
-void BuildLog::Close() {
-  if (log_file_)
-    fclose(log_file_);
-  log_file_ = NULL;
+bool BuildLog::RecordEntry(const LogEntry& entry) {
+  string err;
+  if (!FinishRecompaction(false, &err))
+    Warning("recompacting build log: %s", err.c_str());
+
+  LogEntry* log_entry = EntryFor(entry.output);
+  log_entry->command_hash = entry.command_hash;
+  log_entry->start_time = entry.start_time;
+  log_entry->end_time = entry.end_time;
+  log_entry->mtime = entry.mtime;
+  log_entry->usage = entry.usage;
+  return Recorded(log_entry);
 }
 
-struct LineReader {
-  explicit LineReader(FILE* file)
-    : file_(file), buf_end_(buf_), line_start_(buf_), line_end_(NULL) {
-      memset(buf_, 0, sizeof(buf_));
-  }
-
-  // Reads a \n-terminated line from the file passed to the constructor.
-  // On return, *line_start points to the beginning of the next line, and
-  // *line_end points to the \n at the end of the line. If no newline is seen
-  // in a fixed buffer size, *line_end is set to NULL. Returns false on EOF.
-  bool ReadLine(char** line_start, char** line_end) {
-    if (line_start_ >= buf_end_ || !line_end_) {
-      // Buffer empty, refill.
-      size_t size_read = fread(buf_, 1, sizeof(buf_), file_);
-      if (!size_read)
-        return false;
-      line_start_ = buf_;
-      buf_end_ = buf_ + size_read;
-    } else {
-      // Advance to next line in buffer.
-      line_start_ = line_end_ + 1;
-    }
-
-    line_end_ = (char*)memchr(line_start_, '\n', buf_end_ - line_start_);
-    if (!line_end_) {
-      // No newline. Move rest of data to start of buffer, fill rest.
-      size_t already_consumed = line_start_ - buf_;
-      size_t size_rest = (buf_end_ - buf_) - already_consumed;
-      memmove(buf_, line_start_, size_rest);
-
-      size_t read = fread(buf_ + size_rest, 1, sizeof(buf_) - size_rest, file_);
-      buf_end_ = buf_ + size_rest + read;
-      line_start_ = buf_;
-      line_end_ = (char*)memchr(line_start_, '\n', buf_end_ - line_start_);
-    }
+BuildLog::LogEntry* BuildLog::EntryFor(const string& path) {
+  Entries::iterator i = entries_.find(path);
+  if (i != entries_.end())
+    return i->second;
+  LogEntry* log_entry = new LogEntry(path);
+  entries_.insert(Entries::value_type(log_entry->output, log_entry));
+  ++added_;
+  return log_entry;
+}
 
-    *line_start = line_start_;
-    *line_end = line_end_;
-    return true;
-  }
+bool BuildLog::Recorded(LogEntry* entry) {
+  if (recompaction_)
+    recorded_since_.push_back(entry);
+  return !log_file_.is_open() || log_file_.Append(FormatEntry(*entry));
+}
 
- private:
-  FILE* file_;
-  char buf_[256 << 10];
-  char* buf_end_;  // Points one past the last valid byte in |buf_|.
+void BuildLog::Close() {
+  string err;
+  if (!FinishRecompaction(true, &err))
+    Warning("recompacting build log: %s", err.c_str());
+  log_file_.Close();
+}
 
-  char* line_start_;
-  // Points at the next \n in buf_ after line_start, or NULL.
-  char* line_end_;
-};
+bool BuildLog::Flush() {
+  return log_file_.Flush();
+}
 
 bool BuildLog::Load(const string& path, string* err) {
   METRIC_RECORD(".ninja_log load");
-  FILE* file = fopen(path.c_str(), "r");
-  if (!file) {
-    if (errno == ENOENT)
-      return true;
-    *err = strerror(errno);
+  TRACE_PHASE(".ninja_log load");
+  Unmap();
+  switch (map_.Open(path, err)) {
+  case FileReader::Okay:
+    break;
+  case FileReader::NotFound:
+    err->clear();
+    return true;
+  default:
     return false;
   }
 
+  const char* data = map_.data();
+  const char* data_end = data + map_.size();
+  if (data == data_end)
+    return true; // file was empty
+
   int log_version = 0;
+  const char* first_end = (const char*)memchr(data, '\n', data_end - data);
+  string first_line(data, first_end ? first_end + 1 : data_end);
+  sscanf(first_line.c_str(), kFileSignature, &log_version);
+  if (log_version < kOldestSupportedVersion) {
+    *err = ("build log version invalid, perhaps due to being too old; "
+            "starting over");
+    Unmap();
+    unlink(path.c_str());
+    // Don't report this as a failure.  An empty build log will cause
+    // us to rebuild the outputs anyway.
+    return true;
+  }
+
+  size_t indexed_entry_count = 0;
   int unique_entry_count = 0;
   int total_entry_count = 0;
 
-  LineReader reader(file);
-  char* line_start = 0;
-  char* line_end = 0;
-  while (reader.ReadLine(&line_start, &line_end)) {
-    if (!log_version) {
-      sscanf(line_start, kFileSignature, &log_version);
-
-      if (log_version < kOldestSupportedVersion) {
-        *err = ("build log version invalid, perhaps due to being too old; "
-                "starting over");
-        fclose(file);
-        unlink(path.c_str());
-        // Don't report this as a failure.  An empty build log will cause
-        // us to rebuild the outputs anyway.
-        return true;
-      }
-    }
-
-    // If no newline was found in this chunk, read the next.
+  int line_number = 0;
+  for (const char* line_start = data; line_start < data_end; ++line_number) {
+    const char* line_end =
+        (const char*)memchr(line_start, '\n', data_end - line_start);
+    // An incomplete last line was cut short while being written.
     if (!line_end)
+      break;
+    const char* next = line_end + 1;
+
+    // The index directly follows the signature and the column labels.
+    uint64_t slots, count, end;
+    if (line_number == 2 && log_version >= 6 &&
+        size_t(next - line_start) == kIndexHeaderSize &&
+        memcmp(line_start, "# index ", 8) == 0 &&
+        line_start[16] == ' ' && line_start[25] == ' ' &&
+        ParseHexField(line_start + 8, line_start + 16, &slots) &&
+        ParseHexField(line_start + 17, line_start + 25, &count) &&
+        ParseHexField(line_start + 26, line_end, &end) &&
+        slots > 0 && (slots & (slots - 1)) == 0 && count <= slots &&
+        uint64_t(next - data) + slots * kIndexSlotSize <= end &&
+        end <= uint64_t(data_end - data)) {
+      // An index that doesn't fit the file, e.g. after it got truncated, is
+      // skipped: its lines are comments, so everything gets parsed instead.
+      index_ = next;
+      index_slots_ = (size_t)slots;
+      index_end_ = (size_t)end;
+      indexed_entry_count = (size_t)count;
+      line_start = data + end;
       continue;
+    }
 
-    const char kFieldSeparator = '\t';
-
-    char* start = line_start;
-    char* end = (char*)memchr(start, kFieldSeparator, line_end - start);
-    if (!end)
-      continue;
-    *end = 0;
-
-    int start_time = 0, end_time = 0;
-    TimeStamp restat_mtime = 0;
-
-    start_time = atoi(start);
-    start = end + 1;
-
-    end = (char*)memchr(start, kFieldSeparator, line_end - start);
-    if (!end)
-      continue;
-    *end = 0;
-    end_time = atoi(start);
-    start = end + 1;
-
-    end = (char*)memchr(start, kFieldSeparator, line_end - start);
-    if (!end)
-      continue;
-    *end = 0;
-    restat_mtime = strtoll(start, NULL, 10);
-    start = end + 1;
-
-    end = (char*)memchr(start, kFieldSeparator, line_end - start);
-    if (!end)
-      continue;
-    string output = string(start, end - start);
-
-    start = end + 1;
-    end = line_end;
+    LogLine line;
+    if (ParseLine(line_start, line_end, log_version, &line)) {
+      LogEntry* entry;
+      Entries::iterator i = entries_.find(line.output);
+      if (i != entries_.end()) {
+        entry = i->second;
+      } else {
+        entry = new LogEntry(line.output.AsString());
+        entries_.insert(Entries::value_type(entry->output, entry));
+        LogLine indexed;
+        if (!FindInIndex(line.output, HashPath(line.output), &indexed))
+          ++unique_entry_count;
+      }
+      ++total_entry_count;
 
-    LogEntry* entry;
-    Entries::iterator i = entries_.find(output);
-    if (i != entries_.end()) {
-      entry = i->second;
-    } else {
-      entry = new LogEntry(output);
-      entries_.insert(Entries::value_type(entry->output, entry));
-      ++unique_entry_count;
-    }
-    ++total_entry_count;
-
-    entry->start_time = start_time;
-    entry->end_time = end_time;
-    entry->mtime = restat_mtime;
-    if (log_version >= 5) {
-      char c = *end; *end = '\0';
-      entry->command_hash = (uint64_t)strtoull(start, NULL, 16);
-      *end = c;
-    } else {
-      entry->command_hash = LogEntry::HashCommand(StringPiece(start,
-                                                              end - start));
+      entry->start_time = line.start_time;
+      entry->end_time = line.end_time;
+      entry->mtime = line.mtime;
+      entry->command_hash = line.command_hash;
+      entry->usage = line.usage;
     }
+    line_start = next;
   }
-  fclose(file);
-
-  if (!line_start) {
-    return true; // file was empty
-  }
+  unique_entry_count += indexed_entry_count;
+  total_entry_count += indexed_entry_count;
 
   // Decide whether it's time to rebuild the log:
   // - if we're upgrading versions
   // - if it's getting large
+  // - if most of it isn't indexed
   int kMinCompactionEntryCount = 100;
   int kCompactionRatio = 3;
+  int unindexed_entry_count = unique_entry_count - (int)indexed_entry_count;
   if (log_version < kCurrentVersion) {
     needs_recompaction_ = true;
   } else if (total_entry_count > kMinCompactionEntryCount &&
              total_entry_count > unique_entry_count * kCompactionRatio) {
     needs_recompaction_ = true;
+  } else if (unindexed_entry_count > kMinCompactionEntryCount &&
+             unindexed_entry_count > (int)indexed_entry_count) {
+    needs_recompaction_ = true;
   }
 
   return true;
@@ -363,60 +622,256 @@ BuildLog::LogEntry* BuildLog::LookupByOutput(const string& path) {
   Entries::iterator i = entries_.find(path);
   if (i != entries_.end())
     return i->second;
-  return NULL;
+  LogLine line;
+  if (!FindInIndex(path, HashPath(path), &line))
+    return NULL;
+  LogEntry* entry = new LogEntry(line.output.AsString(), line.command_hash,
+                                 line.start_time, line.end_time, line.mtime);
+  entry->usage = line.usage;
+  entries_.insert(Entries::value_type(entry->output, entry));
+  return entry;
+}
+
+BuildLog::LogEntry* BuildLog::LookupByNode(const Node* node) {
+  int index = node->index();
+  if (index < 0)
+    return LookupByOutput(node->path());
+  if ((size_t)index >= by_node_.size()) {
+    NodeSlot empty = { NULL, NULL, 0 };
+    by_node_.resize(index + 1, empty);
+  }
+  NodeSlot& slot = by_node_[index];
+  if (slot.node != node || (!slot.entry && slot.added != added_)) {
+    slot.node = node;
+    slot.entry = LookupByOutput(node->path());
+    slot.added = added_;
+  }
+  return slot.entry;
+}
+
+bool BuildLog::ReadIndexSlot(size_t slot, uint64_t* hash,
+                             LogLine* line) const {
+  const char* p = index_ + slot * kIndexSlotSize;
+  uint64_t offset;
+  if (!ParseHexField(p + 2, p + 18, hash) ||
+      !ParseHexField(p + 19, p + 35, &offset) || offset == 0 ||
+      offset >= index_end_)
+    return false;
+  const char* line_start = map_.data() + offset;
+  const char* line_end = (const char*)memchr(line_start, '\n',
+                                             index_end_ - (size_t)offset);
+  return line_end && ParseLine(line_start, line_end, kCurrentVersion, line);
+}
+
+bool BuildLog::FindInIndex(StringPiece path, uint64_t hash,
+                           LogLine* line) const {
+  for (size_t probe = 0; probe < index_slots_; ++probe) {
+    uint64_t slot_hash;
+    if (!ReadIndexSlot((hash + probe) & (index_slots_ - 1), &slot_hash, line))
+      return false;
+    if (slot_hash == hash && line->output == path)
+      return true;
+  }
+  return false;
+}
+
+const BuildLog::Entries& BuildLog::entries() {
+  for (size_t i = 0; i < index_slots_; ++i) {
+    uint64_t hash;
+    LogLine line;
+    if (ReadIndexSlot(i, &hash, &line) &&
+        entries_.find(line.output) == entries_.end()) {
+      LogEntry* entry = new LogEntry(line.output.AsString(), line.command_hash,
+                                     line.start_time, line.end_time,
+                                     line.mtime);
+      entry->usage = line.usage;
+      entries_.insert(Entries::value_type(entry->output, entry));
+    }
+  }
+  return entries_;
+}
+
+void BuildLog::Unmap() {
+  // What is in the log changes with the file: live entries could have gone
+  // with it, and absent ones come.
+  by_node_.clear();
+  index_ = NULL;
+  index_slots_ = 0;
+  index_end_ = 0;
+  map_.Close();
+}
+
+// static
+string BuildLog::FormatEntry(const LogEntry& entry) {
+  char times[64];
+  snprintf(times, sizeof(times), "%d\t%d\t%" PRId64 "\t",
+           entry.start_time, entry.end_time, entry.mtime);
+  char hash[192];
+  const ResourceUsage& usage = entry.usage;
+  snprintf(hash, sizeof(hash),
+           "\t%016" PRIx64 "%016" PRIx64 "\t%" PRId64 "\t%" PRId64 "\t%" PRId64
+           "\t%" PRId64 "\t%" PRId64 "\t%" PRId64 "\t%" PRId64 "\n",
+           entry.command_hash.high, entry.command_hash.low,
+           usage.user_micros, usage.system_micros, usage.max_rss_kib,
+           usage.input_blocks, usage.output_blocks, usage.voluntary_switches,
+           usage.involuntary_switches);
+  return times + entry.output + hash;
 }
 
 bool BuildLog::WriteEntry(FILE* f, const LogEntry& entry) {
-  return fprintf(f, "%d\t%d\t%" PRId64 "\t%s\t%" PRIx64 "\n",
-          entry.start_time, entry.end_time, entry.mtime,
-          entry.output.c_str(), entry.command_hash) > 0;
+  string line = FormatEntry(entry);
+  return fwrite(line.data(), 1, line.size(), f) == line.size();
 }
 
 bool BuildLog::Recompact(const string& path, const BuildLogUser& user,
                          string* err) {
+  Close();
+  StartRecompaction(path, user);
+  return FinishRecompaction(true, err);
+}
+
+void BuildLog::StartRecompaction(const string& path,
+                                 const BuildLogUser& user) {
   METRIC_RECORD(".ninja_log recompact");
 
-  Close();
-  string temp_path = path + ".recompact";
-  FILE* f = fopen(temp_path.c_str(), "wb");
+  // Take what the rewrite needs, so that the build can go on changing the
+  // entries meanwhile.  Nothing needs the old file once all is decoded.
+  Recompaction* recompaction = new Recompaction(path);
+  const Entries& all = entries();
+  recompaction->entries.reserve(all.size());
+  vector<StringPiece> dead_outputs;
+  for (Entries::const_iterator i = all.begin(); i != all.end(); ++i) {
+    if (user.IsPathDead(i->first))
+      dead_outputs.push_back(i->first);
+    else
+      recompaction->entries.push_back(*i->second);
+  }
+  for (size_t i = 0; i < dead_outputs.size(); ++i)
+    entries_.erase(dead_outputs[i]);
+  Unmap();
+
+  recompaction_ = recompaction;
+  recompaction_thread_.Start(recompaction);
+}
+
+bool BuildLog::FinishRecompaction(bool wait, string* err) {
+  if (!recompaction_ || (!wait && !recompaction_thread_.Done()))
+    return true;
+  recompaction_thread_.Join();
+  Recompaction* recompaction = recompaction_;
+  recompaction_ = NULL;
+  vector<LogEntry*> recorded;
+  recorded.swap(recorded_since_);
+
+  bool success = recompaction->success;
+  if (!success) {
+    *err = recompaction->err;
+  } else {
+    // Windows can't replace the log while it's open.
+    bool was_open = log_file_.is_open();
+    log_file_.Close();
+    if (unlink(recompaction->path.c_str()) < 0 ||
+        rename(recompaction->temp_path.c_str(),
+               recompaction->path.c_str()) < 0) {
+      *err = strerror(errno);
+      success = false;
+    }
+    if (was_open) {
+      string open_err;
+      if (!OpenLogFile(recompaction->path, &open_err)) {
+        *err = open_err;
+        success = false;
+      } else if (success) {
+        // Add what was recorded while the rewrite ran.
+        sort(recorded.begin(), recorded.end());
+        recorded.erase(unique(recorded.begin(), recorded.end()),
+                       recorded.end());
+        for (vector<LogEntry*>::iterator i = recorded.begin();
+             i != recorded.end() && success; ++i)
+          success = log_file_.Append(FormatEntry(**i));
+        if (!success || !log_file_.Flush()) {
+          *err = strerror(errno);
+          success = false;
+        }
+      }
+    }
+  }
+  if (!success)
+    unlink(recompaction->temp_path.c_str());
+  delete recompaction;
+  return success;
+}
+
+// static
+bool BuildLog::WriteCompacted(const string& path,
+                              const vector<LogEntry>& entries, string* err) {
+  FILE* f = fopen(path.c_str(), "wb");
   if (!f) {
     *err = strerror(errno);
     return false;
   }
 
-  if (fprintf(f, kFileSignature, kCurrentVersion) < 0) {
+  // Keep the index at most half full, so that probes stay short.
+  size_t slots = 1;
+  while (slots < entries.size() * 2)
+    slots <<= 1;
+
+  // Write the index empty first, then fill it in once the offsets of the
+  // entries are known.
+  long index_pos;
+  if (fprintf(f, kFileSignature, kCurrentVersion) < 0 ||
+      fprintf(f, kFileColumnLabels) < 0 ||
+      (index_pos = ftell(f)) < 0 ||
+      fprintf(f, kIndexHeader, 0u, 0u, (uint64_t)0) < 0) {
     *err = strerror(errno);
     fclose(f);
     return false;
   }
-
-  vector<StringPiece> dead_outputs;
-  for (Entries::iterator i = entries_.begin(); i != entries_.end(); ++i) {
-    if (user.IsPathDead(i->first)) {
-      dead_outputs.push_back(i->first);
-      continue;
+  vector<uint64_t> offsets(slots, 0);
+  vector<uint64_t> hashes(slots, 0);
+  for (size_t i = 0; i < slots; ++i) {
+    if (fprintf(f, kIndexSlot, (uint64_t)0, (uint64_t)0) < 0) {
+      *err = strerror(errno);
+      fclose(f);
+      return false;
     }
+  }
 
-    if (!WriteEntry(f, *i->second)) {
+  for (vector<LogEntry>::const_iterator i = entries.begin();
+       i != entries.end(); ++i) {
+    uint64_t hash = HashPath(i->output);
+    size_t slot = hash & (slots - 1);
+    while (offsets[slot])
+      slot = (slot + 1) & (slots - 1);
+    long offset = ftell(f);
+    if (offset < 0 || !WriteEntry(f, *i)) {
       *err = strerror(errno);
       fclose(f);
       return false;
     }
+    hashes[slot] = hash;
+    offsets[slot] = offset;
   }
 
-  for (size_t i = 0; i < dead_outputs.size(); ++i)
-    entries_.erase(dead_outputs[i]);
-
-  fclose(f);
-  if (unlink(path.c_str()) < 0) {
+  long end = ftell(f);
+  if (end < 0 || fseek(f, index_pos, SEEK_SET) < 0 ||
+      fprintf(f, kIndexHeader, (unsigned)slots, (unsigned)entries.size(),
+              (uint64_t)end) < 0) {
     *err = strerror(errno);
+    fclose(f);
     return false;
   }
+  for (size_t i = 0; i < slots; ++i) {
+    if (fprintf(f, kIndexSlot, hashes[i], offsets[i]) < 0) {
+      *err = strerror(errno);
+      fclose(f);
+      return false;
+    }
+  }
 
-  if (rename(temp_path.c_str(), path.c_str()) < 0) {
+  if (fclose(f) != 0) {
     *err = strerror(errno);
     return false;
   }
-
   return true;
 }
@@ -16,14 +16,43 @@
 #define NINJA_BUILD_LOG_H_
 
 #include <string>
+#include <vector>
 #include <stdio.h>
 using namespace std;
 
 #include "hash_map.h"
+#include "log_writer.h"
+#include "mapped_file.h"
+#include "parallel.h"
 #include "timestamp.h"
 #include "util.h"  // uint64_t
 
 struct Edge;
+struct Node;
+
+/// Computes BuildLog::LogEntry::HashCommand() of a string given to it in
+/// pieces, so that the whole string never has to be held at once.  The
+/// input is mixed 32 bytes at a time into four independent lanes, as
+/// xxHash does, which the compiler can keep in flight or vectorize.
+struct CommandHasher {
+  CommandHasher();
+
+  void Update(const char* data, size_t len);
+  void Update(const string& data) { Update(data.data(), data.size()); }
+  void Update(StringPiece data) { Update(data.str_, data.len_); }
+
+  /// The hash of everything passed to Update() so far.
+  Hash128 Finish128() const;
+  /// Its low half, for where 64 bits do.
+  uint64_t Finish() const { return Finish128().low; }
+
+ private:
+  uint64_t lanes_[4];
+  uint64_t len_;
+  /// The bytes of an incomplete 32-byte stripe.
+  unsigned char tail_[32];
+  size_t tail_len_;
+};
 
 /// Can answer questions about the manifest for the BuildLog.
 struct BuildLogUser {
@@ -39,13 +68,27 @@ struct BuildLogUser {
 ///    when we need to rebuild due to the command changing
 /// 2) timing information, perhaps for generating reports
 /// 3) restat information
+///
+/// Recompaction writes a hash index of the entries after the header, so
+/// that loading only has to parse what was appended since.  The rest is
+/// decoded from the mapped file as LookupByOutput() asks for it.
 struct BuildLog {
   BuildLog();
   ~BuildLog();
 
   bool OpenForWrite(const string& path, const BuildLogUser& user, string* err);
+  /// Append entries to a log of their own at |path| rather than to the log
+  /// loaded, which another process owns (see BuildDirLock) and which isn't
+  /// recompacted then.
+  bool OpenSideLog(const string& path, string* err);
+  /// Record a finished command.  Records are written out in batches, see
+  /// LogWriter.
   bool RecordCommand(Edge* edge, int start_time, int end_time,
-                     TimeStamp mtime = 0);
+                     TimeStamp mtime = 0,
+                     const ResourceUsage& usage = ResourceUsage());
+  /// Write out the records held back.  Returns false with errno set on
+  /// failure.
+  bool Flush();
   void Close();
 
   /// Load the on-disk log.
@@ -53,12 +96,14 @@ struct BuildLog {
 
   struct LogEntry {
     string output;
-    uint64_t command_hash;
+    Hash128 command_hash;
     int start_time;
     int end_time;
     TimeStamp mtime;
+    /// What the command used, when it last ran.
+    ResourceUsage usage;
 
-    static uint64_t HashCommand(StringPiece command);
+    static Hash128 HashCommand(StringPiece command);
 
     // Used by tests.
     bool operator==(const LogEntry& o) {
@@ -68,26 +113,110 @@ struct BuildLog {
     }
 
     explicit LogEntry(const string& output);
-    LogEntry(const string& output, uint64_t command_hash,
+    LogEntry(const string& output, Hash128 command_hash,
              int start_time, int end_time, TimeStamp restat_mtime);
   };
 
   /// Lookup a previously-run command by its output path.
   LogEntry* LookupByOutput(const string& path);
+  /// LookupByOutput() for the path of |node|, remembered by the node's
+  /// index, so that asking again, as the scan, the plan and the builder do
+  /// for the same outputs, doesn't hash the path again.
+  LogEntry* LookupByNode(const Node* node);
+
+  /// Record |entry| as it is, replacing any entry for its output.  This is
+  /// for entries taken from another log rather than from a command run here.
+  bool RecordEntry(const LogEntry& entry);
 
   /// Serialize an entry into a log file.
-  bool WriteEntry(FILE* f, const LogEntry& entry);
+  static bool WriteEntry(FILE* f, const LogEntry& entry);
+  /// The line of the log file for an entry.
+  static string FormatEntry(const LogEntry& entry);
 
-  /// Rewrite the known log entries, throwing away old data.
+  /// Rewrite the known log entries, throwing away old data, and wait for
+  /// it.  OpenForWrite() instead rewrites the log in the background when
+  /// it needs it, and puts the new log in place once that's done.
   bool Recompact(const string& path, const BuildLogUser& user, string* err);
 
+  /// Start rewriting the log at |path| from the live entries, on a thread
+  /// of its own.
+  void StartRecompaction(const string& path, const BuildLogUser& user);
+
+  /// Put the rewritten log in place, with the entries recorded since it
+  /// started, once the rewrite is done.  Waits for it if |wait|.  On
+  /// failure the old log is kept, if it can be.
+  bool FinishRecompaction(bool wait, string* err);
+
   typedef ExternalStringHashMap<LogEntry*>::Type Entries;
-  const Entries& entries() const { return entries_; }
+  /// All entries, including the ones not looked up yet.
+  const Entries& entries();
 
  private:
+  struct Recompaction;
+
+  bool OpenLogFile(const string& path, string* err);
+
+  /// The entry for |path|, added if there isn't one yet.
+  LogEntry* EntryFor(const string& path);
+  /// Note that |entry| changed, and write it out.
+  bool Recorded(LogEntry* entry);
+
+  /// Write a log with an index holding |entries| to |path|.
+  static bool WriteCompacted(const string& path,
+                             const vector<LogEntry>& entries, string* err);
+
+  /// The fields of an entry's line in the file.
+  struct LogLine {
+    int start_time;
+    int end_time;
+    TimeStamp mtime;
+    StringPiece output;
+    Hash128 command_hash;
+    ResourceUsage usage;
+  };
+
+  /// Parse the log line [start, end), where |end| points at its newline.
+  /// Returns false for lines that aren't entries, like comments.
+  static bool ParseLine(const char* start, const char* end, int log_version,
+                        LogLine* line);
+
+  /// Decode the entry in index slot |slot|.  Returns false for empty or
+  /// broken slots.
+  bool ReadIndexSlot(size_t slot, uint64_t* hash, LogLine* line) const;
+
+  /// Find the indexed entry for |path|, whose MurmurHash64A is |hash|.
+  bool FindInIndex(StringPiece path, uint64_t hash, LogLine* line) const;
+
+  /// Drop the mapped file and its index.
+  void Unmap();
+
+  /// Entries decoded so far.  They take precedence over the index, as they
+  /// were recorded or appended later.
   Entries entries_;
-  FILE* log_file_;
+  /// What LookupByNode() found, by Node::index().  The node is checked, as
+  /// nodes of different States can have the same index, and a slot that
+  /// found nothing only holds while |added_| is what it was.
+  struct NodeSlot {
+    const Node* node;
+    LogEntry* entry;
+    unsigned added;
+  };
+  vector<NodeSlot> by_node_;
+  /// The count of the entries added to |entries_| for paths that had none.
+  unsigned added_;
+  MappedFile map_;
+  /// The first slot of the index in map_, if there is one.
+  const char* index_;
+  size_t index_slots_;
+  /// Offset in map_ of the end of the indexed entries.
+  size_t index_end_;
+  LogWriter log_file_;
   bool needs_recompaction_;
+
+  Recompaction* recompaction_;
+  BackgroundThread recompaction_thread_;
+  /// Entries recorded while recompaction_ runs.
+  vector<LogEntry*> recorded_since_;
 };
 
 #endif // NINJA_BUILD_LOG_H_
@@ -32,6 +32,18 @@ struct NoDeadPaths : public BuildLogUser {
   virtual bool IsPathDead(StringPiece) const { return false; }
 };
 
+/// A command about as long as those of the build the test data is like.
+string LongCommand() {
+  const size_t kRuleSize = 4000;
+  string command = "gcc ";
+  for (int i = 0; command.size() < kRuleSize; ++i) {
+    char buf[80];
+    sprintf(buf, "-I../../and/arbitrary/but/fairly/long/path/suffixed/%d ", i);
+    command += buf;
+  }
+  return command;
+}
+
 bool WriteTestData(string* err) {
   BuildLog log;
 
@@ -61,14 +73,7 @@ bool WriteTestData(string* err) {
   */
 
   // ManifestParser is the only object allowed to create Rules.
-  const size_t kRuleSize = 4000;
-  string long_rule_command = "gcc ";
-  for (int i = 0; long_rule_command.size() < kRuleSize; ++i) {
-    char buf[80];
-    sprintf(buf, "-I../../and/arbitrary/but/fairly/long/path/suffixed/%d ", i);
-    long_rule_command += buf;
-  }
-  long_rule_command += "$in -o $out\n";
+  string long_rule_command = LongCommand() + "$in -o $out\n";
 
   State state;
   ManifestParser parser(&state, NULL);
@@ -142,6 +147,18 @@ int main() {
   printf("min %dms  max %dms  avg %.1fms\n",
          min, max, total / times.size());
 
+  // Hashing the commands, as the scan does for every edge it checks.
+  const int kNumHashes = 30000;
+  string command = LongCommand();
+  uint64_t sum = 0;
+  int64_t start = GetTimeMillis();
+  for (int i = 0; i < kNumHashes; ++i) {
+    command[command.size() - 1] = (char)i;
+    sum += BuildLog::LogEntry::HashCommand(command).low;
+  }
+  printf("hashed %d commands of %d bytes in %dms (%x)\n", kNumHashes,
+         (int)command.size(), (int)(GetTimeMillis() - start), (unsigned)sum);
+
   unlink(kTestFilename);
 
   return 0;
@@ -14,6 +14,8 @@
 
 #include "build_log.h"
 
+#include "deps_log.h"
+#include "graph.h"
 #include "util.h"
 #include "test.h"
 
@@ -69,9 +71,62 @@ TEST_F(BuildLogTest, WriteRead) {
   ASSERT_EQ("out", e1->output);
 }
 
+TEST_F(BuildLogTest, LookupByNode) {
+  AssertParse(&state_,
+"build out: cat mid\n"
+"build mid: cat in\n");
+
+  BuildLog log;
+  string err;
+  EXPECT_TRUE(log.OpenForWrite(kTestFilename, *this, &err));
+  ASSERT_EQ("", err);
+  Node* out = GetNode("out");
+  Node* mid = GetNode("mid");
+  EXPECT_TRUE(log.LookupByNode(out) == NULL);
+  log.RecordCommand(state_.edges_[0], 15, 18);
+  BuildLog::LogEntry* entry = log.LookupByNode(out);
+  ASSERT_TRUE(entry != NULL);
+  EXPECT_EQ(log.LookupByOutput("out"), entry);
+  EXPECT_TRUE(log.LookupByNode(mid) == NULL);
+
+  // A node of another State, with the same index, is a different path.
+  State other;
+  Node* in = other.GetNode("in", &other.bindings_, 0);
+  ASSERT_EQ(out->index(), in->index());
+  EXPECT_TRUE(log.LookupByNode(in) == NULL);
+  EXPECT_EQ(entry, log.LookupByNode(out));
+  log.Close();
+}
+
+TEST_F(BuildLogTest, RecordEntry) {
+  AssertParse(&state_,
+"build out: cat in\n");
+
+  BuildLog log1;
+  string err;
+  EXPECT_TRUE(log1.OpenForWrite(kTestFilename, *this, &err));
+  ASSERT_EQ("", err);
+  log1.RecordCommand(state_.edges_[0], 15, 18);
+  BuildLog::LogEntry imported("out", Hash128(0x1234, 0x5678), 1, 7, 42);
+  imported.usage.user_micros = 5;
+  EXPECT_TRUE(log1.RecordEntry(imported));
+  log1.Close();
+
+  BuildLog log2;
+  EXPECT_TRUE(log2.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  ASSERT_EQ(1u, log2.entries().size());
+  BuildLog::LogEntry* e = log2.LookupByOutput("out");
+  ASSERT_TRUE(e);
+  EXPECT_TRUE(imported == *e);
+  EXPECT_EQ(5, e->usage.user_micros);
+}
+
 TEST_F(BuildLogTest, FirstWriteAddsSignature) {
   const char kExpectedContent[] = "# ninja log vX\n"
-                                  "# start_time end_time mtime command hash\n";
+                                  "# start_time end_time mtime command hash "
+                                  "user_us sys_us max_rss_kib in_blocks "
+                                  "out_blocks nvcsw nivcsw\n";
   const size_t kVersionPos = 13;  // Points at 'X'.
 
   BuildLog log;
@@ -100,6 +155,59 @@ TEST_F(BuildLogTest, FirstWriteAddsSignature) {
   EXPECT_EQ(kExpectedContent, contents);
 }
 
+TEST_F(BuildLogTest, ResourceUsage) {
+  AssertParse(&state_,
+"build out: cat in\n");
+
+  ResourceUsage usage;
+  usage.user_micros = 1500000;
+  usage.system_micros = 250000;
+  usage.max_rss_kib = 40960;
+  usage.input_blocks = 8;
+  usage.output_blocks = 16;
+  usage.voluntary_switches = 3;
+  usage.involuntary_switches = 1;
+
+  BuildLog log1;
+  string err;
+  EXPECT_TRUE(log1.OpenForWrite(kTestFilename, *this, &err));
+  ASSERT_EQ("", err);
+  log1.RecordCommand(state_.edges_[0], 15, 18, 0, usage);
+  log1.Close();
+
+  BuildLog log2;
+  EXPECT_TRUE(log2.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  BuildLog::LogEntry* e = log2.LookupByOutput("out");
+  ASSERT_TRUE(e);
+  EXPECT_EQ(1500000, e->usage.user_micros);
+  EXPECT_EQ(250000, e->usage.system_micros);
+  EXPECT_EQ(40960, e->usage.max_rss_kib);
+  EXPECT_EQ(8, e->usage.input_blocks);
+  EXPECT_EQ(16, e->usage.output_blocks);
+  EXPECT_EQ(3, e->usage.voluntary_switches);
+  EXPECT_EQ(1, e->usage.involuntary_switches);
+}
+
+TEST_F(BuildLogTest, NoResourceUsageV7) {
+  FILE* f = fopen(kTestFilename, "wb");
+  fprintf(f, "# ninja log v7\n");
+  fprintf(f, "123\t456\t456\tout\tbeefcafe\n");
+  fclose(f);
+
+  string err;
+  BuildLog log;
+  EXPECT_TRUE(log.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+
+  BuildLog::LogEntry* e = log.LookupByOutput("out");
+  ASSERT_TRUE(e);
+  EXPECT_EQ(Hash128(0xbeefcafeu, 0), e->command_hash);
+  EXPECT_EQ(0, e->usage.user_micros);
+  EXPECT_EQ(0, e->usage.max_rss_kib);
+  EXPECT_EQ(0, e->usage.involuntary_switches);
+}
+
 TEST_F(BuildLogTest, DoubleEntry) {
   FILE* f = fopen(kTestFilename, "wb");
   fprintf(f, "# ninja log v4\n");
@@ -218,8 +326,7 @@ TEST_F(BuildLogTest, DuplicateVersionHeader) {
 }
 
 TEST_F(BuildLogTest, VeryLongInputLine) {
-  // Ninja's build log buffer is currently 256kB. Lines longer than that are
-  // silently ignored, but don't affect parsing of other lines.
+  // The log is parsed in place, so lines of any length are read.
   FILE* f = fopen(kTestFilename, "wb");
   fprintf(f, "# ninja log v4\n");
   fprintf(f, "123\t456\t456\tout\tcommand start");
@@ -235,7 +342,8 @@ TEST_F(BuildLogTest, VeryLongInputLine) {
   ASSERT_EQ("", err);
 
   BuildLog::LogEntry* e = log.LookupByOutput("out");
-  ASSERT_EQ(NULL, e);
+  ASSERT_TRUE(e);
+  ASSERT_EQ(123, e->start_time);
 
   e = log.LookupByOutput("out2");
   ASSERT_TRUE(e);
@@ -245,6 +353,38 @@ TEST_F(BuildLogTest, VeryLongInputLine) {
   ASSERT_NO_FATAL_FAILURE(AssertHash("command2", e->command_hash));
 }
 
+TEST_F(BuildLogTest, CommandHasherPieces) {
+  string command;
+  for (int i = 0; i < 100; ++i)
+    command += "cc -c file" + string(i % 7 + 1, 'x') + ".c ";
+  Hash128 whole = BuildLog::LogEntry::HashCommand(command);
+  EXPECT_NE(whole, BuildLog::LogEntry::HashCommand(command + " "));
+
+  // The hash doesn't depend on how the string is split up.
+  for (size_t step = 1; step < 20; ++step) {
+    CommandHasher hasher;
+    for (size_t i = 0; i < command.size(); i += step)
+      hasher.Update(command.data() + i, min(step, command.size() - i));
+    EXPECT_EQ(whole, hasher.Finish128());
+    EXPECT_EQ(whole.low, hasher.Finish());
+  }
+  EXPECT_EQ(BuildLog::LogEntry::HashCommand(""), CommandHasher().Finish128());
+
+  // Inputs that differ only in their length, or in a byte on either side
+  // of a stripe, hash apart, in both halves.
+  string zeros(96, '\0');
+  for (size_t len = 1; len < zeros.size(); ++len) {
+    Hash128 shorter = BuildLog::LogEntry::HashCommand(zeros.substr(0, len - 1));
+    Hash128 hash = BuildLog::LogEntry::HashCommand(zeros.substr(0, len));
+    EXPECT_NE(shorter.low, hash.low);
+    EXPECT_NE(shorter.high, hash.high);
+    EXPECT_NE(hash.low, hash.high);
+    string flipped = zeros.substr(0, len);
+    flipped[len - 1] = 1;
+    EXPECT_NE(hash, BuildLog::LogEntry::HashCommand(flipped));
+  }
+}
+
 TEST_F(BuildLogTest, MultiTargetEdge) {
   AssertParse(&state_,
 "build out out.d: cat\n");
@@ -305,4 +445,211 @@ TEST_F(BuildLogRecompactTest, Recompact) {
   ASSERT_FALSE(log2.LookupByOutput("out2"));
 }
 
+TEST_F(BuildLogRecompactTest, RecompactInBackground) {
+  AssertParse(&state_,
+"build out: cat in\n"
+"build out2: cat in\n"
+"build out3: cat in\n");
+
+  string err;
+  {
+    BuildLog log;
+    EXPECT_TRUE(log.OpenForWrite(kTestFilename, *this, &err));
+    ASSERT_EQ("", err);
+    for (int i = 0; i < 200; ++i)
+      log.RecordCommand(state_.edges_[0], 15, 18 + i);
+    log.RecordCommand(state_.edges_[1], 21, 22);
+  }
+
+  // Entries recorded while the log is rewritten end up in the new log.
+  {
+    BuildLog log;
+    EXPECT_TRUE(log.Load(kTestFilename, &err));
+    ASSERT_EQ("", err);
+    EXPECT_TRUE(log.OpenForWrite(kTestFilename, *this, &err));
+    ASSERT_EQ("", err);
+    log.RecordCommand(state_.edges_[0], 30, 31);
+    log.RecordCommand(state_.edges_[2], 32, 33);
+    log.Close();
+  }
+
+  string contents;
+  ASSERT_EQ(0, ReadFile(kTestFilename, &contents, &err));
+  EXPECT_NE(string::npos, contents.find("\n# index "));
+  BuildLog log;
+  EXPECT_TRUE(log.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  ASSERT_EQ(2u, log.entries().size());
+  BuildLog::LogEntry* e = log.LookupByOutput("out");
+  ASSERT_TRUE(e);
+  EXPECT_EQ(30, e->start_time);
+  e = log.LookupByOutput("out3");
+  ASSERT_TRUE(e);
+  EXPECT_EQ(32, e->start_time);
+  EXPECT_FALSE(log.LookupByOutput("out2"));
+}
+
+TEST_F(BuildLogRecompactTest, RecompactAlongsideDepsLog) {
+  const char kDepsManifest[] =
+"rule cc\n"
+"  command = cc\n"
+"  deps = gcc\n"
+"build out.o: cc\n";
+  AssertParse(&state_,
+"build out: cat in\n"
+"build out2: cat in\n");
+  AssertParse(&state_, kDepsManifest);
+  const char kDepsFilename[] = "BuildLogTest-deps";
+  unlink(kDepsFilename);
+
+  string err;
+  {
+    BuildLog log;
+    EXPECT_TRUE(log.OpenForWrite(kTestFilename, *this, &err));
+    ASSERT_EQ("", err);
+    for (int i = 0; i < 200; ++i)
+      log.RecordCommand(state_.edges_[0], 15, 18 + i);
+    log.RecordCommand(state_.edges_[1], 21, 22);
+    DepsLog deps_log;
+    ASSERT_TRUE(deps_log.OpenForWrite(kDepsFilename, &err));
+    vector<Node*> deps(1, GetNode("foo.h"));
+    for (int i = 0; i < 200; ++i)
+      deps_log.RecordDeps(GetNode("out.o"), i, deps);
+  }
+
+  // Both logs can be rewritten at once, as "-t recompact" does.
+  {
+    BuildLog log;
+    EXPECT_TRUE(log.Load(kTestFilename, &err));
+    ASSERT_EQ("", err);
+    // The nodes of state_ have ids from recording the deps already.
+    State state;
+    AssertParse(&state, kDepsManifest);
+    DepsLog deps_log;
+    ASSERT_TRUE(deps_log.Load(kDepsFilename, &state, &err));
+    ASSERT_EQ("", err);
+    log.StartRecompaction(kTestFilename, *this);
+    deps_log.StartRecompaction(kDepsFilename);
+    EXPECT_TRUE(deps_log.FinishRecompaction(true, &err));
+    EXPECT_TRUE(log.FinishRecompaction(true, &err));
+    EXPECT_EQ("", err);
+  }
+
+  BuildLog log;
+  EXPECT_TRUE(log.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  ASSERT_EQ(1u, log.entries().size());
+  BuildLog::LogEntry* e = log.LookupByOutput("out");
+  ASSERT_TRUE(e);
+  EXPECT_EQ(217, e->end_time);
+
+  State state;
+  AssertParse(&state, kDepsManifest);
+  DepsLog deps_log;
+  ASSERT_TRUE(deps_log.Load(kDepsFilename, &state, &err));
+  ASSERT_EQ("", err);
+  EXPECT_EQ(2u, deps_log.nodes().size());
+  DepsLog::Deps* deps =
+      deps_log.GetDeps(state.GetNode("out.o", &state.bindings_, 0));
+  ASSERT_TRUE(deps);
+  EXPECT_EQ(199, deps->mtime);
+  ASSERT_EQ(1, deps->node_count);
+  EXPECT_EQ("foo.h", deps->nodes[0]->path());
+  deps_log.Close();
+  unlink(kDepsFilename);
+}
+
+TEST_F(BuildLogTest, Index) {
+  AssertParse(&state_,
+"build out: cat in\n"
+"build out2: cat in\n"
+"build out3: cat in\n");
+
+  string err;
+  {
+    BuildLog log;
+    EXPECT_TRUE(log.OpenForWrite(kTestFilename, *this, &err));
+    ASSERT_EQ("", err);
+    log.RecordCommand(state_.edges_[0], 1, 2);
+    log.RecordCommand(state_.edges_[1], 3, 4);
+    log.Close();
+    ASSERT_TRUE(log.Recompact(kTestFilename, *this, &err));
+    ASSERT_EQ("", err);
+  }
+
+  // The rewritten log has an index; append an entry after it.
+  string contents;
+  ASSERT_EQ(0, ReadFile(kTestFilename, &contents, &err));
+  EXPECT_NE(string::npos, contents.find("\n# index "));
+  {
+    BuildLog log;
+    EXPECT_TRUE(log.Load(kTestFilename, &err));
+    ASSERT_EQ("", err);
+    EXPECT_TRUE(log.OpenForWrite(kTestFilename, *this, &err));
+    ASSERT_EQ("", err);
+    log.RecordCommand(state_.edges_[1], 5, 6);
+    log.RecordCommand(state_.edges_[2], 7, 8);
+    log.Close();
+  }
+
+  BuildLog log;
+  EXPECT_TRUE(log.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  BuildLog::LogEntry* e = log.LookupByOutput("out");
+  ASSERT_TRUE(e);
+  EXPECT_EQ("out", e->output);
+  EXPECT_EQ(1, e->start_time);
+  EXPECT_EQ(2, e->end_time);
+  ASSERT_NO_FATAL_FAILURE(AssertHash("cat in > out", e->command_hash));
+  // Appended entries take precedence over indexed ones.
+  e = log.LookupByOutput("out2");
+  ASSERT_TRUE(e);
+  EXPECT_EQ(5, e->start_time);
+  e = log.LookupByOutput("out3");
+  ASSERT_TRUE(e);
+  EXPECT_EQ(7, e->start_time);
+  EXPECT_FALSE(log.LookupByOutput("in"));
+  EXPECT_EQ(3u, log.entries().size());
+}
+
+TEST_F(BuildLogTest, TruncateIndexed) {
+  AssertParse(&state_,
+"build out: cat in\n"
+"build out2: cat in\n");
+
+  string err;
+  {
+    BuildLog log;
+    EXPECT_TRUE(log.OpenForWrite(kTestFilename, *this, &err));
+    ASSERT_EQ("", err);
+    log.RecordCommand(state_.edges_[0], 1, 2);
+    log.RecordCommand(state_.edges_[1], 3, 4);
+    ASSERT_TRUE(log.Recompact(kTestFilename, *this, &err));
+    ASSERT_EQ("", err);
+  }
+  string contents;
+  ASSERT_EQ(0, ReadFile(kTestFilename, &contents, &err));
+
+  // However the log got cut short, loading it shouldn't crash, and what's
+  // left of it should still be found.
+  for (size_t size = contents.size(); size > 0; --size) {
+    // Loading removes logs whose header got lost, so write it out anew.
+    FILE* f = fopen(kTestFilename, "wb");
+    ASSERT_TRUE(f);
+    ASSERT_EQ(size, fwrite(contents.data(), 1, size, f));
+    fclose(f);
+    BuildLog log;
+    err.clear();
+    ASSERT_TRUE(log.Load(kTestFilename, &err) || !err.empty());
+    BuildLog::LogEntry* e = log.LookupByOutput("out");
+    if (size == contents.size()) {
+      ASSERT_TRUE(e);
+      EXPECT_EQ(1, e->start_time);
+    }
+    if (e)
+      EXPECT_EQ("out", e->output);
+    log.entries();
+  }
+}
+
 }  // anonymous namespace
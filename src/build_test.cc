@@ -17,7 +17,9 @@
 #include <assert.h>
 
 #include "build_log.h"
+#include "debug_flags.h"
 #include "deps_log.h"
+#include "digest_log.h"
 #include "graph.h"
 #include "test.h"
 
@@ -197,6 +199,152 @@ TEST_F(PlanTest, DoubleDependent) {
   ASSERT_FALSE(edge);  // done
 }
 
+TEST_F(PlanTest, CollapsedPhony) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"build a: cat in\n"
+"build b: cat in\n"
+"build sub: phony a\n"
+"build dir: phony sub b\n"
+"build all: phony dir a\n"
+"build out: cat sub\n"));
+  GetNode("a")->MarkDirty();
+  GetNode("b")->MarkDirty();
+  GetNode("sub")->MarkDirty();
+  GetNode("dir")->MarkDirty();
+  GetNode("all")->MarkDirty();
+  GetNode("out")->MarkDirty();
+
+  string err;
+  EXPECT_TRUE(plan_.AddTarget(GetNode("all"), &err));
+  ASSERT_EQ("", err);
+
+  // "all" waits for a and b directly, and only for each once.
+  Edge* all = GetNode("all")->in_edge();
+  ASSERT_EQ(2u, all->PlanInputs().size());
+  EXPECT_EQ("a", all->PlanInputs()[0]->path());
+  EXPECT_EQ("b", all->PlanInputs()[1]->path());
+  EXPECT_EQ(2u, all->inputs_.size());
+  // Those they don't read directly tell them when they are done.
+  Edge* dir = GetNode("dir")->in_edge();
+  ASSERT_EQ(1u, GetNode("a")->phony_out_edges().size());
+  EXPECT_EQ(dir, GetNode("a")->phony_out_edges()[0]);
+  ASSERT_EQ(1u, GetNode("b")->phony_out_edges().size());
+  EXPECT_EQ(all, GetNode("b")->phony_out_edges()[0]);
+  // Edges that aren't phony aren't collapsed into.
+  Edge* out = GetNode("out")->in_edge();
+  EXPECT_EQ(&out->inputs_, &out->PlanInputs());
+
+  deque<Edge*> edges;
+  FindWorkSorted(&edges, 2);
+  plan_.EdgeFinished(edges[0], Plan::kEdgeSucceeded, &err);
+  ASSERT_EQ("", err);
+  EXPECT_FALSE(plan_.FindWork());
+  plan_.EdgeFinished(edges[1], Plan::kEdgeSucceeded, &err);
+  ASSERT_EQ("", err);
+
+  // Only "all" is left of the phony edges.
+  Edge* edge = plan_.FindWork();
+  EXPECT_EQ(all, edge);
+  plan_.EdgeFinished(edge, Plan::kEdgeSucceeded, &err);
+  ASSERT_EQ("", err);
+  EXPECT_FALSE(plan_.FindWork());
+  EXPECT_FALSE(plan_.more_to_do());
+  // The graph is as it was.
+  EXPECT_FALSE(dir->outputs_ready());
+}
+
+TEST_F(PlanTest, SpeculateOrderOnly) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"build gen.h: cat gen.in\n"
+"build b.h: cat gen.in\n"
+"build a.o: cat a.c || gen.h\n"
+"  deps = gcc\n"
+"build b.o: cat b.c | b.h || gen.h\n"
+"  deps = gcc\n"
+"build c.o: cat c.c || gen.h\n"));
+  const char* outputs[] = { "gen.h", "b.h", "a.o", "b.o", "c.o" };
+  for (size_t i = 0; i < sizeof(outputs) / sizeof(outputs[0]); ++i)
+    GetNode(outputs[i])->MarkDirty();
+  plan_.set_speculate(true);
+
+  string err;
+  EXPECT_TRUE(plan_.AddTarget(GetNode("a.o"), &err));
+  EXPECT_TRUE(plan_.AddTarget(GetNode("b.o"), &err));
+  EXPECT_TRUE(plan_.AddTarget(GetNode("c.o"), &err));
+  ASSERT_EQ("", err);
+
+  // a.o needn't wait for gen.h, but b.o waits for b.h and c.o, which
+  // doesn't record its deps, waits for everything.
+  deque<Edge*> edges;
+  FindWorkSorted(&edges, 3);
+  EXPECT_EQ("a.o", edges[0]->outputs_[0]->path());
+  EXPECT_EQ("b.h", edges[1]->outputs_[0]->path());
+  EXPECT_EQ("gen.h", edges[2]->outputs_[0]->path());
+  EXPECT_TRUE(plan_.StartedEarly(edges[0]));
+  EXPECT_FALSE(plan_.StartedEarly(edges[2]));
+
+  plan_.EdgeFinished(edges[1], Plan::kEdgeSucceeded, &err);
+  ASSERT_EQ("", err);
+  Edge* edge = plan_.FindWork();
+  ASSERT_TRUE(edge);
+  EXPECT_EQ("b.o", edge->outputs_[0]->path());
+  EXPECT_TRUE(plan_.StartedEarly(edge));
+  ASSERT_FALSE(plan_.FindWork());
+
+  // Having read a file that was built after it started, a.o runs again.
+  plan_.EdgeFinished(edges[2], Plan::kEdgeSucceeded, &err);
+  ASSERT_EQ("", err);
+  EXPECT_TRUE(plan_.EarlyStartHeld(edges[0], vector<Node*>(1, GetNode("a.c"))));
+  EXPECT_FALSE(plan_.EarlyStartHeld(edges[0],
+                                    vector<Node*>(1, GetNode("gen.h"))));
+  plan_.RetryEarlyStart(edges[0]);
+  edges.clear();
+  FindWorkSorted(&edges, 2);
+  EXPECT_EQ("a.o", edges[0]->outputs_[0]->path());
+  EXPECT_EQ("c.o", edges[1]->outputs_[0]->path());
+  EXPECT_FALSE(plan_.StartedEarly(edges[0]));
+}
+
+TEST_F(PlanTest, RemainingMillis) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"build fast: cat in\n"
+"build new: cat in\n"
+"build slow: cat in\n"
+"build all: phony fast new slow\n"));
+  BuildLog log;
+  log.RecordCommand(GetNode("fast")->in_edge(), 0, 10);
+  log.RecordCommand(GetNode("slow")->in_edge(), 0, 1000);
+  GetNode("fast")->MarkDirty();
+  GetNode("new")->MarkDirty();
+  GetNode("slow")->MarkDirty();
+  GetNode("all")->MarkDirty();
+  string err;
+  EXPECT_TRUE(plan_.AddTarget(GetNode("all"), &err));
+  ASSERT_EQ("", err);
+  plan_.PrepareQueue(&log);
+
+  // new is taken to take the average, 505ms.
+  EXPECT_EQ(1515, plan_.remaining_millis());
+  EXPECT_EQ(1000, plan_.NextWeight());
+  BuildConfig config;
+  config.parallelism = 1;
+  BuildStatus status(config);
+  status.set_plan(&plan_);
+  EXPECT_EQ("1.5", status.FormatProgressStatus("%E",
+                                               BuildStatus::kEdgeStarted));
+  config.parallelism = 3;
+  EXPECT_EQ("1.0", status.FormatProgressStatus("%E",
+                                               BuildStatus::kEdgeStarted));
+
+  Edge* edge = plan_.FindWork();
+  ASSERT_TRUE(edge);
+  EXPECT_EQ("slow", edge->outputs_[0]->path());
+  plan_.EdgeFinished(edge, Plan::kEdgeSucceeded, &err);
+  ASSERT_EQ("", err);
+  EXPECT_EQ(515, plan_.remaining_millis());
+  EXPECT_EQ(505, plan_.NextWeight());
+}
+
 void PlanTest::TestPoolWithDepthOne(const char* test_case) {
   ASSERT_NO_FATAL_FAILURE(AssertParse(&state_, test_case));
   GetNode("out1")->MarkDirty();
@@ -336,6 +484,48 @@ TEST_F(PlanTest, PoolsWithDepthTwo) {
   ASSERT_FALSE(plan_.FindWork());
 }
 
+TEST_F(PlanTest, PoolWithWeights) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"pool machine\n"
+"  depth = 8\n"
+"rule cc\n"
+"  command = cc $in -o $out\n"
+"  pool = machine\n"
+"rule lto\n"
+"  command = ld $in -o $out\n"
+"  pool = machine\n"
+"  weight = 6\n"
+"build link: lto in\n"
+"build a.o: cc in\n"
+"build b.o: cc in\n"
+"build c.o: cc in\n"
+"build all: phony link a.o b.o c.o\n"));
+  GetNode("link")->MarkDirty();
+  GetNode("a.o")->MarkDirty();
+  GetNode("b.o")->MarkDirty();
+  GetNode("c.o")->MarkDirty();
+  GetNode("all")->MarkDirty();
+  string err;
+  EXPECT_TRUE(plan_.AddTarget(GetNode("all"), &err));
+  ASSERT_EQ("", err);
+
+  // The link and two compiles fill the pool.
+  deque<Edge*> edges;
+  FindWorkSorted(&edges, 3);
+  ASSERT_EQ("a.o", edges[0]->outputs_[0]->path());
+  ASSERT_EQ("b.o", edges[1]->outputs_[0]->path());
+  ASSERT_EQ("link", edges[2]->outputs_[0]->path());
+  EXPECT_EQ(6, edges[2]->weight());
+
+  // Finishing a compile makes room for the last one.
+  plan_.EdgeFinished(edges[0], Plan::kEdgeSucceeded, &err);
+  ASSERT_EQ("", err);
+  Edge* edge = plan_.FindWork();
+  ASSERT_TRUE(edge);
+  EXPECT_EQ("c.o", edge->outputs_[0]->path());
+  ASSERT_FALSE(plan_.FindWork());
+}
+
 TEST_F(PlanTest, PoolWithRedundantEdges) {
   ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
     "pool compile\n"
@@ -464,6 +654,100 @@ TEST_F(PlanTest, PoolWithFailingEdge) {
   ASSERT_EQ(0, edge);
 }
 
+TEST_F(PlanTest, PriorityWithoutBuildLog) {
+  // With no timings every command counts the same, so the longer chain
+  // starts first.
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"build a1: cat a0\n"
+"build b1: cat b0\n"
+"build b2: cat b1\n"
+"build out: cat a1 b2\n"));
+  GetNode("a1")->MarkDirty();
+  GetNode("b1")->MarkDirty();
+  GetNode("b2")->MarkDirty();
+  GetNode("out")->MarkDirty();
+  string err;
+  EXPECT_TRUE(plan_.AddTarget(GetNode("out"), &err));
+  ASSERT_EQ("", err);
+
+  Edge* edge = plan_.FindWork();
+  ASSERT_TRUE(edge);
+  EXPECT_EQ("b1", edge->outputs_[0]->path());
+  edge = plan_.FindWork();
+  ASSERT_TRUE(edge);
+  EXPECT_EQ("a1", edge->outputs_[0]->path());
+  EXPECT_FALSE(plan_.FindWork());
+
+  EXPECT_EQ(3, GetNode("b1")->in_edge()->critical_path_weight());
+  EXPECT_EQ(2, GetNode("b2")->in_edge()->critical_path_weight());
+  EXPECT_EQ(2, GetNode("a1")->in_edge()->critical_path_weight());
+  EXPECT_EQ(1, GetNode("out")->in_edge()->critical_path_weight());
+}
+
+TEST_F(PlanTest, PriorityTiesInManifestOrder) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"build c: cat in\n"
+"build a: cat in\n"
+"build b: cat in\n"
+"build all: phony a b c\n"));
+  GetNode("a")->MarkDirty();
+  GetNode("b")->MarkDirty();
+  GetNode("c")->MarkDirty();
+  GetNode("all")->MarkDirty();
+  string err;
+  EXPECT_TRUE(plan_.AddTarget(GetNode("all"), &err));
+  ASSERT_EQ("", err);
+
+  const char* expected[] = { "c", "a", "b" };
+  for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+    Edge* edge = plan_.FindWork();
+    ASSERT_TRUE(edge);
+    EXPECT_EQ(expected[i], edge->outputs_[0]->path());
+  }
+  EXPECT_FALSE(plan_.FindWork());
+}
+
+TEST_F(PlanTest, PriorityWithBuildLog) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"pool serial\n"
+"  depth = 1\n"
+"rule poolcat\n"
+"  command = cat $in > $out\n"
+"  pool = serial\n"
+"build fast: poolcat in\n"
+"build new: poolcat in\n"
+"build slow: poolcat in\n"
+"build all: phony fast new slow\n"));
+  BuildLog log;
+  log.RecordCommand(GetNode("fast")->in_edge(), 0, 10);
+  log.RecordCommand(GetNode("slow")->in_edge(), 0, 100);
+  GetNode("fast")->MarkDirty();
+  GetNode("new")->MarkDirty();
+  GetNode("slow")->MarkDirty();
+  GetNode("all")->MarkDirty();
+  string err;
+  EXPECT_TRUE(plan_.AddTarget(GetNode("all"), &err));
+  ASSERT_EQ("", err);
+  plan_.PrepareQueue(&log);
+
+  // The edge with no timing is assumed to take the average time, and the
+  // pool releases its edges in order of weight.
+  const char* expected[] = { "slow", "new", "fast" };
+  for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+    Edge* edge = plan_.FindWork();
+    ASSERT_TRUE(edge);
+    EXPECT_EQ(expected[i], edge->outputs_[0]->path());
+    ASSERT_FALSE(plan_.FindWork());
+    plan_.EdgeFinished(edge, Plan::kEdgeSucceeded, &err);
+    ASSERT_EQ("", err);
+  }
+  EXPECT_EQ(55, GetNode("new")->in_edge()->critical_path_weight());
+
+  Edge* edge = plan_.FindWork();
+  ASSERT_TRUE(edge);
+  EXPECT_EQ("all", edge->outputs_[0]->path());
+}
+
 /// Fake implementation of CommandRunner, useful for tests.
 struct FakeCommandRunner : public CommandRunner {
   explicit FakeCommandRunner(VirtualFileSystem* fs) :
@@ -472,7 +756,7 @@ struct FakeCommandRunner : public CommandRunner {
   // CommandRunner impl
   virtual bool CanRunMore() const;
   virtual bool StartCommand(Edge* edge);
-  virtual bool WaitForCommand(Result* result);
+  virtual bool WaitForCommand(Result* result, int timeout_millis);
   virtual vector<Edge*> GetActiveEdges();
   virtual void Abort();
 
@@ -616,7 +900,8 @@ bool FakeCommandRunner::StartCommand(Edge* edge) {
   return true;
 }
 
-bool FakeCommandRunner::WaitForCommand(Result* result) {
+bool FakeCommandRunner::WaitForCommand(Result* result,
+                                       int /*timeout_millis*/) {
   if (active_edges_.empty())
     return false;
 
@@ -876,6 +1161,31 @@ TEST_F(BuildTest, MakeDirs) {
   EXPECT_EQ("subdir/dir2", fs_.directories_made_[1]);
 }
 
+TEST_F(BuildTest, MakeDirsOnce) {
+  string err;
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"build subdir/a: cat in1\n"
+"build subdir/b: cat in1\n"
+"build subdir/dir2/c: cat in1\n"
+"build other/d: cat in1\n"
+"build all: phony subdir/a subdir/b subdir/dir2/c other/d\n"));
+  // An output that is there, if out of date, has its directory there.
+  fs_.Create("other/d", "");
+  fs_.Tick();
+  fs_.Create("in1", "");
+  EXPECT_TRUE(builder_.AddTarget("all", &err));
+  ASSERT_EQ("", err);
+  EXPECT_TRUE(builder_.Build(&err));
+  ASSERT_EQ("", err);
+  ASSERT_EQ(4u, command_runner_.commands_ran_.size());
+
+  // Each directory is looked at and made only once, however many outputs go
+  // in it.
+  ASSERT_EQ(2u, fs_.directories_made_.size());
+  EXPECT_EQ("subdir", fs_.directories_made_[0]);
+  EXPECT_EQ("subdir/dir2", fs_.directories_made_[1]);
+}
+
 TEST_F(BuildTest, DepFileMissing) {
   string err;
   ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
@@ -1115,6 +1425,36 @@ TEST_F(BuildTest, Phony) {
   ASSERT_EQ(1u, command_runner_.commands_ran_.size());
 }
 
+TEST_F(BuildTest, LoopProfile) {
+  string err;
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"build out: cat bar.cc\n"
+"build all: phony out\n"));
+  fs_.Create("bar.cc", "");
+
+  // Nothing is counted before the build.
+  BuildLoopProfile unstarted;
+  unstarted.Enter(BuildLoopProfile::kPlan);
+  EXPECT_EQ(0, unstarted.total_micros());
+  EXPECT_EQ(0, unstarted.micros(BuildLoopProfile::kPlan));
+
+  EXPECT_TRUE(builder_.AddTarget("all", &err));
+  ASSERT_EQ("", err);
+  EXPECT_TRUE(builder_.Build(&err));
+  ASSERT_EQ("", err);
+
+  // The parts don't overlap, so they add up to the whole.
+  const BuildLoopProfile& profile = builder_.loop_profile();
+  int64_t parts = 0;
+  for (int p = 0; p < BuildLoopProfile::kParts; ++p)
+    parts += profile.micros((BuildLoopProfile::Part)p);
+  EXPECT_EQ(profile.total_micros(), parts);
+  EXPECT_GE(profile.overhead_percent(), 0.0);
+  EXPECT_LE(profile.overhead_percent(), 100.0);
+  EXPECT_EQ(0u, profile.Summary().find("build loop "));
+  EXPECT_NE(string::npos, profile.Summary().find("% scheduler overhead:"));
+}
+
 TEST_F(BuildTest, PhonyNoWork) {
   string err;
   ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
@@ -1251,8 +1591,13 @@ struct BuildWithLogTest : public BuildTest {
   BuildWithLogTest() {
     builder_.SetBuildLog(&build_log_);
   }
+  ~BuildWithLogTest() {
+    // The builder flushes the digest log when it goes, after our members.
+    builder_.SetDigestLog(NULL);
+  }
 
   BuildLog build_log_;
+  DigestLog digest_log_;
 };
 
 TEST_F(BuildWithLogTest, NotInLogButOnDisk) {
@@ -1316,6 +1661,7 @@ TEST_F(BuildWithLogTest, RebuildAfterFailure) {
   builder_.plan_.Reset();
 
   fs_.Tick();
+  err.clear();
 
   // Run again, should rerun even though the output file is up to date on disk
   EXPECT_TRUE(builder_.AddTarget("out1", &err));
@@ -1356,6 +1702,85 @@ TEST_F(BuildWithLogTest, RebuildWithNoInputs) {
   EXPECT_EQ(1u, command_runner_.commands_ran_.size());
 }
 
+TEST_F(BuildWithLogTest, HashInputs) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"rule cc\n"
+"  command = cc\n"
+"  hash_inputs = 1\n"
+"build out: cc in | header\n"));
+  builder_.SetDigestLog(&digest_log_);
+  fs_.Create("in", "int x;");
+  fs_.Create("header", "#define X");
+
+  string err;
+  EXPECT_TRUE(builder_.AddTarget("out", &err));
+  ASSERT_EQ("", err);
+  EXPECT_TRUE(builder_.Build(&err));
+  ASSERT_EQ("", err);
+  EXPECT_EQ(1u, command_runner_.commands_ran_.size());
+
+  // Newer inputs with the same contents don't make the output dirty.
+  fs_.Tick();
+  fs_.Create("in", "int x;");
+  fs_.Create("header", "#define X");
+  command_runner_.commands_ran_.clear();
+  state_.Reset();
+  EXPECT_TRUE(builder_.AddTarget("out", &err));
+  ASSERT_EQ("", err);
+  EXPECT_TRUE(builder_.AlreadyUpToDate());
+
+  // Different contents do.
+  fs_.Tick();
+  fs_.Create("header", "#define Y");
+  state_.Reset();
+  EXPECT_TRUE(builder_.AddTarget("out", &err));
+  ASSERT_EQ("", err);
+  EXPECT_TRUE(builder_.Build(&err));
+  ASSERT_EQ("", err);
+  EXPECT_EQ(1u, command_runner_.commands_ran_.size());
+
+  // And so does a change to the command.
+  command_runner_.commands_ran_.clear();
+  state_.Reset();
+  EXPECT_TRUE(builder_.AddTarget("out", &err));
+  EXPECT_TRUE(builder_.AlreadyUpToDate());
+  state_.edges_[0]->env_->AddBinding("command", "cc -O2");
+  state_.Reset();
+  EXPECT_TRUE(builder_.AddTarget("out", &err));
+  EXPECT_FALSE(builder_.AlreadyUpToDate());
+}
+
+/// A restat edge whose outputs are all unchanged cleans the edges that read
+/// several of them, and what depends on those.
+TEST_F(BuildWithLogTest, RestatMultipleOutputs) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"rule true\n"
+"  command = true\n"
+"  restat = 1\n"
+"build gen1 gen2 gen3: true in\n"
+"build mid: cat gen1 gen2 gen3\n"
+"build out: cat mid gen2\n"));
+
+  fs_.Create("in", "");
+  string err;
+  EXPECT_TRUE(builder_.AddTarget("out", &err));
+  ASSERT_EQ("", err);
+  EXPECT_TRUE(builder_.Build(&err));
+  ASSERT_EQ("", err);
+  EXPECT_EQ(3u, command_runner_.commands_ran_.size());
+  command_runner_.commands_ran_.clear();
+  state_.Reset();
+
+  fs_.Tick();
+  fs_.Create("in", "");
+  EXPECT_TRUE(builder_.AddTarget("out", &err));
+  ASSERT_EQ("", err);
+  EXPECT_TRUE(builder_.Build(&err));
+  ASSERT_EQ("", err);
+  ASSERT_EQ(1u, command_runner_.commands_ran_.size());
+  EXPECT_EQ("true", command_runner_.commands_ran_[0]);
+}
+
 TEST_F(BuildWithLogTest, RestatTest) {
   ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
 "rule true\n"
@@ -1421,6 +1846,41 @@ TEST_F(BuildWithLogTest, RestatTest) {
   ASSERT_EQ(2u, command_runner_.commands_ran_.size());
 }
 
+TEST_F(BuildWithLogTest, RestatThroughPhony) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"rule true\n"
+"  command = true\n"
+"  restat = 1\n"
+"build out1: true in\n"
+"build sub: phony out1\n"
+"build dir: phony sub\n"
+"build out2: cat dir\n"));
+
+  fs_.Create("out1", "");
+  fs_.Create("out2", "");
+  fs_.Tick();
+  fs_.Create("in", "");
+
+  string err;
+  EXPECT_TRUE(builder_.AddTarget("out2", &err));
+  ASSERT_EQ("", err);
+  EXPECT_TRUE(builder_.Build(&err));
+  ASSERT_EQ("", err);
+  command_runner_.commands_ran_.clear();
+  state_.Reset();
+
+  fs_.Tick();
+  fs_.Create("in", "");
+  // "true" leaves out1 be, which the phony edges collapsed into "dir"
+  // have to pass on for out2 not to be built.
+  EXPECT_TRUE(builder_.AddTarget("out2", &err));
+  ASSERT_EQ("", err);
+  EXPECT_TRUE(builder_.Build(&err));
+  ASSERT_EQ("", err);
+  ASSERT_EQ(1u, command_runner_.commands_ran_.size());
+  EXPECT_EQ("true", command_runner_.commands_ran_[0]);
+}
+
 TEST_F(BuildWithLogTest, RestatMissingFile) {
   // If a restat rule doesn't create its output, and the output didn't
   // exist before the rule was run, consider that behavior equivalent
@@ -1720,7 +2180,7 @@ TEST_F(BuildWithLogTest, RspFileCmdLineChange) {
   ASSERT_NO_FATAL_FAILURE(AssertHash(
         "cat out.rsp > out;rspfile=Original very long command",
         log_entry->command_hash));
-  log_entry->command_hash++;  // Change the command hash to something else.
+  log_entry->command_hash.low++;  // Change the command hash to something else.
   // Now expect the target to be rebuilt
   command_runner_.commands_ran_.clear();
   state_.Reset();
@@ -1837,6 +2297,43 @@ TEST_F(BuildTest, StatusFormatReplacePlaceholder) {
                 BuildStatus::kEdgeStarted));
 }
 
+TEST_F(BuildTest, StatusFormatEstimate) {
+  EXPECT_EQ("[?]", status_.FormatProgressStatus("[%E]",
+                                                BuildStatus::kEdgeStarted));
+}
+
+TEST_F(BuildTest, CriticalReserve) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"rule fail\n"
+"  command = fail\n"
+"build a_slow: fail\n"
+"build a_link: cat a_slow\n"
+"build b1: cat in1\n"
+"build b2: cat in1\n"));
+  config_.parallelism = 2;
+  command_runner_.max_active_edges_ = 2;
+
+  // With one of the two slots kept for the critical path, the lighter b1
+  // and b2 don't start next to a_slow, and so never run once it fails.
+  for (int reserve = 1; reserve >= 0; --reserve) {
+    config_.critical_reserve = reserve;
+    command_runner_.commands_ran_.clear();
+    Builder builder(&state_, config_, NULL, NULL, &fs_);
+    builder.command_runner_.reset(&command_runner_);
+    string err;
+    EXPECT_TRUE(builder.AddTarget("a_link", &err));
+    EXPECT_TRUE(builder.AddTarget("b1", &err));
+    EXPECT_TRUE(builder.AddTarget("b2", &err));
+    ASSERT_EQ("", err);
+    EXPECT_FALSE(builder.Build(&err));
+    EXPECT_EQ("subcommand failed", err);
+    EXPECT_EQ("fail", command_runner_.commands_ran_[0]);
+    EXPECT_EQ((reserve ? 1u : 3u), command_runner_.commands_ran_.size());
+    builder.command_runner_.release();
+    state_.Reset();
+  }
+}
+
 TEST_F(BuildTest, FailedDepsParse) {
   ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
 "build bad_deps.o: cat in1\n"
@@ -1942,6 +2439,182 @@ TEST_F(BuildWithDepsLogTest, Straightforward) {
   }
 }
 
+/// Check that with State::defer_dep_links_ the headers from the deps log
+/// get no out-edges until State::LinkDeps(), and that a missing one still
+/// makes its dependents rebuild.
+TEST_F(BuildWithDepsLogTest, DeferDepLinks) {
+  string err;
+  const char* manifest =
+      "build out: cat in1\n"
+      "  deps = gcc\n"
+      "  depfile = in1.d\n";
+  fs_.Create("in2", "");
+  {
+    State state;
+    ASSERT_NO_FATAL_FAILURE(AddCatRule(&state));
+    ASSERT_NO_FATAL_FAILURE(AssertParse(&state, manifest));
+    DepsLog deps_log;
+    ASSERT_TRUE(deps_log.OpenForWrite("ninja_deps", &err));
+    ASSERT_EQ("", err);
+    Builder builder(&state, config_, NULL, &deps_log, &fs_);
+    builder.command_runner_.reset(&command_runner_);
+    EXPECT_TRUE(builder.AddTarget("out", &err));
+    ASSERT_EQ("", err);
+    fs_.Create("in1.d", "out: in2");
+    EXPECT_TRUE(builder.Build(&err));
+    EXPECT_EQ("", err);
+    deps_log.Close();
+    builder.command_runner_.release();
+  }
+
+  for (int missing = 0; missing < 2; ++missing) {
+    State state;
+    state.defer_dep_links_ = true;
+    ASSERT_NO_FATAL_FAILURE(AddCatRule(&state));
+    ASSERT_NO_FATAL_FAILURE(AssertParse(&state, manifest));
+    if (missing)
+      fs_.RemoveFile("in2");
+
+    DepsLog deps_log;
+    ASSERT_TRUE(deps_log.Load("ninja_deps", &state, &err));
+    ASSERT_TRUE(deps_log.OpenForWrite("ninja_deps", &err));
+    Builder builder(&state, config_, NULL, &deps_log, &fs_);
+    builder.command_runner_.reset(&command_runner_);
+    command_runner_.commands_ran_.clear();
+    EXPECT_TRUE(builder.AddTarget("out", &err));
+    ASSERT_EQ("", err);
+    EXPECT_EQ((missing == 0), builder.AlreadyUpToDate());
+    Node* in2 = state.LookupNode("in2");
+    ASSERT_TRUE(in2);
+    EXPECT_EQ(0u, in2->out_edges().size());
+    if (missing) {
+      EXPECT_TRUE(builder.Build(&err));
+      EXPECT_EQ("", err);
+      EXPECT_EQ(1u, command_runner_.commands_ran_.size());
+    } else {
+      state.LinkDeps();
+      EXPECT_EQ(1u, in2->out_edges().size());
+    }
+    deps_log.Close();
+    builder.command_runner_.release();
+  }
+}
+
+/// Check that --speculate starts a command before its order-only inputs
+/// are built when its recorded deps say it doesn't read them, and runs it
+/// again when it turns out to.
+TEST_F(BuildWithDepsLogTest, SpeculateOrderOnly) {
+  string err;
+  const char* manifest =
+      "build gen.h: cat gen.in\n"
+      "build out: cat in1 || gen.h\n"
+      "  deps = gcc\n"
+      "  depfile = in1.d\n";
+  config_.speculate = true;
+  command_runner_.max_active_edges_ = 2;
+  fs_.Create("gen.in", "");
+
+  {
+    State state;
+    ASSERT_NO_FATAL_FAILURE(AddCatRule(&state));
+    ASSERT_NO_FATAL_FAILURE(AssertParse(&state, manifest));
+    DepsLog deps_log;
+    ASSERT_TRUE(deps_log.OpenForWrite("ninja_deps", &err));
+    ASSERT_EQ("", err);
+
+    // Without recorded deps there is nothing to go by: out waits for gen.h.
+    Builder builder(&state, config_, NULL, &deps_log, &fs_);
+    builder.command_runner_.reset(&command_runner_);
+    EXPECT_TRUE(builder.AddTarget("out", &err));
+    ASSERT_EQ("", err);
+    fs_.Create("in1.d", "out: in1\n");
+    command_runner_.max_active_edges_ = 1;
+    EXPECT_TRUE(builder.Build(&err));
+    EXPECT_EQ("", err);
+    ASSERT_EQ(2u, command_runner_.commands_ran_.size());
+    EXPECT_EQ("cat gen.in > gen.h", command_runner_.commands_ran_[0]);
+    command_runner_.max_active_edges_ = 2;
+    deps_log.Close();
+    builder.command_runner_.release();
+  }
+
+  for (int i = 0; i < 2; ++i) {
+    bool reads_gen_h = i == 1;
+    State state;
+    ASSERT_NO_FATAL_FAILURE(AddCatRule(&state));
+    ASSERT_NO_FATAL_FAILURE(AssertParse(&state, manifest));
+    fs_.Tick();
+    fs_.Create("gen.in", "");
+    fs_.Create("in1", "");
+    fs_.Create("in1.d", reads_gen_h ? "out: in1 gen.h\n" : "out: in1\n");
+
+    DepsLog deps_log;
+    ASSERT_TRUE(deps_log.Load("ninja_deps", &state, &err));
+    ASSERT_TRUE(deps_log.OpenForWrite("ninja_deps", &err));
+    Builder builder(&state, config_, NULL, &deps_log, &fs_);
+    builder.command_runner_.reset(&command_runner_);
+    command_runner_.commands_ran_.clear();
+    EXPECT_TRUE(builder.AddTarget("out", &err));
+    ASSERT_EQ("", err);
+    EXPECT_TRUE(builder.Build(&err));
+    EXPECT_EQ("", err);
+
+    // Both start at once, and out finishes first.  If it read gen.h, it
+    // runs again after it.
+    ASSERT_EQ((reads_gen_h ? 3u : 2u), command_runner_.commands_ran_.size());
+    EXPECT_EQ("cat in1 > out", command_runner_.commands_ran_.back());
+    DepsLog::Deps* deps = deps_log.GetDeps(state.LookupNode("out"));
+    ASSERT_TRUE(deps);
+    EXPECT_EQ((reads_gen_h ? 0 : 1), deps->node_count);
+    deps_log.Close();
+    builder.command_runner_.release();
+  }
+}
+
+TEST_F(BuildWithDepsLogTest, RemovesDepfiles) {
+  string err;
+  const char* manifest =
+      "rule cc\n"
+      "  command = cc $in\n"
+      "  deps = gcc\n"
+      "  depfile = $out.d\n"
+      "build a.o: cc a.c\n"
+      "build b.o: cc b.c\n";
+  fs_.Create("a.c", "");
+  fs_.Create("b.c", "");
+
+  for (int keep = 0; keep < 2; ++keep) {
+    g_keep_depfile = keep;
+    fs_.Tick();
+    fs_.Create("a.o.d", "a.o: a.h\n");
+    fs_.Create("b.o.d", "b.o: b.h\n");
+    fs_.Create("a.h", "");
+    fs_.Create("b.h", "");
+    fs_.files_removed_.clear();
+    State state;
+    ASSERT_NO_FATAL_FAILURE(AssertParse(&state, manifest));
+    DepsLog deps_log;
+    ASSERT_TRUE(deps_log.OpenForWrite("ninja_deps", &err));
+    ASSERT_EQ("", err);
+    Builder builder(&state, config_, NULL, &deps_log, &fs_);
+    builder.command_runner_.reset(&command_runner_);
+    EXPECT_TRUE(builder.AddTarget("a.o", &err));
+    EXPECT_TRUE(builder.AddTarget("b.o", &err));
+    ASSERT_EQ("", err);
+    EXPECT_TRUE(builder.Build(&err));
+    EXPECT_EQ("", err);
+    builder.command_runner_.release();
+    deps_log.Close();
+
+    // The depfiles go once the build is done with them, unless they are
+    // to be kept.
+    EXPECT_EQ((keep ? 0u : 1u), fs_.files_removed_.count("a.o.d"));
+    EXPECT_EQ((keep ? 0u : 1u), fs_.files_removed_.count("b.o.d"));
+    EXPECT_EQ((keep != 0), (fs_.Stat("a.o.d", &err) > 0));
+  }
+  g_keep_depfile = false;
+}
+
 /// Verify that obsolete dependency info causes a rebuild.
 /// 1) Run a successful build where everything has time t, record deps.
 /// 2) Move input/output to time t+1 -- despite files in alignment,
@@ -2283,6 +2956,47 @@ const char* manifest =
   ASSERT_EQ(2u, command_runner_.commands_ran_.size());
 }
 
+/// The depfile of a deps=gcc edge in a chdir subninja is in the subninja's
+/// directory, and its deps are recorded.
+TEST_F(BuildWithDepsLogTest, DepFileInChdir) {
+  fs_.MakeDir("sub");
+  fs_.Create("sub/build.ninja",
+"rule cat\n"
+"  command = cat $in > $out\n"
+"build out: cat in\n"
+"  deps = gcc\n"
+"  depfile = out.d\n");
+  fs_.Create("sub/in", "");
+  fs_.Create("sub/header.h", "");
+
+  State state;
+  ManifestParser parser(&state, &fs_);
+  string err;
+  ASSERT_TRUE(parser.ParseTest("subninja build.ninja\n"
+                               "  chdir = sub\n", &err));
+  ASSERT_EQ("", err);
+
+  DepsLog deps_log;
+  ASSERT_TRUE(deps_log.OpenForWrite("ninja_deps", &err));
+  ASSERT_EQ("", err);
+  Builder builder(&state, config_, NULL, &deps_log, &fs_);
+  builder.command_runner_.reset(&command_runner_);
+  EXPECT_TRUE(builder.AddTarget("sub/out", &err));
+  ASSERT_EQ("", err);
+  fs_.Create("sub/out.d", "out: header.h\n");
+  EXPECT_TRUE(builder.Build(&err));
+  EXPECT_EQ("", err);
+  builder.command_runner_.release();
+
+  DepsLog::Deps* deps = deps_log.GetDeps(state.LookupNode("sub/out"));
+  ASSERT_TRUE(deps);
+  ASSERT_EQ(1, deps->node_count);
+  EXPECT_EQ("sub/header.h", deps->nodes[0]->path());
+  // The depfile was read, then removed, from the subninja's directory.
+  EXPECT_EQ(1u, fs_.files_removed_.count("sub/out.d"));
+  deps_log.Close();
+}
+
 /// Check that a restat rule doesn't clear an edge if the deps are missing.
 /// https://github.com/ninja-build/ninja/issues/603
 TEST_F(BuildWithDepsLogTest, RestatMissingDepfileDepslog) {
@@ -2335,6 +3049,142 @@ TEST_F(BuildWithDepsLogTest, RestatMissingDepfileDepslog) {
   ASSERT_EQ(0u, command_runner_.commands_ran_.size());
 }
 
+#ifndef _WIN32
+/// Check that deps read on other threads, while further commands run, are
+/// recorded for the command they belong to.
+TEST_F(BuildWithDepsLogTest, ReadDepsInBackground) {
+  string manifest =
+"rule cc\n"
+"  command = echo \"$out: $out.h $out.x\" > $out.d && touch $out\n"
+"  deps = gcc\n"
+"  depfile = $out.d\n";
+  const int kOutputs = 16;
+  for (int i = 0; i < kOutputs; ++i) {
+    char line[32];
+    snprintf(line, sizeof(line), "build o%d: cc\n", i);
+    manifest += line;
+  }
+  manifest += "build bad: cc\n"
+              "  command = echo bad > $out.d && touch $out\n";
+
+  State state;
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state, manifest.c_str()));
+  RealDiskInterface disk;
+  DepsLog deps_log;
+  string err;
+  ASSERT_TRUE(deps_log.OpenForWrite("ninja_deps", &err));
+  ASSERT_EQ("", err);
+
+  config_.parallelism = 4;
+  {
+    Builder builder(&state, config_, NULL, &deps_log, &disk);
+    for (int i = 0; i < kOutputs; ++i) {
+      char output[8];
+      snprintf(output, sizeof(output), "o%d", i);
+      EXPECT_TRUE(builder.AddTarget(output, &err));
+      ASSERT_EQ("", err);
+    }
+    EXPECT_TRUE(builder.Build(&err));
+    EXPECT_EQ("", err);
+  }
+
+  for (int i = 0; i < kOutputs; ++i) {
+    char output[8];
+    snprintf(output, sizeof(output), "o%d", i);
+    DepsLog::Deps* deps = deps_log.GetDeps(state.LookupNode(output));
+    ASSERT_TRUE(deps);
+    ASSERT_EQ(2, deps->node_count);
+    EXPECT_EQ(string(output) + ".h", deps->nodes[0]->path());
+    EXPECT_EQ(string(output) + ".x", deps->nodes[1]->path());
+    EXPECT_EQ(0, disk.Stat(string(output) + ".d", &err));
+  }
+
+  // A depfile that doesn't parse fails its command.
+  {
+    Builder builder(&state, config_, NULL, &deps_log, &disk);
+    EXPECT_TRUE(builder.AddTarget("bad", &err));
+    ASSERT_EQ("", err);
+    EXPECT_FALSE(builder.Build(&err));
+    EXPECT_EQ("subcommand failed", err);
+  }
+  EXPECT_FALSE(deps_log.GetDeps(state.LookupNode("bad")));
+  deps_log.Close();
+}
+
+/// Check that dyndep files read on other threads update the graph before
+/// the edges that use them start.
+TEST_F(BuildWithDepsLogTest, LoadDyndepsInBackground) {
+  string manifest =
+"rule touch\n"
+"  command = touch $out\n"
+"rule cp\n"
+"  command = cp $in $out\n";
+  RealDiskInterface disk;
+  string err;
+  const int kOutputs = 8;
+  for (int i = 0; i < kOutputs; ++i) {
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+             "build imp%d: touch\n"
+             "build dd%d: cp dd%d.in\n"
+             "build out%d: touch || dd%d\n"
+             "  dyndep = dd%d\n", i, i, i, i, i, i);
+    manifest += buf;
+    snprintf(buf, sizeof(buf),
+             "ninja_dyndep_version = 1\n"
+             "build out%d | out%d.imp: dyndep | imp%d\n", i, i, i);
+    char path[16];
+    snprintf(path, sizeof(path), "dd%d.in", i);
+    ASSERT_TRUE(disk.WriteFile(path, buf));
+  }
+  manifest += "build dd_bad: cp dd_bad.in\n"
+              "build bad: touch || dd_bad\n"
+              "  dyndep = dd_bad\n";
+  ASSERT_TRUE(disk.WriteFile("dd_bad.in",
+                             "ninja_dyndep_version = 1\n"
+                             "build missing: dyndep\n"));
+
+  State state;
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state, manifest.c_str()));
+
+  config_.parallelism = 4;
+  {
+    Builder builder(&state, config_, NULL, NULL, &disk);
+    for (int i = 0; i < kOutputs; ++i) {
+      char output[8];
+      snprintf(output, sizeof(output), "out%d", i);
+      EXPECT_TRUE(builder.AddTarget(output, &err));
+      ASSERT_EQ("", err);
+    }
+    EXPECT_TRUE(builder.Build(&err));
+    EXPECT_EQ("", err);
+  }
+
+  for (int i = 0; i < kOutputs; ++i) {
+    char path[16];
+    snprintf(path, sizeof(path), "out%d", i);
+    Edge* edge = state.LookupNode(path)->in_edge();
+    ASSERT_EQ(2u, edge->outputs_.size());
+    EXPECT_EQ(string(path) + ".imp", edge->outputs_[1]->path());
+    snprintf(path, sizeof(path), "imp%d", i);
+    EXPECT_TRUE(edge->is_implicit(edge->inputs_.size() - 2));
+    EXPECT_EQ(path, edge->inputs_[0]->path());
+    EXPECT_GT(disk.Stat(path, &err), 0);
+  }
+
+  // A dyndep file that doesn't make sense stops the build.
+  {
+    Builder builder(&state, config_, NULL, NULL, &disk);
+    EXPECT_TRUE(builder.AddTarget("bad", &err));
+    ASSERT_EQ("", err);
+    EXPECT_FALSE(builder.Build(&err));
+    EXPECT_EQ("dd_bad:2: no build statement exists for 'missing'\n"
+              "build missing: dyndep\n"
+              "             ^ near here", err);
+  }
+}
+#endif  // _WIN32
+
 TEST_F(BuildTest, WrongOutputInDepfileCausesRebuild) {
   string err;
   const char* manifest =
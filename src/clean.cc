@@ -22,56 +22,171 @@
 #include "state.h"
 #include "util.h"
 
+namespace {
+
+/// Files are handed over to be removed this many at a time.
+const size_t kRemoveBatchSize = 64;
+
+/// Mark @a node in @a marks, by its index, growing them for the nodes
+/// added since they were sized.
+/// @return false if it was already.
+bool Mark(vector<bool>* marks, const Node* node) {
+  size_t index = node->index();
+  if (index >= marks->size())
+    marks->resize(index + 1);
+  if ((*marks)[index])
+    return false;
+  (*marks)[index] = true;
+  return true;
+}
+
+}  // anonymous namespace
+
+/// Files to remove, or with a dry run to check for, on another thread.
+struct Cleaner::RemoveBatch : public BackgroundTask {
+  RemoveBatch(DiskInterface* disk_interface, bool dry_run)
+      : disk_interface(disk_interface), dry_run(dry_run) {}
+
+  virtual void Run() {
+    results.resize(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+      if (dry_run) {
+        string err;
+        TimeStamp mtime = disk_interface->Stat(*paths[i], &err);
+        if (mtime == -1)
+          Error("%s", err.c_str());
+        // Treat Stat() errors as "file does not exist".
+        results[i] = mtime > 0 ? 0 : 1;
+      } else {
+        results[i] = disk_interface->RemoveFile(*paths[i]);
+      }
+    }
+  }
+
+  DiskInterface* disk_interface;
+  bool dry_run;
+  vector<const string*> paths;
+  /// What RemoveFile() returned for each path.
+  vector<int> results;
+};
+
 Cleaner::Cleaner(State* state,
                  const BuildConfig& config,
                  DiskInterface* disk_interface)
   : state_(state),
     config_(config),
     dyndep_loader_(state, disk_interface),
-    removed_(),
-    cleaned_(),
+    removers_(config.parallelism),
     cleaned_files_count_(0),
     disk_interface_(disk_interface),
     status_(0) {
 }
 
-int Cleaner::RemoveFile(const string& path) {
-  return disk_interface_->RemoveFile(path);
-}
-
-bool Cleaner::FileExists(const string& path) {
-  string err;
-  TimeStamp mtime = disk_interface_->Stat(path, &err);
-  if (mtime == -1)
-    Error("%s", err.c_str());
-  return mtime > 0;  // Treat Stat() errors as "file does not exist".
-}
-
 void Cleaner::Report(const string& path) {
   ++cleaned_files_count_;
   if (IsVerbose())
     printf("Remove %s\n", path.c_str());
 }
 
+void Cleaner::Remove(Node* node) {
+  if (Mark(&removed_nodes_, node))
+    QueueRemoval(node->path());
+}
+
 void Cleaner::Remove(const string& path) {
-  if (!IsAlreadyRemoved(path)) {
-    removed_.insert(path);
-    if (config_.dry_run) {
-      if (FileExists(path))
-        Report(path);
-    } else {
-      int ret = RemoveFile(path);
-      if (ret == 0)
-        Report(path);
-      else if (ret == -1)
-        status_ = 1;
+  // A depfile or rspfile may be some edge's output as well.
+  if (Node* node = state_->LookupNode(path)) {
+    Remove(node);
+    return;
+  }
+  if (removed_.count(path))
+    return;
+  edge_files_.push_back(path);
+  removed_.insert(make_pair(StringPiece(edge_files_.back()), true));
+  QueueRemoval(edge_files_.back());
+}
+
+void Cleaner::QueueRemoval(const string& path) {
+  queued_.push_back(&path);
+  if (queued_.size() >= kRemoveBatchSize)
+    PostBatch();
+}
+
+void Cleaner::PostBatch() {
+  if (queued_.empty())
+    return;
+  RemoveBatch* batch = new RemoveBatch(disk_interface_, config_.dry_run);
+  batch->paths.swap(queued_);
+  if (!disk_interface_->AllowsConcurrentAccess()) {
+    batch->Run();
+    BatchDone(batch);
+    return;
+  }
+  removers_.Post(batch);
+  // Report on the batches done so far, and keep the ones in flight from
+  // piling up when the graph is walked faster than files are removed.
+  size_t max_pending = 2 * (config_.parallelism > 1 ? config_.parallelism : 1);
+  while (BackgroundTask* done =
+             removers_.NextFinished(removers_.pending() > max_pending))
+    BatchDone(static_cast<RemoveBatch*>(done));
+}
+
+void Cleaner::BatchDone(RemoveBatch* batch) {
+  for (size_t i = 0; i < batch->paths.size(); ++i) {
+    const string& path = *batch->paths[i];
+    if (batch->results[i] == 0) {
+      Report(path);
+      if (!batch->dry_run)
+        emptied_dirs_.insert(path.substr(0, path.find_last_of("/\\") + 1));
+    } else if (batch->results[i] == -1) {
+      status_ = 1;
     }
   }
+  delete batch;
 }
 
-bool Cleaner::IsAlreadyRemoved(const string& path) {
-  set<string>::iterator i = removed_.find(path);
-  return (i != removed_.end());
+namespace {
+
+/// The depth of the directory |dir|, which ends in a separator.
+int DirDepth(const string& dir) {
+  int depth = 0;
+  for (size_t i = 0; i < dir.size(); ++i) {
+    if (dir[i] == '/' || dir[i] == '\\')
+      ++depth;
+  }
+  return depth;
+}
+
+}  // anonymous namespace
+
+void Cleaner::FinishRemovals() {
+  PostBatch();
+  while (BackgroundTask* done = removers_.NextFinished(true))
+    BatchDone(static_cast<RemoveBatch*>(done));
+
+  // Remove the directories the files were in if that left them empty, and
+  // then their parents, deepest first.  Directories outside the build's
+  // tree are left alone.
+  set<pair<int, string> > dirs;
+  for (set<string>::iterator d = emptied_dirs_.begin();
+       d != emptied_dirs_.end(); ++d)
+    dirs.insert(make_pair(-DirDepth(*d), *d));
+  while (!dirs.empty()) {
+    string dir = dirs.begin()->second;
+    dirs.erase(dirs.begin());
+    if (dir.empty() || dir[0] == '/' || dir[0] == '\\' ||
+        dir.find(':') != string::npos || dir.compare(0, 3, "../") == 0 ||
+        dir.compare(0, 3, "..\\") == 0 || dir == "./")
+      continue;
+    string path = dir.substr(0, dir.size() - 1);
+    if (disk_interface_->RemoveEmptyDir(path) != 0)
+      continue;
+    if (IsVerbose())
+      printf("Remove %s\n", dir.c_str());
+    string parent = path.substr(0, path.find_last_of("/\\") + 1);
+    dirs.insert(make_pair(-DirDepth(parent), parent));
+  }
+  emptied_dirs_.clear();
 }
 
 void Cleaner::RemoveEdgeFiles(Edge* edge) {
@@ -115,34 +230,38 @@ int Cleaner::CleanAll(bool generator) {
       continue;
     for (vector<Node*>::iterator out_node = (*e)->outputs_.begin();
          out_node != (*e)->outputs_.end(); ++out_node) {
-      Remove((*out_node)->path());
+      Remove(*out_node);
     }
 
     RemoveEdgeFiles(*e);
   }
+  FinishRemovals();
   PrintFooter();
   return status_;
 }
 
 void Cleaner::DoCleanTarget(Node* target) {
-  if (Edge* e = target->in_edge()) {
+  if (!Mark(&cleaned_, target))
+    return;
+  vector<Node*> stack(1, target);
+  while (!stack.empty()) {
+    Node* node = stack.back();
+    stack.pop_back();
+    Edge* e = node->in_edge();
+    if (!e)
+      continue;
     // Do not try to remove phony targets
     if (!e->is_phony()) {
-      Remove(target->path());
+      Remove(node);
       RemoveEdgeFiles(e);
     }
-    for (vector<Node*>::iterator n = e->inputs_.begin(); n != e->inputs_.end();
-         ++n) {
-      Node* next = *n;
-      // call DoCleanTarget recursively if this node has not been visited
-      if (cleaned_.count(next) == 0) {
-        DoCleanTarget(next);
-      }
+    // Visit the inputs in order, as they come off the stack.
+    for (vector<Node*>::reverse_iterator n = e->inputs_.rbegin();
+         n != e->inputs_.rend(); ++n) {
+      if (Mark(&cleaned_, *n))
+        stack.push_back(*n);
     }
   }
-
-  // mark this target to be cleaned already
-  cleaned_.insert(target);
 }
 
 int Cleaner::CleanTarget(Node* target) {
@@ -152,6 +271,7 @@ int Cleaner::CleanTarget(Node* target) {
   PrintHeader();
   LoadDyndeps();
   DoCleanTarget(target);
+  FinishRemovals();
   PrintFooter();
   return status_;
 }
@@ -193,22 +313,29 @@ int Cleaner::CleanTargets(int target_count, char* targets[]) {
       }
     }
   }
+  FinishRemovals();
   PrintFooter();
   return status_;
 }
 
-void Cleaner::DoCleanRule(const Rule* rule) {
-  assert(rule);
+void Cleaner::DoCleanRules(const vector<const Rule*>& rules) {
+  if (rules.empty())
+    return;
+  // Rules are matched by name, for the rules of the same name that
+  // subninjas have.
+  ExternalStringHashMap<bool>::Type names;
+  for (vector<const Rule*>::const_iterator r = rules.begin();
+       r != rules.end(); ++r)
+    names[(*r)->name()] = true;
 
   for (vector<Edge*>::iterator e = state_->edges_.begin();
        e != state_->edges_.end(); ++e) {
-    if ((*e)->rule().name() == rule->name()) {
-      for (vector<Node*>::iterator out_node = (*e)->outputs_.begin();
-           out_node != (*e)->outputs_.end(); ++out_node) {
-        Remove((*out_node)->path());
-        RemoveEdgeFiles(*e);
-      }
-    }
+    if (!names.count((*e)->rule().name()))
+      continue;
+    for (vector<Node*>::iterator out_node = (*e)->outputs_.begin();
+         out_node != (*e)->outputs_.end(); ++out_node)
+      Remove(*out_node);
+    RemoveEdgeFiles(*e);
   }
 }
 
@@ -218,7 +345,8 @@ int Cleaner::CleanRule(const Rule* rule) {
   Reset();
   PrintHeader();
   LoadDyndeps();
-  DoCleanRule(rule);
+  DoCleanRules(vector<const Rule*>(1, rule));
+  FinishRemovals();
   PrintFooter();
   return status_;
 }
@@ -243,18 +371,38 @@ int Cleaner::CleanRules(int rule_count, char* rules[]) {
   Reset();
   PrintHeader();
   LoadDyndeps();
+  vector<const Rule*> found;
   for (int i = 0; i < rule_count; ++i) {
     const char* rule_name = rules[i];
     const Rule* rule = state_->bindings_.LookupRule(rule_name);
     if (rule) {
       if (IsVerbose())
         printf("Rule %s\n", rule_name);
-      DoCleanRule(rule);
+      found.push_back(rule);
     } else {
       Error("unknown rule '%s'", rule_name);
       status_ = 1;
     }
   }
+  DoCleanRules(found);
+  FinishRemovals();
+  PrintFooter();
+  return status_;
+}
+
+int Cleaner::CleanDead(const BuildLog::Entries& entries) {
+  Reset();
+  PrintHeader();
+  LoadDyndeps();
+  for (BuildLog::Entries::const_iterator i = entries.begin();
+       i != entries.end(); ++i) {
+    Node* n = state_->LookupNode(i->first);
+    // An output is stale if the graph doesn't know it, or if it only knows
+    // it from a stale entry in the deps log: no edge builds or reads it.
+    if (!n || (!n->in_edge() && n->out_edges().empty()))
+      Remove(i->second->output);
+  }
+  FinishRemovals();
   PrintFooter();
   return status_;
 }
@@ -262,8 +410,10 @@ int Cleaner::CleanRules(int rule_count, char* rules[]) {
 void Cleaner::Reset() {
   status_ = 0;
   cleaned_files_count_ = 0;
+  removed_nodes_.assign(state_->node_count(), false);
   removed_.clear();
-  cleaned_.clear();
+  edge_files_.clear();
+  cleaned_.assign(state_->node_count(), false);
 }
 
 void Cleaner::LoadDyndeps() {
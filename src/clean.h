@@ -15,11 +15,16 @@
 #ifndef NINJA_CLEAN_H_
 #define NINJA_CLEAN_H_
 
+#include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "build.h"
+#include "build_log.h"
 #include "dyndep.h"
+#include "hash_map.h"
+#include "parallel.h"
 
 using namespace std;
 
@@ -28,6 +33,11 @@ struct Node;
 struct Rule;
 struct DiskInterface;
 
+/// Removes the files a build made.  When the disk interface allows it,
+/// the files are removed in batches on several threads while the graph is
+/// still being walked, which matters most on network filesystems where
+/// every removal is a round trip.  Directories the build left empty are
+/// removed afterwards, deepest first.
 struct Cleaner {
   /// Build a cleaner object with the given @a disk_interface
   Cleaner(State* state,
@@ -59,6 +69,11 @@ struct Cleaner {
   /// @return non-zero if an error occurs.
   int CleanRules(int rule_count, char* rules[]);
 
+  /// Clean the files the build log lists that the graph no longer builds,
+  /// outputs of edges since removed from the manifest.
+  /// @return non-zero if an error occurs.
+  int CleanDead(const BuildLog::Entries& entries);
+
   /// @return the number of file cleaned.
   int cleaned_files_count() const {
     return cleaned_files_count_;
@@ -71,25 +86,33 @@ struct Cleaner {
   }
 
  private:
-  /// Remove the file @a path.
-  /// @return whether the file has been removed.
-  int RemoveFile(const string& path);
-  /// @returns whether the file @a path exists.
-  bool FileExists(const string& path);
   void Report(const string& path);
 
-  /// Remove the given @a path file only if it has not been already removed.
+  /// Remove the output @a node only if it has not been already removed.
+  void Remove(Node* node);
+  /// Remove the given @a path file only if it has not been already removed,
+  /// as a node's output or otherwise.
   void Remove(const string& path);
-  /// @return whether the given @a path has already been removed.
-  bool IsAlreadyRemoved(const string& path);
+  /// Queue @a path for removal.  The string must outlive the clean.
+  void QueueRemoval(const string& path);
   /// Remove the depfile and rspfile for an Edge.
   void RemoveEdgeFiles(Edge* edge);
 
-  /// Helper recursive method for CleanTarget().
+  struct RemoveBatch;
+  /// Hand the queued paths over to be removed.
+  void PostBatch();
+  /// Record the outcome of a batch of removals.
+  void BatchDone(RemoveBatch* batch);
+  /// Wait for every batch, then prune the directories left empty.
+  void FinishRemovals();
+
+  /// Clean @a target and everything it is built from, unless already.
   void DoCleanTarget(Node* target);
   void PrintHeader();
   void PrintFooter();
-  void DoCleanRule(const Rule* rule);
+  /// Clean the outputs of the edges of all of @a rules, by name, in one walk
+  /// over the edges.
+  void DoCleanRules(const vector<const Rule*>& rules);
   void Reset();
 
   /// Load dependencies from dyndep bindings.
@@ -98,8 +121,20 @@ struct Cleaner {
   State* state_;
   const BuildConfig& config_;
   DyndepLoader dyndep_loader_;
-  set<string> removed_;
-  set<Node*> cleaned_;
+  /// By Node::index(), the nodes whose paths were queued for removal.
+  vector<bool> removed_nodes_;
+  /// The other paths queued for removal, keyed by strings owned by
+  /// edge_files_.
+  ExternalStringHashMap<bool>::Type removed_;
+  /// The depfiles and rspfiles queued for removal.
+  deque<string> edge_files_;
+  /// The paths to hand over in the next batch.
+  vector<const string*> queued_;
+  TaskQueue removers_;
+  /// The directories of the files removed.
+  set<string> emptied_dirs_;
+  /// By Node::index(), the targets cleaned so far.
+  vector<bool> cleaned_;
   int cleaned_files_count_;
   DiskInterface* disk_interface_;
   int status_;
@@ -240,6 +240,32 @@ TEST_F(CleanTest, CleanRuleGenerator) {
   EXPECT_EQ(2u, fs_.files_removed_.size());
 }
 
+TEST_F(CleanTest, CleanRules) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"rule cat_e\n"
+"  command = cat -e $in > $out\n"
+"rule cc\n"
+"  command = cc $in > $out\n"
+"  depfile = in1\n"
+"build in1: cat_e src1\n"
+"build out1: cc in1\n"
+"build out2: cat in1\n"));
+  fs_.Create("in1", "");
+  fs_.Create("out1", "");
+  fs_.Create("out2", "");
+
+  // The depfile of out1 is the output of the other rule, and is only
+  // counted once.
+  config_.dry_run = true;
+  Cleaner cleaner(&state_, config_, &fs_);
+  char cat_e[] = "cat_e";
+  char cc[] = "cc";
+  char* rules[] = { cat_e, cc, cat_e };
+  EXPECT_EQ(0, cleaner.CleanRules(3, rules));
+  EXPECT_EQ(2, cleaner.cleaned_files_count());
+  EXPECT_EQ(0u, fs_.files_removed_.size());
+}
+
 TEST_F(CleanTest, CleanDepFile) {
   ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
 "rule cc\n"
@@ -454,3 +480,117 @@ TEST_F(CleanTest, CleanDepFileAndRspFileWithSpaces) {
   EXPECT_EQ(0, fs_.Stat("out 1.d", &err));
   EXPECT_EQ(0, fs_.Stat("out 2.rsp", &err));
 }
+
+TEST_F(CleanTest, CleanEmptiedDirs) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"build out/sub/a: cat src1\n"
+"build out/b: cat src1\n"
+"build gen/c: cat src1\n"));
+  fs_.MakeDir("out");
+  fs_.MakeDir("out/sub");
+  fs_.MakeDir("gen");
+  fs_.Create("out/sub/a", "");
+  fs_.Create("out/b", "");
+  fs_.Create("gen/c", "");
+  fs_.Create("gen/keep", "");
+
+  Cleaner cleaner(&state_, config_, &fs_);
+  EXPECT_EQ(0, cleaner.CleanAll());
+  EXPECT_EQ(3, cleaner.cleaned_files_count());
+
+  // out/ and out/sub/ are left empty, gen/ isn't.
+  ASSERT_EQ(1u, fs_.directories_made_.size());
+  EXPECT_EQ("gen", fs_.directories_made_[0]);
+}
+
+struct CleanDiskTest : public StateTestWithBuiltinRules {
+  virtual void SetUp() {
+    // These tests do real disk accesses, so create a temp dir.
+    temp_dir_.CreateAndEnter("Ninja-CleanDiskTest");
+    config_.verbosity = BuildConfig::QUIET;
+    config_.parallelism = 4;
+  }
+
+  virtual void TearDown() {
+    temp_dir_.Cleanup();
+  }
+
+  ScopedTempDir temp_dir_;
+  RealDiskInterface disk_;
+  BuildConfig config_;
+};
+
+TEST_F(CleanDiskTest, CleanManyInParallel) {
+  string manifest;
+  for (int i = 0; i < 500; ++i) {
+    char line[64];
+    snprintf(line, sizeof(line), "build out/%d/o out/%d.o: cat src\n",
+             i % 10, i);
+    manifest += line;
+  }
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_, manifest.c_str()));
+  ASSERT_TRUE(disk_.MakeDir("out"));
+  ASSERT_TRUE(disk_.MakeDir("out/3"));
+  for (int i = 0; i < 500; ++i) {
+    char path[32];
+    snprintf(path, sizeof(path), "out/%d.o", i);
+    ASSERT_TRUE(disk_.WriteFile(path, ""));
+  }
+  ASSERT_TRUE(disk_.WriteFile("out/3/o", ""));
+
+  Cleaner cleaner(&state_, config_, &disk_);
+  EXPECT_EQ(0, cleaner.CleanAll());
+  EXPECT_EQ(501, cleaner.cleaned_files_count());
+
+  // Every directory the outputs were in is left empty.
+  string err;
+  EXPECT_EQ(0, disk_.Stat("out/3", &err));
+  EXPECT_EQ(0, disk_.Stat("out", &err));
+}
+
+namespace {
+
+struct NoDeadPaths : public BuildLogUser {
+  virtual bool IsPathDead(StringPiece) const { return false; }
+};
+
+}  // anonymous namespace
+
+TEST_F(CleanDiskTest, CleanDead) {
+  State old_state;
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&old_state,
+"rule cat\n"
+"  command = cat $in > $out\n"
+"build out1: cat in\n"
+"build out2: cat in\n"
+"build gone/out3: cat out1\n"));
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"build out2: cat in\n"
+"build out4: cat out1\n"));
+  ASSERT_TRUE(disk_.WriteFile("in", ""));
+  ASSERT_TRUE(disk_.WriteFile("out1", ""));
+  ASSERT_TRUE(disk_.WriteFile("out2", ""));
+  ASSERT_TRUE(disk_.MakeDir("gone"));
+  ASSERT_TRUE(disk_.WriteFile("gone/out3", ""));
+
+  string err;
+  NoDeadPaths user;
+  BuildLog log;
+  ASSERT_TRUE(log.OpenForWrite(".ninja_log", user, &err));
+  for (size_t i = 0; i < old_state.edges_.size(); ++i)
+    ASSERT_TRUE(log.RecordCommand(old_state.edges_[i], 15, 18));
+  log.Close();
+
+  BuildLog loaded;
+  ASSERT_TRUE(loaded.Load(".ninja_log", &err));
+  ASSERT_EQ("", err);
+
+  // out1 is still read by another edge, and out2 still built.
+  Cleaner cleaner(&state_, config_, &disk_);
+  EXPECT_EQ(0, cleaner.CleanDead(loaded.entries()));
+  EXPECT_EQ(1, cleaner.cleaned_files_count());
+  EXPECT_GT(disk_.Stat("out1", &err), 0);
+  EXPECT_GT(disk_.Stat("out2", &err), 0);
+  EXPECT_EQ(0, disk_.Stat("gone/out3", &err));
+  EXPECT_EQ(0, disk_.Stat("gone", &err));
+}
@@ -36,8 +36,62 @@ bool EndsWith(const string& input, const string& needle) {
           input.substr(input.size() - needle.size()) == needle);
 }
 
+/// Normalizes the includes a CLParser hasn't seen before, possibly on
+/// several threads at once.
+struct NormalizeTask : public ParallelTask {
+  explicit NormalizeTask(const vector<string>& includes)
+      : includes_(includes), normalized_(includes.size()),
+#ifdef _WIN32
+        normalizer_("."),
+#endif
+        errs_(includes.size()) {}
+
+  virtual void Run(size_t index) {
+    string& normalized = normalized_[index];
+#ifdef _WIN32
+    if (!normalizer_.Normalize(includes_[index], &normalized, &errs_[index]))
+      return;
+#else
+    // TODO: should this make the path relative to cwd?
+    normalized = includes_[index];
+    uint64_t slash_bits;
+    if (!CanonicalizePath(&normalized, &slash_bits, &errs_[index]))
+      return;
+#endif
+    if (CLParser::IsSystemInclude(normalized))
+      normalized.clear();
+  }
+
+  const vector<string>& includes_;
+  /// The paths to record, empty for the ones to drop.
+  vector<string> normalized_;
+#ifdef _WIN32
+  IncludesNormalize normalizer_;
+#endif
+  vector<string> errs_;
+};
+
 }  // anonymous namespace
 
+bool IncludesCache::Lookup(const string& include, string* normalized) {
+  ScopedLock lock(&mutex_);
+  map<string, string>::const_iterator i = entries_.find(include);
+  if (i == entries_.end())
+    return false;
+  *normalized = i->second;
+  return true;
+}
+
+void IncludesCache::Add(const string& include, const string& normalized) {
+  ScopedLock lock(&mutex_);
+  entries_.insert(make_pair(include, normalized));
+}
+
+size_t IncludesCache::size() {
+  ScopedLock lock(&mutex_);
+  return entries_.size();
+}
+
 // static
 string CLParser::FilterShowIncludes(const string& line,
                                     const string& deps_prefix) {
@@ -73,7 +127,6 @@ bool CLParser::FilterInputFilename(string line) {
       EndsWith(line, ".cpp");
 }
 
-// static
 bool CLParser::Parse(const string& output, const string& deps_prefix,
                      string* filtered_output, string* err) {
   METRIC_RECORD("CLParser::Parse");
@@ -81,9 +134,7 @@ bool CLParser::Parse(const string& output, const string& deps_prefix,
   // Loop over all lines in the output to process them.
   assert(&output != filtered_output);
   size_t start = 0;
-#ifdef _WIN32
-  IncludesNormalize normalizer(".");
-#endif
+  vector<string> includes;
 
   while (start < output.size()) {
     size_t end = output.find_first_of("\r\n", start);
@@ -93,19 +144,7 @@ bool CLParser::Parse(const string& output, const string& deps_prefix,
 
     string include = FilterShowIncludes(line, deps_prefix);
     if (!include.empty()) {
-      string normalized;
-#ifdef _WIN32
-      if (!normalizer.Normalize(include, &normalized, err))
-        return false;
-#else
-      // TODO: should this make the path relative to cwd?
-      normalized = include;
-      uint64_t slash_bits;
-      if (!CanonicalizePath(&normalized, &slash_bits, err))
-        return false;
-#endif
-      if (!IsSystemInclude(normalized))
-        includes_.insert(normalized);
+      includes.push_back(include);
     } else if (FilterInputFilename(line)) {
       // Drop it.
       // TODO: if we support compiling multiple output files in a single
@@ -122,5 +161,42 @@ bool CLParser::Parse(const string& output, const string& deps_prefix,
     start = end;
   }
 
+  return AddIncludes(includes, err);
+}
+
+bool CLParser::AddIncludes(const vector<string>& includes, string* err) {
+  // Take what the cache knows, and normalize each other path only once.
+  vector<string> pending;
+  set<string> seen;
+  string normalized;
+  for (vector<string>::const_iterator i = includes.begin();
+       i != includes.end(); ++i) {
+    if (cache_ && cache_->Lookup(*i, &normalized)) {
+      if (!normalized.empty())
+        includes_.insert(normalized);
+    } else if (seen.insert(*i).second) {
+      pending.push_back(*i);
+    }
+  }
+  if (pending.empty())
+    return true;
+
+  // Normalizing a path is cheap next to starting a thread, so only the
+  // first commands of a build, with a cold cache, fan out.
+  const size_t kMinIncludesPerThread = 128;
+  NormalizeTask task(pending);
+  RunInParallel(&task, pending.size(),
+                ParallelismFor(pending.size(), kMinIncludesPerThread));
+
+  for (size_t i = 0; i < pending.size(); ++i) {
+    if (!task.errs_[i].empty()) {
+      *err = task.errs_[i];
+      return false;
+    }
+    if (cache_)
+      cache_->Add(pending[i], task.normalized_[i]);
+    if (!task.normalized_[i].empty())
+      includes_.insert(task.normalized_[i]);
+  }
   return true;
 }
@@ -15,15 +15,40 @@
 #ifndef NINJA_CLPARSER_H_
 #define NINJA_CLPARSER_H_
 
+#include <map>
 #include <set>
 #include <string>
+#include <vector>
 using namespace std;
 
+#include "parallel.h"
+
+/// Normalized include paths, shared by the CLParsers of a build so each
+/// header the compiler mentions is normalized once rather than once per
+/// edge.  Normalization only depends on the path and the working
+/// directory, so entries stay valid for the life of the process.
+/// Safe to use from several threads at once.
+struct IncludesCache {
+  /// Look up the normalized form of |include|, which is empty if the
+  /// include is to be dropped.  Returns false if it isn't known yet.
+  bool Lookup(const string& include, string* normalized);
+
+  void Add(const string& include, const string& normalized);
+
+  size_t size();
+
+ private:
+  Mutex mutex_;
+  map<string, string> entries_;
+};
+
 /// Visual Studio's cl.exe requires some massaging to work with Ninja;
 /// for example, it emits include information on stderr in a funny
 /// format when building with /showIncludes.  This class parses this
 /// output.
 struct CLParser {
+  explicit CLParser(IncludesCache* cache = NULL) : cache_(cache) {}
+
   /// Parse a line of cl.exe output and extract /showIncludes info.
   /// If a dependency is extracted, returns a nonempty string.
   /// Exposed for testing.
@@ -47,6 +72,13 @@ struct CLParser {
              string* filtered_output, string* err);
 
   set<string> includes_;
+
+ private:
+  /// Normalize the raw |includes| and add them to includes_, consulting
+  /// and filling cache_ if there is one.
+  bool AddIncludes(const vector<string>& includes, string* err);
+
+  IncludesCache* cache_;
 };
 
 #endif  // NINJA_CLPARSER_H_
@@ -115,3 +115,30 @@ TEST(CLParserTest, DuplicatedHeaderPathConverted) {
   ASSERT_EQ("", output);
   ASSERT_EQ(2u, parser.includes_.size());
 }
+
+TEST(CLParserTest, SharedCache) {
+  IncludesCache cache;
+  string output, err;
+  {
+    CLParser parser(&cache);
+    ASSERT_TRUE(parser.Parse(
+        "Note: including file: sub/./foo.h\r\n"
+        "Note: including file: c:\\Program Files\\bar.h\r\n"
+        "Note: including file: sub/./foo.h\r\n",
+        "", &output, &err));
+    ASSERT_EQ(1u, parser.includes_.size());
+  }
+  // Each raw path is cached once, the dropped system header included.
+  ASSERT_EQ(2u, cache.size());
+
+  // A later parser takes what the cache says without normalizing again.
+  cache.Add("baz.h", "cached/baz.h");
+  CLParser parser(&cache);
+  ASSERT_TRUE(parser.Parse(
+      "Note: including file: baz.h\r\n"
+      "Note: including file: c:\\Program Files\\bar.h\r\n",
+      "", &output, &err));
+  ASSERT_EQ("", output);
+  ASSERT_EQ(1u, parser.includes_.size());
+  ASSERT_EQ("cached/baz.h", *parser.includes_.begin());
+}
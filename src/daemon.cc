@@ -0,0 +1,301 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "daemon.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "graph.h"
+#include "state.h"
+
+// GraphSnapshot ---------------------------------------------------------------
+
+void GraphSnapshot::Capture(const State& state) {
+  implicit_deps_.clear();
+  implicit_deps_.reserve(state.edges_.size());
+  uses_dyndep_ = false;
+  for (vector<Edge*>::const_iterator e = state.edges_.begin();
+       e != state.edges_.end(); ++e) {
+    implicit_deps_.push_back((*e)->implicit_deps_);
+    if ((*e)->dyndep_)
+      uses_dyndep_ = true;
+  }
+}
+
+void GraphSnapshot::Restore(State* state) const {
+  for (size_t i = 0; i < implicit_deps_.size(); ++i)
+    RestoreEdge(state->edges_[i]);
+}
+
+void GraphSnapshot::RestoreEdge(Edge* edge) const {
+  // Edges made since the capture, like the phony ones for discovered deps,
+  // have nothing to give back.
+  if (edge->id() < 0 || (size_t)edge->id() >= implicit_deps_.size())
+    return;
+  int discovered = edge->implicit_deps_ - implicit_deps_[edge->id()];
+  if (discovered <= 0)
+    return;
+  // Discovered deps sit at the end of the implicit deps, just before
+  // the order-only ones.
+  vector<Node*>::iterator end = edge->inputs_.end() - edge->order_only_deps_;
+  vector<Node*>::iterator begin = end - discovered;
+  for (vector<Node*>::iterator n = begin; n != end; ++n)
+    (*n)->RemoveOutEdge(edge);
+  edge->inputs_.erase(begin, end);
+  edge->ClearMemo();
+  edge->implicit_deps_ = implicit_deps_[edge->id()];
+  edge->log_deps_ = 0;
+  edge->unlinked_deps_ = 0;
+}
+
+#ifndef _WIN32
+
+namespace {
+
+/// Write all of |size| bytes, retrying on EINTR.
+bool WriteAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t len = write(fd, data, size);
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len <= 0)
+      return false;
+    data += len;
+    size -= len;
+  }
+  return true;
+}
+
+/// Read exactly |size| bytes, retrying on EINTR.
+bool ReadAll(int fd, char* data, size_t size) {
+  while (size > 0) {
+    ssize_t len = read(fd, data, size);
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len <= 0)
+      return false;
+    data += len;
+    size -= len;
+  }
+  return true;
+}
+
+bool MakeSocketAddress(const string& path, sockaddr_un* addr, string* err) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr->sun_path)) {
+    *err = "socket path '" + path + "' too long";
+    return false;
+  }
+  memcpy(addr->sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+}  // anonymous namespace
+
+// DaemonServer ----------------------------------------------------------------
+
+bool DaemonServer::Listen(const string& path, string* err) {
+  sockaddr_un addr;
+  if (!MakeSocketAddress(path, &addr, err))
+    return false;
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd_ < 0) {
+    *err = string("socket: ") + strerror(errno);
+    return false;
+  }
+  // Don't leak the socket into the commands we run.
+  fcntl(listen_fd_, F_SETFD, FD_CLOEXEC);
+  unlink(path.c_str());
+  // Only the user running the daemon may ask it to run commands.
+  mode_t old_umask = umask(077);
+  int ret = bind(listen_fd_, (sockaddr*)&addr, sizeof(addr));
+  umask(old_umask);
+  if (ret < 0 || listen(listen_fd_, 16) < 0) {
+    *err = "listening on '" + path + "': " + strerror(errno);
+    Close();
+    return false;
+  }
+  path_ = path;
+  return true;
+}
+
+bool DaemonServer::Accept(DaemonRequest* request, string* err) {
+  int fd;
+  do {
+    fd = accept(listen_fd_, NULL, NULL);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0) {
+    *err = string("accept: ") + strerror(errno);
+    return false;
+  }
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  request->fd = fd;
+
+  // The first message carries the payload size and the client's stdout and
+  // stderr.
+  uint32_t size = 0;
+  iovec iov = { &size, sizeof(size) };
+  char control[CMSG_SPACE(2 * sizeof(int))];
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t len;
+  do {
+    len = recvmsg(fd, &msg, 0);
+  } while (len < 0 && errno == EINTR);
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  if (len != sizeof(size) || !cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+    *err = "malformed request";
+    Reply(request, 1);
+    return false;
+  }
+  int fds[2];
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+  request->stdout_fd = fds[0];
+  request->stderr_fd = fds[1];
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+  string payload(size, '\0');
+  if (size && !ReadAll(fd, &payload[0], size)) {
+    *err = "truncated request";
+    Reply(request, 1);
+    return false;
+  }
+  // The payload is the client's working directory followed by its
+  // arguments, each nul-terminated.
+  request->args.clear();
+  size_t start = 0;
+  bool first = true;
+  for (size_t i = 0; i < payload.size(); ++i) {
+    if (payload[i] != '\0')
+      continue;
+    string word = payload.substr(start, i - start);
+    if (first)
+      request->cwd = word;
+    else
+      request->args.push_back(word);
+    first = false;
+    start = i + 1;
+  }
+  return true;
+}
+
+void DaemonServer::Reply(DaemonRequest* request, int status) {
+  // A client that went away must not take the daemon down with SIGPIPE.
+  struct sigaction ignore, old_act;
+  memset(&ignore, 0, sizeof(ignore));
+  ignore.sa_handler = SIG_IGN;
+  sigaction(SIGPIPE, &ignore, &old_act);
+  char byte = (char)status;
+  WriteAll(request->fd, &byte, 1);
+  sigaction(SIGPIPE, &old_act, NULL);
+
+  if (request->stdout_fd >= 0)
+    close(request->stdout_fd);
+  if (request->stderr_fd >= 0)
+    close(request->stderr_fd);
+  close(request->fd);
+  request->stdout_fd = request->stderr_fd = request->fd = -1;
+}
+
+void DaemonServer::Close() {
+  if (listen_fd_ < 0)
+    return;
+  close(listen_fd_);
+  listen_fd_ = -1;
+  if (!path_.empty())
+    unlink(path_.c_str());
+  path_.clear();
+}
+
+// Client ----------------------------------------------------------------------
+
+int RunDaemonRequest(const string& path, const vector<string>& args,
+                     string* err) {
+  sockaddr_un addr;
+  if (!MakeSocketAddress(path, &addr, err))
+    return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    *err = string("socket: ") + strerror(errno);
+    return -1;
+  }
+  if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    *err = "connecting to '" + path + "': " + strerror(errno);
+    close(fd);
+    return -1;
+  }
+
+  vector<char> cwd(1024);
+  while (!getcwd(&cwd[0], cwd.size()) && errno == ERANGE)
+    cwd.resize(cwd.size() * 2);
+  string payload(&cwd[0]);
+  payload.push_back('\0');
+  for (vector<string>::const_iterator i = args.begin(); i != args.end(); ++i) {
+    payload += *i;
+    payload.push_back('\0');
+  }
+
+  uint32_t size = payload.size();
+  iovec iov = { &size, sizeof(size) };
+  int fds[2] = { 1, 2 };
+  char control[CMSG_SPACE(sizeof(fds))];
+  memset(control, 0, sizeof(control));
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  if (sendmsg(fd, &msg, 0) != sizeof(size) ||
+      !WriteAll(fd, payload.data(), payload.size())) {
+    *err = string("sending request: ") + strerror(errno);
+    close(fd);
+    return -1;
+  }
+
+  char status;
+  if (!ReadAll(fd, &status, 1)) {
+    *err = "daemon exited without replying";
+    close(fd);
+    return -1;
+  }
+  close(fd);
+  return (unsigned char)status;
+}
+
+#endif  // _WIN32
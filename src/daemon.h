@@ -0,0 +1,95 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_DAEMON_H_
+#define NINJA_DAEMON_H_
+
+#include <string>
+#include <vector>
+using namespace std;
+
+struct Edge;
+struct State;
+
+/// Remembers the shape of a freshly loaded graph so that it can be reused
+/// for another build.  DependencyScan appends discovered dependencies to
+/// edges as it loads them; Restore() takes them off again so the next scan
+/// reloads them from the (possibly updated) depfiles and deps log.
+struct GraphSnapshot {
+  void Capture(const State& state);
+  void Restore(State* state) const;
+  /// Restore() only |edge|.
+  void RestoreEdge(Edge* edge) const;
+
+  /// Whether the graph uses dyndep files.  Those change the graph in ways
+  /// Restore() cannot undo.
+  bool uses_dyndep() const { return uses_dyndep_; }
+
+ private:
+  /// Number of implicit deps of each captured edge, by index in State::edges_.
+  vector<int> implicit_deps_;
+  bool uses_dyndep_;
+};
+
+#ifndef _WIN32
+/// Status sent to a client when the daemon has to reload before it can
+/// serve its request.  The client should reconnect and ask again.
+const int kDaemonRestarting = 255;
+
+/// A build request received by "ninja -t daemon".
+struct DaemonRequest {
+  DaemonRequest() : stdout_fd(-1), stderr_fd(-1), fd(-1) {}
+
+  /// Working directory of the client.
+  string cwd;
+  /// Command-line arguments (targets) to build.
+  vector<string> args;
+  /// The client's own stdout and stderr, passed over the socket.
+  int stdout_fd;
+  int stderr_fd;
+  /// Connection to the client.
+  int fd;
+};
+
+/// The listening end of "ninja -t daemon": a Unix domain socket on which
+/// clients send build requests along with their stdout and stderr.
+struct DaemonServer {
+  DaemonServer() : listen_fd_(-1) {}
+  ~DaemonServer() { Close(); }
+
+  /// Start listening on |path|, replacing any stale socket there.
+  bool Listen(const string& path, string* err);
+
+  /// Wait for the next client and read its request.
+  bool Accept(DaemonRequest* request, string* err);
+
+  /// Send the exit status of a request to its client and close it.
+  void Reply(DaemonRequest* request, int status);
+
+  /// Stop listening and remove the socket.
+  void Close();
+
+ private:
+  string path_;
+  int listen_fd_;
+};
+
+/// Ask the daemon listening on |path| to build |args| with our stdout and
+/// stderr.  Returns the exit status of the build, or -1 and fills |err| if
+/// the daemon could not be reached.
+int RunDaemonRequest(const string& path, const vector<string>& args,
+                     string* err);
+#endif  // _WIN32
+
+#endif  // NINJA_DAEMON_H_
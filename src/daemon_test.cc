@@ -0,0 +1,181 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "daemon.h"
+
+#include "graph.h"
+#include "parallel.h"
+#include "state.h"
+#include "test.h"
+
+namespace {
+
+struct GraphSnapshotTest : public StateTestWithBuiltinRules {
+  GraphSnapshotTest() : scan_(&state_, NULL, NULL, &fs_, NULL) {}
+
+  VirtualFileSystem fs_;
+  DependencyScan scan_;
+};
+
+TEST_F(GraphSnapshotTest, DropsDiscoveredDeps) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"rule catdep\n"
+"  depfile = $out.d\n"
+"  command = cat $in > $out\n"
+"build out.o: catdep foo.cc | manifest.h || order\n"));
+  fs_.Create("foo.cc", "");
+  fs_.Create("out.o.d", "out.o: foo.cc header.h\n");
+  fs_.Create("out.o", "");
+
+  GraphSnapshot snapshot;
+  snapshot.Capture(state_);
+  EXPECT_FALSE(snapshot.uses_dyndep());
+
+  string err;
+  Edge* edge = GetNode("out.o")->in_edge();
+  EXPECT_TRUE(scan_.RecomputeDirty(GetNode("out.o"), &err));
+  ASSERT_EQ("", err);
+  ASSERT_EQ(5u, edge->inputs_.size());
+  ASSERT_EQ(1u, GetNode("header.h")->out_edges().size());
+
+  snapshot.Restore(&state_);
+  ASSERT_EQ(3u, edge->inputs_.size());
+  EXPECT_EQ(1, edge->implicit_deps_);
+  EXPECT_EQ("manifest.h", edge->inputs_[1]->path());
+  EXPECT_EQ("order", edge->inputs_[2]->path());
+  EXPECT_EQ(0u, GetNode("header.h")->out_edges().size());
+  EXPECT_EQ(1u, GetNode("foo.cc")->out_edges().size());
+
+  // The deps are loaded afresh by the next scan.
+  state_.Reset();
+  EXPECT_TRUE(scan_.RecomputeDirty(GetNode("out.o"), &err));
+  ASSERT_EQ("", err);
+  EXPECT_EQ(5u, edge->inputs_.size());
+}
+
+TEST_F(GraphSnapshotTest, ResetDependents) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"rule catdep\n"
+"  depfile = $out.d\n"
+"  command = cat $in > $out\n"
+"build a.o: catdep a.c\n"
+"build b.o: catdep b.c\n"
+"build all: cat a.o b.o\n"));
+  fs_.Create("a.c", "");
+  fs_.Create("b.c", "");
+  fs_.Create("a.o.d", "a.o: a.c a.h\n");
+  fs_.Create("b.o.d", "b.o: b.c\n");
+  fs_.Create("a.o", "");
+  fs_.Create("b.o", "");
+  fs_.Create("all", "");
+
+  GraphSnapshot snapshot;
+  snapshot.Capture(state_);
+  string err;
+  EXPECT_TRUE(scan_.RecomputeDirty(GetNode("all"), &err));
+  ASSERT_EQ("", err);
+  Edge* a = GetNode("a.o")->in_edge();
+  Edge* b = GetNode("b.o")->in_edge();
+  ASSERT_EQ(3u, a->inputs_.size());
+
+  // A change to a discovered header resets the edges that depend on it,
+  // and their outputs, leaving b.o's alone.
+  vector<Node*> changed(1, GetNode("a.h"));
+  vector<Edge*> edges;
+  state_.ResetDependents(changed, &edges);
+  for (vector<Edge*>::iterator e = edges.begin(); e != edges.end(); ++e)
+    snapshot.RestoreEdge(*e);
+  EXPECT_FALSE(GetNode("a.h")->status_known());
+  EXPECT_FALSE(GetNode("a.o")->status_known());
+  EXPECT_FALSE(GetNode("all")->status_known());
+  EXPECT_TRUE(GetNode("b.o")->status_known());
+  EXPECT_EQ(Edge::VisitNone, a->mark_);
+  EXPECT_EQ(Edge::VisitDone, b->mark_);
+  EXPECT_EQ(1u, a->inputs_.size());
+  EXPECT_EQ(0u, GetNode("a.h")->out_edges().size());
+
+  // The next scan loads the deps of what was reset again.
+  fs_.Tick();
+  fs_.Create("a.h", "");
+  EXPECT_TRUE(scan_.RecomputeDirty(GetNode("all"), &err));
+  ASSERT_EQ("", err);
+  EXPECT_EQ(3u, a->inputs_.size());
+  EXPECT_EQ(2u, b->inputs_.size());
+  EXPECT_TRUE(GetNode("a.o")->dirty());
+  EXPECT_FALSE(GetNode("b.o")->dirty());
+  EXPECT_TRUE(GetNode("all")->dirty());
+}
+
+TEST_F(GraphSnapshotTest, NoticesDyndep) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"build out: cat in || dd\n"
+"  dyndep = dd\n"));
+  GraphSnapshot snapshot;
+  snapshot.Capture(state_);
+  EXPECT_TRUE(snapshot.uses_dyndep());
+}
+
+#if !defined(_WIN32) && defined(NINJA_HAVE_THREADS)
+/// Runs a daemon that answers a single request while a client sends it.
+struct RoundTrip : public ParallelTask {
+  explicit RoundTrip(DaemonServer* server) : server_(server), status_(-1) {}
+
+  virtual void Run(size_t index) {
+    if (index == 0) {
+      DaemonRequest request;
+      if (server_->Accept(&request, &server_err_)) {
+        request_ = request;
+        server_->Reply(&request, 42);
+      }
+    } else {
+      vector<string> args;
+      args.push_back("all");
+      args.push_back("");
+      status_ = RunDaemonRequest(".ninja_daemon", args, &client_err_);
+    }
+  }
+
+  DaemonServer* server_;
+  DaemonRequest request_;
+  string server_err_;
+  string client_err_;
+  int status_;
+};
+
+TEST(DaemonTest, RoundTrip) {
+  ScopedTempDir temp_dir;
+  temp_dir.CreateAndEnter("NinjaDaemonTest");
+
+  DaemonServer server;
+  string err;
+  ASSERT_TRUE(server.Listen(".ninja_daemon", &err));
+  ASSERT_EQ("", err);
+
+  RoundTrip task(&server);
+  RunInParallel(&task, 2, 2);
+  server.Close();
+
+  EXPECT_EQ("", task.server_err_);
+  EXPECT_EQ("", task.client_err_);
+  EXPECT_EQ(42, task.status_);
+  EXPECT_FALSE(task.request_.cwd.empty());
+  ASSERT_EQ(2u, task.request_.args.size());
+  EXPECT_EQ("all", task.request_.args[0]);
+  EXPECT_EQ("", task.request_.args[1]);
+
+  temp_dir.Cleanup();
+}
+#endif
+
+}  // anonymous namespace
@@ -19,3 +19,7 @@ bool g_keep_depfile = false;
 bool g_keep_rsp = false;
 
 bool g_experimental_statcache = true;
+
+bool g_experimental_manifest_cache = false;
+
+bool g_huge_pages = false;
@@ -30,4 +30,8 @@ extern bool g_keep_rsp;
 
 extern bool g_experimental_statcache;
 
+extern bool g_experimental_manifest_cache;
+
+extern bool g_huge_pages;
+
 #endif // NINJA_EXPLAIN_H_
@@ -15,6 +15,80 @@
 #include "depfile_parser.h"
 #include "util.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NINJA_DEPFILE_SSE2 1
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace {
+
+#ifdef NINJA_DEPFILE_SSE2
+/// Mark the bytes of |v| between |lo| and |hi|, both below 0x80.
+inline __m128i InRange(__m128i v, char lo, char hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                       _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+inline __m128i Equal(__m128i v, char c) {
+  return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+}
+
+/// Mark the bytes of |v| that can't be part of a span of plain text, as
+/// matched by the state machine below.  Bytes from 0x80 up are plain;
+/// compared as signed, they are below everything else.
+inline __m128i NotPlain(__m128i v) {
+  __m128i m = InRange(v, 0, ' ');
+  m = _mm_or_si128(m, _mm_andnot_si128(Equal(v, '%'), InRange(v, '"', '\'')));
+  m = _mm_or_si128(m, Equal(v, '*'));
+  m = _mm_or_si128(m, _mm_andnot_si128(Equal(v, '='), InRange(v, ';', '?')));
+  m = _mm_or_si128(m, Equal(v, '\\'));
+  m = _mm_or_si128(m, Equal(v, '^'));
+  m = _mm_or_si128(m, Equal(v, '`'));
+  m = _mm_or_si128(m, Equal(v, '|'));
+  m = _mm_or_si128(m, Equal(v, 0x7f));
+  return m;
+}
+
+inline int CountTrailingZeros(unsigned mask) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (int)index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+#endif  // NINJA_DEPFILE_SSE2
+
+/// Return the length of the span of plain text at |in|, looking at whole
+/// blocks of 16 bytes before |end| only.  The state machine takes over for
+/// the rest.
+inline size_t PlainSpanLength(const char* in, const char* end) {
+#ifdef NINJA_DEPFILE_SSE2
+  // Don't bother for the separators between spans.
+  unsigned char c = *in;
+  if (c <= ' ' || c == '\\' || c == '$')
+    return 0;
+  const char* p = in;
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    unsigned mask = (unsigned)_mm_movemask_epi8(NotPlain(v));
+    if (mask)
+      return (p - in) + CountTrailingZeros(mask);
+    p += 16;
+  }
+  return p - in;
+#else
+  return 0;
+#endif
+}
+
+}  // anonymous namespace
+
 DepfileParser::DepfileParser(DepfileParserOptions options)
   : options_(options)
 {
@@ -61,6 +135,19 @@ bool DepfileParser::Parse(string* content, string* err) {
     for (;;) {
       // start: beginning of the current parsed span.
       const char* start = in;
+
+      // Most of a depfile is plain text.  Skip over it many bytes at a
+      // time, as the span of plain text below would.
+      size_t plain = PlainSpanLength(in, end);
+      if (plain > 0) {
+        // Need to shift it over if we're overwriting backslashes.
+        if (out < start)
+          memmove(out, start, plain);
+        in += plain;
+        out += plain;
+        continue;
+      }
+
       char* yymarker = NULL;
       /*!re2c
       re2c:define:YYCTYPE = "unsigned char";
@@ -309,3 +309,42 @@ TEST_F(DepfileParserTest, MultipleRulesRejectDifferentOutputs) {
   ASSERT_EQ("depfile has multiple output paths (on separate lines)"
             " [-w depfilemulti=err]", err);
 }
+
+TEST_F(DepfileParserTest, LongSpans) {
+  // Long spans of plain text may be scanned many bytes at a time.  Whatever
+  // the byte that ends one, and wherever it falls, the result should be the
+  // same as for a short span.
+  for (int c = 0; c < 256; ++c) {
+    if (c == 'x' || c == 'y')
+      continue;
+    string short_input = string("out: x") + (char)c + "y\n";
+    DepfileParser short_parser;
+    string short_err;
+    bool short_ok = short_parser.Parse(&short_input, &short_err);
+
+    for (size_t len = 14; len < 50; ++len) {
+      string x(len, 'x');
+      string y(len, 'y');
+      string input = "out: " + x + (char)c + y + "\n";
+      DepfileParser parser;
+      string err;
+      ASSERT_EQ(short_ok, parser.Parse(&input, &err));
+      ASSERT_EQ(short_err, err);
+      ASSERT_EQ(short_parser.out_.AsString(), parser.out_.AsString());
+      ASSERT_EQ(short_parser.ins_.size(), parser.ins_.size());
+      for (size_t i = 0; i < parser.ins_.size(); ++i) {
+        string expected;
+        string in = short_parser.ins_[i].AsString();
+        for (size_t j = 0; j < in.size(); ++j) {
+          if (in[j] == 'x')
+            expected += x;
+          else if (in[j] == 'y')
+            expected += y;
+          else
+            expected += in[j];
+        }
+        ASSERT_EQ(expected, parser.ins_[i].AsString());
+      }
+    }
+  }
+}
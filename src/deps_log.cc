@@ -18,6 +18,9 @@
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <algorithm>
+#include <sys/stat.h>
+#include <sys/types.h>
 #ifndef _WIN32
 #include <unistd.h>
 #elif defined(_MSC_VER) && (_MSC_VER < 1900)
@@ -28,55 +31,272 @@ typedef unsigned __int32 uint32_t;
 #include "graph.h"
 #include "metrics.h"
 #include "state.h"
+#include "trace.h"
 #include "util.h"
 
 // The version is stored as 4 bytes after the signature and also serves as a
 // byte order mark. Signature and version combined are 16 bytes long.
 const char kFileSignature[] = "# ninjadeps\n";
-const int kCurrentVersion = 4;
+const int kCurrentVersion = 5;
+/// The oldest version that is still read.
+const int kOldestReadVersion = 4;
 
 // Record size is currently limited to less than the full 32 bit, due to
 // internal buffers having to have this size.
 const unsigned kMaxRecordSize = (1 << 19) - 1;
 
+namespace {
+
+/// Write |chunk| to |f| and clear it, once it has at least |min_size| bytes.
+bool WriteChunk(FILE* f, string* chunk, size_t min_size) {
+  if (chunk->empty() || chunk->size() < min_size)
+    return true;
+  bool success = fwrite(chunk->data(), 1, chunk->size(), f) == chunk->size();
+  chunk->clear();
+  return success;
+}
+
+/// Append |value| to |out| as an LEB128 varint.
+void AppendVarint(string* out, uint32_t value) {
+  while (value >= 0x80) {
+    out->push_back((char)(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back((char)value);
+}
+
+/// Read a varint written by AppendVarint() at |*p|, which must be before
+/// |end|, and move |*p| past it.  Returns false if it runs past |end| or
+/// doesn't fit in 32 bits.
+bool ReadVarint(const unsigned char** p, const unsigned char* end,
+                uint32_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 35 && *p < end; shift += 7) {
+    unsigned char byte = *(*p)++;
+    *value |= (uint32_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+}  // anonymous namespace
+
+/// What IndexRecords() found in the log, before the State is looked at.
+struct DepsLog::Index {
+  Index()
+      : status(FileReader::NotFound), size(-1), mtime(-1), version(0),
+        end(0), read_failed(false), unique_deps(0), total_deps(0) {}
+
+  string path;
+  FileReader::Status status;
+  string err;
+  /// The size and mtime of the file indexed, to tell whether it changed
+  /// since, or -1.
+  int64_t size;
+  int64_t mtime;
+  /// 0 if the log has no valid header.
+  int version;
+  /// The offset of the end of the last record read.
+  size_t end;
+  bool read_failed;
+  int unique_deps;
+  int total_deps;
+};
+
+DepsLog::DepsLog()
+    : needs_recompaction_(false), side_(false), version_(kCurrentVersion),
+      state_(NULL),
+      unresolved_ids_built_(false), recompaction_(NULL), prefetched_(NULL) {}
+
 DepsLog::~DepsLog() {
   Close();
+  delete prefetched_;
+  for (ExternalStringHashMap<Node**>::Type::iterator i = node_lists_.begin();
+       i != node_lists_.end(); ++i)
+    delete [] i->second;
+}
+
+/// A rewrite of the log running on a thread of its own.  It renumbers
+/// the paths it keeps; the nodes only take the new ids once it's done.
+struct DepsLog::Recompaction : public BackgroundTask {
+  explicit Recompaction(const string& path)
+      : path(path), temp_path(path + ".recompact"), success(false) {}
+
+  /// Give |node| an id in the rewritten log, given the ids it has so far
+  /// by old id in |new_ids|.
+  int AssignId(Node* node, vector<int>* new_ids) {
+    int& id = (*new_ids)[node->id()];
+    if (id < 0) {
+      id = (int)nodes.size();
+      nodes.push_back(node);
+      paths.push_back(node->path());
+    }
+    return id;
+  }
+
+  virtual void Run();
+
+  string path;
+  string temp_path;
+
+  /// Maps new id -> node; only for the thread that started the rewrite.
+  vector<Node*> nodes;
+  /// Maps new id -> path.
+  vector<string> paths;
+  /// A dependency record to write, with its inputs in inputs[begin, end).
+  struct Record {
+    int old_id;
+    int new_id;
+    TimeStamp mtime;
+    size_t begin;
+    size_t end;
+  };
+  vector<Record> records;
+  vector<int> inputs;
+
+  bool success;
+  string err;
+};
+
+void DepsLog::Recompaction::Run() {
+  FILE* f = fopen(temp_path.c_str(), "wb");
+  if (!f) {
+    err = strerror(errno);
+    return;
+  }
+  // The new log only replaces the old one once it's complete, so it can be
+  // written in big chunks.
+  const size_t kChunkSize = 1 << 20;
+  string chunk;
+  AppendHeader(&chunk);
+  success = true;
+  for (size_t i = 0; success && i < paths.size(); ++i) {
+    success = AppendPathRecord(&chunk, paths[i], (int)i) &&
+        WriteChunk(f, &chunk, kChunkSize);
+  }
+  for (size_t i = 0; success && i < records.size(); ++i) {
+    const Record& record = records[i];
+    success = AppendDepsRecord(&chunk, record.new_id, record.mtime,
+                               (int)(record.end - record.begin),
+                               inputs.empty() ? NULL : &inputs[record.begin]) &&
+        WriteChunk(f, &chunk, kChunkSize);
+  }
+  if (success)
+    success = WriteChunk(f, &chunk, 0);
+  if (fclose(f) != 0)
+    success = false;
+  if (!success)
+    err = strerror(errno);
 }
 
 bool DepsLog::OpenForWrite(const string& path, string* err) {
-  if (needs_recompaction_) {
-    if (!Recompact(path, err))
+  if (version_ != kCurrentVersion) {
+    // Records can't be appended to a log of another version, so rewrite it
+    // first, and wait for that.
+    needs_recompaction_ = false;
+    StartRecompaction(path);
+    if (!FinishRecompaction(true, err))
       return false;
   }
-
-  file_ = fopen(path.c_str(), "ab");
-  if (!file_) {
-    *err = strerror(errno);
-    return false;
+  if (needs_recompaction_) {
+    // The rewrite runs while we build; the deps recorded in the meantime
+    // are added to it once it's done.
+    needs_recompaction_ = false;
+    StartRecompaction(path);
   }
-  // Set the buffer size to this and flush the file buffer after every record
-  // to make sure records aren't written partially.
-  setvbuf(file_, NULL, _IOFBF, kMaxRecordSize + 1);
-  SetCloseOnExec(fileno(file_));
 
-  // Opening a file in append mode doesn't set the file pointer to the file's
-  // end on Windows. Do that explicitly.
-  fseek(file_, 0, SEEK_END);
+  if (!OpenLogFile(path, err))
+    return false;
 
-  if (ftell(file_) == 0) {
-    if (fwrite(kFileSignature, sizeof(kFileSignature) - 1, 1, file_) < 1) {
-      *err = strerror(errno);
+  // Without threads the recompaction is done already.
+  string recompact_err;
+  if (!FinishRecompaction(false, &recompact_err)) {
+    if (!file_.is_open()) {
+      *err = recompact_err;
       return false;
     }
-    if (fwrite(&kCurrentVersion, 4, 1, file_) < 1) {
+    Warning("recompacting deps log: %s", recompact_err.c_str());
+  }
+  return true;
+}
+
+bool DepsLog::OpenSideLog(const string& path, string* err) {
+  side_ = true;
+  return OpenLogFile(path, err);
+}
+
+bool DepsLog::OpenLogFile(const string& path, string* err) {
+  if (!file_.Open(path, err))
+    return false;
+
+  if (file_.empty()) {
+    string header;
+    AppendHeader(&header);
+    if (!file_.Append(header) || !file_.Flush()) {
       *err = strerror(errno);
       return false;
     }
   }
-  if (fflush(file_) != 0) {
-    *err = strerror(errno);
+  return true;
+}
+
+bool DepsLog::Flush() {
+  return file_.Flush();
+}
+
+// static
+void DepsLog::AppendHeader(string* out) {
+  out->append(kFileSignature, sizeof(kFileSignature) - 1);
+  out->append((const char*)&kCurrentVersion, 4);
+}
+
+// static
+bool DepsLog::AppendPathRecord(string* out, const string& path, int id) {
+  int path_size = path.size();
+  int padding = (4 - path_size % 4) % 4;  // Pad path to 4 byte boundary.
+
+  unsigned size = path_size + padding + 4;
+  if (size > kMaxRecordSize) {
+    errno = ERANGE;
     return false;
   }
+  assert(path_size > 0);
+  out->append((const char*)&size, 4);
+  out->append(path);
+  out->append(padding, '\0');
+  unsigned checksum = ~(unsigned)id;
+  out->append((const char*)&checksum, 4);
+  return true;
+}
+
+// static
+bool DepsLog::AppendDepsRecord(string* out, int out_id, TimeStamp mtime,
+                               int node_count, const int* ids) {
+  size_t start = out->size();
+  out->append(4, '\0');  // The size, once it's known.
+  out->append((const char*)&out_id, 4);
+  uint32_t mtime_part = static_cast<uint32_t>(mtime & 0xffffffff);
+  out->append((const char*)&mtime_part, 4);
+  mtime_part = static_cast<uint32_t>((mtime >> 32) & 0xffffffff);
+  out->append((const char*)&mtime_part, 4);
+  out->append((const char*)&node_count, 4);
+  int last = out_id;
+  for (int i = 0; i < node_count; ++i) {
+    int32_t delta = (int32_t)((uint32_t)ids[i] - (uint32_t)last);
+    AppendVarint(out, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+    last = ids[i];
+  }
+  out->append((4 - (out->size() - start) % 4) % 4, '\0');
+
+  unsigned size = out->size() - start - 4;
+  if (size > kMaxRecordSize) {
+    out->resize(start);
+    errno = ERANGE;
+    return false;
+  }
+  size |= 0x80000000;  // Deps record: set high bit.
+  memcpy(&(*out)[start], &size, 4);
   return true;
 }
 
@@ -88,9 +308,18 @@ bool DepsLog::RecordDeps(Node* node, TimeStamp mtime,
 
 bool DepsLog::RecordDeps(Node* node, TimeStamp mtime,
                          int node_count, Node** nodes) {
+  string err;
+  if (!FinishRecompaction(false, &err))
+    Warning("recompacting deps log: %s", err.c_str());
+
   // Track whether there's any new data to be recorded.
   bool made_change = false;
 
+  // Nodes created since the log was loaded may have ids in it already.
+  ResolveId(node);
+  for (int i = 0; i < node_count; ++i)
+    ResolveId(nodes[i]);
+
   // Assign ids to all nodes that are missing one.
   if (node->id() < 0) {
     if (!RecordId(node))
@@ -127,163 +356,222 @@ bool DepsLog::RecordDeps(Node* node, TimeStamp mtime,
     return true;
 
   // Update on-disk representation.
-  unsigned size = 4 * (1 + 2 + node_count);
-  if (size > kMaxRecordSize) {
-    errno = ERANGE;
-    return false;
-  }
-  size |= 0x80000000;  // Deps record: set high bit.
-  if (fwrite(&size, 4, 1, file_) < 1)
-    return false;
-  int id = node->id();
-  if (fwrite(&id, 4, 1, file_) < 1)
-    return false;
-  uint32_t mtime_part = static_cast<uint32_t>(mtime & 0xffffffff);
-  if (fwrite(&mtime_part, 4, 1, file_) < 1)
-    return false;
-  mtime_part = static_cast<uint32_t>((mtime >> 32) & 0xffffffff);
-  if (fwrite(&mtime_part, 4, 1, file_) < 1)
-    return false;
-  for (int i = 0; i < node_count; ++i) {
-    id = nodes[i]->id();
-    if (fwrite(&id, 4, 1, file_) < 1)
+  vector<int> ids(node_count);
+  for (int i = 0; i < node_count; ++i)
+    ids[i] = nodes[i]->id();
+  string record;
+  if (side_) {
+    if (!AppendSideRecords(&record, node, mtime, node_count, nodes) ||
+        !file_.Append(record))
       return false;
-  }
-  if (fflush(file_) != 0)
+  } else if (!AppendDepsRecord(&record, node->id(), mtime, node_count,
+                               ids.empty() ? NULL : &ids[0]) ||
+             !file_.Append(record)) {
     return false;
+  }
 
   // Update in-memory representation.
-  Deps* deps = new Deps(mtime, node_count);
-  for (int i = 0; i < node_count; ++i)
-    deps->nodes[i] = nodes[i];
+  Deps* deps = new Deps(mtime, node_count, InternNodes(node_count, nodes));
   UpdateDeps(node->id(), deps);
+  if (recompaction_)
+    recorded_since_.push_back(node);
 
   return true;
 }
 
 void DepsLog::Close() {
-  if (file_)
-    fclose(file_);
-  file_ = NULL;
+  string err;
+  if (!FinishRecompaction(true, &err))
+    Warning("recompacting deps log: %s", err.c_str());
+  file_.Close();
 }
 
-bool DepsLog::Load(const string& path, State* state, string* err) {
-  METRIC_RECORD(".ninja_deps load");
-  char buf[kMaxRecordSize + 1];
-  FILE* f = fopen(path.c_str(), "rb");
-  if (!f) {
-    if (errno == ENOENT)
-      return true;
-    *err = strerror(errno);
-    return false;
+namespace {
+
+void StatLog(const string& path, int64_t* size, int64_t* mtime) {
+  struct stat st;
+  if (stat(path.c_str(), &st) < 0) {
+    *size = *mtime = -1;
+    return;
   }
+  *size = st.st_size;
+  *mtime = st.st_mtime;
+}
+
+}  // anonymous namespace
+
+void DepsLog::IndexRecords(const string& path, Index* index) {
+  map_.Close();
+  nodes_.clear();
+  paths_.clear();
+  deps_.clear();
+  deps_records_.clear();
+
+  index->path = path;
+  StatLog(path, &index->size, &index->mtime);
+  index->status = map_.Open(path, &index->err);
+  if (index->status != FileReader::Okay)
+    return;
+  const char* data = map_.data();
+  size_t file_size = map_.size();
 
-  bool valid_header = true;
+  const size_t kHeaderSize = sizeof(kFileSignature) - 1 + 4;
   int version = 0;
-  if (!fgets(buf, sizeof(buf), f) || fread(&version, 4, 1, f) < 1)
-    valid_header = false;
-  // Note: For version differences, this should migrate to the new format.
-  // But the v1 format could sometimes (rarely) end up with invalid data, so
-  // don't migrate v1 to v3 to force a rebuild. (v2 only existed for a few days,
-  // and there was no release with it, so pretend that it never happened.)
-  if (!valid_header || strcmp(buf, kFileSignature) != 0 ||
-      version != kCurrentVersion) {
-    if (version == 1)
-      *err = "deps log version change; rebuilding";
-    else
-      *err = "bad deps log signature or version; starting over";
-    fclose(f);
-    unlink(path.c_str());
-    // Don't report this as a failure.  An empty deps log will cause
-    // us to rebuild the outputs anyway.
-    return true;
+  if (file_size >= kHeaderSize)
+    memcpy(&version, data + kHeaderSize - 4, 4);
+  if (file_size < kHeaderSize ||
+      memcmp(data, kFileSignature, sizeof(kFileSignature) - 1) != 0 ||
+      version < kOldestReadVersion || version > kCurrentVersion) {
+    index->version = version == 1 ? 1 : 0;
+    return;
   }
+  index->version = version;
 
-  long offset;
-  bool read_failed = false;
-  int unique_dep_record_count = 0;
-  int total_dep_record_count = 0;
+  // Records are multiples of 4 bytes long and the header is 16, so every
+  // record is aligned in the mapping.
+  size_t offset = kHeaderSize;
   for (;;) {
-    offset = ftell(f);
-
-    unsigned size;
-    if (fread(&size, 4, 1, f) < 1) {
-      if (!feof(f))
-        read_failed = true;
-      break;
-    }
+    if (file_size - offset < 4)
+      break;  // Like a short read of the size: a partial final record.
+    const unsigned* record = reinterpret_cast<const unsigned*>(data + offset);
+    unsigned size = record[0];
     bool is_deps = (size >> 31) != 0;
     size = size & 0x7FFFFFFF;
 
-    if (size > kMaxRecordSize || fread(buf, size, 1, f) < 1) {
-      read_failed = true;
+    if (size > kMaxRecordSize || size > file_size - offset - 4 ||
+        size % 4 != 0) {
+      index->read_failed = true;
       break;
     }
+    const char* buf = data + offset + 4;
 
     if (is_deps) {
-      assert(size % 4 == 0);
-      int* deps_data = reinterpret_cast<int*>(buf);
-      int out_id = deps_data[0];
-      TimeStamp mtime;
-      mtime = (TimeStamp)(((uint64_t)(unsigned int)deps_data[2] << 32) |
-                          (uint64_t)(unsigned int)deps_data[1]);
-      deps_data += 3;
-      int deps_count = (size / 4) - 3;
-
-      Deps* deps = new Deps(mtime, deps_count);
-      for (int i = 0; i < deps_count; ++i) {
-        assert(deps_data[i] < (int)nodes_.size());
-        assert(nodes_[deps_data[i]]);
-        deps->nodes[i] = nodes_[deps_data[i]];
+      if (size < (version < 5 ? 12u : 16u)) {
+        index->read_failed = true;
+        break;
       }
-
-      total_dep_record_count++;
-      if (!UpdateDeps(out_id, deps))
-        ++unique_dep_record_count;
+      int out_id = record[1];
+      if (out_id < 0) {
+        index->read_failed = true;
+        break;
+      }
+      if (out_id >= (int)deps_.size()) {
+        deps_.resize(out_id + 1);
+        deps_records_.resize(out_id + 1);
+      }
+      index->total_deps++;
+      if (!deps_records_[out_id])
+        ++index->unique_deps;
+      deps_records_[out_id] = record;
     } else {
       int path_size = size - 4;
-      assert(path_size > 0);  // CanonicalizePath() rejects empty paths.
+      if (path_size <= 0) {  // CanonicalizePath() rejects empty paths.
+        index->read_failed = true;
+        break;
+      }
       // There can be up to 3 bytes of padding.
       if (buf[path_size - 1] == '\0') --path_size;
       if (buf[path_size - 1] == '\0') --path_size;
       if (buf[path_size - 1] == '\0') --path_size;
-      StringPiece subpath(buf, path_size);
-      // It is not necessary to pass in a correct slash_bits here. It will
-      // either be a Node that's in the manifest (in which case it will already
-      // have a correct slash_bits that GetNode will look up), or it is an
-      // implicit dependency from a .d which does not affect the build command
-      // (and so need not have its slashes maintained).
-      Node* node = state->GetNode(subpath, &state->bindings_, 0);
 
       // Check that the expected index matches the actual index. This can only
       // happen if two ninja processes write to the same deps log concurrently.
       // (This uses unary complement to make the checksum look less like a
       // dependency record entry.)
-      unsigned checksum = *reinterpret_cast<unsigned*>(buf + size - 4);
+      unsigned checksum = record[size / 4];
       int expected_id = ~checksum;
-      int id = nodes_.size();
-      if (id != expected_id) {
-        read_failed = true;
+      if ((int)paths_.size() != expected_id) {
+        index->read_failed = true;
         break;
       }
+      paths_.push_back(StringPiece(buf, path_size));
+    }
+    offset += 4 + size;
+  }
+  index->end = offset;
+}
+
+void DepsLog::Prefetch(const string& path) {
+  TRACE_PHASE(".ninja_deps prefetch");
+  delete prefetched_;
+  prefetched_ = new Index;
+  IndexRecords(path, prefetched_);
+}
+
+bool DepsLog::Load(const string& path, State* state, string* err) {
+  METRIC_RECORD(".ninja_deps load");
+  TRACE_PHASE(".ninja_deps load");
+  state_ = state;
+
+  // What Prefetch() indexed holds if it was this log and nobody wrote to it
+  // since.
+  Index index;
+  bool prefetched = false;
+  if (prefetched_ && prefetched_->path == path) {
+    int64_t size, mtime;
+    StatLog(path, &size, &mtime);
+    prefetched = size == prefetched_->size && mtime == prefetched_->mtime;
+  }
+  if (prefetched)
+    index = *prefetched_;
+  else
+    IndexRecords(path, &index);
+  delete prefetched_;
+  prefetched_ = NULL;
+
+  switch (index.status) {
+  case FileReader::Okay:
+    break;
+  case FileReader::NotFound:
+    err->clear();
+    return true;
+  default:
+    *err = index.err;
+    return false;
+  }
+
+  // Note: For version differences, this should migrate to the new format.
+  // But the v1 format could sometimes (rarely) end up with invalid data, so
+  // don't migrate v1 to v3 to force a rebuild. (v2 only existed for a few days,
+  // and there was no release with it, so pretend that it never happened.)
+  if (index.version < kOldestReadVersion) {
+    if (index.version == 1)
+      *err = "deps log version change; rebuilding";
+    else
+      *err = "bad deps log signature or version; starting over";
+    map_.Close();
+    if (!side_)
+      unlink(path.c_str());
+    version_ = kCurrentVersion;
+    // Don't report this as a failure.  An empty deps log will cause
+    // us to rebuild the outputs anyway.
+    return true;
+  }
+
+  version_ = index.version;
 
+  // Nodes from the manifest get their ids now, so that GetDeps() finds
+  // them.  Others, such as headers only named by depfiles, are created
+  // when a dependency record naming them is decoded.
+  nodes_.resize(paths_.size());
+  for (size_t id = 0; id < paths_.size(); ++id) {
+    Node* node = state->LookupNode(paths_[id]);
+    if (node) {
       assert(node->id() < 0);
-      node->set_id(id);
-      nodes_.push_back(node);
+      node->set_id((int)id);
     }
+    nodes_[id] = node;
   }
 
-  if (read_failed) {
-    // An error occurred while loading; try to recover by truncating the
-    // file to the last fully-read record.
-    if (ferror(f)) {
-      *err = strerror(ferror(f));
-    } else {
-      *err = "premature end of file";
-    }
-    fclose(f);
+  if (index.read_failed) {
+    // Another process is appending to the log.
+    if (side_)
+      return true;
 
-    if (!Truncate(path, offset, err))
+    // An error occurred while loading; try to recover by truncating the
+    // file to the last fully-read record.  Nothing is kept past it.
+    *err = "premature end of file";
+    if (!Truncate(path, index.end, err))
       return false;
 
     // The truncate succeeded; we'll just report the load error as a
@@ -292,13 +580,11 @@ bool DepsLog::Load(const string& path, State* state, string* err) {
     return true;
   }
 
-  fclose(f);
-
   // Rebuild the log if there are too many dead records.
   int kMinCompactionEntryCount = 1000;
   int kCompactionRatio = 3;
-  if (total_dep_record_count > kMinCompactionEntryCount &&
-      total_dep_record_count > unique_dep_record_count * kCompactionRatio) {
+  if (index.total_deps > kMinCompactionEntryCount &&
+      index.total_deps > index.unique_deps * kCompactionRatio) {
     needs_recompaction_ = true;
   }
 
@@ -306,33 +592,148 @@ bool DepsLog::Load(const string& path, State* state, string* err) {
 }
 
 DepsLog::Deps* DepsLog::GetDeps(Node* node) {
+  METRIC_RECORD("deps log lookup");
   // Abort if the node has no id (never referenced in the deps) or if
-  // there's no deps recorded for the node.
-  if (node->id() < 0 || node->id() >= (int)deps_.size())
+  // there's no deps recorded for the node.  Nodes created after Load() may
+  // have a record that isn't theirs yet.
+  ResolveId(node);
+  int id = node->id();
+  if (id < 0 || id >= (int)deps_.size())
     return NULL;
-  return deps_[node->id()];
+  if (!deps_[id] && deps_records_[id]) {
+    deps_[id] = DecodeDeps(deps_records_[id]);
+    deps_records_[id] = NULL;
+  }
+  return deps_[id];
 }
 
-bool DepsLog::Recompact(const string& path, string* err) {
-  METRIC_RECORD(".ninja_deps recompact");
+Node* DepsLog::ResolveNode(int id) {
+  if (id < 0 || id >= (int)nodes_.size())
+    return NULL;
+  if (!nodes_[id]) {
+    // It is not necessary to pass in a correct slash_bits here. It will
+    // either be a Node that's in the manifest (in which case it will already
+    // have a correct slash_bits that GetNode will look up), or it is an
+    // implicit dependency from a .d which does not affect the build command
+    // (and so need not have its slashes maintained).
+    Node* node = state_->GetNode(paths_[id], &state_->bindings_, 0);
+    if (node->id() < 0)
+      node->set_id(id);
+    nodes_[id] = node;
+  }
+  return nodes_[id];
+}
 
-  Close();
-  string temp_path = path + ".recompact";
+DepsLog::Deps* DepsLog::DecodeDeps(const unsigned* record) {
+  int size = record[0] & 0x7FFFFFFF;
+  TimeStamp mtime = (TimeStamp)(((uint64_t)record[3] << 32) |
+                                (uint64_t)record[2]);
+  decoded_.clear();
+  if (version_ < 5) {
+    int deps_count = (size / 4) - 3;
+    const int* ids = reinterpret_cast<const int*>(record + 4);
+    for (int i = 0; i < deps_count; ++i) {
+      Node* node = ResolveNode(ids[i]);
+      if (!node)
+        return NULL;  // A corrupt record; treat the deps as missing.
+      decoded_.push_back(node);
+    }
+  } else {
+    // Every input takes at least a byte, which bounds the count of a
+    // corrupt record.
+    const unsigned char* p =
+        reinterpret_cast<const unsigned char*>(record + 5);
+    const unsigned char* end =
+        reinterpret_cast<const unsigned char*>(record + 1) + size;
+    int deps_count = (int)record[4];
+    if (deps_count < 0 || deps_count > end - p)
+      return NULL;
+    uint32_t id = record[1];
+    for (int i = 0; i < deps_count; ++i) {
+      uint32_t zigzag;
+      if (!ReadVarint(&p, end, &zigzag))
+        return NULL;
+      id += (zigzag >> 1) ^ (0 - (zigzag & 1));
+      Node* node = ResolveNode((int)id);
+      if (!node)
+        return NULL;
+      decoded_.push_back(node);
+    }
+  }
+  return new Deps(mtime, (int)decoded_.size(),
+                  InternNodes((int)decoded_.size(),
+                              decoded_.empty() ? NULL : &decoded_[0]));
+}
 
-  // OpenForWrite() opens for append.  Make sure it's not appending to a
-  // left-over file from a previous recompaction attempt that crashed somehow.
-  unlink(temp_path.c_str());
+Node** DepsLog::InternNodes(int node_count, Node* const* nodes) {
+  if (node_count == 0)
+    return NULL;
+  StringPiece key(reinterpret_cast<const char*>(nodes),
+                  node_count * sizeof(Node*));
+  ExternalStringHashMap<Node**>::Type::iterator i = node_lists_.find(key);
+  if (i != node_lists_.end())
+    return i->second;
+  Node** copy = new Node*[node_count];
+  std::copy(nodes, nodes + node_count, copy);
+  node_lists_.insert(make_pair(
+      StringPiece(reinterpret_cast<const char*>(copy), key.len_), copy));
+  return copy;
+}
 
-  DepsLog new_log;
-  if (!new_log.OpenForWrite(temp_path, err))
-    return false;
+void DepsLog::ResolveId(Node* node) {
+  if (node->id() >= 0 || paths_.empty())
+    return;
+  if (!unresolved_ids_built_) {
+    for (int id = 0; id < (int)nodes_.size(); ++id) {
+      if (!nodes_[id])
+        unresolved_ids_.insert(make_pair(paths_[id], id));
+    }
+    unresolved_ids_built_ = true;
+  }
+  ExternalStringHashMap<int>::Type::iterator i =
+      unresolved_ids_.find(node->path());
+  if (i == unresolved_ids_.end() || nodes_[i->second])
+    return;
+  node->set_id(i->second);
+  nodes_[i->second] = node;
+}
+
+void DepsLog::ResolveAll() {
+  for (int id = 0; id < (int)nodes_.size(); ++id)
+    ResolveNode(id);
+  for (int id = 0; id < (int)deps_.size(); ++id) {
+    if (!deps_[id] && deps_records_[id]) {
+      deps_[id] = DecodeDeps(deps_records_[id]);
+      deps_records_[id] = NULL;
+    }
+  }
+}
+
+const vector<Node*>& DepsLog::nodes() {
+  ResolveAll();
+  return nodes_;
+}
 
-  // Clear all known ids so that new ones can be reassigned.  The new indices
-  // will refer to the ordering in new_log, not in the current log.
-  for (vector<Node*>::iterator i = nodes_.begin(); i != nodes_.end(); ++i)
-    (*i)->set_id(-1);
+const vector<DepsLog::Deps*>& DepsLog::deps() {
+  ResolveAll();
+  return deps_;
+}
+
+bool DepsLog::Recompact(const string& path, string* err) {
+  Close();
+  StartRecompaction(path);
+  return FinishRecompaction(true, err);
+}
+
+void DepsLog::StartRecompaction(const string& path) {
+  METRIC_RECORD(".ninja_deps recompact");
 
-  // Write out all deps again.
+  // Take what the rewrite needs, so that the build can go on recording
+  // deps meanwhile.  The new ids follow the order in which RecordDeps()
+  // would assign them.
+  ResolveAll();
+  Recompaction* recompaction = new Recompaction(path);
+  vector<int> new_ids(nodes_.size(), -1);
   for (int old_id = 0; old_id < (int)deps_.size(); ++old_id) {
     Deps* deps = deps_[old_id];
     if (!deps) continue;  // If nodes_[old_id] is a leaf, it has no deps.
@@ -340,29 +741,94 @@ bool DepsLog::Recompact(const string& path, string* err) {
     if (!IsDepsEntryLiveFor(nodes_[old_id]))
       continue;
 
-    if (!new_log.RecordDeps(nodes_[old_id], deps->mtime,
-                            deps->node_count, deps->nodes)) {
-      new_log.Close();
-      return false;
+    Recompaction::Record record;
+    record.old_id = old_id;
+    record.new_id = recompaction->AssignId(nodes_[old_id], &new_ids);
+    record.mtime = deps->mtime;
+    record.begin = recompaction->inputs.size();
+    for (int i = 0; i < deps->node_count; ++i) {
+      recompaction->inputs.push_back(
+          recompaction->AssignId(deps->nodes[i], &new_ids));
     }
+    record.end = recompaction->inputs.size();
+    recompaction->records.push_back(record);
   }
 
-  new_log.Close();
-
-  // All nodes now have ids that refer to new_log, so steal its data.
-  deps_.swap(new_log.deps_);
-  nodes_.swap(new_log.nodes_);
+  recompaction_ = recompaction;
+  recompaction_thread_.Start(recompaction);
+}
 
-  if (unlink(path.c_str()) < 0) {
-    *err = strerror(errno);
+bool DepsLog::FinishRecompaction(bool wait, string* err) {
+  if (!recompaction_ || (!wait && !recompaction_thread_.Done()))
+    return true;
+  recompaction_thread_.Join();
+  Recompaction* recompaction = recompaction_;
+  recompaction_ = NULL;
+  vector<Node*> recorded;
+  recorded.swap(recorded_since_);
+  string path = recompaction->path;
+
+  // Windows can't replace the log while it's open.
+  bool was_open = file_.is_open();
+  file_.Close();
+  if (!recompaction->success || unlink(path.c_str()) < 0 ||
+      rename(recompaction->temp_path.c_str(), path.c_str()) < 0) {
+    *err = recompaction->success ? strerror(errno) : recompaction->err;
+    unlink(recompaction->temp_path.c_str());
+    delete recompaction;
+    string open_err;
+    if (was_open && !OpenLogFile(path, &open_err))
+      *err = open_err;
     return false;
   }
 
-  if (rename(temp_path.c_str(), path.c_str()) < 0) {
-    *err = strerror(errno);
-    return false;
+  // The deps recorded since the rewrite started are newer than what it
+  // wrote, so they are recorded in it anew below.
+  vector<Deps*> old_deps;
+  old_deps.swap(deps_);
+  sort(recorded.begin(), recorded.end());
+  recorded.erase(unique(recorded.begin(), recorded.end()), recorded.end());
+  vector<pair<Node*, Deps*> > newer;
+  for (vector<Node*>::iterator i = recorded.begin(); i != recorded.end();
+       ++i) {
+    newer.push_back(make_pair(*i, old_deps[(*i)->id()]));
+    old_deps[(*i)->id()] = NULL;
   }
 
+  // Switch to the ids of the new log.
+  for (vector<Node*>::iterator i = nodes_.begin(); i != nodes_.end(); ++i) {
+    if (*i)
+      (*i)->set_id(-1);
+  }
+  nodes_.swap(recompaction->nodes);
+  for (int id = 0; id < (int)nodes_.size(); ++id)
+    nodes_[id]->set_id(id);
+  deps_.assign(nodes_.size(), NULL);
+  for (vector<Recompaction::Record>::iterator i =
+           recompaction->records.begin();
+       i != recompaction->records.end(); ++i)
+    deps_[i->new_id] = old_deps[i->old_id];
+  deps_records_.assign(nodes_.size(), NULL);
+  paths_.assign(nodes_.size(), StringPiece());
+  unresolved_ids_.clear();
+  unresolved_ids_built_ = false;
+  map_.Close();
+  version_ = kCurrentVersion;
+  delete recompaction;
+
+  if (!was_open)
+    return true;
+  if (!OpenLogFile(path, err))
+    return false;
+  for (vector<pair<Node*, Deps*> >::iterator i = newer.begin();
+       i != newer.end(); ++i) {
+    Deps* deps = i->second;
+    if (deps && !RecordDeps(i->first, deps->mtime, deps->node_count,
+                            deps->nodes)) {
+      *err = strerror(errno);
+      return false;
+    }
+  }
   return true;
 }
 
@@ -377,42 +843,54 @@ bool DepsLog::IsDepsEntryLiveFor(Node* node) {
 }
 
 bool DepsLog::UpdateDeps(int out_id, Deps* deps) {
-  if (out_id >= (int)deps_.size())
+  if (out_id >= (int)deps_.size()) {
     deps_.resize(out_id + 1);
+    deps_records_.resize(out_id + 1);
+  }
 
-  bool delete_old = deps_[out_id] != NULL;
-  if (delete_old)
-    delete deps_[out_id];
+  bool delete_old = deps_[out_id] != NULL || deps_records_[out_id] != NULL;
+  delete deps_[out_id];
   deps_[out_id] = deps;
+  deps_records_[out_id] = NULL;
   return delete_old;
 }
 
 bool DepsLog::RecordId(Node* node) {
-  int path_size = node->path().size();
-  int padding = (4 - path_size % 4) % 4;  // Pad path to 4 byte boundary.
-
-  unsigned size = path_size + padding + 4;
-  if (size > kMaxRecordSize) {
-    errno = ERANGE;
-    return false;
-  }
-  if (fwrite(&size, 4, 1, file_) < 1)
-    return false;
-  if (fwrite(node->path().data(), path_size, 1, file_) < 1) {
-    assert(node->path().size() > 0);
-    return false;
-  }
-  if (padding && fwrite("\0\0", padding, 1, file_) < 1)
-    return false;
   int id = nodes_.size();
-  unsigned checksum = ~(unsigned)id;
-  if (fwrite(&checksum, 4, 1, file_) < 1)
-    return false;
-  if (fflush(file_) != 0)
+  string record;
+  // A side log has ids of its own.
+  if (!side_ &&
+      (!AppendPathRecord(&record, node->path(), id) || !file_.Append(record)))
     return false;
 
   node->set_id(id);
   nodes_.push_back(node);
+  paths_.push_back(StringPiece());
 
   return true;
 }
+
+bool DepsLog::AppendSideRecords(string* record, Node* node, TimeStamp mtime,
+                                int node_count, Node** nodes) {
+  vector<int> ids(node_count + 1);
+  vector<Node*> added;
+  bool success = true;
+  for (int i = 0; i <= node_count && success; ++i) {
+    Node* n = i < node_count ? nodes[i] : node;
+    map<Node*, int>::iterator id = side_ids_.find(n);
+    if (id == side_ids_.end()) {
+      id = side_ids_.insert(make_pair(n, (int)side_ids_.size())).first;
+      added.push_back(n);
+      success = AppendPathRecord(record, n->path(), id->second);
+    }
+    ids[i] = id->second;
+  }
+  success = success && AppendDepsRecord(record, ids[node_count], mtime,
+                                        node_count, node_count ? &ids[0] : NULL);
+  // Nothing is written then, so the nodes have no ids there after all.
+  if (!success) {
+    for (vector<Node*>::iterator n = added.begin(); n != added.end(); ++n)
+      side_ids_.erase(*n);
+  }
+  return success;
+}
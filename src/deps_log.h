@@ -15,12 +15,18 @@
 #ifndef NINJA_DEPS_LOG_H_
 #define NINJA_DEPS_LOG_H_
 
+#include <map>
 #include <string>
 #include <vector>
 using namespace std;
 
 #include <stdio.h>
 
+#include "hash_map.h"
+#include "log_writer.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "string_piece.h"
 #include "timestamp.h"
 
 struct Node;
@@ -56,30 +62,53 @@ struct State;
 ///      padding bytes to align on 4 byte boundaries, followed by the
 ///      one's complement of the expected index of the record (to detect
 ///      concurrent writes of multiple ninja processes to the log).
-///    dependency records are an array of 4-byte integers
+///    dependency records are four 4-byte integers
 ///      [output path id,
 ///       output path mtime (lower 4 bytes), output path mtime (upper 4 bytes),
-///       input path id, input path id...]
+///       input count]
+///      followed by the input path ids, each as the difference from the id
+///      before it (the output's for the first), zigzag-encoded so that small
+///      negative differences are small too, in LEB128 varints, and then up
+///      to 3 padding bytes.  Paths get their ids in the order they are first
+///      seen, so the inputs of an output mostly have ids close together and
+///      take a byte or two each rather than four.
 ///      (The mtime is compared against the on-disk output path mtime
 ///      to verify the stored data is up-to-date.)
+///    Version 4 logs, whose dependency records have no count and plain
+///    4-byte input ids, are read too, and rewritten before anything is added
+///    to them.
 /// If two records reference the same output the latter one in the file
 /// wins, allowing updates to just be appended to the file.  A separate
 /// repacking step can run occasionally to remove dead records.
+///
+/// Loading maps the file and only indexes its records.  Nodes that don't
+/// exist yet in the State are created, and dependency records decoded,
+/// when GetDeps() first asks for them.  Asking about a node created since
+/// loading indexes the paths of the nodes not created yet.
 struct DepsLog {
-  DepsLog() : needs_recompaction_(false), file_(NULL) {}
+  DepsLog();
   ~DepsLog();
 
-  // Writing (build-time) interface.
+  // Writing (build-time) interface.  Records are written out in batches,
+  // see LogWriter; Flush() writes out the ones held back.
   bool OpenForWrite(const string& path, string* err);
   bool RecordDeps(Node* node, TimeStamp mtime, const vector<Node*>& nodes);
   bool RecordDeps(Node* node, TimeStamp mtime, int node_count, Node** nodes);
+  bool Flush();
   void Close();
 
+  /// Record deps to a log of their own at |path|, with ids of its own,
+  /// rather than to the log loaded, which another process owns (see
+  /// BuildDirLock).  Comes before Load(), which then leaves the log as it
+  /// is: what looks cut short at its end may be a record being written.
+  bool OpenSideLog(const string& path, string* err);
+
   // Reading (startup-time) interface.
+  /// The deps of an output.  Outputs with the same deps share |nodes|,
+  /// which the log owns.
   struct Deps {
-    Deps(int64_t mtime, int node_count)
-        : mtime(mtime), node_count(node_count), nodes(new Node*[node_count]) {}
-    ~Deps() { delete [] nodes; }
+    Deps(int64_t mtime, int node_count, Node** nodes)
+        : mtime(mtime), node_count(node_count), nodes(nodes) {}
     TimeStamp mtime;
     int node_count;
     Node** nodes;
@@ -87,9 +116,27 @@ struct DepsLog {
   bool Load(const string& path, State* state, string* err);
   Deps* GetDeps(Node* node);
 
-  /// Rewrite the known log entries, throwing away old data.
+  /// Map the log at |path| and index its records, which takes no State, so
+  /// that it can be done on another thread while the manifest is parsed;
+  /// the log mustn't be used otherwise until it's done.  Load() of the same
+  /// path then only finds the nodes of its paths, unless the log changed
+  /// since.  Reports no errors: Load() does.
+  void Prefetch(const string& path);
+
+  /// Rewrite the known log entries, throwing away old data, and wait for
+  /// it.  OpenForWrite() instead rewrites the log in the background when
+  /// it needs it, and puts the new log in place once that's done.
   bool Recompact(const string& path, string* err);
 
+  /// Start rewriting the log at |path| from the live records, on a thread
+  /// of its own.
+  void StartRecompaction(const string& path);
+
+  /// Put the rewritten log in place and switch to its ids, once the
+  /// rewrite is done, then record anew the deps recorded since it started.
+  /// Waits for it if |wait|.  On failure the old log is kept, if it can be.
+  bool FinishRecompaction(bool wait, string* err);
+
   /// Returns if the deps entry for a node is still reachable from the manifest.
   ///
   /// The deps log can contain deps entries for files that were built in the
@@ -98,24 +145,92 @@ struct DepsLog {
   /// it from code that runs on every build.
   bool IsDepsEntryLiveFor(Node* node);
 
-  /// Used for tests.
-  const vector<Node*>& nodes() const { return nodes_; }
-  const vector<Deps*>& deps() const { return deps_; }
+  /// All nodes and deps in the log, by id.  These decode every record not
+  /// yet used, so they are slow on a big log.
+  const vector<Node*>& nodes();
+  const vector<Deps*>& deps();
 
  private:
+  struct Recompaction;
+
+  bool OpenLogFile(const string& path, string* err);
+
+  struct Index;
+  /// Map |path| and index its records into paths_ and deps_records_,
+  /// noting in |index| what was found.  Everything but the State.
+  void IndexRecords(const string& path, Index* index);
+
+  // Encode the parts of the log; the records fail with ERANGE if they're
+  // too big.
+  static void AppendHeader(string* out);
+  static bool AppendPathRecord(string* out, const string& path, int id);
+  static bool AppendDepsRecord(string* out, int out_id, TimeStamp mtime,
+                               int node_count, const int* ids);
+
   // Updates the in-memory representation.  Takes ownership of |deps|.
   // Returns true if a prior deps record was deleted.
   bool UpdateDeps(int out_id, Deps* deps);
   // Write a node name record, assigning it an id.
   bool RecordId(Node* node);
+  /// Append to |record| the deps record of the side log, and the path
+  /// records of the nodes new to it.
+  bool AppendSideRecords(string* record, Node* node, TimeStamp mtime,
+                         int node_count, Node** nodes);
+
+  /// Return the node with |id|, creating it if needed, or NULL if there is
+  /// no such id.
+  Node* ResolveNode(int id);
+  /// Decode the dependency record for |id| mapped at |record|.
+  Deps* DecodeDeps(const unsigned* record);
+  /// Returns the log's copy of the |node_count| nodes at |nodes|, making
+  /// one if it has none yet.
+  Node** InternNodes(int node_count, Node* const* nodes);
+  /// Give |node| the id its path already has in the log, if any.
+  void ResolveId(Node* node);
+  /// Resolve every node and decode every dependency record.
+  void ResolveAll();
 
   bool needs_recompaction_;
-  FILE* file_;
+  LogWriter file_;
+  /// Whether file_ is a side log; see OpenSideLog().
+  bool side_;
+  /// The ids of the nodes in the side log.
+  map<Node*, int> side_ids_;
+
+  /// The version of the log loaded, whose records are in map_.
+  int version_;
+
+  /// State to create nodes in when they are first needed.
+  State* state_;
+  /// The log as it was loaded.
+  MappedFile map_;
 
-  /// Maps id -> Node.
+  /// Maps id -> Node, or NULL if not created yet.
   vector<Node*> nodes_;
+  /// Maps id -> path of that id in map_, for nodes not created yet.
+  vector<StringPiece> paths_;
+  /// Maps path -> id of nodes not created yet.  Built when first needed.
+  ExternalStringHashMap<int>::Type unresolved_ids_;
+  bool unresolved_ids_built_;
   /// Maps id -> deps of that id.
   vector<Deps*> deps_;
+  /// Maps id -> the latest dependency record of that id in map_, for deps
+  /// not decoded yet.
+  vector<const unsigned*> deps_records_;
+  /// The node lists of all the deps, each held once however many outputs
+  /// have it, keyed by the bytes of the list itself.  Headers mostly come
+  /// in the same sets for the sources of a directory, so many outputs have
+  /// the same deps.
+  ExternalStringHashMap<Node**>::Type node_lists_;
+  /// Scratch space for DecodeDeps().
+  vector<Node*> decoded_;
+
+  Recompaction* recompaction_;
+  /// What Prefetch() found, until Load().
+  Index* prefetched_;
+  BackgroundThread recompaction_thread_;
+  /// Nodes whose deps were recorded while recompaction_ runs.
+  vector<Node*> recorded_since_;
 
   friend struct DepsLogTest;
 };
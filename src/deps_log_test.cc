@@ -87,6 +87,148 @@ TEST_F(DepsLogTest, WriteRead) {
   ASSERT_EQ("bar2.h", log_deps->nodes[1]->path());
 }
 
+// A side log, written next to a log in use, numbers the nodes it records
+// on its own.
+TEST_F(DepsLogTest, Prefetch) {
+  State state1;
+  DepsLog log1;
+  string err;
+  EXPECT_TRUE(log1.OpenForWrite(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  vector<Node*> deps;
+  deps.push_back(state1.GetNode("foo.h", &state1.bindings_, 0));
+  log1.RecordDeps(state1.GetNode("out.o", &state1.bindings_, 0), 1, deps);
+  log1.Close();
+
+  // Indexed before the nodes are there, found once they are.
+  DepsLog log2;
+  log2.Prefetch(kTestFilename);
+  State state2;
+  Node* out = state2.GetNode("out.o", &state2.bindings_, 0);
+  EXPECT_TRUE(log2.Load(kTestFilename, &state2, &err));
+  ASSERT_EQ("", err);
+  EXPECT_GE(out->id(), 0);
+  DepsLog::Deps* log_deps = log2.GetDeps(out);
+  ASSERT_TRUE(log_deps);
+  ASSERT_EQ(1, log_deps->node_count);
+  EXPECT_EQ("foo.h", log_deps->nodes[0]->path());
+
+  // A log written to since is indexed again.
+  DepsLog log3;
+  log3.Prefetch(kTestFilename);
+  {
+    State state;
+    DepsLog writer;
+    EXPECT_TRUE(writer.Load(kTestFilename, &state, &err));
+    EXPECT_TRUE(writer.OpenForWrite(kTestFilename, &err));
+    ASSERT_EQ("", err);
+    deps.clear();
+    deps.push_back(state.GetNode("bar.h", &state.bindings_, 0));
+    writer.RecordDeps(state.GetNode("out2.o", &state.bindings_, 0), 2, deps);
+    writer.Close();
+  }
+  State state3;
+  EXPECT_TRUE(log3.Load(kTestFilename, &state3, &err));
+  ASSERT_EQ("", err);
+  log_deps = log3.GetDeps(state3.GetNode("out2.o", &state3.bindings_, 0));
+  ASSERT_TRUE(log_deps);
+  EXPECT_EQ("bar.h", log_deps->nodes[0]->path());
+
+  // As is another log.
+  DepsLog log4;
+  log4.Prefetch("DepsLogTest-missing");
+  State state4;
+  EXPECT_TRUE(log4.Load(kTestFilename, &state4, &err));
+  ASSERT_EQ("", err);
+  EXPECT_TRUE(log4.GetDeps(state4.GetNode("out.o", &state4.bindings_, 0)));
+}
+
+TEST_F(DepsLogTest, SideLog) {
+  const char kSideFilename[] = "DepsLogTest-tempfile.side";
+  unlink(kSideFilename);
+  State state1;
+  DepsLog log1;
+  string err;
+  EXPECT_TRUE(log1.OpenForWrite(kTestFilename, &err));
+  vector<Node*> deps;
+  deps.push_back(state1.GetNode("foo.h", &state1.bindings_, 0));
+  log1.RecordDeps(state1.GetNode("out.o", &state1.bindings_, 0), 1, deps);
+  log1.Close();
+
+  State state2;
+  DepsLog log2;
+  EXPECT_TRUE(log2.OpenSideLog(kSideFilename, &err));
+  EXPECT_TRUE(log2.Load(kTestFilename, &state2, &err));
+  ASSERT_EQ("", err);
+  deps.clear();
+  deps.push_back(state2.GetNode("bar.h", &state2.bindings_, 0));
+  deps.push_back(state2.GetNode("foo.h", &state2.bindings_, 0));
+  log2.RecordDeps(state2.GetNode("out2.o", &state2.bindings_, 0), 2, deps);
+  DepsLog::Deps* log_deps =
+      log2.GetDeps(state2.GetNode("out2.o", &state2.bindings_, 0));
+  ASSERT_TRUE(log_deps);
+  EXPECT_EQ(2, log_deps->node_count);
+  log2.Close();
+
+  // The log itself is as it was.
+  State state3;
+  DepsLog log3;
+  EXPECT_TRUE(log3.Load(kTestFilename, &state3, &err));
+  EXPECT_EQ(2u, log3.nodes().size());
+  EXPECT_FALSE(log3.GetDeps(state3.GetNode("out2.o", &state3.bindings_, 0)));
+
+  State state4;
+  DepsLog log4;
+  EXPECT_TRUE(log4.Load(kSideFilename, &state4, &err));
+  ASSERT_EQ("", err);
+  ASSERT_EQ(3u, log4.nodes().size());
+  EXPECT_EQ("bar.h", log4.nodes()[0]->path());
+  log_deps = log4.GetDeps(state4.GetNode("out2.o", &state4.bindings_, 0));
+  ASSERT_TRUE(log_deps);
+  EXPECT_EQ(2, log_deps->mtime);
+  ASSERT_EQ(2, log_deps->node_count);
+  EXPECT_EQ("bar.h", log_deps->nodes[0]->path());
+  EXPECT_EQ("foo.h", log_deps->nodes[1]->path());
+  EXPECT_FALSE(log4.GetDeps(state4.GetNode("out.o", &state4.bindings_, 0)));
+  unlink(kSideFilename);
+}
+
+TEST_F(DepsLogTest, SharedNodeLists) {
+  State state1;
+  DepsLog log1;
+  string err;
+  EXPECT_TRUE(log1.OpenForWrite(kTestFilename, &err));
+  ASSERT_EQ("", err);
+
+  vector<Node*> deps;
+  deps.push_back(state1.GetNode("foo.h", &state1.bindings_, 0));
+  deps.push_back(state1.GetNode("bar.h", &state1.bindings_, 0));
+  log1.RecordDeps(state1.GetNode("a.o", &state1.bindings_, 0), 1, deps);
+  log1.RecordDeps(state1.GetNode("b.o", &state1.bindings_, 0), 2, deps);
+  deps.pop_back();
+  log1.RecordDeps(state1.GetNode("c.o", &state1.bindings_, 0), 3, deps);
+
+  DepsLog::Deps* a = log1.GetDeps(state1.GetNode("a.o", &state1.bindings_, 0));
+  DepsLog::Deps* b = log1.GetDeps(state1.GetNode("b.o", &state1.bindings_, 0));
+  DepsLog::Deps* c = log1.GetDeps(state1.GetNode("c.o", &state1.bindings_, 0));
+  ASSERT_TRUE(a && b && c);
+  EXPECT_EQ(a->nodes, b->nodes);
+  EXPECT_NE(a->nodes, c->nodes);
+  log1.Close();
+
+  // Lists decoded from the log are shared too.
+  State state2;
+  DepsLog log2;
+  EXPECT_TRUE(log2.Load(kTestFilename, &state2, &err));
+  ASSERT_EQ("", err);
+  a = log2.GetDeps(state2.GetNode("a.o", &state2.bindings_, 0));
+  b = log2.GetDeps(state2.GetNode("b.o", &state2.bindings_, 0));
+  ASSERT_TRUE(a && b);
+  EXPECT_EQ(a->nodes, b->nodes);
+  ASSERT_EQ(2, b->node_count);
+  EXPECT_EQ("bar.h", b->nodes[1]->path());
+}
+
 TEST_F(DepsLogTest, LotsOfDeps) {
   const int kNumDeps = 100000;  // More than 64k.
 
@@ -323,6 +465,81 @@ TEST_F(DepsLogTest, Recompact) {
 }
 
 // Verify that invalid file headers cause a new build.
+TEST_F(DepsLogTest, RecompactInBackground) {
+  const char kManifest[] =
+"rule cc\n"
+"  command = cc\n"
+"  deps = gcc\n"
+"build out.o: cc\n"
+"build other_out.o: cc\n";
+
+  // Enough stale records to ask for recompaction on the next load.
+  int file_size;
+  {
+    State state;
+    ASSERT_NO_FATAL_FAILURE(AssertParse(&state, kManifest));
+    DepsLog log;
+    string err;
+    ASSERT_TRUE(log.OpenForWrite(kTestFilename, &err));
+    vector<Node*> deps;
+    deps.push_back(state.GetNode("foo.h", &state.bindings_, 0));
+    for (int i = 0; i < 2000; ++i)
+      log.RecordDeps(state.GetNode("out.o", &state.bindings_, 0), i, deps);
+    log.Close();
+
+    struct stat st;
+    ASSERT_EQ(0, stat(kTestFilename, &st));
+    file_size = (int)st.st_size;
+  }
+
+  // Deps recorded while the log is rewritten, including ones for new
+  // paths, end up in the new log.
+  {
+    State state;
+    ASSERT_NO_FATAL_FAILURE(AssertParse(&state, kManifest));
+    DepsLog log;
+    string err;
+    ASSERT_TRUE(log.Load(kTestFilename, &state, &err));
+    ASSERT_TRUE(log.OpenForWrite(kTestFilename, &err));
+    ASSERT_EQ("", err);
+
+    Node* out = state.GetNode("out.o", &state.bindings_, 0);
+    Node* other_out = state.GetNode("other_out.o", &state.bindings_, 0);
+    vector<Node*> deps;
+    deps.push_back(state.GetNode("bar.h", &state.bindings_, 0));
+    log.RecordDeps(out, 5000, deps);
+    deps.push_back(state.GetNode("baz.h", &state.bindings_, 0));
+    log.RecordDeps(other_out, 6000, deps);
+    log.Close();
+
+    DepsLog::Deps* out_deps = log.GetDeps(out);
+    ASSERT_TRUE(out_deps);
+    EXPECT_EQ(5000, out_deps->mtime);
+    EXPECT_EQ(out, log.nodes()[out->id()]);
+    EXPECT_EQ(other_out, log.nodes()[other_out->id()]);
+  }
+
+  struct stat st;
+  ASSERT_EQ(0, stat(kTestFilename, &st));
+  EXPECT_LT((int)st.st_size, file_size / 10);
+
+  State state;
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state, kManifest));
+  DepsLog log;
+  string err;
+  ASSERT_TRUE(log.Load(kTestFilename, &state, &err));
+  DepsLog::Deps* deps = log.GetDeps(state.LookupNode("out.o"));
+  ASSERT_TRUE(deps);
+  EXPECT_EQ(5000, deps->mtime);
+  ASSERT_EQ(1, deps->node_count);
+  EXPECT_EQ("bar.h", deps->nodes[0]->path());
+  deps = log.GetDeps(state.LookupNode("other_out.o"));
+  ASSERT_TRUE(deps);
+  EXPECT_EQ(6000, deps->mtime);
+  ASSERT_EQ(2, deps->node_count);
+  EXPECT_EQ("baz.h", deps->nodes[1]->path());
+}
+
 TEST_F(DepsLogTest, InvalidHeader) {
   const char *kInvalidHeaders[] = {
     "",                              // Empty file.
@@ -348,6 +565,79 @@ TEST_F(DepsLogTest, InvalidHeader) {
   }
 }
 
+// Write a path record of the version 4 format, which is that of version 5.
+void AppendV4Path(string* out, const char* path, int id) {
+  unsigned size = (strlen(path) + 3) / 4 * 4 + 4;
+  out->append((const char*)&size, 4);
+  out->append(path);
+  out->append(size - 4 - strlen(path), '\0');
+  unsigned checksum = ~(unsigned)id;
+  out->append((const char*)&checksum, 4);
+}
+
+TEST_F(DepsLogTest, ReadVersion4) {
+  {
+    string contents = "# ninjadeps\n";
+    int version = 4;
+    contents.append((const char*)&version, 4);
+    AppendV4Path(&contents, "out.o", 0);
+    AppendV4Path(&contents, "foo.h", 1);
+    AppendV4Path(&contents, "bar.h", 2);
+    unsigned record[] = { 0x80000000 | 20, 0, 5, 0, 2, 1 };
+    contents.append((const char*)record, sizeof(record));
+    FILE* f = fopen(kTestFilename, "wb");
+    ASSERT_TRUE(f != NULL);
+    ASSERT_EQ(contents.size(), fwrite(contents.data(), 1, contents.size(), f));
+    ASSERT_EQ(0, fclose(f));
+  }
+
+  // The rewrite keeps only the deps of outputs built with "deps".
+  const char kManifest[] =
+"rule cc\n"
+"  command = cc\n"
+"  deps = gcc\n"
+"build out.o: cc\n"
+"build other.o: cc\n";
+  State state;
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state, kManifest));
+  DepsLog log;
+  string err;
+  ASSERT_TRUE(log.Load(kTestFilename, &state, &err));
+  ASSERT_EQ("", err);
+  DepsLog::Deps* deps = log.GetDeps(state.GetNode("out.o", &state.bindings_, 0));
+  ASSERT_TRUE(deps);
+  EXPECT_EQ(5, deps->mtime);
+  ASSERT_EQ(2, deps->node_count);
+  EXPECT_EQ("bar.h", deps->nodes[0]->path());
+  EXPECT_EQ("foo.h", deps->nodes[1]->path());
+
+  // Opening it for write rewrites it in the current format first, so that
+  // what's added to it can be read back along with what was there.
+  ASSERT_TRUE(log.OpenForWrite(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  vector<Node*> new_deps;
+  new_deps.push_back(state.GetNode("foo.h", &state.bindings_, 0));
+  log.RecordDeps(state.GetNode("other.o", &state.bindings_, 0), 6, new_deps);
+  log.Close();
+
+  State state2;
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state2, kManifest));
+  DepsLog log2;
+  ASSERT_TRUE(log2.Load(kTestFilename, &state2, &err));
+  ASSERT_EQ("", err);
+  deps = log2.GetDeps(state2.GetNode("out.o", &state2.bindings_, 0));
+  ASSERT_TRUE(deps);
+  EXPECT_EQ(5, deps->mtime);
+  ASSERT_EQ(2, deps->node_count);
+  EXPECT_EQ("bar.h", deps->nodes[0]->path());
+  EXPECT_EQ("foo.h", deps->nodes[1]->path());
+  deps = log2.GetDeps(state2.GetNode("other.o", &state2.bindings_, 0));
+  ASSERT_TRUE(deps);
+  EXPECT_EQ(6, deps->mtime);
+  ASSERT_EQ(1, deps->node_count);
+  EXPECT_EQ("foo.h", deps->nodes[0]->path());
+}
+
 // Simulate what happens when loading a truncated log file.
 TEST_F(DepsLogTest, Truncated) {
   // Create a file with some entries.
@@ -0,0 +1,94 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _WIN32
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#endif
+
+#include "deps_printer.h"
+
+#ifndef _WIN32
+#include <inttypes.h>
+#endif
+
+#include <algorithm>
+
+#include "deps_log.h"
+#include "disk_interface.h"
+#include "graph.h"
+#include "util.h"
+
+namespace {
+
+void Write(string* text, FILE* out) {
+  fwrite(text->data(), 1, text->size(), out);
+  text->clear();
+}
+
+}  // anonymous namespace
+
+void DepsPrinter::Print(const vector<Node*>& nodes, FILE* out) {
+  const size_t kFlushSize = 1 << 20;
+  string text;
+  vector<const string*> paths;
+  vector<TimeStamp> mtimes;
+  for (size_t begin = 0; begin < nodes.size(); begin += batch_size_) {
+    size_t end = min(begin + batch_size_, nodes.size());
+    paths.clear();
+    for (size_t i = begin; i < end; ++i) {
+      if (deps_log_->GetDeps(nodes[i]))
+        paths.push_back(&nodes[i]->path());
+    }
+    disk_interface_->StatMany(paths, &mtimes);
+
+    size_t stat = 0;
+    for (size_t i = begin; i < end; ++i) {
+      Node* node = nodes[i];
+      DepsLog::Deps* deps = deps_log_->GetDeps(node);
+      if (!deps) {
+        text += node->path();
+        text += ": deps not found\n";
+        continue;
+      }
+
+      TimeStamp mtime = mtimes[stat++];
+      if (mtime == -1) {
+        // Stat() again for the error, after what comes before it.
+        Write(&text, out);
+        fflush(out);
+        string err;
+        mtime = disk_interface_->Stat(node->path(), &err);
+        if (mtime == -1)
+          Error("%s", err.c_str());  // Log and ignore Stat() errors;
+      }
+      char line[80];
+      snprintf(line, sizeof(line), ": #deps %d, deps mtime %" PRId64 " (%s)\n",
+               deps->node_count, deps->mtime,
+               (!mtime || mtime > deps->mtime ? "STALE":"VALID"));
+      text += node->path();
+      text += line;
+      for (int d = 0; d < deps->node_count; ++d) {
+        text += "    ";
+        text += deps->nodes[d]->path();
+        text.push_back('\n');
+      }
+      text.push_back('\n');
+      if (text.size() >= kFlushSize)
+        Write(&text, out);
+    }
+  }
+  Write(&text, out);
+}
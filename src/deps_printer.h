@@ -0,0 +1,53 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_DEPS_PRINTER_H_
+#define NINJA_DEPS_PRINTER_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+struct DepsLog;
+struct DiskInterface;
+struct Node;
+
+/// Prints what "-t deps" does: the deps that the deps log has for each
+/// node, and whether they are STALE or VALID by the mtime of its file.
+///
+/// A log can have the deps of many files, so they are stat()ed a batch at
+/// a time through DiskInterface::StatMany(), and what is printed is written
+/// out in large blocks as it comes.
+struct DepsPrinter {
+  DepsPrinter(DepsLog* deps_log, DiskInterface* disk_interface)
+      : deps_log_(deps_log), disk_interface_(disk_interface),
+        batch_size_(16384) {}
+
+  /// Print the deps of |nodes|, in order, to |out|.  Stat() errors are
+  /// reported after what comes before them, and otherwise ignored.
+  void Print(const vector<Node*>& nodes, FILE* out);
+
+  /// How many files to stat() at once.
+  void set_batch_size(size_t batch_size) { batch_size_ = batch_size; }
+
+ private:
+  DepsLog* deps_log_;
+  DiskInterface* disk_interface_;
+  size_t batch_size_;
+};
+
+#endif  // NINJA_DEPS_PRINTER_H_
@@ -0,0 +1,125 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "deps_printer.h"
+
+#include "deps_log.h"
+#include "disk_interface.h"
+#include "graph.h"
+#include "test.h"
+#include "util.h"
+
+namespace {
+
+struct DepsPrinterTest : public StateTestWithBuiltinRules {
+  virtual void SetUp() {
+    temp_dir_.CreateAndEnter("DepsPrinterTest");
+    string err;
+    ASSERT_TRUE(deps_log_.OpenForWrite("ninja_deps", &err));
+    ASSERT_EQ("", err);
+  }
+  virtual void TearDown() {
+    deps_log_.Close();
+    temp_dir_.Cleanup();
+  }
+
+  /// Record in the deps log that |out| read |input| when it had |mtime|.
+  void RecordDep(const string& out, TimeStamp mtime, const string& input) {
+    vector<Node*> nodes(1, GetNode(input));
+    ASSERT_TRUE(deps_log_.RecordDeps(GetNode(out), mtime, nodes));
+  }
+
+  /// What |printer| prints for the nodes at |paths|.
+  string Print(DepsPrinter* printer, const vector<string>& paths) {
+    vector<Node*> nodes;
+    for (size_t i = 0; i < paths.size(); ++i)
+      nodes.push_back(GetNode(paths[i]));
+    FILE* f = fopen("printed", "wb");
+    EXPECT_TRUE(f != NULL);
+    printer->Print(nodes, f);
+    fclose(f);
+    string printed, err;
+    EXPECT_EQ(0, ReadFile("printed", &printed, &err));
+    return printed;
+  }
+
+  /// The line that "-t deps" prints for |path| before its deps.
+  static string Line(const string& path, int count, TimeStamp mtime,
+                     const char* state) {
+    char line[80];
+    snprintf(line, sizeof(line), ": #deps %d, deps mtime %lld (%s)\n",
+             count, (long long)mtime, state);
+    return path + line;
+  }
+
+  ScopedTempDir temp_dir_;
+  RealDiskInterface disk_;
+  DepsLog deps_log_;
+};
+
+TEST_F(DepsPrinterTest, InOrderAcrossBatches) {
+  disk_.WriteFile("valid", "");
+  disk_.WriteFile("newer", "");
+  string err;
+  TimeStamp mtime = disk_.Stat("valid", &err);
+  ASSERT_GT(mtime, 0);
+  RecordDep("valid", mtime, "a.h");
+  RecordDep("newer", disk_.Stat("newer", &err) - 1, "b.h");
+  RecordDep("missing", mtime, "c.h");
+
+  vector<string> paths;
+  paths.push_back("valid");
+  paths.push_back("none");
+  paths.push_back("newer");
+  paths.push_back("missing");
+  paths.push_back("valid");
+  const string expected =
+      Line("valid", 1, mtime, "VALID") + "    a.h\n\n" +
+      "none: deps not found\n" +
+      Line("newer", 1, disk_.Stat("newer", &err) - 1, "STALE") +
+      "    b.h\n\n" +
+      Line("missing", 1, mtime, "STALE") + "    c.h\n\n" +
+      Line("valid", 1, mtime, "VALID") + "    a.h\n\n";
+
+  // However many files are stat()ed at once, the same is printed as one
+  // at a time would.
+  for (size_t batch = 1; batch <= paths.size() + 1; ++batch) {
+    DepsPrinter printer(&deps_log_, &disk_);
+    printer.set_batch_size(batch);
+    EXPECT_EQ(expected, Print(&printer, paths));
+  }
+}
+
+#ifndef _WIN32
+TEST_F(DepsPrinterTest, StatError) {
+  // A file name too long to stat() fails, rather than being missing.
+  string bad(300, 'x');
+  RecordDep(bad, 5, "a.h");
+  RecordDep("missing", 5, "b.h");
+  string err;
+  ASSERT_EQ(-1, disk_.Stat(bad, &err));
+
+  vector<string> paths;
+  paths.push_back("missing");
+  paths.push_back(bad);
+  paths.push_back("missing");
+  DepsPrinter printer(&deps_log_, &disk_);
+  EXPECT_EQ(Line("missing", 1, 5, "STALE") + "    b.h\n\n" +
+            Line(bad, 1, 5, "VALID") + "    a.h\n\n" +
+            Line("missing", 1, 5, "STALE") + "    b.h\n\n",
+            Print(&printer, paths));
+}
+#endif
+
+}  // anonymous namespace
@@ -0,0 +1,321 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "digest_log.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <vector>
+
+#include "build_log.h"
+#include "graph.h"
+#include "metrics.h"
+#include "string_piece_util.h"
+#include "trace.h"
+#if defined(_MSC_VER) && (_MSC_VER < 1800)
+#define strtoll _strtoi64
+#define strtoull _strtoui64
+#endif
+
+namespace {
+
+const char kFileSignature[] = "# ninja digests v2\n";
+
+// Rewrite the log once it holds this many records more than it has live
+// ones, and this many times as many.
+const size_t kMinCompactionRecordCount = 1000;
+const size_t kCompactionRatio = 3;
+
+uint64_t ParseUnsigned(const string& s, int base) {
+  return strtoull(s.c_str(), NULL, base);
+}
+
+}  // anonymous namespace
+
+DigestLog::DigestLog() : needs_recompaction_(false) {}
+
+DigestLog::~DigestLog() {
+  Close();
+}
+
+bool DigestLog::Load(const string& path, string* err) {
+  METRIC_RECORD(".ninja_digests load");
+  TRACE_PHASE(".ninja_digests load");
+  string contents;
+  int status = ReadFile(path, &contents, err);
+  if (status == -ENOENT) {
+    err->clear();
+    return true;
+  }
+  if (status < 0)
+    return false;
+  if (contents.empty())
+    return true;
+
+  if (contents.compare(0, sizeof(kFileSignature) - 1, kFileSignature) != 0) {
+    *err = "digest log version invalid; starting over";
+    unlink(path.c_str());
+    // Not a failure: what isn't known is just hashed again.
+    return true;
+  }
+
+  size_t records = 0;
+  size_t start = sizeof(kFileSignature) - 1;
+  for (;;) {
+    size_t end = contents.find('\n', start);
+    // An incomplete last line was cut short while being written.
+    if (end == string::npos)
+      break;
+    string line = contents.substr(start, end - start);
+    start = end + 1;
+
+    vector<StringPiece> fields = SplitStringPiece(line, '\t');
+    if (fields.size() == 7 && fields[0] == "f") {
+      FileEntry entry;
+      entry.digest = ParseUnsigned(fields[1].AsString(), 16);
+      entry.id.device = ParseUnsigned(fields[2].AsString(), 10);
+      entry.id.inode = ParseUnsigned(fields[3].AsString(), 10);
+      entry.id.size = ParseUnsigned(fields[4].AsString(), 10);
+      entry.id.mtime = strtoll(fields[5].AsString().c_str(), NULL, 10);
+      files_[fields[6].AsString()] = entry;
+      ++records;
+    } else if (fields.size() == 3 && fields[0] == "o") {
+      outputs_[fields[2].AsString()] = ParseUnsigned(fields[1].AsString(), 16);
+      ++records;
+    } else if (fields.size() == 3 && fields[0] == "l") {
+      if (fields[1].size() == 0)
+        lazy_.erase(fields[2].AsString());
+      else
+        lazy_[fields[2].AsString()] = fields[1].AsString();
+      ++records;
+    }
+  }
+
+  size_t live = files_.size() + outputs_.size() + lazy_.size();
+  needs_recompaction_ = records > live + kMinCompactionRecordCount &&
+      records > live * kCompactionRatio;
+  return true;
+}
+
+bool DigestLog::OpenForWrite(const string& path, string* err) {
+  if (needs_recompaction_ && !Recompact(path, err))
+    return false;
+  path_ = path;
+  return true;
+}
+
+void DigestLog::OpenSideLog(const string& path) {
+  needs_recompaction_ = false;
+  path_ = path;
+}
+
+bool DigestLog::Flush() {
+  return file_.Flush();
+}
+
+void DigestLog::Close() {
+  file_.Close();
+  path_.clear();
+}
+
+bool DigestLog::InputsDigest(const Edge* edge, DiskInterface* disk,
+                             uint64_t* digest) {
+  CommandHasher hasher;
+  for (size_t i = 0; i < edge->inputs_.size() - edge->order_only_deps_; ++i) {
+    const string& path = edge->inputs_[i]->path();
+    uint64_t file_digest;
+    if (!FileDigest(path, disk, &file_digest))
+      return false;
+    hasher.Update(path.c_str(), path.size() + 1);
+    hasher.Update((const char*)&file_digest, sizeof(file_digest));
+  }
+  *digest = hasher.Finish();
+  return true;
+}
+
+bool DigestLog::LookupOutput(const string& output, uint64_t* digest) const {
+  map<string, uint64_t>::const_iterator i = outputs_.find(output);
+  if (i == outputs_.end())
+    return false;
+  *digest = i->second;
+  return true;
+}
+
+bool DigestLog::RecordOutputs(const Edge* edge, uint64_t digest) {
+  for (vector<Node*>::const_iterator o = edge->outputs_.begin();
+       o != edge->outputs_.end(); ++o) {
+    const string& path = (*o)->path();
+    outputs_[path] = digest;
+    if (!Append(FormatOutput(path, digest)))
+      return false;
+  }
+  return true;
+}
+
+bool DigestLog::RecordLazy(const string& path, const string& source,
+                           const FileIdentity& id, uint64_t digest) {
+  FileEntry& entry = files_[path];
+  entry.id = id;
+  entry.digest = digest;
+  lazy_[path] = source;
+  return Append(FormatFile(path, entry)) && Append(FormatLazy(path, source));
+}
+
+bool DigestLog::LookupLazy(const string& path, string* source,
+                           FileIdentity* id) const {
+  map<string, string>::const_iterator i = lazy_.find(path);
+  if (i == lazy_.end())
+    return false;
+  map<string, FileEntry>::const_iterator file = files_.find(path);
+  if (file == files_.end())
+    return false;
+  *source = i->second;
+  *id = file->second.id;
+  return true;
+}
+
+bool DigestLog::ForgetLazy(const string& path) {
+  if (!lazy_.erase(path))
+    return true;
+  return Append(FormatLazy(path, ""));
+}
+
+bool DigestLog::Merge(const DigestLog& side, const set<string>& outputs) {
+  // A file's digest goes with its identity, whoever took it.
+  for (map<string, FileEntry>::const_iterator i = side.files_.begin();
+       i != side.files_.end(); ++i) {
+    files_[i->first] = i->second;
+    if (!Append(FormatFile(i->first, i->second)))
+      return false;
+  }
+  for (set<string>::const_iterator o = outputs.begin(); o != outputs.end();
+       ++o) {
+    map<string, uint64_t>::const_iterator output = side.outputs_.find(*o);
+    if (output != side.outputs_.end()) {
+      outputs_[*o] = output->second;
+      if (!Append(FormatOutput(*o, output->second)))
+        return false;
+    }
+    map<string, string>::const_iterator lazy = side.lazy_.find(*o);
+    if (lazy != side.lazy_.end()) {
+      lazy_[*o] = lazy->second;
+      if (!Append(FormatLazy(*o, lazy->second)))
+        return false;
+    } else if (!ForgetLazy(*o)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool DigestLog::Recompact(const string& path, string* err) {
+  METRIC_RECORD(".ninja_digests recompact");
+  Close();
+  string temp_path = path + ".recompact";
+  string contents = kFileSignature;
+  for (map<string, FileEntry>::const_iterator i = files_.begin();
+       i != files_.end(); ++i)
+    contents += FormatFile(i->first, i->second);
+  for (map<string, uint64_t>::const_iterator i = outputs_.begin();
+       i != outputs_.end(); ++i)
+    contents += FormatOutput(i->first, i->second);
+  for (map<string, string>::const_iterator i = lazy_.begin();
+       i != lazy_.end(); ++i)
+    contents += FormatLazy(i->first, i->second);
+
+  FILE* f = fopen(temp_path.c_str(), "wb");
+  if (!f || fwrite(contents.data(), 1, contents.size(), f) != contents.size()) {
+    *err = strerror(errno);
+    if (f)
+      fclose(f);
+    unlink(temp_path.c_str());
+    return false;
+  }
+  if (fclose(f) < 0 || (unlink(path.c_str()) < 0 && errno != ENOENT) ||
+      rename(temp_path.c_str(), path.c_str()) < 0) {
+    *err = strerror(errno);
+    unlink(temp_path.c_str());
+    return false;
+  }
+  needs_recompaction_ = false;
+  return true;
+}
+
+bool DigestLog::FileDigest(const string& path, DiskInterface* disk,
+                           uint64_t* digest) {
+  FileIdentity id;
+  bool identified = disk->Identify(path, &id);
+  map<string, FileEntry>::iterator i = files_.find(path);
+  if (identified && i != files_.end() && i->second.id == id) {
+    *digest = i->second.digest;
+    return true;
+  }
+
+  string contents, err;
+  if (disk->ReadFile(path, &contents, &err) != FileReader::Okay)
+    return false;
+  *digest = BuildLog::LogEntry::HashCommand(contents).low;
+
+  // Without an identity the file has to be read every time.
+  if (identified) {
+    FileEntry& entry = files_[path];
+    entry.id = id;
+    entry.digest = *digest;
+    if (!Append(FormatFile(path, entry)))
+      Warning("writing to digest log: %s", strerror(errno));
+  }
+  return true;
+}
+
+bool DigestLog::Append(const string& record) {
+  if (path_.empty())
+    return true;
+  if (!file_.is_open()) {
+    string err;
+    if (!file_.Open(path_, &err))
+      return false;
+    if (file_.empty() && !file_.Append(kFileSignature))
+      return false;
+  }
+  return file_.Append(record);
+}
+
+// static
+string DigestLog::FormatFile(const string& path, const FileEntry& entry) {
+  char buf[128];
+  snprintf(buf, sizeof(buf),
+           "f\t%016" PRIx64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRId64
+           "\t",
+           entry.digest, entry.id.device, entry.id.inode, entry.id.size,
+           entry.id.mtime);
+  return buf + path + "\n";
+}
+
+// static
+string DigestLog::FormatOutput(const string& path, uint64_t digest) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "o\t%016" PRIx64 "\t", digest);
+  return buf + path + "\n";
+}
+
+// static
+string DigestLog::FormatLazy(const string& path, const string& source) {
+  return "l\t" + source + "\t" + path + "\n";
+}
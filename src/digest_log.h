@@ -0,0 +1,118 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_DIGEST_LOG_H_
+#define NINJA_DIGEST_LOG_H_
+
+#include <map>
+#include <set>
+#include <string>
+using namespace std;
+
+#include "disk_interface.h"
+#include "log_writer.h"
+#include "util.h"  // uint64_t
+
+struct Edge;
+
+/// Digests of file contents, for the edges that ask to be rebuilt only
+/// when the contents of their inputs change ("hash_inputs = 1") rather
+/// than whenever an input is newer than their outputs, as it is after
+/// switching branches back and forth.
+///
+/// The log remembers, for every file it hashed, the digest of its contents
+/// and the FileIdentity it had then, so that a file is only read again
+/// once its identity changes.  For every output of such an edge it
+/// remembers the digest of the edge's inputs when the output was built.
+///
+/// The file holds a signature line followed by tab-separated records,
+///   f <digest> <device> <inode> <size> <mtime> <path>
+///   o <digest> <path>
+///   l <source> <path>
+/// with the digests in hexadecimal.  An "l" record with no source drops the
+/// one before it.  A record overrides earlier ones for
+/// the same path, so updates are appended.
+struct DigestLog {
+  DigestLog();
+  ~DigestLog();
+
+  bool Load(const string& path, string* err);
+  /// Prepare to append to |path|, which is only created once there's
+  /// something to write.
+  bool OpenForWrite(const string& path, string* err);
+  /// Append to a log of its own at |path| rather than to the log loaded,
+  /// which another process owns (see BuildDirLock) and which isn't
+  /// recompacted then.
+  void OpenSideLog(const string& path);
+  bool Flush();
+  void Close();
+
+  /// Compute into |digest| a digest of the contents of the inputs of
+  /// |edge| that its outputs depend on: all but the order-only ones.
+  /// Returns false if one of them is missing or can't be read.
+  bool InputsDigest(const Edge* edge, DiskInterface* disk, uint64_t* digest);
+
+  /// The digest of the contents of |path|, which is only read if its
+  /// FileIdentity changed since it was last hashed.  Returns false if it's
+  /// missing or can't be read.
+  bool FileDigest(const string& path, DiskInterface* disk, uint64_t* digest);
+
+  /// The inputs digest of the edge that last built |output|.
+  bool LookupOutput(const string& output, uint64_t* digest) const;
+
+  /// Record |digest| as the inputs digest of every output of |edge|.
+  bool RecordOutputs(const Edge* edge, uint64_t digest);
+
+  /// Record that |path| isn't written out yet, but is to have the contents
+  /// of |source|, whose digest is |digest|, and identity |id| until then.
+  /// See LazyDiskInterface.
+  bool RecordLazy(const string& path, const string& source,
+                  const FileIdentity& id, uint64_t digest);
+
+  /// If |path| was recorded by RecordLazy(), fill |source| and |id|.
+  bool LookupLazy(const string& path, string* source, FileIdentity* id) const;
+
+  /// Drop the record of RecordLazy() for |path|, if there is one.
+  bool ForgetLazy(const string& path);
+
+  /// Take in the records of |side|, a side log: all of its file digests,
+  /// and what it knows of |outputs|, which it built last.
+  bool Merge(const DigestLog& side, const set<string>& outputs);
+
+  /// Rewrite the log with only its live records.
+  bool Recompact(const string& path, string* err);
+
+ private:
+  struct FileEntry {
+    FileIdentity id;
+    uint64_t digest;
+  };
+
+  bool Append(const string& record);
+  static string FormatFile(const string& path, const FileEntry& entry);
+  static string FormatOutput(const string& path, uint64_t digest);
+  static string FormatLazy(const string& path, const string& source);
+
+  map<string, FileEntry> files_;
+  map<string, uint64_t> outputs_;
+  /// The source of every file recorded by RecordLazy().
+  map<string, string> lazy_;
+  bool needs_recompaction_;
+
+  /// Where to append, once there's something to append.
+  string path_;
+  LogWriter file_;
+};
+
+#endif  // NINJA_DIGEST_LOG_H_
@@ -0,0 +1,176 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "digest_log.h"
+
+#include <stdio.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "graph.h"
+#include "state.h"
+#include "test.h"
+
+namespace {
+
+const char kTestFilename[] = "DigestLogTest-tempfile";
+
+struct DigestLogTest : public StateTestWithBuiltinRules {
+  virtual void SetUp() {
+    // In case a crashing test left a stale file behind.
+    unlink(kTestFilename);
+    AssertParse(&state_, "build out1 out2: cat in1 in2 || oo\n");
+    edge_ = state_.edges_[0];
+    fs_.Create("in1", "one");
+    fs_.Create("in2", "two");
+  }
+  virtual void TearDown() {
+    unlink(kTestFilename);
+  }
+
+  VirtualFileSystem fs_;
+  Edge* edge_;
+};
+
+TEST_F(DigestLogTest, HashesOncePerIdentity) {
+  DigestLog log;
+  uint64_t digest;
+  ASSERT_TRUE(log.InputsDigest(edge_, &fs_, &digest));
+  // Order-only inputs don't count.
+  ASSERT_EQ(2u, fs_.files_read_.size());
+
+  uint64_t again;
+  ASSERT_TRUE(log.InputsDigest(edge_, &fs_, &again));
+  EXPECT_EQ(digest, again);
+  EXPECT_EQ(2u, fs_.files_read_.size());
+
+  // A newer file is read again, but the same contents give the same digest.
+  fs_.Tick();
+  fs_.Create("in1", "one");
+  ASSERT_TRUE(log.InputsDigest(edge_, &fs_, &again));
+  EXPECT_EQ(digest, again);
+  EXPECT_EQ(3u, fs_.files_read_.size());
+
+  fs_.Create("in2", "TWO");
+  ASSERT_TRUE(log.InputsDigest(edge_, &fs_, &again));
+  EXPECT_NE(digest, again);
+
+  // Swapping the contents of the inputs changes the digest too.
+  fs_.Create("in1", "two");
+  fs_.Create("in2", "one");
+  ASSERT_TRUE(log.InputsDigest(edge_, &fs_, &again));
+  EXPECT_NE(digest, again);
+
+  fs_.RemoveFile("in1");
+  EXPECT_FALSE(log.InputsDigest(edge_, &fs_, &again));
+}
+
+TEST_F(DigestLogTest, WriteRead) {
+  uint64_t digest;
+  string err;
+  {
+    DigestLog log;
+    ASSERT_TRUE(log.Load(kTestFilename, &err));
+    ASSERT_EQ("", err);
+    ASSERT_TRUE(log.OpenForWrite(kTestFilename, &err));
+    ASSERT_TRUE(log.InputsDigest(edge_, &fs_, &digest));
+    ASSERT_TRUE(log.RecordOutputs(edge_, digest));
+    log.Close();
+  }
+
+  DigestLog log;
+  ASSERT_TRUE(log.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  uint64_t recorded;
+  ASSERT_TRUE(log.LookupOutput("out1", &recorded));
+  EXPECT_EQ(digest, recorded);
+  ASSERT_TRUE(log.LookupOutput("out2", &recorded));
+  EXPECT_EQ(digest, recorded);
+  EXPECT_FALSE(log.LookupOutput("in1", &recorded));
+
+  // The files hashed before aren't read again.
+  fs_.files_read_.clear();
+  ASSERT_TRUE(log.InputsDigest(edge_, &fs_, &recorded));
+  EXPECT_EQ(digest, recorded);
+  EXPECT_TRUE(fs_.files_read_.empty());
+
+  // Recompacting keeps the records.
+  ASSERT_TRUE(log.Recompact(kTestFilename, &err));
+  DigestLog recompacted;
+  ASSERT_TRUE(recompacted.Load(kTestFilename, &err));
+  ASSERT_TRUE(recompacted.LookupOutput("out2", &recorded));
+  EXPECT_EQ(digest, recorded);
+}
+
+TEST_F(DigestLogTest, LazyRecords) {
+  string err;
+  FileIdentity id;
+  id.size = 5;
+  id.mtime = 42;
+  {
+    DigestLog log;
+    ASSERT_TRUE(log.Load(kTestFilename, &err));
+    ASSERT_TRUE(log.OpenForWrite(kTestFilename, &err));
+    ASSERT_TRUE(log.RecordLazy("out1", "cache/1", id, 0x1234));
+    ASSERT_TRUE(log.RecordLazy("out2", "cache/2", id, 0x5678));
+    ASSERT_TRUE(log.ForgetLazy("out2"));
+    log.Close();
+  }
+
+  DigestLog log;
+  ASSERT_TRUE(log.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  string source;
+  FileIdentity recorded;
+  ASSERT_TRUE(log.LookupLazy("out1", &source, &recorded));
+  EXPECT_EQ("cache/1", source);
+  EXPECT_TRUE(id == recorded);
+  EXPECT_FALSE(log.LookupLazy("out2", &source, &recorded));
+
+  // Recompacting keeps the records.
+  ASSERT_TRUE(log.Recompact(kTestFilename, &err));
+  DigestLog recompacted;
+  ASSERT_TRUE(recompacted.Load(kTestFilename, &err));
+  EXPECT_TRUE(recompacted.LookupLazy("out1", &source, &recorded));
+  EXPECT_FALSE(recompacted.LookupLazy("out2", &source, &recorded));
+}
+
+TEST_F(DigestLogTest, Truncated) {
+  uint64_t digest;
+  string err;
+  {
+    DigestLog log;
+    ASSERT_TRUE(log.OpenForWrite(kTestFilename, &err));
+    ASSERT_TRUE(log.InputsDigest(edge_, &fs_, &digest));
+    ASSERT_TRUE(log.RecordOutputs(edge_, digest));
+    log.Close();
+  }
+  string contents;
+  ASSERT_EQ(0, ReadFile(kTestFilename, &contents, &err));
+  FILE* f = fopen(kTestFilename, "wb");
+  ASSERT_TRUE(f);
+  fwrite(contents.data(), 1, contents.size() - 2, f);
+  fclose(f);
+
+  // The record cut short is dropped, and the ones before it stay.
+  DigestLog log;
+  ASSERT_TRUE(log.Load(kTestFilename, &err));
+  ASSERT_EQ("", err);
+  uint64_t recorded;
+  EXPECT_TRUE(log.LookupOutput("out1", &recorded));
+  EXPECT_FALSE(log.LookupOutput("out2", &recorded));
+}
+
+}  // anonymous namespace
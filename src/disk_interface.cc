@@ -27,10 +27,14 @@
 #include <windows.h>
 #include <direct.h>  // _mkdir, chdir, getcwd
 #else
+#include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
 #endif
 
+#include "mapped_file.h"
 #include "metrics.h"
+#include "parallel.h"
 #include "util.h"
 
 namespace {
@@ -60,6 +64,10 @@ int MakeDir(const string& path) {
 #endif
 }
 
+/// Stands in the stat cache for the mtime of a file that a directory
+/// listing found but that hasn't been stat()ed yet.
+const TimeStamp kUnknownMTime = -2;
+
 #ifdef _WIN32
 TimeStamp TimeStampFromFileTime(const FILETIME& filetime) {
   // FILETIME is in 100-nanosecond increments since the Windows epoch.
@@ -93,38 +101,59 @@ bool IsWindows7OrLater() {
       &version_info, VER_MAJORVERSION | VER_MINORVERSION, comparison);
 }
 
-bool StatAllFilesInDir(const string& dir, map<string, TimeStamp>* stamps,
-                       string* err) {
-  // FindExInfoBasic is 30% faster than FindExInfoStandard.
-  static bool can_use_basic_info = IsWindows7OrLater();
-  // This is not in earlier SDKs.
-  const FINDEX_INFO_LEVELS kFindExInfoBasic =
-      static_cast<FINDEX_INFO_LEVELS>(1);
-  FINDEX_INFO_LEVELS level =
-      can_use_basic_info ? kFindExInfoBasic : FindExInfoStandard;
-  WIN32_FIND_DATAA ffd;
-  HANDLE find_handle = FindFirstFileExA((dir + "\\*").c_str(), level, &ffd,
-                                        FindExSearchNameMatch, NULL, 0);
+/// Turn |path| into the form it has in the stat cache: lowercase, with
+/// backslashes, as the paths that name the same file compare on Windows.
+void FoldCase(string* path) {
+  transform(path->begin(), path->end(), path->begin(), ::tolower);
+  replace(path->begin(), path->end(), '/', '\\');
+}
+#else
+TimeStamp MTimeOf(const struct stat& st) {
+  // Some users (Flatpak) set mtime to 0, this should be harmless
+  // and avoids conflicting with our return value of 0 meaning
+  // that it doesn't exist.
+  if (st.st_mtime == 0)
+    return 1;
+#if defined(_AIX)
+  return (int64_t)st.st_mtime * 1000000000LL + st.st_mtime_n;
+#elif defined(__APPLE__)
+  return ((int64_t)st.st_mtimespec.tv_sec * 1000000000LL +
+          st.st_mtimespec.tv_nsec);
+#elif defined(st_mtime) // A macro, so we're likely on modern POSIX.
+  return (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#else
+  return (int64_t)st.st_mtime * 1000000000LL + st.st_mtimensec;
+#endif
+}
 
-  if (find_handle == INVALID_HANDLE_VALUE) {
-    DWORD win_err = GetLastError();
-    if (win_err == ERROR_FILE_NOT_FOUND || win_err == ERROR_PATH_NOT_FOUND)
-      return true;
-    *err = "FindFirstFileExA(" + dir + "): " + GetLastErrorString();
-    return false;
+TimeStamp StatSingleFile(const string& path, string* err) {
+  struct stat st;
+  if (stat(path.c_str(), &st) < 0) {
+    if (errno == ENOENT || errno == ENOTDIR)
+      return 0;
+    *err = "stat(" + path + "): " + strerror(errno);
+    return -1;
   }
-  do {
-    string lowername = ffd.cFileName;
-    if (lowername == "..") {
-      // Seems to just copy the timestamp for ".." from ".", which is wrong.
-      // This is the case at least on NTFS under Windows 7.
-      continue;
-    }
-    transform(lowername.begin(), lowername.end(), lowername.begin(), ::tolower);
-    stamps->insert(make_pair(lowername,
-                             TimeStampFromFileTime(ffd.ftLastWriteTime)));
-  } while (FindNextFileA(find_handle, &ffd));
-  FindClose(find_handle);
+  return MTimeOf(st);
+}
+
+/// Split |path| into the directory holding it and its key in the stat
+/// cache, which is the path with redundant slashes before the name removed.
+/// Returns false for paths the cache can't handle.
+bool CacheKey(const string& path, string* dir, string* key) {
+  string::size_type slash_pos = path.rfind('/');
+  string base = path.substr(slash_pos == string::npos ? 0 : slash_pos + 1);
+  if (base.empty())
+    return false;
+  *dir = DirName(path);
+  if (dir->empty() && slash_pos != string::npos)
+    *dir = "/";
+  if (dir->empty())
+    *key = base;
+  else if (*dir == "/")
+    *key = "/" + base;
+  else
+    *key = *dir + "/" + base;
   return true;
 }
 #endif  // _WIN32
@@ -153,6 +182,25 @@ bool DiskInterface::MakeDirs(const string& path) {
   return MakeDir(dir);
 }
 
+FileReader::Status FileReader::ReadFileTerminated(const string& path,
+                                                  MappedFile* file,
+                                                  string* err) {
+  string contents;
+  Status status = ReadFile(path, &contents, err);
+  if (status == Okay)
+    file->Assign(contents);
+  return status;
+}
+
+void DiskInterface::StatMany(const vector<const string*>& paths,
+                             vector<TimeStamp>* mtimes) const {
+  mtimes->resize(paths.size());
+  for (size_t i = 0; i < paths.size(); ++i) {
+    string err;
+    (*mtimes)[i] = Stat(*paths[i], &err);
+  }
+}
+
 // RealDiskInterface -----------------------------------------------------------
 
 TimeStamp RealDiskInterface::Stat(const string& path, string* err) const {
@@ -173,57 +221,411 @@ TimeStamp RealDiskInterface::Stat(const string& path, string* err) const {
   string dir = DirName(path);
   string base(path.substr(dir.size() ? dir.size() + 1 : 0));
   if (base == "..") {
-    // StatAllFilesInDir does not report any information for base = "..".
+    // ListDir() does not report any information for base = "..".
     base = ".";
     dir = path;
   }
+  FoldCase(&dir);
+  FoldCase(&base);
+  string key = dir.empty() ? base : dir + "\\" + base;
+
+  ScopedLock lock(&cache_mutex_);
+  if (listed_dirs_.find(dir) == listed_dirs_.end()) {
+    METRIC_RECORD("node stat dir listing");
+    if (!ListDir(dir, err))
+      return -1;
+    listed_dirs_.insert(make_pair(KeepKey(dir), true));
+  }
+  StatCache::iterator i = stat_cache_.find(key);
+  if (i == stat_cache_.end())
+    return 0;
+  if (i->second != kUnknownMTime)
+    return i->second;
+  // Invalidated since the listing.
+  TimeStamp mtime = StatSingleFile(path, err);
+  if (mtime != -1)
+    i->second = mtime;
+  return mtime;
+#else
+  string dir, key;
+  if (!use_cache_ || !CacheKey(path, &dir, &key))
+    return StatSingleFile(path, err);
+  ScopedLock lock(&cache_mutex_);
+  return CachedStat(path, dir, key, err);
+#endif
+}
 
-  transform(dir.begin(), dir.end(), dir.begin(), ::tolower);
-  transform(base.begin(), base.end(), base.begin(), ::tolower);
+#ifdef _WIN32
+bool RealDiskInterface::ListDir(const string& dir, string* err) const {
+  // FindExInfoBasic is 30% faster than FindExInfoStandard, and a large
+  // fetch gets the entries from the kernel in fewer, bigger batches; both
+  // need Windows 7.
+  static bool is_windows7 = IsWindows7OrLater();
+  // These are not in earlier SDKs.
+  const FINDEX_INFO_LEVELS kFindExInfoBasic =
+      static_cast<FINDEX_INFO_LEVELS>(1);
+  const DWORD kFindFirstExLargeFetch = 2;
+  FINDEX_INFO_LEVELS level =
+      is_windows7 ? kFindExInfoBasic : FindExInfoStandard;
+  DWORD flags = is_windows7 ? kFindFirstExLargeFetch : 0;
+  WIN32_FIND_DATAA ffd;
+  string pattern = (dir.empty() ? "." : dir) + "\\*";
+  HANDLE find_handle = FindFirstFileExA(pattern.c_str(), level, &ffd,
+                                        FindExSearchNameMatch, NULL, flags);
 
-  Cache::iterator ci = cache_.find(dir);
-  if (ci == cache_.end()) {
-    ci = cache_.insert(make_pair(dir, DirCache())).first;
-    if (!StatAllFilesInDir(dir.empty() ? "." : dir, &ci->second, err)) {
-      cache_.erase(ci);
-      return -1;
+  if (find_handle == INVALID_HANDLE_VALUE) {
+    DWORD win_err = GetLastError();
+    if (win_err == ERROR_FILE_NOT_FOUND || win_err == ERROR_PATH_NOT_FOUND)
+      return true;
+    *err = "FindFirstFileExA(" + dir + "): " + GetLastErrorString();
+    return false;
+  }
+  string key = dir.empty() ? "" : dir + "\\";
+  size_t prefix = key.size();
+  do {
+    if (strcmp(ffd.cFileName, "..") == 0) {
+      // Seems to just copy the timestamp for ".." from ".", which is wrong.
+      // This is the case at least on NTFS under Windows 7.
+      continue;
+    }
+    key.resize(prefix);
+    key += ffd.cFileName;
+    transform(key.begin() + prefix, key.end(), key.begin() + prefix,
+              ::tolower);
+    TimeStamp mtime = TimeStampFromFileTime(ffd.ftLastWriteTime);
+    StatCache::iterator i = stat_cache_.find(key);
+    if (i != stat_cache_.end())
+      i->second = mtime;
+    else
+      stat_cache_.insert(make_pair(KeepKey(key), mtime));
+  } while (FindNextFileA(find_handle, &ffd));
+  FindClose(find_handle);
+  return true;
+}
+#endif
+
+StringPiece RealDiskInterface::KeepKey(const string& key) const {
+  cache_keys_.push_back(key);
+  return cache_keys_.back();
+}
+
+#ifndef _WIN32
+TimeStamp RealDiskInterface::CachedStat(const string& path, const string& dir,
+                                        const string& key, string* err) const {
+  StatCache::iterator i = stat_cache_.find(key);
+  if (i == stat_cache_.end()) {
+    // Listing the directory once tells which of the files in it don't
+    // exist, without a stat() for each of them.
+    ListedDirs::iterator d = listed_dirs_.find(dir);
+    if (d == listed_dirs_.end()) {
+      METRIC_RECORD("node stat dir listing");
+      bool listed = ListDir(dir);
+      d = listed_dirs_.insert(make_pair(KeepKey(dir), listed)).first;
+      i = stat_cache_.find(key);
     }
+    if (i == stat_cache_.end() && d->second)
+      return 0;
   }
-  DirCache::iterator di = ci->second.find(base);
-  return di != ci->second.end() ? di->second : 0;
-#else
+  if (i != stat_cache_.end() && i->second != kUnknownMTime)
+    return i->second;
+
+  TimeStamp mtime = StatSingleFile(path, err);
+  if (mtime == -1)
+    return mtime;
+  if (i != stat_cache_.end())
+    i->second = mtime;
+  else
+    stat_cache_.insert(make_pair(KeepKey(key), mtime));
+  return mtime;
+}
+
+bool RealDiskInterface::ListDir(const string& dir) const {
+  DIR* d = opendir(dir.empty() ? "." : dir.c_str());
+  if (!d) {
+    // Nothing exists in a directory that doesn't.
+    return errno == ENOENT || errno == ENOTDIR;
+  }
+  string prefix = dir.empty() ? "" : dir == "/" ? "/" : dir + "/";
+  for (;;) {
+    errno = 0;
+    struct dirent* entry = readdir(d);
+    if (!entry)
+      break;
+    string key = prefix + entry->d_name;
+    if (stat_cache_.find(key) == stat_cache_.end())
+      stat_cache_.insert(make_pair(KeepKey(key), kUnknownMTime));
+  }
+  // Whatever was listed before an error is still known to exist, but not
+  // whether anything else does.
+  bool listed = errno == 0;
+  closedir(d);
+  return listed;
+}
+
+
+namespace {
+
+/// The mtime of |name| in the directory open as |dir_fd|, as
+/// StatSingleFile() would give it.
+TimeStamp StatAt(int dir_fd, const char* name, const string& path) {
+#if defined(__linux__) && defined(STATX_MTIME)
+  // Ask for nothing but the mtime, which saves filesystems that have to
+  // compute the rest some work.
+  struct statx stx;
+  int ret = statx(dir_fd, name, 0, STATX_MTIME, &stx);
+  if (ret == 0 && (stx.stx_mask & STATX_MTIME)) {
+    if (stx.stx_mtime.tv_sec == 0)
+      return 1;  // As MTimeOf() does.
+    return (int64_t)stx.stx_mtime.tv_sec * 1000000000LL +
+        stx.stx_mtime.tv_nsec;
+  }
+  if (ret < 0 && (errno == ENOENT || errno == ENOTDIR))
+    return 0;
+  // Kernels without statx() get a plain fstatat().
+#endif
   struct stat st;
-  if (stat(path.c_str(), &st) < 0) {
+  if (fstatat(dir_fd, name, &st, 0) < 0) {
     if (errno == ENOENT || errno == ENOTDIR)
       return 0;
-    *err = "stat(" + path + "): " + strerror(errno);
-    return -1;
+    // Errors are reported when the caller stat()s the path again.
+    string err;
+    return StatSingleFile(path, &err);
   }
-  // Some users (Flatpak) set mtime to 0, this should be harmless
-  // and avoids conflicting with our return value of 0 meaning
-  // that it doesn't exist.
-  if (st.st_mtime == 0)
-    return 1;
-#if defined(_AIX)
-  return (int64_t)st.st_mtime * 1000000000LL + st.st_mtime_n;
-#elif defined(__APPLE__)
-  return ((int64_t)st.st_mtimespec.tv_sec * 1000000000LL +
-          st.st_mtimespec.tv_nsec);
-#elif defined(st_mtime) // A macro, so we're likely on modern POSIX.
-  return (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+  return MTimeOf(st);
+}
+
+/// Paths of a StatMany() request in the same directory.
+struct StatGroup {
+  StatGroup(const string& dir) : dir(dir) {}
+  /// Empty for paths to stat() whole, from the current directory.
+  string dir;
+  /// Indices into the request's paths.
+  vector<size_t> indices;
+};
+
+/// stat()s the paths of a StatMany() request from worker threads, relative
+/// to their directory, so that the kernel walks the way to each directory
+/// once rather than once per file in it.
+struct StatTask : public ParallelTask {
+  StatTask(const vector<const string*>& paths, const vector<StatGroup>& groups,
+           vector<TimeStamp>* mtimes)
+      : paths_(paths), groups_(groups), mtimes_(mtimes) {}
+
+  virtual void Run(size_t index) {
+    const StatGroup& group = groups_[index];
+    int dir_fd = AT_FDCWD;
+    if (!group.dir.empty()) {
+#ifdef O_PATH
+      const int kFlags = O_PATH | O_DIRECTORY | O_CLOEXEC;
 #else
-  return (int64_t)st.st_mtime * 1000000000LL + st.st_mtimensec;
+      const int kFlags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
 #endif
+      dir_fd = open(group.dir.c_str(), kFlags);
+      if (dir_fd < 0) {
+        bool missing = errno == ENOENT || errno == ENOTDIR;
+        for (size_t i = 0; i < group.indices.size(); ++i) {
+          size_t path = group.indices[i];
+          string err;
+          (*mtimes_)[path] = missing ? 0 : StatSingleFile(*paths_[path], &err);
+        }
+        return;
+      }
+    }
+    for (size_t i = 0; i < group.indices.size(); ++i) {
+      const string& path = *paths_[group.indices[i]];
+      const char* name = path.c_str();
+      if (dir_fd != AT_FDCWD)
+        name += path.rfind('/') + 1;
+      (*mtimes_)[group.indices[i]] = StatAt(dir_fd, name, path);
+    }
+    if (dir_fd != AT_FDCWD)
+      close(dir_fd);
+  }
+
+  const vector<const string*>& paths_;
+  const vector<StatGroup>& groups_;
+  vector<TimeStamp>* mtimes_;
+};
+
+}  // namespace
+
+void RealDiskInterface::StatMany(const vector<const string*>& paths,
+                                 vector<TimeStamp>* mtimes) const {
+  METRIC_RECORD("node stat batch");
+  mtimes->resize(paths.size());
+  string dir, key;
+
+  // What the cache knows needn't be stat()ed again.
+  vector<const string*> uncached_paths;
+  vector<size_t> uncached;
+  if (use_cache_) {
+    ScopedLock lock(&cache_mutex_);
+    for (size_t i = 0; i < paths.size(); ++i) {
+      if (CacheKey(*paths[i], &dir, &key)) {
+        StatCache::iterator entry = stat_cache_.find(key);
+        if (entry != stat_cache_.end() && entry->second != kUnknownMTime) {
+          (*mtimes)[i] = entry->second;
+          continue;
+        }
+        if (entry == stat_cache_.end()) {
+          ListedDirs::iterator listed = listed_dirs_.find(dir);
+          if (listed != listed_dirs_.end() && listed->second) {
+            (*mtimes)[i] = 0;
+            continue;
+          }
+        }
+      }
+      uncached_paths.push_back(paths[i]);
+      uncached.push_back(i);
+    }
+    if (uncached_paths.empty())
+      return;
+  }
+  const vector<const string*>& todo = use_cache_ ? uncached_paths : paths;
+
+  // Group the paths by directory, in groups small enough to spread over
+  // threads.  Paths without a file name, like "dir/", go in groups of
+  // their own.
+  const size_t kMaxGroupSize = 64;
+  vector<StatGroup> groups;
+  map<string, size_t> open_groups;
+  for (size_t i = 0; i < todo.size(); ++i) {
+    const string& path = *todo[i];
+    if (!CacheKey(path, &dir, &key)) {
+      groups.push_back(StatGroup(""));
+      groups.back().indices.push_back(i);
+      continue;
+    }
+    map<string, size_t>::iterator group = open_groups.find(dir);
+    if (group == open_groups.end() ||
+        groups[group->second].indices.size() == kMaxGroupSize) {
+      groups.push_back(StatGroup(dir));
+      open_groups[dir] = groups.size() - 1;
+      group = open_groups.find(dir);
+    }
+    groups[group->second].indices.push_back(i);
+  }
+
+  // Spawning threads costs far more than a warm stat(), so only fan out
+  // when each thread has a decent amount of work to do.
+  const size_t kMinStatsPerThread = 256;
+  vector<TimeStamp> results(todo.size());
+  StatTask task(todo, groups, &results);
+  RunInParallel(&task, groups.size(),
+                ParallelismFor(todo.size(), kMinStatsPerThread));
+  if (!use_cache_) {
+    mtimes->swap(results);
+    return;
+  }
+
+  // Keep what was learned for later Stat()s of the same paths.
+  ScopedLock lock(&cache_mutex_);
+  for (size_t i = 0; i < todo.size(); ++i) {
+    TimeStamp mtime = results[i];
+    (*mtimes)[uncached[i]] = mtime;
+    if (mtime == -1 || !CacheKey(*todo[i], &dir, &key))
+      continue;
+    StatCache::iterator entry = stat_cache_.find(key);
+    if (entry != stat_cache_.end())
+      entry->second = mtime;
+    else
+      stat_cache_.insert(make_pair(KeepKey(key), mtime));
+  }
+}
+
+void RealDiskInterface::CachedDirs(set<string>* dirs) const {
+  ScopedLock lock(&cache_mutex_);
+  string dir, key;
+  for (StatCache::const_iterator i = stat_cache_.begin();
+       i != stat_cache_.end(); ++i) {
+    if (CacheKey(i->first.AsString(), &dir, &key))
+      dirs->insert(dir);
+  }
+  for (ListedDirs::const_iterator i = listed_dirs_.begin();
+       i != listed_dirs_.end(); ++i)
+    dirs->insert(i->first.AsString());
+}
+
+namespace {
+
+/// Whether the cache key |key| is |dir|, or in or below it.
+bool KeyUnder(StringPiece key, const string& dir) {
+  if (dir.empty())
+    return key.size() == 0 || key.str_[0] != '/';
+  if (key.size() < dir.size() || memcmp(key.str_, dir.data(), dir.size()))
+    return false;
+  return key.size() == dir.size() || dir == "/" || key.str_[dir.size()] == '/';
+}
+
+}  // namespace
+
+void RealDiskInterface::InvalidateDirs(const vector<string>& dirs) {
+  if (!use_cache_ || dirs.empty())
+    return;
+  ScopedLock lock(&cache_mutex_);
+  for (vector<string>::const_iterator d = dirs.begin(); d != dirs.end(); ++d) {
+    for (StatCache::iterator i = stat_cache_.begin(); i != stat_cache_.end();) {
+      if (KeyUnder(i->first, *d))
+        stat_cache_.erase(i++);
+      else
+        ++i;
+    }
+    for (ListedDirs::iterator i = listed_dirs_.begin();
+         i != listed_dirs_.end();) {
+      if (KeyUnder(i->first, *d))
+        listed_dirs_.erase(i++);
+      else
+        ++i;
+    }
+  }
+}
+#endif
+
+namespace {
+
+/// Whether the file at |path| holds exactly |contents|.
+bool HasContents(const string& path, const string& contents) {
+#ifndef _WIN32
+  // On Windows, text mode makes the sizes differ.
+  struct stat st;
+  if (stat(path.c_str(), &st) < 0 || st.st_size != (off_t)contents.size())
+    return false;
 #endif
+  FILE* fp = fopen(path.c_str(), "r");
+  if (!fp)
+    return false;
+  char buf[64 << 10];
+  size_t offset = 0;
+  bool same = true;
+  while (same) {
+    size_t len = fread(buf, 1, sizeof(buf), fp);
+    if (len == 0)
+      break;
+    same = offset + len <= contents.size() &&
+        memcmp(buf, contents.data() + offset, len) == 0;
+    offset += len;
+  }
+  same = same && !ferror(fp) && offset == contents.size();
+  fclose(fp);
+  return same;
 }
 
+}  // namespace
+
 bool RealDiskInterface::WriteFile(const string& path, const string& contents) {
+  // Rewriting a large rspfile that hasn't changed costs more than reading it.
+  if (HasContents(path, contents))
+    return true;
+
+  Invalidate(path);
   FILE* fp = fopen(path.c_str(), "w");
   if (fp == NULL) {
     Error("WriteFile(%s): Unable to create file. %s",
           path.c_str(), strerror(errno));
     return false;
   }
+  // The contents are all there already: hand them over in one write.
+  setvbuf(fp, NULL, _IONBF, 0);
 
   if (fwrite(contents.data(), 1, contents.length(), fp) < contents.length())  {
     Error("WriteFile(%s): Unable to write to the file. %s",
@@ -242,6 +644,7 @@ bool RealDiskInterface::WriteFile(const string& path, const string& contents) {
 }
 
 bool RealDiskInterface::MakeDir(const string& path) {
+  Invalidate(path);
   if (::MakeDir(path) < 0) {
     if (errno == EEXIST) {
       return true;
@@ -252,6 +655,19 @@ bool RealDiskInterface::MakeDir(const string& path) {
   return true;
 }
 
+#ifndef _WIN32
+bool RealDiskInterface::Identify(const string& path, FileIdentity* id) const {
+  struct stat st;
+  if (stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode))
+    return false;
+  id->device = st.st_dev;
+  id->inode = st.st_ino;
+  id->size = st.st_size;
+  id->mtime = MTimeOf(st);
+  return true;
+}
+#endif
+
 FileReader::Status RealDiskInterface::ReadFile(const string& path,
                                                string* contents,
                                                string* err) {
@@ -262,6 +678,12 @@ FileReader::Status RealDiskInterface::ReadFile(const string& path,
   }
 }
 
+FileReader::Status RealDiskInterface::ReadFileTerminated(const string& path,
+                                                         MappedFile* file,
+                                                         string* err) {
+  return file->OpenTerminated(path, err);
+}
+
 FileReader::Status RealDiskInterface::Chdir(const string& path, string* err) {
   switch (chdir(path.c_str())) {
     case 0:
@@ -296,6 +718,7 @@ FileReader::Status RealDiskInterface::Getcwd(string* path, string* err) {
 }
 
 int RealDiskInterface::RemoveFile(const string& path) {
+  Invalidate(path);
   if (remove(path.c_str()) < 0) {
     switch (errno) {
       case ENOENT:
@@ -309,10 +732,59 @@ int RealDiskInterface::RemoveFile(const string& path) {
   }
 }
 
-void RealDiskInterface::AllowStatCache(bool allow) {
+int RealDiskInterface::RemoveEmptyDir(const string& path) {
+  Invalidate(path);
 #ifdef _WIN32
-  use_cache_ = allow;
+  if (_rmdir(path.c_str()) < 0) {
+#else
+  if (rmdir(path.c_str()) < 0) {
+#endif
+    switch (errno) {
+      case ENOENT:
+      case ENOTDIR:
+      case ENOTEMPTY:
+      case EEXIST:
+        return 1;
+      default:
+        Error("rmdir(%s): %s", path.c_str(), strerror(errno));
+        return -1;
+    }
+  }
+  return 0;
+}
+
+void RealDiskInterface::Invalidate(const string& path) {
   if (!use_cache_)
-    cache_.clear();
+    return;
+#ifdef _WIN32
+  string dir = DirName(path);
+  string key = path.substr(dir.size() ? dir.size() + 1 : 0);
+  if (key.empty())
+    return;
+  FoldCase(&dir);
+  FoldCase(&key);
+  if (!dir.empty())
+    key = dir + "\\" + key;
+#else
+  string dir, key;
+  if (!CacheKey(path, &dir, &key))
+    return;
 #endif
+  ScopedLock lock(&cache_mutex_);
+  // Stat() it afresh next time, even if its directory was listed without
+  // it.  If it is a directory, list that afresh too.
+  StatCache::iterator entry = stat_cache_.find(key);
+  if (entry != stat_cache_.end())
+    entry->second = kUnknownMTime;
+  else if (listed_dirs_.find(dir) != listed_dirs_.end())
+    stat_cache_.insert(make_pair(KeepKey(key), kUnknownMTime));
+  listed_dirs_.erase(key);
+}
+
+void RealDiskInterface::AllowStatCache(bool allow) {
+  use_cache_ = allow;
+  ScopedLock lock(&cache_mutex_);
+  stat_cache_.clear();
+  listed_dirs_.clear();
+  cache_keys_.clear();
 }
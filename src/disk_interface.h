@@ -15,12 +15,36 @@
 #ifndef NINJA_DISK_INTERFACE_H_
 #define NINJA_DISK_INTERFACE_H_
 
+#include <deque>
 #include <map>
+#include <set>
 #include <string>
+#include <vector>
 using namespace std;
 
+#include "hash_map.h"
+#include "parallel.h"
 #include "timestamp.h"
 
+struct MappedFile;
+
+/// What tells versions of a file apart without reading it: as long as all
+/// of it stays the same, the contents are taken to be the same too.
+struct FileIdentity {
+  FileIdentity() : device(0), inode(0), size(0), mtime(0) {}
+
+  bool operator==(const FileIdentity& o) const {
+    return device == o.device && inode == o.inode && size == o.size &&
+        mtime == o.mtime;
+  }
+  bool operator!=(const FileIdentity& o) const { return !(*this == o); }
+
+  uint64_t device;
+  uint64_t inode;
+  uint64_t size;
+  TimeStamp mtime;
+};
+
 /// Interface for reading files from disk.  See DiskInterface for details.
 /// This base offers the minimum interface needed just to read files.
 struct FileReader {
@@ -38,6 +62,13 @@ struct FileReader {
   virtual Status ReadFile(const string& path, string* contents,
                           string* err) = 0;
 
+  /// Like ReadFile(), but make the contents readable through |file| with a
+  /// nul byte after them, as the Lexer needs.  By default the file is read
+  /// with ReadFile(); RealDiskInterface maps it instead, which saves both
+  /// copying it and keeping all of it in memory.
+  virtual Status ReadFileTerminated(const string& path, MappedFile* file,
+                                    string* err);
+
   // Change the current working directory.  On success, return Okay.
   // On error, return another Status and fill |err|.
   virtual Status Chdir(const string& path, string* err) = 0;
@@ -56,10 +87,18 @@ struct DiskInterface: public FileReader {
   /// other errors.
   virtual TimeStamp Stat(const string& path, string* err) const = 0;
 
+  /// stat() every file in |paths|, storing each result in the matching slot
+  /// of |mtimes| as Stat() would.  Implementations may stat concurrently.
+  /// Errors are not reported; the caller should Stat() any path that came
+  /// back as -1 to learn why.
+  virtual void StatMany(const vector<const string*>& paths,
+                        vector<TimeStamp>* mtimes) const;
+
   /// Create a directory, returning false on failure.
   virtual bool MakeDir(const string& path) = 0;
 
-  /// Create a file, with the specified name and contents
+  /// Create a file, with the specified name and contents.  A file that
+  /// already has them may be left alone.
   /// Returns true on success, false on failure
   virtual bool WriteFile(const string& path, const string& contents) = 0;
 
@@ -70,41 +109,105 @@ struct DiskInterface: public FileReader {
   ///          -1 if an error occurs.
   virtual int RemoveFile(const string& path) = 0;
 
+  /// Remove the directory @a path if it is empty.
+  /// @returns 0 if the directory has been removed,
+  ///          1 if it is not empty or does not exist, and
+  ///          -1 if an error occurs.
+  virtual int RemoveEmptyDir(const string& path) { return 1; }
+
   /// Create all the parent directories for path; like mkdir -p
   /// `basename path`.
   bool MakeDirs(const string& path);
+
+  /// Whether ReadFile(), WriteFile() and RemoveFile() may be called from
+  /// other threads while this one goes on using the interface.
+  virtual bool AllowsConcurrentAccess() const { return false; }
+
+  /// Forget whatever is cached about |path|, which something other than
+  /// this interface (a command, say) may have changed.
+  virtual void Invalidate(const string& path) {}
+
+  /// Fill |id| for the regular file |path|.  Returns false if the file is
+  /// missing or can't be identified, in which case telling whether it
+  /// changed means reading it.
+  virtual bool Identify(const string& path, FileIdentity* id) const {
+    return false;
+  }
 };
 
 /// Implementation of DiskInterface that actually hits the disk.
 struct RealDiskInterface : public DiskInterface {
-  RealDiskInterface()
-#ifdef _WIN32
-                      : use_cache_(false)
-#endif
-                      {}
+  RealDiskInterface() : use_cache_(false) {}
   virtual ~RealDiskInterface() {}
   virtual TimeStamp Stat(const string& path, string* err) const;
+#ifndef _WIN32
+  virtual void StatMany(const vector<const string*>& paths,
+                        vector<TimeStamp>* mtimes) const;
+#endif
   virtual bool MakeDir(const string& path);
   virtual bool WriteFile(const string& path, const string& contents);
   virtual Status ReadFile(const string& path, string* contents, string* err);
+  virtual Status ReadFileTerminated(const string& path, MappedFile* file,
+                                    string* err);
   virtual Status Chdir(const string& path, string* err);
   virtual Status Getcwd(string* path, string* err);
   virtual int RemoveFile(const string& path);
+  virtual int RemoveEmptyDir(const string& path);
+  virtual bool AllowsConcurrentAccess() const { return true; }
+  virtual void Invalidate(const string& path);
+#ifndef _WIN32
+  virtual bool Identify(const string& path, FileIdentity* id) const;
+#endif
 
-  /// Whether stat information can be cached.  Only has an effect on Windows.
+  /// Whether stat information can be cached.  Either way, whatever was
+  /// cached so far is dropped.
   void AllowStatCache(bool allow);
 
+#ifndef _WIN32
+  /// Add to |dirs| the directories that the cache knows something of, as
+  /// in "a/b", or "" for the current one.
+  void CachedDirs(set<string>* dirs) const;
+
+  /// Forget what the cache knows of |dirs|, the files in them and
+  /// everything below them.
+  void InvalidateDirs(const vector<string>& dirs);
+#endif
+
  private:
-#ifdef _WIN32
   /// Whether stat information can be cached.
   bool use_cache_;
 
-  typedef map<string, TimeStamp> DirCache;
-  // TODO: Neither a map nor a hashmap seems ideal here.  If the statcache
-  // works out, come up with a better data structure.
-  typedef map<string, DirCache> Cache;
-  mutable Cache cache_;
+#ifdef _WIN32
+  /// Add what |dir|, lowercased, holds to the cache, with the mtimes the
+  /// listing gives.  Returns false if it can't be read.
+  bool ListDir(const string& dir, string* err) const;
+#else
+  /// Stat() |path|, whose directory is |dir| and which is |key| in the cache,
+  /// with cache_mutex_ held.
+  TimeStamp CachedStat(const string& path, const string& dir,
+                       const string& key, string* err) const;
+
+  /// Add what |dir| holds to the cache, returning false if it can't be read.
+  bool ListDir(const string& dir) const;
 #endif
+
+  /// Return a copy of |key| that lives as long as the cache.
+  StringPiece KeepKey(const string& key) const;
+
+  /// The mtimes of the paths stat()ed, and kUnknownMTime for those found
+  /// in a directory listing but not stat()ed yet.  A path in a listed
+  /// directory that is not here doesn't exist.  On Windows, where the
+  /// listing gives the mtimes too, the paths are lowercased.
+  typedef ExternalStringHashMap<TimeStamp>::Type StatCache;
+  mutable StatCache stat_cache_;
+  /// The directories listed, and whether that worked.
+  typedef ExternalStringHashMap<bool>::Type ListedDirs;
+  mutable ListedDirs listed_dirs_;
+  /// Storage for the keys of the maps above.
+  mutable deque<string> cache_keys_;
+  /// Guards the cache against ReadFile(), WriteFile() and RemoveFile() from
+  /// other threads.
+  mutable Mutex cache_mutex_;
 };
 
 #endif  // NINJA_DISK_INTERFACE_H_
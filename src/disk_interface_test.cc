@@ -17,6 +17,8 @@
 #ifdef _WIN32
 #include <io.h>
 #include <windows.h>
+#else
+#include <sys/time.h>
 #endif
 
 #include "disk_interface.h"
@@ -163,6 +165,151 @@ TEST_F(DiskInterfaceTest, StatCache) {
   EXPECT_EQ("", err);
   EXPECT_EQ(0, disk_.Stat("nosuchdir/nosuchfile", &err));
   EXPECT_EQ("", err);
+
+  // Changes made through the interface are seen at once, however the
+  // paths are spelt.
+  ASSERT_TRUE(disk_.WriteFile("subdir/NEWFILE", ""));
+  EXPECT_GT(disk_.Stat("subdir\\newfile", &err), 1);
+  EXPECT_EQ(0, disk_.RemoveFile("SUBDIR/newfile"));
+  EXPECT_EQ(0, disk_.Stat("subdir/NewFile", &err));
+  EXPECT_EQ("", err);
+}
+#endif
+
+#ifndef _WIN32
+TEST_F(DiskInterfaceTest, StatCache) {
+  string err;
+  ASSERT_TRUE(Touch("file1"));
+  ASSERT_TRUE(disk_.MakeDir("subdir"));
+  ASSERT_TRUE(Touch("subdir/subfile1"));
+  disk_.AllowStatCache(true);
+
+  TimeStamp file1 = disk_.Stat("file1", &err);
+  EXPECT_GT(file1, 1);
+  EXPECT_GT(disk_.Stat("subdir//subfile1", &err), 1);
+  EXPECT_EQ(0, disk_.Stat("subdir/nosuchfile", &err));
+  EXPECT_EQ(0, disk_.Stat("nosuchdir/nosuchfile", &err));
+  EXPECT_EQ(disk_.Stat("subdir", &err), disk_.Stat("subdir/.", &err));
+  EXPECT_GT(disk_.Stat("/", &err), 1);
+  EXPECT_EQ("", err);
+
+  // Changes made behind the cache's back go unnoticed...
+  ASSERT_TRUE(Touch("subdir/subfile2"));
+  struct timeval times[2] = { { 1, 0 }, { 1, 0 } };
+  ASSERT_EQ(0, utimes("file1", times));
+  EXPECT_EQ(0, disk_.Stat("subdir/subfile2", &err));
+  EXPECT_EQ(file1, disk_.Stat("file1", &err));
+
+  // ...until the paths are invalidated.
+  disk_.Invalidate("subdir/subfile2");
+  disk_.Invalidate("file1");
+  EXPECT_GT(disk_.Stat("subdir/subfile2", &err), 1);
+  EXPECT_EQ(1000000000, disk_.Stat("file1", &err));
+
+  // Changes made through the interface are seen at once.
+  EXPECT_EQ(0, disk_.RemoveFile("subdir/subfile1"));
+  EXPECT_EQ(0, disk_.Stat("subdir/subfile1", &err));
+  ASSERT_TRUE(disk_.WriteFile("file2", ""));
+  EXPECT_GT(disk_.Stat("file2", &err), 1);
+  ASSERT_TRUE(disk_.MakeDir("nosuchdir"));
+  ASSERT_TRUE(disk_.WriteFile("nosuchdir/file", ""));
+  EXPECT_GT(disk_.Stat("nosuchdir/file", &err), 1);
+  EXPECT_EQ("", err);
+
+  // Disallowing the cache empties it.
+  ASSERT_TRUE(Touch("file3"));
+  disk_.AllowStatCache(false);
+  disk_.AllowStatCache(true);
+  EXPECT_GT(disk_.Stat("file3", &err), 1);
+}
+#endif
+
+#ifndef _WIN32
+TEST_F(DiskInterfaceTest, StatMany) {
+  ASSERT_TRUE(Touch("file"));
+  ASSERT_TRUE(disk_.MakeDir("subdir"));
+  ASSERT_TRUE(Touch("notadir"));
+  vector<string> names;
+  names.push_back("file");
+  names.push_back("nosuchfile");
+  names.push_back("subdir");
+  names.push_back("subdir/");
+  names.push_back("subdir/.");
+  names.push_back("subdir//nosuchfile");
+  names.push_back("nosuchdir/nosuchfile");
+  names.push_back("notadir/nosuchfile");
+  names.push_back("/");
+  // More files in one directory than one thread stats at a time.
+  for (int i = 0; i < 100; ++i) {
+    char name[32];
+    sprintf(name, "subdir/file%d", i);
+    if (i % 3)
+      ASSERT_TRUE(Touch(name));
+    names.push_back(name);
+  }
+  vector<const string*> paths;
+  for (size_t i = 0; i < names.size(); ++i)
+    paths.push_back(&names[i]);
+
+  vector<TimeStamp> mtimes;
+  disk_.StatMany(paths, &mtimes);
+  ASSERT_EQ(names.size(), mtimes.size());
+  string err;
+  for (size_t i = 0; i < names.size(); ++i)
+    EXPECT_EQ(disk_.Stat(names[i], &err), mtimes[i]);
+  EXPECT_EQ("", err);
+  EXPECT_GT(mtimes[0], 1);
+  EXPECT_EQ(0, mtimes[1]);
+  EXPECT_EQ(0, mtimes[9]);
+  EXPECT_GT(mtimes[10], 1);
+}
+
+TEST_F(DiskInterfaceTest, StatManyCached) {
+  ASSERT_TRUE(Touch("file"));
+  ASSERT_TRUE(disk_.MakeDir("subdir"));
+  ASSERT_TRUE(Touch("subdir/file"));
+  disk_.AllowStatCache(true);
+  string err;
+  TimeStamp file = disk_.Stat("file", &err);
+  EXPECT_EQ(0, disk_.Stat("subdir/nosuchfile", &err));
+
+  // What the cache knows is served from it, and the rest cached.
+  struct timeval times[2] = { { 1, 0 }, { 1, 0 } };
+  ASSERT_EQ(0, utimes("file", times));
+  ASSERT_TRUE(Touch("subdir/nosuchfile"));
+  vector<string> names;
+  names.push_back("file");
+  names.push_back("subdir/nosuchfile");
+  names.push_back("subdir/file");
+  vector<const string*> paths;
+  for (size_t i = 0; i < names.size(); ++i)
+    paths.push_back(&names[i]);
+  vector<TimeStamp> mtimes;
+  disk_.StatMany(paths, &mtimes);
+  ASSERT_EQ(3u, mtimes.size());
+  EXPECT_EQ(file, mtimes[0]);
+  EXPECT_EQ(0, mtimes[1]);
+  EXPECT_GT(mtimes[2], 1);
+  ASSERT_EQ(0, utimes("subdir/file", times));
+  EXPECT_EQ(mtimes[2], disk_.Stat("subdir/file", &err));
+
+  set<string> dirs;
+  disk_.CachedDirs(&dirs);
+  ASSERT_EQ(2u, dirs.size());
+  EXPECT_EQ("", *dirs.begin());
+  EXPECT_EQ("subdir", *dirs.rbegin());
+
+  // Invalidating a directory drops what is known of everything in it.
+  vector<string> lost;
+  lost.push_back("subdir");
+  disk_.InvalidateDirs(lost);
+  EXPECT_EQ(file, disk_.Stat("file", &err));
+  EXPECT_GT(disk_.Stat("subdir/nosuchfile", &err), 1);
+  EXPECT_EQ(1000000000, disk_.Stat("subdir/file", &err));
+  lost[0] = "";
+  disk_.InvalidateDirs(lost);
+  EXPECT_EQ(1000000000, disk_.Stat("file", &err));
+  EXPECT_EQ("", err);
 }
 #endif
 
@@ -188,6 +335,30 @@ TEST_F(DiskInterfaceTest, ReadFile) {
   EXPECT_EQ("", err);
 }
 
+#ifndef _WIN32
+TEST_F(DiskInterfaceTest, WriteFileUnchanged) {
+  string err;
+  ASSERT_TRUE(disk_.WriteFile("file", "contents\n"));
+  struct timeval times[2] = { { 1, 0 }, { 1, 0 } };
+  ASSERT_EQ(0, utimes("file", times));
+
+  // The same contents again leave the file alone...
+  ASSERT_TRUE(disk_.WriteFile("file", "contents\n"));
+  EXPECT_EQ(1000000000, disk_.Stat("file", &err));
+
+  // ...but anything else, of whatever size, replaces them.
+  ASSERT_TRUE(disk_.WriteFile("file", "contents!\n"));
+  EXPECT_GT(disk_.Stat("file", &err), 1000000000);
+  ASSERT_EQ(0, utimes("file", times));
+  ASSERT_TRUE(disk_.WriteFile("file", "Contents!\n"));
+  EXPECT_GT(disk_.Stat("file", &err), 1000000000);
+
+  string contents;
+  ASSERT_EQ(DiskInterface::Okay, disk_.ReadFile("file", &contents, &err));
+  EXPECT_EQ("Contents!\n", contents);
+}
+#endif
+
 TEST_F(DiskInterfaceTest, MakeDirs) {
   string path = "path/with/double//slash/";
   EXPECT_TRUE(disk_.MakeDirs(path.c_str()));
@@ -327,4 +498,37 @@ TEST_F(StatTest, Middle) {
   ASSERT_TRUE(GetNode("out")->dirty());
 }
 
+TEST_F(StatTest, Prefetch) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"build out: cat mid1 mid2\n"
+"build mid1: cat in1 in2\n"
+"build mid2: cat in2 in3\n"));
+
+  mtimes_["in1"] = 1;
+  mtimes_["in2"] = 1;
+  mtimes_["mid1"] = 2;
+  mtimes_["mid2"] = 2;
+  mtimes_["out"] = 3;
+
+  Node* out = GetNode("out");
+  scan_.PrefetchStats(out);
+  // Every node is stat()ed once, including in2 which is shared.
+  ASSERT_EQ(6u, stats_.size());
+  EXPECT_TRUE(GetNode("in1")->status_known());
+  EXPECT_TRUE(GetNode("in3")->dirty());
+
+  string err;
+  EXPECT_TRUE(scan_.RecomputeDirty(out, &err));
+  EXPECT_EQ("", err);
+  // RecomputeDirty() found everything already stat()ed.
+  ASSERT_EQ(6u, stats_.size());
+  EXPECT_FALSE(GetNode("mid1")->dirty());
+  EXPECT_TRUE(GetNode("mid2")->dirty());
+  EXPECT_TRUE(GetNode("out")->dirty());
+
+  // The finished subgraph is not walked again.
+  scan_.PrefetchStats(out);
+  ASSERT_EQ(6u, stats_.size());
+}
+
 }  // namespace
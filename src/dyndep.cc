@@ -17,6 +17,8 @@
 #include <assert.h>
 #include <stdio.h>
 
+#include <algorithm>
+
 #include "debug_flags.h"
 #include "disk_interface.h"
 #include "dyndep_parser.h"
@@ -24,6 +26,39 @@
 #include "state.h"
 #include "util.h"
 
+void DyndepFile::reserve(size_t count) {
+  entries_.reserve(count);
+  index_.reserve(count);
+}
+
+Dyndeps* DyndepFile::Add(Edge* edge) {
+  index_.push_back(make_pair(edge->id(), entries_.size()));
+  entries_.push_back(value_type(edge, Dyndeps()));
+  return &entries_.back().second;
+}
+
+bool DyndepFile::Index(size_t* duplicate) {
+  sort(index_.begin(), index_.end());
+  bool unique = true;
+  for (size_t i = 1; i < index_.size(); ++i) {
+    if (index_[i].first != index_[i - 1].first)
+      continue;
+    if (unique || index_[i].second < *duplicate)
+      *duplicate = index_[i].second;
+    unique = false;
+  }
+  return unique;
+}
+
+DyndepFile::iterator DyndepFile::find(const Edge* edge) {
+  std::vector<std::pair<int, size_t> >::const_iterator i =
+      lower_bound(index_.begin(), index_.end(),
+                  make_pair(edge->id(), (size_t)0));
+  if (i == index_.end() || i->first != edge->id())
+    return end();
+  return entries_.begin() + i->second;
+}
+
 bool DyndepLoader::LoadDyndeps(Node* node, std::string* err) const {
   DyndepFile ddf;
   return LoadDyndeps(node, &ddf, err);
@@ -39,6 +74,13 @@ bool DyndepLoader::LoadDyndeps(Node* node, DyndepFile* ddf,
   if (!LoadDyndepFile(node, ddf, err))
     return false;
 
+  return UpdateEdges(node, ddf, err);
+}
+
+bool DyndepLoader::UpdateEdges(Node* node, DyndepFile* ddf,
+                               std::string* err) const {
+  node->set_dyndep_pending(false);
+
   // Update each edge that specified this node as its dyndep binding.
   std::vector<Edge*> const& out_edges = node->out_edges();
   for (std::vector<Edge*>::const_iterator oe = out_edges.begin();
@@ -107,6 +149,7 @@ bool DyndepLoader::UpdateEdge(Edge* edge, Dyndeps const* dyndeps,
                        dyndeps->implicit_inputs_.begin(),
                        dyndeps->implicit_inputs_.end());
   edge->implicit_deps_ += dyndeps->implicit_inputs_.size();
+  edge->log_deps_ = 0;
 
   // Add this edge as outgoing from each new input.
   for (std::vector<Node*>::const_iterator i =
@@ -15,8 +15,10 @@
 #ifndef NINJA_DYNDEP_LOADER_H_
 #define NINJA_DYNDEP_LOADER_H_
 
-#include <map>
+#include <stddef.h>
+
 #include <string>
+#include <utility>
 #include <vector>
 
 struct DiskInterface;
@@ -33,11 +35,39 @@ struct Dyndeps {
   std::vector<Node*> implicit_outputs_;
 };
 
-/// Store data loaded from one dyndep file.  Map from an edge
-/// to its dynamically-discovered dependency information.
-/// This is a struct rather than a typedef so that we can
-/// forward-declare it in other headers.
-struct DyndepFile: public std::map<Edge*, Dyndeps> {};
+/// Store data loaded from one dyndep file: each edge it mentions, with
+/// its dynamically-discovered dependency information, in the order the
+/// file mentions them.  A build can load many dyndep files of many edges
+/// each, so rather than a map this is one vector, found in through a
+/// sorted index of edge ids.
+struct DyndepFile {
+  typedef std::pair<Edge*, Dyndeps> value_type;
+  typedef std::vector<value_type>::iterator iterator;
+  typedef std::vector<value_type>::const_iterator const_iterator;
+
+  /// Make room for |count| edges.
+  void reserve(size_t count);
+  /// Add |edge|, to be found once Index() has been called.  The result is
+  /// good until the next Add().
+  Dyndeps* Add(Edge* edge);
+  /// Index the edges that were added.  If one was added more than once,
+  /// return false, with |duplicate| the position of the first edge that
+  /// had been added before it.
+  bool Index(size_t* duplicate);
+
+  iterator find(const Edge* edge);
+  iterator begin() { return entries_.begin(); }
+  iterator end() { return entries_.end(); }
+  const_iterator begin() const { return entries_.begin(); }
+  const_iterator end() const { return entries_.end(); }
+  size_t size() const { return entries_.size(); }
+  bool empty() const { return entries_.empty(); }
+
+ private:
+  std::vector<value_type> entries_;
+  /// The id of each edge and its position in |entries_|, by id.
+  std::vector<std::pair<int, size_t> > index_;
+};
 
 /// DyndepLoader loads dynamically discovered dependencies, as
 /// referenced via the "dyndep" attribute in build files.
@@ -52,6 +82,10 @@ struct DyndepLoader {
   bool LoadDyndeps(Node* node, std::string* err) const;
   bool LoadDyndeps(Node* node, DyndepFile* ddf, std::string* err) const;
 
+  /// Update the build graph with |ddf|, the information already loaded
+  /// from the dyndep file at |node|'s path.
+  bool UpdateEdges(Node* node, DyndepFile* ddf, std::string* err) const;
+
  private:
   bool LoadDyndepFile(Node* file, DyndepFile* ddf, std::string* err) const;
 
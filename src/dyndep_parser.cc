@@ -25,11 +25,30 @@
 DyndepParser::DyndepParser(State* state, FileReader* file_reader,
                            DyndepFile* dyndep_file)
     : Parser(state, file_reader)
-    , dyndep_file_(dyndep_file) {
+    , dyndep_file_(dyndep_file)
+    , statements_(NULL) {
 }
 
-bool DyndepParser::Parse(const string& filename, const string& input,
+DyndepParser::DyndepParser(FileReader* file_reader,
+                           DyndepStatements* statements)
+    : Parser(NULL, file_reader)
+    , dyndep_file_(NULL)
+    , statements_(statements) {
+}
+
+bool DyndepParser::Parse(const string& filename, StringPiece input,
                          string* err) {
+  // With a State, parse into statements of our own and resolve them while
+  // |input| is still around for their lexers.
+  if (!statements_) {
+    DyndepStatements statements;
+    statements_ = &statements;
+    bool success = Parse(filename, input, err) &&
+        Resolve(state_, statements, dyndep_file_, err);
+    statements_ = NULL;
+    return success;
+  }
+
   lexer_.Start(filename, input);
 
   // Require a supported ninja_dyndep_version value immediately so
@@ -102,9 +121,10 @@ bool DyndepParser::ParseLet(string* key, EvalString* value, string* err) {
 }
 
 bool DyndepParser::ParseEdge(string* err) {
-  // Parse one explicit output.  We expect it to already have an edge.
-  // We will record its dynamically-discovered dependency information.
-  Dyndeps* dyndeps = NULL;
+  // Parse one explicit output.  We expect it to already have an edge,
+  // which Resolve() checks.
+  statements_->statements.push_back(DyndepStatements::Statement());
+  DyndepStatements::Statement* statement = &statements_->statements.back();
   {
     EvalString out0;
     if (!lexer_.ReadPath(&out0, err))
@@ -112,20 +132,12 @@ bool DyndepParser::ParseEdge(string* err) {
     if (out0.empty())
       return lexer_.Error("expected path", err);
 
-    string path = out0.Evaluate(&env_);
+    statement->lexer = lexer_;
+    statement->output = out0.Evaluate(&env_);
     string path_err;
     uint64_t slash_bits;
-    if (!CanonicalizePath(&path, &slash_bits, &path_err))
+    if (!CanonicalizePath(&statement->output, &slash_bits, &path_err))
       return lexer_.Error(path_err, err);
-    Node* node = state_->LookupNode(path);
-    if (!node || !node->in_edge())
-      return lexer_.Error("no build statement exists for '" + path + "'", err);
-    Edge* edge = node->in_edge();
-    std::pair<DyndepFile::iterator, bool> res =
-      dyndep_file_->insert(DyndepFile::value_type(edge, Dyndeps()));
-    if (!res.second)
-      return lexer_.Error("multiple statements for '" + path + "'", err);
-    dyndeps = &res.first->second;
   }
 
   // Disallow explicit outputs.
@@ -194,30 +206,74 @@ bool DyndepParser::ParseEdge(string* err) {
     if (key != "restat")
       return lexer_.Error("binding is not 'restat'", err);
     string value = val.Evaluate(&env_);
-    dyndeps->restat_ = !value.empty();
+    statement->restat = !value.empty();
   }
 
-  dyndeps->implicit_inputs_.reserve(ins.size());
+  statement->implicit_inputs.reserve(ins.size());
   for (vector<EvalString>::iterator i = ins.begin(); i != ins.end(); ++i) {
     string path = i->Evaluate(&env_);
     string path_err;
     uint64_t slash_bits;
     if (!CanonicalizePath(&path, &slash_bits, &path_err))
       return lexer_.Error(path_err, err);
-    Node* n = state_->GetNode(path, &env_, slash_bits);
-    dyndeps->implicit_inputs_.push_back(n);
+    statement->implicit_inputs.push_back(make_pair(path, slash_bits));
   }
 
-  dyndeps->implicit_outputs_.reserve(outs.size());
+  statement->implicit_outputs.reserve(outs.size());
   for (vector<EvalString>::iterator i = outs.begin(); i != outs.end(); ++i) {
     string path = i->Evaluate(&env_);
     string path_err;
     uint64_t slash_bits;
     if (!CanonicalizePath(&path, &slash_bits, &path_err))
       return lexer_.Error(path_err, err);
-    Node* n = state_->GetNode(path, &env_, slash_bits);
-    dyndeps->implicit_outputs_.push_back(n);
+    statement->implicit_outputs.push_back(make_pair(path, slash_bits));
   }
 
   return true;
 }
+
+bool DyndepParser::Resolve(State* state, const DyndepStatements& statements,
+                           DyndepFile* dyndep_file, string* err) {
+  // Duplicates are only found once the edges are indexed, after the loop.
+  // The first error in the file wins: a statement without a build
+  // statement ends the loop, and a duplicate before it comes first.
+  dyndep_file->reserve(statements.statements.size());
+  vector<DyndepStatements::Statement>::const_iterator s;
+  for (s = statements.statements.begin(); s != statements.statements.end();
+       ++s) {
+    Node* node = state->LookupNode(s->output);
+    if (!node || !node->in_edge())
+      break;
+    Dyndeps* dyndeps = dyndep_file->Add(node->in_edge());
+    dyndeps->restat_ = s->restat;
+
+    dyndeps->implicit_inputs_.reserve(s->implicit_inputs.size());
+    for (vector<pair<string, uint64_t> >::const_iterator i =
+             s->implicit_inputs.begin();
+         i != s->implicit_inputs.end(); ++i) {
+      dyndeps->implicit_inputs_.push_back(
+          state->GetNode(i->first, &state->bindings_, i->second));
+    }
+
+    dyndeps->implicit_outputs_.reserve(s->implicit_outputs.size());
+    for (vector<pair<string, uint64_t> >::const_iterator i =
+             s->implicit_outputs.begin();
+         i != s->implicit_outputs.end(); ++i) {
+      dyndeps->implicit_outputs_.push_back(
+          state->GetNode(i->first, &state->bindings_, i->second));
+    }
+  }
+
+  size_t duplicate;
+  if (!dyndep_file->Index(&duplicate)) {
+    const DyndepStatements::Statement& dup = statements.statements[duplicate];
+    Lexer lexer = dup.lexer;
+    return lexer.Error("multiple statements for '" + dup.output + "'", err);
+  }
+  if (s != statements.statements.end()) {
+    Lexer lexer = s->lexer;
+    return lexer.Error("no build statement exists for '" + s->output + "'",
+                       err);
+  }
+  return true;
+}
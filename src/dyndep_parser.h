@@ -18,28 +18,59 @@
 #include "eval_env.h"
 #include "parser.h"
 
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
 struct DyndepFile;
 struct EvalString;
 
+/// The statements of a dyndep file, with their paths canonicalized but not
+/// yet looked up in the graph, so that they may be parsed on another thread.
+struct DyndepStatements {
+  struct Statement {
+    Statement() : restat(false) {}
+
+    /// Positioned at |output|, to point at it when it is in error.  Its
+    /// filename and input must outlive the Statement.
+    Lexer lexer;
+    string output;
+    bool restat;
+    vector<pair<string, uint64_t> > implicit_inputs;
+    vector<pair<string, uint64_t> > implicit_outputs;
+  };
+  vector<Statement> statements;
+};
+
 /// Parses dyndep files.
 struct DyndepParser: public Parser {
   DyndepParser(State* state, FileReader* file_reader,
                DyndepFile* dyndep_file);
 
+  /// Parse into |statements| without looking at any State.
+  DyndepParser(FileReader* file_reader, DyndepStatements* statements);
+
   /// Parse a text string of input.  Used by tests.
   bool ParseTest(const string& input, string* err) {
     return Parse("input", input, err);
   }
 
+  /// Look up the edges and nodes |statements| refers to, creating the
+  /// nodes that don't exist yet, and store them in |dyndep_file|.
+  static bool Resolve(State* state, const DyndepStatements& statements,
+                      DyndepFile* dyndep_file, string* err);
+
 private:
-  /// Parse a file, given its contents as a string.
-  bool Parse(const string& filename, const string& input, string* err);
+  /// Parse a file, given its contents, which a nul byte must follow.
+  bool Parse(const string& filename, StringPiece input, string* err);
 
   bool ParseDyndepVersion(string* err);
   bool ParseLet(string* key, EvalString* val, string* err);
   bool ParseEdge(string* err);
 
   DyndepFile* dyndep_file_;
+  DyndepStatements* statements_;
   BindingEnv env_;
 };
 
@@ -510,3 +510,78 @@ TEST_F(DyndepParserTest, MultipleEdges) {
     EXPECT_EQ(0u, i->second.implicit_inputs_.size());
   }
 }
+
+TEST_F(DyndepParserTest, EdgesOutOfOrder) {
+    ::AssertParse(&state_,
+"build out2: touch\n"
+"build out3: touch\n");
+
+  ASSERT_NO_FATAL_FAILURE(AssertParse(
+"ninja_dyndep_version = 1\n"
+"build out3: dyndep | in3\n"
+"build out: dyndep | in\n"
+"build out2: dyndep | in2\n"));
+
+  ASSERT_EQ(3u, dyndep_file_.size());
+  // In the order of the file, and found by edge.
+  EXPECT_EQ(state_.edges_[2], dyndep_file_.begin()->first);
+  for (int e = 0; e < 3; ++e) {
+    DyndepFile::iterator i = dyndep_file_.find(state_.edges_[e]);
+    ASSERT_NE(i, dyndep_file_.end());
+    EXPECT_EQ(state_.edges_[e], i->first);
+    ASSERT_EQ(1u, i->second.implicit_inputs_.size());
+    EXPECT_EQ("in" + state_.edges_[e]->outputs_[0]->path().substr(3),
+              i->second.implicit_inputs_[0]->path());
+  }
+}
+
+TEST_F(DyndepParserTest, OutDuplicateAmongOthers) {
+    ::AssertParse(&state_,
+"build out2: touch\n");
+  const char kInput[] =
+"ninja_dyndep_version = 1\n"
+"build out2: dyndep\n"
+"build out: dyndep\n"
+"build out2: dyndep\n"
+"build otherout: dyndep\n";
+  DyndepParser parser(&state_, &fs_, &dyndep_file_);
+  string err;
+  EXPECT_FALSE(parser.ParseTest(kInput, &err));
+  EXPECT_EQ("input:4: multiple statements for 'out2'\n"
+            "build out2: dyndep\n"
+            "          ^ near here", err);
+}
+
+TEST_F(DyndepParserTest, FirstErrorWins) {
+  // A duplicate before a statement without a build statement...
+  {
+    const char kInput[] =
+"ninja_dyndep_version = 1\n"
+"build out: dyndep\n"
+"build out: dyndep\n"
+"build missing: dyndep\n";
+    DyndepFile dyndep_file;
+    DyndepParser parser(&state_, &fs_, &dyndep_file);
+    string err;
+    EXPECT_FALSE(parser.ParseTest(kInput, &err));
+    EXPECT_EQ("input:3: multiple statements for 'out'\n"
+              "build out: dyndep\n"
+              "         ^ near here", err);
+  }
+
+  // ...and after it.
+  {
+    const char kInput[] =
+"ninja_dyndep_version = 1\n"
+"build out: dyndep\n"
+"build missing: dyndep\n"
+"build out: dyndep\n";
+    DyndepFile dyndep_file;
+    DyndepParser parser(&state_, &fs_, &dyndep_file);
+    string err;
+    EXPECT_FALSE(parser.ParseTest(kInput, &err));
+    EXPECT_EQ("input:3: no build statement exists for 'missing'\n"
+              "build missing: dyndep\n"
+              "             ^ near here", err);
+  }
+}
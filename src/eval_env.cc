@@ -14,19 +14,86 @@
 
 #include <assert.h>
 
+#include <algorithm>
+#include <set>
+
 #include "eval_env.h"
+#include "parallel.h"
+
+/// The strings of a tree of BindingEnvs, each stored once.  The manifest
+/// parser may add to it from several threads.
+struct StringInterner {
+  const string* Intern(const string& s) {
+    ScopedLock lock(&mutex_);
+    return &*strings_.insert(s).first;
+  }
+
+ private:
+  Mutex mutex_;
+  set<string> strings_;
+};
+
+namespace {
+
+struct KeyLess {
+  bool operator()(const pair<const string*, const string*>& binding,
+                  const string& key) const {
+    return *binding.first < key;
+  }
+};
+
+}  // anonymous namespace
+
+BindingEnv::BindingEnv()
+    : RelPathEnv("", ""), parent_(NULL), source_(NULL),
+      interner_(new StringInterner) {}
+
+BindingEnv::BindingEnv(BindingEnv* parent)
+    : RelPathEnv("", parent->AsString()), parent_(parent), source_(NULL),
+      interner_(parent->interner_) {}
+
+BindingEnv::BindingEnv(BindingEnv* parent, const string& rel_path,
+                       const string& abs_path)
+    : RelPathEnv(rel_path, abs_path), parent_(parent), source_(NULL),
+      interner_(parent ? parent->interner_ : new StringInterner) {}
+
+BindingEnv::~BindingEnv() {
+  delete source_;
+  if (!parent_)
+    delete interner_;
+}
+
+const string* BindingEnv::FindBinding(const string& var) const {
+  Bindings::const_iterator i =
+      lower_bound(bindings_.begin(), bindings_.end(), var, KeyLess());
+  if (i == bindings_.end() || *i->first != var)
+    return NULL;
+  return i->second;
+}
 
 string BindingEnv::LookupVariable(const string& var) {
-  map<string, string>::iterator i = bindings_.find(var);
-  if (i != bindings_.end())
-    return i->second;
+  if (const string* value = FindBinding(var))
+    return *value;
   if (parent_ && !HasRelPath())
     return parent_->LookupVariable(var);
   return "";
 }
 
+void BindingEnv::AppendVariable(const string& var, string* result) {
+  if (const string* value = FindBinding(var))
+    result->append(*value);
+  else if (parent_ && !HasRelPath())
+    parent_->AppendVariable(var, result);
+}
+
 void BindingEnv::AddBinding(const string& key, const string& val) {
-  bindings_[key] = val;
+  const string* value = interner_->Intern(val);
+  Bindings::iterator i =
+      lower_bound(bindings_.begin(), bindings_.end(), key, KeyLess());
+  if (i != bindings_.end() && *i->first == key)
+    i->second = value;
+  else
+    bindings_.insert(i, make_pair(interner_->Intern(key), value));
 }
 
 void BindingEnv::AddRule(const Rule* rule) {
@@ -50,8 +117,38 @@ const Rule* BindingEnv::LookupRule(const string& rule_name) {
   return NULL;
 }
 
+RuleTemplate::RuleTemplate(const EvalString& value) : text_size_(0) {
+  for (size_t i = 0; i < value.size(); ++i) {
+    const EvalString::Token& token = value.token(i);
+    if (token.type == EvalString::RAW) {
+      text_size_ += token.text.len_;
+      // Text split by escapes makes a single segment.
+      if (!segments_.empty() && segments_.back().kind == kText) {
+        segments_.back().text.append(token.text.str_, token.text.len_);
+        continue;
+      }
+    }
+    Segment segment;
+    segment.text = token.text.AsString();
+    if (token.type == EvalString::RAW)
+      segment.kind = kText;
+    else if (segment.text == "in")
+      segment.kind = kIn;
+    else if (segment.text == "in_newline")
+      segment.kind = kInNewline;
+    else if (segment.text == "out")
+      segment.kind = kOut;
+    else
+      segment.kind = kVariable;
+    segments_.push_back(segment);
+  }
+}
+
 void Rule::AddBinding(const string& key, const EvalString& val) {
-  bindings_[key] = val;
+  EvalString& binding = bindings_[key];
+  binding = val;
+  binding.Persist();
+  templates_[key] = RuleTemplate(binding);
 }
 
 const EvalString* Rule::GetBinding(const string& key) const {
@@ -61,6 +158,13 @@ const EvalString* Rule::GetBinding(const string& key) const {
   return &i->second;
 }
 
+const RuleTemplate* Rule::GetTemplate(const string& key) const {
+  map<string, RuleTemplate>::const_iterator i = templates_.find(key);
+  if (i == templates_.end())
+    return NULL;
+  return &i->second;
+}
+
 // static
 bool Rule::IsReservedBinding(const string& var) {
   return var == "command" ||
@@ -69,10 +173,12 @@ bool Rule::IsReservedBinding(const string& var) {
       var == "description" ||
       var == "deps" ||
       var == "generator" ||
+      var == "hash_inputs" ||
       var == "pool" ||
       var == "restat" ||
       var == "rspfile" ||
       var == "rspfile_content" ||
+      var == "weight" ||
       var == "msvc_deps_prefix";
 }
 
@@ -83,50 +189,136 @@ const map<string, const Rule*>& BindingEnv::GetRules() const {
 string BindingEnv::LookupWithFallback(const string& var,
                                       const EvalString* eval,
                                       Env* env) {
-  map<string, string>::iterator i = bindings_.find(var);
-  if (i != bindings_.end())
-    return i->second;
+  string result;
+  AppendWithFallback(var, eval, env, &result);
+  return result;
+}
+
+void BindingEnv::AppendWithFallback(const string& var,
+                                    const EvalString* eval,
+                                    Env* env, string* result) {
+  if (AppendOwnBinding(var, result))
+    return;
 
-  if (eval)
-    return eval->Evaluate(env);
+  if (eval) {
+    eval->EvaluateInto(env, result);
+    return;
+  }
 
   if (parent_ && !HasRelPath())
-    return parent_->LookupVariable(var);
+    parent_->AppendVariable(var, result);
+}
 
-  return "";
+bool BindingEnv::AppendOwnBinding(const string& var, string* result) {
+  const string* value = FindBinding(var);
+  if (!value)
+    return false;
+  result->append(*value);
+  return true;
+}
+
+EvalString::EvalString(const EvalString& other) : size_(0) {
+  *this = other;
+}
+
+EvalString& EvalString::operator=(const EvalString& other) {
+  if (this == &other)
+    return *this;
+  first_ = other.first_;
+  size_ = other.size_;
+  rest_ = other.rest_;
+  storage_ = other.storage_;
+  if (storage_.empty())
+    return *this;
+  // Point the copied tokens into our own storage.
+  const char* begin = other.storage_.data();
+  const char* end = begin + other.storage_.size();
+  for (size_t i = 0; i < size_; ++i) {
+    Token& t = i == 0 ? first_ : rest_[i - 1];
+    if (t.text.str_ >= begin && t.text.str_ < end)
+      t.text.str_ = storage_.data() + (t.text.str_ - begin);
+  }
+  return *this;
 }
 
 string EvalString::Evaluate(Env* env) const {
+  // Literal text needs no evaluation, nor a second copy.
+  if (size_ == 1 && first_.type == RAW)
+    return first_.text.AsString();
   string result;
-  for (TokenList::const_iterator i = parsed_.begin(); i != parsed_.end(); ++i) {
-    if (i->second == RAW)
-      result.append(i->first);
+  EvaluateInto(env, &result);
+  return result;
+}
+
+void EvalString::EvaluateInto(Env* env, string* result) const {
+  for (size_t i = 0; i < size_; ++i) {
+    const Token& t = token(i);
+    if (t.type == RAW)
+      result->append(t.text.str_, t.text.len_);
     else
-      result.append(env->LookupVariable(i->first));
+      env->AppendVariable(t.text.AsString(), result);
   }
-  return result;
+}
+
+void EvalString::AddToken(StringPiece text, TokenType type) {
+  Token t;
+  t.text = text;
+  t.type = type;
+  if (size_ == 0)
+    first_ = t;
+  else
+    rest_.push_back(t);
+  ++size_;
 }
 
 void EvalString::AddText(StringPiece text) {
-  // Add it to the end of an existing RAW token if possible.
-  if (!parsed_.empty() && parsed_.back().second == RAW) {
-    parsed_.back().first.append(text.str_, text.len_);
-  } else {
-    parsed_.push_back(make_pair(text.AsString(), RAW));
+  // Extend the last token if it is RAW text that |text| directly follows,
+  // as it does in a path without escapes.
+  if (size_ > 0) {
+    Token& last = size_ == 1 ? first_ : rest_.back();
+    if (last.type == RAW && last.text.str_ + last.text.len_ == text.str_) {
+      last.text.len_ += text.len_;
+      return;
+    }
   }
+  AddToken(text, RAW);
 }
+
 void EvalString::AddSpecial(StringPiece text) {
-  parsed_.push_back(make_pair(text.AsString(), SPECIAL));
+  AddToken(text, SPECIAL);
+}
+
+void EvalString::Persist() {
+  size_t length = 0;
+  for (size_t i = 0; i < size_; ++i)
+    length += token(i).text.len_;
+  string storage;
+  storage.reserve(length);
+  for (size_t i = 0; i < size_; ++i)
+    storage.append(token(i).text.str_, token(i).text.len_);
+  storage_.swap(storage);
+  // |storage_| doesn't reallocate, since it was reserved and swapped.
+  const char* p = storage_.data();
+  for (size_t i = 0; i < size_; ++i) {
+    Token& t = i == 0 ? first_ : rest_[i - 1];
+    t.text.str_ = p;
+    p += t.text.len_;
+  }
 }
 
 string EvalString::Serialize() const {
   string result;
-  for (TokenList::const_iterator i = parsed_.begin();
-       i != parsed_.end(); ++i) {
-    result.append("[");
-    if (i->second == SPECIAL)
+  for (size_t i = 0; i < size_; ++i) {
+    const Token& t = token(i);
+    // Text split by escapes still reads as one token.
+    bool joined = t.type == RAW && i > 0 && token(i - 1).type == RAW;
+    if (joined)
+      result.resize(result.size() - 1);
+    else
+      result.append("[");
+    if (t.type == SPECIAL)
       result.append("$");
-    result.append(i->first);
+    result.append(t.text.str_, t.text.len_);
     result.append("]");
   }
   return result;
@@ -134,12 +326,12 @@ string EvalString::Serialize() const {
 
 string EvalString::Unparse() const {
   string result;
-  for (TokenList::const_iterator i = parsed_.begin();
-       i != parsed_.end(); ++i) {
-    bool special = (i->second == SPECIAL);
+  for (size_t i = 0; i < size_; ++i) {
+    const Token& t = token(i);
+    bool special = (t.type == SPECIAL);
     if (special)
       result.append("${");
-    result.append(i->first);
+    result.append(t.text.str_, t.text.len_);
     if (special)
       result.append("}");
   }
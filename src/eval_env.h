@@ -23,37 +23,99 @@ using namespace std;
 #include "string_piece.h"
 
 struct Rule;
+struct StringInterner;
 
 /// An interface for a scope for variable (e.g. "$foo") lookups.
 struct Env {
   virtual ~Env() {}
   virtual string LookupVariable(const string& var) = 0;
+
+  /// Append the value of |var| to |result|.  Scopes that can produce the
+  /// value in place override this to save building a temporary string.
+  virtual void AppendVariable(const string& var, string* result) {
+    result->append(LookupVariable(var));
+  }
 };
 
 /// A tokenized string that contains variable references.
 /// Can be evaluated relative to an Env.
+///
+/// The tokens point into the text they were parsed from, usually the
+/// manifest, so that parsing a path doesn't copy it.  An EvalString that
+/// outlives that text, like a rule's binding, must be Persist()ed.
 struct EvalString {
+  EvalString() : size_(0) {}
+  EvalString(const EvalString& other);
+  EvalString& operator=(const EvalString& other);
+
   /// @return The evaluated string with variable expanded using value found in
   ///         environment @a env.
   string Evaluate(Env* env) const;
+  /// Like Evaluate(), but appending the result to |result|.
+  void EvaluateInto(Env* env, string* result) const;
 
   /// @return The string with variables not expanded.
   string Unparse() const;
 
-  void Clear() { parsed_.clear(); }
-  bool empty() const { return parsed_.empty(); }
+  void Clear() { size_ = 0; rest_.clear(); storage_.clear(); }
+  bool empty() const { return size_ == 0; }
 
+  /// Append |text|, which must outlive the EvalString or its Persist().
   void AddText(StringPiece text);
+  /// Append a reference to the variable |text|, under the same condition.
   void AddSpecial(StringPiece text);
 
+  /// Copy the text of the tokens into the EvalString itself.
+  void Persist();
+
   /// Construct a human-readable representation of the parsed state,
   /// for use in tests.
   string Serialize() const;
 
 private:
+  friend struct ManifestCache;
+  friend struct RuleTemplate;
+
   enum TokenType { RAW, SPECIAL };
-  typedef vector<pair<string, TokenType> > TokenList;
-  TokenList parsed_;
+  struct Token {
+    StringPiece text;
+    TokenType type;
+  };
+
+  size_t size() const { return size_; }
+  const Token& token(size_t i) const { return i == 0 ? first_ : rest_[i - 1]; }
+  void AddToken(StringPiece text, TokenType type);
+
+  /// The first token, inline: most strings are a single piece of text.
+  Token first_;
+  size_t size_;
+  vector<Token> rest_;
+  /// What the tokens point into once Persist()ed.
+  string storage_;
+};
+
+/// A rule's binding compiled for evaluating it against edges: its literal
+/// text, with the escapes already applied, and slots for the variables it
+/// refers to.  $in, $in_newline and $out get slots of their own so that an
+/// edge can write its paths in without looking them up by name.
+struct RuleTemplate {
+  enum SlotKind { kText, kVariable, kIn, kInNewline, kOut };
+  struct Segment {
+    SlotKind kind;
+    /// The literal text, or the name of the variable.
+    string text;
+  };
+
+  RuleTemplate() : text_size_(0) {}
+  explicit RuleTemplate(const EvalString& value);
+
+  const vector<Segment>& segments() const { return segments_; }
+  /// The total size of the literal text.
+  size_t text_size() const { return text_size_; }
+
+ private:
+  vector<Segment> segments_;
+  size_t text_size_;
 };
 
 /// An invokable build command and associated metadata (description, etc.).
@@ -67,14 +129,18 @@ struct Rule {
   static bool IsReservedBinding(const string& var);
 
   const EvalString* GetBinding(const string& key) const;
+  /// The compiled form of GetBinding(|key|), or NULL if there's no binding.
+  const RuleTemplate* GetTemplate(const string& key) const;
 
  private:
   // Allow the parsers to reach into this object and fill out its fields.
   friend struct ManifestParser;
+  friend struct ManifestCache;
 
   string name_;
   typedef map<string, EvalString> Bindings;
   Bindings bindings_;
+  map<string, RuleTemplate> templates_;
 };
 
 struct RelPathEnv : public Env {
@@ -85,9 +151,19 @@ struct RelPathEnv : public Env {
   const string& AsString() const { return abs_path_; }
   bool equals(RelPathEnv* other) { return other->abs_path_ == abs_path_; }
   bool HasRelPath() const { return !rel_path_.empty(); }
-  string ApplyChdir(string s) const {
-    if (s.size() > 0 && s[0] == '/') {
+  string ApplyChdir(const string& s) const {
+    if (abs_path_.empty())
       return s;
+    string out;
+    AppendChdir(s, &out);
+    return out;
+  }
+  /// Append ApplyChdir(|s|) to |out|, which allocates nothing once |out|,
+  /// kept across calls, has grown enough.
+  void AppendChdir(StringPiece s, string* out) const {
+    if (s.len_ > 0 && s.str_[0] == '/') {
+      out->append(s.str_, s.len_);
+      return;
     }
     // Optimization: only simplify ./ and ../ on boundary between a and s.
     // To process all ./ and ../, wrap the following code in a loop. At the end
@@ -98,44 +174,69 @@ struct RelPathEnv : public Env {
     // simplified in this way. It only "works" when the dir before ../ in the
     // relative path is a physical directory entry (so, no symlinks, FS joins,
     // or other filesystem features).
-    string a = AsString();
-    while (!a.empty() && s.size() > 3 &&
-        s[0] == '.') {
-      if (s[1] == '/') {
-        s.erase(0, 2);  // Remove "./" from s.
-      } else if (s[1] == '.' && s[2] == '/') {
-        string::size_type i = a.rfind('/', a.size() - 2);
-        if (i == string::npos) {
-          a.clear();
-        } else {
-          i++;
-          a.erase(i, a.size() - i);  // Remove "../" from s and one dir from a.
-        }
-        s.erase(0, 3);
+    size_t a_len = abs_path_.size();
+    while (a_len > 0 && s.len_ > 3 && s.str_[0] == '.') {
+      if (s.str_[1] == '/') {
+        // Remove "./" from s.
+        s.str_ += 2;
+        s.len_ -= 2;
+      } else if (s.str_[1] == '.' && s.str_[2] == '/') {
+        // Remove "../" from s and one dir from a.
+        string::size_type i =
+            a_len < 2 ? string::npos : abs_path_.rfind('/', a_len - 2);
+        a_len = i == string::npos ? 0 : i + 1;
+        s.str_ += 3;
+        s.len_ -= 3;
+      } else {
+        break;
       }
     }
-    return a + s;
+    out->append(abs_path_, 0, a_len);
+    out->append(s.str_, s.len_);
   }
 
 private:
+  friend struct ManifestCache;
+
   // rel_path_ is relative to the parent BindingEnv.
   string rel_path_;
   // abs_path_ is still relative to the root ninja invocation.
   string abs_path_;
 };
 
+/// Where the statements of the scope of a manifest file came from, which
+/// the manifest cache needs to load one subninja again on its own.
+struct ManifestSource {
+  ManifestSource()
+      : declares_globals(false), has_subninjas(false), rebound(false) {}
+
+  /// The files read into the scope: the subninja's own, then the files it
+  /// includes, as named to be read from the scope's directory.
+  vector<string> files;
+  /// Whether a 'pool' or 'default' line added to the State.
+  bool declares_globals;
+  /// Whether a 'subninja' line was read.
+  bool has_subninjas;
+  /// Whether a variable or rule was added after a 'subninja' line, which
+  /// then saw a scope different from the final one.
+  bool rebound;
+};
+
 /// An Env which contains a mapping of variables to values
 /// as well as a pointer to a parent scope.
+///
+/// The keys and values are interned in a set shared by the whole tree of
+/// scopes and owned by its root, since generators tend to repeat the same
+/// blocks of variables on many build statements.
 struct BindingEnv : public RelPathEnv {
-  BindingEnv() : RelPathEnv("", ""), parent_(NULL) {}
-  explicit BindingEnv(BindingEnv* parent)
-    : RelPathEnv("", parent->AsString()), parent_(parent) {}
+  BindingEnv();
+  explicit BindingEnv(BindingEnv* parent);
   explicit BindingEnv(BindingEnv* parent, const string& rel_path,
-                      const string& abs_path)
-    : RelPathEnv(rel_path, abs_path), parent_(parent) {}
+                      const string& abs_path);
 
-  virtual ~BindingEnv() {}
+  virtual ~BindingEnv();
   virtual string LookupVariable(const string& var);
+  virtual void AppendVariable(const string& var, string* result);
 
   void AddRule(const Rule* rule);
   const Rule* LookupRule(const string& rule_name);
@@ -144,6 +245,20 @@ struct BindingEnv : public RelPathEnv {
 
   void AddBinding(const string& key, const string& val);
 
+  /// The bindings set on this scope itself, as interned (key, value)
+  /// pairs sorted by key.
+  typedef vector<pair<const string*, const string*> > Bindings;
+  const Bindings& bindings() const { return bindings_; }
+
+  /// The source of the scope of a manifest file, created on first use.
+  /// NULL for the scopes of build statements.
+  ManifestSource* source() {
+    if (!source_)
+      source_ = new ManifestSource;
+    return source_;
+  }
+  const ManifestSource* source() const { return source_; }
+
   /// This is tricky.  Edges want lookup scope to go in this order:
   /// 1) value set on edge itself (edge_->env_)
   /// 2) value set on rule, with expansion in the edge's scope
@@ -151,11 +266,24 @@ struct BindingEnv : public RelPathEnv {
   /// This function takes as parameters the necessary info to do (2).
   string LookupWithFallback(const string& var, const EvalString* eval,
                             Env* env);
+  /// Like LookupWithFallback(), but appending the value to |result|.
+  void AppendWithFallback(const string& var, const EvalString* eval,
+                          Env* env, string* result);
+  /// Append only (1), the value set on this scope itself.
+  /// @return false if there is none.
+  bool AppendOwnBinding(const string& var, string* result);
 
 private:
-  map<string, string> bindings_;
+  friend struct ManifestCache;
+
+  /// The value of |var| set on this scope itself, or NULL.
+  const string* FindBinding(const string& var) const;
+
+  Bindings bindings_;
   map<string, const Rule*> rules_;
   BindingEnv* parent_;
+  ManifestSource* source_;
+  StringInterner* interner_;
 };
 
 #endif  // NINJA_EVAL_ENV_H_
@@ -17,27 +17,187 @@
 #include <assert.h>
 #include <stdio.h>
 
+#include <algorithm>
+#include <set>
+
 #include "build_log.h"
 #include "debug_flags.h"
 #include "depfile_parser.h"
 #include "deps_log.h"
+#include "digest_log.h"
 #include "disk_interface.h"
 #include "manifest_parser.h"
 #include "metrics.h"
+#include "parallel.h"
+#include "resume_log.h"
 #include "state.h"
+#include "trace.h"
 #include "util.h"
 
 bool Node::Stat(DiskInterface* disk_interface, string* err) {
   return (mtime_ = disk_interface->Stat(path(), err)) != -1;
 }
 
+/// The walk of RecomputeDirty() through one edge, which it goes back to
+/// after each node it has to visit first.
+struct DependencyScan::Visit {
+  enum Step {
+    kStart,
+    kDyndepVisited,
+    kInputs
+  };
+
+  explicit Visit(Node* node)
+      : node(node), edge(node->in_edge()), step(kStart), input(0),
+        input_visited(false), dirty(false), most_recent_input(NULL) {}
+
+  /// The node through which the edge was reached.
+  Node* node;
+  Edge* edge;
+  Step step;
+  /// The input being visited, and whether it has been.
+  size_t input;
+  bool input_visited;
+  bool dirty;
+  Node* most_recent_input;
+};
+
 bool DependencyScan::RecomputeDirty(Node* node, string* err) {
+  TRACE_PHASE("RecomputeDirty");
+  // The walk keeps its own stack rather than recursing, as chains of
+  // edges can run deeper than the native one.  |stack| holds the node of
+  // each visit in |visits|, for VerifyDAG().
   vector<Node*> stack;
-  return RecomputeDirty(node, &stack, err);
+  vector<Visit> visits;
+  Node* next = node;
+  for (;;) {
+    if (next) {
+      bool started = false;
+      if (!StartVisit(next, &stack, &started, err))
+        return false;
+      if (started)
+        visits.push_back(Visit(next));
+      next = NULL;
+    }
+    if (visits.empty())
+      return true;
+
+    Visit* visit = &visits.back();
+    if (!ContinueVisit(visit, &next, err))
+      return false;
+    if (next)
+      continue;
+
+    // Mark the edge as finished during this walk now that it will no longer
+    // be in the stack.
+    visit->edge->mark_ = Edge::VisitDone;
+    assert(stack.back() == visit->node);
+    stack.pop_back();
+    visits.pop_back();
+  }
 }
 
-bool DependencyScan::RecomputeDirty(Node* node, vector<Node*>* stack,
-                                    string* err) {
+void DependencyScan::PrefetchStats(Node* node) {
+  METRIC_RECORD("stat prefetch");
+  vector<Node*> nodes;
+  vector<Edge*> edges;
+  set<Node*> seen_nodes;
+  set<Edge*> seen_edges;
+  DepsLog* deps_log = this->deps_log();
+  vector<Node*> stack(1, node);
+  while (!stack.empty()) {
+    Node* n = stack.back();
+    stack.pop_back();
+    if (!seen_nodes.insert(n).second)
+      continue;
+    if (!n->status_known())
+      nodes.push_back(n);
+
+    Edge* edge = n->in_edge();
+    // Edges that RecomputeDirty() has finished have had all their nodes
+    // stat()ed already.
+    if (!edge || edge->mark_ == Edge::VisitDone ||
+        !seen_edges.insert(edge).second)
+      continue;
+    edges.push_back(edge);
+    stack.insert(stack.end(), edge->outputs_.begin(), edge->outputs_.end());
+    stack.insert(stack.end(), edge->inputs_.begin(), edge->inputs_.end());
+    // What the resume log lists is dirty whatever its deps are.
+    if (!edge->deps_loaded_ && deps_log && !edge->outputs_.empty() &&
+        !(resume_log_ && resume_log_->Lists(edge))) {
+      if (DepsLog::Deps* deps = deps_log->GetDeps(edge->outputs_[0]))
+        stack.insert(stack.end(), deps->nodes, deps->nodes + deps->node_count);
+    }
+  }
+  StatNodes(nodes);
+  HashCommands(edges);
+}
+
+namespace {
+
+/// Works out the command hashes of edges, which only reads the graph and
+/// each edge's own memo.
+struct HashCommandsTask : public ParallelTask {
+  explicit HashCommandsTask(const vector<Edge*>& edges) : edges_(edges) {}
+
+  virtual void Run(size_t index) {
+    edges_[index]->CommandHash();
+  }
+
+  const vector<Edge*>& edges_;
+};
+
+}  // anonymous namespace
+
+void DependencyScan::HashCommands(const vector<Edge*>& edges) {
+  if (!build_log())
+    return;
+  // Only outputs that are there, with an entry in the log, have their
+  // commands compared.  Looking that up, and whether an edge is a
+  // generator, touches what the edges share, so it's done here.
+  vector<Edge*> hashed;
+  for (vector<Edge*>::const_iterator e = edges.begin(); e != edges.end();
+       ++e) {
+    Edge* edge = *e;
+    // A dyndep file still to be loaded may change the edge.
+    if (edge->is_phony() || edge->outputs_.empty() ||
+        (edge->dyndep_ && edge->dyndep_->dyndep_pending()) ||
+        edge->GetBindingBool("generator"))
+      continue;
+    Node* output = edge->outputs_[0];
+    if (output->exists() && build_log()->LookupByNode(output))
+      hashed.push_back(edge);
+  }
+  METRIC_RECORD("command hash prefetch");
+  HashCommandsTask task(hashed);
+  RunInParallel(&task, hashed.size(), ParallelismFor(hashed.size(), 64));
+}
+
+void DependencyScan::StatNodes(const vector<Node*>& nodes) {
+  vector<const string*> paths;
+  paths.reserve(nodes.size());
+  for (vector<Node*>::const_iterator i = nodes.begin(); i != nodes.end(); ++i)
+    paths.push_back(&(*i)->path());
+  vector<TimeStamp> mtimes;
+  disk_interface_->StatMany(paths, &mtimes);
+  // Failed stats are left unknown so RecomputeDirty() reports the error.
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (mtimes[i] == -1)
+      continue;
+    Node* n = nodes[i];
+    n->set_mtime(mtimes[i]);
+    // RecomputeDirty() treats a leaf whose status is known as visited, so
+    // do its work here.
+    if (!n->in_edge()) {
+      if (!n->exists())
+        EXPLAIN("%s has no in-edge and is missing", n->path().c_str());
+      n->set_dirty(!n->exists());
+    }
+  }
+}
+
+bool DependencyScan::StartVisit(Node* node, vector<Node*>* stack,
+                                bool* started, string* err) {
   Edge* edge = node->in_edge();
   if (!edge) {
     // If we already visited this leaf node then we are done.
@@ -56,85 +216,118 @@ bool DependencyScan::RecomputeDirty(Node* node, vector<Node*>* stack,
   if (edge->mark_ == Edge::VisitDone)
     return true;
 
-  // If we encountered this edge earlier in the call stack we have a cycle.
+  // If we encountered this edge earlier in the stack we have a cycle.
   if (!VerifyDAG(node, stack, err))
     return false;
 
-  // Mark the edge temporarily while in the call stack.
+  // Mark the edge temporarily while in the stack.
   edge->mark_ = Edge::VisitInStack;
   stack->push_back(node);
+  *started = true;
 
-  bool dirty = false;
   edge->outputs_ready_ = true;
   edge->deps_missing_ = false;
+  return true;
+}
 
-  if (!edge->deps_loaded_) {
-    // This is our first encounter with this edge.
-    // If there is a pending dyndep file, visit it now:
-    // * If the dyndep file is ready then load it now to get any
-    //   additional inputs and outputs for this and other edges.
-    //   Once the dyndep file is loaded it will no longer be pending
-    //   if any other edges encounter it, but they will already have
-    //   been updated.
-    // * If the dyndep file is not ready then since is known to be an
-    //   input to this edge, the edge will not be considered ready below.
-    //   Later during the build the dyndep file will become ready and be
-    //   loaded to update this edge before it can possibly be scheduled.
-    if (edge->dyndep_ && edge->dyndep_->dyndep_pending()) {
-      if (!RecomputeDirty(edge->dyndep_, stack, err))
-        return false;
-
-      if (!edge->dyndep_->in_edge() ||
-          edge->dyndep_->in_edge()->outputs_ready()) {
-        // The dyndep file is ready, so load it now.
-        if (!LoadDyndeps(edge->dyndep_, err))
-          return false;
+bool DependencyScan::ContinueVisit(Visit* visit, Node** next, string* err) {
+  Edge* edge = visit->edge;
+  if (visit->step == Visit::kStart) {
+    if (!edge->deps_loaded_) {
+      // This is our first encounter with this edge.
+      // If there is a pending dyndep file, visit it now:
+      // * If the dyndep file is ready then load it now to get any
+      //   additional inputs and outputs for this and other edges.
+      //   Once the dyndep file is loaded it will no longer be pending
+      //   if any other edges encounter it, but they will already have
+      //   been updated.
+      // * If the dyndep file is not ready then since is known to be an
+      //   input to this edge, the edge will not be considered ready below.
+      //   Later during the build the dyndep file will become ready and be
+      //   loaded to update this edge before it can possibly be scheduled.
+      if (edge->dyndep_ && edge->dyndep_->dyndep_pending()) {
+        visit->step = Visit::kDyndepVisited;
+        *next = edge->dyndep_;
+        return true;
       }
     }
   }
 
-  // Load output mtimes so we can compare them to the most recent input below.
-  for (vector<Node*>::iterator o = edge->outputs_.begin();
-       o != edge->outputs_.end(); ++o) {
-    if (!(*o)->StatIfNecessary(disk_interface_, err))
-      return false;
+  if (visit->step == Visit::kDyndepVisited) {
+    if (!edge->dyndep_->in_edge() ||
+        edge->dyndep_->in_edge()->outputs_ready()) {
+      // The dyndep file is ready, so load it now.
+      if (!LoadDyndeps(edge->dyndep_, err))
+        return false;
+    }
   }
 
-  if (!edge->deps_loaded_) {
-    // This is our first encounter with this edge.  Load discovered deps.
-    edge->deps_loaded_ = true;
-    if (!dep_loader_.LoadDeps(edge, err)) {
-      if (!err->empty())
+  if (visit->step != Visit::kInputs) {
+    visit->step = Visit::kInputs;
+    // Load output mtimes so we can compare them to the most recent input
+    // below.
+    for (vector<Node*>::iterator o = edge->outputs_.begin();
+         o != edge->outputs_.end(); ++o) {
+      if (!(*o)->StatIfNecessary(disk_interface_, err))
         return false;
-      // Failed to load dependency info: rebuild to regenerate it.
-      // LoadDeps() did EXPLAIN() already, no need to do it here.
-      dirty = edge->deps_missing_ = true;
     }
+
+    if (!edge->deps_loaded_) {
+      // This is our first encounter with this edge.  Load discovered deps.
+      edge->deps_loaded_ = true;
+      if (resume_log_ && resume_log_->LeftToRun(edge)) {
+        // They are recorded again once it has run.
+        EXPLAIN("%s was left to run by a build that stopped short",
+                edge->outputs_[0]->path().c_str());
+        visit->dirty = edge->deps_missing_ = true;
+      } else if (!dep_loader_.LoadDeps(edge, err)) {
+        if (!err->empty())
+          return false;
+        // Failed to load dependency info: rebuild to regenerate it.
+        // LoadDeps() did EXPLAIN() already, no need to do it here.
+        visit->dirty = edge->deps_missing_ = true;
+      }
+    }
+
+    // Stat the inputs nothing stat()ed yet, such as those only a depfile
+    // named, in one batch rather than one at a time as they are visited.
+    vector<Node*> unknown;
+    for (vector<Node*>::iterator i = edge->inputs_.begin();
+         i != edge->inputs_.end(); ++i) {
+      if (!(*i)->status_known() && !(*i)->in_edge())
+        unknown.push_back(*i);
+    }
+    if (unknown.size() > 1)
+      StatNodes(unknown);
   }
 
   // Visit all inputs; we're dirty if any of the inputs are dirty.
-  Node* most_recent_input = NULL;
-  for (vector<Node*>::iterator i = edge->inputs_.begin();
-       i != edge->inputs_.end(); ++i) {
-    // Visit this input.
-    if (!RecomputeDirty(*i, stack, err))
-      return false;
+  while (visit->input < edge->inputs_.size()) {
+    Node* input = edge->inputs_[visit->input];
+    if (!visit->input_visited) {
+      // Visit this input.
+      visit->input_visited = true;
+      *next = input;
+      return true;
+    }
+    visit->input_visited = false;
 
     // If an input is not ready, neither are our outputs.
-    if (Edge* in_edge = (*i)->in_edge()) {
+    if (Edge* in_edge = input->in_edge()) {
       if (!in_edge->outputs_ready_)
         edge->outputs_ready_ = false;
     }
 
-    if (!edge->is_order_only(i - edge->inputs_.begin())) {
+    if (!edge->is_order_only(visit->input++)) {
       // If a regular input is dirty (or missing), we're dirty.
       // Otherwise consider mtime.
-      if ((*i)->dirty()) {
-        EXPLAIN("%s is dirty", (*i)->path().c_str());
-        dirty = true;
+      if (input->dirty()) {
+        EXPLAIN("%s is dirty", input->path().c_str());
+        visit->dirty = true;
       } else {
-        if (!most_recent_input || (*i)->mtime() > most_recent_input->mtime()) {
-          most_recent_input = *i;
+        if (!visit->most_recent_input ||
+            input->mtime() > visit->most_recent_input->mtime()) {
+          visit->most_recent_input = input;
         }
       }
     }
@@ -142,14 +335,15 @@ bool DependencyScan::RecomputeDirty(Node* node, vector<Node*>* stack,
 
   // We may also be dirty due to output state: missing outputs, out of
   // date outputs, etc.  Visit all outputs and determine whether they're dirty.
-  if (!dirty)
-    if (!RecomputeOutputsDirty(edge, most_recent_input, &dirty, err))
+  if (!visit->dirty)
+    if (!RecomputeOutputsDirty(edge, visit->most_recent_input, &visit->dirty,
+                               err))
       return false;
 
   // Finally, visit each output and update their dirty state if necessary.
   for (vector<Node*>::iterator o = edge->outputs_.begin();
        o != edge->outputs_.end(); ++o) {
-    if (dirty)
+    if (visit->dirty)
       (*o)->MarkDirty();
   }
 
@@ -158,15 +352,9 @@ bool DependencyScan::RecomputeDirty(Node* node, vector<Node*>* stack,
   // order-only inputs.)
   // But phony edges with no inputs have nothing to do, so are always
   // ready.
-  if (dirty && !(edge->is_phony() && edge->inputs_.empty()))
+  if (visit->dirty && !(edge->is_phony() && edge->inputs_.empty()))
     edge->outputs_ready_ = false;
 
-  // Mark the edge as finished during this walk now that it will no longer
-  // be in the call stack.
-  edge->mark_ = Edge::VisitDone;
-  assert(stack->back() == node);
-  stack->pop_back();
-
   return true;
 }
 
@@ -211,10 +399,9 @@ bool DependencyScan::VerifyDAG(Node* node, vector<Node*>* stack, string* err) {
 
 bool DependencyScan::RecomputeOutputsDirty(Edge* edge, Node* most_recent_input,
                                            bool* outputs_dirty, string* err) {
-  string command = edge->EvaluateCommand(/*incl_rsp_file=*/true);
   for (vector<Node*>::iterator o = edge->outputs_.begin();
        o != edge->outputs_.end(); ++o) {
-    if (RecomputeOutputDirty(edge, most_recent_input, command, *o)) {
+    if (RecomputeOutputDirty(edge, most_recent_input, *o)) {
       *outputs_dirty = true;
       return true;
     }
@@ -224,7 +411,6 @@ bool DependencyScan::RecomputeOutputsDirty(Edge* edge, Node* most_recent_input,
 
 bool DependencyScan::RecomputeOutputDirty(Edge* edge,
                                           Node* most_recent_input,
-                                          const string& command,
                                           Node* output) {
   if (edge->is_phony()) {
     // Phony edges don't write any output.  Outputs are only dirty if
@@ -255,12 +441,13 @@ bool DependencyScan::RecomputeOutputDirty(Edge* edge,
     // considered dirty if an input was modified since the previous run.
     bool used_restat = false;
     if (edge->GetBindingBool("restat") && build_log() &&
-        (entry = build_log()->LookupByOutput(output->path()))) {
+        (entry = build_log()->LookupByNode(output))) {
       output_mtime = entry->mtime;
       used_restat = true;
     }
 
-    if (output_mtime < most_recent_input->mtime()) {
+    if (output_mtime < most_recent_input->mtime() &&
+        !InputContentsUnchanged(edge, output)) {
       EXPLAIN("%soutput %s older than most recent input %s "
               "(%" PRId64 " vs %" PRId64 ")",
               used_restat ? "restat of " : "", output->path().c_str(),
@@ -272,16 +459,17 @@ bool DependencyScan::RecomputeOutputDirty(Edge* edge,
 
   if (build_log()) {
     bool generator = edge->GetBindingBool("generator");
-    if (entry || (entry = build_log()->LookupByOutput(output->path()))) {
+    if (entry || (entry = build_log()->LookupByNode(output))) {
       if (!generator &&
-          BuildLog::LogEntry::HashCommand(command) != entry->command_hash) {
+          edge->CommandHash() != entry->command_hash) {
         // May also be dirty due to the command changing since the last build.
         // But if this is a generator rule, the command changing does not make us
         // dirty.
         EXPLAIN("command line changed for %s", output->path().c_str());
         return true;
       }
-      if (most_recent_input && entry->mtime < most_recent_input->mtime()) {
+      if (most_recent_input && entry->mtime < most_recent_input->mtime() &&
+          !InputContentsUnchanged(edge, output)) {
         // May also be dirty due to the mtime in the log being older than the
         // mtime of the most recent input.  This can occur even when the mtime
         // on disk is newer if a previous run wrote to the output file but
@@ -301,6 +489,18 @@ bool DependencyScan::RecomputeOutputDirty(Edge* edge,
   return false;
 }
 
+bool DependencyScan::InputContentsUnchanged(Edge* edge, Node* output) {
+  uint64_t recorded, current;
+  if (!digest_log_ || !edge->GetBindingBool("hash_inputs") ||
+      !digest_log_->LookupOutput(output->path(), &recorded) ||
+      !digest_log_->InputsDigest(edge, disk_interface_, &current) ||
+      current != recorded)
+    return false;
+  EXPLAIN("inputs of %s are newer but their contents are the same",
+          output->path().c_str());
+  return true;
+}
+
 bool DependencyScan::LoadDyndeps(Node* node, string* err) const {
   return dyndep_loader_.LoadDyndeps(node, err);
 }
@@ -311,12 +511,79 @@ bool DependencyScan::LoadDyndeps(Node* node, DyndepFile* ddf,
 }
 
 bool Edge::AllInputsReady() const {
-  for (vector<Node*>::const_iterator i = inputs_.begin();
-       i != inputs_.end(); ++i) {
-    if ((*i)->in_edge() && !(*i)->in_edge()->outputs_ready())
-      return false;
+  size_t ready = ReadyInputs();
+  return ready == ready_inputs_of_;
+}
+
+size_t Edge::ReadyInputs() const {
+  const vector<Node*>& inputs =
+      plan_inputs_ == kPlanInputsCollapsed ? phony_inputs_ : inputs_;
+  if (ready_inputs_of_ != inputs.size()) {
+    ready_inputs_ = 0;
+    ready_inputs_of_ = (unsigned)inputs.size();
   }
-  return true;
+  for (; ready_inputs_ < inputs.size(); ++ready_inputs_) {
+    Edge* in_edge = inputs[ready_inputs_]->in_edge();
+    if (in_edge && !in_edge->outputs_ready())
+      break;
+  }
+  return ready_inputs_;
+}
+
+const vector<Node*>& Edge::PlanInputs() {
+  if (plan_inputs_ != kPlanInputsUnknown)
+    return plan_inputs_ == kPlanInputsCollapsed ? phony_inputs_ : inputs_;
+  // Until the inputs are known, which a cycle would come back to before,
+  // they are the edge's own.
+  plan_inputs_ = kPlanInputsOwn;
+  if (!collapsible())
+    return inputs_;
+  vector<Node*>::const_iterator i = inputs_.begin();
+  while (i != inputs_.end() &&
+         !((*i)->in_edge() && (*i)->in_edge()->collapsible()))
+    ++i;
+  if (i == inputs_.end())
+    return inputs_;
+
+  set<Node*> own(inputs_.begin(), inputs_.end());
+  set<Node*> seen;
+  for (i = inputs_.begin(); i != inputs_.end(); ++i) {
+    Edge* in_edge = (*i)->in_edge();
+    if (!in_edge || !in_edge->collapsible()) {
+      if (seen.insert(*i).second)
+        phony_inputs_.push_back(*i);
+      continue;
+    }
+    const vector<Node*>& theirs = in_edge->PlanInputs();
+    for (vector<Node*>::const_iterator t = theirs.begin(); t != theirs.end();
+         ++t) {
+      if (!seen.insert(*t).second)
+        continue;
+      phony_inputs_.push_back(*t);
+      if (!own.count(*t))
+        (*t)->AddPhonyOutEdge(this);
+    }
+  }
+  plan_inputs_ = kPlanInputsCollapsed;
+  ready_inputs_ = 0;
+  return phony_inputs_;
+}
+
+/// Whether |node| is a file no edge writes, which the build never visits
+/// the out-edges of: one with no in-edge or, like those the dependency
+/// loader makes, a phony edge with no inputs, which is always ready even
+/// when the file is missing.
+static bool IsSourceFile(const Node* node) {
+  const Edge* in_edge = node->in_edge();
+  return !in_edge || (in_edge->is_phony() && in_edge->inputs_.empty());
+}
+
+void Edge::LinkDeps() {
+  for (int i = unlinked_begin_; i < unlinked_begin_ + unlinked_deps_; ++i) {
+    if (IsSourceFile(inputs_[i]))
+      inputs_[i]->AddOutEdge(this);
+  }
+  unlinked_deps_ = 0;
 }
 
 /// An Env for an Edge, providing $in and $out.
@@ -324,33 +591,76 @@ struct EdgeEnv : public Env {
   enum EscapeKind { kShellEscape, kDoNotEscape };
 
   EdgeEnv(const Edge* const edge, const EscapeKind escape)
-      : edge_(edge), escape_in_out_(escape), recursive_(false) {}
+      : edge_(edge), escape_in_out_(escape), recursive_(false),
+        hasher_(NULL), sink_(NULL), held_(0) {}
   virtual string LookupVariable(const string& var);
+  virtual void AppendVariable(const string& var, string* result);
+
+  /// Pass what gets appended to |sink| on to |hasher| as the evaluation
+  /// goes, rather than letting |sink| grow to hold all of it.  The first
+  /// |held| bytes of |sink| are only passed on once more text follows them.
+  void StreamTo(CommandHasher* hasher, string* sink, size_t held) {
+    hasher_ = hasher;
+    sink_ = sink;
+    held_ = held;
+  }
+  /// The number of bytes of the sink still held back.
+  size_t held() const { return held_; }
 
-  /// Given a span of Nodes, construct a list of paths suitable for a command
-  /// line.
-  std::string MakePathList(const Node* const* span, size_t size, char sep) const;
+  /// Given a span of Nodes, append a list of paths suitable for a command
+  /// line to |result|.
+  void AppendPathList(const Node* const* span, size_t size, char sep,
+                      string* result);
 
  private:
+  /// Append $in, $in_newline or $out.
+  void AppendSlot(RuleTemplate::SlotKind kind, string* result);
+  /// Append the evaluation of a rule's binding, in a single pass.
+  void AppendTemplate(const RuleTemplate& tmpl, string* result);
+  /// The explicit inputs and outputs of the edge, as $in and $out use them.
+  size_t explicit_ins() const {
+    return edge_->inputs_.size() - edge_->implicit_deps_ -
+        edge_->order_only_deps_;
+  }
+  size_t explicit_outs() const {
+    return edge_->outputs_.size() - edge_->implicit_outs_;
+  }
+
   vector<string> lookups_;
+  /// Hand |result| to the hasher if it's the sink and holds enough.
+  void Drain(string* result) {
+    if (result == sink_ && result->size() > held_) {
+      hasher_->Update(*result);
+      result->clear();
+      held_ = 0;
+    }
+  }
+
   const Edge* const edge_;
   EscapeKind escape_in_out_;
   bool recursive_;
+  CommandHasher* hasher_;
+  string* sink_;
+  size_t held_;
 };
 
 string EdgeEnv::LookupVariable(const string& var) {
-  if (var == "in" || var == "in_newline") {
-    int explicit_deps_count = edge_->inputs_.size() - edge_->implicit_deps_ -
-      edge_->order_only_deps_;
-#if __cplusplus >= 201103L
-    return MakePathList(edge_->inputs_.data(), explicit_deps_count,
-#else
-    return MakePathList(&edge_->inputs_[0], explicit_deps_count,
-#endif
-                        var == "in" ? ' ' : '\n');
+  string result;
+  AppendVariable(var, &result);
+  return result;
+}
+
+void EdgeEnv::AppendVariable(const string& var, string* result) {
+  Drain(result);
+  if (var == "in") {
+    AppendSlot(RuleTemplate::kIn, result);
+    return;
+  } else if (var == "in_newline") {
+    AppendSlot(RuleTemplate::kInNewline, result);
+    return;
   } else if (var == "out") {
-    int explicit_outs_count = edge_->outputs_.size() - edge_->implicit_outs_;
-    return MakePathList(&edge_->outputs_[0], explicit_outs_count, ' ');
+    AppendSlot(RuleTemplate::kOut, result);
+    return;
   }
 
   if (recursive_) {
@@ -365,51 +675,154 @@ string EdgeEnv::LookupVariable(const string& var) {
   }
 
   // See notes on BindingEnv::LookupWithFallback.
-  const EvalString* eval = edge_->rule_->GetBinding(var);
-  if (recursive_ && eval)
+  const RuleTemplate* tmpl = edge_->rule_->GetTemplate(var);
+  if (!tmpl) {
+    edge_->env_->AppendWithFallback(var, NULL, this, result);
+    return;
+  }
+  if (edge_->env_->AppendOwnBinding(var, result))
+    return;
+  if (recursive_)
     lookups_.push_back(var);
 
   // In practice, variables defined on rules never use another rule variable.
   // For performance, only start checking for cycles after the first lookup.
   recursive_ = true;
-  return edge_->env_->LookupWithFallback(var, eval, this);
+  AppendTemplate(*tmpl, result);
 }
 
-std::string EdgeEnv::MakePathList(const Node* const* const span,
-                                  const size_t size, const char sep) const {
-  string result;
+void EdgeEnv::AppendSlot(const RuleTemplate::SlotKind kind, string* result) {
+  if (kind == RuleTemplate::kOut) {
+    AppendPathList(&edge_->outputs_[0], explicit_outs(), ' ', result);
+    return;
+  }
+#if __cplusplus >= 201103L
+  AppendPathList(edge_->inputs_.data(), explicit_ins(),
+#else
+  AppendPathList(&edge_->inputs_[0], explicit_ins(),
+#endif
+                 kind == RuleTemplate::kIn ? ' ' : '\n', result);
+}
+
+void EdgeEnv::AppendTemplate(const RuleTemplate& tmpl, string* result) {
+  const vector<RuleTemplate::Segment>& segments = tmpl.segments();
+
+  // Make room for all of it up front, short of any escaping, unless it's
+  // streamed to a hasher.
+  if (result != sink_) {
+    size_t size = result->size() + tmpl.text_size();
+    for (vector<RuleTemplate::Segment>::const_iterator s = segments.begin();
+         s != segments.end(); ++s) {
+      if (s->kind == RuleTemplate::kOut) {
+        for (size_t i = 0; i < explicit_outs(); ++i)
+          size += edge_->outputs_[i]->env_relative_path().size() + 1;
+      } else if (s->kind == RuleTemplate::kIn ||
+                 s->kind == RuleTemplate::kInNewline) {
+        for (size_t i = 0; i < explicit_ins(); ++i)
+          size += edge_->inputs_[i]->env_relative_path().size() + 1;
+      }
+    }
+    result->reserve(size);
+  }
+
+  for (vector<RuleTemplate::Segment>::const_iterator s = segments.begin();
+       s != segments.end(); ++s) {
+    switch (s->kind) {
+    case RuleTemplate::kText:
+      result->append(s->text);
+      break;
+    case RuleTemplate::kVariable:
+      AppendVariable(s->text, result);
+      break;
+    default:
+      Drain(result);
+      AppendSlot(s->kind, result);
+      break;
+    }
+  }
+}
+
+void EdgeEnv::AppendPathList(const Node* const* const span,
+                             const size_t size, const char sep,
+                             string* result) {
   for (const Node* const* i = span; i != span + size; ++i) {
-    if (!result.empty())
-      result.push_back(sep);
-    const string& path = (*i)->PathDecanonicalized(edge_->env_);
+    if (i != span) {
+      result->push_back(sep);
+      Drain(result);
+    }
+    // Paths in the edge's own directory are written as they are.
+    const string* path = &(*i)->env_relative_path();
+    string decanonicalized;
+    BindingEnv* env = (*i)->GetEnv();
+    if ((*i)->slash_bits() ||
+        (env != edge_->env_ && !env->equals(edge_->env_))) {
+      decanonicalized = (*i)->PathDecanonicalized(edge_->env_);
+      path = &decanonicalized;
+    }
     if (escape_in_out_ == kShellEscape) {
 #if _WIN32
-      GetWin32EscapedString(path, &result);
+      GetWin32EscapedString(*path, result);
 #else
-      GetShellEscapedString(path, &result);
+      GetShellEscapedString(*path, result);
 #endif
     } else {
-      result.append(path);
+      result->append(*path);
     }
   }
-  return result;
 }
 
 std::string Edge::EvaluateCommand(const bool incl_rsp_file) const {
-  string command = GetBinding("command");
+  string command;
+  const string& dir = env_->AsString();
+  if (!dir.empty()) {
+#if _WIN32
+    command = "cmd /c cd " + dir + " && ";
+#else
+    command = "cd " + dir + " && ";
+#endif
+  }
+  EdgeEnv env(this, EdgeEnv::kShellEscape);
+  env.AppendVariable("command", &command);
   if (incl_rsp_file) {
     string rspfile_content = GetBinding("rspfile_content");
     if (!rspfile_content.empty())
       command += ";rspfile=" + rspfile_content;
   }
-  if (!env_->AsString().empty()) {
+  return command;
+}
+
+Hash128 Edge::CommandHash() const {
+  if (memo_known_ & kMemoCommandHash)
+    return command_hash_;
+
+  // Hash EvaluateCommand(true) as it is evaluated rather than building it:
+  // long link commands with their rspfiles run to many kilobytes.
+  CommandHasher hasher;
+  string buffer;
+  const string& dir = env_->AsString();
+  if (!dir.empty()) {
 #if _WIN32
-    command = "cmd /c cd " + env_->AsString() + " && " + command;
+    buffer = "cmd /c cd " + dir + " && ";
 #else
-    command = "cd " + env_->AsString() + " && " + command;
+    buffer = "cd " + dir + " && ";
 #endif
   }
-  return command;
+  EdgeEnv env(this, EdgeEnv::kShellEscape);
+  env.StreamTo(&hasher, &buffer, 0);
+  env.AppendVariable("command", &buffer);
+  hasher.Update(buffer);
+
+  // The rspfile part is only there if the content isn't empty.
+  buffer = ";rspfile=";
+  EdgeEnv rsp_env(this, EdgeEnv::kShellEscape);
+  rsp_env.StreamTo(&hasher, &buffer, buffer.size());
+  rsp_env.AppendVariable("rspfile_content", &buffer);
+  if (rsp_env.held() == 0 || buffer.size() > rsp_env.held())
+    hasher.Update(buffer);
+
+  command_hash_ = hasher.Finish128();
+  memo_known_ |= kMemoCommandHash;
+  return command_hash_;
 }
 
 std::string Edge::GetBinding(const std::string& key) const {
@@ -418,7 +831,24 @@ std::string Edge::GetBinding(const std::string& key) const {
 }
 
 bool Edge::GetBindingBool(const string& key) const {
-  return !GetBinding(key).empty();
+  Memo bit;
+  if (key == "restat")
+    bit = kMemoRestat;
+  else if (key == "generator")
+    bit = kMemoGenerator;
+  else if (key == "hash_inputs")
+    bit = kMemoHashInputs;
+  else
+    return !GetBinding(key).empty();
+
+  if (!(memo_known_ & bit)) {
+    if (GetBinding(key).empty())
+      memo_values_ &= ~bit;
+    else
+      memo_values_ |= bit;
+    memo_known_ |= bit;
+  }
+  return (memo_values_ & bit) != 0;
 }
 
 string Edge::GetUnescapedDepfile() const {
@@ -599,8 +1029,7 @@ bool ImplicitDepLoader::LoadDepFile(Edge* edge, const string& path,
 
     Node* node = state_->GetNode(*i, edge->env_, slash_bits);
     *implicit_dep = node;
-    node->AddOutEdge(edge);
-    CreatePhonyInEdge(node);
+    AddDep(edge, node);
   }
 
   return true;
@@ -622,25 +1051,48 @@ bool ImplicitDepLoader::LoadDepsFromLog(Edge* edge, string* err) {
     return false;
   }
 
+  // A scan after State::Reset() finds the deps from the last one still in
+  // place, and usually unchanged.
+  vector<Node*>::iterator end = edge->inputs_.end() - edge->order_only_deps_;
+  if (deps->node_count > 0 && edge->log_deps_ == deps->node_count &&
+      equal(deps->nodes, deps->nodes + deps->node_count,
+            end - deps->node_count))
+    return true;
+
   vector<Node*>::iterator implicit_dep =
       PreallocateSpace(edge, deps->node_count);
   for (int i = 0; i < deps->node_count; ++i, ++implicit_dep) {
     Node* node = deps->nodes[i];
     *implicit_dep = node;
-    node->AddOutEdge(edge);
-    CreatePhonyInEdge(node);
+    AddDep(edge, node);
   }
+  edge->log_deps_ = deps->node_count;
   return true;
 }
 
 vector<Node*>::iterator ImplicitDepLoader::PreallocateSpace(Edge* edge,
                                                             int count) {
+  // Only the deps discovered last are left unlinked.
+  edge->LinkDeps();
   edge->inputs_.insert(edge->inputs_.end() - edge->order_only_deps_,
                        (size_t)count, 0);
   edge->implicit_deps_ += count;
+  edge->log_deps_ = 0;
+  if (state_->defer_dep_links_) {
+    edge->unlinked_begin_ =
+        (int)edge->inputs_.size() - edge->order_only_deps_ - count;
+    edge->unlinked_deps_ = count;
+  }
   return edge->inputs_.end() - edge->order_only_deps_ - count;
 }
 
+void ImplicitDepLoader::AddDep(Edge* edge, Node* node) {
+  // A source file read by the edge stays unlinked; see PreallocateSpace().
+  if (!state_->defer_dep_links_ || !IsSourceFile(node))
+    node->AddOutEdge(edge);
+  CreatePhonyInEdge(node);
+}
+
 void ImplicitDepLoader::CreatePhonyInEdge(Node* node) {
   if (node->in_edge())
     return;
@@ -22,6 +22,7 @@ using namespace std;
 
 #include "dyndep.h"
 #include "eval_env.h"
+#include "hash_map.h"
 #include "timestamp.h"
 #include "util.h"
 
@@ -29,9 +30,11 @@ struct BuildLog;
 struct DepfileParserOptions;
 struct DiskInterface;
 struct DepsLog;
+struct DigestLog;
 struct Edge;
 struct Node;
 struct Pool;
+struct ResumeLog;
 struct State;
 
 /// Information about a node in the dependency graph: the file, whether
@@ -46,7 +49,8 @@ struct Node {
         dirty_(false),
         dyndep_pending_(false),
         in_edge_(NULL),
-        id_(-1) {}
+        id_(-1),
+        index_(-1) {}
 
   /// Return false on error.
   bool Stat(DiskInterface* disk_interface, string* err);
@@ -78,11 +82,15 @@ struct Node {
   }
 
   const string& path() const { return env_path_; }
+  /// The path relative to the directory of GetEnv().
+  const string& env_relative_path() const { return path_; }
   /// Get |path()| but use slash_bits to convert back to original slash styles.
   string PathDecanonicalized(BindingEnv* in_env) const;
   uint64_t slash_bits() const { return slash_bits_; }
 
   TimeStamp mtime() const { return mtime_; }
+  /// Record the result of a stat() performed on our behalf.
+  void set_mtime(TimeStamp mtime) { mtime_ = mtime; }
 
   bool dirty() const { return dirty_; }
   void set_dirty(bool dirty) { dirty_ = dirty; }
@@ -97,9 +105,26 @@ struct Node {
   int id() const { return id_; }
   void set_id(int id) { id_ = id; }
 
+  int index() const { return index_; }
+  void set_index(int index) { index_ = index; }
+
   const vector<Edge*>& out_edges() const { return out_edges_; }
   void AddOutEdge(Edge* edge) { out_edges_.push_back(edge); }
 
+  /// The phony edges that wait for this node through chains of phony
+  /// edges collapsed by Edge::PlanInputs(), rather than directly.
+  const vector<Edge*>& phony_out_edges() const { return phony_out_edges_; }
+  void AddPhonyOutEdge(Edge* edge) { phony_out_edges_.push_back(edge); }
+  /// Undo the most recent AddOutEdge(edge).
+  void RemoveOutEdge(Edge* edge) {
+    for (size_t i = out_edges_.size(); i > 0; --i) {
+      if (out_edges_[i - 1] == edge) {
+        out_edges_.erase(out_edges_.begin() + i - 1);
+        return;
+      }
+    }
+  }
+
   void Dump(const char* prefix="") const;
 
   void ResetEnv(BindingEnv* newEnv) {
@@ -109,9 +134,11 @@ struct Node {
     env_ = newEnv;
     assert(env_->ApplyChdir(path_) == oldPath);
   }
-  BindingEnv* GetEnv() { return env_; }
+  BindingEnv* GetEnv() const { return env_; }
 
 private:
+  friend struct ManifestCache;
+
   BindingEnv* env_;
   const string env_path_;
   string path_;
@@ -142,8 +169,15 @@ private:
   /// All Edges that use this Node as an input.
   vector<Edge*> out_edges_;
 
+  vector<Edge*> phony_out_edges_;
+
   /// A dense integer id for the node, assigned and used by DepsLog.
   int id_;
+
+  /// A dense index for the node among those its State made, in the order
+  /// it made them, for tables kept by node such as BuildLog's.  -1 for
+  /// nodes made elsewhere.
+  int index_;
 };
 
 /// An edge in the dependency graph; links between Nodes using Rules.
@@ -154,21 +188,56 @@ struct Edge {
     VisitDone
   };
 
-  Edge() : rule_(NULL), pool_(NULL), dyndep_(NULL), env_(NULL),
+  Edge() : implicit_deps_(0), order_only_deps_(0), implicit_outs_(0),
            mark_(VisitNone), outputs_ready_(false), deps_loaded_(false),
-           deps_missing_(false), implicit_deps_(0), order_only_deps_(0),
-           implicit_outs_(0) {}
-
-  /// Return true if all inputs' in-edges are ready.
+           deps_missing_(false), rule_(NULL), pool_(NULL), dyndep_(NULL),
+           env_(NULL), id_(-1), weight_(1), critical_path_weight_(-1),
+           fail_first_(false), log_deps_(0), unlinked_begin_(0),
+           unlinked_deps_(0), plan_inputs_(kPlanInputsUnknown),
+           ready_inputs_(0), ready_inputs_of_(0), command_hash_(),
+           memo_known_(0), memo_values_(0) {}
+
+  /// Return true if all inputs' in-edges are ready, of PlanInputs() once
+  /// that was worked out.  Inputs stay ready once they are, until the
+  /// graph is reset, so each call carries on from the first input that
+  /// wasn't last time: an edge with many inputs is checked in time linear
+  /// in them over the whole build, rather than once for each input.
   bool AllInputsReady() const;
 
+  /// How many of the inputs AllInputsReady() goes by, from the first, are
+  /// ready.
+  size_t ReadyInputs() const;
+
+  /// The inputs that the plan waits for: for a phony edge, its inputs with
+  /// those that other phony edges make replaced by the inputs of those, and
+  /// so on, so that the plan needn't go through the aggregations that
+  /// generators make edge by edge; for other edges, inputs_.  The graph
+  /// itself, as the dependency scan and the tools see it, stays as it is.
+  ///
+  /// Worked out on first use, when each of the inputs reached through a
+  /// phony edge gets this one among its phony_out_edges().  Only phony
+  /// edges without order-only inputs or a dyndep binding are collapsed, and
+  /// only into others like them, so that the inputs are all alike.
+  const vector<Node*>& PlanInputs();
+
+  /// Whether PlanInputs() may see through this edge.
+  bool collapsible() const {
+    return is_phony() && !inputs_.empty() && order_only_deps_ == 0 &&
+        !dyndep_;
+  }
+
   /// Expand all variables in a command and return it as a string.
   /// If incl_rsp_file is enabled, the string will also contain the
   /// full contents of a response file (if applicable)
   std::string EvaluateCommand(bool incl_rsp_file = false) const;
 
+  /// The hash of EvaluateCommand(true), as the build log records it.
+  Hash128 CommandHash() const;
+
   /// Returns the shell-escaped value of |key|.
   std::string GetBinding(const string& key) const;
+  /// Whether |key| is set.  "restat", "generator" and "hash_inputs", which
+  /// are checked for every output, are only evaluated once; see ClearMemo().
   bool GetBindingBool(const string& key) const;
 
   /// Like GetBinding("depfile"), but without shell escaping. The result *must*
@@ -183,21 +252,22 @@ struct Edge {
 
   void Dump(const char* prefix="") const;
 
-  const Rule* rule_;
-  Pool* pool_;
+  /// Forget the bindings evaluated once by CommandHash() and
+  /// GetBindingBool(), and the inputs AllInputsReady() found ready, for
+  /// when the edge or its environment change.
+  void ClearMemo() {
+    memo_known_ = 0;
+    ready_inputs_ = 0;
+  }
+
+  /// Add the edge to the out-edges of its unlinked deps.
+  void LinkDeps();
+
+  // The members that the dependency scan and the plan look at for every
+  // edge come first, in 64 bytes on 64-bit hosts, so that they share as
+  // few cache lines as they can.
   vector<Node*> inputs_;
   vector<Node*> outputs_;
-  Node* dyndep_;
-  BindingEnv* env_;
-  VisitMark mark_;
-  bool outputs_ready_;
-  bool deps_loaded_;
-  bool deps_missing_;
-
-  const Rule& rule() const { return *rule_; }
-  Pool* pool() const { return pool_; }
-  int weight() const { return 1; }
-  bool outputs_ready() const { return outputs_ready_; }
 
   // There are three types of inputs.
   // 1) explicit deps, which show up as $in on the command line;
@@ -209,6 +279,80 @@ struct Edge {
   // #2 and #3 when we need to access the various subsets.
   int implicit_deps_;
   int order_only_deps_;
+
+  // There are two types of outputs.
+  // 1) explicit outs, which show up as $out on the command line;
+  // 2) implicit outs, which the target generates but are not part of $out.
+  // These are stored in outputs_ in that order, and we keep a count of
+  // #2 to use when we need to access the various subsets.
+  int implicit_outs_;
+
+  /// A VisitMark, in a byte of its own next to the flags.
+  unsigned char mark_;
+  bool outputs_ready_;
+  bool deps_loaded_;
+  bool deps_missing_;
+
+  const Rule* rule_;
+  Pool* pool_;
+  Node* dyndep_;
+  BindingEnv* env_;
+  /// Index of the edge in State::edges_.
+  int id_;
+  /// How much of its pool's depth the edge takes up while it runs, from
+  /// its "weight" binding.
+  int weight_;
+
+  /// Expected time (in build log units) of the longest chain of wanted
+  /// edges from this one to a target, including this edge itself.  Set by
+  /// Plan before scheduling; -1 if unknown.
+  int64_t critical_path_weight_;
+
+  /// Whether the edge failed the last time it ran, or a wanted edge that
+  /// failed depends on it: it is started ahead of the others.  Set by Plan
+  /// before scheduling.
+  bool fail_first_;
+
+  /// How many of the implicit deps, the last ones, were the deps log's
+  /// deps for the edge when it last loaded them; 0 once anything else is
+  /// added.  A later scan leaves them be if they are still the same.
+  int log_deps_;
+
+  /// The |unlinked_deps_| inputs from |unlinked_begin_| on are the deps
+  /// the edge discovered last, and those of them that are source files
+  /// don't have the edge as an out-edge yet; see State::defer_dep_links_.
+  int unlinked_begin_;
+  int unlinked_deps_;
+
+  /// Whether PlanInputs() are known yet, and whether they are
+  /// |phony_inputs_| or just inputs_.
+  enum PlanInputsState {
+    kPlanInputsUnknown,
+    kPlanInputsOwn,
+    kPlanInputsCollapsed
+  };
+  unsigned char plan_inputs_;
+  vector<Node*> phony_inputs_;
+
+  /// How many of the inputs AllInputsReady() goes by were ready, checked
+  /// when there were |ready_inputs_of_| of them; any added since, as deps
+  /// are, start it over.
+  mutable unsigned ready_inputs_;
+  mutable unsigned ready_inputs_of_;
+
+  const Rule& rule() const { return *rule_; }
+  Pool* pool() const { return pool_; }
+  int id() const { return id_; }
+  int weight() const { return weight_; }
+  bool outputs_ready() const { return outputs_ready_; }
+  int64_t critical_path_weight() const { return critical_path_weight_; }
+  void set_critical_path_weight(int64_t weight) {
+    critical_path_weight_ = weight;
+  }
+  bool fail_first() const { return fail_first_; }
+  void set_fail_first(bool fail_first) { fail_first_ = fail_first; }
+
+  // See implicit_deps_ and order_only_deps_ for the types of inputs.
   bool is_implicit(size_t index) {
     return index >= inputs_.size() - order_only_deps_ - implicit_deps_ &&
         !is_order_only(index);
@@ -217,12 +361,7 @@ struct Edge {
     return index >= inputs_.size() - order_only_deps_;
   }
 
-  // There are two types of outputs.
-  // 1) explicit outs, which show up as $out on the command line;
-  // 2) implicit outs, which the target generates but are not part of $out.
-  // These are stored in outputs_ in that order, and we keep a count of
-  // #2 to use when we need to access the various subsets.
-  int implicit_outs_;
+  // See implicit_outs_ for the types of outputs.
   bool is_implicit_out(size_t index) const {
     return index >= outputs_.size() - implicit_outs_;
   }
@@ -230,6 +369,19 @@ struct Edge {
   bool is_phony() const;
   bool use_console() const;
   bool maybe_phonycycle_diagnostic() const;
+
+ private:
+  enum Memo {
+    kMemoCommandHash = 1 << 0,
+    kMemoRestat = 1 << 1,
+    kMemoGenerator = 1 << 2,
+    kMemoHashInputs = 1 << 3
+  };
+
+  mutable Hash128 command_hash_;
+  /// The Memo bits evaluated so far, and the values of the boolean ones.
+  mutable unsigned char memo_known_;
+  mutable unsigned char memo_values_;
 };
 
 
@@ -264,6 +416,9 @@ struct ImplicitDepLoader {
   /// an iterator pointing at the first new space.
   vector<Node*>::iterator PreallocateSpace(Edge* edge, int count);
 
+  /// Add \a node, just put in the space made for it, to \a edge's deps.
+  void AddDep(Edge* edge, Node* node);
+
   /// If we don't have a edge that generates this input already,
   /// create one; this makes us not abort if the input is missing,
   /// but instead will rebuild in that circumstance.
@@ -283,6 +438,8 @@ struct DependencyScan {
                  DiskInterface* disk_interface,
                  DepfileParserOptions const* depfile_parser_options)
       : build_log_(build_log),
+        digest_log_(NULL),
+        resume_log_(NULL),
         disk_interface_(disk_interface),
         dep_loader_(state, deps_log, disk_interface, depfile_parser_options),
         dyndep_loader_(state, disk_interface) {}
@@ -294,6 +451,14 @@ struct DependencyScan {
   /// Returns false on failure.
   bool RecomputeDirty(Node* node, string* err);
 
+  /// Stat, in one batch, every node that RecomputeDirty(node) is going to
+  /// stat.  This lets the DiskInterface overlap the file system calls rather
+  /// than having the scan wait on each one in turn.  Only the graph already
+  /// known is walked: the manifest plus any dependencies in the deps log.
+  /// The command hashes the scan is going to compare with the build log are
+  /// worked out too, on several threads.
+  void PrefetchStats(Node* node);
+
   /// Recompute whether any output of the edge is dirty, if so sets |*dirty|.
   /// Returns false on failure.
   bool RecomputeOutputsDirty(Edge* edge, Node* most_recent_input,
@@ -306,6 +471,20 @@ struct DependencyScan {
     build_log_ = log;
   }
 
+  DigestLog* digest_log() const {
+    return digest_log_;
+  }
+  void set_digest_log(DigestLog* log) {
+    digest_log_ = log;
+  }
+
+  const ResumeLog* resume_log() const {
+    return resume_log_;
+  }
+  void set_resume_log(const ResumeLog* log) {
+    resume_log_ = log;
+  }
+
   DepsLog* deps_log() const {
     return dep_loader_.deps_log();
   }
@@ -318,15 +497,35 @@ struct DependencyScan {
   bool LoadDyndeps(Node* node, DyndepFile* ddf, string* err) const;
 
  private:
-  bool RecomputeDirty(Node* node, vector<Node*>* stack, string* err);
+  struct Visit;
+
+  /// Start visiting |node| for RecomputeDirty(), setting |*started| if its
+  /// edge still has to be visited.
+  bool StartVisit(Node* node, vector<Node*>* stack, bool* started,
+                  string* err);
+  /// Carry on with |visit| until it is done or another node has to be
+  /// visited first, which is then put in |*next|.
+  bool ContinueVisit(Visit* visit, Node** next, string* err);
+  /// Stat |nodes| in one batch, as PrefetchStats() does.
+  void StatNodes(const vector<Node*>& nodes);
+  /// Work out the command hashes of those of |edges| that
+  /// RecomputeOutputDirty() will compare with the build log, as
+  /// PrefetchStats() does.
+  void HashCommands(const vector<Edge*>& edges);
   bool VerifyDAG(Node* node, vector<Node*>* stack, string* err);
 
   /// Recompute whether a given single output should be marked dirty.
   /// Returns true if so.
   bool RecomputeOutputDirty(Edge* edge, Node* most_recent_input,
-                            const string& command, Node* output);
+                            Node* output);
+
+  /// Whether |edge| is to be rebuilt only when the contents of its inputs
+  /// change, and they haven't since |output| was built.
+  bool InputContentsUnchanged(Edge* edge, Node* output);
 
   BuildLog* build_log_;
+  DigestLog* digest_log_;
+  const ResumeLog* resume_log_;
   DiskInterface* disk_interface_;
   ImplicitDepLoader dep_loader_;
   DyndepLoader dyndep_loader_;
@@ -0,0 +1,132 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "graph_json.h"
+
+#include "deps_log.h"
+#include "graph.h"
+#include "util.h"
+
+namespace {
+
+/// Mark @a index in @a marks, growing them as needed.
+/// @return false if it was already.
+bool Mark(vector<bool>* marks, size_t index) {
+  if (index >= marks->size())
+    marks->resize(index + 1);
+  if ((*marks)[index])
+    return false;
+  (*marks)[index] = true;
+  return true;
+}
+
+void AppendInt(int value, string* out) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%d", value);
+  out->append(buf);
+}
+
+}  // anonymous namespace
+
+void GraphJSON::AddTarget(Node* target) {
+  AddNode(target);
+  vector<Node*> stack(1, target);
+  while (!stack.empty()) {
+    Node* node = stack.back();
+    stack.pop_back();
+    Edge* edge = node->in_edge();
+    if (edge && Mark(&edges_, edge->id()))
+      AddEdge(edge, &stack);
+  }
+}
+
+void GraphJSON::AddNode(Node* node) {
+  if (!Mark(&nodes_, node->index()))
+    return;
+  line_ = "{\"node\":";
+  AppendInt(node->index(), &line_);
+  line_ += ",\"path\":";
+  AppendJSONString(node->path(), &line_);
+  line_ += "}\n";
+  WriteLine(line_);
+}
+
+void GraphJSON::AddEdge(Edge* edge, vector<Node*>* next) {
+  if (edge->dyndep_ && edge->dyndep_->dyndep_pending()) {
+    string err;
+    if (!dyndep_loader_.LoadDyndeps(edge->dyndep_, &err))
+      Warning("%s\n", err.c_str());
+  }
+
+  for (vector<Node*>::iterator i = edge->inputs_.begin();
+       i != edge->inputs_.end(); ++i)
+    AddNode(*i);
+  for (vector<Node*>::iterator o = edge->outputs_.begin();
+       o != edge->outputs_.end(); ++o)
+    AddNode(*o);
+
+  line_ = "{\"edge\":";
+  AppendInt(edge->id(), &line_);
+  line_ += ",\"rule\":";
+  AppendJSONString(edge->rule().name(), &line_);
+  line_ += ",\"inputs\":";
+  AppendIds(edge->inputs_.begin(), edge->inputs_.end(), &line_);
+  line_ += ",\"implicit\":";
+  AppendInt(edge->implicit_deps_, &line_);
+  line_ += ",\"order_only\":";
+  AppendInt(edge->order_only_deps_, &line_);
+  line_ += ",\"outputs\":";
+  AppendIds(edge->outputs_.begin(), edge->outputs_.end(), &line_);
+  line_ += ",\"implicit_outputs\":";
+  AppendInt(edge->implicit_outs_, &line_);
+  line_ += "}\n";
+  WriteLine(line_);
+  next->insert(next->end(), edge->inputs_.rbegin(), edge->inputs_.rend());
+
+  if (!deps_log_)
+    return;
+  for (vector<Node*>::iterator o = edge->outputs_.begin();
+       o != edge->outputs_.end(); ++o) {
+    DepsLog::Deps* deps = deps_log_->GetDeps(*o);
+    if (!deps || !deps_log_->IsDepsEntryLiveFor(*o))
+      continue;
+    vector<Node*> inputs(deps->nodes, deps->nodes + deps->node_count);
+    for (vector<Node*>::iterator i = inputs.begin(); i != inputs.end(); ++i)
+      AddNode(*i);
+    line_ = "{\"deps\":";
+    AppendInt((*o)->index(), &line_);
+    line_ += ",\"inputs\":";
+    AppendIds(inputs.begin(), inputs.end(), &line_);
+    line_ += "}\n";
+    WriteLine(line_);
+    next->insert(next->end(), inputs.rbegin(), inputs.rend());
+  }
+}
+
+void GraphJSON::AppendIds(const vector<Node*>::const_iterator& begin,
+                          const vector<Node*>::const_iterator& end,
+                          string* out) {
+  out->push_back('[');
+  for (vector<Node*>::const_iterator i = begin; i != end; ++i) {
+    if (i != begin)
+      out->push_back(',');
+    AppendInt((*i)->index(), out);
+  }
+  out->push_back(']');
+}
+
+void GraphJSON::WriteLine(const string& line) {
+  fwrite(line.data(), 1, line.size(), out_);
+}
@@ -0,0 +1,75 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef NINJA_GRAPH_JSON_H_
+#define NINJA_GRAPH_JSON_H_
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "dyndep.h"
+
+struct DepsLog;
+struct DiskInterface;
+struct Edge;
+struct Node;
+struct State;
+
+/// Writes the graph of some targets, as "-t graph --format=json" does: a
+/// line of JSON for each node, edge and deps log record, each once, and
+/// each node before the first line that names it, so that the graph can be
+/// read as it comes.
+///
+///   {"node":ID,"path":PATH}
+///   {"edge":ID,"rule":NAME,"inputs":[ID...],"implicit":N,"order_only":N,
+///    "outputs":[ID...],"implicit_outputs":N}
+///   {"deps":ID,"inputs":[ID...]}
+///
+/// where the last N of the inputs or outputs of an edge are implicit or
+/// order-only, and a deps line lists the inputs the deps log has for the
+/// output ID.
+struct GraphJSON {
+  /// @a deps_log may be NULL, for no deps lines.
+  GraphJSON(State* state, DiskInterface* disk_interface, DepsLog* deps_log,
+            FILE* out)
+      : dyndep_loader_(state, disk_interface), deps_log_(deps_log),
+        out_(out) {}
+
+  /// Write @a target and what it is built from, except what was already.
+  void AddTarget(Node* target);
+
+ private:
+  /// Write the line of @a node, unless already.
+  void AddNode(Node* node);
+  /// Write the line of @a edge and of its deps log records, and add their
+  /// nodes to @a next to be visited.
+  void AddEdge(Edge* edge, vector<Node*>* next);
+  void AppendIds(const vector<Node*>::const_iterator& begin,
+                 const vector<Node*>::const_iterator& end, string* out);
+  void WriteLine(const string& line);
+
+  DyndepLoader dyndep_loader_;
+  DepsLog* deps_log_;
+  FILE* out_;
+  /// By Node::index(), and by Edge::id(): what was written.
+  vector<bool> nodes_;
+  vector<bool> edges_;
+  string line_;
+};
+
+#endif  // NINJA_GRAPH_JSON_H_
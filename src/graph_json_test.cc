@@ -0,0 +1,105 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "graph_json.h"
+
+#include "deps_log.h"
+#include "graph.h"
+#include "test.h"
+
+namespace {
+
+struct GraphJSONTest : public StateTestWithBuiltinRules {
+  virtual void SetUp() {
+    temp_dir_.CreateAndEnter("GraphJSONTest");
+    string err;
+    ASSERT_TRUE(deps_log_.OpenForWrite("ninja_deps", &err));
+    ASSERT_EQ("", err);
+  }
+  virtual void TearDown() {
+    deps_log_.Close();
+    temp_dir_.Cleanup();
+  }
+
+  /// The lines written for |targets|, with a node's id replaced by its path.
+  vector<string> Write(const vector<string>& targets) {
+    FILE* f = tmpfile();
+    GraphJSON graph(&state_, &fs_, &deps_log_, f);
+    for (size_t i = 0; i < targets.size(); ++i)
+      graph.AddTarget(GetNode(targets[i]));
+    rewind(f);
+    vector<string> lines;
+    char buf[1024];
+    while (fgets(buf, sizeof(buf), f))
+      lines.push_back(buf);
+    fclose(f);
+    return lines;
+  }
+
+  string Id(const string& path) {
+    return Str(GetNode(path)->index());
+  }
+  string Str(int id) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%d", id);
+    return buf;
+  }
+
+  ScopedTempDir temp_dir_;
+  VirtualFileSystem fs_;
+  DepsLog deps_log_;
+};
+
+TEST_F(GraphJSONTest, NodesEdgesAndDeps) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"rule cc\n"
+"  command = cc $in > $out\n"
+"  deps = gcc\n"
+"build a.o: cc a.c | a.h || gen\n"
+"build gen: cat\n"
+"build \"x\": cat a.o\n"));
+  vector<Node*> deps(1, GetNode("b.h"));
+  ASSERT_TRUE(deps_log_.RecordDeps(GetNode("a.o"), 1, deps));
+
+  vector<string> targets(1, "\"x\"");
+  targets.push_back("a.o");
+  vector<string> lines = Write(targets);
+  ASSERT_EQ(10u, lines.size());
+  EXPECT_EQ("{\"node\":" + Id("\"x\"") + ",\"path\":\"\\\"x\\\"\"}\n",
+            lines[0]);
+  EXPECT_EQ("{\"node\":" + Id("a.o") + ",\"path\":\"a.o\"}\n", lines[1]);
+  EXPECT_EQ("{\"edge\":" + Str(GetNode("\"x\"")->in_edge()->id()) +
+            ",\"rule\":\"cat\",\"inputs\":[" + Id("a.o") + "],\"implicit\":0,"
+            "\"order_only\":0,\"outputs\":[" + Id("\"x\"") +
+            "],\"implicit_outputs\":0}\n", lines[2]);
+  EXPECT_EQ("{\"node\":" + Id("a.c") + ",\"path\":\"a.c\"}\n", lines[3]);
+  EXPECT_EQ("{\"node\":" + Id("a.h") + ",\"path\":\"a.h\"}\n", lines[4]);
+  EXPECT_EQ("{\"node\":" + Id("gen") + ",\"path\":\"gen\"}\n", lines[5]);
+  EXPECT_EQ("{\"edge\":" + Str(GetNode("a.o")->in_edge()->id()) +
+            ",\"rule\":\"cc\",\"inputs\":[" + Id("a.c") + "," + Id("a.h") +
+            "," + Id("gen") + "],\"implicit\":1,\"order_only\":1,"
+            "\"outputs\":[" + Id("a.o") + "],\"implicit_outputs\":0}\n",
+            lines[6]);
+  // The deps log's inputs come with the edge, and a.o again adds nothing.
+  EXPECT_EQ("{\"node\":" + Id("b.h") + ",\"path\":\"b.h\"}\n", lines[7]);
+  EXPECT_EQ("{\"deps\":" + Id("a.o") + ",\"inputs\":[" + Id("b.h") + "]}\n",
+            lines[8]);
+  EXPECT_EQ("{\"edge\":" + Str(GetNode("gen")->in_edge()->id()) +
+            ",\"rule\":\"cat\",\"inputs\":[],\"implicit\":0,"
+            "\"order_only\":0,\"outputs\":[" + Id("gen") +
+            "],\"implicit_outputs\":0}\n", lines[9]);
+}
+
+}  // anonymous namespace
@@ -14,6 +14,8 @@
 
 #include "graph.h"
 #include "build.h"
+#include "build_log.h"
+#include "deps_log.h"
 
 #include "test.h"
 
@@ -347,6 +349,28 @@ TEST_F(GraphTest, DependencyCycle) {
   ASSERT_EQ("dependency cycle: out -> mid -> in -> pre -> out", err);
 }
 
+TEST_F(GraphTest, DeepChain) {
+  // Deeper than a recursive walk could go on a small native stack.
+  const int kDepth = 100000;
+  string manifest;
+  for (int i = 1; i <= kDepth; ++i) {
+    char line[64];
+    snprintf(line, sizeof(line), "build n%d: cat n%d\n", i, i - 1);
+    manifest += line;
+  }
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_, manifest.c_str()));
+  fs_.Create("n0", "");
+
+  char top[16];
+  snprintf(top, sizeof(top), "n%d", kDepth);
+  string err;
+  EXPECT_TRUE(scan_.RecomputeDirty(GetNode(top), &err));
+  ASSERT_EQ("", err);
+  EXPECT_TRUE(GetNode("n1")->dirty());
+  EXPECT_TRUE(GetNode(top)->dirty());
+  EXPECT_FALSE(GetNode(top)->in_edge()->outputs_ready());
+}
+
 TEST_F(GraphTest, CycleInEdgesButNotInNodes1) {
   string err;
   AssertParse(&state_,
@@ -856,3 +880,182 @@ TEST_F(GraphTest, DyndepFileCircular) {
   EXPECT_EQ(1u, edge->implicit_deps_);
   EXPECT_EQ(1u, edge->order_only_deps_);
 }
+
+TEST_F(GraphTest, CommandHashMemoized) {
+  AssertParse(&state_,
+"rule r\n"
+"  command = cat $in > $out\n"
+"  rspfile = $out.rsp\n"
+"  rspfile_content = $in\n"
+"  restat = 1\n"
+"build out: r in1 in2\n"
+  );
+  Edge* edge = GetNode("out")->in_edge();
+  EXPECT_EQ("cat in1 in2 > out", edge->EvaluateCommand());
+  EXPECT_EQ(BuildLog::LogEntry::HashCommand(
+                "cat in1 in2 > out;rspfile=in1 in2"),
+            edge->CommandHash());
+  EXPECT_TRUE(edge->GetBindingBool("restat"));
+  EXPECT_FALSE(edge->GetBindingBool("generator"));
+
+  // Commands long enough to be hashed in pieces hash like the whole.
+  AssertParse(&state_,
+"build long: r $\n"
+"    a0 a1 a2 a3 a4 a5 a6 a7 a8 a9 b0 b1 b2 b3 b4 b5 b6 b7 b8 b9 $\n"
+"    c0 c1 c2 c3 c4 c5 c6 c7 c8 c9 d0 d1 d2 d3 d4 d5 d6 d7 d8 d9\n"
+"  rspfile_content =\n"
+"  command = link $in -o $out $in_newline\n"
+  );
+  Edge* long_edge = GetNode("long")->in_edge();
+  EXPECT_EQ(BuildLog::LogEntry::HashCommand(long_edge->EvaluateCommand(true)),
+            long_edge->CommandHash());
+
+  // The memoized values stand until they are cleared.
+  edge->env_->AddBinding("generator", "1");
+  EXPECT_FALSE(edge->GetBindingBool("generator"));
+  edge->ClearMemo();
+  EXPECT_TRUE(edge->GetBindingBool("generator"));
+}
+
+TEST_F(GraphTest, PrefetchHashesCommands) {
+  // Enough edges for the hashes to be worked out on several threads.
+  const int kEdges = 512;
+  string manifest = "rule r\n  command = cat $in > $out\n";
+  string all = "build all: phony";
+  for (int i = 0; i < kEdges; ++i) {
+    char line[64];
+    snprintf(line, sizeof(line), "build out%d: r in%d\n", i, i);
+    manifest += line;
+    snprintf(line, sizeof(line), " out%d", i);
+    all += line;
+  }
+  all += "\n";
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_, (manifest + all).c_str()));
+
+  BuildLog log;
+  for (int i = 0; i < kEdges; ++i) {
+    char in[16];
+    snprintf(in, sizeof(in), "in%d", i);
+    fs_.Create(in, "");
+  }
+  fs_.Tick();
+  for (int i = 0; i < kEdges; ++i) {
+    char out[16];
+    snprintf(out, sizeof(out), "out%d", i);
+    fs_.Create(out, "");
+    Edge* edge = GetNode(out)->in_edge();
+    log.RecordCommand(edge, 0, 1, fs_.now_);
+    // For the scan to hash it again.
+    edge->ClearMemo();
+  }
+  // One command changed since it last ran.
+  log.LookupByOutput("out7")->command_hash = Hash128();
+
+  DependencyScan scan(&state_, &log, NULL, &fs_, NULL);
+  scan.PrefetchStats(GetNode("all"));
+  string err;
+  EXPECT_TRUE(scan.RecomputeDirty(GetNode("all"), &err));
+  ASSERT_EQ("", err);
+  for (int i = 0; i < kEdges; ++i) {
+    char out[16];
+    snprintf(out, sizeof(out), "out%d", i);
+    EXPECT_EQ((i == 7), GetNode(out)->dirty());
+  }
+}
+
+TEST_F(GraphTest, AllInputsReadyCarriesOn) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"build a: cat src\n"
+"build b: cat src\n"
+"build c: cat src\n"
+"build out: cat a b src\n"));
+  Edge* edge = GetNode("out")->in_edge();
+  EXPECT_FALSE(edge->AllInputsReady());
+  EXPECT_EQ(0u, edge->ReadyInputs());
+  GetNode("a")->in_edge()->outputs_ready_ = true;
+  EXPECT_FALSE(edge->AllInputsReady());
+  EXPECT_EQ(1u, edge->ReadyInputs());
+  GetNode("b")->in_edge()->outputs_ready_ = true;
+  EXPECT_TRUE(edge->AllInputsReady());
+  EXPECT_EQ(3u, edge->ReadyInputs());
+
+  // An input added since is looked at, as are all of them once the graph
+  // is reset.
+  edge->inputs_.insert(edge->inputs_.begin(), GetNode("c"));
+  EXPECT_FALSE(edge->AllInputsReady());
+  edge->inputs_.erase(edge->inputs_.begin());
+  EXPECT_TRUE(edge->AllInputsReady());
+  GetNode("a")->in_edge()->outputs_ready_ = false;
+  edge->ClearMemo();
+  EXPECT_FALSE(edge->AllInputsReady());
+}
+
+TEST_F(GraphTest, RuleTemplate) {
+  AssertParse(&state_,
+"flags = -O2\n"
+"rule r\n"
+"  command = cc $$HOME$in -o ${out} $flags $in_newline\n"
+"build out: r in1 in2 | imp || order\n"
+"build out2: r in3\n"
+"  flags = -g\n"
+  );
+  const Rule* rule = state_.bindings_.LookupRule("r");
+  const RuleTemplate* tmpl = rule->GetTemplate("command");
+  ASSERT_TRUE(tmpl != NULL);
+  const vector<RuleTemplate::Segment>& segments = tmpl->segments();
+  ASSERT_EQ(8u, segments.size());
+  EXPECT_EQ(RuleTemplate::kText, segments[0].kind);
+  EXPECT_EQ("cc $HOME", segments[0].text);
+  EXPECT_EQ(RuleTemplate::kIn, segments[1].kind);
+  EXPECT_EQ(RuleTemplate::kOut, segments[3].kind);
+  EXPECT_EQ(RuleTemplate::kVariable, segments[5].kind);
+  EXPECT_EQ("flags", segments[5].text);
+  EXPECT_EQ(RuleTemplate::kInNewline, segments[7].kind);
+  EXPECT_EQ(strlen("cc $HOME -o   "), tmpl->text_size());
+  EXPECT_TRUE(rule->GetTemplate("description") == NULL);
+
+  EXPECT_EQ("cc $HOMEin1 in2 -o out -O2 in1\nin2",
+            GetNode("out")->in_edge()->EvaluateCommand());
+  EXPECT_EQ("cc $HOMEin3 -o out2 -g in3",
+            GetNode("out2")->in_edge()->EvaluateCommand());
+}
+
+// A scan after State::Reset() leaves the deps it loaded from the log before
+// in place, instead of adding them again.
+TEST_F(GraphTest, DepsLogDepsNotReloaded) {
+  ScopedTempDir temp_dir;
+  temp_dir.CreateAndEnter("GraphTest-deps");
+
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"rule cc\n"
+"  command = cc\n"
+"  deps = gcc\n"
+"build out.o: cc in.c\n"));
+  fs_.Create("in.c", "");
+  fs_.Create("a.h", "");
+  fs_.Create("b.h", "");
+  fs_.Create("out.o", "");
+
+  string err;
+  DepsLog deps_log;
+  ASSERT_TRUE(deps_log.OpenForWrite("ninja_deps", &err));
+  vector<Node*> deps;
+  deps.push_back(GetNode("a.h"));
+  deps.push_back(GetNode("b.h"));
+  ASSERT_TRUE(deps_log.RecordDeps(GetNode("out.o"), fs_.now_, deps));
+
+  DependencyScan scan(&state_, NULL, &deps_log, &fs_, NULL);
+  for (int i = 0; i < 2; ++i) {
+    state_.Reset();
+    EXPECT_TRUE(scan.RecomputeDirty(GetNode("out.o"), &err));
+    ASSERT_EQ("", err);
+    Edge* edge = GetNode("out.o")->in_edge();
+    ASSERT_EQ(3u, edge->inputs_.size());
+    EXPECT_EQ(2, edge->implicit_deps_);
+    EXPECT_EQ(1u, GetNode("a.h")->out_edges().size());
+    EXPECT_FALSE(GetNode("out.o")->dirty());
+  }
+
+  deps_log.Close();
+  temp_dir.Cleanup();
+}
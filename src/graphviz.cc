@@ -20,14 +20,28 @@
 #include "dyndep.h"
 #include "graph.h"
 
+namespace {
+
+/// Mark @a index in @a marks, growing them as needed.
+/// @return false if it was already.
+bool Mark(vector<bool>* marks, size_t index) {
+  if (index >= marks->size())
+    marks->resize(index + 1);
+  if ((*marks)[index])
+    return false;
+  (*marks)[index] = true;
+  return true;
+}
+
+}  // anonymous namespace
+
 void GraphViz::AddTarget(Node* node) {
-  if (visited_nodes_.find(node) != visited_nodes_.end())
+  if (!Mark(&visited_nodes_, node->index()))
     return;
 
   string pathstr = node->path();
   replace(pathstr.begin(), pathstr.end(), '\\', '/');
   printf("\"%p\" [label=\"%s\"]\n", node, pathstr.c_str());
-  visited_nodes_.insert(node);
 
   Edge* edge = node->in_edge();
 
@@ -37,9 +51,8 @@ void GraphViz::AddTarget(Node* node) {
     return;
   }
 
-  if (visited_edges_.find(edge) != visited_edges_.end())
+  if (!Mark(&visited_edges_, edge->id()))
     return;
-  visited_edges_.insert(edge);
 
   if (edge->dyndep_ && edge->dyndep_->dyndep_pending()) {
     std::string err;
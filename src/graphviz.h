@@ -15,7 +15,7 @@
 #ifndef NINJA_GRAPHVIZ_H_
 #define NINJA_GRAPHVIZ_H_
 
-#include <set>
+#include <vector>
 
 #include "dyndep.h"
 
@@ -24,7 +24,8 @@ struct Node;
 struct Edge;
 struct State;
 
-/// Runs the process of creating GraphViz .dot file output.
+/// Runs the process of creating GraphViz .dot file output, which is
+/// printed as the graph is walked.
 struct GraphViz {
   GraphViz(State* state, DiskInterface* disk_interface)
       : dyndep_loader_(state, disk_interface) {}
@@ -33,8 +34,9 @@ struct GraphViz {
   void Finish();
 
   DyndepLoader dyndep_loader_;
-  std::set<Node*> visited_nodes_;
-  std::set<Edge*> visited_edges_;
+  /// By Node::index(), and by Edge::id(): what was printed.
+  std::vector<bool> visited_nodes_;
+  std::vector<bool> visited_edges_;
 };
 
 #endif  // NINJA_GRAPHVIZ_H_
@@ -18,17 +18,43 @@
 using namespace std;
 
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
+#include "metrics.h"
+
 int random(int low, int high) {
   return int(low + (rand() / double(RAND_MAX)) * (high - low) + 0.5);
 }
 
 void RandomCommand(char** s) {
   int len = random(5, 100);
-  *s = new char[len];
+  *s = new char[len + 1];
   for (int i = 0; i < len; ++i)
     (*s)[i] = (char)random(32, 127);
+  (*s)[len] = '\0';
+}
+
+/// Count the hashes equal to the one before them whose commands aren't.
+template<typename Hash>
+int CountCollisions(pair<Hash, int>* hashes, int n, char** commands,
+                    bool print) {
+  sort(hashes, hashes + n);
+  int collision_count = 0;
+  for (int i = 1; i < n; ++i) {
+    if (hashes[i - 1].first == hashes[i].first) {
+      if (strcmp(commands[hashes[i - 1].second],
+                 commands[hashes[i].second]) != 0) {
+        if (print) {
+          printf("collision!\n  string 1: '%s'\n  string 2: '%s'\n",
+                 commands[hashes[i - 1].second],
+                 commands[hashes[i].second]);
+        }
+        collision_count++;
+      }
+    }
+  }
+  return collision_count;
 }
 
 int main() {
@@ -36,28 +62,29 @@ int main() {
 
   // Leak these, else 10% of the runtime is spent destroying strings.
   char** commands = new char*[N];
-  pair<uint64_t, int>* hashes = new pair<uint64_t, int>[N];
+  pair<Hash128, int>* hashes = new pair<Hash128, int>[N];
+  pair<uint64_t, int>* low_hashes = new pair<uint64_t, int>[N];
 
   srand((int)time(NULL));
 
+  size_t bytes = 0;
   for (int i = 0; i < N; ++i) {
     RandomCommand(&commands[i]);
-    hashes[i] = make_pair(BuildLog::LogEntry::HashCommand(commands[i]), i);
+    bytes += strlen(commands[i]);
   }
 
-  sort(hashes, hashes + N);
+  int64_t start = GetTimeMillis();
+  for (int i = 0; i < N; ++i)
+    hashes[i] = make_pair(BuildLog::LogEntry::HashCommand(commands[i]), i);
+  int64_t millis = GetTimeMillis() - start;
+  printf("hashed %d commands, %.1f MB, in %dms\n", N, bytes / 1e6,
+         (int)millis);
 
-  int collision_count = 0;
-  for (int i = 1; i < N; ++i) {
-    if (hashes[i - 1].first == hashes[i].first) {
-      if (strcmp(commands[hashes[i - 1].second],
-                 commands[hashes[i].second]) != 0) {
-        printf("collision!\n  string 1: '%s'\n  string 2: '%s'\n",
-               commands[hashes[i - 1].second],
-               commands[hashes[i].second]);
-        collision_count++;
-      }
-    }
-  }
-  printf("\n\n%d collisions after %d runs\n", collision_count, N);
+  for (int i = 0; i < N; ++i)
+    low_hashes[i] = make_pair(hashes[i].first.low, hashes[i].second);
+
+  int collision_count = CountCollisions(hashes, N, commands, true);
+  int low_collision_count = CountCollisions(low_hashes, N, commands, false);
+  printf("\n\n%d collisions after %d runs, %d in the low 64 bits\n",
+         collision_count, N, low_collision_count);
 }
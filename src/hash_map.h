@@ -17,9 +17,30 @@
 
 #include <algorithm>
 #include <string.h>
+#include <utility>
+#include <vector>
 #include "string_piece.h"
 #include "util.h"
 
+/// A 128-bit hash, as the CommandHasher of build_log.h computes them: wide
+/// enough that commands, and the action cache's keys, can be compared
+/// across machines without collisions to speak of.
+struct Hash128 {
+  Hash128() : low(0), high(0) {}
+  Hash128(uint64_t low, uint64_t high) : low(low), high(high) {}
+
+  bool operator==(const Hash128& o) const {
+    return low == o.low && high == o.high;
+  }
+  bool operator!=(const Hash128& o) const { return !(*this == o); }
+  bool operator<(const Hash128& o) const {
+    return high != o.high ? high < o.high : low < o.low;
+  }
+
+  uint64_t low;
+  uint64_t high;
+};
+
 // MurmurHash2, by Austin Appleby
 static inline
 unsigned int MurmurHash2(const void* key, size_t len) {
@@ -120,4 +141,162 @@ struct ExternalStringHashMap {
 #endif
 };
 
+/// An open-addressing hash table keyed by a StringPiece whose string is
+/// owned externally, for maps big enough that their lookups are bound by
+/// cache misses.  The hash of each key is kept in an array of its own that
+/// is probed linearly, so a lookup mostly reads a single cache line of
+/// hashes and compares a single key; neither chains nor growing the table
+/// touch the keys' strings.  Supports the parts of the map interface used
+/// for State::paths_.  Iteration order is unspecified, and inserting or
+/// erasing invalidates iterators.
+template<typename V>
+struct ExternalStringHashTable {
+  typedef std::pair<StringPiece, V> value_type;
+
+  template<typename Value, typename Table>
+  struct Iterator {
+    Iterator(Table* table, size_t slot) : table_(table), slot_(slot) {
+      SkipEmpty();
+    }
+
+    Value& operator*() const { return table_->slots_[slot_]; }
+    Value* operator->() const { return &table_->slots_[slot_]; }
+    Iterator& operator++() {
+      ++slot_;
+      SkipEmpty();
+      return *this;
+    }
+    bool operator==(const Iterator& other) const {
+      return slot_ == other.slot_;
+    }
+    bool operator!=(const Iterator& other) const {
+      return slot_ != other.slot_;
+    }
+
+   private:
+    void SkipEmpty() {
+      while (slot_ < table_->hashes_.size() && !table_->hashes_[slot_])
+        ++slot_;
+    }
+
+    Table* table_;
+    size_t slot_;
+  };
+  typedef Iterator<value_type, ExternalStringHashTable> iterator;
+  typedef Iterator<const value_type, const ExternalStringHashTable>
+      const_iterator;
+
+  ExternalStringHashTable() : size_(0) {}
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  size_t bucket_count() const { return hashes_.size(); }
+
+  iterator begin() { return iterator(this, 0); }
+  iterator end() { return iterator(this, hashes_.size()); }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, hashes_.size()); }
+
+  iterator find(StringPiece key) {
+    return iterator(this, Find(key, Hash(key)));
+  }
+  const_iterator find(StringPiece key) const {
+    return const_iterator(this, Find(key, Hash(key)));
+  }
+
+  V& operator[](StringPiece key) {
+    uint32_t hash = Hash(key);
+    size_t slot = Find(key, hash);
+    if (slot != hashes_.size())
+      return slots_[slot].second;
+    if ((size_ + 1) * 4 > hashes_.size() * 3)
+      Rehash(hashes_.empty() ? kMinCapacity : hashes_.size() * 2);
+    slot = FreeSlot(hash);
+    hashes_[slot] = hash;
+    slots_[slot] = value_type(key, V());
+    ++size_;
+    return slots_[slot].second;
+  }
+
+  /// Make room for |count| keys without growing the table again.
+  void reserve(size_t count) {
+    size_t capacity = kMinCapacity;
+    while (capacity * 3 < count * 4)
+      capacity *= 2;
+    if (capacity > hashes_.size())
+      Rehash(capacity);
+  }
+
+  size_t erase(StringPiece key) {
+    size_t hole = Find(key, Hash(key));
+    if (hole == hashes_.size())
+      return 0;
+    // Shift the keys after the hole back into it, unless that would take
+    // them before the slot they hash to, so that no probe stops early.
+    size_t mask = hashes_.size() - 1;
+    for (size_t i = (hole + 1) & mask; hashes_[i]; i = (i + 1) & mask) {
+      size_t home = hashes_[i] & mask;
+      if (((i - home) & mask) >= ((i - hole) & mask)) {
+        hashes_[hole] = hashes_[i];
+        slots_[hole] = slots_[i];
+        hole = i;
+      }
+    }
+    hashes_[hole] = 0;
+    slots_[hole] = value_type();
+    --size_;
+    return 1;
+  }
+
+ private:
+  static const size_t kMinCapacity = 16;
+
+  /// The hash of |key|, never 0, which marks empty slots.
+  static uint32_t Hash(StringPiece key) {
+    uint32_t hash = MurmurHash2(key.str_, key.len_);
+    return hash ? hash : 1;
+  }
+
+  /// The slot holding |key|, or bucket_count() if there is none.
+  size_t Find(StringPiece key, uint32_t hash) const {
+    if (hashes_.empty())
+      return 0;
+    size_t mask = hashes_.size() - 1;
+    for (size_t i = hash & mask; hashes_[i]; i = (i + 1) & mask) {
+      if (hashes_[i] == hash && slots_[i].first == key)
+        return i;
+    }
+    return hashes_.size();
+  }
+
+  /// The first empty slot from where |hash| belongs.
+  size_t FreeSlot(uint32_t hash) const {
+    size_t mask = hashes_.size() - 1;
+    size_t i = hash & mask;
+    while (hashes_[i])
+      i = (i + 1) & mask;
+    return i;
+  }
+
+  void Rehash(size_t capacity) {
+    std::vector<uint32_t> hashes(capacity, 0);
+    std::vector<value_type> slots(capacity);
+    hashes_.swap(hashes);
+    slots_.swap(slots);
+    for (size_t i = 0; i < hashes.size(); ++i) {
+      if (!hashes[i])
+        continue;
+      size_t slot = FreeSlot(hashes[i]);
+      hashes_[slot] = hashes[i];
+      slots_[slot] = slots[i];
+    }
+  }
+
+  /// The hash of the key in each slot, or 0 for an empty one.  The
+  /// number of slots is a power of two.
+  std::vector<uint32_t> hashes_;
+  std::vector<value_type> slots_;
+  size_t size_;
+};
+
 #endif // NINJA_MAP_H_
@@ -0,0 +1,75 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "hash_map.h"
+#include "metrics.h"
+
+using namespace std;
+
+/// Insert |keys| into a new |Map|, then look up each of |lookups|, which
+/// are copies of the keys at |order|, printing how long each half took.
+template<typename Map>
+void Run(const char* name, const vector<string>& keys,
+         const vector<string>& lookups, const vector<size_t>& order) {
+  Map map;
+  int64_t start = GetTimeMillis();
+  for (size_t i = 0; i < keys.size(); ++i)
+    map[keys[i]] = i;
+  int64_t inserted = GetTimeMillis();
+  size_t found = 0;
+  for (size_t i = 0; i < order.size(); ++i)
+    found += map.find(lookups[i])->second == order[i];
+  int64_t looked_up = GetTimeMillis();
+  printf("%-24s insert %5dms  lookup %5dms  (%d found)\n", name,
+         (int)(inserted - start), (int)(looked_up - inserted), (int)found);
+}
+
+int main(int argc, char* argv[]) {
+  // Paths like those of a large build: many files in many directories.
+  int count = argc > 1 ? atoi(argv[1]) : 3 * 1000 * 1000;
+  vector<string> keys;
+  keys.reserve(count);
+  for (int i = 0; i < count; ++i) {
+    char path[64];
+    snprintf(path, sizeof(path), "obj/third_party/lib%d/src/file%d.o",
+             i / 100, i % 100);
+    keys.push_back(path);
+  }
+  vector<size_t> order;
+  for (int i = 0; i < count; ++i)
+    order.push_back(i);
+  srand(42);
+  random_shuffle(order.begin(), order.end());
+  // Like the paths a parser looks up, those looked up are not the keys
+  // themselves, and are read in order.
+  vector<string> lookups;
+  lookups.reserve(count);
+  for (int i = 0; i < count; ++i)
+    lookups.push_back(keys[order[i]]);
+
+  for (int j = 0; j < 3; ++j) {
+    Run<ExternalStringHashMap<size_t>::Type>("ExternalStringHashMap", keys,
+                                             lookups, order);
+    Run<ExternalStringHashTable<size_t> >("ExternalStringHashTable", keys,
+                                          lookups, order);
+  }
+  return 0;
+}
@@ -0,0 +1,116 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "hash_map.h"
+
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+namespace {
+
+typedef ExternalStringHashTable<int> Table;
+
+// The table doesn't own its keys.
+vector<string> MakeKeys(int count) {
+  vector<string> keys;
+  for (int i = 0; i < count; ++i) {
+    char key[32];
+    snprintf(key, sizeof(key), "out/obj/%d.o", i);
+    keys.push_back(key);
+  }
+  return keys;
+}
+
+TEST(ExternalStringHashTableTest, InsertAndFind) {
+  vector<string> keys = MakeKeys(1000);
+  Table table;
+  EXPECT_TRUE(table.empty());
+  EXPECT_TRUE(table.find("out/obj/0.o") == table.end());
+  for (size_t i = 0; i < keys.size(); ++i)
+    table[keys[i]] = (int)i;
+  // Assigning again leaves the size alone.
+  table[keys[7]] = 7;
+  EXPECT_EQ(keys.size(), table.size());
+  EXPECT_LE(table.size() * 4, table.bucket_count() * 3);
+
+  for (size_t i = 0; i < keys.size(); ++i) {
+    Table::const_iterator found =
+        static_cast<const Table&>(table).find(string(keys[i]));
+    ASSERT_TRUE(found != static_cast<const Table&>(table).end());
+    EXPECT_EQ((int)i, found->second);
+  }
+  EXPECT_TRUE(table.find("out/obj/1000.o") == table.end());
+
+  vector<bool> seen(keys.size());
+  for (Table::iterator i = table.begin(); i != table.end(); ++i) {
+    EXPECT_FALSE(seen[i->second]);
+    EXPECT_EQ(keys[i->second], i->first.AsString());
+    seen[i->second] = true;
+  }
+  EXPECT_EQ(vector<bool>(keys.size(), true), seen);
+}
+
+TEST(ExternalStringHashTableTest, Erase) {
+  vector<string> keys = MakeKeys(2000);
+  Table table;
+  map<string, int> expected;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    table[keys[i]] = (int)i;
+    expected[keys[i]] = (int)i;
+  }
+  // Erase keys all over the table, so that some of the keys left behind
+  // are shifted back, across the end of the table too.
+  for (size_t i = 0; i < keys.size(); i += 3) {
+    EXPECT_EQ(1u, table.erase(keys[i]));
+    expected.erase(keys[i]);
+  }
+  EXPECT_EQ(0u, table.erase(keys[0]));
+  EXPECT_EQ(0u, table.erase("missing"));
+
+  EXPECT_EQ(expected.size(), table.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    Table::iterator found = table.find(keys[i]);
+    if (expected.count(keys[i])) {
+      ASSERT_TRUE(found != table.end());
+      EXPECT_EQ((int)i, found->second);
+    } else {
+      EXPECT_TRUE(found == table.end());
+    }
+  }
+  size_t count = 0;
+  for (Table::iterator i = table.begin(); i != table.end(); ++i)
+    ++count;
+  EXPECT_EQ(expected.size(), count);
+}
+
+TEST(ExternalStringHashTableTest, Reserve) {
+  vector<string> keys = MakeKeys(100);
+  Table table;
+  table[keys[0]] = 0;
+  table.reserve(keys.size());
+  size_t buckets = table.bucket_count();
+  EXPECT_LE(keys.size() * 4, buckets * 3);
+  for (size_t i = 0; i < keys.size(); ++i)
+    table[keys[i]] = (int)i;
+  EXPECT_EQ(buckets, table.bucket_count());
+  EXPECT_EQ(0, table.find(keys[0])->second);
+  EXPECT_EQ(99, table.find(keys[99])->second);
+}
+
+}  // anonymous namespace
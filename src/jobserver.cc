@@ -0,0 +1,246 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "jobserver.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <vector>
+
+#include "string_piece_util.h"
+#include "util.h"
+
+Jobserver::Jobserver() : fd_(-1), child_fd_(-1) {}
+
+Jobserver::~Jobserver() {
+  Close();
+}
+
+// static
+bool Jobserver::ParseMakeflags(const string& makeflags, string* auth) {
+  bool found = false;
+  vector<StringPiece> words = SplitStringPiece(makeflags, ' ');
+  for (vector<StringPiece>::iterator w = words.begin(); w != words.end(); ++w) {
+    // Make 4.2 and later say --jobserver-auth; older ones --jobserver-fds.
+    // The last one given wins.
+    static const char* const kOptions[] = {
+      "--jobserver-auth=", "--jobserver-fds="
+    };
+    for (size_t i = 0; i < sizeof(kOptions) / sizeof(kOptions[0]); ++i) {
+      size_t len = strlen(kOptions[i]);
+      if (w->len_ > len && memcmp(w->str_, kOptions[i], len) == 0) {
+        *auth = string(w->str_ + len, w->len_ - len);
+        found = true;
+      }
+    }
+  }
+  return found;
+}
+
+#ifdef _WIN32
+
+bool Jobserver::Connect(const string& makeflags, string* err) {
+  string auth;
+  if (!ParseMakeflags(makeflags, &auth))
+    return false;
+  *err = "jobserver not supported on Windows";
+  return false;
+}
+
+bool Jobserver::Serve(int parallelism, string* err) {
+  *err = "jobserver not supported on Windows";
+  return false;
+}
+
+bool Jobserver::Acquire() {
+  return false;
+}
+
+void Jobserver::Release() {}
+
+void Jobserver::Close() {}
+
+#else  // _WIN32
+
+namespace {
+
+/// Open |path| for our own use: readable and writable, without blocking and
+/// without leaking into the commands we run.
+int OpenNonBlocking(const string& path) {
+  int fd = open(path.c_str(), O_RDWR | O_NONBLOCK);
+  if (fd >= 0)
+    SetCloseOnExec(fd);
+  return fd;
+}
+
+}  // anonymous namespace
+
+bool Jobserver::Connect(const string& makeflags, string* err) {
+  string auth;
+  if (!ParseMakeflags(makeflags, &auth))
+    return false;
+
+  if (auth.compare(0, 5, "fifo:") == 0) {
+    fd_ = OpenNonBlocking(auth.substr(5));
+    if (fd_ < 0) {
+      *err = "opening jobserver '" + auth.substr(5) + "': " + strerror(errno);
+      return false;
+    }
+    return true;
+  }
+
+  int read_fd, write_fd;
+  char extra;
+  if (sscanf(auth.c_str(), "%d,%d%c", &read_fd, &write_fd, &extra) != 2) {
+    *err = "unknown jobserver '" + auth + "'";
+    return false;
+  }
+  // Make passes negative fds, or closes them, for commands it doesn't
+  // consider recursive makes.
+  if (read_fd < 0 || write_fd < 0 || fcntl(read_fd, F_GETFD) < 0 ||
+      fcntl(write_fd, F_GETFD) < 0) {
+    *err = "jobserver pipe not inherited (prefix the command with '+')";
+    return false;
+  }
+  // The pipe is shared with the other tools, so it must stay blocking for
+  // them.  Linux lets us open it afresh to get a non-blocking handle of our
+  // own; elsewhere only the named jobserver of make 4.4 can be used.
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/self/fd/%d", read_fd);
+  fd_ = OpenNonBlocking(path);
+  if (fd_ < 0) {
+    *err = "can't read jobserver pipe without blocking (needs make 4.4's "
+           "--jobserver-style=fifo)";
+    return false;
+  }
+  return true;
+}
+
+bool Jobserver::Serve(int parallelism, string* err) {
+  if (parallelism == INT_MAX) {
+    *err = "can't serve unlimited jobs; pass -j N";
+    return false;
+  }
+
+  // A named pipe, unlike an anonymous one, can be opened twice: once
+  // blocking for the children and once non-blocking for us.  It can be
+  // removed again once both are open.
+  const char* tmpdir = getenv("TMPDIR");
+  string dir = string(tmpdir && *tmpdir ? tmpdir : "/tmp") +
+      "/ninja-jobserver-XXXXXX";
+  if (!mkdtemp(&dir[0])) {
+    *err = "mkdtemp(" + dir + "): " + strerror(errno);
+    return false;
+  }
+  string path = dir + "/fifo";
+  if (mkfifo(path.c_str(), 0600) < 0) {
+    *err = "mkfifo(" + path + "): " + strerror(errno);
+    rmdir(dir.c_str());
+    return false;
+  }
+  fd_ = OpenNonBlocking(path);
+  if (fd_ >= 0)
+    child_fd_ = open(path.c_str(), O_RDWR);
+  int open_errno = errno;
+  unlink(path.c_str());
+  rmdir(dir.c_str());
+  if (fd_ < 0 || child_fd_ < 0) {
+    *err = "opening jobserver '" + path + "': " + strerror(open_errno);
+    Close();
+    return false;
+  }
+
+  // We hold the implicit token for our own first job.
+  for (int i = 1; i < parallelism; ++i) {
+    if (write(fd_, "+", 1) != 1) {
+      *err = string("filling jobserver: ") + strerror(errno);
+      Close();
+      return false;
+    }
+  }
+
+  // Keep whatever else is in MAKEFLAGS, but replace what it says about
+  // parallelism.
+  string makeflags;
+  if (const char* old = getenv("MAKEFLAGS")) {
+    vector<StringPiece> words = SplitStringPiece(old, ' ');
+    for (vector<StringPiece>::iterator w = words.begin();
+         w != words.end(); ++w) {
+      string word = w->AsString();
+      if (word.empty() || word.compare(0, 2, "-j") == 0 ||
+          word.compare(0, 12, "--jobserver-") == 0)
+        continue;
+      makeflags += word + " ";
+    }
+  }
+  char flags[128];
+  snprintf(flags, sizeof(flags),
+           "-j%d --jobserver-fds=%d,%d --jobserver-auth=%d,%d", parallelism,
+           child_fd_, child_fd_, child_fd_, child_fd_);
+  makeflags += flags;
+  if (setenv("MAKEFLAGS", makeflags.c_str(), 1) < 0) {
+    *err = string("setenv(MAKEFLAGS): ") + strerror(errno);
+    Close();
+    return false;
+  }
+  return true;
+}
+
+bool Jobserver::Acquire() {
+  if (fd_ < 0)
+    return false;
+  char token;
+  ssize_t len;
+  do {
+    len = read(fd_, &token, 1);
+  } while (len < 0 && errno == EINTR);
+  if (len != 1)
+    return false;
+  tokens_.push_back(token);
+  return true;
+}
+
+void Jobserver::Release() {
+  if (tokens_.empty())
+    return;
+  char token = tokens_[tokens_.size() - 1];
+  tokens_.resize(tokens_.size() - 1);
+  ssize_t len;
+  do {
+    len = write(fd_, &token, 1);
+  } while (len < 0 && errno == EINTR);
+  if (len != 1)
+    Warning("returning jobserver token: %s", strerror(errno));
+}
+
+void Jobserver::Close() {
+  while (!tokens_.empty())
+    Release();
+  if (fd_ >= 0)
+    close(fd_);
+  if (child_fd_ >= 0)
+    close(child_fd_);
+  fd_ = child_fd_ = -1;
+}
+
+#endif  // _WIN32
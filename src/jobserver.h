@@ -0,0 +1,64 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_JOBSERVER_H_
+#define NINJA_JOBSERVER_H_
+
+#include <string>
+using namespace std;
+
+/// A GNU make jobserver: a pipe shared by nested build tools that holds a
+/// token for every job they may run in total, beyond the one job each of
+/// them may always run.  A tool takes a token before starting another job
+/// and puts it back when the job is done.
+struct Jobserver {
+  Jobserver();
+  ~Jobserver();
+
+  /// Join the jobserver advertised in |makeflags| (the value of MAKEFLAGS).
+  /// Returns false if there is none, filling |err| only if one is
+  /// advertised but can't be used.
+  bool Connect(const string& makeflags, string* err);
+
+  /// Become the jobserver of our children, sharing |parallelism| jobs
+  /// between them and us, and advertise it in MAKEFLAGS.
+  bool Serve(int parallelism, string* err);
+
+  bool enabled() const { return fd_ >= 0; }
+
+  /// Take a token if one is free, without blocking.
+  bool Acquire();
+
+  /// Put back the most recently acquired token.
+  void Release();
+
+  /// Number of tokens currently held.
+  size_t tokens() const { return tokens_.size(); }
+
+  /// Find the jobserver in |makeflags|: "R,W" for an inherited pipe or
+  /// "fifo:PATH" for a named one.  Returns false if there is none.
+  static bool ParseMakeflags(const string& makeflags, string* auth);
+
+ private:
+  void Close();
+
+  /// Tokens read from the jobserver, to be written back as they were.
+  string tokens_;
+  /// Our own non-blocking descriptor for the jobserver.
+  int fd_;
+  /// The descriptor for a served jobserver that children inherit.
+  int child_fd_;
+};
+
+#endif  // NINJA_JOBSERVER_H_
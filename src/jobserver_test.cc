@@ -0,0 +1,110 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "jobserver.h"
+
+#include <stdlib.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "test.h"
+
+namespace {
+
+TEST(JobserverTest, ParseMakeflags) {
+  string auth;
+  EXPECT_FALSE(Jobserver::ParseMakeflags("", &auth));
+  EXPECT_FALSE(Jobserver::ParseMakeflags("ks -j4", &auth));
+  EXPECT_TRUE(Jobserver::ParseMakeflags(" -j4 --jobserver-fds=3,4 -j",
+                                        &auth));
+  EXPECT_EQ("3,4", auth);
+  EXPECT_TRUE(Jobserver::ParseMakeflags(
+      "-j4 --jobserver-fds=3,4 --jobserver-auth=fifo:/tmp/GMfifo1", &auth));
+  EXPECT_EQ("fifo:/tmp/GMfifo1", auth);
+}
+
+#ifndef _WIN32
+TEST(JobserverTest, Fifo) {
+  ScopedTempDir temp_dir;
+  temp_dir.CreateAndEnter("NinjaJobserverTest");
+  ASSERT_EQ(0, mkfifo("fifo", 0600));
+  // Hold the fifo open so that it keeps its tokens between our opens.
+  int fd = open("fifo", O_RDWR);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(2, write(fd, "+-", 2));
+
+  Jobserver jobserver;
+  string err;
+  ASSERT_TRUE(jobserver.Connect("-j3 --jobserver-auth=fifo:fifo", &err));
+  EXPECT_EQ("", err);
+  EXPECT_TRUE(jobserver.Acquire());
+  EXPECT_TRUE(jobserver.Acquire());
+  EXPECT_FALSE(jobserver.Acquire());
+  EXPECT_EQ(2u, jobserver.tokens());
+  jobserver.Release();
+  EXPECT_EQ(1u, jobserver.tokens());
+
+  // Tokens still held go back when the jobserver is closed.
+  {
+    Jobserver other;
+    ASSERT_TRUE(other.Connect("--jobserver-auth=fifo:fifo", &err));
+    EXPECT_TRUE(other.Acquire());
+    EXPECT_FALSE(other.Acquire());
+  }
+  EXPECT_TRUE(jobserver.Acquire());
+  EXPECT_FALSE(jobserver.Acquire());
+
+  close(fd);
+  temp_dir.Cleanup();
+}
+
+TEST(JobserverTest, UnusablePipe) {
+  Jobserver jobserver;
+  string err;
+  EXPECT_FALSE(jobserver.Connect("--jobserver-auth=-2,-2", &err));
+  EXPECT_EQ("jobserver pipe not inherited (prefix the command with '+')", err);
+  EXPECT_FALSE(jobserver.enabled());
+}
+
+TEST(JobserverTest, Serve) {
+  const char* old = getenv("MAKEFLAGS");
+  string old_makeflags = old ? old : "";
+  setenv("MAKEFLAGS", "k -j8 --jobserver-auth=5,6", 1);
+
+  Jobserver jobserver;
+  string err;
+  ASSERT_TRUE(jobserver.Serve(3, &err));
+  EXPECT_EQ("", err);
+  string makeflags = getenv("MAKEFLAGS");
+  EXPECT_EQ(0u, makeflags.find("k -j3 --jobserver-fds="));
+  string auth;
+  ASSERT_TRUE(Jobserver::ParseMakeflags(makeflags, &auth));
+  EXPECT_NE("5,6", auth);
+
+  // We may run two jobs beyond the first.
+  EXPECT_TRUE(jobserver.Acquire());
+  EXPECT_TRUE(jobserver.Acquire());
+  EXPECT_FALSE(jobserver.Acquire());
+
+  if (old)
+    setenv("MAKEFLAGS", old_makeflags.c_str(), 1);
+  else
+    unsetenv("MAKEFLAGS");
+}
+#endif  // _WIN32
+
+}  // anonymous namespace
@@ -16,9 +16,53 @@
 
 #include <stdio.h>
 
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define NINJA_LEXER_SSE2 1
+#endif
+
 #include "eval_env.h"
 #include "util.h"
 
+namespace {
+
+/// Skip ahead from |p| over 16-byte blocks of [p, end) that hold none of
+/// the |count| bytes of |stops|.  Returns the first such byte in the last
+/// block looked at, or the start of a block past which there are fewer than
+/// 16 bytes left for the re2c scanner to handle.  Paths and commands are
+/// mostly long runs of plain bytes, which this gets through without the
+/// scanner's per-byte state transitions.
+inline const char* SkipPlainBytes(const char* p, const char* end,
+                                  const char* stops, int count) {
+#ifdef NINJA_LEXER_SSE2
+  __m128i stop[8];
+  for (int i = 0; i < count; ++i)
+    stop[i] = _mm_set1_epi8(stops[i]);
+  while (end - p >= 16) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i hits = _mm_cmpeq_epi8(block, stop[0]);
+    for (int i = 1; i < count; ++i)
+      hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, stop[i]));
+    int mask = _mm_movemask_epi8(hits);
+    if (mask)
+      return p + __builtin_ctz(mask);
+    p += 16;
+  }
+#else
+  (void)end;
+  (void)stops;
+  (void)count;
+#endif
+  return p;
+}
+
+/// The bytes that end a run of literal text in an eval string.
+const char kEvalStops[] = { '$', ' ', ':', '\r', '\n', '|', '\0' };
+/// The bytes that end a comment.
+const char kCommentStops[] = { '\n', '\0' };
+
+}  // anonymous namespace
+
 bool Lexer::Error(const string& message, string* err) {
   // Compute line/column.
   int line = 1;
@@ -118,8 +162,16 @@ Lexer::Token Lexer::ReadToken() {
   const char* q;
   const char* start;
   Lexer::Token token;
+  const char* end = input_.str_ + input_.len_;
   for (;;) {
     start = p;
+    if (*p == '#') {
+      const char* text_end = SkipPlainBytes(p + 1, end, kCommentStops, 2);
+      if (text_end > p + 1 && *text_end == '\n') {
+        p = text_end + 1;
+        continue;
+      }
+    }
     /*!re2c
     re2c:define:YYCTYPE = "unsigned char";
     re2c:define:YYCURSOR = p;
@@ -206,8 +258,14 @@ bool Lexer::ReadEvalString(EvalString* eval, bool path, string* err) {
   const char* p = ofs_;
   const char* q;
   const char* start;
+  const char* end = input_.str_ + input_.len_;
   for (;;) {
     start = p;
+    p = SkipPlainBytes(p, end, kEvalStops, sizeof(kEvalStops));
+    if (p != start) {
+      eval->AddText(StringPiece(start, p - start));
+      continue;
+    }
     /*!re2c
     [^$ :\r\n|\000]+ {
       eval->AddText(StringPiece(start, p - start));
@@ -37,6 +37,23 @@ TEST(Lexer, ReadEvalStringEscapes) {
             eval.Serialize());
 }
 
+TEST(Lexer, PersistedEvalStringOutlivesInput) {
+  EvalString copy;
+  {
+    string input = "$in -o ${out}.o $$x\n";
+    Lexer lexer(input.c_str());
+    EvalString eval;
+    string err;
+    EXPECT_TRUE(lexer.ReadVarValue(&eval, &err));
+    EXPECT_EQ("", err);
+    eval.Persist();
+    copy = eval;
+    input.assign(input.size(), 'z');
+  }
+  EXPECT_EQ("[$in][ -o ][$out][.o $x]", copy.Serialize());
+  EXPECT_EQ("${in} -o ${out}.o $x", copy.Unparse());
+}
+
 TEST(Lexer, ReadIdent) {
   Lexer lexer("foo baR baz_123 foo-bar");
   string ident;
@@ -94,3 +111,33 @@ TEST(Lexer, Tabs) {
   EXPECT_EQ(Lexer::ERROR, token);
   EXPECT_EQ("tabs are not allowed, use spaces", lexer.DescribeLastError());
 }
+
+TEST(Lexer, LongRuns) {
+  // Runs of text and comments long enough to be skipped a block at a time
+  // stop at each delimiter, wherever it falls in a block.
+  string text;
+  for (int i = 0; i < 40; ++i)
+    text += "abcdefghijklmnopqrstuvwxyz"[i % 26];
+  // Each delimiter, and what it ends the path with.
+  const char* delims[][2] = {
+    { "$x\n", "[$x]" }, { " \n", "" }, { ":\n", "" }, { "|\n", "" },
+    { "\n", "" },
+  };
+  for (size_t i = 0; i < sizeof(delims) / sizeof(delims[0]); ++i) {
+    for (size_t len = 15; len < 34; ++len) {
+      string path = text.substr(0, len);
+      string input = "# " + text + "\nbuild " + path + delims[i][0];
+      Lexer lexer(input.c_str());
+      EXPECT_EQ(Lexer::BUILD, lexer.ReadToken());
+      EvalString eval;
+      string err;
+      EXPECT_TRUE(lexer.ReadPath(&eval, &err));
+      EXPECT_EQ("[" + path + "]" + delims[i][1], eval.Serialize());
+    }
+  }
+
+  // A long comment running into the end of the input is still an error.
+  string comment = "# " + text + text;
+  Lexer lexer(comment.c_str());
+  EXPECT_EQ(Lexer::ERROR, lexer.ReadToken());
+}
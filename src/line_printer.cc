@@ -14,6 +14,10 @@
 
 #include "line_printer.h"
 
+#include <algorithm>
+
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #ifdef _WIN32
@@ -24,13 +28,19 @@
 #else
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <termios.h>
 #include <sys/time.h>
 #endif
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 
 #include "util.h"
 
-LinePrinter::LinePrinter() : have_blank_line_(true), console_locked_(false) {
+LinePrinter::LinePrinter()
+    : have_blank_line_(true), console_locked_(false), extra_lines_(0) {
   const char* term = getenv("TERM");
 #ifndef _WIN32
   smart_terminal_ = isatty(1) && term && string(term) != "dumb";
@@ -73,14 +83,12 @@ void LinePrinter::Print(string to_print, LineType type) {
     return;
   }
 
-  if (smart_terminal_) {
+  if (smart_terminal_ && type == ELIDE) {
+#ifdef _WIN32
     printf("\r");  // Print over previous line, if any.
     // On Windows, calling a C library function writing to stdout also handles
     // pausing the executable when the "Pause" key or Ctrl-S is pressed.
-  }
 
-  if (smart_terminal_ && type == ELIDE) {
-#ifdef _WIN32
     CONSOLE_SCREEN_BUFFER_INFO csbi;
     GetConsoleScreenBufferInfo(console_, &csbi);
 
@@ -108,15 +116,60 @@ void LinePrinter::Print(string to_print, LineType type) {
     if ((ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0) && size.ws_col) {
       to_print = ElideMiddle(to_print, size.ws_col);
     }
-    printf("%s", to_print.c_str());
-    printf("\x1B[K");  // Clear to end of line.
+    // Print over the previous line and clear to the end of it in a single
+    // write, so a redraw costs one trip to the terminal.
+    string line;
+    line.reserve(to_print.size() + 4);
+    line += '\r';
+    line += to_print;
+    // Clearing to the end of the screen also drops PrintMultiLine()'s lines.
+    line += extra_lines_ ? "\x1B[J" : "\x1B[K";
+    extra_lines_ = 0;
+    fwrite(line.data(), 1, line.size(), stdout);
     fflush(stdout);
 #endif
 
     have_blank_line_ = false;
   } else {
-    printf("%s\n", to_print.c_str());
+    if (smart_terminal_)
+      to_print.insert(0, 1, '\r');  // Print over previous line, if any.
+    to_print += '\n';
+    fwrite(to_print.data(), 1, to_print.size(), stdout);
+  }
+}
+
+void LinePrinter::PrintMultiLine(string to_print,
+                                 const vector<string>& lines) {
+#ifndef _WIN32
+  winsize size;
+  if (!console_locked_ && smart_terminal_ &&
+      ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col &&
+      size.ws_row > 1) {
+    // Draw every line, then go back up to the first, in one write.  Each
+    // line is only cleared past its own end, and the screen below the
+    // last one only if it used to show more.
+    size_t count = min(lines.size(), (size_t)size.ws_row - 1);
+    string out = "\r" + ElideMiddle(to_print, size.ws_col) + "\x1B[K";
+    for (size_t i = 0; i < count; ++i) {
+      out += "\n";
+      out += ElideMiddle(lines[i], size.ws_col);
+      out += "\x1B[K";
+    }
+    if (count < extra_lines_)
+      out += "\x1B[J";
+    if (count) {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "\x1B[%dA", (int)count);
+      out += buf;
+    }
+    fwrite(out.data(), 1, out.size(), stdout);
+    fflush(stdout);
+    extra_lines_ = count;
+    have_blank_line_ = false;
+    return;
   }
+#endif
+  Print(to_print, ELIDE);
 }
 
 void LinePrinter::PrintOrBuffer(const char* data, size_t size) {
@@ -129,19 +182,112 @@ void LinePrinter::PrintOrBuffer(const char* data, size_t size) {
   }
 }
 
+void LinePrinter::PrintOrBuffer(const vector<StringPiece>& pieces) {
+  if (console_locked_) {
+    for (vector<StringPiece>::const_iterator p = pieces.begin();
+         p != pieces.end(); ++p)
+      output_buffer_.append(p->str_, p->len_);
+    return;
+  }
+#ifdef _WIN32
+  for (vector<StringPiece>::const_iterator p = pieces.begin();
+       p != pieces.end(); ++p)
+    fwrite(p->str_, 1, p->len_, stdout);
+#else
+  // What stdio holds goes first.
+  fflush(stdout);
+  vector<struct iovec> iov;
+  for (vector<StringPiece>::const_iterator p = pieces.begin();
+       p != pieces.end(); ++p) {
+    if (p->len_ == 0)
+      continue;
+    struct iovec v = { const_cast<char*>(p->str_), p->len_ };
+    iov.push_back(v);
+  }
+  size_t first = 0;
+  while (first < iov.size()) {
+    ssize_t len = writev(1, &iov[first], min<size_t>(iov.size() - first,
+                                                     IOV_MAX));
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len <= 0)
+      return;  // As fwrite() would have, unheard.
+    // Move on past what was written.
+    while (first < iov.size() && (size_t)len >= iov[first].iov_len)
+      len -= iov[first++].iov_len;
+    if (len > 0) {
+      iov[first].iov_base = (char*)iov[first].iov_base + len;
+      iov[first].iov_len -= len;
+    }
+  }
+#endif
+}
+
 void LinePrinter::PrintOnNewLine(const string& to_print) {
+  PrintOnNewLine(vector<StringPiece>(1, to_print));
+}
+
+void LinePrinter::PrintOnNewLine(const vector<StringPiece>& pieces) {
   if (console_locked_ && !line_buffer_.empty()) {
     output_buffer_.append(line_buffer_);
     output_buffer_.append(1, '\n');
     line_buffer_.clear();
   }
+  const StringPiece* last = NULL;
+  for (vector<StringPiece>::const_iterator p = pieces.begin();
+       p != pieces.end(); ++p) {
+    if (p->len_ > 0)
+      last = &*p;
+  }
   if (!have_blank_line_) {
-    PrintOrBuffer("\n", 1);
+    // Finish the status line and print the pieces in one write.
+    vector<StringPiece> line;
+    line.reserve(pieces.size() + 1);
+    // Dropping PrintMultiLine()'s lines with it.
+    line.push_back(extra_lines_ ? "\n\x1B[J" : "\n");
+    extra_lines_ = 0;
+    line.insert(line.end(), pieces.begin(), pieces.end());
+    PrintOrBuffer(line);
+  } else if (last) {
+    PrintOrBuffer(pieces);
   }
-  if (!to_print.empty()) {
-    PrintOrBuffer(&to_print[0], to_print.size());
+  have_blank_line_ = !last || last->str_[last->len_ - 1] == '\n';
+}
+
+void LinePrinter::PrintFile(FILE* file) {
+  long start = ftell(file);
+  if (start < 0)
+    return;
+  bool printed = false;
+  char last = 0;
+  off_t offset = start;
+#ifdef __linux__
+  struct stat st;
+  if (!console_locked_ && fstat(fileno(file), &st) == 0) {
+    fflush(stdout);
+    while (offset < st.st_size) {
+      ssize_t len = sendfile(1, fileno(file), &offset, st.st_size - offset);
+      if (len < 0 && errno == EINTR)
+        continue;
+      if (len <= 0)
+        break;  // Say, to a stdout opened for appending; write the rest.
+    }
+    printed = offset > start &&
+        pread(fileno(file), &last, 1, offset - 1) == 1;
+  }
+#endif
+  if (fseek(file, offset, SEEK_SET) == 0) {
+    char buf[64 << 10];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), file)) > 0) {
+      PrintOrBuffer(buf, len);
+      printed = true;
+      last = buf[len - 1];
+    }
   }
-  have_blank_line_ = to_print.empty() || *to_print.rbegin() == '\n';
+  fseek(file, start, SEEK_SET);
+  if (printed)
+    have_blank_line_ = last == '\n';
 }
 
 void LinePrinter::SetConsoleLocked(bool locked) {
@@ -17,8 +17,11 @@
 
 #include <stddef.h>
 #include <string>
+#include <vector>
 using namespace std;
 
+#include "string_piece.h"
+
 /// Prints lines of text, possibly overprinting previously printed lines
 /// if the terminal supports it.
 struct LinePrinter {
@@ -37,8 +40,22 @@ struct LinePrinter {
   /// one line.
   void Print(string to_print, LineType type);
 
+  /// Overprints the current line with |to_print|, elided to fit, and shows
+  /// |lines| below it in place of the lines shown by the last call.  The
+  /// cursor stays on the first line, so the next call draws over the lot.
+  /// Terminals that can't do this only get |to_print|.
+  void PrintMultiLine(string to_print, const vector<string>& lines);
+
   /// Prints a string on a new line, not overprinting previous output.
   void PrintOnNewLine(const string& to_print);
+  /// Prints |pieces| one after the other on a new line, in one write as if
+  /// they were one string, but without joining them first.
+  void PrintOnNewLine(const vector<StringPiece>& pieces);
+
+  /// Prints the rest of |file| after what was printed last, from the
+  /// file's current position, which it leaves be.  On Linux the kernel
+  /// copies it, without it passing through ninja.
+  void PrintFile(FILE* file);
 
   /// Lock or unlock the console.  Any output sent to the LinePrinter while the
   /// console is locked will not be printed until it is unlocked.
@@ -57,6 +74,9 @@ struct LinePrinter {
   /// Whether console is locked.
   bool console_locked_;
 
+  /// Number of lines PrintMultiLine() left below the cursor.
+  size_t extra_lines_;
+
   /// Buffered current line while console is locked.
   string line_buffer_;
 
@@ -72,6 +92,7 @@ struct LinePrinter {
 
   /// Print the given data to the console, or buffer it if it is locked.
   void PrintOrBuffer(const char *data, size_t size);
+  void PrintOrBuffer(const vector<StringPiece>& pieces);
 };
 
 #endif  // NINJA_LINE_PRINTER_H_
@@ -0,0 +1,79 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "log_writer.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "metrics.h"
+
+LogWriter::LogWriter()
+    : file_(NULL), empty_(false), pending_records_(0),
+      pending_since_millis_(0) {}
+
+LogWriter::~LogWriter() {
+  Close();
+}
+
+bool LogWriter::Open(const string& path, string* err) {
+  Close();
+  file_ = fopen(path.c_str(), "ab");
+  if (!file_) {
+    *err = strerror(errno);
+    return false;
+  }
+  // Records are collected in pending_, and each write must hand them to
+  // the system in one go so that only whole records reach the file.
+  setvbuf(file_, NULL, _IONBF, 0);
+  SetCloseOnExec(fileno(file_));
+
+  // Opening a file in append mode doesn't set the file pointer to the file's
+  // end on Windows. Do that explicitly.
+  fseek(file_, 0, SEEK_END);
+  empty_ = ftell(file_) == 0;
+  return true;
+}
+
+bool LogWriter::Append(const char* data, size_t size) {
+  int64_t now = GetTimeMillis();
+  if (!pending_records_)
+    pending_since_millis_ = now;
+  pending_.append(data, size);
+  ++pending_records_;
+  empty_ = false;
+  if (pending_records_ >= kMaxPendingRecords ||
+      pending_.size() >= kMaxPendingBytes ||
+      now - pending_since_millis_ >= kMaxDelayMillis)
+    return Flush();
+  return true;
+}
+
+bool LogWriter::Flush() {
+  if (!file_ || pending_.empty())
+    return true;
+  size_t written = fwrite(pending_.data(), 1, pending_.size(), file_);
+  bool success = written == pending_.size();
+  pending_.clear();
+  pending_records_ = 0;
+  return success;
+}
+
+void LogWriter::Close() {
+  if (!file_)
+    return;
+  Flush();
+  fclose(file_);
+  file_ = NULL;
+}
@@ -0,0 +1,76 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_LOG_WRITER_H_
+#define NINJA_LOG_WRITER_H_
+
+#include <stdio.h>
+
+#include <string>
+using namespace std;
+
+#include "util.h"  // int64_t
+
+/// Appends records to a log file, holding them back so that a busy build
+/// writes many records with one system call instead of one each.  Records
+/// are written out after kMaxPendingRecords of them, once the oldest has
+/// waited kMaxDelayMillis, or when Flush() or Close() is called.
+///
+/// Records are only ever written whole and in order, so a crash loses the
+/// latest records, at worst cutting the last one short.  The logs already
+/// cope with both: a lost record just means rebuilding its outputs.
+struct LogWriter {
+  LogWriter();
+  ~LogWriter();
+
+  /// Open |path| for appending, creating it if needed.
+  bool Open(const string& path, string* err);
+
+  bool is_open() const { return file_ != NULL; }
+
+  /// Whether the file was empty when opened and nothing was appended since.
+  bool empty() const { return empty_; }
+
+  /// Append the complete record [data, data + size).  May write out the
+  /// pending records, returning false with errno set if that fails.
+  bool Append(const char* data, size_t size);
+  bool Append(const string& record) {
+    return Append(record.data(), record.size());
+  }
+
+  /// Write out the pending records.  Returns false with errno set on failure.
+  bool Flush();
+
+  /// Flush and close the file.
+  void Close();
+
+  static const size_t kMaxPendingRecords = 512;
+  static const size_t kMaxPendingBytes = 1 << 20;
+  static const int64_t kMaxDelayMillis = 1000;
+
+ private:
+  FILE* file_;
+  bool empty_;
+  /// Records not written out yet.
+  string pending_;
+  size_t pending_records_;
+  /// When the oldest pending record was appended.
+  int64_t pending_since_millis_;
+
+  // Not copyable.
+  LogWriter(const LogWriter&);
+  void operator=(const LogWriter&);
+};
+
+#endif  // NINJA_LOG_WRITER_H_
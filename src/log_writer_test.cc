@@ -0,0 +1,79 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "log_writer.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "test.h"
+
+namespace {
+
+const char kTestFilename[] = "LogWriterTest-tempfile";
+
+struct LogWriterTest : public testing::Test {
+  virtual void SetUp() {
+    // In case a crashing test left a stale file behind.
+    unlink(kTestFilename);
+  }
+  virtual void TearDown() {
+    unlink(kTestFilename);
+  }
+
+  string Contents() {
+    string contents, err;
+    ReadFile(kTestFilename, &contents, &err);
+    return contents;
+  }
+};
+
+TEST_F(LogWriterTest, HoldsBackRecords) {
+  LogWriter writer;
+  string err;
+  ASSERT_TRUE(writer.Open(kTestFilename, &err));
+  EXPECT_TRUE(writer.empty());
+  EXPECT_TRUE(writer.Append("one\n"));
+  EXPECT_TRUE(writer.Append("two\n"));
+  EXPECT_FALSE(writer.empty());
+  EXPECT_EQ("", Contents());
+
+  EXPECT_TRUE(writer.Flush());
+  EXPECT_EQ("one\ntwo\n", Contents());
+
+  EXPECT_TRUE(writer.Append("three\n"));
+  writer.Close();
+  EXPECT_EQ("one\ntwo\nthree\n", Contents());
+
+  // Reopening appends.
+  ASSERT_TRUE(writer.Open(kTestFilename, &err));
+  EXPECT_FALSE(writer.empty());
+  EXPECT_TRUE(writer.Append("four\n"));
+  writer.Close();
+  EXPECT_EQ("one\ntwo\nthree\nfour\n", Contents());
+}
+
+TEST_F(LogWriterTest, WritesOutManyRecords) {
+  LogWriter writer;
+  string err;
+  ASSERT_TRUE(writer.Open(kTestFilename, &err));
+  for (size_t i = 0; i + 1 < LogWriter::kMaxPendingRecords; ++i)
+    EXPECT_TRUE(writer.Append("x"));
+  EXPECT_EQ("", Contents());
+  EXPECT_TRUE(writer.Append("x"));
+  EXPECT_EQ((size_t)LogWriter::kMaxPendingRecords, Contents().size());
+}
+
+}  // anonymous namespace
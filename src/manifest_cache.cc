@@ -0,0 +1,730 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "manifest_cache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <set>
+
+#include "build_log.h"
+#include "eval_env.h"
+#include "graph.h"
+#include "metrics.h"
+#include "state.h"
+#include "trace.h"
+#include "util.h"
+#include "version.h"
+
+// ManifestFileRecorder --------------------------------------------------------
+
+FileReader::Status ManifestFileRecorder::ReadFile(const string& path,
+                                                  string* contents,
+                                                  string* err) {
+  string full_path;
+  TimeStamp mtime = StatBeforeRead(path, &full_path);
+  Status status = disk_interface_->ReadFile(path, contents, err);
+  if (!full_path.empty()) {
+    Add(full_path, mtime,
+        status == Okay ? BuildLog::LogEntry::HashCommand(*contents).low : 0);
+  }
+  return status;
+}
+
+FileReader::Status ManifestFileRecorder::ReadFileTerminated(
+    const string& path, MappedFile* file, string* err) {
+  string full_path;
+  TimeStamp mtime = StatBeforeRead(path, &full_path);
+  Status status = disk_interface_->ReadFileTerminated(path, file, err);
+  if (!full_path.empty()) {
+    Add(full_path, mtime, status == Okay ? BuildLog::LogEntry::HashCommand(
+        StringPiece(file->data(), file->size())).low : 0);
+  }
+  return status;
+}
+
+TimeStamp ManifestFileRecorder::StatBeforeRead(const string& path,
+                                               string* full_path) {
+  // Stat before reading so that a change made while we read is noticed.
+  string cwd, stat_err;
+  if (Getcwd(&cwd, &stat_err) != Okay)
+    return -1;
+  *full_path = path;
+  if (full_path->empty() || (*full_path)[0] != '/') {
+    if (cwd.empty() || cwd[cwd.size() - 1] != '/')
+      cwd += '/';
+    *full_path = cwd + path;
+  }
+  return disk_interface_->Stat(*full_path, &stat_err);
+}
+
+FileReader::Status ManifestFileRecorder::Chdir(const string& path,
+                                               string* err) {
+  return disk_interface_->Chdir(path, err);
+}
+
+FileReader::Status ManifestFileRecorder::Getcwd(string* path, string* err) {
+  return disk_interface_->Getcwd(path, err);
+}
+
+void ManifestFileRecorder::Add(const string& path, TimeStamp mtime,
+                               uint64_t hash) {
+  paths_.push_back(path);
+  mtimes_.push_back(mtime);
+  hashes_.push_back(hash);
+}
+
+bool ManifestFileRecorder::AnyChanged() const {
+  vector<const string*> paths;
+  paths.reserve(paths_.size());
+  for (vector<string>::const_iterator i = paths_.begin(); i != paths_.end();
+       ++i)
+    paths.push_back(&*i);
+  vector<TimeStamp> mtimes;
+  disk_interface_->StatMany(paths, &mtimes);
+  // A failed stat here counts as a change; the reload will report it.
+  return mtimes != mtimes_;
+}
+
+// ManifestCache ---------------------------------------------------------------
+
+namespace {
+
+const char kFileSignature[] = "# ninjamanifestcache\n";
+const int kCurrentVersion = 6;
+
+/// Appends fixed-width integers and length-prefixed strings to a buffer.
+struct Writer {
+  void Write32(uint32_t value) { out_.append((const char*)&value, 4); }
+  void Write64(uint64_t value) { out_.append((const char*)&value, 8); }
+  void WriteString(const string& value) {
+    Write32((uint32_t)value.size());
+    out_.append(value);
+  }
+  string out_;
+};
+
+/// Reads back what Writer wrote.  Once a read runs off the end of the input
+/// every further read returns zero and ok() turns false.
+struct Reader {
+  Reader(const char* data, size_t size)
+      : pos_(data), end_(data + size), ok_(true) {}
+
+  uint32_t Read32() {
+    uint32_t value = 0;
+    if (Check(4))
+      memcpy(&value, pos_, 4);
+    pos_ += ok_ ? 4 : 0;
+    return value;
+  }
+  uint64_t Read64() {
+    uint64_t value = 0;
+    if (Check(8))
+      memcpy(&value, pos_, 8);
+    pos_ += ok_ ? 8 : 0;
+    return value;
+  }
+  string ReadString() {
+    uint32_t size = Read32();
+    if (!Check(size))
+      return string();
+    string value(pos_, size);
+    pos_ += size;
+    return value;
+  }
+  /// Read an index that must be below |limit|.
+  uint32_t ReadIndex(size_t limit) {
+    uint32_t index = Read32();
+    if (index >= limit) {
+      ok_ = false;
+      return 0;
+    }
+    return index;
+  }
+
+  bool ok() const { return ok_; }
+  bool at_end() const { return pos_ == end_; }
+
+ private:
+  bool Check(size_t size) {
+    if (ok_ && (size_t)(end_ - pos_) >= size)
+      return true;
+    ok_ = false;
+    return false;
+  }
+
+  const char* pos_;
+  const char* end_;
+  bool ok_;
+};
+
+const uint32_t kNone = 0xffffffff;
+
+/// Bits of the flags of a scope's ManifestSource.
+enum {
+  kDeclaresGlobals = 1,
+  kHasSubninjas = 2,
+  kRebound = 4,
+};
+
+/// The part of the file that decides whether it may be used.
+void WriteKey(Writer* writer, const string& input_file,
+              const ManifestParserOptions& options) {
+  writer->out_.append(kFileSignature, sizeof(kFileSignature) - 1);
+  writer->Write32(kCurrentVersion);
+  writer->WriteString(kNinjaVersion);
+  writer->WriteString(input_file);
+  writer->Write32(options.dupe_edge_action_);
+  writer->Write32(options.phony_cycle_action_);
+}
+
+}  // anonymous namespace
+
+bool ManifestCache::Save(const string& path, const string& input_file,
+                         const ManifestParserOptions& options,
+                         const State& state, const ManifestFileRecorder& files,
+                         string* err) {
+  METRIC_RECORD("manifest cache save");
+  Writer writer;
+  WriteKey(&writer, input_file, options);
+  writer.Write32((uint32_t)files.paths().size());
+  for (size_t i = 0; i < files.paths().size(); ++i) {
+    writer.WriteString(files.paths()[i]);
+    writer.Write64((uint64_t)files.mtimes()[i]);
+    writer.Write64(files.hashes()[i]);
+  }
+
+  // Number every scope reachable from the graph, parents first.  The root
+  // scope is the State's own and is always number 0.
+  map<const BindingEnv*, uint32_t> env_ids;
+  vector<const BindingEnv*> envs;
+  vector<const BindingEnv*> pending;
+  pending.push_back(&state.bindings_);
+  for (vector<Edge*>::const_iterator e = state.edges_.begin();
+       e != state.edges_.end(); ++e)
+    pending.push_back((*e)->env_);
+  for (State::Paths::const_iterator p = state.paths_.begin();
+       p != state.paths_.end(); ++p)
+    pending.push_back(p->second->env_);
+  for (size_t i = 0; i < pending.size(); ++i) {
+    vector<const BindingEnv*> chain;
+    for (const BindingEnv* env = pending[i]; env && !env_ids.count(env);
+         env = env->parent_)
+      chain.push_back(env);
+    for (size_t j = chain.size(); j > 0; --j) {
+      env_ids[chain[j - 1]] = (uint32_t)envs.size();
+      envs.push_back(chain[j - 1]);
+    }
+  }
+
+  // The scopes go first, so that Load() can tell which subninjas changed
+  // before filling anything in.
+  writer.Write32((uint32_t)envs.size());
+  for (size_t i = 1; i < envs.size(); ++i) {
+    const BindingEnv* env = envs[i];
+    writer.Write32(env_ids[env->parent_]);
+    writer.WriteString(env->rel_path_);
+    writer.WriteString(env->abs_path_);
+  }
+  for (size_t i = 0; i < envs.size(); ++i) {
+    const ManifestSource* source = envs[i]->source();
+    if (!source) {
+      writer.Write32(kNone);
+      continue;
+    }
+    writer.Write32((source->declares_globals ? kDeclaresGlobals : 0) |
+                   (source->has_subninjas ? kHasSubninjas : 0) |
+                   (source->rebound ? kRebound : 0));
+    writer.Write32((uint32_t)source->files.size());
+    for (vector<string>::const_iterator f = source->files.begin();
+         f != source->files.end(); ++f)
+      writer.WriteString(*f);
+  }
+
+  // Number the rules; the builtin phony rule is number 0.
+  map<const Rule*, uint32_t> rule_ids;
+  vector<const Rule*> rules;
+  rule_ids[&State::kPhonyRule] = 0;
+  rules.push_back(&State::kPhonyRule);
+  for (size_t i = 0; i < envs.size(); ++i) {
+    const map<string, const Rule*>& env_rules = envs[i]->rules_;
+    for (map<string, const Rule*>::const_iterator r = env_rules.begin();
+         r != env_rules.end(); ++r) {
+      if (rule_ids.insert(make_pair(r->second, (uint32_t)rules.size())).second)
+        rules.push_back(r->second);
+    }
+  }
+
+  writer.Write32((uint32_t)rules.size());
+  for (size_t i = 1; i < rules.size(); ++i) {
+    const Rule* rule = rules[i];
+    writer.WriteString(rule->name_);
+    writer.Write32((uint32_t)rule->bindings_.size());
+    for (Rule::Bindings::const_iterator b = rule->bindings_.begin();
+         b != rule->bindings_.end(); ++b) {
+      writer.WriteString(b->first);
+      const EvalString& value = b->second;
+      writer.Write32((uint32_t)value.size());
+      for (size_t t = 0; t < value.size(); ++t) {
+        writer.Write32(value.token(t).type);
+        writer.WriteString(value.token(t).text.AsString());
+      }
+    }
+  }
+
+  for (size_t i = 0; i < envs.size(); ++i) {
+    const BindingEnv* env = envs[i];
+    writer.Write32((uint32_t)env->bindings().size());
+    for (BindingEnv::Bindings::const_iterator b = env->bindings().begin();
+         b != env->bindings().end(); ++b) {
+      writer.WriteString(*b->first);
+      writer.WriteString(*b->second);
+    }
+    writer.Write32((uint32_t)env->rules_.size());
+    for (map<string, const Rule*>::const_iterator r = env->rules_.begin();
+         r != env->rules_.end(); ++r)
+      writer.Write32(rule_ids[r->second]);
+  }
+
+  // The builtin pools exist in every State.
+  writer.Write32((uint32_t)state.pools_.size());
+  for (map<string, Pool*>::const_iterator p = state.pools_.begin();
+       p != state.pools_.end(); ++p) {
+    writer.WriteString(p->first);
+    writer.Write32((uint32_t)p->second->depth());
+    writer.WriteString(p->second->depth_expression());
+    writer.Write32(p->second->local_only());
+  }
+
+  map<const Node*, uint32_t> node_ids;
+  writer.Write32((uint32_t)state.paths_.size());
+  for (State::Paths::const_iterator p = state.paths_.begin();
+       p != state.paths_.end(); ++p) {
+    const Node* node = p->second;
+    node_ids[node] = (uint32_t)node_ids.size();
+    writer.Write32(env_ids[node->env_]);
+    writer.WriteString(node->path_);
+    writer.Write64(node->slash_bits_);
+    writer.Write32(node->dyndep_pending_);
+  }
+
+  map<const Edge*, uint32_t> edge_ids;
+  writer.Write32((uint32_t)state.edges_.size());
+  for (vector<Edge*>::const_iterator e = state.edges_.begin();
+       e != state.edges_.end(); ++e) {
+    const Edge* edge = *e;
+    edge_ids[edge] = (uint32_t)edge_ids.size();
+    writer.Write32(rule_ids[edge->rule_]);
+    writer.WriteString(edge->pool_->name());
+    writer.Write32(edge->weight_);
+    writer.Write32(env_ids[edge->env_]);
+    writer.Write32((uint32_t)edge->inputs_.size());
+    for (vector<Node*>::const_iterator n = edge->inputs_.begin();
+         n != edge->inputs_.end(); ++n)
+      writer.Write32(node_ids[*n]);
+    writer.Write32((uint32_t)edge->outputs_.size());
+    for (vector<Node*>::const_iterator n = edge->outputs_.begin();
+         n != edge->outputs_.end(); ++n)
+      writer.Write32(node_ids[*n]);
+    writer.Write32(edge->implicit_deps_);
+    writer.Write32(edge->order_only_deps_);
+    writer.Write32(edge->implicit_outs_);
+    writer.Write32(edge->dyndep_ ? node_ids[edge->dyndep_] : kNone);
+  }
+
+  // Out edges are stored rather than recomputed from the inputs: the parser
+  // drops self-references from phony edges without touching them.
+  for (State::Paths::const_iterator p = state.paths_.begin();
+       p != state.paths_.end(); ++p) {
+    const vector<Edge*>& out_edges = p->second->out_edges();
+    writer.Write32((uint32_t)out_edges.size());
+    for (vector<Edge*>::const_iterator e = out_edges.begin();
+         e != out_edges.end(); ++e)
+      writer.Write32(edge_ids[*e]);
+  }
+
+  writer.Write32((uint32_t)state.defaults_.size());
+  for (vector<Node*>::const_iterator n = state.defaults_.begin();
+       n != state.defaults_.end(); ++n)
+    writer.Write32(node_ids[*n]);
+
+  // Write to a temporary file and move it into place, so a concurrent or
+  // interrupted run never sees a partial cache.
+  string temp_path = path + ".tmp";
+  FILE* f = fopen(temp_path.c_str(), "wb");
+  if (!f) {
+    *err = "opening " + temp_path + ": " + strerror(errno);
+    return false;
+  }
+  if (fwrite(writer.out_.data(), 1, writer.out_.size(), f) !=
+      writer.out_.size()) {
+    *err = "writing " + temp_path + ": " + strerror(errno);
+    fclose(f);
+    remove(temp_path.c_str());
+    return false;
+  }
+  if (fclose(f) != 0) {
+    *err = "writing " + temp_path + ": " + strerror(errno);
+    remove(temp_path.c_str());
+    return false;
+  }
+#ifdef _WIN32
+  // rename() does not replace existing files on Windows.
+  remove(path.c_str());
+#endif
+  if (rename(temp_path.c_str(), path.c_str()) < 0) {
+    *err = "renaming " + temp_path + ": " + strerror(errno);
+    remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+namespace {
+
+/// A scope as the cache describes it, read before any scope is created.
+struct EnvRecord {
+  EnvRecord() : parent(0), flags(kNone) {}
+  uint32_t parent;
+  string rel_path;
+  string abs_path;
+  /// The flags of its ManifestSource, or kNone if it has none.
+  uint32_t flags;
+  vector<string> files;
+};
+
+}  // anonymous namespace
+
+bool ManifestCache::Load(const string& path, const string& input_file,
+                         const ManifestParserOptions& options, State* state,
+                         DiskInterface* disk_interface,
+                         ManifestFileRecorder* files, bool* outdated,
+                         string* err) {
+  METRIC_RECORD("manifest cache load");
+  TRACE_PHASE("manifest cache load");
+  string contents, read_err;
+  if (disk_interface->ReadFile(path, &contents, &read_err) !=
+      FileReader::Okay)
+    return false;
+
+  Writer key;
+  WriteKey(&key, input_file, options);
+  if (contents.compare(0, key.out_.size(), key.out_) != 0)
+    return false;
+  Reader reader(contents.data() + key.out_.size(),
+                contents.size() - key.out_.size());
+
+  // Find the manifest files that changed before touching |state|.  A file
+  // that was merely touched is as good as unchanged.
+  uint32_t file_count = reader.Read32();
+  vector<string> paths;
+  vector<TimeStamp> mtimes;
+  vector<uint64_t> hashes;
+  for (uint32_t i = 0; i < file_count && reader.ok(); ++i) {
+    paths.push_back(reader.ReadString());
+    mtimes.push_back((TimeStamp)reader.Read64());
+    hashes.push_back(reader.Read64());
+  }
+  if (!reader.ok() || paths.empty())
+    return false;
+  vector<const string*> path_ptrs;
+  for (vector<string>::iterator i = paths.begin(); i != paths.end(); ++i)
+    path_ptrs.push_back(&*i);
+  vector<TimeStamp> current_mtimes;
+  disk_interface->StatMany(path_ptrs, &current_mtimes);
+  vector<size_t> changed;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (current_mtimes[i] == mtimes[i])
+      continue;
+    string file_contents;
+    if (current_mtimes[i] > 0 &&
+        disk_interface->ReadFile(paths[i], &file_contents, &read_err) ==
+            FileReader::Okay &&
+        BuildLog::LogEntry::HashCommand(file_contents).low == hashes[i]) {
+      mtimes[i] = current_mtimes[i];
+      *outdated = true;
+      continue;
+    }
+    changed.push_back(i);
+  }
+
+  uint32_t env_count = reader.Read32();
+  if (!reader.ok() || env_count == 0)
+    return false;
+  vector<EnvRecord> env_records(env_count);
+  for (uint32_t i = 1; i < env_count && reader.ok(); ++i) {
+    // Scopes are numbered parents first.
+    env_records[i].parent = reader.ReadIndex(i);
+    env_records[i].rel_path = reader.ReadString();
+    env_records[i].abs_path = reader.ReadString();
+  }
+  for (uint32_t i = 0; i < env_count && reader.ok(); ++i) {
+    EnvRecord* record = &env_records[i];
+    record->flags = reader.Read32();
+    if (record->flags == kNone)
+      continue;
+    uint32_t source_file_count = reader.Read32();
+    for (uint32_t j = 0; j < source_file_count && reader.ok(); ++j)
+      record->files.push_back(reader.ReadString());
+  }
+  if (!reader.ok())
+    return false;
+
+  // Find the subninjas the changed files belong to, which are parsed again
+  // along with everything in their scopes.
+  string cwd;
+  vector<bool> dropped(env_count, false);
+  vector<uint32_t> reloads;
+  vector<int> file_envs(paths.size(), -1);
+  if (!changed.empty()) {
+    if (disk_interface->Getcwd(&cwd, &read_err) != FileReader::Okay)
+      return false;
+    string dir = cwd;
+    if (dir.empty() || dir[dir.size() - 1] != '/')
+      dir += '/';
+    map<string, uint32_t> env_of_file;
+    for (uint32_t i = 0; i < env_count; ++i) {
+      const EnvRecord& record = env_records[i];
+      for (vector<string>::const_iterator f = record.files.begin();
+           f != record.files.end(); ++f) {
+        bool absolute = !f->empty() && (*f)[0] == '/';
+        env_of_file[absolute ? *f : dir + record.abs_path + *f] = i;
+      }
+    }
+    for (size_t i = 0; i < paths.size(); ++i) {
+      map<string, uint32_t>::iterator e = env_of_file.find(paths[i]);
+      if (e != env_of_file.end())
+        file_envs[i] = (int)e->second;
+    }
+
+    set<uint32_t> changed_envs;
+    for (vector<size_t>::iterator c = changed.begin(); c != changed.end();
+         ++c) {
+      // The top-level manifest, or a file that can't be told apart.
+      if (file_envs[*c] <= 0)
+        return false;
+      changed_envs.insert((uint32_t)file_envs[*c]);
+    }
+    for (uint32_t i = 1; i < env_count; ++i) {
+      if (changed_envs.count(i) && !dropped[env_records[i].parent])
+        reloads.push_back(i);
+      dropped[i] = changed_envs.count(i) || dropped[env_records[i].parent];
+    }
+    for (vector<uint32_t>::iterator r = reloads.begin(); r != reloads.end();
+         ++r) {
+      for (uint32_t e = env_records[*r].parent; ;
+           e = env_records[e].parent) {
+        if (env_records[e].flags != kNone && (env_records[e].flags & kRebound))
+          return false;
+        if (e == 0)
+          break;
+      }
+    }
+    for (uint32_t i = 0; i < env_count; ++i) {
+      if (dropped[i] && env_records[i].flags != kNone &&
+          (env_records[i].flags & kDeclaresGlobals))
+        return false;
+    }
+    *outdated = true;
+  }
+
+  vector<const Rule*> rules;
+  uint32_t rule_count = reader.Read32();
+  rules.push_back(&State::kPhonyRule);
+  for (uint32_t i = 1; i < rule_count && reader.ok(); ++i) {
+    Rule* rule = new Rule(reader.ReadString());
+    uint32_t binding_count = reader.Read32();
+    for (uint32_t j = 0; j < binding_count && reader.ok(); ++j) {
+      string key = reader.ReadString();
+      EvalString value;
+      uint32_t token_count = reader.Read32();
+      vector<string> texts(token_count);
+      for (uint32_t k = 0; k < token_count && reader.ok(); ++k) {
+        EvalString::TokenType type =
+            reader.Read32() ? EvalString::SPECIAL : EvalString::RAW;
+        texts[k] = reader.ReadString();
+        value.AddToken(texts[k], type);
+      }
+      rule->AddBinding(key, value);
+    }
+    rules.push_back(rule);
+  }
+
+  vector<BindingEnv*> envs;
+  envs.push_back(&state->bindings_);
+  for (uint32_t i = 1; i < env_count; ++i) {
+    const EnvRecord& record = env_records[i];
+    envs.push_back(new BindingEnv(envs[record.parent], record.rel_path,
+                                  record.abs_path));
+  }
+  for (size_t i = 0; i < envs.size() && reader.ok(); ++i) {
+    BindingEnv* env = envs[i];
+    const EnvRecord& record = env_records[i];
+    if (record.flags != kNone) {
+      ManifestSource* source = env->source();
+      source->declares_globals = (record.flags & kDeclaresGlobals) != 0;
+      source->has_subninjas = (record.flags & kHasSubninjas) != 0;
+      source->rebound = (record.flags & kRebound) != 0;
+      source->files = record.files;
+    }
+    uint32_t binding_count = reader.Read32();
+    for (uint32_t j = 0; j < binding_count && reader.ok(); ++j) {
+      string key = reader.ReadString();
+      env->AddBinding(key, reader.ReadString());
+    }
+    uint32_t env_rule_count = reader.Read32();
+    for (uint32_t j = 0; j < env_rule_count && reader.ok(); ++j) {
+      const Rule* rule = rules[reader.ReadIndex(rules.size())];
+      env->rules_[rule->name()] = rule;
+    }
+  }
+
+  uint32_t pool_count = reader.Read32();
+  for (uint32_t i = 0; i < pool_count && reader.ok(); ++i) {
+    string name = reader.ReadString();
+    int depth = (int)reader.Read32();
+    string expression = reader.ReadString();
+    bool local_only = reader.Read32() != 0;
+    // Depths that depend on the machine or the -j are worked out again,
+    // rather than have either make the cache invalid.
+    bool is_expression;
+    string depth_err;
+    if (!expression.empty() &&
+        !ManifestParser::EvaluatePoolDepth(expression, options.parallelism_,
+                                           &depth, &is_expression,
+                                           &depth_err)) {
+      *err = "pool '" + name + "': " + depth_err;
+      return false;
+    }
+    if (!state->LookupPool(name)) {
+      Pool* pool = new Pool(name, depth, local_only);
+      pool->set_depth_expression(expression);
+      state->AddPool(pool);
+    }
+  }
+
+  vector<Node*> nodes;
+  uint32_t node_count = reader.Read32();
+  for (uint32_t i = 0; i < node_count && reader.ok(); ++i) {
+    BindingEnv* env = envs[reader.ReadIndex(envs.size())];
+    string node_path = reader.ReadString();
+    uint64_t slash_bits = reader.Read64();
+    Node* node = state->NewNode(env, node_path, slash_bits);
+    // Without the edges dropped, a node may no longer be a dyndep file.
+    node->dyndep_pending_ = reader.Read32() != 0 && reloads.empty();
+    state->AddNode(node);
+    nodes.push_back(node);
+  }
+
+  // The edges of the scopes parsed again are left out.
+  uint32_t edge_count = reader.Read32();
+  vector<Edge*> edges;
+  for (uint32_t i = 0; i < edge_count && reader.ok(); ++i) {
+    const Rule* rule = rules[reader.ReadIndex(rules.size())];
+    Pool* pool = state->LookupPool(reader.ReadString());
+    int weight = (int)reader.Read32();
+    uint32_t env = reader.ReadIndex(envs.size());
+    if (!pool || !reader.ok())
+      break;
+    Edge* edge = NULL;
+    if (!dropped[env]) {
+      edge = state->AddEdge(rule);
+      edge->pool_ = pool;
+      edge->weight_ = weight;
+      edge->env_ = envs[env];
+    }
+    edges.push_back(edge);
+    uint32_t input_count = reader.Read32();
+    for (uint32_t j = 0; j < input_count && reader.ok(); ++j) {
+      Node* node = nodes[reader.ReadIndex(nodes.size())];
+      if (edge)
+        edge->inputs_.push_back(node);
+    }
+    uint32_t output_count = reader.Read32();
+    for (uint32_t j = 0; j < output_count && reader.ok(); ++j) {
+      Node* node = nodes[reader.ReadIndex(nodes.size())];
+      if (edge) {
+        edge->outputs_.push_back(node);
+        node->set_in_edge(edge);
+      }
+    }
+    int implicit_deps = (int)reader.Read32();
+    int order_only_deps = (int)reader.Read32();
+    int implicit_outs = (int)reader.Read32();
+    uint32_t dyndep = reader.Read32();
+    if (dyndep != kNone && dyndep >= nodes.size())
+      break;
+    if (edge) {
+      edge->implicit_deps_ = implicit_deps;
+      edge->order_only_deps_ = order_only_deps;
+      edge->implicit_outs_ = implicit_outs;
+      if (dyndep != kNone) {
+        edge->dyndep_ = nodes[dyndep];
+        if (!reloads.empty())
+          edge->dyndep_->dyndep_pending_ = true;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < nodes.size() && reader.ok(); ++i) {
+    uint32_t out_count = reader.Read32();
+    for (uint32_t j = 0; j < out_count && reader.ok(); ++j) {
+      Edge* edge = edges[reader.ReadIndex(edges.size())];
+      if (edge)
+        nodes[i]->AddOutEdge(edge);
+    }
+  }
+
+  uint32_t default_count = reader.Read32();
+  for (uint32_t i = 0; i < default_count && reader.ok(); ++i)
+    state->defaults_.push_back(nodes[reader.ReadIndex(nodes.size())]);
+
+  if (!reader.ok() || !reader.at_end() || edges.size() != edge_count) {
+    *err = "manifest cache '" + path + "' is corrupt";
+    return false;
+  }
+
+  for (size_t i = 0; i < paths.size(); ++i) {
+    if (file_envs[i] < 0 || !dropped[file_envs[i]])
+      files->Add(paths[i], mtimes[i], hashes[i]);
+  }
+
+  // Parse the changed subninjas again, from the directory of their parent
+  // scope, into the scopes restored from the cache.
+  for (vector<uint32_t>::iterator r = reloads.begin(); r != reloads.end();
+       ++r) {
+    const EnvRecord& record = env_records[*r];
+    const string& dir = env_records[record.parent].abs_path;
+    string chdir = record.rel_path;
+    if (!chdir.empty())
+      chdir.resize(chdir.size() - 1);  // The trailing slash.
+    if (!dir.empty() && files->Chdir(dir, &read_err) != FileReader::Okay) {
+      *err = "chdir to '" + dir + "': " + read_err;
+      return false;
+    }
+    ManifestParser parser(state, files, options);
+    bool ok = parser.LoadSubninja(envs[record.parent], record.files[0],
+                                  chdir, err);
+    if (!dir.empty() && files->Chdir(cwd, &read_err) != FileReader::Okay) {
+      *err = "restore cwd = '" + cwd + "': " + read_err;
+      return false;
+    }
+    if (!ok)
+      return false;
+  }
+  return true;
+}
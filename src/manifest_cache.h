@@ -0,0 +1,99 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_MANIFEST_CACHE_H_
+#define NINJA_MANIFEST_CACHE_H_
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "disk_interface.h"
+#include "manifest_parser.h"
+#include "timestamp.h"
+
+struct State;
+
+/// A FileReader that records which files were read through it, so that the
+/// loaded manifest can later be checked for staleness.
+struct ManifestFileRecorder : public FileReader {
+  explicit ManifestFileRecorder(DiskInterface* disk_interface)
+      : disk_interface_(disk_interface) {}
+
+  virtual Status ReadFile(const string& path, string* contents, string* err);
+  virtual Status ReadFileTerminated(const string& path, MappedFile* file,
+                                    string* err);
+  virtual Status Chdir(const string& path, string* err);
+  virtual Status Getcwd(string* path, string* err);
+
+  /// Remember that |path| (absolute) had |mtime| when it was read, and
+  /// contents hashing to |hash|.
+  void Add(const string& path, TimeStamp mtime, uint64_t hash);
+
+  /// Return true if any of the files read so far changed since they were
+  /// read.
+  bool AnyChanged() const;
+
+  const vector<string>& paths() const { return paths_; }
+  const vector<TimeStamp>& mtimes() const { return mtimes_; }
+  const vector<uint64_t>& hashes() const { return hashes_; }
+
+ private:
+  /// Stat |path| ahead of reading it, setting |full_path| to its absolute
+  /// path unless the working directory is unknown.
+  TimeStamp StatBeforeRead(const string& path, string* full_path);
+
+  DiskInterface* disk_interface_;
+  /// Absolute paths of the files read, their mtimes at the time and the
+  /// hashes of their contents.
+  vector<string> paths_;
+  vector<TimeStamp> mtimes_;
+  vector<uint64_t> hashes_;
+};
+
+/// A binary snapshot of a fully parsed State: nodes, edges, rules, pools and
+/// scopes.  Loading one skips lexing the manifest and evaluating its
+/// variables.  The cache is only used while every manifest file it was made
+/// from still has the contents it had when it was parsed, which is checked
+/// by hashing the files whose mtime changed.
+///
+/// When only subninjas changed, such as after a generator rewrote a few of
+/// them, the rest of the State is loaded from the cache and just those
+/// subninjas are parsed again.  That needs them not to affect anything
+/// outside their scope: the whole manifest is parsed again instead if one
+/// of them, or of the subninjas they contain, has a 'pool' or 'default'
+/// line, or if a scope around one got a variable or rule after it.
+struct ManifestCache {
+  /// Write |state|, parsed from |input_file| with |options|, to |path|.
+  /// |files| lists the manifest files that were read.
+  static bool Save(const string& path, const string& input_file,
+                   const ManifestParserOptions& options, const State& state,
+                   const ManifestFileRecorder& files, string* err);
+
+  /// Load |state| from the cache at |path| if it is still valid for
+  /// |input_file| and |options|, and add the manifest files it was made from
+  /// to |files|, parsing the subninjas that changed again.  |state| must be
+  /// freshly constructed.  |outdated| is set if the cache should be saved
+  /// again, because of what was parsed or of files touched but unchanged.
+  /// Returns false if the cache could not be used.  In that case |err| is
+  /// empty if there was simply no valid cache, and set if the cache turned
+  /// out to be corrupt, or a changed subninja failed to parse, after |state|
+  /// was partially filled in.
+  static bool Load(const string& path, const string& input_file,
+                   const ManifestParserOptions& options, State* state,
+                   DiskInterface* disk_interface, ManifestFileRecorder* files,
+                   bool* outdated, string* err);
+};
+
+#endif  // NINJA_MANIFEST_CACHE_H_
@@ -0,0 +1,357 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "manifest_cache.h"
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+#include "graph.h"
+#include "state.h"
+#include "test.h"
+
+namespace {
+
+#ifndef _WIN32
+TEST(ManifestFileRecorderTest, AnyChanged) {
+  ScopedTempDir temp_dir;
+  temp_dir.CreateAndEnter("NinjaManifestFileRecorderTest");
+
+  RealDiskInterface disk;
+  ASSERT_TRUE(disk.WriteFile("build.ninja", ""));
+  ManifestFileRecorder recorder(&disk);
+  string contents, err;
+  EXPECT_EQ(FileReader::Okay,
+            recorder.ReadFile("build.ninja", &contents, &err));
+  EXPECT_FALSE(recorder.AnyChanged());
+
+  struct timeval times[2] = { { 1, 0 }, { 1, 0 } };
+  ASSERT_EQ(0, utimes("build.ninja", times));
+  EXPECT_TRUE(recorder.AnyChanged());
+
+  temp_dir.Cleanup();
+}
+
+struct ManifestCacheTest : public testing::Test {
+  virtual void SetUp() {
+    temp_dir_.CreateAndEnter("NinjaManifestCacheTest");
+  }
+  virtual void TearDown() {
+    temp_dir_.Cleanup();
+  }
+
+  /// Parse build.ninja into |state| and save it to the cache.
+  void ParseAndSave(State* state) {
+    ManifestFileRecorder files(&disk_);
+    ManifestParser parser(state, &files, options_);
+    string err;
+    ASSERT_TRUE(parser.Load("build.ninja", &err));
+    ASSERT_EQ("", err);
+    ASSERT_TRUE(ManifestCache::Save("cache", "build.ninja", options_, *state,
+                                    files, &err));
+    ASSERT_EQ("", err);
+  }
+
+  ScopedTempDir temp_dir_;
+  RealDiskInterface disk_;
+  ManifestParserOptions options_;
+};
+
+TEST_F(ManifestCacheTest, RoundTrip) {
+  disk_.MakeDir("sub");
+  ASSERT_TRUE(disk_.WriteFile("sub/sub.ninja",
+"rule cc\n"
+"  command = cc $in -o $out\n"
+"build sub.o: cc sub.c\n"));
+  ASSERT_TRUE(disk_.WriteFile("build.ninja",
+"flags = -O2\n"
+"pool link_pool\n"
+"  depth = 3\n"
+"  local_only = 1\n"
+"pool jobs_pool\n"
+"  depth = jobs / 2\n"
+"rule cat\n"
+"  command = cat $flags $in > $out\n"
+"  description = CAT $out\n"
+"build out: cat in1 in2 | imp || oo\n"
+"  pool = link_pool\n"
+"  weight = 2\n"
+"  flags = -g\n"
+"build dd: phony\n"
+"build dyn: cat in1 || dd\n"
+"  dyndep = dd\n"
+"build all: phony out sub/sub.o\n"
+"subninja sub.ninja\n"
+"  chdir = sub\n"
+"default all\n"));
+
+  State parsed;
+  ASSERT_NO_FATAL_FAILURE(ParseAndSave(&parsed));
+
+  State state;
+  ManifestFileRecorder files(&disk_);
+  string err;
+  bool outdated = false;
+  ASSERT_TRUE(ManifestCache::Load("cache", "build.ninja", options_, &state,
+                                  &disk_, &files, &outdated, &err));
+  ASSERT_EQ("", err);
+  EXPECT_FALSE(outdated);
+  EXPECT_EQ(2u, files.paths().size());
+  EXPECT_FALSE(files.AnyChanged());
+
+  ASSERT_EQ(parsed.edges_.size(), state.edges_.size());
+  ASSERT_EQ(parsed.paths_.size(), state.paths_.size());
+  for (size_t i = 0; i < parsed.edges_.size(); ++i) {
+    Edge* a = parsed.edges_[i];
+    Edge* b = state.edges_[i];
+    EXPECT_EQ(a->EvaluateCommand(), b->EvaluateCommand());
+    EXPECT_EQ(a->GetBinding("description"), b->GetBinding("description"));
+    EXPECT_EQ(a->pool()->name(), b->pool()->name());
+    EXPECT_EQ(a->weight(), b->weight());
+    EXPECT_EQ(a->inputs_.size(), b->inputs_.size());
+    EXPECT_EQ(a->implicit_deps_, b->implicit_deps_);
+    EXPECT_EQ(a->order_only_deps_, b->order_only_deps_);
+    EXPECT_EQ(a->outputs_.size(), b->outputs_.size());
+  }
+
+  Edge* edge = state.LookupNode("out")->in_edge();
+  EXPECT_EQ("cat -g in1 in2 > out", edge->EvaluateCommand());
+  EXPECT_EQ(3, edge->pool()->depth());
+  EXPECT_EQ(2, edge->weight());
+  EXPECT_EQ(max(GuessParallelism() / 2, 1),
+            state.LookupPool("jobs_pool")->depth());
+  EXPECT_TRUE(edge->pool()->local_only());
+  EXPECT_EQ(2u, state.LookupNode("in1")->out_edges().size());
+  EXPECT_EQ(state.LookupNode("dd"),
+            state.LookupNode("dyn")->in_edge()->dyndep_);
+  EXPECT_TRUE(state.LookupNode("dd")->dyndep_pending());
+  Node* sub = state.LookupNode("sub/sub.o");
+  ASSERT_TRUE(sub);
+  EXPECT_EQ(state.LookupNode("all")->in_edge(), sub->out_edges()[0]);
+  EXPECT_EQ(parsed.LookupNode("sub/sub.o")->in_edge()->EvaluateCommand(),
+            sub->in_edge()->EvaluateCommand());
+  ASSERT_EQ(1u, state.defaults_.size());
+  EXPECT_EQ("all", state.defaults_[0]->path());
+}
+
+TEST_F(ManifestCacheTest, Stale) {
+  ASSERT_TRUE(disk_.WriteFile("build.ninja", "build out: phony\n"));
+  State parsed;
+  ASSERT_NO_FATAL_FAILURE(ParseAndSave(&parsed));
+
+  State state;
+  ManifestFileRecorder files(&disk_);
+  string err;
+  bool outdated = false;
+
+  // A different manifest or different options don't match.
+  EXPECT_FALSE(ManifestCache::Load("cache", "other.ninja", options_, &state,
+                                   &disk_, &files, &outdated, &err));
+  EXPECT_EQ("", err);
+  ManifestParserOptions options;
+  options.dupe_edge_action_ = kDupeEdgeActionError;
+  EXPECT_FALSE(ManifestCache::Load("cache", "build.ninja", options, &state,
+                                   &disk_, &files, &outdated, &err));
+  EXPECT_EQ("", err);
+
+  ASSERT_TRUE(disk_.WriteFile("build.ninja", "build other: phony\n"));
+  struct timeval times[2] = { { 1, 0 }, { 1, 0 } };
+  ASSERT_EQ(0, utimes("build.ninja", times));
+  EXPECT_FALSE(ManifestCache::Load("cache", "build.ninja", options_, &state,
+                                   &disk_, &files, &outdated, &err));
+  EXPECT_EQ("", err);
+  EXPECT_TRUE(state.edges_.empty());
+  EXPECT_TRUE(files.paths().empty());
+}
+
+TEST_F(ManifestCacheTest, PoolDepthForAnotherJobs) {
+  ASSERT_TRUE(disk_.WriteFile("build.ninja",
+"pool half\n"
+"  depth = jobs / 2\n"
+"build out: phony\n"
+"  pool = half\n"));
+  options_.parallelism_ = 8;
+  State parsed;
+  ASSERT_NO_FATAL_FAILURE(ParseAndSave(&parsed));
+  EXPECT_EQ(4, parsed.LookupPool("half")->depth());
+
+  // Another -j still matches, and the depth follows it.
+  State state;
+  ManifestFileRecorder files(&disk_);
+  string err;
+  bool outdated = false;
+  ManifestParserOptions options;
+  options.parallelism_ = 40;
+  ASSERT_TRUE(ManifestCache::Load("cache", "build.ninja", options, &state,
+                                  &disk_, &files, &outdated, &err));
+  ASSERT_EQ("", err);
+  EXPECT_FALSE(outdated);
+  EXPECT_EQ(20, state.LookupPool("half")->depth());
+}
+
+TEST_F(ManifestCacheTest, Touched) {
+  ASSERT_TRUE(disk_.WriteFile("build.ninja", "build out: phony\n"));
+  State parsed;
+  ASSERT_NO_FATAL_FAILURE(ParseAndSave(&parsed));
+
+  // Rewriting a file with the same contents leaves the cache usable, but
+  // with an mtime to update.
+  struct timeval times[2] = { { 1, 0 }, { 1, 0 } };
+  ASSERT_EQ(0, utimes("build.ninja", times));
+  State state;
+  ManifestFileRecorder files(&disk_);
+  string err;
+  bool outdated = false;
+  ASSERT_TRUE(ManifestCache::Load("cache", "build.ninja", options_, &state,
+                                  &disk_, &files, &outdated, &err));
+  EXPECT_EQ("", err);
+  EXPECT_TRUE(outdated);
+  EXPECT_EQ(1u, state.edges_.size());
+  EXPECT_FALSE(files.AnyChanged());
+}
+
+TEST_F(ManifestCacheTest, ReloadChangedSubninja) {
+  disk_.MakeDir("sub");
+  ASSERT_TRUE(disk_.WriteFile("sub/sub.ninja",
+"rule cc\n"
+"  command = cc $in -o $out\n"
+"build sub.o: cc sub.c\n"));
+  ASSERT_TRUE(disk_.WriteFile("other.ninja",
+"build other.o: cc other.c\n"
+"build dd: phony\n"
+"build dyn: cc x || dd\n"
+"  dyndep = dd\n"));
+  ASSERT_TRUE(disk_.WriteFile("third.ninja",
+"build third.o: cc third.c\n"));
+  ASSERT_TRUE(disk_.WriteFile("build.ninja",
+"rule cc\n"
+"  command = cc $in -o $out\n"
+"subninja sub.ninja\n"
+"  chdir = sub\n"
+"subninja other.ninja\n"
+"subninja third.ninja\n"
+"build all: phony sub/sub.o other.o\n"
+"default all\n"));
+  State parsed;
+  ASSERT_NO_FATAL_FAILURE(ParseAndSave(&parsed));
+
+  ASSERT_TRUE(disk_.WriteFile("sub/sub.ninja",
+"rule cc\n"
+"  command = cc $in -o $out $extra\n"
+"build sub.o: cc sub.c\n"
+"  extra = -g\n"
+"build new.o: cc new.c\n"));
+  ASSERT_TRUE(disk_.WriteFile("other.ninja",
+"build other.o: cc other.c\n"));
+  struct timeval times[2] = { { 1, 0 }, { 1, 0 } };
+  ASSERT_EQ(0, utimes("sub/sub.ninja", times));
+  ASSERT_EQ(0, utimes("other.ninja", times));
+
+  State state;
+  ManifestFileRecorder files(&disk_);
+  string err;
+  bool outdated = false;
+  ASSERT_TRUE(ManifestCache::Load("cache", "build.ninja", options_, &state,
+                                  &disk_, &files, &outdated, &err));
+  ASSERT_EQ("", err);
+  EXPECT_TRUE(outdated);
+  EXPECT_EQ(4u, files.paths().size());
+  EXPECT_FALSE(files.AnyChanged());
+
+  // third.ninja's edge and the top-level one come from the cache, the
+  // others from parsing the subninjas again.
+  ASSERT_EQ(5u, state.edges_.size());
+  EXPECT_EQ("third.o", state.edges_[0]->outputs_[0]->path());
+  EXPECT_EQ("all", state.edges_[1]->outputs_[0]->path());
+  Node* sub = state.LookupNode("sub/sub.o");
+  ASSERT_TRUE(sub);
+  EXPECT_EQ("cd sub/ && cc sub.c -o sub.o -g",
+            sub->in_edge()->EvaluateCommand());
+  EXPECT_EQ("cd sub/ && cc new.c -o new.o ",
+            state.LookupNode("sub/new.o")->in_edge()->EvaluateCommand());
+  EXPECT_EQ(state.LookupNode("all")->in_edge(), sub->out_edges()[0]);
+  EXPECT_FALSE(state.LookupNode("dyn")->in_edge());
+  EXPECT_FALSE(state.LookupNode("dd")->dyndep_pending());
+  EXPECT_TRUE(state.LookupNode("other.o")->in_edge());
+  ASSERT_EQ(1u, state.defaults_.size());
+
+  // Saved again, the result loads as it is.
+  ASSERT_TRUE(ManifestCache::Save("cache", "build.ninja", options_, state,
+                                  files, &err));
+  State reloaded;
+  ManifestFileRecorder reloaded_files(&disk_);
+  outdated = false;
+  ASSERT_TRUE(ManifestCache::Load("cache", "build.ninja", options_, &reloaded,
+                                  &disk_, &reloaded_files, &outdated, &err));
+  EXPECT_FALSE(outdated);
+  EXPECT_EQ(5u, reloaded.edges_.size());
+}
+
+TEST_F(ManifestCacheTest, ReloadNeedsFullParse) {
+  ASSERT_TRUE(disk_.WriteFile("sub.ninja", "build sub.o: phony\n"));
+  ASSERT_TRUE(disk_.WriteFile("build.ninja",
+"subninja sub.ninja\n"
+"x = 1\n"));
+  State parsed;
+  ASSERT_NO_FATAL_FAILURE(ParseAndSave(&parsed));
+
+  // The subninja saw a scope without x.
+  ASSERT_TRUE(disk_.WriteFile("sub.ninja", "build sub2.o: phony\n"));
+  struct timeval times[2] = { { 1, 0 }, { 1, 0 } };
+  ASSERT_EQ(0, utimes("sub.ninja", times));
+  State state;
+  ManifestFileRecorder files(&disk_);
+  string err;
+  bool outdated = false;
+  EXPECT_FALSE(ManifestCache::Load("cache", "build.ninja", options_, &state,
+                                   &disk_, &files, &outdated, &err));
+  EXPECT_EQ("", err);
+
+  // A subninja with a 'default' line adds to the State.
+  ASSERT_TRUE(disk_.WriteFile("build.ninja", "subninja sub.ninja\n"));
+  ASSERT_TRUE(disk_.WriteFile("sub.ninja",
+"build sub.o: phony\n"
+"default sub.o\n"));
+  State parsed2;
+  ASSERT_NO_FATAL_FAILURE(ParseAndSave(&parsed2));
+  ASSERT_TRUE(disk_.WriteFile("sub.ninja",
+"build sub2.o: phony\n"
+"default sub2.o\n"));
+  ASSERT_EQ(0, utimes("sub.ninja", times));
+  EXPECT_FALSE(ManifestCache::Load("cache", "build.ninja", options_, &state,
+                                   &disk_, &files, &outdated, &err));
+  EXPECT_EQ("", err);
+}
+
+TEST_F(ManifestCacheTest, Truncated) {
+  ASSERT_TRUE(disk_.WriteFile("build.ninja", "build out: phony in\n"));
+  State parsed;
+  ASSERT_NO_FATAL_FAILURE(ParseAndSave(&parsed));
+
+  string contents, err;
+  ASSERT_EQ(FileReader::Okay, disk_.ReadFile("cache", &contents, &err));
+  ASSERT_TRUE(disk_.WriteFile("cache",
+                              contents.substr(0, contents.size() - 2)));
+
+  State state;
+  ManifestFileRecorder files(&disk_);
+  bool outdated = false;
+  EXPECT_FALSE(ManifestCache::Load("cache", "build.ninja", options_, &state,
+                                   &disk_, &files, &outdated, &err));
+  EXPECT_EQ("manifest cache 'cache' is corrupt", err);
+}
+#endif  // _WIN32
+
+}  // anonymous namespace
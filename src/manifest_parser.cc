@@ -15,25 +15,155 @@
 #include "manifest_parser.h"
 #include "disk_interface.h"
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include <vector>
 
 #include "graph.h"
+#include "metrics.h"
+#include "parallel.h"
 #include "state.h"
+#include "trace.h"
 #include "util.h"
 #include "version.h"
 
+namespace {
+
+/// Reads the expressions of ManifestParser::EvaluatePoolDepth().
+struct DepthExpression {
+  DepthExpression(const string& text, int parallelism)
+      : p_(text.c_str()), parallelism_(parallelism) {}
+
+  bool Parse(int64_t* value, string* err) {
+    if (!Sum(value, err))
+      return false;
+    Skip();
+    if (*p_) {
+      *err = string("unexpected '") + *p_ + "'";
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  void Skip() {
+    while (*p_ == ' ' || *p_ == '\t')
+      ++p_;
+  }
+
+  bool Sum(int64_t* value, string* err) {
+    if (!Product(value, err))
+      return false;
+    for (;;) {
+      Skip();
+      char op = *p_;
+      if (op != '+' && op != '-')
+        return true;
+      ++p_;
+      int64_t rhs;
+      if (!Product(&rhs, err))
+        return false;
+      *value = op == '+' ? *value + rhs : *value - rhs;
+    }
+  }
+
+  bool Product(int64_t* value, string* err) {
+    if (!Term(value, err))
+      return false;
+    for (;;) {
+      Skip();
+      char op = *p_;
+      if (op != '*' && op != '/')
+        return true;
+      ++p_;
+      int64_t rhs;
+      if (!Term(&rhs, err))
+        return false;
+      if (op == '/' && rhs == 0) {
+        *err = "division by zero";
+        return false;
+      }
+      *value = op == '*' ? *value * rhs : *value / rhs;
+    }
+  }
+
+  bool Term(int64_t* value, string* err) {
+    Skip();
+    if (*p_ == '-') {
+      ++p_;
+      if (!Term(value, err))
+        return false;
+      *value = -*value;
+      return true;
+    }
+    if (*p_ == '(') {
+      ++p_;
+      if (!Sum(value, err))
+        return false;
+      Skip();
+      if (*p_ != ')') {
+        *err = "expected ')'";
+        return false;
+      }
+      ++p_;
+      return true;
+    }
+    if (*p_ >= '0' && *p_ <= '9') {
+      char* end;
+      *value = strtoll(p_, &end, 10);
+      p_ = end;
+      const char* kUnits = "KMGT";
+      if (const char* unit = *p_ ? strchr(kUnits, *p_) : NULL) {
+        *value <<= 10 * (unit - kUnits + 1);
+        ++p_;
+      }
+      return true;
+    }
+    const char* begin = p_;
+    while ((*p_ >= 'a' && *p_ <= 'z') || *p_ == '_')
+      ++p_;
+    string name(begin, p_ - begin);
+    if (name == "ncpus") {
+      *value = GetProcessorCount();
+    } else if (name == "jobs") {
+      *value = parallelism_ > 0 ? parallelism_ : GuessParallelism();
+    } else if (name == "mem") {
+      *value = GetTotalMemory();
+      if (*value < 0) {
+        *err = "the memory of this machine is unknown";
+        return false;
+      }
+    } else if (name.empty()) {
+      *err = "expected a number, ncpus, mem or jobs";
+      return false;
+    } else {
+      *err = "unknown name '" + name + "'";
+      return false;
+    }
+    return true;
+  }
+
+  const char* p_;
+  int parallelism_;
+};
+
+}  // anonymous namespace
+
 ManifestParser::ManifestParser(State* state, FileReader* file_reader,
                                ManifestParserOptions options)
     : Parser(state, file_reader),
-      options_(options), quiet_(false) {
+      options_(options), quiet_(false), concurrent_(false),
+      chdir_envs_(NULL) {
   env_ = &state->bindings_;
 }
 
-bool ManifestParser::Parse(const string& filename, const string& input,
+bool ManifestParser::Parse(const string& filename, StringPiece input,
                            string* err) {
   lexer_.Start(filename, input);
+  env_->source()->files.push_back(filename);
 
   for (;;) {
     Lexer::Token token = lexer_.ReadToken();
@@ -63,8 +193,13 @@ bool ManifestParser::Parse(const string& filename, const string& input,
       string value = let_value.Evaluate(env_);
       // Check ninja_required_version immediately so we can exit
       // before encountering any syntactic surprises.
-      if (name == "ninja_required_version")
+      if (name == "ninja_required_version") {
+        if (concurrent_)
+          return false;
         CheckNinjaVersion(value);
+      }
+      if (env_->source()->has_subninjas)
+        env_->source()->rebound = true;
       env_->AddBinding(name, value);
       break;
     }
@@ -73,8 +208,12 @@ bool ManifestParser::Parse(const string& filename, const string& input,
         return false;
       break;
     case Lexer::SUBNINJA:
-      if (!ParseFileInclude(true, err))
+      if (concurrent_) {
+        if (!ParseFileInclude(true, err))
+          return false;
+      } else if (!ParseSubninjas(err)) {
         return false;
+      }
       break;
     case Lexer::ERROR: {
       return lexer_.Error(lexer_.DescribeLastError(), err);
@@ -104,6 +243,8 @@ bool ManifestParser::ParsePool(string* err) {
     return lexer_.Error("duplicate pool '" + name + "'", err);
 
   int depth = -1;
+  string depth_expression;
+  bool local_only = false;
 
   while (lexer_.PeekToken(Lexer::INDENT)) {
     string key;
@@ -112,10 +253,16 @@ bool ManifestParser::ParsePool(string* err) {
       return false;
 
     if (key == "depth") {
-      string depth_string = value.Evaluate(env_);
-      depth = atol(depth_string.c_str());
-      if (depth < 0)
-        return lexer_.Error("invalid pool depth", err);
+      depth_expression = value.Evaluate(env_);
+      bool is_expression = false;
+      string depth_err;
+      if (!EvaluatePoolDepth(depth_expression, options_.parallelism_, &depth,
+                             &is_expression, &depth_err))
+        return lexer_.Error(depth_err, err);
+      if (!is_expression)
+        depth_expression.clear();
+    } else if (key == "local_only") {
+      local_only = !value.Evaluate(env_).empty();
     } else {
       return lexer_.Error("unexpected variable '" + key + "'", err);
     }
@@ -124,7 +271,35 @@ bool ManifestParser::ParsePool(string* err) {
   if (depth < 0)
     return lexer_.Error("expected 'depth =' line", err);
 
-  state_->AddPool(new Pool(name, depth));
+  Pool* pool = new Pool(name, depth, local_only);
+  pool->set_depth_expression(depth_expression);
+  state_->AddPool(pool);
+  env_->source()->declares_globals = true;
+  return true;
+}
+
+// static
+bool ManifestParser::EvaluatePoolDepth(const string& expression,
+                                       int parallelism, int* depth,
+                                       bool* is_expression, string* err) {
+  *is_expression =
+      expression.find_first_not_of("0123456789") != string::npos;
+  int64_t value = 0;
+  if (!*is_expression) {
+    value = atol(expression.c_str());
+  } else {
+    DepthExpression parser(expression, parallelism);
+    if (!parser.Parse(&value, err)) {
+      *err = "invalid pool depth: " + *err;
+      return false;
+    }
+    if (value < 0) {
+      *err = "invalid pool depth";
+      return false;
+    }
+    value = max<int64_t>(value, 1);
+  }
+  *depth = (int)min<int64_t>(value, INT_MAX);
   return true;
 }
 
@@ -157,15 +332,23 @@ bool ManifestParser::ParseRule(string* err) {
     }
   }
 
-  if (rule->bindings_["rspfile"].empty() !=
-      rule->bindings_["rspfile_content"].empty()) {
+  // A rule without an rspfile still hides any variables of that name.
+  if (!rule->GetBinding("rspfile"))
+    rule->AddBinding("rspfile", EvalString());
+  if (!rule->GetBinding("rspfile_content"))
+    rule->AddBinding("rspfile_content", EvalString());
+  if (rule->GetBinding("rspfile")->empty() !=
+      rule->GetBinding("rspfile_content")->empty()) {
     return lexer_.Error("rspfile and rspfile_content need to be "
                         "both specified", err);
   }
 
-  if (rule->bindings_["command"].empty())
+  const EvalString* command = rule->GetBinding("command");
+  if (!command || command->empty())
     return lexer_.Error("expected 'command =' line", err);
 
+  if (env_->source()->has_subninjas)
+    env_->source()->rebound = true;
   env_->AddRule(rule);
   return true;
 }
@@ -195,6 +378,7 @@ bool ManifestParser::ParseDefault(string* err) {
       return lexer_.Error(path_err, err);
     if (!state_->AddDefault(path, env_, &path_err))
       return lexer_.Error(path_err, err);
+    env_->source()->declares_globals = true;
 
     eval.Clear();
     if (!lexer_.ReadPath(&eval, err))
@@ -316,6 +500,19 @@ bool ManifestParser::ParseEdge(string* err) {
     edge->pool_ = pool;
   }
 
+  string weight = edge->GetBinding("weight");
+  if (!weight.empty()) {
+    char* end;
+    long value = strtol(weight.c_str(), &end, 10);
+    if (*end || value < 1 || value > INT_MAX)
+      return lexer_.Error("invalid weight '" + weight + "'", err);
+    // Heavier than its pool, it could never start.
+    if (edge->pool_->depth() != 0 && value > edge->pool_->depth())
+      return lexer_.Error("weight " + weight + " exceeds the depth of pool '" +
+                          edge->pool_->name() + "'", err);
+    edge->weight_ = (int)value;
+  }
+
   edge->outputs_.reserve(outs.size());
   for (size_t i = 0, e = outs.size(); i != e; ++i) {
     string path = outs[i].Evaluate(env);
@@ -330,6 +527,8 @@ bool ManifestParser::ParseEdge(string* err) {
         return false;
       } else {
         if (!quiet_) {
+          if (concurrent_)
+            return false;
           Warning("multiple rules generate %s. "
                   "builds involving this target will not be correct; "
                   "continuing anyway [-w dupbuild=warn]",
@@ -344,7 +543,7 @@ bool ManifestParser::ParseEdge(string* err) {
     // All outputs of the edge are already created by other edges. Don't add
     // this edge.  Do this check before input nodes are connected to the edge.
     state_->edges_.pop_back();
-    delete edge;
+    edge->~Edge();  // Its memory stays in the State's arena.
     return true;
   }
   edge->implicit_outs_ = implicit_outs;
@@ -373,6 +572,8 @@ bool ManifestParser::ParseEdge(string* err) {
     if (new_end != edge->inputs_.end()) {
       edge->inputs_.erase(new_end, edge->inputs_.end());
       if (!quiet_) {
+        if (concurrent_)
+          return false;
         Warning("phony target '%s' names itself as an input; "
                 "ignoring [-w phonycycle=warn]",
                 out->path().c_str());
@@ -409,96 +610,153 @@ bool ManifestParser::ParseEdge(string* err) {
   return true;
 }
 
+
+namespace {
+
+/// A FileReader for a worker thread.  The process working directory is
+/// shared, so chdir is emulated by prefixing paths instead, and reads are
+/// serialized because the underlying reader need not be thread-safe.
+struct SubdirFileReader : public FileReader {
+  SubdirFileReader(FileReader* file_reader, Mutex* lock, const string& cwd,
+                   const string& dir)
+      : file_reader_(file_reader), lock_(lock), cwd_(cwd) {
+    if (cwd_.empty() || cwd_[cwd_.size() - 1] != '/')
+      cwd_ += '/';
+    Chdir(dir, NULL);
+  }
+
+  virtual Status ReadFile(const string& path, string* contents, string* err) {
+    string full_path = IsAbsolute(path) ? path : dir_ + path;
+    ScopedLock lock(lock_);
+    return file_reader_->ReadFile(full_path, contents, err);
+  }
+
+  virtual Status ReadFileTerminated(const string& path, MappedFile* file,
+                                    string* err) {
+    string full_path = IsAbsolute(path) ? path : dir_ + path;
+    ScopedLock lock(lock_);
+    return file_reader_->ReadFileTerminated(full_path, file, err);
+  }
+
+  virtual Status Chdir(const string& path, string* err) {
+    if (path.compare(0, cwd_.size(), cwd_) == 0)
+      dir_ = path.substr(cwd_.size());  // A directory from Getcwd().
+    else if (IsAbsolute(path))
+      dir_ = path;
+    else
+      dir_ += path;
+    if (!dir_.empty() && dir_[dir_.size() - 1] != '/')
+      dir_ += '/';
+    return Okay;
+  }
+
+  virtual Status Getcwd(string* path, string* err) {
+    *path = IsAbsolute(dir_) ? dir_ : cwd_ + dir_;
+    return Okay;
+  }
+
+ private:
+  static bool IsAbsolute(const string& path) {
+    return !path.empty() && path[0] == '/';
+  }
+
+  FileReader* file_reader_;
+  Mutex* lock_;
+  /// The real working directory, with a trailing slash.
+  string cwd_;
+  /// The emulated working directory, relative to |cwd_| unless absolute.
+  string dir_;
+};
+
+}  // anonymous namespace
+
 bool ManifestParser::ParseFileInclude(bool new_scope, string* err) {
+  FileInclude include;
+  if (!ReadFileInclude(new_scope, &include, err))
+    return false;
+  return LoadFileInclude(include, err);
+}
+
+bool ManifestParser::ReadFileInclude(bool new_scope, FileInclude* include,
+                                     string* err) {
   EvalString eval;
   if (!lexer_.ReadPath(&eval, err))
     return false;
-  string path = eval.Evaluate(env_);
+  include->path = eval.Evaluate(env_);
+  include->new_scope = new_scope;
+  if (new_scope)
+    env_->source()->has_subninjas = true;
 
   if (!ExpectToken(Lexer::NEWLINE, err))
     return false;
 
-  bool has_chdir = false;
-  string parent_path = env_->AsString();
-  string dir_err;
-  string prev_cwd;
-  string rel_path;
-  bool ok = true;  // Always restore prev_cwd, even if there is an error.
   while (lexer_.PeekToken(Lexer::INDENT)) {
     string key;
     EvalString let_value;
-    if (!ParseLet(&key, &let_value, err)) {
-      ok = false;
-      break;
-    }
+    if (!ParseLet(&key, &let_value, err))
+      return false;
     if (key != "chdir") {
-      lexer_.Error("illegal key '" + key + "' (only 'chdir' is supported)",
-                   err);
-      ok = false;
-      break;
-    }
-    if (!new_scope) {
-      lexer_.Error("invalid use of 'chdir' in include line", err);
-      ok = false;
-      break;
-    }
-    if (has_chdir) {
-      lexer_.Error("duplicate 'chdir' in subninja", err);
-      ok = false;
-      break;
+      return lexer_.Error("illegal key '" + key +
+                          "' (only 'chdir' is supported)", err);
     }
-    rel_path = let_value.Evaluate(env_);
+    if (!new_scope)
+      return lexer_.Error("invalid use of 'chdir' in include line", err);
+    if (include->has_chdir)
+      return lexer_.Error("duplicate 'chdir' in subninja", err);
+    include->rel_path = let_value.Evaluate(env_);
     // if (rel_path.find("./") == 0 || rel_path.find("/./") != string::npos ||
     //     rel_path.find("../") == 0 || rel_path.find("/../") != string::npos) {
     //   return lexer_.Error("invalid use of '.' or '..' in chdir", err);
     // }
+    include->has_chdir = true;
+  }
+  include->lexer = lexer_;
+  return true;
+}
+
+bool ManifestParser::LoadFileInclude(const FileInclude& include,
+                                     string* err) {
+  string parent_path = env_->AsString();
+  string dir_err;
+  string prev_cwd;
+  string rel_path;
+  if (include.has_chdir) {
     if (file_reader_->Getcwd(&prev_cwd, &dir_err) != FileReader::Okay) {
       *err = "Getcwd: " + dir_err;
-      return false;  // Can return because has_chdir is always false here.
+      return false;
     }
-    if (file_reader_->Chdir(rel_path, &dir_err) != FileReader::Okay) {
-      *err = "Chdir to '" + rel_path + "': " + dir_err;
+    if (file_reader_->Chdir(include.rel_path, &dir_err) != FileReader::Okay) {
+      *err = "Chdir to '" + include.rel_path + "': " + dir_err;
       return false;
     }
-    has_chdir = true;
-    rel_path += '/';
+    rel_path = include.rel_path + '/';
   }
 
-  if (ok) {
-    ManifestParser subparser(state_, file_reader_, options_);
-    if (new_scope) {
-      // Note that rel_path of "" (for whatever reason) means no chdir.
-      subparser.env_ = new BindingEnv(env_, rel_path,
-                                      parent_path + rel_path);
-
-      if (!rel_path.empty()) {
-        subparser.env_->AddRule(&State::kPhonyRule);
-
-        const string& abs_path = subparser.env_->AsString();
-        // Find all inbound references to this chdir. Their env will be a parent
-        // of subparser.env_ and assume no chdir. Replace it so that
-        // subparser.env_ is used correctly with the chdir in place.
-        for (State::Paths::iterator i = state_->paths_.begin();
-            i != state_->paths_.end(); ++i) {
-          if (i->first.AsString().find(abs_path) == 0) {
-            Node* node = i->second;
-            node->ResetEnv(subparser.env_);
-          }
-        }
-      }
-    } else {
-      subparser.env_ = env_;
-    }
-
-    if (!subparser.Load(path, err, &lexer_)) {
-      ok = false;
+  ManifestParser subparser(state_, file_reader_, options_);
+  subparser.concurrent_ = concurrent_;
+  subparser.chdir_envs_ = chdir_envs_;
+  if (include.new_scope) {
+    // Note that rel_path of "" (for whatever reason) means no chdir.
+    subparser.env_ = new BindingEnv(env_, rel_path, parent_path + rel_path);
+
+    if (!rel_path.empty()) {
+      subparser.env_->AddRule(&State::kPhonyRule);
+      // Nodes in the chdir that parent scopes referenced before now were
+      // created as if there were no chdir.
+      state_->ResetEnvUnder(subparser.env_);
+      if (chdir_envs_)
+        chdir_envs_->push_back(subparser.env_);
     }
+  } else {
+    subparser.env_ = env_;
   }
 
-  // Restore prev_cwd. Note that has_chdir is set to true only after
-  // file_reader_->Chdir() succeeds, and any errors after that set ok = false.
-  // Do not smash the value of err if it was previously set.
-  if (has_chdir) {
+  Lexer lexer = include.lexer;
+  bool ok = subparser.Load(include.path, err, &lexer);
+
+  // Restore prev_cwd.  Do not smash the value of err if it was previously
+  // set.
+  if (include.has_chdir) {
     if (file_reader_->Chdir(prev_cwd, &dir_err) != FileReader::Okay) {
       if (ok) {
         ok = false;
@@ -508,3 +766,234 @@ bool ManifestParser::ParseFileInclude(bool new_scope, string* err) {
   }
   return ok;
 }
+
+bool ManifestParser::LoadSubninja(BindingEnv* parent, const string& path,
+                                  const string& chdir, string* err) {
+  FileInclude include;
+  include.path = path;
+  include.new_scope = true;
+  include.has_chdir = !chdir.empty();
+  include.rel_path = chdir;
+  // Errors reading the file are reported against the parent's.
+  const vector<string>& parent_files = parent->source()->files;
+  include.lexer.Start(parent_files.empty() ? "" : parent_files[0], "");
+  env_ = parent;
+  return LoadFileInclude(include, err);
+}
+
+bool ManifestParser::ParseSubninjas(string* err) {
+  vector<FileInclude> includes(1);
+  if (!ReadFileInclude(true, &includes[0], err))
+    return false;
+
+  // Subninjas only see their parent's scope, which cannot change while
+  // consecutive 'subninja' lines are read.
+  string line_err;
+  for (;;) {
+    while (lexer_.PeekToken(Lexer::NEWLINE)) {}
+    if (!lexer_.PeekToken(Lexer::SUBNINJA))
+      break;
+    includes.push_back(FileInclude());
+    if (!ReadFileInclude(true, &includes.back(), &line_err)) {
+      includes.pop_back();
+      break;
+    }
+  }
+
+  // Errors in the files come before an error on a later line.
+  if (!LoadSubninjas(includes, err))
+    return false;
+  if (!line_err.empty()) {
+    *err = line_err;
+    return false;
+  }
+  return true;
+}
+
+/// Loads subninjas into a private State each, then merges those into the
+/// real one in manifest order.  A subninja whose result would depend on the
+/// others, or whose parse failed, is simply loaded again serially at its
+/// turn; that reproduces the exact serial behavior, errors included.
+struct ManifestParser::SubninjaLoader : public ParallelTask {
+  struct Shard {
+    Shard() : env(NULL), ok(false) {}
+    State state;
+    BindingEnv* env;
+    /// chdir scopes created, |env| first if it is one.
+    vector<BindingEnv*> chdir_envs;
+    bool ok;
+  };
+
+  SubninjaLoader(ManifestParser* parser, const vector<FileInclude>& includes,
+                 const string& cwd)
+      : parser_(parser), includes_(includes), cwd_(cwd),
+        shards_(includes.size()) {
+    const string& parent_path = parser_->env_->AsString();
+    for (size_t i = 0; i < includes_.size(); ++i) {
+      const FileInclude& include = includes_[i];
+      // Leave "chdir =" with an empty directory to LoadFileInclude().
+      if (include.has_chdir && include.rel_path.empty())
+        continue;
+      Shard* shard = new Shard;
+      shard->state.pools_ = parser_->state_->pools_;
+      string rel_path = include.has_chdir ? include.rel_path + '/' : "";
+      shard->env = new BindingEnv(parser_->env_, rel_path,
+                                  parent_path + rel_path);
+      if (!rel_path.empty()) {
+        shard->env->AddRule(&State::kPhonyRule);
+        shard->chdir_envs.push_back(shard->env);
+      }
+      shards_[i] = shard;
+    }
+  }
+
+  ~SubninjaLoader() {
+    for (size_t i = 0; i < shards_.size(); ++i)
+      delete shards_[i];
+  }
+
+  virtual void Run(size_t index) {
+    Shard* shard = shards_[index];
+    if (!shard)
+      return;
+    const FileInclude& include = includes_[index];
+    SubdirFileReader reader(parser_->file_reader_, &read_lock_, cwd_,
+                            include.has_chdir ? include.rel_path : "");
+    ManifestParser subparser(&shard->state, &reader, parser_->options_);
+    subparser.env_ = shard->env;
+    subparser.concurrent_ = true;
+    subparser.chdir_envs_ = &shard->chdir_envs;
+    string err;
+    Lexer lexer = include.lexer;
+    shard->ok = subparser.Load(include.path, &err, &lexer);
+  }
+
+  /// Add the results to the real State in order.
+  bool Merge(string* err) {
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      if (shards_[i] && shards_[i]->ok && CanMerge(*shards_[i])) {
+        Merge(shards_[i]);
+      } else if (!parser_->LoadFileInclude(includes_[i], err)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  /// Whether merging |shard| gives the same result as loading it now.
+  bool CanMerge(const Shard& shard) const {
+    State* state = parser_->state_;
+    for (map<string, Pool*>::const_iterator i = shard.state.pools_.begin();
+         i != shard.state.pools_.end(); ++i) {
+      Pool* pool = state->LookupPool(i->first);
+      if (pool && pool != i->second)
+        return false;  // "duplicate pool".
+    }
+    for (vector<Edge*>::const_iterator e = shard.state.edges_.begin();
+         e != shard.state.edges_.end(); ++e) {
+      for (vector<Node*>::const_iterator o = (*e)->outputs_.begin();
+           o != (*e)->outputs_.end(); ++o) {
+        Node* node = state->LookupNode((*o)->path());
+        if (node && node->in_edge())
+          return false;  // "multiple rules generate".
+      }
+    }
+    return true;
+  }
+
+  void Merge(Shard* shard) {
+    State* state = parser_->state_;
+    for (vector<BindingEnv*>::iterator i = shard->chdir_envs.begin();
+         i != shard->chdir_envs.end(); ++i)
+      state->ResetEnvUnder(*i);
+
+    for (map<string, Pool*>::iterator i = shard->state.pools_.begin();
+         i != shard->state.pools_.end(); ++i) {
+      if (!state->LookupPool(i->first))
+        state->AddPool(i->second);
+    }
+
+    // Move the shard's nodes over, unless the real State has them already.
+    // Node ids are unused until the deps log is loaded, so they number the
+    // shard's nodes meanwhile.
+    vector<Node*> nodes;
+    vector<Node*> duplicates;
+    nodes.reserve(shard->state.paths_.size());
+    state->paths_.reserve(state->paths_.size() + shard->state.paths_.size());
+    for (State::Paths::iterator i = shard->state.paths_.begin();
+         i != shard->state.paths_.end(); ++i) {
+      Node* node = i->second;
+      Node* existing = state->LookupNode(node->path());
+      node->set_id((int)nodes.size());
+      if (existing) {
+        for (vector<Edge*>::const_iterator e = node->out_edges().begin();
+             e != node->out_edges().end(); ++e)
+          existing->AddOutEdge(*e);
+        if (node->dyndep_pending())
+          existing->set_dyndep_pending(true);
+        nodes.push_back(existing);
+        duplicates.push_back(node);
+      } else {
+        state->AddNode(node);
+        nodes.push_back(node);
+      }
+    }
+
+    for (vector<Edge*>::iterator e = shard->state.edges_.begin();
+         e != shard->state.edges_.end(); ++e) {
+      Edge* edge = *e;
+      for (vector<Node*>::iterator n = edge->inputs_.begin();
+           n != edge->inputs_.end(); ++n)
+        *n = nodes[(*n)->id()];
+      for (vector<Node*>::iterator n = edge->outputs_.begin();
+           n != edge->outputs_.end(); ++n) {
+        *n = nodes[(*n)->id()];
+        (*n)->set_in_edge(edge);
+      }
+      if (edge->dyndep_)
+        edge->dyndep_ = nodes[edge->dyndep_->id()];
+      edge->id_ = (int)state->edges_.size();
+      state->edges_.push_back(edge);
+    }
+    for (vector<Node*>::iterator n = shard->state.defaults_.begin();
+         n != shard->state.defaults_.end(); ++n)
+      state->defaults_.push_back(nodes[(*n)->id()]);
+
+    for (State::Paths::iterator i = shard->state.paths_.begin();
+         i != shard->state.paths_.end(); ++i)
+      i->second->set_id(-1);
+    for (vector<Node*>::iterator n = duplicates.begin();
+         n != duplicates.end(); ++n)
+      (*n)->~Node();
+    state->AdoptArena(&shard->state);
+  }
+
+  ManifestParser* parser_;
+  const vector<FileInclude>& includes_;
+  string cwd_;
+  vector<Shard*> shards_;
+  Mutex read_lock_;
+};
+
+bool ManifestParser::LoadSubninjas(const vector<FileInclude>& includes,
+                                   string* err) {
+  // The shards are used even on a single core, so that the result never
+  // depends on the machine.
+  string cwd, cwd_err;
+  if (includes.size() < 2 ||
+      file_reader_->Getcwd(&cwd, &cwd_err) != FileReader::Okay) {
+    for (vector<FileInclude>::const_iterator i = includes.begin();
+         i != includes.end(); ++i) {
+      if (!LoadFileInclude(*i, err))
+        return false;
+    }
+    return true;
+  }
+
+  METRIC_RECORD(".ninja parse subninjas");
+  TRACE_PHASE(".ninja parse subninjas");
+  SubninjaLoader loader(this, includes, cwd);
+  RunInParallel(&loader, includes.size(), ParallelismFor(includes.size(), 1));
+  return loader.Merge(err);
+}
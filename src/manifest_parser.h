@@ -15,6 +15,11 @@
 #ifndef NINJA_MANIFEST_PARSER_H_
 #define NINJA_MANIFEST_PARSER_H_
 
+#include <string>
+#include <vector>
+
+using namespace std;
+
 #include "parser.h"
 
 struct BindingEnv;
@@ -33,9 +38,12 @@ enum PhonyCycleAction {
 struct ManifestParserOptions {
   ManifestParserOptions()
       : dupe_edge_action_(kDupeEdgeActionWarn),
-        phony_cycle_action_(kPhonyCycleActionWarn) {}
+        phony_cycle_action_(kPhonyCycleActionWarn), parallelism_(0) {}
   DupeEdgeAction dupe_edge_action_;
   PhonyCycleAction phony_cycle_action_;
+  /// The -j of the build, which is "jobs" in the depths of pools; 0 for
+  /// the default.
+  int parallelism_;
 };
 
 /// Parses .ninja files.
@@ -49,9 +57,28 @@ struct ManifestParser : public Parser {
     return Parse("input", input, err);
   }
 
+  /// Load |path| as a 'subninja' line of the scope |parent| would, with
+  /// |chdir| as its 'chdir' directory unless it is empty.  The current
+  /// directory must be that of |parent|.  Used by the manifest cache to
+  /// load one subninja again.
+  bool LoadSubninja(BindingEnv* parent, const string& path,
+                    const string& chdir, string* err);
+
+  /// Work out the "depth =" of a pool, |expression| once its variables are
+  /// expanded: a number, or a sum, difference, product or quotient of
+  /// numbers, in parentheses as needed, that may end in K, M, G or T for
+  /// powers of 1024, and of the names "ncpus", the processors of this
+  /// machine, "mem", the bytes of memory it has, and "jobs", how many
+  /// commands the build runs at once.  Unlike a plain 0, which is no limit,
+  /// an expression comes to a depth of at least 1.  Sets |is_expression|
+  /// if the depth has to be worked out again for another machine or -j.
+  static bool EvaluatePoolDepth(const string& expression, int parallelism,
+                                int* depth, bool* is_expression,
+                                string* err);
+
 private:
-  /// Parse a file, given its contents as a string.
-  bool Parse(const string& filename, const string& input, string* err);
+  /// Parse a file, given its contents, which a nul byte must follow.
+  bool Parse(const string& filename, StringPiece input, string* err);
 
   /// Parse various statement types.
   bool ParsePool(string* err);
@@ -60,12 +87,41 @@ private:
   bool ParseEdge(string* err);
   bool ParseDefault(string* err);
 
+  /// A 'subninja' or 'include' line that has been read but whose file has
+  /// not been loaded yet.
+  struct FileInclude {
+    FileInclude() : new_scope(false), has_chdir(false) {}
+    string path;
+    bool new_scope;
+    bool has_chdir;
+    /// The 'chdir' directory, if any.
+    string rel_path;
+    /// The lexer just after the line, for reporting errors in the file.
+    Lexer lexer;
+  };
+
   /// Parse either a 'subninja' or 'include' line.
   bool ParseFileInclude(bool new_scope, string* err);
+  bool ReadFileInclude(bool new_scope, FileInclude* include, string* err);
+  bool LoadFileInclude(const FileInclude& include, string* err);
+
+  /// Parse a run of consecutive 'subninja' lines, loading the files on
+  /// several threads at once.
+  bool ParseSubninjas(string* err);
+  bool LoadSubninjas(const vector<FileInclude>& includes, string* err);
+
+  struct SubninjaLoader;
 
   BindingEnv* env_;
   ManifestParserOptions options_;
   bool quiet_;
+
+  /// Set when parsing into a private State on a worker thread.  Anything
+  /// that has to happen in manifest order, such as printing a warning, makes
+  /// the parse fail instead so that the file is loaded again serially.
+  bool concurrent_;
+  /// When set, every chdir scope created is appended here.
+  vector<BindingEnv*>* chdir_envs_;
 };
 
 #endif  // NINJA_MANIFEST_PARSER_H_
@@ -82,6 +82,93 @@ TEST_F(ParserTest, RuleAttributes) {
 ));
 }
 
+TEST_F(ParserTest, PoolAttributes) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(
+"pool link_pool\n"
+"  depth = 4\n"
+"  local_only = 1\n"
+"pool compile_pool\n"
+"  depth = 100\n"));
+
+  EXPECT_EQ(4, state.LookupPool("link_pool")->depth());
+  EXPECT_TRUE(state.LookupPool("link_pool")->local_only());
+  EXPECT_FALSE(state.LookupPool("compile_pool")->local_only());
+  EXPECT_TRUE(state.LookupPool("console")->local_only());
+}
+
+TEST_F(ParserTest, PoolDepthExpressions) {
+  ManifestParserOptions options;
+  options.parallelism_ = 12;
+  ManifestParser parser(&state, &fs_, options);
+  string err;
+  EXPECT_TRUE(parser.ParseTest(
+"quarter = 4\n"
+"pool plain\n"
+"  depth = 0\n"
+"pool jobs\n"
+"  depth = jobs / $quarter\n", &err));
+  ASSERT_EQ("", err);
+  EXPECT_EQ(0, state.LookupPool("plain")->depth());
+  EXPECT_EQ("", state.LookupPool("plain")->depth_expression());
+  EXPECT_EQ(3, state.LookupPool("jobs")->depth());
+  EXPECT_EQ("jobs / 4", state.LookupPool("jobs")->depth_expression());
+
+  int depth;
+  bool is_expression;
+  EXPECT_TRUE(ManifestParser::EvaluatePoolDepth("0", 12, &depth,
+                                                &is_expression, &err));
+  EXPECT_EQ(0, depth);
+  EXPECT_FALSE(is_expression);
+  EXPECT_TRUE(ManifestParser::EvaluatePoolDepth("jobs / 4", 12, &depth,
+                                                &is_expression, &err));
+  EXPECT_EQ(3, depth);
+  EXPECT_TRUE(is_expression);
+  EXPECT_TRUE(ManifestParser::EvaluatePoolDepth("(jobs - 2) * 3 + 1", 12,
+                                                &depth, &is_expression,
+                                                &err));
+  EXPECT_EQ(31, depth);
+  EXPECT_TRUE(ManifestParser::EvaluatePoolDepth("8G / 1G", 12, &depth,
+                                                &is_expression, &err));
+  EXPECT_EQ(8, depth);
+  // An expression never means no limit.
+  EXPECT_TRUE(ManifestParser::EvaluatePoolDepth("jobs / 100", 12, &depth,
+                                                &is_expression, &err));
+  EXPECT_EQ(1, depth);
+  EXPECT_TRUE(ManifestParser::EvaluatePoolDepth("ncpus", 12, &depth,
+                                                &is_expression, &err));
+  EXPECT_EQ(GetProcessorCount(), depth);
+
+  EXPECT_FALSE(ManifestParser::EvaluatePoolDepth("jobs / 0", 12, &depth,
+                                                 &is_expression, &err));
+  EXPECT_EQ("invalid pool depth: division by zero", err);
+  EXPECT_FALSE(ManifestParser::EvaluatePoolDepth("cpus", 12, &depth,
+                                                 &is_expression, &err));
+  EXPECT_EQ("invalid pool depth: unknown name 'cpus'", err);
+  EXPECT_FALSE(ManifestParser::EvaluatePoolDepth("(jobs", 12, &depth,
+                                                 &is_expression, &err));
+  EXPECT_EQ("invalid pool depth: expected ')'", err);
+}
+
+TEST_F(ParserTest, Weight) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(
+"pool link_pool\n"
+"  depth = 8\n"
+"rule link\n"
+"  command = ld $in -o $out\n"
+"  pool = link_pool\n"
+"  weight = 4\n"
+"build lto: link a.o\n"
+"  weight = 8\n"
+"build plain: link b.o\n"
+"build unpooled: link c.o\n"
+"  pool =\n"
+"  weight = 100\n"));
+
+  EXPECT_EQ(8, GetNode("lto")->in_edge()->weight());
+  EXPECT_EQ(4, GetNode("plain")->in_edge()->weight());
+  EXPECT_EQ(100, GetNode("unpooled")->in_edge()->weight());
+}
+
 TEST_F(ParserTest, IgnoreIndentedComments) {
   ASSERT_NO_FATAL_FAILURE(AssertParse(
 "  #indented comment\n"
@@ -195,6 +282,36 @@ TEST_F(ParserTest, VariableScope) {
   EXPECT_EQ("cmd bar b outer", state.edges_[1]->EvaluateCommand());
 }
 
+TEST_F(ParserTest, SharedVariableValues) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(
+"rule cmd\n"
+"  command = cmd $flags $in $out\n"
+"build a: cmd a.c\n"
+"  zz = 1\n"
+"  flags = -O2 -g\n"
+"build b: cmd b.c\n"
+"  flags = -O2 -g\n"
+"  flags = -O3\n"
+"build c: cmd c.c\n"
+"  flags = -O2 -g\n"
+));
+
+  ASSERT_EQ(3u, state.edges_.size());
+  const BindingEnv::Bindings& a = state.edges_[0]->env_->bindings();
+  const BindingEnv::Bindings& b = state.edges_[1]->env_->bindings();
+  const BindingEnv::Bindings& c = state.edges_[2]->env_->bindings();
+  ASSERT_EQ(2u, a.size());
+  ASSERT_EQ(1u, b.size());
+  ASSERT_EQ(1u, c.size());
+  // The bindings are sorted, and equal strings are stored once.
+  EXPECT_EQ("flags", *a[0].first);
+  EXPECT_EQ("zz", *a[1].first);
+  EXPECT_EQ(a[0].first, c[0].first);
+  EXPECT_EQ(a[0].second, c[0].second);
+  EXPECT_EQ("-O3", *b[0].second);
+  EXPECT_EQ("cmd -O2 -g c.c c", state.edges_[2]->EvaluateCommand());
+}
+
 TEST_F(ParserTest, Continuation) {
   ASSERT_NO_FATAL_FAILURE(AssertParse(
 "rule link\n"
@@ -846,6 +963,31 @@ TEST_F(ParserTest, Errors) {
                                   "build out: run in\n", &err));
     EXPECT_EQ("input:5: unknown pool name 'unnamed_pool'\n", err);
   }
+
+  {
+    State local_state;
+    ManifestParser parser(&local_state, NULL);
+    string err;
+    EXPECT_FALSE(parser.ParseTest("rule run\n"
+                                  "  command = echo\n"
+                                  "  weight = 1.5\n"
+                                  "build out: run in\n", &err));
+    EXPECT_EQ("input:5: invalid weight '1.5'\n", err);
+  }
+
+  {
+    State local_state;
+    ManifestParser parser(&local_state, NULL);
+    string err;
+    EXPECT_FALSE(parser.ParseTest("pool p\n"
+                                  "  depth = 2\n"
+                                  "rule run\n"
+                                  "  command = echo\n"
+                                  "  pool = p\n"
+                                  "build out: run in\n"
+                                  "  weight = 3\n", &err));
+    EXPECT_EQ("input:8: weight 3 exceeds the depth of pool 'p'\n", err);
+  }
 }
 
 TEST_F(ParserTest, MissingInput) {
@@ -933,6 +1075,97 @@ TEST_F(ParserTest, DuplicateRuleInDifferentSubninjasWithInclude) {
                                 "build y : cat\n", &err));
 }
 
+TEST_F(ParserTest, ConsecutiveSubninjas) {
+  // Consecutive subninjas are parsed concurrently; the graph must be the
+  // same as if they had been parsed one after another.
+  fs_.Create("a.ninja",
+    "rule cat\n"
+    "  command = cat $var $in > $out\n"
+    "pool a_pool\n"
+    "  depth = 2\n"
+    "build a.o: cat shared.h\n"
+    "default a.o\n");
+  fs_.MakeDir("sub");
+  fs_.Create("sub/b.ninja",
+    "rule cat\n"
+    "  command = cat $in > $out\n"
+    "build b.o: cat b.c\n");
+  fs_.Create("c.ninja",
+    "rule link\n"
+    "  command = link $in -o $out\n"
+    "  pool = a_pool\n"
+    "build c: link a.o sub/b.o shared.h\n"
+    "default c\n");
+  ASSERT_NO_FATAL_FAILURE(AssertParse(
+"var = outer\n"
+"build sub/b.o.stamp: phony sub/b.o\n"
+"subninja a.ninja\n"
+"\n"
+"subninja b.ninja\n"
+"  chdir = sub\n"
+"subninja c.ninja\n"
+"build all: phony c\n"));
+  EXPECT_EQ("/", VerifyCwd(fs_));
+
+  ASSERT_EQ(5u, state.edges_.size());
+  EXPECT_EQ("cat outer shared.h > a.o", state.edges_[1]->EvaluateCommand());
+#if _WIN32
+  EXPECT_EQ("cmd /c cd sub/ && cat b.c > b.o",
+            state.edges_[2]->EvaluateCommand());
+#else
+  EXPECT_EQ("cd sub/ && cat b.c > b.o",
+            state.edges_[2]->EvaluateCommand());
+#endif
+  EXPECT_EQ("link a.o sub/b.o shared.h -o c",
+            state.edges_[3]->EvaluateCommand());
+  EXPECT_EQ("a_pool", state.edges_[3]->pool()->name());
+
+  // Nodes shared between subninjas are merged.
+  Node* b = state.LookupNode("sub/b.o");
+  EXPECT_EQ(state.edges_[2], b->in_edge());
+  ASSERT_EQ(2u, b->out_edges().size());
+  EXPECT_EQ(state.edges_[0], b->out_edges()[0]);
+  EXPECT_EQ(state.edges_[3], b->out_edges()[1]);
+  EXPECT_EQ(2u, state.LookupNode("shared.h")->out_edges().size());
+  ASSERT_EQ(2u, state.defaults_.size());
+  EXPECT_EQ("a.o", state.defaults_[0]->path());
+  EXPECT_EQ("c", state.defaults_[1]->path());
+}
+
+TEST_F(ParserTest, DuplicateEdgeInConsecutiveSubninjas) {
+  fs_.Create("a.ninja",
+    "rule cat\n"
+    "  command = cat $in > $out\n"
+    "build out: cat in\n");
+  fs_.Create("b.ninja",
+    "rule cat\n"
+    "  command = cat $in > $out\n"
+    "build in: cat src\n"
+    "build out: cat in\n");
+  ManifestParserOptions parser_opts;
+  parser_opts.dupe_edge_action_ = kDupeEdgeActionError;
+  ManifestParser parser(&state, &fs_, parser_opts);
+  string err;
+  EXPECT_FALSE(parser.ParseTest("subninja a.ninja\n"
+                                "subninja b.ninja\n"
+                                "subninja c.ninja\n", &err));
+  EXPECT_EQ("b.ninja:5: multiple rules generate out [-w dupbuild=err]\n",
+            err);
+}
+
+TEST_F(ParserTest, ErrorAfterConsecutiveSubninjas) {
+  fs_.Create("a.ninja", "build out: phony\n");
+  ManifestParser parser(&state, &fs_);
+  string err;
+  EXPECT_FALSE(parser.ParseTest("subninja a.ninja\n"
+                                "subninja b.ninja\n"
+                                "  foo = bar\n", &err));
+  EXPECT_EQ("input:3: illegal key 'foo' (only 'chdir' is supported)\n"
+            "  foo = bar\n"
+            "           ^ near here", err);
+  EXPECT_TRUE(state.LookupNode("out"));
+}
+
 TEST_F(ParserTest, Include) {
   fs_.Create("include.ninja", "var = inner\n");
   ASSERT_NO_FATAL_FAILURE(AssertParse(
@@ -0,0 +1,145 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mapped_file.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+FileReader::Status MappedFile::Open(const string& path, string* err) {
+  return OpenFile(path, false, err);
+}
+
+FileReader::Status MappedFile::OpenTerminated(const string& path,
+                                              string* err) {
+  return OpenFile(path, true, err);
+}
+
+void MappedFile::Assign(const string& contents) {
+  Close();
+  data_ = static_cast<char*>(malloc(contents.size() + 1));
+  memcpy(data_, contents.data(), contents.size());
+  data_[contents.size()] = '\0';
+  size_ = contents.size();
+}
+
+#ifdef _WIN32
+FileReader::Status MappedFile::OpenFile(const string& path, bool terminated,
+                                        string* err) {
+  Close();
+  FILE* f = fopen(path.c_str(), "rb");
+  if (!f) {
+    *err = strerror(errno);
+    return errno == ENOENT ? FileReader::NotFound : FileReader::OtherError;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  // The file is read whole here, so it is always nul-terminated.
+  data_ = static_cast<char*>(malloc(size + 1));
+  if (!data_ || (size > 0 && fread(data_, size, 1, f) < 1)) {
+    *err = strerror(errno);
+    fclose(f);
+    Close();
+    return FileReader::OtherError;
+  }
+  data_[size] = '\0';
+  fclose(f);
+  size_ = size;
+  return FileReader::Okay;
+}
+
+void MappedFile::Close() {
+  free(data_);
+  data_ = NULL;
+  size_ = 0;
+}
+#else
+FileReader::Status MappedFile::OpenFile(const string& path, bool terminated,
+                                        string* err) {
+  Close();
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    *err = strerror(errno);
+    return errno == ENOENT ? FileReader::NotFound : FileReader::OtherError;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    *err = strerror(errno);
+    close(fd);
+    return FileReader::OtherError;
+  }
+  size_t size = st.st_size;
+  // A mapping reads as zeros from the end of the file to the end of its
+  // last page, which provides the nul byte unless there is no room left.
+  // mmap() refuses empty mappings; an empty file needs no data anyway.
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  if (size > 0 && (!terminated || size % page_size != 0)) {
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      *err = strerror(errno);
+      close(fd);
+      return FileReader::OtherError;
+    }
+    data_ = static_cast<char*>(data);
+    mapped_ = true;
+#ifdef MADV_SEQUENTIAL
+    // Terminated files are for the lexer, which reads them front to back.
+    if (terminated)
+      madvise(data, size, MADV_SEQUENTIAL);
+#endif
+  } else if (terminated) {
+    data_ = static_cast<char*>(malloc(size + 1));
+    size_t done = 0;
+    while (done < size) {
+      ssize_t n = read(fd, data_ + done, size - done);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0) {
+        *err = strerror(errno);
+        close(fd);
+        Close();
+        return FileReader::OtherError;
+      }
+      if (n == 0)
+        break;
+      done += n;
+    }
+    data_[done] = '\0';
+    size = done;
+  }
+  // The mapping stays valid after the file is closed.
+  close(fd);
+  size_ = size;
+  return FileReader::Okay;
+}
+
+void MappedFile::Close() {
+  if (mapped_)
+    munmap(data_, size_);
+  else
+    free(data_);
+  data_ = NULL;
+  size_ = 0;
+  mapped_ = false;
+}
+#endif  // _WIN32
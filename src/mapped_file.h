@@ -0,0 +1,64 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_MAPPED_FILE_H_
+#define NINJA_MAPPED_FILE_H_
+
+#include <stddef.h>
+
+#include <string>
+using namespace std;
+
+#include "disk_interface.h"
+
+/// The contents of a file, readable in place.  On POSIX systems the file
+/// is mapped into memory, so only the pages that are touched get read.
+/// Windows doesn't let a mapped file be truncated, renamed or deleted,
+/// which the logs need to do while their contents are in use, so there
+/// the file is read into memory instead.
+///
+/// Data appended to the file after Open() is not visible.
+struct MappedFile {
+  MappedFile() : data_(NULL), size_(0), mapped_(false) {}
+  ~MappedFile() { Close(); }
+
+  /// Open |path|.  On error, return NotFound or OtherError and fill |err|
+  /// with the system's description of the error.
+  FileReader::Status Open(const string& path, string* err);
+  /// Open |path| like Open(), but with a nul byte after the data, as the
+  /// Lexer needs.  The mapping provides one for free, unless the file ends
+  /// right at the end of a page, in which case the file is read instead.
+  FileReader::Status OpenTerminated(const string& path, string* err);
+  /// Hold a copy of |contents|, followed by a nul byte.
+  void Assign(const string& contents);
+  void Close();
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  FileReader::Status OpenFile(const string& path, bool terminated,
+                              string* err);
+
+  char* data_;
+  size_t size_;
+  /// Whether data_ is a mapping rather than a heap buffer.
+  bool mapped_;
+
+  // Not copyable.
+  MappedFile(const MappedFile&);
+  void operator=(const MappedFile&);
+};
+
+#endif  // NINJA_MAPPED_FILE_H_
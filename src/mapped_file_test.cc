@@ -0,0 +1,90 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mapped_file.h"
+
+#include "test.h"
+
+namespace {
+
+struct MappedFileTest : public testing::Test {
+  virtual void SetUp() {
+    temp_dir_.CreateAndEnter("NinjaMappedFileTest");
+  }
+  virtual void TearDown() {
+    temp_dir_.Cleanup();
+  }
+
+  ScopedTempDir temp_dir_;
+  RealDiskInterface disk_;
+};
+
+TEST_F(MappedFileTest, Basic) {
+  ASSERT_TRUE(disk_.WriteFile("file", "contents"));
+  MappedFile file;
+  string err;
+  ASSERT_EQ(FileReader::Okay, file.Open("file", &err));
+  EXPECT_EQ("contents", string(file.data(), file.size()));
+
+  // The contents outlive the file's name.
+  ASSERT_EQ(0, disk_.RemoveFile("file"));
+  EXPECT_EQ("contents", string(file.data(), file.size()));
+  file.Close();
+  EXPECT_EQ(0u, file.size());
+}
+
+TEST_F(MappedFileTest, Empty) {
+  ASSERT_TRUE(disk_.WriteFile("empty", ""));
+  MappedFile file;
+  string err;
+  ASSERT_EQ(FileReader::Okay, file.Open("empty", &err));
+  EXPECT_EQ(0u, file.size());
+}
+
+TEST_F(MappedFileTest, Missing) {
+  MappedFile file;
+  string err;
+  EXPECT_EQ(FileReader::NotFound, file.Open("missing", &err));
+  EXPECT_NE("", err);
+}
+
+TEST_F(MappedFileTest, Terminated) {
+  // One file the mapping leaves room for a nul byte after, and ones that
+  // fill their last page, or have no page at all, which are read instead.
+  const size_t kSizes[] = { 100, 4096, 65536, 0 };
+  for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+    string contents(kSizes[i], 'x');
+    ASSERT_TRUE(disk_.WriteFile("file", contents));
+    MappedFile file;
+    string err;
+    ASSERT_EQ(FileReader::Okay, disk_.ReadFileTerminated("file", &file, &err));
+    ASSERT_EQ(contents, string(file.data(), file.size()));
+    EXPECT_EQ('\0', file.data()[file.size()]);
+  }
+
+  MappedFile file;
+  string err;
+  EXPECT_EQ(FileReader::NotFound,
+            disk_.ReadFileTerminated("missing", &file, &err));
+  EXPECT_NE("", err);
+}
+
+TEST_F(MappedFileTest, Assign) {
+  MappedFile file;
+  file.Assign("contents");
+  EXPECT_EQ("contents", string(file.data(), file.size()));
+  EXPECT_EQ('\0', file.data()[file.size()]);
+}
+
+}  // anonymous namespace
@@ -15,6 +15,7 @@
 #include "metrics.h"
 
 #include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -72,6 +73,36 @@ int64_t TimerToMicros(int64_t dt) {
 }
 #endif
 
+/// The name of |metric| in the report, which says when it isn't a time.
+string DisplayName(const Metric& metric) {
+  if (metric.unit == Metric::kBytes)
+    return metric.name + " (bytes)";
+  return metric.name;
+}
+
+/// Turn a metric name like ".ninja parse" or "StartEdge" into a Prometheus
+/// one like "ninja_ninja_parse" or "ninja_start_edge".
+string PrometheusName(const string& name) {
+  string out = "ninja_";
+  char last = 0;
+  for (size_t i = 0; i < name.size(); ++i) {
+    char c = name[i];
+    if (c >= 'A' && c <= 'Z') {
+      if (last >= 'a' && last <= 'z')
+        out += '_';
+      out += (char)(c - 'A' + 'a');
+    } else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+      out += c;
+    } else if (*out.rbegin() != '_') {
+      out += '_';
+    }
+    last = c;
+  }
+  if (*out.rbegin() == '_')
+    out.resize(out.size() - 1);
+  return out;
+}
+
 }  // anonymous namespace
 
 
@@ -84,16 +115,33 @@ ScopedMetric::ScopedMetric(Metric* metric) {
 ScopedMetric::~ScopedMetric() {
   if (!metric_)
     return;
-  metric_->count++;
-  int64_t dt = TimerToMicros(HighResTimer() - start_);
-  metric_->sum += dt;
+  metric_->Add(TimerToMicros(HighResTimer() - start_));
 }
 
-Metric* Metrics::NewMetric(const string& name) {
+void Metric::Add(int64_t value) {
+  int bucket = 0;
+  while (bucket < kBuckets - 1 && ((int64_t)1 << bucket) < value)
+    ++bucket;
+  count++;
+  sum += value;
+  buckets[bucket]++;
+}
+
+Metric* Metrics::NewMetric(const string& name, Metric::Unit unit) {
+  ScopedLock lock(&lock_);
+  // Call sites that share a name share the metric.
+  for (vector<Metric*>::iterator i = metrics_.begin(); i != metrics_.end();
+       ++i) {
+    if ((*i)->name == name && (*i)->unit == unit)
+      return *i;
+  }
   Metric* metric = new Metric;
   metric->name = name;
+  metric->unit = unit;
   metric->count = 0;
   metric->sum = 0;
+  for (int b = 0; b < Metric::kBuckets; ++b)
+    metric->buckets[b] = 0;
   metrics_.push_back(metric);
   return metric;
 }
@@ -102,7 +150,7 @@ void Metrics::Report() {
   int width = 0;
   for (vector<Metric*>::iterator i = metrics_.begin();
        i != metrics_.end(); ++i) {
-    width = max((int)(*i)->name.size(), width);
+    width = max((int)DisplayName(**i).size(), width);
   }
 
   printf("%-*s\t%-6s\t%-9s\t%s\n", width,
@@ -110,11 +158,56 @@ void Metrics::Report() {
   for (vector<Metric*>::iterator i = metrics_.begin();
        i != metrics_.end(); ++i) {
     Metric* metric = *i;
-    double total = metric->sum / (double)1000;
-    double avg = metric->sum / (double)metric->count;
-    printf("%-*s\t%-6d\t%-8.1f\t%.1f\n", width, metric->name.c_str(),
-           metric->count, avg, total);
+    int count = metric->count;
+    int64_t sum = metric->sum;
+    double total = sum / (double)1000;
+    double avg = sum / (double)count;
+    printf("%-*s\t%-6d\t%-8.1f\t%.1f\n", width,
+           DisplayName(*metric).c_str(), count, avg, total);
+  }
+}
+
+bool Metrics::WritePrometheus(const string& path, string* err) {
+  string out;
+  char buf[128];
+  ScopedLock lock(&lock_);
+  for (vector<Metric*>::iterator i = metrics_.begin();
+       i != metrics_.end(); ++i) {
+    Metric* metric = *i;
+    bool seconds = metric->unit == Metric::kMicros;
+    double scale = seconds ? 1e-6 : 1;
+    string name = PrometheusName(metric->name) +
+        (seconds ? "_seconds" : "_bytes");
+    out += "# HELP " + name + " " + metric->name + "\n";
+    out += "# TYPE " + name + " histogram\n";
+    // Prometheus buckets count every value up to their bound.
+    int64_t cumulative = 0;
+    for (int b = 0; b < Metric::kBuckets - 1; ++b) {
+      cumulative += metric->buckets[b];
+      snprintf(buf, sizeof(buf), "_bucket{le=\"%g\"} %" PRId64 "\n",
+               ((int64_t)1 << b) * scale, cumulative);
+      out += name + buf;
+    }
+    int count = metric->count;
+    snprintf(buf, sizeof(buf), "_bucket{le=\"+Inf\"} %d\n", count);
+    out += name + buf;
+    snprintf(buf, sizeof(buf), "_sum %.9g\n", metric->sum * scale);
+    out += name + buf;
+    snprintf(buf, sizeof(buf), "_count %d\n", count);
+    out += name + buf;
+  }
+
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) {
+    *err = strerror(errno);
+    return false;
+  }
+  bool written = fwrite(out.data(), 1, out.size(), f) == out.size();
+  if (fclose(f) < 0 || !written) {
+    *err = strerror(errno);
+    return false;
   }
+  return true;
 }
 
 uint64_t Stopwatch::Now() const {
@@ -125,3 +218,7 @@ int64_t GetTimeMillis() {
   return TimerToMicros(HighResTimer()) / 1000;
 }
 
+int64_t GetTimeMicros() {
+  return TimerToMicros(HighResTimer());
+}
+
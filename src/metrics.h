@@ -19,18 +19,45 @@
 #include <vector>
 using namespace std;
 
+#include "parallel.h"
 #include "util.h"  // For int64_t.
 
+#ifdef NINJA_HAVE_THREADS
+#include <atomic>
+#endif
+
 /// The Metrics module is used for the debug mode that dumps timing stats of
 /// various actions.  To use, see METRIC_RECORD below.
 
 /// A single metrics we're tracking, like "depfile load time".
+/// The counters may be updated from several threads at once.
 struct Metric {
+  /// What the values of a metric measure.
+  enum Unit {
+    kMicros,
+    kBytes
+  };
+
+  /// Values are counted in power-of-two buckets: buckets[i] counts those
+  /// up to 2^i, and the last one those above too.
+  static const int kBuckets = 32;
+
+  /// Count |value| in the metric.
+  void Add(int64_t value);
+
   string name;
+  Unit unit;
+#ifdef NINJA_HAVE_THREADS
   /// Number of times we've hit the code path.
+  std::atomic<int> count;
+  /// Total time (in micros), or other value, we've spent on the code path.
+  std::atomic<int64_t> sum;
+  std::atomic<int> buckets[kBuckets];
+#else
   int count;
-  /// Total time (in micros) we've spent on the code path.
   int64_t sum;
+  int buckets[kBuckets];
+#endif
 };
 
 
@@ -49,12 +76,18 @@ private:
 
 /// The singleton that stores metrics and prints the report.
 struct Metrics {
-  Metric* NewMetric(const string& name);
+  /// Returns the metric called |name|, creating it if needed.
+  Metric* NewMetric(const string& name, Metric::Unit unit = Metric::kMicros);
 
   /// Print a summary report to stdout.
   void Report();
 
+  /// Write every metric as a histogram in the Prometheus text format, with
+  /// times in seconds, to |path|.
+  bool WritePrometheus(const string& path, string* err);
+
 private:
+  Mutex lock_;
   vector<Metric*> metrics_;
 };
 
@@ -62,6 +95,9 @@ private:
 /// Epoch varies between platforms; only useful for measuring elapsed time.
 int64_t GetTimeMillis();
 
+/// The same in microseconds.
+int64_t GetTimeMicros();
+
 /// A simple stopwatch which returns the time
 /// in seconds since Restart() was called.
 struct Stopwatch {
@@ -87,6 +123,16 @@ struct Stopwatch {
       g_metrics ? g_metrics->NewMetric(name) : NULL;                    \
   ScopedMetric metrics_h_scoped(metrics_h_metric);
 
+/// Count |value|, measured in |unit| (a Metric::Unit), in the metric called
+/// |name|.
+#define METRIC_RECORD_VALUE(name, unit, value)                          \
+  do {                                                                  \
+    static Metric* metrics_h_value_metric =                             \
+        g_metrics ? g_metrics->NewMetric(name, Metric::unit) : NULL;    \
+    if (metrics_h_value_metric)                                         \
+      metrics_h_value_metric->Add(value);                               \
+  } while (0)
+
 extern Metrics* g_metrics;
 
 #endif // NINJA_METRICS_H_
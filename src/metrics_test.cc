@@ -0,0 +1,90 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "metrics.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "test.h"
+
+namespace {
+
+const char kTestFilename[] = "MetricsTest-tempfile";
+
+struct MetricsTest : public testing::Test {
+  virtual void TearDown() {
+    unlink(kTestFilename);
+  }
+
+  Metrics metrics_;
+};
+
+TEST_F(MetricsTest, Buckets) {
+  Metric* metric = metrics_.NewMetric("output", Metric::kBytes);
+  metric->Add(0);
+  metric->Add(1);
+  metric->Add(2);
+  metric->Add(3);
+  metric->Add(1000);
+  metric->Add((int64_t)1 << 40);
+  EXPECT_EQ(6, (int)metric->count);
+  EXPECT_EQ(1006 + ((int64_t)1 << 40), (int64_t)metric->sum);
+  EXPECT_EQ(2, (int)metric->buckets[0]);
+  EXPECT_EQ(1, (int)metric->buckets[1]);
+  EXPECT_EQ(1, (int)metric->buckets[2]);
+  EXPECT_EQ(0, (int)metric->buckets[3]);
+  EXPECT_EQ(1, (int)metric->buckets[10]);
+  EXPECT_EQ(1, (int)metric->buckets[Metric::kBuckets - 1]);
+
+  // Another call site with the same name adds to the same metric.
+  EXPECT_EQ(metric, metrics_.NewMetric("output", Metric::kBytes));
+  EXPECT_NE(metric, metrics_.NewMetric("output"));
+}
+
+TEST_F(MetricsTest, WritePrometheus) {
+  Metric* time = metrics_.NewMetric(".ninja parse");
+  time->Add(3);
+  time->Add(1500000);
+  metrics_.NewMetric("CLParser::Parse");
+  metrics_.NewMetric("command output", Metric::kBytes)->Add(100);
+
+  string err, contents;
+  EXPECT_TRUE(metrics_.WritePrometheus(kTestFilename, &err));
+  EXPECT_EQ("", err);
+  EXPECT_EQ(0, ReadFile(kTestFilename, &contents, &err));
+
+  EXPECT_NE(string::npos, contents.find(
+      "# HELP ninja_ninja_parse_seconds .ninja parse\n"
+      "# TYPE ninja_ninja_parse_seconds histogram\n"
+      "ninja_ninja_parse_seconds_bucket{le=\"1e-06\"} 0\n"
+      "ninja_ninja_parse_seconds_bucket{le=\"2e-06\"} 0\n"
+      "ninja_ninja_parse_seconds_bucket{le=\"4e-06\"} 1\n"));
+  EXPECT_NE(string::npos, contents.find(
+      "ninja_ninja_parse_seconds_bucket{le=\"1.04858\"} 1\n"
+      "ninja_ninja_parse_seconds_bucket{le=\"2.09715\"} 2\n"));
+  EXPECT_NE(string::npos, contents.find(
+      "ninja_ninja_parse_seconds_bucket{le=\"+Inf\"} 2\n"
+      "ninja_ninja_parse_seconds_sum 1.500003\n"
+      "ninja_ninja_parse_seconds_count 2\n"));
+  EXPECT_NE(string::npos, contents.find(
+      "ninja_clparser_parse_seconds_count 0\n"));
+  EXPECT_NE(string::npos, contents.find(
+      "ninja_command_output_bytes_bucket{le=\"128\"} 1\n"));
+  EXPECT_NE(string::npos, contents.find(
+      "ninja_command_output_bytes_sum 100\n"));
+}
+
+}  // anonymous namespace
@@ -0,0 +1,89 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "missing_deps.h"
+
+#include "deps_log.h"
+#include "graph.h"
+#include "state.h"
+
+bool MissingDependencyScanner::ProcessNode(Node* node) {
+  size_t missing = missing_.size();
+  // Edges are visited with an explicit stack, as chains of them can be
+  // deeper than the call stack.
+  vector<Node*> stack(1, node);
+  while (!stack.empty()) {
+    Node* n = stack.back();
+    stack.pop_back();
+    Edge* edge = n->in_edge();
+    if (!edge || !seen_.insert(edge).second)
+      continue;
+    CheckEdge(edge);
+    stack.insert(stack.end(), edge->inputs_.begin(), edge->inputs_.end());
+  }
+  return missing_.size() == missing;
+}
+
+void MissingDependencyScanner::CheckEdge(Edge* edge) {
+  if (edge->is_phony())
+    return;
+  ++edges_checked_;
+  set<Node*> checked;
+  for (vector<Node*>::iterator o = edge->outputs_.begin();
+       o != edge->outputs_.end(); ++o) {
+    DepsLog::Deps* deps = deps_log_->GetDeps(*o);
+    if (!deps)
+      continue;
+    for (int i = 0; i < deps->node_count; ++i) {
+      Node* input = deps->nodes[i];
+      Edge* generator = input->in_edge();
+      if (!generator || generator->is_phony() || generator == edge ||
+          !checked.insert(input).second)
+        continue;
+      if (DependsOn(edge, generator))
+        continue;
+      MissingDep dep = { edge, input };
+      missing_.push_back(dep);
+      missing_inputs_.insert(input);
+      generator_rules_.insert(generator->rule().name());
+    }
+  }
+}
+
+bool MissingDependencyScanner::DependsOn(Edge* to, Edge* from) {
+  map<Edge*, vector<bool> >::iterator i = downstream_.find(from);
+  if (i == downstream_.end()) {
+    i = downstream_.insert(make_pair(from, vector<bool>())).first;
+    vector<bool>& downstream = i->second;
+    downstream.resize(state_->edges_.size());
+    vector<Edge*> stack(1, from);
+    while (!stack.empty()) {
+      Edge* edge = stack.back();
+      stack.pop_back();
+      for (vector<Node*>::iterator o = edge->outputs_.begin();
+           o != edge->outputs_.end(); ++o) {
+        const vector<Edge*>& users = (*o)->out_edges();
+        for (vector<Edge*>::const_iterator u = users.begin();
+             u != users.end(); ++u) {
+          if (downstream[(*u)->id_])
+            continue;
+          downstream[(*u)->id_] = true;
+          stack.push_back(*u);
+        }
+      }
+    }
+  }
+  return to->id_ >= 0 && (size_t)to->id_ < i->second.size() &&
+      i->second[to->id_];
+}
@@ -0,0 +1,79 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_MISSING_DEPS_H_
+#define NINJA_MISSING_DEPS_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+using namespace std;
+
+struct DepsLog;
+struct Edge;
+struct Node;
+struct State;
+
+/// Finds the inputs that edges read, by their deps logs, from files that
+/// other edges make, without anything in the manifest having the one wait
+/// for the other: a clean build may read them before they are written, or
+/// build the edge without them when asked for it alone.
+///
+/// Whether an edge depends on another is looked up, for each edge that
+/// makes such a file, in the set of every edge downstream of it, found
+/// once and kept as a bitset by edge id.  Few edges make the files that
+/// others find in depfiles, so that stays small however many edges use
+/// them.
+struct MissingDependencyScanner {
+  MissingDependencyScanner(DepsLog* deps_log, State* state)
+      : deps_log_(deps_log), state_(state), edges_checked_(0) {}
+
+  /// Check the edges that |node| needs.  Returns false if any of them
+  /// misses a dependency.
+  bool ProcessNode(Node* node);
+
+  /// A deps log input, and the edge making it, that |edge| has no
+  /// dependency on in the manifest.
+  struct MissingDep {
+    Edge* edge;
+    Node* input;
+  };
+  const vector<MissingDep>& missing() const { return missing_; }
+
+  int edges_checked() const { return edges_checked_; }
+  /// The generated inputs, and the rules generating them, that are missing
+  /// a dependency somewhere.
+  const set<Node*>& missing_inputs() const { return missing_inputs_; }
+  const set<string>& generator_rules() const { return generator_rules_; }
+
+  /// Whether |to| depends on |from|, or more precisely on one of its
+  /// outputs, by the manifest.
+  bool DependsOn(Edge* to, Edge* from);
+
+ private:
+  void CheckEdge(Edge* edge);
+
+  DepsLog* deps_log_;
+  State* state_;
+  set<Edge*> seen_;
+  int edges_checked_;
+  vector<MissingDep> missing_;
+  set<Node*> missing_inputs_;
+  set<string> generator_rules_;
+  /// For each edge that made a deps log input, the edges downstream of it.
+  map<Edge*, vector<bool> > downstream_;
+};
+
+#endif  // NINJA_MISSING_DEPS_H_
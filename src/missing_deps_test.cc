@@ -0,0 +1,93 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "missing_deps.h"
+
+#include "deps_log.h"
+#include "graph.h"
+#include "state.h"
+#include "test.h"
+
+namespace {
+
+struct MissingDependencyScannerTest : public StateTestWithBuiltinRules {
+  virtual void SetUp() {
+    temp_dir_.CreateAndEnter("MissingDependencyScannerTest");
+    string err;
+    ASSERT_TRUE(deps_log_.OpenForWrite("ninja_deps", &err));
+    ASSERT_EQ("", err);
+  }
+  virtual void TearDown() {
+    deps_log_.Close();
+    temp_dir_.Cleanup();
+  }
+
+  /// Record in the deps log that |out| read |input|.
+  void RecordDep(const string& out, const string& input) {
+    vector<Node*> nodes(1, GetNode(input));
+    ASSERT_TRUE(deps_log_.RecordDeps(GetNode(out), 1, nodes));
+  }
+
+  ScopedTempDir temp_dir_;
+  DepsLog deps_log_;
+};
+
+TEST_F(MissingDependencyScannerTest, Missing) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"rule gen\n"
+"  command = gen $out\n"
+"build gen.h: gen\n"
+"build a.o: cat a.c\n"
+"build b.o: cat b.c || gen.h\n"
+"build all: phony a.o b.o\n"));
+  RecordDep("a.o", "gen.h");
+  RecordDep("b.o", "gen.h");
+  RecordDep("b.o", "source.h");
+
+  MissingDependencyScanner scanner(&deps_log_, &state_);
+  EXPECT_FALSE(scanner.ProcessNode(GetNode("all")));
+  EXPECT_EQ(3, scanner.edges_checked());
+  ASSERT_EQ(1u, scanner.missing().size());
+  EXPECT_EQ(GetNode("a.o")->in_edge(), scanner.missing()[0].edge);
+  EXPECT_EQ(GetNode("gen.h"), scanner.missing()[0].input);
+  EXPECT_EQ(1u, scanner.generator_rules().size());
+
+  // Checked edges aren't checked again.
+  EXPECT_TRUE(scanner.ProcessNode(GetNode("a.o")));
+  EXPECT_EQ(1u, scanner.missing().size());
+}
+
+TEST_F(MissingDependencyScannerTest, Transitive) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"rule gen\n"
+"  command = gen $out\n"
+"build gen.h: gen\n"
+"build stamp: phony gen.h\n"
+"build lib.a: cat stamp\n"
+"build a.o: cat a.c | lib.a\n"
+"build b.o: cat b.c\n"));
+  RecordDep("a.o", "gen.h");
+
+  // Through a phony edge and another one, a.o waits for gen.h.
+  MissingDependencyScanner scanner(&deps_log_, &state_);
+  EXPECT_TRUE(scanner.ProcessNode(GetNode("a.o")));
+  EXPECT_TRUE(scanner.DependsOn(GetNode("a.o")->in_edge(),
+                                GetNode("gen.h")->in_edge()));
+  EXPECT_FALSE(scanner.DependsOn(GetNode("b.o")->in_edge(),
+                                 GetNode("gen.h")->in_edge()));
+  EXPECT_FALSE(scanner.DependsOn(GetNode("gen.h")->in_edge(),
+                                 GetNode("a.o")->in_edge()));
+}
+
+}  // anonymous namespace
@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <set>
 #include <errno.h>
 #include <limits.h>
 #include <stdio.h>
@@ -30,20 +32,40 @@
 #include <unistd.h>
 #endif
 
+#include "action_cache.h"
+#include "affected.h"
 #include "browse.h"
 #include "build.h"
+#include "build_dir_lock.h"
 #include "build_log.h"
 #include "deps_log.h"
+#include "deps_printer.h"
+#include "digest_log.h"
 #include "clean.h"
+#include "daemon.h"
 #include "debug_flags.h"
 #include "disk_interface.h"
 #include "graph.h"
+#include "graph_json.h"
 #include "graphviz.h"
+#include "jobserver.h"
+#include "manifest_cache.h"
 #include "manifest_parser.h"
+#include "mapped_file.h"
 #include "metrics.h"
+#include "missing_deps.h"
+#include "parallel.h"
+#include "remote_launcher.h"
+#include "resume_log.h"
+#include "shard.h"
+#include "simulate.h"
 #include "state.h"
+#include "status_events.h"
+#include "subprocess.h"
+#include "trace.h"
 #include "util.h"
 #include "version.h"
+#include "watch.h"
 
 #ifdef _MSC_VER
 // Defined in msvc_helper_main-win32.cc.
@@ -57,6 +79,9 @@ namespace {
 
 struct Tool;
 
+/// Where -d manifestcache keeps the parsed manifest.
+const char kManifestCachePath[] = ".ninja_manifest_cache";
+
 /// Command-line options.
 struct Options {
   /// Build file to load.
@@ -77,13 +102,71 @@ struct Options {
   /// Whether a depfile with multiple targets on separate lines should
   /// warn or print an error.
   bool depfile_distinct_target_lines_should_err;
+
+  /// Whether -j was passed, overriding any jobserver inherited from make.
+  bool parallelism_set;
+
+  /// Whether to act as a jobserver for the commands we run.
+  bool serve_jobs;
+
+  /// The directory of the action cache, if any.
+  const char* action_cache_dir;
+
+  /// The command to run commands remotely through, if any.
+  const char* remote_launcher;
+
+  /// Whether to spawn commands through a helper process.
+  bool spawner;
+
+  /// Whether to rebuild whenever a source file changes.
+  bool watch;
+
+  /// The file descriptor to write status events to, if status_events.
+  bool status_events;
+  int status_fd;
+};
+
+/// The command line Ninja was started with and, if -C was passed, the
+/// directory it was started in, so that "-t daemon" and "--watch" can
+/// restart themselves.
+vector<string> g_start_argv;
+string g_start_dir;
+
+/// Where "-d trace=FILE" writes the trace.
+string g_trace_path;
+
+/// Where "-d stats=FILE" writes the metrics, if not to stdout.
+string g_metrics_path;
+
+/// Reads the logs, where they are when the manifest sets no builddir, while
+/// the manifest is parsed: the deps log is indexed, and the build log, which
+/// is only looked into as it's used, is brought into memory.
+struct LogPrefetch : public BackgroundTask {
+  explicit LogPrefetch(DepsLog* deps_log) : deps_log_(deps_log) {}
+
+  virtual void Run() {
+    MappedFile build_log;
+    string err;
+    if (build_log.Open(".ninja_log", &err) == FileReader::Okay) {
+      const size_t kPageSize = 4096;
+      volatile char touched = 0;
+      for (size_t i = 0; i < build_log.size(); i += kPageSize)
+        touched = touched + build_log.data()[i];
+    }
+    deps_log_->Prefetch(".ninja_deps");
+  }
+
+ private:
+  DepsLog* deps_log_;
 };
 
 /// The Ninja main() loads up a series of data structures; various tools need
 /// to poke into these, so store them as fields on an object.
 struct NinjaMain : public BuildLogUser {
   NinjaMain(const char* ninja_command, const BuildConfig& config) :
-      ninja_command_(ninja_command), config_(config) {}
+      ninja_command_(ninja_command), config_(config),
+      manifest_files_(&disk_interface_), keep_stat_cache_(false),
+      log_prefetch_(&deps_log_) {}
 
   /// Command line used to run Ninja.
   const char* ninja_command_;
@@ -97,11 +180,33 @@ struct NinjaMain : public BuildLogUser {
   /// Functions for accesssing the disk.
   RealDiskInterface disk_interface_;
 
+  /// Reads the manifest for "-t daemon" and "--watch", remembering which
+  /// files it read.
+  ManifestFileRecorder manifest_files_;
+
   /// The build directory, used for storing the build log etc.
   string build_dir_;
 
+  /// Whether the stat cache of disk_interface_ lasts from one build to the
+  /// next, for "-t daemon", which keeps it up to date.
+  bool keep_stat_cache_;
+
   BuildLog build_log_;
   DepsLog deps_log_;
+  DigestLog digest_log_;
+
+  /// Start reading the logs on another thread, to be done with by the time
+  /// they're opened.
+  void PrefetchLogs() { log_prefetch_thread_.Start(&log_prefetch_); }
+  LogPrefetch log_prefetch_;
+  BackgroundThread log_prefetch_thread_;
+
+  /// What lets other ninja processes build in the build directory at the
+  /// same time.
+  BuildDirLock build_dir_lock_;
+
+  /// Where the time of the last build went, for -d stats.
+  BuildLoopProfile loop_profile_;
 
   /// The type of functions that are the entry points to tools (subcommands).
   typedef int (NinjaMain::*ToolFunc)(const Options*, int, char**);
@@ -114,32 +219,71 @@ struct NinjaMain : public BuildLogUser {
   bool CollectTargetsFromArgs(int argc, char* argv[],
                               vector<Node*>* targets, string* err);
 
+  /// Print what -t query knows of the target |path|, loading its dyndep
+  /// file if need be.  Returns false if there is no such target.
+  bool QueryTarget(const char* path, bool json, DyndepLoader* dyndep_loader);
+
   // The various subcommands, run via "-t XXX".
   int ToolGraph(const Options* options, int argc, char* argv[]);
   int ToolQuery(const Options* options, int argc, char* argv[]);
   int ToolDeps(const Options* options, int argc, char* argv[]);
+  int ToolMissingDeps(const Options* options, int argc, char* argv[]);
+  int ToolAffected(const Options* options, int argc, char* argv[]);
+  int ToolShard(const Options* options, int argc, char* argv[]);
+  int ToolSimulate(const Options* options, int argc, char* argv[]);
+  int ToolImportLog(const Options* options, int argc, char* argv[]);
   int ToolBrowse(const Options* options, int argc, char* argv[]);
   int ToolMSVC(const Options* options, int argc, char* argv[]);
   int ToolTargets(const Options* options, int argc, char* argv[]);
   int ToolCommands(const Options* options, int argc, char* argv[]);
   int ToolClean(const Options* options, int argc, char* argv[]);
+  int ToolCleanDead(const Options* options, int argc, char* argv[]);
   int ToolCompilationDatabase(const Options* options, int argc, char* argv[]);
   int ToolRecompact(const Options* options, int argc, char* argv[]);
+  int ToolResources(const Options* options, int argc, char* argv[]);
   int ToolUrtle(const Options* options, int argc, char** argv);
   int ToolRules(const Options* options, int argc, char* argv[]);
+#ifndef _WIN32
+  int ToolDaemon(const Options* options, int argc, char* argv[]);
+  int ToolClient(const Options* options, int argc, char* argv[]);
+#endif
+
+  /// Write what |plan| left to run to the resume log at |path|, after
+  /// |log| as loaded from it.
+  bool WriteResumeLog(const ResumeLog& log, const string& path,
+                      const Plan& plan);
 
-  /// Open the build log.
+  /// Write out the promised |targets| of a build with lazy outputs.
+  bool MaterializeTargets(LazyDiskInterface* lazy,
+                          const vector<Node*>& targets);
+
+  /// Open the build log.  With |recompact_only|, load it and start
+  /// rewriting it instead, for FinishRecompaction() to wait for.
   /// @return false on error.
   bool OpenBuildLog(bool recompact_only = false);
 
-  /// Open the deps log: load it, then open for writing.
+  /// Open the deps log: load it, then open for writing.  With
+  /// |recompact_only|, start rewriting it instead, as for the build log.
   /// @return false on error.
   bool OpenDepsLog(bool recompact_only = false);
 
+  /// Open the digest log: load it, then open for writing.
+  /// @return false on error.
+  bool OpenDigestLog(bool recompact_only = false);
+
   /// Ensure the build directory exists, creating it if necessary.
   /// @return false on error.
   bool EnsureBuildDirExists();
 
+  /// Open the lock of the build directory, unless this is a dry run.
+  /// @return false on error.
+  bool LockBuildDir();
+
+  /// Merge in the side logs that ninja processes which didn't own the logs
+  /// left behind, if this process owns them.
+  /// @return false on error.
+  bool MergeSideLogs();
+
   /// Rebuild the manifest, if necessary.
   /// Fills in \a err on error.
   /// @return true if the manifest was rebuilt.
@@ -149,12 +293,25 @@ struct NinjaMain : public BuildLogUser {
   /// @return an exit code.
   int RunBuild(int argc, char** argv);
 
-  /// Dump the output requested by '-d stats'.
+#ifndef _WIN32
+  /// Build the targets listed on the command line, then again whenever
+  /// the files they are built from change.  Only returns on errors.
+  int RunWatch(const Options* options, int argc, char** argv);
+#endif
+
+  /// Close the logs, letting a recompaction still running finish.
+  void CloseLogs();
+
+  /// Dump the output requested by '-d stats' or write the file requested by
+  /// '-d stats=FILE'.
   void DumpMetrics();
 
+  /// Write the trace requested by '-d trace'.
+  void WriteTrace();
+
   virtual bool IsPathDead(StringPiece s) const {
     Node* n = state_.LookupNode(s);
-    if (!n || !n->in_edge())
+    if (n && n->in_edge())
       return false;
     // Just checking n isn't enough: If an old output is both in the build log
     // and in the deps log, it will have a Node object in state_.  (It will also
@@ -213,8 +370,29 @@ void Usage(const BuildConfig& config) {
 "  -f FILE  specify input build file [default=build.ninja]\n"
 "\n"
 "  -j N     run N jobs in parallel (0 means infinity) [default=%d on this system]\n"
+"  --jobserver  share the -j limit with nested builds through a GNU make\n"
+"           jobserver\n"
+"  --action-cache DIR  reuse the outputs of commands run before, kept in DIR\n"
+"  --lazy-outputs  copy outputs out of the action cache only once needed\n"
+"  --remote CMD  run the commands of pools not marked local_only through CMD\n"
+"           (see manual)\n"
+"  --spawner  spawn commands from a helper process forked at startup\n"
+"  --schedule POLICY  how to pick the next command: critical_path (default),\n"
+"           subprojects or pools (see manual)\n"
+"  --critical-reserve N  keep N of the -j slots for the commands on the\n"
+"           critical path\n"
+"  --affinity POLICY  which processors commands run on: none (default),\n"
+"           numa or cores (see manual)\n"
+"  --speculate  start commands before their order-only inputs are ready when\n"
+"           the deps log says they don't read them (see manual)\n"
+"  --watch  build, then build again whenever a source file changes\n"
+"  --status-fd FD  write the progress of the build to file descriptor FD\n"
+"           as JSON lines (see manual)\n"
 "  -k N     keep going until N jobs fail (0 means infinity) [default=1]\n"
 "  -l N     do not start new jobs if the load average is greater than N\n"
+"  --cpu-pressure N  do not start new jobs while tasks wait for a CPU more\n"
+"           than N%% of the time (Linux)\n"
+"  -m N     do not start new jobs if less than N MiB of memory is available\n"
 "  -n       dry run (don't run commands but act like they succeeded)\n"
 "\n"
 "  -d MODE  enable debugging (use '-d list' to list modes)\n"
@@ -224,19 +402,6 @@ void Usage(const BuildConfig& config) {
           kNinjaVersion, config.parallelism);
 }
 
-/// Choose a default value for the -j (parallelism) flag.
-int GuessParallelism() {
-  switch (int processors = GetProcessorCount()) {
-  case 0:
-  case 1:
-    return 2;
-  case 2:
-    return 3;
-  default:
-    return processors + 2;
-  }
-}
-
 /// Rebuild the build manifest, if necessary.
 /// Returns true if the manifest was rebuilt.
 bool NinjaMain::RebuildManifest(const char* input_file, string* err) {
@@ -249,7 +414,12 @@ bool NinjaMain::RebuildManifest(const char* input_file, string* err) {
     return false;
 
   Builder builder(&state_, config_, &build_log_, &deps_log_, &disk_interface_);
-  if (!builder.AddTarget(node, err))
+  builder.SetDigestLog(&digest_log_);
+  bool added = builder.AddTarget(node, err);
+  // The default targets of the build that follows are the nodes without
+  // out-edges.
+  state_.LinkDeps();
+  if (!added)
     return false;
 
   if (builder.AlreadyUpToDate())
@@ -336,6 +506,44 @@ bool NinjaMain::CollectTargetsFromArgs(int argc, char* argv[],
 }
 
 int NinjaMain::ToolGraph(const Options* options, int argc, char* argv[]) {
+  // The graph tool uses getopt, and expects argv[0] to contain the name of
+  // the tool, i.e. "graph".
+  argc++;
+  argv--;
+
+  const option kLongOptions[] = {
+    { "format", required_argument, NULL, 'F' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  bool json = false;
+  optind = 1;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "h", kLongOptions, NULL)) != -1) {
+    switch (opt) {
+      case 'F':
+        if (strcmp(optarg, "json") == 0)
+          json = true;
+        else if (strcmp(optarg, "dot") != 0)
+          Fatal("unknown --format '%s'; expected 'dot' or 'json'", optarg);
+        break;
+      case 'h':
+      default:
+        printf(
+            "usage: ninja -t graph [options] [targets]\n"
+            "\n"
+            "options:\n"
+            "  --format=dot   print a graphviz dot file (default)\n"
+            "  --format=json  print a line of JSON per node, edge and deps log\n"
+            "                 record\n"
+            );
+        return 1;
+    }
+  }
+  argv += optind;
+  argc -= optind;
+
   vector<Node*> nodes;
   string err;
   if (!CollectTargetsFromArgs(argc, argv, &nodes, &err)) {
@@ -343,6 +551,14 @@ int NinjaMain::ToolGraph(const Options* options, int argc, char* argv[]) {
     return 1;
   }
 
+  if (json) {
+    GraphJSON graph(&state_, &disk_interface_, &deps_log_, stdout);
+    for (vector<Node*>::const_iterator n = nodes.begin(); n != nodes.end();
+         ++n)
+      graph.AddTarget(*n);
+    return 0;
+  }
+
   GraphViz graph(&state_, &disk_interface_);
   graph.Start();
   for (vector<Node*>::const_iterator n = nodes.begin(); n != nodes.end(); ++n)
@@ -352,29 +568,43 @@ int NinjaMain::ToolGraph(const Options* options, int argc, char* argv[]) {
   return 0;
 }
 
-int NinjaMain::ToolQuery(const Options* options, int argc, char* argv[]) {
-  if (argc == 0) {
-    Error("expected a target to query");
-    return 1;
+void EncodeJSONString(const string& str, string* out) {
+  size_t start = 0;
+  for (size_t i = 0; i < str.size(); ++i) {
+    if (str[i] == '"' || str[i] == '\\') {
+      out->append(str, start, i - start);
+      out->push_back('\\');
+      start = i;
+    }
   }
+  out->append(str, start, string::npos);
+}
 
-  DyndepLoader dyndep_loader(&state_, &disk_interface_);
+void AppendJSONPaths(vector<Node*>::const_iterator begin,
+                     vector<Node*>::const_iterator end, string* out) {
+  out->push_back('[');
+  for (vector<Node*>::const_iterator i = begin; i != end; ++i) {
+    if (i != begin)
+      out->push_back(',');
+    AppendJSONString((*i)->path(), out);
+  }
+  out->push_back(']');
+}
 
-  for (int i = 0; i < argc; ++i) {
-    string err;
-    Node* node = CollectTarget(argv[i], &err);
-    if (!node) {
-      Error("%s", err.c_str());
-      return 1;
-    }
+/// Print the inputs and outputs of |node| for -t query.  The JSON form is
+/// a single line per target, so that answers can be read as they come.
+void PrintQuery(const Node* node, bool json) {
+  Edge* edge = node->in_edge();
+  vector<Node*> outputs;
+  for (vector<Edge*>::const_iterator e = node->out_edges().begin();
+       e != node->out_edges().end(); ++e) {
+    outputs.insert(outputs.end(), (*e)->outputs_.begin(),
+                   (*e)->outputs_.end());
+  }
 
+  if (!json) {
     printf("%s:\n", node->path().c_str());
-    if (Edge* edge = node->in_edge()) {
-      if (edge->dyndep_ && edge->dyndep_->dyndep_pending()) {
-        if (!dyndep_loader.LoadDyndeps(edge->dyndep_, &err)) {
-          Warning("%s\n", err.c_str());
-        }
-      }
+    if (edge) {
       printf("  input: %s\n", edge->rule_->name().c_str());
       for (int in = 0; in < (int)edge->inputs_.size(); in++) {
         const char* label = "";
@@ -386,15 +616,134 @@ int NinjaMain::ToolQuery(const Options* options, int argc, char* argv[]) {
       }
     }
     printf("  outputs:\n");
-    for (vector<Edge*>::const_iterator edge = node->out_edges().begin();
-         edge != node->out_edges().end(); ++edge) {
-      for (vector<Node*>::iterator out = (*edge)->outputs_.begin();
-           out != (*edge)->outputs_.end(); ++out) {
-        printf("    %s\n", (*out)->path().c_str());
-      }
+    for (vector<Node*>::iterator out = outputs.begin(); out != outputs.end();
+         ++out) {
+      printf("    %s\n", (*out)->path().c_str());
     }
+    return;
   }
-  return 0;
+
+  string out = "{\"target\":";
+  AppendJSONString(node->path(), &out);
+  if (edge) {
+    vector<Node*>::const_iterator implicit = edge->inputs_.end() -
+        edge->implicit_deps_ - edge->order_only_deps_;
+    vector<Node*>::const_iterator order_only = edge->inputs_.end() -
+        edge->order_only_deps_;
+    out += ",\"input\":{\"rule\":";
+    AppendJSONString(edge->rule_->name(), &out);
+    out += ",\"explicit\":";
+    AppendJSONPaths(edge->inputs_.begin(), implicit, &out);
+    out += ",\"implicit\":";
+    AppendJSONPaths(implicit, order_only, &out);
+    out += ",\"order_only\":";
+    AppendJSONPaths(order_only, edge->inputs_.end(), &out);
+    out += "}";
+  }
+  out += ",\"outputs\":";
+  AppendJSONPaths(outputs.begin(), outputs.end(), &out);
+  out += "}\n";
+  fputs(out.c_str(), stdout);
+}
+
+bool NinjaMain::QueryTarget(const char* path, bool json,
+                            DyndepLoader* dyndep_loader) {
+  string err;
+  Node* node = CollectTarget(path, &err);
+  if (!node) {
+    if (json) {
+      string out = "{\"target\":";
+      AppendJSONString(path, &out);
+      out += ",\"error\":";
+      AppendJSONString(err, &out);
+      out += "}\n";
+      fputs(out.c_str(), stdout);
+    } else {
+      Error("%s", err.c_str());
+    }
+    return false;
+  }
+
+  Edge* edge = node->in_edge();
+  if (edge && edge->dyndep_ && edge->dyndep_->dyndep_pending()) {
+    if (!dyndep_loader->LoadDyndeps(edge->dyndep_, &err)) {
+      Warning("%s\n", err.c_str());
+    }
+  }
+  PrintQuery(node, json);
+  return true;
+}
+
+int NinjaMain::ToolQuery(const Options* options, int argc, char* argv[]) {
+  // The query tool uses getopt, and expects argv[0] to contain the name of
+  // the tool, i.e. "query".
+  argc++;
+  argv--;
+
+  bool json = false;
+  bool from_stdin = false;
+
+  optind = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, const_cast<char*>("hij"))) != -1) {
+    switch(opt) {
+      case 'i':
+        from_stdin = true;
+        break;
+
+      case 'j':
+        json = true;
+        break;
+
+      case 'h':
+      default:
+        printf(
+            "usage: ninja -t query [options] [targets]\n"
+            "\n"
+            "options:\n"
+            "  -i     also query the targets read from stdin, one per line\n"
+            "  -j     print a line of JSON per target\n"
+            );
+        return 1;
+    }
+  }
+  argv += optind;
+  argc -= optind;
+
+  if (argc == 0 && !from_stdin) {
+    Error("expected a target to query");
+    return 1;
+  }
+
+  DyndepLoader dyndep_loader(&state_, &disk_interface_);
+
+  for (int i = 0; i < argc; ++i) {
+    if (!QueryTarget(argv[i], json, &dyndep_loader))
+      return 1;
+  }
+  if (!from_stdin)
+    return 0;
+
+  // Each answer is flushed as soon as it is printed, so that the targets
+  // can be asked for one at a time over a pipe.  An unknown target is
+  // reported without ending the session.
+  fflush(stdout);
+  int status = 0;
+  string line;
+  char buf[1024];
+  while (fgets(buf, sizeof(buf), stdin)) {
+    line += buf;
+    if (line[line.size() - 1] != '\n' && !feof(stdin))
+      continue;
+    while (!line.empty() &&
+           (line[line.size() - 1] == '\n' || line[line.size() - 1] == '\r'))
+      line.resize(line.size() - 1);
+    if (!line.empty() && !QueryTarget(line.c_str(), json, &dyndep_loader))
+      status = 1;
+    fflush(stdout);
+    line.clear();
+  }
+  return status;
 }
 
 #if defined(NINJA_HAVE_BROWSE)
@@ -503,136 +852,547 @@ int NinjaMain::ToolDeps(const Options* options, int argc, char** argv) {
   }
 
   RealDiskInterface disk_interface;
-  for (vector<Node*>::iterator it = nodes.begin(), end = nodes.end();
-       it != end; ++it) {
-    DepsLog::Deps* deps = deps_log_.GetDeps(*it);
-    if (!deps) {
-      printf("%s: deps not found\n", (*it)->path().c_str());
-      continue;
-    }
-
-    string err;
-    TimeStamp mtime = disk_interface.Stat((*it)->path(), &err);
-    if (mtime == -1)
-      Error("%s", err.c_str());  // Log and ignore Stat() errors;
-    printf("%s: #deps %d, deps mtime %" PRId64 " (%s)\n",
-           (*it)->path().c_str(), deps->node_count, deps->mtime,
-           (!mtime || mtime > deps->mtime ? "STALE":"VALID"));
-    for (int i = 0; i < deps->node_count; ++i)
-      printf("    %s\n", deps->nodes[i]->path().c_str());
-    printf("\n");
-  }
-
+  DepsPrinter printer(&deps_log_, &disk_interface);
+  printer.Print(nodes, stdout);
   return 0;
 }
 
-int NinjaMain::ToolTargets(const Options* options, int argc, char* argv[]) {
-  int depth = 1;
-  if (argc >= 1) {
-    string mode = argv[0];
-    if (mode == "rule") {
-      string rule;
-      if (argc > 1)
-        rule = argv[1];
-      if (rule.empty())
-        return ToolTargetsSourceList(&state_);
-      else
-        return ToolTargetsList(&state_, rule);
-    } else if (mode == "depth") {
-      if (argc > 1)
-        depth = atoi(argv[1]);
-    } else if (mode == "all") {
-      return ToolTargetsList(&state_);
-    } else {
-      const char* suggestion =
-          SpellcheckString(mode.c_str(), "rule", "depth", "all", NULL);
-      if (suggestion) {
-        Error("unknown target tool mode '%s', did you mean '%s'?",
-              mode.c_str(), suggestion);
-      } else {
-        Error("unknown target tool mode '%s'", mode.c_str());
-      }
-      return 1;
-    }
-  }
-
+int NinjaMain::ToolMissingDeps(const Options* options, int argc,
+                               char** argv) {
+  vector<Node*> nodes;
   string err;
-  vector<Node*> root_nodes = state_.RootNodes(&err);
-  if (err.empty()) {
-    return ToolTargetsList(root_nodes, depth, 0);
-  } else {
+  if (!CollectTargetsFromArgs(argc, argv, &nodes, &err)) {
     Error("%s", err.c_str());
     return 1;
   }
-}
 
-int NinjaMain::ToolRules(const Options* options, int argc, char* argv[]) {
-  // Parse options.
+  MissingDependencyScanner scanner(&deps_log_, &state_);
+  for (vector<Node*>::iterator it = nodes.begin(); it != nodes.end(); ++it)
+    scanner.ProcessNode(*it);
+
+  const vector<MissingDependencyScanner::MissingDep>& missing =
+      scanner.missing();
+  for (vector<MissingDependencyScanner::MissingDep>::const_iterator
+           i = missing.begin(); i != missing.end(); ++i) {
+    printf("Missing dep: %s uses %s (generated by %s)\n",
+           i->edge->outputs_[0]->path().c_str(), i->input->path().c_str(),
+           i->input->in_edge()->rule().name().c_str());
+  }
+  printf("Processed %d edges.\n", scanner.edges_checked());
+  if (missing.empty()) {
+    printf("No missing dependencies on generated files found.\n");
+    return 0;
+  }
+  printf("Error: %d missing dependencies on %d generated files, made by "
+         "%d rules.\n"
+         "Builds of the targets using them may be flaky, as they may be "
+         "built before\nthey are, or without them in a clean build "
+         "directory.\n",
+         (int)missing.size(), (int)scanner.missing_inputs().size(),
+         (int)scanner.generator_rules().size());
+  return 3;
+}
 
-  // The rules tool uses getopt, and expects argv[0] to contain the name of
-  // the tool, i.e. "rules".
+int NinjaMain::ToolAffected(const Options* options, int argc, char* argv[]) {
+  // The affected tool uses getopt, and expects argv[0] to contain the name of
+  // the tool, i.e. "affected".
   argc++;
   argv--;
 
-  bool print_description = false;
+  bool defaults_only = false;
+  bool from_stdin = false;
 
   optind = 1;
   int opt;
-  while ((opt = getopt(argc, argv, const_cast<char*>("hd"))) != -1) {
-    switch (opt) {
-    case 'd':
-      print_description = true;
-      break;
-    case 'h':
-    default:
-      printf("usage: ninja -t rules [options]\n"
-             "\n"
-             "options:\n"
-             "  -d     also print the description of the rule\n"
-             "  -h     print this message\n"
-             );
-    return 1;
+  while ((opt = getopt(argc, argv, const_cast<char*>("hdi"))) != -1) {
+    switch(opt) {
+      case 'd':
+        defaults_only = true;
+        break;
+
+      case 'i':
+        from_stdin = true;
+        break;
+
+      case 'h':
+      default:
+        printf(
+            "usage: ninja -t affected [options] [files]\n"
+            "\n"
+            "options:\n"
+            "  -d     only print the affected default targets\n"
+            "  -i     also read the changed files from stdin, one per line\n"
+            );
+        return 1;
     }
   }
   argv += optind;
   argc -= optind;
 
-  // Print rules
-
-  typedef map<string, const Rule*> Rules;
-  const Rules& rules = state_.bindings_.GetRules();
-  for (Rules::const_iterator i = rules.begin(); i != rules.end(); ++i) {
-    printf("%s", i->first.c_str());
-    if (print_description) {
-      const Rule* rule = i->second;
-      const EvalString* description = rule->GetBinding("description");
-      if (description != NULL) {
-        printf(": %s", description->Unparse().c_str());
-      }
+  AffectedScanner scanner(&deps_log_, &state_);
+  string err;
+  for (int i = 0; i < argc; ++i) {
+    if (!scanner.AddChanged(argv[i], &err)) {
+      Error("%s", err.c_str());
+      return 1;
     }
-    printf("\n");
   }
-  return 0;
-}
-
-enum PrintCommandMode { PCM_Single, PCM_All };
-void PrintCommands(Edge* edge, set<Edge*>* seen, PrintCommandMode mode) {
-  if (!edge)
-    return;
-  if (!seen->insert(edge).second)
-    return;
-
-  if (mode == PCM_All) {
-    for (vector<Node*>::iterator in = edge->inputs_.begin();
-         in != edge->inputs_.end(); ++in)
-      PrintCommands((*in)->in_edge(), seen, mode);
+  if (from_stdin && !scanner.AddChangedFrom(stdin, &err)) {
+    Error("%s", err.c_str());
+    return 1;
+  }
+  if (scanner.empty()) {
+    Error("expected a file to find the dependents of");
+    return 1;
   }
 
-  if (!edge->is_phony())
-    puts(edge->EvaluateCommand().c_str());
+  vector<string> out;
+  if (!scanner.Find(defaults_only, &out, &err)) {
+    Error("%s", err.c_str());
+    return 1;
+  }
+  for (vector<string>::iterator o = out.begin(); o != out.end(); ++o)
+    printf("%s\n", o->c_str());
+  return 0;
 }
 
-int NinjaMain::ToolCommands(const Options* options, int argc, char* argv[]) {
+int NinjaMain::ToolShard(const Options* options, int argc, char* argv[]) {
+  // The shard tool uses getopt, and expects argv[0] to contain the name of
+  // the tool, i.e. "shard".
+  argc++;
+  argv--;
+
+  const option kLongOptions[] = {
+    { "count", required_argument, NULL, 'n' },
+    { "index", required_argument, NULL, 'i' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  int count = 0;
+  int index = -1;
+  optind = 1;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "hn:i:", kLongOptions, NULL)) != -1) {
+    char* end;
+    switch (opt) {
+      case 'n':
+        count = strtol(optarg, &end, 10);
+        if (*end != 0 || count <= 0)
+          Fatal("invalid --count parameter");
+        break;
+      case 'i':
+        index = strtol(optarg, &end, 10);
+        if (*end != 0 || index < 0)
+          Fatal("invalid --index parameter");
+        break;
+      case 'h':
+      default:
+        printf(
+            "usage: ninja -t shard --count N --index I [targets]\n"
+            "\n"
+            "Print what the I'th of N machines (from 0) builds of the targets:\n"
+            "'build PATH' for each target to build there, and 'fetch J PATH'\n"
+            "for each file it needs from machine J first.\n"
+            "\n"
+            "options:\n"
+            "  -n, --count N  split the build among N machines\n"
+            "  -i, --index I  print the share of machine I\n"
+            );
+        return 1;
+    }
+  }
+  argv += optind;
+  argc -= optind;
+  if (count == 0 || index < 0) {
+    Error("expected --count and --index");
+    return 1;
+  }
+  if (index >= count) {
+    Error("--index must be less than --count");
+    return 1;
+  }
+
+  vector<Node*> nodes;
+  string err;
+  if (!CollectTargetsFromArgs(argc, argv, &nodes, &err)) {
+    Error("%s", err.c_str());
+    return 1;
+  }
+
+  Sharder sharder(&build_log_);
+  for (vector<Node*>::iterator n = nodes.begin(); n != nodes.end(); ++n)
+    sharder.AddTarget(*n);
+  sharder.Partition(count);
+
+  vector<Node*> targets = sharder.Targets(index);
+  for (vector<Node*>::iterator n = targets.begin(); n != targets.end(); ++n)
+    printf("build %s\n", (*n)->path().c_str());
+  vector<pair<Node*, int> > fetches = sharder.Fetches(index);
+  for (vector<pair<Node*, int> >::iterator f = fetches.begin();
+       f != fetches.end(); ++f)
+    printf("fetch %d %s\n", f->second, f->first->path().c_str());
+  return 0;
+}
+
+int NinjaMain::ToolSimulate(const Options* options, int argc, char* argv[]) {
+  // The simulate tool uses getopt, and expects argv[0] to contain the name
+  // of the tool, i.e. "simulate".
+  argc++;
+  argv--;
+
+  const option kLongOptions[] = {
+    { "jobs", required_argument, NULL, 'j' },
+    { "pool", required_argument, NULL, 'p' },
+    { "incremental", no_argument, NULL, 'i' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  vector<int> jobs;
+  bool incremental = false;
+  optind = 1;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "hij:p:", kLongOptions, NULL)) != -1) {
+    switch (opt) {
+      case 'j': {
+        char* end;
+        int value = strtol(optarg, &end, 10);
+        if (*end != 0 || value <= 0)
+          Fatal("invalid --jobs parameter");
+        jobs.push_back(value);
+        break;
+      }
+      case 'p': {
+        const char* equals = strchr(optarg, '=');
+        char* end;
+        int depth = equals ? strtol(equals + 1, &end, 10) : -1;
+        if (!equals || *end != 0 || depth < 0)
+          Fatal("invalid --pool parameter; expected POOL=DEPTH");
+        Pool* pool = state_.LookupPool(string(optarg, equals - optarg));
+        if (!pool)
+          Fatal("unknown pool '%.*s'", (int)(equals - optarg), optarg);
+        pool->set_depth(depth);
+        break;
+      }
+      case 'i':
+        incremental = true;
+        break;
+      case 'h':
+      default:
+        printf(
+            "usage: ninja -t simulate [options] [targets]\n"
+            "\n"
+            "Replay a build of the targets, without running anything, each\n"
+            "command taking as long as the build log says it did, and print\n"
+            "how long the build takes and how busy it keeps the job slots.\n"
+            "The scheduling flags, like --schedule, apply.\n"
+            "\n"
+            "options:\n"
+            "  -j, --jobs N          replay with N jobs; give it again to\n"
+            "                        compare [default: like the build]\n"
+            "  -p, --pool POOL=DEPTH give POOL another depth\n"
+            "  -i, --incremental     only run what is dirty now, rather than\n"
+            "                        everything\n"
+            );
+        return 1;
+    }
+  }
+  argv += optind;
+  argc -= optind;
+  if (jobs.empty())
+    jobs.push_back(config_.parallelism);
+
+  vector<Node*> targets;
+  string err;
+  if (!CollectTargetsFromArgs(argc, argv, &targets, &err)) {
+    Error("%s", err.c_str());
+    return 1;
+  }
+
+  SimulatedDiskInterface disk(&disk_interface_, &state_, !incremental);
+  int unknown = 0;
+  printf("%6s %10s %8s %10s %10s  %s\n", "jobs", "wall s", "busy %",
+         "cpu s", "peak MiB", "pool waits (commands / total s / max s)");
+  for (vector<int>::iterator j = jobs.begin(); j != jobs.end(); ++j) {
+    BuildConfig config = config_;
+    config.parallelism = *j;
+    config.dry_run = true;
+    config.verbosity = BuildConfig::QUIET;
+    config.max_load_average = -0.0f;
+    config.min_available_memory = 0;
+    config.jobserver = NULL;
+    config.action_cache = NULL;
+    config.lazy_outputs = false;
+    config.remote = NULL;
+    config.observer = NULL;
+    config.build_dir_lock = NULL;
+
+    state_.Reset();
+    Builder builder(&state_, config, &build_log_, &deps_log_, &disk);
+    SimulatedCommandRunner* runner =
+        new SimulatedCommandRunner(config, &build_log_);
+    builder.command_runner_.reset(runner);
+    for (vector<Node*>::iterator t = targets.begin(); t != targets.end(); ++t) {
+      if (!builder.AddTarget(*t, &err) && !err.empty()) {
+        Error("%s", err.c_str());
+        return 1;
+      }
+    }
+    if (!builder.AlreadyUpToDate() && !builder.Build(&err)) {
+      Error("simulated build failed: %s", err.c_str());
+      return 1;
+    }
+
+    int64_t wall = runner->now_millis();
+    printf("%6d %10.3f %8.1f %10.3f %10.1f", *j, wall / 1e3,
+           wall ? 100.0 * runner->busy_millis() / (wall * (double)*j) : 0.0,
+           runner->cpu_micros() / 1e6, runner->peak_rss_kib() / 1024.0);
+    const map<string, SimulatedCommandRunner::PoolWait>& waits =
+        runner->pool_waits();
+    const char* separator = "  ";
+    for (map<string, SimulatedCommandRunner::PoolWait>::const_iterator w =
+             waits.begin(); w != waits.end(); ++w, separator = " ") {
+      printf("%s%s %d/%.3f/%.3f", separator,
+             w->first.empty() ? "(default)" : w->first.c_str(),
+             w->second.commands, w->second.wait_millis / 1e3,
+             w->second.max_wait_millis / 1e3);
+    }
+    printf("\n");
+    unknown = runner->unknown_commands();
+  }
+  if (unknown) {
+    printf("the build log didn't know %d of the commands; they took as long "
+           "as the average\n", unknown);
+  }
+  return 0;
+}
+
+int NinjaMain::ToolImportLog(const Options* options, int argc, char* argv[]) {
+  if (argc != 1) {
+    printf("usage: ninja -t importlog DIR\n"
+           "\n"
+           "merge the .ninja_log and .ninja_deps found in DIR into this\n"
+           "build's logs, for the outputs that they don't know about yet\n");
+    return 1;
+  }
+  string dir = argv[0];
+  string err;
+
+  // Outputs that are on disk are taken to be the ones the snapshot
+  // describes, restored along with it, so their records get the local
+  // mtimes.  The others will be rebuilt anyway.
+  BuildLog snapshot_log;
+  if (!snapshot_log.Load(dir + "/.ninja_log", &err)) {
+    Error("loading %s/.ninja_log: %s", dir.c_str(), err.c_str());
+    return 1;
+  }
+  int entries = 0;
+  const BuildLog::Entries& snapshot_entries = snapshot_log.entries();
+  for (BuildLog::Entries::const_iterator i = snapshot_entries.begin();
+       i != snapshot_entries.end(); ++i) {
+    BuildLog::LogEntry entry = *i->second;
+    Node* node = state_.LookupNode(entry.output);
+    if (!node || !node->in_edge() || build_log_.LookupByOutput(entry.output))
+      continue;
+    TimeStamp mtime = disk_interface_.Stat(entry.output, &err);
+    if (mtime == -1) {
+      Error("%s", err.c_str());
+      return 1;
+    }
+    if (mtime > 0)
+      entry.mtime = mtime;
+    if (!build_log_.RecordEntry(entry)) {
+      Error("writing build log: %s", strerror(errno));
+      return 1;
+    }
+    ++entries;
+  }
+
+  // The snapshot's node ids mean nothing here, so load it into a State of
+  // its own and record its deps again by path, which gives the nodes ids in
+  // this build's log.
+  State snapshot_state;
+  DepsLog snapshot_deps;
+  if (!snapshot_deps.Load(dir + "/.ninja_deps", &snapshot_state, &err)) {
+    Error("loading %s/.ninja_deps: %s", dir.c_str(), err.c_str());
+    return 1;
+  }
+  int records = 0;
+  const vector<Node*>& snapshot_nodes = snapshot_deps.nodes();
+  const vector<DepsLog::Deps*>& snapshot_records = snapshot_deps.deps();
+  vector<Node*> inputs;
+  for (size_t id = 0; id < snapshot_records.size(); ++id) {
+    DepsLog::Deps* deps = snapshot_records[id];
+    if (!deps)
+      continue;
+    const string& path = snapshot_nodes[id]->path();
+    Node* node = state_.LookupNode(path);
+    if (!node || !node->in_edge() || deps_log_.GetDeps(node))
+      continue;
+    TimeStamp mtime = disk_interface_.Stat(path, &err);
+    if (mtime == -1) {
+      Error("%s", err.c_str());
+      return 1;
+    }
+    inputs.clear();
+    for (int i = 0; i < deps->node_count; ++i) {
+      inputs.push_back(state_.GetNode(deps->nodes[i]->path(),
+                                      &state_.bindings_, 0));
+    }
+    if (!deps_log_.RecordDeps(node, mtime > 0 ? mtime : deps->mtime,
+                              inputs)) {
+      Error("writing deps log: %s", strerror(errno));
+      return 1;
+    }
+    ++records;
+  }
+
+  build_log_.Close();
+  deps_log_.Close();
+  printf("imported %d build log entries and %d deps records from %s\n",
+         entries, records, dir.c_str());
+  return 0;
+}
+
+int NinjaMain::ToolTargets(const Options* options, int argc, char* argv[]) {
+  int depth = 1;
+  if (argc >= 1) {
+    string mode = argv[0];
+    if (mode == "rule") {
+      string rule;
+      if (argc > 1)
+        rule = argv[1];
+      if (rule.empty())
+        return ToolTargetsSourceList(&state_);
+      else
+        return ToolTargetsList(&state_, rule);
+    } else if (mode == "depth") {
+      if (argc > 1)
+        depth = atoi(argv[1]);
+    } else if (mode == "all") {
+      return ToolTargetsList(&state_);
+    } else {
+      const char* suggestion =
+          SpellcheckString(mode.c_str(), "rule", "depth", "all", NULL);
+      if (suggestion) {
+        Error("unknown target tool mode '%s', did you mean '%s'?",
+              mode.c_str(), suggestion);
+      } else {
+        Error("unknown target tool mode '%s'", mode.c_str());
+      }
+      return 1;
+    }
+  }
+
+  string err;
+  vector<Node*> root_nodes = state_.RootNodes(&err);
+  if (err.empty()) {
+    return ToolTargetsList(root_nodes, depth, 0);
+  } else {
+    Error("%s", err.c_str());
+    return 1;
+  }
+}
+
+int NinjaMain::ToolRules(const Options* options, int argc, char* argv[]) {
+  // Parse options.
+
+  // The rules tool uses getopt, and expects argv[0] to contain the name of
+  // the tool, i.e. "rules".
+  argc++;
+  argv--;
+
+  bool print_description = false;
+
+  optind = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, const_cast<char*>("hd"))) != -1) {
+    switch (opt) {
+    case 'd':
+      print_description = true;
+      break;
+    case 'h':
+    default:
+      printf("usage: ninja -t rules [options]\n"
+             "\n"
+             "options:\n"
+             "  -d     also print the description of the rule\n"
+             "  -h     print this message\n"
+             );
+    return 1;
+    }
+  }
+  argv += optind;
+  argc -= optind;
+
+  // Print rules
+
+  typedef map<string, const Rule*> Rules;
+  const Rules& rules = state_.bindings_.GetRules();
+  for (Rules::const_iterator i = rules.begin(); i != rules.end(); ++i) {
+    printf("%s", i->first.c_str());
+    if (print_description) {
+      const Rule* rule = i->second;
+      const EvalString* description = rule->GetBinding("description");
+      if (description != NULL) {
+        printf(": %s", description->Unparse().c_str());
+      }
+    }
+    printf("\n");
+  }
+  return 0;
+}
+
+enum PrintCommandMode { PCM_Single, PCM_All };
+/// Add the edges whose commands build |edge|, inputs first, and |edge|
+/// itself to |edges|, skipping those |seen| by id and phony ones.
+void CollectCommands(Edge* edge, vector<bool>* seen, PrintCommandMode mode,
+                     vector<const Edge*>* edges) {
+  if (!edge || (*seen)[edge->id()])
+    return;
+  (*seen)[edge->id()] = true;
+  if (mode == PCM_Single) {
+    if (!edge->is_phony())
+      edges->push_back(edge);
+    return;
+  }
+
+  // Each edge, with the next of its inputs to go through.
+  vector<pair<Edge*, size_t> > stack(1, make_pair(edge, (size_t)0));
+  while (!stack.empty()) {
+    Edge* e = stack.back().first;
+    size_t& input = stack.back().second;
+    if (input == e->inputs_.size()) {
+      if (!e->is_phony())
+        edges->push_back(e);
+      stack.pop_back();
+      continue;
+    }
+    Edge* in_edge = e->inputs_[input++]->in_edge();
+    if (in_edge && !(*seen)[in_edge->id()]) {
+      (*seen)[in_edge->id()] = true;
+      stack.push_back(make_pair(in_edge, (size_t)0));
+    }
+  }
+}
+
+/// Evaluates the commands of a batch of edges.
+struct CommandsTask : public ParallelTask {
+  virtual void Run(size_t index) {
+    commands_[index] = edges_[index]->EvaluateCommand();
+  }
+
+  vector<const Edge*> edges_;
+  vector<string> commands_;
+};
+
+void WriteStdout(string* out) {
+  fwrite(out->data(), 1, out->size(), stdout);
+  out->clear();
+}
+
+int NinjaMain::ToolCommands(const Options* options, int argc, char* argv[]) {
   // The clean tool uses getopt, and expects argv[0] to contain the name of
   // the tool, i.e. "commands".
   ++argc;
@@ -667,10 +1427,31 @@ int NinjaMain::ToolCommands(const Options* options, int argc, char* argv[]) {
     return 1;
   }
 
-  set<Edge*> seen;
+  vector<bool> seen(state_.edges_.size());
+  vector<const Edge*> edges;
   for (vector<Node*>::iterator in = nodes.begin(); in != nodes.end(); ++in)
-    PrintCommands((*in)->in_edge(), &seen, mode);
-
+    CollectCommands((*in)->in_edge(), &seen, mode, &edges);
+
+  // Evaluate a batch of commands at a time, as compdb does.
+  const size_t kBatchSize = 4096;
+  const size_t kMinCommandsPerThread = 256;
+  const size_t kFlushSize = 1 << 20;
+  CommandsTask task;
+  string out;
+  for (size_t begin = 0; begin < edges.size(); begin += kBatchSize) {
+    size_t end = min(begin + kBatchSize, edges.size());
+    task.edges_.assign(edges.begin() + begin, edges.begin() + end);
+    task.commands_.resize(task.edges_.size());
+    RunInParallel(&task, task.edges_.size(),
+                  ParallelismFor(task.edges_.size(), kMinCommandsPerThread));
+    for (size_t i = 0; i < task.commands_.size(); ++i) {
+      out += task.commands_[i];
+      out.push_back('\n');
+      if (out.size() >= kFlushSize)
+        WriteStdout(&out);
+    }
+  }
+  WriteStdout(&out);
   return 0;
 }
 
@@ -723,13 +1504,26 @@ int NinjaMain::ToolClean(const Options* options, int argc, char* argv[]) {
   }
 }
 
-void EncodeJSONString(const char *str) {
-  while (*str) {
-    if (*str == '"' || *str == '\\')
-      putchar('\\');
-    putchar(*str);
-    str++;
+int NinjaMain::ToolCleanDead(const Options* options, int argc, char* argv[]) {
+  Cleaner cleaner(&state_, config_, &disk_interface_);
+  int status = cleaner.CleanDead(build_log_.entries());
+  if (config_.dry_run || !build_dir_lock_.owns_logs())
+    return status;
+
+  // Drop what is now dead from the logs as well, while they're loaded.
+  string log_path = ".ninja_log";
+  string deps_path = ".ninja_deps";
+  if (!build_dir_.empty()) {
+    log_path = build_dir_ + "/" + log_path;
+    deps_path = build_dir_ + "/" + deps_path;
   }
+  string err;
+  if (!build_log_.Recompact(log_path, *this, &err) ||
+      !deps_log_.Recompact(deps_path, &err)) {
+    Error("failed recompaction: %s", err.c_str());
+    return 1;
+  }
+  return status;
 }
 
 enum EvaluateCommandMode {
@@ -761,17 +1555,48 @@ std::string EvaluateCommandWithRspfile(const Edge* edge,
   return command;
 }
 
-void printCompdb(const char* const directory, const Edge* const edge,
-                 const EvaluateCommandMode eval_mode) {
-  printf("\n  {\n    \"directory\": \"");
-  EncodeJSONString(directory);
-  printf("\",\n    \"command\": \"");
-  EncodeJSONString(EvaluateCommandWithRspfile(edge, eval_mode).c_str());
-  printf("\",\n    \"file\": \"");
-  EncodeJSONString(edge->inputs_[0]->path().c_str());
-  printf("\",\n    \"output\": \"");
-  EncodeJSONString(edge->outputs_[0]->path().c_str());
-  printf("\"\n  }");
+void AppendCompdbEntry(const string& directory, const Edge* const edge,
+                       const EvaluateCommandMode eval_mode, string* out) {
+  out->append("\n  {\n    \"directory\": \"");
+  EncodeJSONString(directory, out);
+  out->append("\",\n    \"command\": \"");
+  EncodeJSONString(EvaluateCommandWithRspfile(edge, eval_mode), out);
+  out->append("\",\n    \"file\": \"");
+  EncodeJSONString(edge->inputs_[0]->path(), out);
+  out->append("\",\n    \"output\": \"");
+  EncodeJSONString(edge->outputs_[0]->path(), out);
+  out->append("\"\n  }");
+}
+
+/// Formats the compilation database entries of a batch of edges.  Nearly
+/// all the time goes into evaluating their commands, which only reads
+/// the graph, so the entries are formatted in parallel.
+struct CompdbTask : public ParallelTask {
+  CompdbTask(const string& directory, EvaluateCommandMode eval_mode)
+      : directory_(directory), eval_mode_(eval_mode) {}
+
+  virtual void Run(size_t index) {
+    entries_[index].clear();
+    AppendCompdbEntry(directory_, edges_[index], eval_mode_,
+                      &entries_[index]);
+  }
+
+  const string& directory_;
+  EvaluateCommandMode eval_mode_;
+  vector<const Edge*> edges_;
+  vector<string> entries_;
+};
+
+/// Add the edges |node| is built by, directly or not, to |edges|.
+void CollectInEdges(const Node* node, set<const Edge*>* edges) {
+  vector<const Node*> stack(1, node);
+  while (!stack.empty()) {
+    const Edge* edge = stack.back()->in_edge();
+    stack.pop_back();
+    if (!edge || !edges->insert(edge).second)
+      continue;
+    stack.insert(stack.end(), edge->inputs_.begin(), edge->inputs_.end());
+  }
 }
 
 int NinjaMain::ToolCompilationDatabase(const Options* options, int argc,
@@ -782,22 +1607,36 @@ int NinjaMain::ToolCompilationDatabase(const Options* options, int argc,
   argv--;
 
   EvaluateCommandMode eval_mode = ECM_NORMAL;
+  vector<Node*> targets;
+  string err;
 
   optind = 1;
   int opt;
-  while ((opt = getopt(argc, argv, const_cast<char*>("hx"))) != -1) {
+  while ((opt = getopt(argc, argv, const_cast<char*>("hxT:"))) != -1) {
     switch(opt) {
       case 'x':
         eval_mode = ECM_EXPAND_RSPFILE;
         break;
 
+      case 'T': {
+        Node* target = CollectTarget(optarg, &err);
+        if (!target) {
+          Error("%s", err.c_str());
+          return 1;
+        }
+        targets.push_back(target);
+        break;
+      }
+
       case 'h':
       default:
         printf(
             "usage: ninja -t compdb [options] [rules]\n"
             "\n"
             "options:\n"
-            "  -x     expand @rspfile style response file invocations\n"
+            "  -x         expand @rspfile style response file invocations\n"
+            "  -T TARGET  only include commands TARGET depends on "
+            "(may be repeated)\n"
             );
         return 1;
     }
@@ -805,50 +1644,171 @@ int NinjaMain::ToolCompilationDatabase(const Options* options, int argc,
   argv += optind;
   argc -= optind;
 
-  bool first = true;
   string cwd;
-  string err;
   if (disk_interface_.Getcwd(&cwd, &err) != RealDiskInterface::Okay) {
     Error("cannot determine working directory: %s", err.c_str());
     return 1;
   }
 
-  putchar('[');
+  set<const Edge*> reachable;
+  for (vector<Node*>::iterator t = targets.begin(); t != targets.end(); ++t)
+    CollectInEdges(*t, &reachable);
+
+  // Keep the order of the manifest, whichever edges are picked.
+  vector<const Edge*> edges;
   for (vector<Edge*>::iterator e = state_.edges_.begin();
        e != state_.edges_.end(); ++e) {
     if ((*e)->inputs_.empty())
       continue;
-    if (argc == 0) {
-      if (!first) {
-        putchar(',');
-      }
-      printCompdb(cwd.c_str(), *e, eval_mode);
-      first = false;
-    } else {
-      for (int i = 0; i != argc; ++i) {
-        if ((*e)->rule_->name() == argv[i]) {
-          if (!first) {
-            putchar(',');
-          }
-          printCompdb(cwd.c_str(), *e, eval_mode);
-          first = false;
-        }
-      }
-    }
+    if (!targets.empty() && !reachable.count(*e))
+      continue;
+    bool wanted = argc == 0;
+    for (int i = 0; i != argc && !wanted; ++i)
+      wanted = (*e)->rule_->name() == argv[i];
+    if (wanted)
+      edges.push_back(*e);
   }
 
-  puts("\n]");
+  // Format a batch of entries at a time and write them out as they come,
+  // so that large databases aren't held in memory whole.
+  const size_t kBatchSize = 4096;
+  const size_t kMinEntriesPerThread = 64;
+  const size_t kFlushSize = 1 << 20;
+  CompdbTask task(cwd, eval_mode);
+  string out = "[";
+  for (size_t begin = 0; begin < edges.size(); begin += kBatchSize) {
+    size_t end = min(begin + kBatchSize, edges.size());
+    task.edges_.assign(edges.begin() + begin, edges.begin() + end);
+    task.entries_.resize(task.edges_.size());
+    RunInParallel(&task, task.edges_.size(),
+                  ParallelismFor(task.edges_.size(), kMinEntriesPerThread));
+    for (size_t i = 0; i < task.entries_.size(); ++i) {
+      if (begin + i > 0)
+        out.push_back(',');
+      out += task.entries_[i];
+      if (out.size() >= kFlushSize)
+        WriteStdout(&out);
+    }
+  }
+  out += "\n]\n";
+  WriteStdout(&out);
   return 0;
 }
 
 int NinjaMain::ToolRecompact(const Options* options, int argc, char* argv[]) {
-  if (!EnsureBuildDirExists())
+  if (!EnsureBuildDirExists() || !LockBuildDir())
     return 1;
-
-  if (!OpenBuildLog(/*recompact_only=*/true) ||
-      !OpenDepsLog(/*recompact_only=*/true))
+  if (!build_dir_lock_.owns_logs()) {
+    Error("another ninja process is using the logs");
     return 1;
+  }
+
+  // The build and deps logs are each rewritten on a thread of their own
+  // from when they are loaded, so the rewrites overlap with each other and
+  // with loading the logs after them.
+  bool success = OpenBuildLog(/*recompact_only=*/true) &&
+                 OpenDepsLog(/*recompact_only=*/true) &&
+                 OpenDigestLog(/*recompact_only=*/true);
+  string err;
+  if (!build_log_.FinishRecompaction(true, &err)) {
+    Error("failed recompaction: %s", err.c_str());
+    success = false;
+  }
+  err.clear();
+  if (!deps_log_.FinishRecompaction(true, &err)) {
+    Error("failed recompaction: %s", err.c_str());
+    success = false;
+  }
+  return success ? 0 : 1;
+}
+
+enum ResourceSortKey { RSK_Cpu, RSK_Rss, RSK_Wall };
+
+/// Orders build log entries by the resource their commands used the most
+/// of first.
+struct ResourceOrder {
+  explicit ResourceOrder(ResourceSortKey key) : key_(key) {}
+
+  int64_t Value(const BuildLog::LogEntry* e) const {
+    switch (key_) {
+    case RSK_Rss:
+      return e->usage.max_rss_kib;
+    case RSK_Wall:
+      return e->end_time - e->start_time;
+    case RSK_Cpu:
+    default:
+      return e->usage.user_micros + e->usage.system_micros;
+    }
+  }
+
+  bool operator()(const BuildLog::LogEntry* a,
+                  const BuildLog::LogEntry* b) const {
+    int64_t va = Value(a), vb = Value(b);
+    if (va != vb)
+      return va > vb;
+    return a->output < b->output;
+  }
 
+  ResourceSortKey key_;
+};
+
+int NinjaMain::ToolResources(const Options* options, int argc, char* argv[]) {
+  // The resources tool uses getopt, and expects argv[0] to contain the name
+  // of the tool, i.e. "resources".
+  argc++;
+  argv--;
+
+  ResourceSortKey key = RSK_Cpu;
+  optind = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, const_cast<char*>("hs:"))) != -1) {
+    string sort_key = opt == 's' ? optarg : "";
+    if (sort_key == "cpu") {
+      key = RSK_Cpu;
+    } else if (sort_key == "rss") {
+      key = RSK_Rss;
+    } else if (sort_key == "wall") {
+      key = RSK_Wall;
+    } else {
+      printf("usage: ninja -t resources [options]\n"
+             "\n"
+             "options:\n"
+             "  -s KEY  sort by KEY: cpu (the default), rss or wall\n"
+             "  -h      print this message\n"
+             );
+      return 1;
+    }
+  }
+
+  // A command with several outputs is logged once for each; list it once,
+  // under its first output in path order.
+  typedef map<pair<Hash128, pair<int, int> >, BuildLog::LogEntry*> Commands;
+  Commands commands;
+  const BuildLog::Entries& entries = build_log_.entries();
+  for (BuildLog::Entries::const_iterator i = entries.begin();
+       i != entries.end(); ++i) {
+    BuildLog::LogEntry* e = i->second;
+    pair<Commands::iterator, bool> inserted = commands.insert(
+        make_pair(make_pair(e->command_hash,
+                            make_pair(e->start_time, e->end_time)), e));
+    if (!inserted.second && e->output < inserted.first->second->output)
+      inserted.first->second = e;
+  }
+
+  vector<BuildLog::LogEntry*> sorted;
+  for (Commands::const_iterator i = commands.begin(); i != commands.end(); ++i)
+    sorted.push_back(i->second);
+  sort(sorted.begin(), sorted.end(), ResourceOrder(key));
+
+  printf("%10s %10s %10s  %s\n", "cpu s", "rss MiB", "wall s", "output");
+  for (vector<BuildLog::LogEntry*>::const_iterator i = sorted.begin();
+       i != sorted.end(); ++i) {
+    const BuildLog::LogEntry* e = *i;
+    printf("%10.3f %10.1f %10.3f  %s\n",
+           (e->usage.user_micros + e->usage.system_micros) / 1e6,
+           e->usage.max_rss_kib / 1024.0,
+           (e->end_time - e->start_time) / 1e3, e->output.c_str());
+  }
   return 0;
 }
 
@@ -890,22 +1850,42 @@ const Tool* ChooseTool(const string& tool_name) {
 #endif
     { "clean", "clean built files",
       Tool::RUN_AFTER_LOAD, &NinjaMain::ToolClean },
+    { "cleandead", "clean built files that are no longer produced by the manifest",
+      Tool::RUN_AFTER_LOGS, &NinjaMain::ToolCleanDead },
     { "commands", "list all commands required to rebuild given targets",
       Tool::RUN_AFTER_LOAD, &NinjaMain::ToolCommands },
     { "deps", "show dependencies stored in the deps log",
       Tool::RUN_AFTER_LOGS, &NinjaMain::ToolDeps },
-    { "graph", "output graphviz dot file for targets",
-      Tool::RUN_AFTER_LOAD, &NinjaMain::ToolGraph },
+    { "missingdeps", "check deps log dependencies on generated files",
+      Tool::RUN_AFTER_LOGS, &NinjaMain::ToolMissingDeps },
+    { "affected", "list the targets that depend on the given files",
+      Tool::RUN_AFTER_LOGS, &NinjaMain::ToolAffected },
+    { "shard", "split the targets' edges among machines building them",
+      Tool::RUN_AFTER_LOGS, &NinjaMain::ToolShard },
+    { "simulate", "replay a build of the targets with the durations logged",
+      Tool::RUN_AFTER_LOGS, &NinjaMain::ToolSimulate },
+    { "graph", "output graphviz dot file, or JSON, for targets",
+      Tool::RUN_AFTER_LOGS, &NinjaMain::ToolGraph },
     { "query", "show inputs/outputs for a path",
       Tool::RUN_AFTER_LOGS, &NinjaMain::ToolQuery },
     { "targets",  "list targets by their rule or depth in the DAG",
       Tool::RUN_AFTER_LOAD, &NinjaMain::ToolTargets },
     { "compdb",  "dump JSON compilation database to stdout",
       Tool::RUN_AFTER_LOAD, &NinjaMain::ToolCompilationDatabase },
+    { "importlog",  "seed the build and deps logs from another build's",
+      Tool::RUN_AFTER_LOGS, &NinjaMain::ToolImportLog },
     { "recompact",  "recompacts ninja-internal data structures",
       Tool::RUN_AFTER_LOAD, &NinjaMain::ToolRecompact },
+    { "resources",  "list the CPU and memory commands used in the last build",
+      Tool::RUN_AFTER_LOGS, &NinjaMain::ToolResources },
     { "rules",  "list all rules",
       Tool::RUN_AFTER_LOAD, &NinjaMain::ToolRules },
+#ifndef _WIN32
+    { "daemon",  "keep the build graph loaded and serve 'client' requests",
+      Tool::RUN_AFTER_LOGS, &NinjaMain::ToolDaemon },
+    { "client",  "build targets using a running 'daemon'",
+      Tool::RUN_AFTER_FLAGS, &NinjaMain::ToolClient },
+#endif
     { "urtle", NULL,
       Tool::RUN_AFTER_FLAGS, &NinjaMain::ToolUrtle },
     { NULL, NULL, Tool::RUN_AFTER_FLAGS, NULL }
@@ -944,16 +1924,24 @@ bool DebugEnable(const string& name) {
   if (name == "list") {
     printf("debugging modes:\n"
 "  stats        print operation counts/timing info\n"
+"  stats=FILE   write them to FILE as histograms, in the Prometheus text format\n"
 "  explain      explain what caused a command to execute\n"
 "  keepdepfile  don't delete depfiles after they're read by ninja\n"
+"  hugepages    put the build graph on huge pages where the OS allows\n"
 "  keeprsp      don't delete @response files on success\n"
-#ifdef _WIN32
+"  manifestcache  load the parsed manifest from .ninja_manifest_cache\n"
 "  nostatcache  don't batch stat() calls per directory and cache them\n"
-#endif
+"  trace=FILE   write a timeline of the build to FILE, for chrome://tracing\n"
 "multiple modes can be enabled via -d FOO -d BAR\n");
     return false;
   } else if (name == "stats") {
-    g_metrics = new Metrics;
+    if (!g_metrics)
+      g_metrics = new Metrics;
+    return true;
+  } else if (name.compare(0, 6, "stats=") == 0 && name.size() > 6) {
+    g_metrics_path = name.substr(6);
+    if (!g_metrics)
+      g_metrics = new Metrics;
     return true;
   } else if (name == "explain") {
     g_explaining = true;
@@ -964,14 +1952,26 @@ bool DebugEnable(const string& name) {
   } else if (name == "keeprsp") {
     g_keep_rsp = true;
     return true;
+  } else if (name == "manifestcache") {
+    g_experimental_manifest_cache = true;
+    return true;
+  } else if (name == "hugepages") {
+    g_huge_pages = true;
+    return true;
   } else if (name == "nostatcache") {
     g_experimental_statcache = false;
     return true;
+  } else if (name.compare(0, 6, "trace=") == 0 && name.size() > 6) {
+    g_trace_path = name.substr(6);
+    if (!g_trace)
+      g_trace = new Trace;
+    return true;
   } else {
     const char* suggestion =
         SpellcheckString(name.c_str(),
-                         "stats", "explain", "keepdepfile", "keeprsp",
-                         "nostatcache", NULL);
+                         "stats", "explain", "keepdepfile", "hugepages",
+                         "keeprsp", "manifestcache", "nostatcache", "trace",
+                         NULL);
     if (suggestion) {
       Error("unknown debug setting '%s', did you mean '%s'?",
             name.c_str(), suggestion);
@@ -1029,6 +2029,7 @@ bool NinjaMain::OpenBuildLog(bool recompact_only) {
   if (!build_dir_.empty())
     log_path = build_dir_ + "/" + log_path;
 
+  log_prefetch_thread_.Join();
   string err;
   if (!build_log_.Load(log_path, &err)) {
     Error("loading build log %s: %s", log_path.c_str(), err.c_str());
@@ -1041,13 +2042,17 @@ bool NinjaMain::OpenBuildLog(bool recompact_only) {
   }
 
   if (recompact_only) {
-    bool success = build_log_.Recompact(log_path, *this, &err);
-    if (!success)
-      Error("failed recompaction: %s", err.c_str());
-    return success;
+    build_log_.StartRecompaction(log_path, *this);
+    return true;
   }
 
-  if (!config_.dry_run) {
+  if (!config_.dry_run && !build_dir_lock_.owns_logs()) {
+    string side_path = log_path + build_dir_lock_.side_suffix();
+    if (!build_log_.OpenSideLog(side_path, &err)) {
+      Error("opening build log: %s", err.c_str());
+      return false;
+    }
+  } else if (!config_.dry_run) {
     if (!build_log_.OpenForWrite(log_path, *this, &err)) {
       Error("opening build log: %s", err.c_str());
       return false;
@@ -1057,16 +2062,58 @@ bool NinjaMain::OpenBuildLog(bool recompact_only) {
   return true;
 }
 
-/// Open the deps log: load it, then open for writing.
+/// Open the deps log: load it, then open for writing.
+/// @return false on error.
+bool NinjaMain::OpenDepsLog(bool recompact_only) {
+  string path = ".ninja_deps";
+  if (!build_dir_.empty())
+    path = build_dir_ + "/" + path;
+
+  log_prefetch_thread_.Join();
+  string err;
+  // The side log has to know before loading not to touch the log.
+  if (!config_.dry_run && !recompact_only && !build_dir_lock_.owns_logs()) {
+    string side_path = path + build_dir_lock_.side_suffix();
+    if (!deps_log_.OpenSideLog(side_path, &err)) {
+      Error("opening deps log: %s", err.c_str());
+      return false;
+    }
+  }
+  if (!deps_log_.Load(path, &state_, &err)) {
+    Error("loading deps log %s: %s", path.c_str(), err.c_str());
+    return false;
+  }
+  if (!err.empty()) {
+    // Hack: Load() can return a warning via err by returning true.
+    Warning("%s", err.c_str());
+    err.clear();
+  }
+
+  if (recompact_only) {
+    deps_log_.StartRecompaction(path);
+    return true;
+  }
+
+  if (!config_.dry_run && build_dir_lock_.owns_logs()) {
+    if (!deps_log_.OpenForWrite(path, &err)) {
+      Error("opening deps log: %s", err.c_str());
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/// Open the digest log: load it, then open for writing.
 /// @return false on error.
-bool NinjaMain::OpenDepsLog(bool recompact_only) {
-  string path = ".ninja_deps";
+bool NinjaMain::OpenDigestLog(bool recompact_only) {
+  string path = ".ninja_digests";
   if (!build_dir_.empty())
     path = build_dir_ + "/" + path;
 
   string err;
-  if (!deps_log_.Load(path, &state_, &err)) {
-    Error("loading deps log %s: %s", path.c_str(), err.c_str());
+  if (!digest_log_.Load(path, &err)) {
+    Error("loading digest log %s: %s", path.c_str(), err.c_str());
     return false;
   }
   if (!err.empty()) {
@@ -1076,15 +2123,17 @@ bool NinjaMain::OpenDepsLog(bool recompact_only) {
   }
 
   if (recompact_only) {
-    bool success = deps_log_.Recompact(path, &err);
+    bool success = digest_log_.Recompact(path, &err);
     if (!success)
       Error("failed recompaction: %s", err.c_str());
     return success;
   }
 
-  if (!config_.dry_run) {
-    if (!deps_log_.OpenForWrite(path, &err)) {
-      Error("opening deps log: %s", err.c_str());
+  if (!config_.dry_run && !build_dir_lock_.owns_logs()) {
+    digest_log_.OpenSideLog(path + build_dir_lock_.side_suffix());
+  } else if (!config_.dry_run) {
+    if (!digest_log_.OpenForWrite(path, &err)) {
+      Error("opening digest log: %s", err.c_str());
       return false;
     }
   }
@@ -1092,7 +2141,26 @@ bool NinjaMain::OpenDepsLog(bool recompact_only) {
   return true;
 }
 
+void NinjaMain::CloseLogs() {
+  build_log_.Close();
+  deps_log_.Close();
+  digest_log_.Close();
+}
+
+void NinjaMain::WriteTrace() {
+  string err;
+  if (!g_trace->Write(g_trace_path, &err))
+    Error("writing trace to %s: %s", g_trace_path.c_str(), err.c_str());
+}
+
 void NinjaMain::DumpMetrics() {
+  if (!g_metrics_path.empty()) {
+    string err;
+    if (!g_metrics->WritePrometheus(g_metrics_path, &err))
+      Error("writing metrics to %s: %s", g_metrics_path.c_str(), err.c_str());
+    return;
+  }
+
   g_metrics->Report();
 
   printf("\n");
@@ -1100,6 +2168,17 @@ void NinjaMain::DumpMetrics() {
   int buckets = (int)state_.paths_.bucket_count();
   printf("path->node hash load %.2f (%d entries / %d buckets)\n",
          count / (double) buckets, count, buckets);
+
+  const Arena& arena = state_.arena();
+  const double kMiB = 1 << 20;
+  int nodes = state_.node_count(), edges = (int)state_.edges_.size();
+  printf("graph arena %.1f MiB in %d slabs, %.1f MiB on huge pages: "
+         "%.1f MiB for %d nodes and %d edges (%.0f bytes each)\n",
+         arena.capacity() / kMiB, (int)arena.slabs(),
+         arena.huge_capacity() / kMiB, arena.used() / kMiB, nodes, edges,
+         nodes + edges ? arena.used() / (double)(nodes + edges) : 0.0);
+  if (loop_profile_.total_micros() > 0)
+    printf("%s\n", loop_profile_.Summary().c_str());
 }
 
 bool NinjaMain::EnsureBuildDirExists() {
@@ -1114,6 +2193,127 @@ bool NinjaMain::EnsureBuildDirExists() {
   return true;
 }
 
+bool NinjaMain::LockBuildDir() {
+  if (config_.dry_run)
+    return true;
+  string err;
+  if (!build_dir_lock_.Open(build_dir_.empty() ? "" : build_dir_ + "/",
+                            &err)) {
+    Error("%s", err.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool NinjaMain::MergeSideLogs() {
+  if (config_.dry_run || !build_dir_lock_.owns_logs())
+    return true;
+  vector<string> suffixes = build_dir_lock_.FinishedSideLogs();
+  if (suffixes.empty())
+    return true;
+  METRIC_RECORD("merge side logs");
+
+  string prefix = build_dir_.empty() ? "" : build_dir_ + "/";
+  for (vector<string>::iterator s = suffixes.begin(); s != suffixes.end();
+       ++s) {
+    string log_path = prefix + ".ninja_log" + *s;
+    string deps_path = prefix + ".ninja_deps" + *s;
+    string digests_path = prefix + ".ninja_digests" + *s;
+    string err;
+
+    // The side log's records are newer than those of the log as it was when
+    // its process started, but not necessarily than what was built since.
+    BuildLog side_log;
+    if (!side_log.Load(log_path, &err)) {
+      Error("loading build log %s: %s", log_path.c_str(), err.c_str());
+      return false;
+    }
+    set<string> merged;
+    const BuildLog::Entries& side_entries = side_log.entries();
+    for (BuildLog::Entries::const_iterator i = side_entries.begin();
+         i != side_entries.end(); ++i) {
+      const BuildLog::LogEntry* entry = build_log_.LookupByOutput(i->second->output);
+      if (entry && entry->mtime > i->second->mtime)
+        continue;
+      if (!build_log_.RecordEntry(*i->second)) {
+        Error("writing build log: %s", strerror(errno));
+        return false;
+      }
+      merged.insert(i->second->output);
+    }
+
+    // As in -t importlog, the side log's ids are its own.
+    State side_state;
+    DepsLog side_deps;
+    err.clear();
+    if (!side_deps.Load(deps_path, &side_state, &err)) {
+      Error("loading deps log %s: %s", deps_path.c_str(), err.c_str());
+      return false;
+    }
+    const vector<Node*>& side_nodes = side_deps.nodes();
+    const vector<DepsLog::Deps*>& side_records = side_deps.deps();
+    vector<Node*> inputs;
+    for (size_t id = 0; id < side_records.size(); ++id) {
+      DepsLog::Deps* deps = side_records[id];
+      if (!deps)
+        continue;
+      Node* node = state_.LookupNode(side_nodes[id]->path());
+      if (!node)
+        continue;
+      DepsLog::Deps* existing = deps_log_.GetDeps(node);
+      if (existing && existing->mtime > deps->mtime)
+        continue;
+      inputs.clear();
+      for (int i = 0; i < deps->node_count; ++i) {
+        inputs.push_back(state_.GetNode(deps->nodes[i]->path(),
+                                        &state_.bindings_, 0));
+      }
+      if (!deps_log_.RecordDeps(node, deps->mtime, inputs)) {
+        Error("writing deps log: %s", strerror(errno));
+        return false;
+      }
+    }
+
+    DigestLog side_digests;
+    err.clear();
+    if (!side_digests.Load(digests_path, &err)) {
+      Error("loading digest log %s: %s", digests_path.c_str(), err.c_str());
+      return false;
+    }
+    if (!digest_log_.Merge(side_digests, merged)) {
+      Error("writing digest log: %s", strerror(errno));
+      return false;
+    }
+
+    // Only let go of the side logs once what they hold is on disk.
+    if (!build_log_.Flush() || !deps_log_.Flush() || !digest_log_.Flush()) {
+      Error("writing logs: %s", strerror(errno));
+      return false;
+    }
+    disk_interface_.RemoveFile(log_path);
+    disk_interface_.RemoveFile(deps_path);
+    disk_interface_.RemoveFile(digests_path);
+  }
+  return true;
+}
+
+/// Lets a RealDiskInterface cache stat information while in scope.  Once
+/// the build is over files may change again, so the cache goes with it.
+/// A NULL |disk| keeps a cache that is already there.
+struct ScopedStatCache {
+  ScopedStatCache(RealDiskInterface* disk, bool allow) : disk_(disk) {
+    if (disk_)
+      disk_->AllowStatCache(allow);
+  }
+  ~ScopedStatCache() {
+    if (disk_)
+      disk_->AllowStatCache(false);
+  }
+
+ private:
+  RealDiskInterface* disk_;
+};
+
 int NinjaMain::RunBuild(int argc, char** argv) {
   string err;
   vector<Node*> targets;
@@ -1122,9 +2322,31 @@ int NinjaMain::RunBuild(int argc, char** argv) {
     return 1;
   }
 
-  disk_interface_.AllowStatCache(g_experimental_statcache);
+  // The builder drops what is cached about the files its commands write.
+  ScopedStatCache stat_cache(keep_stat_cache_ ? NULL : &disk_interface_,
+                             g_experimental_statcache);
+
+  LazyDiskInterface lazy_disk(&disk_interface_, &digest_log_);
+  bool lazy = config_.lazy_outputs && config_.action_cache && !config_.dry_run;
+  Builder builder(&state_, config_, &build_log_, &deps_log_,
+                  lazy ? &lazy_disk : (DiskInterface*)&disk_interface_);
+  builder.SetDigestLog(&digest_log_);
+  if (lazy)
+    builder.SetLazyOutputs(&lazy_disk);
+
+  // What an earlier build left to run is taken to be dirty still, and
+  // what this one leaves is written for the next.
+  string resume_path = ".ninja_resume";
+  if (!build_dir_.empty())
+    resume_path = build_dir_ + "/" + resume_path;
+  ResumeLog resume_log;
+  if (!resume_log.Load(resume_path, &state_, &disk_interface_, &err)) {
+    Error("loading %s: %s", resume_path.c_str(), err.c_str());
+    return 1;
+  }
+  builder.SetResumeLog(&resume_log);
+  bool write_resume = !config_.dry_run && build_dir_lock_.owns_logs();
 
-  Builder builder(&state_, config_, &build_log_, &deps_log_, &disk_interface_);
   for (size_t i = 0; i < targets.size(); ++i) {
     if (!builder.AddTarget(targets[i], &err)) {
       if (!err.empty()) {
@@ -1137,15 +2359,21 @@ int NinjaMain::RunBuild(int argc, char** argv) {
     }
   }
 
-  // Make sure restat rules do not see stale timestamps.
-  disk_interface_.AllowStatCache(false);
-
   if (builder.AlreadyUpToDate()) {
+    if (write_resume &&
+        !WriteResumeLog(resume_log, resume_path, builder.plan_))
+      return 1;
+    if (lazy && !MaterializeTargets(&lazy_disk, targets))
+      return 1;
     printf("ninja: no work to do.\n");
     return 0;
   }
 
-  if (!builder.Build(&err)) {
+  bool built = builder.Build(&err);
+  loop_profile_ = builder.loop_profile();
+  if (write_resume && !WriteResumeLog(resume_log, resume_path, builder.plan_))
+    return 1;
+  if (!built) {
     printf("ninja: build stopped: %s.\n", err.c_str());
     if (err.find("interrupted by user") != string::npos) {
       return 2;
@@ -1153,9 +2381,380 @@ int NinjaMain::RunBuild(int argc, char** argv) {
     return 1;
   }
 
+  if (lazy && !MaterializeTargets(&lazy_disk, targets))
+    return 1;
   return 0;
 }
 
+bool NinjaMain::WriteResumeLog(const ResumeLog& log, const string& path,
+                               const Plan& plan) {
+  string err;
+  if (!log.Write(path, plan, &disk_interface_, &err)) {
+    Error("%s", err.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool NinjaMain::MaterializeTargets(LazyDiskInterface* lazy,
+                                   const vector<Node*>& targets) {
+  // The files asked for are written out, but not those behind a phony
+  // target such as "all", which would leave nothing promised.
+  for (vector<Node*>::const_iterator n = targets.begin(); n != targets.end();
+       ++n) {
+    string err;
+    if ((*n)->in_edge() && (*n)->in_edge()->is_phony())
+      continue;
+    if (!lazy->Materialize((*n)->path(), &err)) {
+      Error("%s", err.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+#ifndef _WIN32
+/// Keeps the daemon's stat cache from one request to the next: the
+/// directories that it knows anything of are watched, and what changed in
+/// them is dropped from it before the next build looks.
+struct StatJournal {
+  explicit StatJournal(RealDiskInterface* disk)
+      : disk_(disk), watcher_(disk) {}
+
+  /// Whether the cache can be kept, which needs inotify.
+  bool active() const { return !watcher_.polling(); }
+
+  /// Drop from the cache what changed since the last call.  Sets
+  /// |*quiet| if nothing did.  Returns false if changes can't be told
+  /// anymore, when the cache must go.
+  bool Update(bool* quiet, string* err) {
+    vector<string> changed, lost_dirs;
+    bool overflowed = false;
+    if (!watcher_.TakeChanges(&changed, &lost_dirs, &overflowed, err))
+      return false;
+    for (vector<string>::iterator i = changed.begin(); i != changed.end(); ++i)
+      disk_->Invalidate(*i);
+    disk_->InvalidateDirs(lost_dirs);
+    if (overflowed)
+      disk_->AllowStatCache(true);  // Which starts it over.
+    *quiet = changed.empty() && lost_dirs.empty() && !overflowed;
+    return true;
+  }
+
+  /// Watch the directories the cache knows of after a build.  Sets
+  /// |*settled| if all of them were already, as what is known of the
+  /// others may have changed before they were, and is dropped.  Returns
+  /// false if they can't be watched, when the cache must go.
+  bool WatchCached(bool* settled) {
+    set<string> dirs;
+    vector<string> fresh;
+    disk_->CachedDirs(&dirs);
+    if (!watcher_.WatchDirectories(dirs, &fresh))
+      return false;
+    disk_->InvalidateDirs(fresh);
+    *settled = fresh.empty();
+    return true;
+  }
+
+ private:
+  RealDiskInterface* disk_;
+  FileWatcher watcher_;
+};
+
+/// Serves one daemon request: runs the build with the client's stdout and
+/// stderr.  Sets |*reload| if the loaded state must be thrown away.  If
+/// |known_clean|, nothing changed since a build of the same targets found
+/// them up to date, and there is no need to look again.
+int ServeDaemonRequest(NinjaMain* ninja, const Options* options,
+                       const GraphSnapshot& snapshot,
+                       const DaemonRequest& request, bool known_clean,
+                       bool* reload) {
+  string cwd, err;
+  if (ninja->disk_interface_.Getcwd(&cwd, &err) != FileReader::Okay ||
+      cwd != request.cwd) {
+    Error("daemon serves '%s', not '%s'", cwd.c_str(), request.cwd.c_str());
+    return 1;
+  }
+
+  if (ninja->manifest_files_.AnyChanged()) {
+    *reload = true;
+    return kDaemonRestarting;
+  }
+
+  if (known_clean) {
+    printf("ninja: no work to do.\n");
+    return 0;
+  }
+
+  snapshot.Restore(&ninja->state_);
+  ninja->state_.Reset();
+  if (ninja->RebuildManifest(options->input_file, &err)) {
+    *reload = true;
+    return kDaemonRestarting;
+  } else if (!err.empty()) {
+    Error("rebuilding '%s': %s", options->input_file, err.c_str());
+    return 1;
+  }
+
+  vector<char*> args;
+  for (vector<string>::const_iterator i = request.args.begin();
+       i != request.args.end(); ++i)
+    args.push_back(const_cast<char*>(i->c_str()));
+  args.push_back(NULL);
+  snapshot.Restore(&ninja->state_);
+  ninja->state_.Reset();
+  int status = ninja->RunBuild((int)request.args.size(), &args[0]);
+  if (g_metrics)
+    ninja->DumpMetrics();
+  if (g_trace)
+    ninja->WriteTrace();
+  // Loaded dyndep files edit the graph beyond what the snapshot can undo.
+  if (snapshot.uses_dyndep())
+    *reload = true;
+  return status;
+}
+
+/// Replace the current process with a fresh copy of itself, as it was
+/// started.
+NORETURN void Restart() {
+  if (!g_start_dir.empty() && chdir(g_start_dir.c_str()) < 0)
+    Fatal("chdir to '%s' - %s", g_start_dir.c_str(), strerror(errno));
+  vector<char*> argv;
+  for (vector<string>::iterator i = g_start_argv.begin();
+       i != g_start_argv.end(); ++i)
+    argv.push_back(const_cast<char*>(i->c_str()));
+  argv.push_back(NULL);
+  execvp(argv[0], &argv[0]);
+  Fatal("restarting %s: %s", argv[0], strerror(errno));
+}
+
+int NinjaMain::ToolDaemon(const Options* options, int argc, char* argv[]) {
+  // The daemon tool uses getopt, and expects argv[0] to contain the name of
+  // the tool, i.e. "daemon".
+  argc++;
+  argv--;
+
+  string socket_path = ".ninja_daemon";
+  optind = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, const_cast<char*>("hs:"))) != -1) {
+    switch (opt) {
+    case 's':
+      socket_path = optarg;
+      break;
+    case 'h':
+    default:
+      printf("usage: ninja -t daemon [options]\n"
+"\n"
+"keep the loaded manifest and logs in memory and build targets requested\n"
+"with 'ninja -t client'.\n"
+"\n"
+"options:\n"
+"  -s SOCKET  listen on SOCKET [default=.ninja_daemon]\n"
+             );
+    return 1;
+    }
+  }
+
+  DaemonServer server;
+  string err;
+  if (!server.Listen(socket_path, &err)) {
+    Error("%s", err.c_str());
+    return 1;
+  }
+
+  // With the files changed in between known, what was statted for one
+  // build holds for the next, and a build of the same targets that found
+  // nothing to do needn't look again while nothing changes.
+  StatJournal journal(&disk_interface_);
+  if (journal.active() && g_experimental_statcache) {
+    disk_interface_.AllowStatCache(true);
+    keep_stat_cache_ = true;
+  }
+  bool clean = false;
+  vector<string> clean_args;
+
+  GraphSnapshot snapshot;
+  snapshot.Capture(state_);
+  for (;;) {
+    DaemonRequest request;
+    if (!server.Accept(&request, &err)) {
+      Warning("daemon: %s", err.c_str());
+      continue;
+    }
+
+    bool quiet = false;
+    if (keep_stat_cache_ && !journal.Update(&quiet, &err)) {
+      Warning("daemon: %s; not keeping stat information", err.c_str());
+      disk_interface_.AllowStatCache(false);
+      keep_stat_cache_ = false;
+    }
+    bool known_clean = keep_stat_cache_ && quiet && clean &&
+        request.args == clean_args;
+
+    // Run the build with the client's output in place of ours.
+    fflush(stdout);
+    fflush(stderr);
+    int saved_stdout = dup(1), saved_stderr = dup(2);
+    dup2(request.stdout_fd, 1);
+    dup2(request.stderr_fd, 2);
+    bool reload = false;
+    int status = ServeDaemonRequest(this, options, snapshot, request,
+                                    known_clean, &reload);
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_stdout, 1);
+    dup2(saved_stderr, 2);
+    close(saved_stdout);
+    close(saved_stderr);
+
+    // Anything the build itself changed, such as its outputs, shows up as
+    // changes, and the targets are clean only if there were none.
+    clean = false;
+    if (keep_stat_cache_) {
+      bool settled = false;
+      quiet = false;
+      if (!journal.WatchCached(&settled) || !journal.Update(&quiet, &err)) {
+        disk_interface_.AllowStatCache(false);
+        keep_stat_cache_ = false;
+      }
+      clean = keep_stat_cache_ && status == 0 && settled && quiet && !reload;
+      clean_args = request.args;
+    }
+
+    server.Reply(&request, status);
+    if (reload) {
+      server.Close();
+      Restart();
+    }
+  }
+}
+
+/// Whether the watch mode should wait for changes to |node|: a source file
+/// read to build the targets, including the headers found in depfiles.
+/// Those first recorded by the last build were not scanned yet, and have
+/// no out-edges until they are.
+bool IsWatchedSource(const Node* node) {
+  const Edge* edge = node->in_edge();
+  if (!edge)
+    return node->status_known() || node->out_edges().empty();
+  return node->status_known() && edge->is_phony() && edge->inputs_.empty();
+}
+
+int NinjaMain::RunWatch(const Options* options, int argc, char** argv) {
+  GraphSnapshot snapshot;
+  snapshot.Capture(state_);
+  FileWatcher watcher(&disk_interface_);
+  for (;;) {
+    int status = RunBuild(argc, argv);
+    if (g_metrics)
+      DumpMetrics();
+    if (status == 2)  // Interrupted.
+      return status;
+
+    vector<string> paths = manifest_files_.paths();
+    for (State::Paths::iterator i = state_.paths_.begin();
+         i != state_.paths_.end(); ++i) {
+      if (IsWatchedSource(i->second))
+        paths.push_back(i->second->path());
+    }
+    watcher.Watch(paths);
+    printf("ninja: watching %d files for changes...\n", (int)paths.size());
+    fflush(stdout);
+
+    vector<string> changed;
+    string err;
+    if (!watcher.WaitForChanges(&changed, &err)) {
+      Error("%s", err.c_str());
+      return 1;
+    }
+
+    // Loading the manifest anew is simplest done from scratch, and loaded
+    // dyndep files edit the graph beyond what the snapshot can undo.
+    if (manifest_files_.AnyChanged() || snapshot.uses_dyndep()) {
+      CloseLogs();
+      Restart();
+    }
+
+    // Scan again what changed, what depends on it, and what was out of
+    // date last time, whether it was built since or not.
+    vector<Node*> nodes;
+    for (vector<string>::iterator i = changed.begin(); i != changed.end();
+         ++i) {
+      if (Node* node = state_.LookupNode(*i))
+        nodes.push_back(node);
+    }
+    for (State::Paths::iterator i = state_.paths_.begin();
+         i != state_.paths_.end(); ++i) {
+      if (i->second->dirty())
+        nodes.push_back(i->second);
+    }
+    vector<Edge*> edges;
+    state_.ResetDependents(nodes, &edges);
+    for (vector<Edge*>::iterator e = edges.begin(); e != edges.end(); ++e)
+      snapshot.RestoreEdge(*e);
+
+    // The manifest may need regenerating first.
+    Node* manifest = state_.LookupNode(options->input_file);
+    if (manifest && manifest->in_edge() &&
+        manifest->in_edge()->mark_ == Edge::VisitNone) {
+      CloseLogs();
+      Restart();
+    }
+  }
+}
+
+int NinjaMain::ToolClient(const Options* options, int argc, char* argv[]) {
+  // The client tool uses getopt, and expects argv[0] to contain the name of
+  // the tool, i.e. "client".
+  argc++;
+  argv--;
+
+  string socket_path = ".ninja_daemon";
+  optind = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, const_cast<char*>("hs:"))) != -1) {
+    switch (opt) {
+    case 's':
+      socket_path = optarg;
+      break;
+    case 'h':
+    default:
+      printf("usage: ninja -t client [options] [targets]\n"
+"\n"
+"ask a running 'ninja -t daemon' to build targets.\n"
+"\n"
+"options:\n"
+"  -s SOCKET  connect to SOCKET [default=.ninja_daemon]\n"
+             );
+    return 1;
+    }
+  }
+  vector<string> targets(argv + optind, argv + argc);
+
+  // A restarting daemon takes a while to load the manifest again.
+  const int kMaxAttempts = 600;
+  bool restarting = false;
+  for (int attempt = 0; attempt < kMaxAttempts; ++attempt) {
+    string err;
+    int status = RunDaemonRequest(socket_path, targets, &err);
+    if (status == kDaemonRestarting) {
+      restarting = true;
+      continue;
+    }
+    if (status >= 0)
+      return status;
+    if (!restarting) {
+      Error("%s", err.c_str());
+      return 1;
+    }
+    usleep(100 * 1000);
+  }
+  Error("daemon at '%s' did not come back", socket_path.c_str());
+  return 1;
+}
+#endif  // _WIN32
+
 #ifdef _MSC_VER
 
 /// This handler processes fatal crashes that you can't catch
@@ -1185,17 +2784,33 @@ int ReadFlags(int* argc, char*** argv,
               Options* options, BuildConfig* config) {
   config->parallelism = GuessParallelism();
 
-  enum { OPT_VERSION = 1 };
+  enum { OPT_VERSION = 1, OPT_JOBSERVER = 2, OPT_ACTION_CACHE = 3,
+         OPT_REMOTE = 4, OPT_SPAWNER = 5, OPT_SCHEDULE = 6, OPT_WATCH = 7,
+         OPT_SPECULATE = 8, OPT_CRITICAL_RESERVE = 9,
+         OPT_LAZY_OUTPUTS = 10, OPT_AFFINITY = 11, OPT_CPU_PRESSURE = 12,
+         OPT_STATUS_FD = 13 };
   const option kLongOptions[] = {
     { "help", no_argument, NULL, 'h' },
     { "version", no_argument, NULL, OPT_VERSION },
+    { "jobserver", no_argument, NULL, OPT_JOBSERVER },
+    { "action-cache", required_argument, NULL, OPT_ACTION_CACHE },
+    { "remote", required_argument, NULL, OPT_REMOTE },
+    { "spawner", no_argument, NULL, OPT_SPAWNER },
+    { "schedule", required_argument, NULL, OPT_SCHEDULE },
+    { "watch", no_argument, NULL, OPT_WATCH },
+    { "speculate", no_argument, NULL, OPT_SPECULATE },
+    { "critical-reserve", required_argument, NULL, OPT_CRITICAL_RESERVE },
+    { "lazy-outputs", no_argument, NULL, OPT_LAZY_OUTPUTS },
+    { "affinity", required_argument, NULL, OPT_AFFINITY },
+    { "cpu-pressure", required_argument, NULL, OPT_CPU_PRESSURE },
+    { "status-fd", required_argument, NULL, OPT_STATUS_FD },
     { "verbose", no_argument, NULL, 'v' },
     { NULL, 0, NULL, 0 }
   };
 
   int opt;
   while (!options->tool &&
-         (opt = getopt_long(*argc, *argv, "d:f:j:k:l:nt:vw:C:h", kLongOptions,
+         (opt = getopt_long(*argc, *argv, "d:f:j:k:l:m:nt:vw:C:h", kLongOptions,
                             NULL)) != -1) {
     switch (opt) {
       case 'd':
@@ -1214,6 +2829,7 @@ int ReadFlags(int* argc, char*** argv,
         // We want to run N jobs in parallel. For N = 0, INT_MAX
         // is close enough to infinite for most sane builds.
         config->parallelism = value > 0 ? value : INT_MAX;
+        options->parallelism_set = true;
         break;
       }
       case 'k': {
@@ -1236,6 +2852,14 @@ int ReadFlags(int* argc, char*** argv,
         config->max_load_average = value;
         break;
       }
+      case 'm': {
+        char* end;
+        long value = strtol(optarg, &end, 10);
+        if (*end != 0 || value < 0)
+          Fatal("invalid -m parameter");
+        config->min_available_memory = (int64_t)value << 20;
+        break;
+      }
       case 'n':
         config->dry_run = true;
         break;
@@ -1257,6 +2881,74 @@ int ReadFlags(int* argc, char*** argv,
       case OPT_VERSION:
         printf("%s\n", kNinjaVersion);
         return 0;
+      case OPT_JOBSERVER:
+        options->serve_jobs = true;
+        break;
+      case OPT_ACTION_CACHE:
+        options->action_cache_dir = optarg;
+        break;
+      case OPT_REMOTE:
+        options->remote_launcher = optarg;
+        break;
+      case OPT_SPAWNER:
+        options->spawner = true;
+        break;
+      case OPT_SCHEDULE:
+        if (string(optarg) == "critical_path") {
+          config->scheduling = EdgePriorityQueue::kCriticalPath;
+        } else if (string(optarg) == "subprojects") {
+          config->scheduling = EdgePriorityQueue::kRoundRobinSubprojects;
+        } else if (string(optarg) == "pools") {
+          config->scheduling = EdgePriorityQueue::kRoundRobinPools;
+        } else {
+          Fatal("unknown scheduling policy '%s'", optarg);
+        }
+        break;
+      case OPT_WATCH:
+        options->watch = true;
+        break;
+      case OPT_SPECULATE:
+        config->speculate = true;
+        break;
+      case OPT_LAZY_OUTPUTS:
+        config->lazy_outputs = true;
+        break;
+      case OPT_AFFINITY:
+        if (string(optarg) == "numa") {
+          config->affinity = CpuPlacer::kNuma;
+        } else if (string(optarg) == "cores") {
+          config->affinity = CpuPlacer::kCores;
+        } else if (string(optarg) == "none") {
+          config->affinity = CpuPlacer::kNone;
+        } else {
+          Fatal("unknown affinity policy '%s'", optarg);
+        }
+        break;
+      case OPT_CPU_PRESSURE: {
+        char* end;
+        double value = strtod(optarg, &end);
+        if (end == optarg || *end != 0 || value < 0 || value > 100)
+          Fatal("invalid --cpu-pressure parameter");
+        config->max_cpu_pressure = value / 100;
+        break;
+      }
+      case OPT_STATUS_FD: {
+        char* end;
+        long value = strtol(optarg, &end, 10);
+        if (end == optarg || *end != 0 || value < 0)
+          Fatal("invalid --status-fd parameter");
+        options->status_events = true;
+        options->status_fd = (int)value;
+        break;
+      }
+      case OPT_CRITICAL_RESERVE: {
+        char* end;
+        long value = strtol(optarg, &end, 10);
+        if (*end != 0 || value < 0)
+          Fatal("invalid --critical-reserve parameter");
+        config->critical_reserve = (int)value;
+        break;
+      }
       case 'h':
       default:
         Usage(*config);
@@ -1279,17 +2971,46 @@ NORETURN void real_main(int argc, char** argv) {
 
   setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
   const char* ninja_command = argv[0];
+  g_start_argv.assign(argv, argv + argc);
 
   int exit_code = ReadFlags(&argc, &argv, &options, &config);
   if (exit_code >= 0)
     exit(exit_code);
 
+#ifndef _WIN32
+  // A dry run into a pipe or file prints a line for every edge, which is
+  // better written in large blocks than a line at a time.
+  if (config.dry_run && !isatty(1))
+    setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+#endif
+
   if (options.depfile_distinct_target_lines_should_err) {
     config.depfile_parser_options.depfile_distinct_target_lines_action_ =
         kDepfileDistinctTargetLinesActionError;
   }
 
+  // Share parallelism with make: join the jobserver of a make that runs us,
+  // unless -j says otherwise, or become one for the commands we run.
+  Jobserver jobserver;
+  string jobserver_err;
+  const char* makeflags = getenv("MAKEFLAGS");
+  if (!options.parallelism_set && makeflags &&
+      jobserver.Connect(makeflags, &jobserver_err)) {
+    config.parallelism = INT_MAX;
+    config.jobserver = &jobserver;
+  } else if (!jobserver_err.empty()) {
+    Warning("%s; not using the jobserver", jobserver_err.c_str());
+  }
+  if (options.serve_jobs && !config.jobserver) {
+    if (jobserver.Serve(config.parallelism, &jobserver_err))
+      config.jobserver = &jobserver;
+    else
+      Warning("%s; not serving jobs", jobserver_err.c_str());
+  }
+
   if (options.working_dir) {
+    string err;
+    RealDiskInterface().Getcwd(&g_start_dir, &err);
     // The formatting of this string, complete with funny quotes, is
     // so Emacs can properly identify that the cwd has changed for
     // subsequent commands.
@@ -1302,6 +3023,30 @@ NORETURN void real_main(int argc, char** argv) {
     }
   }
 
+  // A relative cache directory is taken from the directory we build in.
+  ActionCache action_cache(options.action_cache_dir ?
+                           options.action_cache_dir : "");
+  if (options.action_cache_dir)
+    config.action_cache = &action_cache;
+  RealDiskInterface remote_disk_interface;
+  RemoteLauncher remote(options.remote_launcher ? options.remote_launcher : "",
+                        &remote_disk_interface);
+  if (options.remote_launcher)
+    config.remote = &remote;
+  FILE* status_file = NULL;
+  if (options.status_events) {
+#ifdef _WIN32
+    status_file = _fdopen(options.status_fd, "wb");
+#else
+    status_file = fdopen(options.status_fd, "w");
+#endif
+    if (!status_file)
+      Fatal("--status-fd %d: %s", options.status_fd, strerror(errno));
+  }
+  StatusEventWriter status_events(status_file);
+  if (status_file)
+    config.observer = &status_events;
+
   if (options.tool && options.tool->when == Tool::RUN_AFTER_FLAGS) {
     // None of the RUN_AFTER_FLAGS actually use a NinjaMain, but it's needed
     // by other tools.
@@ -1309,6 +3054,23 @@ NORETURN void real_main(int argc, char** argv) {
     exit((ninja.*options.tool->func)(&options, argc, argv));
   }
 
+#ifdef _WIN32
+  if (options.watch)
+    Fatal("--watch is not supported on Windows");
+#endif
+
+  // Fork the spawner while ninja is still small, after the jobserver and
+  // the working directory are set up for the commands it runs.
+  if (options.spawner) {
+#ifdef _WIN32
+    Warning("--spawner is not supported on Windows; ignoring");
+#else
+    string err;
+    if (!SubprocessSet::StartSpawner(&err))
+      Warning("%s; spawning commands directly", err.c_str());
+#endif
+  }
+
   // Limit number of rebuilds, to prevent infinite loops.
   const int kCycleLimit = 100;
   for (int cycle = 1; cycle <= kCycleLimit; ++cycle) {
@@ -1321,24 +3083,72 @@ NORETURN void real_main(int argc, char** argv) {
     if (options.phony_cycle_should_err) {
       parser_opts.phony_cycle_action_ = kPhonyCycleActionError;
     }
-    ManifestParser parser(&ninja.state_, &ninja.disk_interface_, parser_opts);
+    parser_opts.parallelism_ = config.parallelism;
+    FileReader* file_reader = &ninja.disk_interface_;
+#ifndef _WIN32
+    if ((options.tool && options.tool->func == &NinjaMain::ToolDaemon) ||
+        options.watch)
+      file_reader = &ninja.manifest_files_;
+#endif
+    // Tools that don't open the logs may exit before it's done.
+    if (!options.tool || options.tool->when == Tool::RUN_AFTER_LOGS)
+      ninja.PrefetchLogs();
+
     string err;
-    if (!parser.Load(options.input_file, &err)) {
-      Error("%s", err.c_str());
-      exit(1);
+    bool loaded = false;
+    bool cache_outdated = false;
+    if (g_experimental_manifest_cache) {
+      file_reader = &ninja.manifest_files_;
+      loaded = ManifestCache::Load(kManifestCachePath, options.input_file,
+                                   parser_opts, &ninja.state_,
+                                   &ninja.disk_interface_,
+                                   &ninja.manifest_files_, &cache_outdated,
+                                   &err);
+      if (!loaded && !err.empty()) {
+        // The state is half-filled; start over without the cache.
+        Warning("%s; reparsing manifest", err.c_str());
+        ninja.disk_interface_.RemoveFile(kManifestCachePath);
+        continue;
+      }
+    }
+    if (!loaded) {
+      ManifestParser parser(&ninja.state_, file_reader, parser_opts);
+      if (!parser.Load(options.input_file, &err)) {
+        Error("%s", err.c_str());
+        exit(1);
+      }
+    }
+    if (g_experimental_manifest_cache && (!loaded || cache_outdated) &&
+        !ManifestCache::Save(kManifestCachePath, options.input_file,
+                             parser_opts, ninja.state_,
+                             ninja.manifest_files_, &err)) {
+      Warning("%s", err.c_str());
+      err.clear();
     }
 
     if (options.tool && options.tool->when == Tool::RUN_AFTER_LOAD)
       exit((ninja.*options.tool->func)(&options, argc, argv));
 
-    if (!ninja.EnsureBuildDirExists())
+    if (!ninja.EnsureBuildDirExists() || !ninja.LockBuildDir())
       exit(1);
+    config.build_dir_lock =
+        ninja.build_dir_lock_.is_open() ? &ninja.build_dir_lock_ : NULL;
+    if (config.remote && !ninja.build_dir_.empty())
+      config.remote->set_files_dir(ninja.build_dir_ + "/.ninja_remote");
 
-    if (!ninja.OpenBuildLog() || !ninja.OpenDepsLog())
+    if (!ninja.OpenBuildLog() || !ninja.OpenDepsLog() ||
+        !ninja.OpenDigestLog() || !ninja.MergeSideLogs())
       exit(1);
 
-    if (options.tool && options.tool->when == Tool::RUN_AFTER_LOGS)
-      exit((ninja.*options.tool->func)(&options, argc, argv));
+    if (options.tool && options.tool->when == Tool::RUN_AFTER_LOGS) {
+      int result = (ninja.*options.tool->func)(&options, argc, argv);
+      ninja.CloseLogs();
+      exit(result);
+    }
+
+    // A plain build has no use for the out-edges of the source files it
+    // reads; watching for changes needs all of them.
+    ninja.state_.defer_dep_links_ = !options.watch;
 
     // Attempt to rebuild the manifest before building anything else
     if (ninja.RebuildManifest(options.input_file, &err)) {
@@ -1353,9 +3163,20 @@ NORETURN void real_main(int argc, char** argv) {
       exit(1);
     }
 
+#ifndef _WIN32
+    if (options.watch) {
+      int result = ninja.RunWatch(&options, argc, argv);
+      ninja.CloseLogs();
+      exit(result);
+    }
+#endif
+
     int result = ninja.RunBuild(argc, argv);
+    ninja.CloseLogs();
     if (g_metrics)
       ninja.DumpMetrics();
+    if (g_trace)
+      ninja.WriteTrace();
     exit(result);
   }
 
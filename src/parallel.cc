@@ -0,0 +1,216 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "parallel.h"
+
+#ifdef NINJA_HAVE_THREADS
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif
+
+#include "util.h"
+
+namespace {
+
+#ifdef NINJA_HAVE_THREADS
+/// Hands out item indices to worker threads one at a time.
+struct Dispatcher {
+  Dispatcher(ParallelTask* task, size_t count)
+      : task_(task), count_(count), next_(0) {}
+
+  void Work() {
+    for (;;) {
+      size_t index = next_.fetch_add(1);
+      if (index >= count_)
+        return;
+      task_->Run(index);
+    }
+  }
+
+  ParallelTask* task_;
+  size_t count_;
+  std::atomic<size_t> next_;
+};
+
+void RunWorker(Dispatcher* dispatcher) {
+  dispatcher->Work();
+}
+#endif
+
+}  // anonymous namespace
+
+void RunInParallel(ParallelTask* task, size_t count, int max_threads) {
+#ifdef NINJA_HAVE_THREADS
+  if (max_threads > 1 && count > 1) {
+    if ((size_t)max_threads > count)
+      max_threads = (int)count;
+    Dispatcher dispatcher(task, count);
+    std::vector<std::thread> threads;
+    threads.reserve(max_threads - 1);
+    for (int i = 1; i < max_threads; ++i)
+      threads.push_back(std::thread(RunWorker, &dispatcher));
+    dispatcher.Work();
+    for (size_t i = 0; i < threads.size(); ++i)
+      threads[i].join();
+    return;
+  }
+#endif
+  for (size_t i = 0; i < count; ++i)
+    task->Run(i);
+}
+
+int ParallelismFor(size_t count, size_t min_per_thread) {
+#ifdef NINJA_HAVE_THREADS
+  if (min_per_thread == 0)
+    min_per_thread = 1;
+  size_t wanted = count / min_per_thread;
+  size_t cpus = (size_t)GetProcessorCount();
+  if (wanted > cpus)
+    wanted = cpus;
+  return wanted > 1 ? (int)wanted : 1;
+#else
+  return 1;
+#endif
+}
+
+BackgroundThread::BackgroundThread() : task_(NULL) {
+#ifdef NINJA_HAVE_THREADS
+  done_ = false;
+#endif
+}
+
+BackgroundThread::~BackgroundThread() {
+  Join();
+}
+
+void BackgroundThread::Start(BackgroundTask* task) {
+  Join();
+  task_ = task;
+#ifdef NINJA_HAVE_THREADS
+  done_ = false;
+  thread_ = std::thread(RunTask, this);
+#else
+  task_->Run();
+#endif
+}
+
+bool BackgroundThread::Done() const {
+#ifdef NINJA_HAVE_THREADS
+  return !task_ || done_;
+#else
+  return true;
+#endif
+}
+
+void BackgroundThread::Join() {
+#ifdef NINJA_HAVE_THREADS
+  if (thread_.joinable())
+    thread_.join();
+#endif
+  task_ = NULL;
+}
+
+#ifdef NINJA_HAVE_THREADS
+// static
+void BackgroundThread::RunTask(BackgroundThread* thread) {
+  thread->task_->Run();
+  thread->done_ = true;
+}
+#endif
+
+TaskQueue::TaskQueue(int max_threads) : pending_(0) {
+#ifdef NINJA_HAVE_THREADS
+  max_threads_ = max_threads > 1 ? max_threads : 1;
+  idle_ = 0;
+  stopping_ = false;
+#endif
+}
+
+TaskQueue::~TaskQueue() {
+#ifdef NINJA_HAVE_THREADS
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  task_posted_.notify_all();
+  for (size_t i = 0; i < threads_.size(); ++i)
+    threads_[i].join();
+#endif
+}
+
+void TaskQueue::Post(BackgroundTask* task) {
+  ++pending_;
+#ifdef NINJA_HAVE_THREADS
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(task);
+    if (idle_ >= (int)queue_.size() || (int)threads_.size() >= max_threads_) {
+      task_posted_.notify_one();
+      return;
+    }
+  }
+  threads_.push_back(std::thread(RunWorker, this));
+#else
+  task->Run();
+  finished_.push_back(task);
+#endif
+}
+
+BackgroundTask* TaskQueue::NextFinished(bool wait) {
+  if (!pending_)
+    return NULL;
+#ifdef NINJA_HAVE_THREADS
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (finished_.empty()) {
+    if (!wait)
+      return NULL;
+    task_finished_.wait(lock);
+  }
+#endif
+  BackgroundTask* task = finished_.front();
+  finished_.pop_front();
+  --pending_;
+  return task;
+}
+
+#ifdef NINJA_HAVE_THREADS
+void TaskQueue::Work() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    if (queue_.empty()) {
+      if (stopping_)
+        return;
+      ++idle_;
+      task_posted_.wait(lock);
+      --idle_;
+      continue;
+    }
+    BackgroundTask* task = queue_.front();
+    queue_.pop_front();
+    lock.unlock();
+    task->Run();
+    lock.lock();
+    finished_.push_back(task);
+    task_finished_.notify_one();
+  }
+}
+
+// static
+void TaskQueue::RunWorker(TaskQueue* queue) {
+  queue->Work();
+}
+#endif
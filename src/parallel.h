@@ -0,0 +1,160 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_PARALLEL_H_
+#define NINJA_PARALLEL_H_
+
+#include <stddef.h>
+
+#include <deque>
+
+/// Threads are only used when the standard library provides them;
+/// otherwise everything below degrades to running on the calling thread.
+#if (__cplusplus >= 201103L) || (_MSC_VER >= 1900)
+#define NINJA_HAVE_THREADS 1
+#endif
+
+#ifdef NINJA_HAVE_THREADS
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif
+
+/// A lock for state shared between the items of a ParallelTask.
+struct Mutex {
+#ifdef NINJA_HAVE_THREADS
+  void Lock() { mutex_.lock(); }
+  void Unlock() { mutex_.unlock(); }
+
+ private:
+  std::mutex mutex_;
+#else
+  void Lock() {}
+  void Unlock() {}
+#endif
+};
+
+/// Holds a Mutex for the lifetime of the object.
+struct ScopedLock {
+  explicit ScopedLock(Mutex* mutex) : mutex_(mutex) { mutex_->Lock(); }
+  ~ScopedLock() { mutex_->Unlock(); }
+
+ private:
+  Mutex* mutex_;
+};
+
+/// A batch of independent work items, identified by index, that can be
+/// processed concurrently by RunInParallel().
+struct ParallelTask {
+  virtual ~ParallelTask() {}
+
+  /// Process item |index|.  May be called from several threads at once, so
+  /// implementations must only touch state owned by that item.
+  virtual void Run(size_t index) = 0;
+};
+
+/// Call task->Run(i) for every i in [0, count), spreading the calls over at
+/// most |max_threads| threads (the calling thread included).  Returns once
+/// every item has been processed.
+void RunInParallel(ParallelTask* task, size_t count, int max_threads);
+
+/// Return the number of threads worth using for |count| items when each
+/// thread should get at least |min_per_thread| of them.
+int ParallelismFor(size_t count, size_t min_per_thread);
+
+/// Work to be done by a BackgroundThread.
+struct BackgroundTask {
+  virtual ~BackgroundTask() {}
+
+  /// Do the work.  Runs concurrently with the thread that started it, so
+  /// it must only touch state the task owns.
+  virtual void Run() = 0;
+};
+
+/// Runs a BackgroundTask on a thread of its own while the calling thread
+/// carries on.  Without threads, Start() runs the task to completion.
+struct BackgroundThread {
+  BackgroundThread();
+  ~BackgroundThread();
+
+  /// Start running |task|, which must outlive the run.
+  void Start(BackgroundTask* task);
+
+  /// Whether a task was started and hasn't been joined yet.
+  bool running() const { return task_ != NULL; }
+
+  /// Whether the running task has returned, so that Join() won't block.
+  bool Done() const;
+
+  /// Wait for the running task, if any, to return.
+  void Join();
+
+ private:
+  BackgroundTask* task_;
+#ifdef NINJA_HAVE_THREADS
+  static void RunTask(BackgroundThread* thread);
+
+  std::thread thread_;
+  std::atomic<bool> done_;
+#endif
+
+  // Not copyable.
+  BackgroundThread(const BackgroundThread&);
+  void operator=(const BackgroundThread&);
+};
+
+/// Runs BackgroundTasks on a pool of up to |max_threads| worker threads,
+/// started as they are needed, and hands the tasks back as they finish.
+/// Without threads, Post() runs the task to completion.
+struct TaskQueue {
+  explicit TaskQueue(int max_threads);
+  /// Waits for the tasks still running; tasks not taken back are leaked.
+  ~TaskQueue();
+
+  /// Queue |task| to run, which must outlive the run.
+  void Post(BackgroundTask* task);
+
+  /// Take back a task that has finished running.  Returns NULL if none is
+  /// pending, or if none has finished yet and |wait| is false.
+  BackgroundTask* NextFinished(bool wait);
+
+  /// Number of tasks posted and not taken back yet.
+  size_t pending() const { return pending_; }
+
+ private:
+  std::deque<BackgroundTask*> finished_;
+  size_t pending_;
+#ifdef NINJA_HAVE_THREADS
+  void Work();
+  static void RunWorker(TaskQueue* queue);
+
+  int max_threads_;
+  /// Number of workers waiting for a task.
+  int idle_;
+  bool stopping_;
+  std::deque<BackgroundTask*> queue_;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable task_posted_;
+  std::condition_variable task_finished_;
+#endif
+
+  // Not copyable.
+  TaskQueue(const TaskQueue&);
+  void operator=(const TaskQueue&);
+};
+
+#endif  // NINJA_PARALLEL_H_
@@ -0,0 +1,95 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "parallel.h"
+
+#include <vector>
+using namespace std;
+
+#include "test.h"
+
+namespace {
+
+struct SquareTask : public ParallelTask {
+  explicit SquareTask(size_t count) : results(count, 0) {}
+  virtual void Run(size_t index) { results[index] = (int)(index * index); }
+  vector<int> results;
+};
+
+struct CountTask : public BackgroundTask {
+  CountTask() : runs(0) {}
+  virtual void Run() { ++runs; }
+  int runs;
+};
+
+}  // anonymous namespace
+
+TEST(ParallelTest, RunsEveryItemOnce) {
+  for (int threads = 1; threads <= 8; threads *= 2) {
+    SquareTask task(1000);
+    RunInParallel(&task, task.results.size(), threads);
+    for (size_t i = 0; i < task.results.size(); ++i)
+      ASSERT_EQ((int)(i * i), task.results[i]);
+  }
+}
+
+TEST(ParallelTest, NoItems) {
+  SquareTask task(0);
+  RunInParallel(&task, 0, 4);
+  EXPECT_TRUE(task.results.empty());
+}
+
+TEST(ParallelTest, ParallelismFor) {
+  EXPECT_EQ(1, ParallelismFor(0, 16));
+  EXPECT_EQ(1, ParallelismFor(15, 16));
+  EXPECT_GE(ParallelismFor(1000000, 16), 1);
+}
+
+TEST(ParallelTest, BackgroundThread) {
+  CountTask task;
+  BackgroundThread thread;
+  EXPECT_FALSE(thread.running());
+  EXPECT_TRUE(thread.Done());
+
+  thread.Start(&task);
+  EXPECT_TRUE(thread.running());
+  thread.Join();
+  EXPECT_FALSE(thread.running());
+  EXPECT_EQ(1, task.runs);
+
+  // A thread can be reused, and joins what it ran when it goes away.
+  thread.Start(&task);
+}
+
+TEST(ParallelTest, TaskQueue) {
+  for (int threads = 1; threads <= 4; threads *= 2) {
+    TaskQueue queue(threads);
+    EXPECT_EQ(NULL, queue.NextFinished(true));
+
+    vector<CountTask> tasks(20);
+    for (size_t i = 0; i < tasks.size(); ++i)
+      queue.Post(&tasks[i]);
+    EXPECT_EQ(tasks.size(), queue.pending());
+
+    // Every task comes back once, having run once.
+    size_t finished = 0;
+    while (BackgroundTask* task = queue.NextFinished(true)) {
+      EXPECT_EQ(1, static_cast<CountTask*>(task)->runs);
+      ++finished;
+    }
+    EXPECT_EQ(tasks.size(), finished);
+    EXPECT_EQ(0u, queue.pending());
+    EXPECT_EQ(NULL, queue.NextFinished(false));
+  }
+}
@@ -15,13 +15,21 @@
 #include "parser.h"
 
 #include "disk_interface.h"
+#include "mapped_file.h"
 #include "metrics.h"
+#include "trace.h"
 
 bool Parser::Load(const string& filename, string* err, Lexer* parent) {
+  MappedFile contents;
+  return Load(filename, &contents, err, parent);
+}
+
+bool Parser::Load(const string& filename, MappedFile* contents, string* err,
+                  Lexer* parent) {
   METRIC_RECORD(".ninja parse");
-  string contents;
+  TRACE_PHASE(".ninja parse");
   string read_err;
-  if (file_reader_->ReadFile(filename, &contents, &read_err) !=
+  if (file_reader_->ReadFileTerminated(filename, contents, &read_err) !=
       FileReader::Okay) {
     *err = "loading '" + filename + "': " + read_err;
     if (parent)
@@ -29,14 +37,11 @@ bool Parser::Load(const string& filename, string* err, Lexer* parent) {
     return false;
   }
 
-  // The lexer needs a nul byte at the end of its input, to know when it's done.
-  // It takes a StringPiece, and StringPiece's string constructor uses
-  // string::data().  data()'s return value isn't guaranteed to be
-  // null-terminated (although in practice - libc++, libstdc++, msvc's stl --
-  // it is, and C++11 demands that too), so add an explicit nul byte.
-  contents.resize(contents.size() + 1);
-
-  return Parse(filename, contents, err);
+  // The lexer needs a nul byte at the end of its input, to know when it's
+  // done, which ReadFileTerminated() provides.  The lexer's tokens point
+  // into |contents|, which is mapped rather than copied when it can be.
+  return Parse(filename, StringPiece(contents->data(), contents->size() + 1),
+               err);
 }
 
 bool Parser::ExpectToken(Lexer::Token expected, string* err) {
@@ -22,6 +22,7 @@ using namespace std;
 #include "lexer.h"
 
 struct FileReader;
+struct MappedFile;
 struct State;
 
 /// Base class for parsers.
@@ -32,6 +33,11 @@ struct Parser {
   /// Load and parse a file.
   bool Load(const string& filename, string* err, Lexer* parent = NULL);
 
+  /// Load and parse a file into |contents|, for parsers that keep pointers
+  /// into it after they are done.
+  bool Load(const string& filename, MappedFile* contents, string* err,
+            Lexer* parent = NULL);
+
 protected:
   /// If the next token is not \a expected, produce an error string
   /// saying "expected foo, got bar".
@@ -42,8 +48,8 @@ protected:
   Lexer lexer_;
 
 private:
-  /// Parse a file, given its contents as a string.
-  virtual bool Parse(const string& filename, const string& input,
+  /// Parse a file, given its contents, which a nul byte must follow.
+  virtual bool Parse(const string& filename, StringPiece input,
                      string* err) = 0;
 };
 
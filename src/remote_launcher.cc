@@ -0,0 +1,83 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "remote_launcher.h"
+
+#include <stdio.h>
+
+#include "disk_interface.h"
+#include "graph.h"
+#include "state.h"
+#include "util.h"
+
+namespace {
+
+void AppendEscaped(const string& arg, string* command) {
+#ifdef _WIN32
+  GetWin32EscapedString(arg, command);
+#else
+  GetShellEscapedString(arg, command);
+#endif
+}
+
+}  // anonymous namespace
+
+// static
+bool RemoteLauncher::RunsLocally(const Edge* edge) {
+  // The console pool is local_only too.
+  return edge->pool()->local_only();
+}
+
+bool RemoteLauncher::WrapCommand(const Edge* edge, string* command,
+                                 string* err) {
+  string files;
+  for (vector<Node*>::const_iterator i = edge->inputs_.begin();
+       i != edge->inputs_.end(); ++i) {
+    // Phony inputs and missing order-only ones aren't files to send.
+    if ((*i)->exists())
+      files += "in " + (*i)->path() + "\n";
+  }
+  string rspfile = edge->GetUnescapedRspfile();
+  if (!rspfile.empty())
+    files += "in " + edge->env_->ApplyChdir(rspfile) + "\n";
+  for (vector<Node*>::const_iterator o = edge->outputs_.begin();
+       o != edge->outputs_.end(); ++o)
+    files += "out " + (*o)->path() + "\n";
+  string depfile = edge->GetUnescapedDepfile();
+  if (!depfile.empty())
+    files += "out " + edge->env_->ApplyChdir(depfile) + "\n";
+
+  string path = FilesPath(edge);
+  if (!disk_interface_->MakeDirs(path) ||
+      !disk_interface_->WriteFile(path, files)) {
+    *err = "writing " + path;
+    return false;
+  }
+
+  *command = launcher_ + " ";
+  AppendEscaped(path, command);
+  *command += " ";
+  AppendEscaped(edge->EvaluateCommand(), command);
+  return true;
+}
+
+void RemoteLauncher::CommandFinished(const Edge* edge) {
+  disk_interface_->RemoveFile(FilesPath(edge));
+}
+
+string RemoteLauncher::FilesPath(const Edge* edge) const {
+  char name[32];
+  snprintf(name, sizeof(name), "/%d.files", edge->id());
+  return files_dir_ + name;
+}
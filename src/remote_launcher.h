@@ -0,0 +1,69 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_REMOTE_LAUNCHER_H_
+#define NINJA_REMOTE_LAUNCHER_H_
+
+#include <string>
+using namespace std;
+
+struct DiskInterface;
+struct Edge;
+
+/// Runs the commands of edges on other machines, through a launcher
+/// command that knows how to reach them: a client of a remote execution
+/// service, or a script around ssh.  The command of an edge becomes
+///   <launcher> <files> <command>
+/// where <command> is the edge's command as a single argument, and <files>
+/// is the path of a list of the files the command reads, which the launcher
+/// has to make available remotely, and of the files it writes, which it
+/// has to bring back.  Its lines are
+///   in <path>
+///   out <path>
+/// with the paths relative to the directory Ninja runs in.  The inputs are
+/// those the edge is known to have, including the ones its deps log or
+/// depfile recorded the last time it ran.
+///
+/// Since the commands don't use this machine's processors, -j can go as
+/// high as the remote side allows.  The edges of pools that set
+/// "local_only", and those of the console pool, still run here, limited
+/// by their pools' depths.
+struct RemoteLauncher {
+  RemoteLauncher(const string& launcher, DiskInterface* disk_interface)
+      : launcher_(launcher), files_dir_(".ninja_remote"),
+        disk_interface_(disk_interface) {}
+
+  /// Where to write the lists of files, which is only created once one is
+  /// written.
+  void set_files_dir(const string& dir) { files_dir_ = dir; }
+
+  /// Whether |edge| has to run on this machine.
+  static bool RunsLocally(const Edge* edge);
+
+  /// Write the list of the files of |edge| and set |command| to the command
+  /// that runs it through the launcher.
+  bool WrapCommand(const Edge* edge, string* command, string* err);
+
+  /// Remove the list of the files of |edge|, whose command finished.
+  void CommandFinished(const Edge* edge);
+
+ private:
+  string FilesPath(const Edge* edge) const;
+
+  string launcher_;
+  string files_dir_;
+  DiskInterface* disk_interface_;
+};
+
+#endif  // NINJA_REMOTE_LAUNCHER_H_
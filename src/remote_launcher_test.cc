@@ -0,0 +1,81 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "remote_launcher.h"
+
+#include "graph.h"
+#include "state.h"
+#include "test.h"
+
+namespace {
+
+struct RemoteLauncherTest : public StateTestWithBuiltinRules {
+  RemoteLauncherTest() : launcher_("rexec --fast", &fs_) {
+    launcher_.set_files_dir("build/.ninja_remote");
+  }
+
+  VirtualFileSystem fs_;
+  RemoteLauncher launcher_;
+};
+
+TEST_F(RemoteLauncherTest, RunsLocally) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"pool link_pool\n"
+"  depth = 2\n"
+"  local_only = 1\n"
+"pool compile_pool\n"
+"  depth = 100\n"
+"build a: cat in\n"
+"build b: cat in\n"
+"  pool = link_pool\n"
+"build c: cat in\n"
+"  pool = compile_pool\n"
+"build d: cat in\n"
+"  pool = console\n"));
+  EXPECT_FALSE(RemoteLauncher::RunsLocally(GetNode("a")->in_edge()));
+  EXPECT_TRUE(RemoteLauncher::RunsLocally(GetNode("b")->in_edge()));
+  EXPECT_FALSE(RemoteLauncher::RunsLocally(GetNode("c")->in_edge()));
+  EXPECT_TRUE(RemoteLauncher::RunsLocally(GetNode("d")->in_edge()));
+}
+
+TEST_F(RemoteLauncherTest, WrapCommand) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"rule cc\n"
+"  command = cc -c $in -o $out && echo done\n"
+"  depfile = $out.d\n"
+"  rspfile = $out.rsp\n"
+"  rspfile_content = $in\n"
+"build out.o: cc in.c | gen.h || missing_dir\n"));
+  Edge* edge = GetNode("out.o")->in_edge();
+  GetNode("missing_dir")->MarkMissing();
+
+  string command, err;
+  ASSERT_TRUE(launcher_.WrapCommand(edge, &command, &err));
+  ASSERT_EQ("", err);
+  char files[32];
+  snprintf(files, sizeof(files), "build/.ninja_remote/%d.files", edge->id());
+  EXPECT_EQ(string("rexec --fast ") + files +
+            " 'cc -c in.c -o out.o && echo done'", command);
+
+  EXPECT_EQ("in in.c\n"
+            "in gen.h\n"
+            "in out.o.rsp\n"
+            "out out.o\n"
+            "out out.o.d\n", fs_.files_[files].contents);
+
+  launcher_.CommandFinished(edge);
+  EXPECT_EQ(1u, fs_.files_removed_.count(files));
+}
+
+}  // anonymous namespace
@@ -0,0 +1,192 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _WIN32
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#endif
+
+#include "resume_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#ifndef _WIN32
+#include <inttypes.h>
+#endif
+
+#include "build.h"
+#include "disk_interface.h"
+#include "graph.h"
+#include "state.h"
+#if defined(_MSC_VER) && (_MSC_VER < 1800)
+#define strtoll _strtoi64
+#endif
+
+namespace {
+
+const char kFileSignature[] = "# ninja resume v2\n";
+
+void AppendEntry(TimeStamp mtime, bool failed, const string& path,
+                 string* out) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%" PRId64 "\t", mtime);
+  *out += buf;
+  *out += failed ? "failed\t" : "left\t";
+  *out += path;
+  *out += '\n';
+}
+
+}  // anonymous namespace
+
+bool ResumeLog::Load(const string& path, State* state, DiskInterface* disk,
+                     string* err) {
+  listed_.clear();
+  mtimes_.clear();
+  failed_.clear();
+  string contents;
+  if (disk->ReadFile(path, &contents, err) != FileReader::Okay) {
+    err->clear();
+    return true;
+  }
+  if (contents.compare(0, sizeof(kFileSignature) - 1, kFileSignature) != 0)
+    return true;
+
+  for (size_t start = sizeof(kFileSignature) - 1, end;
+       start < contents.size(); start = end + 1) {
+    end = contents.find('\n', start);
+    if (end == string::npos)
+      break;  // Cut short.
+    size_t tab = contents.find('\t', start);
+    if (tab == string::npos || tab > end)
+      continue;
+    size_t status_tab = contents.find('\t', tab + 1);
+    if (status_tab == string::npos || status_tab > end)
+      continue;
+    char* mtime_end;
+    TimeStamp mtime = strtoll(contents.c_str() + start, &mtime_end, 10);
+    if (mtime_end != contents.c_str() + tab || mtime < 0)
+      continue;
+    StringPiece status(contents.data() + tab + 1, status_tab - tab - 1);
+    if (status != "failed" && status != "left")
+      continue;
+    Node* node = state->LookupNode(StringPiece(
+        contents.data() + status_tab + 1, end - status_tab - 1));
+    if (!node || !node->in_edge())
+      continue;
+    size_t index = node->index();
+    if (index >= mtimes_.size()) {
+      mtimes_.resize(index + 1, -1);
+      failed_.resize(index + 1);
+    }
+    if (mtimes_[index] < 0)
+      listed_.push_back(node);
+    mtimes_[index] = mtime;
+    failed_[index] = status == "failed";
+  }
+  return true;
+}
+
+bool ResumeLog::Write(const string& path, const Plan& plan,
+                      DiskInterface* disk, string* err) const {
+  string contents;
+  vector<bool> joined;
+  const vector<Edge*>& planned = plan.planned();
+  for (vector<Edge*>::const_iterator e = planned.begin(); e != planned.end();
+       ++e) {
+    if ((size_t)(*e)->id() >= joined.size())
+      joined.resize((*e)->id() + 1);
+    joined[(*e)->id()] = true;
+    if ((*e)->is_phony() || !plan.LeftToRun(*e))
+      continue;
+    string entries;
+    bool known = true;
+    // An edge that failed before and didn't run again hasn't been fixed.
+    bool failed = plan.Failed(*e) || Failed(*e);
+    for (vector<Node*>::iterator o = (*e)->outputs_.begin();
+         o != (*e)->outputs_.end() && known; ++o) {
+      string stat_err;
+      TimeStamp mtime = disk->Stat((*o)->path(), &stat_err);
+      known = mtime >= 0;
+      AppendEntry(mtime, failed, (*o)->path(), &entries);
+    }
+    // What can't be stat()ed is left for the next build to look at.
+    if (known)
+      contents += entries;
+  }
+
+  // Edges of other targets are still as they were, unless their outputs
+  // were seen to change.
+  for (vector<Node*>::const_iterator n = listed_.begin(); n != listed_.end();
+       ++n) {
+    const Edge* edge = (*n)->in_edge();
+    if ((size_t)edge->id() < joined.size() && joined[edge->id()])
+      continue;
+    TimeStamp mtime = Listed(*n);
+    if ((*n)->status_known() && (*n)->mtime() != mtime)
+      continue;
+    AppendEntry(mtime, failed_[(*n)->index()], (*n)->path(), &contents);
+  }
+
+  if (contents.empty()) {
+    if (disk->RemoveFile(path) < 0) {
+      *err = "removing " + path;
+      return false;
+    }
+    return true;
+  }
+  if (!disk->WriteFile(path, kFileSignature + contents)) {
+    *err = "writing " + path;
+    return false;
+  }
+  return true;
+}
+
+bool ResumeLog::LeftToRun(const Edge* edge) const {
+  if (listed_.empty() || edge->is_phony())
+    return false;
+  for (vector<Node*>::const_iterator o = edge->outputs_.begin();
+       o != edge->outputs_.end(); ++o) {
+    if (!(*o)->status_known() || Listed(*o) != (*o)->mtime())
+      return false;
+  }
+  return true;
+}
+
+bool ResumeLog::Lists(const Edge* edge) const {
+  if (listed_.empty() || edge->is_phony())
+    return false;
+  for (vector<Node*>::const_iterator o = edge->outputs_.begin();
+       o != edge->outputs_.end(); ++o) {
+    if (Listed(*o) < 0)
+      return false;
+  }
+  return true;
+}
+
+bool ResumeLog::Failed(const Edge* edge) const {
+  if (listed_.empty())
+    return false;
+  for (vector<Node*>::const_iterator o = edge->outputs_.begin();
+       o != edge->outputs_.end(); ++o) {
+    if (Listed(*o) >= 0 && failed_[(*o)->index()])
+      return true;
+  }
+  return false;
+}
+
+TimeStamp ResumeLog::Listed(const Node* node) const {
+  size_t index = node->index();
+  return index < mtimes_.size() ? mtimes_[index] : -1;
+}
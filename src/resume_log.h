@@ -0,0 +1,83 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_RESUME_LOG_H_
+#define NINJA_RESUME_LOG_H_
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "timestamp.h"
+
+struct DiskInterface;
+struct Edge;
+struct Node;
+struct Plan;
+struct State;
+
+/// The edges that a build which stopped short, interrupted or failing,
+/// left to run, with the mtimes their outputs had then.
+///
+/// Nothing made the outputs of such an edge since if they are still as
+/// they were, so it is still dirty, and the next build takes it to be
+/// without loading its deps or checking its inputs and command against the
+/// logs: resuming a long build doesn't stat every header of what is left
+/// of it again.  At worst, when what made the edge dirty was undone in the
+/// meantime, it runs when it didn't have to.
+///
+/// The edges that failed are marked as such, for the next build to start
+/// them, and what they need, ahead of the rest: a developer fixing an error
+/// sees whether the fix worked without waiting for everything else.
+///
+/// The file holds a signature line followed by a line per output,
+///   <mtime> <status> <path>
+/// separated by tabs, where <status> is "failed" or "left".
+struct ResumeLog {
+  /// Load the log at |path|, for the nodes of |state|.  A missing or
+  /// unreadable log loads as empty.
+  bool Load(const string& path, State* state, DiskInterface* disk,
+            string* err);
+
+  /// Write to |path| what |plan| left to run, with the outputs as |disk|
+  /// has them now, and what this log listed of the edges |plan| had
+  /// nothing to do with.  The file is removed if that's nothing.
+  bool Write(const string& path, const Plan& plan, DiskInterface* disk,
+             string* err) const;
+
+  /// Whether this log lists |edge|, whose outputs are stat()ed already, and
+  /// its outputs haven't changed since.
+  bool LeftToRun(const Edge* edge) const;
+
+  /// Whether this log lists every output of |edge|, whatever their mtimes.
+  bool Lists(const Edge* edge) const;
+
+  /// Whether this log lists |edge| as failed, whatever its outputs' mtimes.
+  bool Failed(const Edge* edge) const;
+
+  bool empty() const { return listed_.empty(); }
+
+ private:
+  /// The mtime this log lists for |node|, or -1 if it doesn't.
+  TimeStamp Listed(const Node* node) const;
+
+  /// The outputs listed, in the order they were.
+  vector<Node*> listed_;
+  /// By Node::index(): the mtime listed, or -1.
+  vector<TimeStamp> mtimes_;
+  /// By Node::index(): whether the edge making the node failed.
+  vector<bool> failed_;
+};
+
+#endif  // NINJA_RESUME_LOG_H_
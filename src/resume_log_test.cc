@@ -0,0 +1,177 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "resume_log.h"
+
+#include "build.h"
+#include "graph.h"
+#include "test.h"
+
+namespace {
+
+const char kSignature[] = "# ninja resume v2\n";
+
+struct ResumeLogTest : public StateTestWithBuiltinRules {
+  virtual void SetUp() {
+    ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"build mid: cat in\n"
+"build out: cat mid\n"
+"build other: cat in\n"));
+    fs_.Create("in", "");
+    fs_.Tick();
+    fs_.Create("mid", "");
+    fs_.Create("out", "");
+    fs_.Create("other", "");
+  }
+
+  /// Load |log| from |entries|, after the signature.
+  void Load(ResumeLog* log, const string& entries) {
+    fs_.Create(".ninja_resume", kSignature + entries);
+    string err;
+    ASSERT_TRUE(log->Load(".ninja_resume", &state_, &fs_, &err));
+    ASSERT_EQ("", err);
+  }
+
+  VirtualFileSystem fs_;
+};
+
+TEST_F(ResumeLogTest, Load) {
+  ResumeLog log;
+  string err;
+  EXPECT_TRUE(log.Load(".ninja_resume", &state_, &fs_, &err));
+  EXPECT_EQ("", err);
+  EXPECT_TRUE(log.empty());
+
+  fs_.Create(".ninja_resume", "# ninja resume v1\n2\tother\n");
+  EXPECT_TRUE(log.Load(".ninja_resume", &state_, &fs_, &err));
+  EXPECT_TRUE(log.empty());
+
+  // Files that aren't built, unknown statuses, and a line cut short, are
+  // left out.
+  ASSERT_NO_FATAL_FAILURE(Load(&log,
+      "2\tleft\tother\n1\tfailed\tmid\n2\tleft\tin\n2\tgone\tout\n"
+      "2\tleft\tout"));
+  EXPECT_TRUE(log.Lists(GetNode("other")->in_edge()));
+  EXPECT_FALSE(log.Failed(GetNode("other")->in_edge()));
+  EXPECT_TRUE(log.Lists(GetNode("mid")->in_edge()));
+  EXPECT_TRUE(log.Failed(GetNode("mid")->in_edge()));
+  EXPECT_FALSE(log.Lists(GetNode("out")->in_edge()));
+}
+
+TEST_F(ResumeLogTest, LeftToRunIsDirty) {
+  ResumeLog log;
+  ASSERT_NO_FATAL_FAILURE(Load(&log, "2\tleft\tother\n1\tleft\tmid\n"));
+
+  DependencyScan scan(&state_, NULL, NULL, &fs_, NULL);
+  scan.set_resume_log(&log);
+  string err;
+  EXPECT_TRUE(scan.RecomputeDirty(GetNode("other"), &err));
+  ASSERT_EQ("", err);
+  EXPECT_TRUE(GetNode("other")->dirty());
+  EXPECT_TRUE(log.LeftToRun(GetNode("other")->in_edge()));
+
+  // mid was made since.
+  EXPECT_TRUE(scan.RecomputeDirty(GetNode("out"), &err));
+  ASSERT_EQ("", err);
+  EXPECT_FALSE(log.LeftToRun(GetNode("mid")->in_edge()));
+  EXPECT_FALSE(GetNode("mid")->dirty());
+  EXPECT_FALSE(GetNode("out")->dirty());
+}
+
+TEST_F(ResumeLogTest, Write) {
+  ResumeLog log;
+  ASSERT_NO_FATAL_FAILURE(Load(&log, "2\tfailed\tother\n"));
+
+  GetNode("mid")->MarkDirty();
+  GetNode("out")->MarkDirty();
+  Plan plan;
+  string err;
+  EXPECT_TRUE(plan.AddTarget(GetNode("out"), &err));
+  ASSERT_EQ("", err);
+  Edge* edge = plan.FindWork();
+  ASSERT_EQ(GetNode("mid")->in_edge(), edge);
+  ASSERT_TRUE(plan.EdgeFinished(edge, Plan::kEdgeSucceeded, &err));
+
+  // What the plan has left, and what it had nothing to do with.
+  ASSERT_TRUE(log.Write(".ninja_resume", plan, &fs_, &err));
+  ASSERT_EQ("", err);
+  EXPECT_EQ(string(kSignature) + "2\tleft\tout\n2\tfailed\tother\n",
+            fs_.files_[".ninja_resume"].contents);
+
+  // An output that changed is known to have been made.
+  fs_.Tick();
+  fs_.Create("other", "");
+  EXPECT_TRUE(GetNode("other")->Stat(&fs_, &err));
+  edge = plan.FindWork();
+  ASSERT_EQ(GetNode("out")->in_edge(), edge);
+  ASSERT_TRUE(plan.EdgeFinished(edge, Plan::kEdgeSucceeded, &err));
+  ASSERT_TRUE(log.Write(".ninja_resume", plan, &fs_, &err));
+  ASSERT_EQ("", err);
+  EXPECT_EQ(1u, fs_.files_removed_.count(".ninja_resume"));
+}
+
+TEST_F(ResumeLogTest, WriteFailed) {
+  GetNode("mid")->MarkDirty();
+  GetNode("out")->MarkDirty();
+  Plan plan;
+  string err;
+  EXPECT_TRUE(plan.AddTarget(GetNode("out"), &err));
+  ASSERT_EQ("", err);
+  Edge* edge = plan.FindWork();
+  ASSERT_EQ(GetNode("mid")->in_edge(), edge);
+  ASSERT_TRUE(plan.EdgeFinished(edge, Plan::kEdgeFailed, &err));
+  EXPECT_TRUE(plan.Failed(edge));
+  EXPECT_FALSE(plan.Failed(GetNode("out")->in_edge()));
+
+  ResumeLog log;
+  ASSERT_TRUE(log.Write(".ninja_resume", plan, &fs_, &err));
+  ASSERT_EQ("", err);
+  EXPECT_EQ(string(kSignature) + "2\tleft\tout\n2\tfailed\tmid\n",
+            fs_.files_[".ninja_resume"].contents);
+}
+
+TEST_F(ResumeLogTest, FailedGoesFirst) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"build first: cat in\n"
+"build second: cat in\n"
+"build last: cat first second\n"));
+  ResumeLog log;
+  ASSERT_NO_FATAL_FAILURE(Load(&log, "2\tfailed\tlast\n"));
+
+  // As heavy as mid, but it comes after by id unless what failed goes
+  // first, with what it needs.
+  const char* kOrders[] = { "mid first second", "first second mid" };
+  for (int i = 0; i < 2; ++i) {
+    state_.Reset();
+    GetNode("mid")->MarkDirty();
+    GetNode("out")->MarkDirty();
+    GetNode("first")->MarkDirty();
+    GetNode("second")->MarkDirty();
+    GetNode("last")->MarkDirty();
+    Plan plan;
+    string err;
+    EXPECT_TRUE(plan.AddTarget(GetNode("out"), &err));
+    EXPECT_TRUE(plan.AddTarget(GetNode("last"), &err));
+    ASSERT_EQ("", err);
+    plan.PrepareQueue(NULL, i ? &log : NULL);
+    string order;
+    while (Edge* edge = plan.FindWork())
+      order += (order.empty() ? "" : " ") + edge->outputs_[0]->path();
+    EXPECT_EQ(kOrders[i], order);
+    EXPECT_EQ((i == 1), GetNode("first")->in_edge()->fail_first());
+    EXPECT_FALSE(GetNode("mid")->in_edge()->fail_first());
+  }
+}
+
+}  // anonymous namespace
@@ -0,0 +1,302 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "session.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "graph.h"
+#include "manifest_parser.h"
+#include "session_c.h"
+#include "util.h"
+
+BuildSession::BuildSession(const BuildConfig& config)
+    : config_(config), manifest_files_(&disk_interface_), loaded_(false),
+      used_(false) {}
+
+BuildSession::~BuildSession() {
+  Close();
+}
+
+bool BuildSession::Load(const string& manifest, string* err) {
+  if (loaded_) {
+    *err = "the session is loaded already";
+    return false;
+  }
+  ManifestParser parser(&state_, &manifest_files_);
+  if (!parser.Load(manifest, err))
+    return false;
+  loaded_ = true;
+  snapshot_.Capture(state_);
+
+  string build_dir = state_.bindings_.LookupVariable("builddir");
+  string prefix;
+  if (!build_dir.empty()) {
+    if (!config_.dry_run && !disk_interface_.MakeDirs(build_dir + "/.") &&
+        errno != EEXIST) {
+      *err = "creating build directory " + build_dir + ": " + strerror(errno);
+      return false;
+    }
+    prefix = build_dir + "/";
+  }
+
+  // Warnings come back in |err| from a successful load.
+  string log_err;
+  if (!build_log_.Load(prefix + ".ninja_log", &log_err)) {
+    *err = "loading build log: " + log_err;
+    return false;
+  }
+  if (!log_err.empty())
+    Warning("%s", log_err.c_str());
+  log_err.clear();
+  if (!deps_log_.Load(prefix + ".ninja_deps", &state_, &log_err)) {
+    *err = "loading deps log: " + log_err;
+    return false;
+  }
+  if (!log_err.empty())
+    Warning("%s", log_err.c_str());
+  log_err.clear();
+  if (!digest_log_.Load(prefix + ".ninja_digests", &log_err)) {
+    *err = "loading digest log: " + log_err;
+    return false;
+  }
+  if (!log_err.empty())
+    Warning("%s", log_err.c_str());
+
+  if (config_.dry_run)
+    return true;
+  if (!build_log_.OpenForWrite(prefix + ".ninja_log", *this, err) ||
+      !deps_log_.OpenForWrite(prefix + ".ninja_deps", err) ||
+      !digest_log_.OpenForWrite(prefix + ".ninja_digests", err)) {
+    *err = "opening logs: " + *err;
+    return false;
+  }
+  return true;
+}
+
+bool BuildSession::NeedsReload() const {
+  return manifest_files_.AnyChanged() || (used_ && snapshot_.uses_dyndep());
+}
+
+bool BuildSession::Prepare(const vector<string>& targets,
+                           vector<Node*>* nodes, string* err) {
+  if (!loaded_) {
+    *err = "the session is not loaded";
+    return false;
+  }
+  if (NeedsReload()) {
+    *err = "the manifest changed; load it in a new session";
+    return false;
+  }
+
+  // Take off what the last scan found out, for the files may have changed
+  // since.
+  if (used_) {
+    snapshot_.Restore(&state_);
+    state_.Reset();
+  }
+  used_ = true;
+
+  if (targets.empty()) {
+    *nodes = state_.DefaultNodes(err);
+    return err->empty();
+  }
+  for (vector<string>::const_iterator i = targets.begin();
+       i != targets.end(); ++i) {
+    string path = *i;
+    uint64_t slash_bits;
+    if (!CanonicalizePath(&path, &slash_bits, err))
+      return false;
+    Node* node = state_.LookupNode(path);
+    if (!node) {
+      *err = "unknown target '" + path + "'";
+      return false;
+    }
+    nodes->push_back(node);
+  }
+  return true;
+}
+
+bool BuildSession::IsDirty(const string& target, bool* dirty, string* err) {
+  vector<Node*> nodes;
+  if (!Prepare(vector<string>(1, target), &nodes, err))
+    return false;
+  DependencyScan scan(&state_, &build_log_, &deps_log_, &disk_interface_,
+                      &config_.depfile_parser_options);
+  scan.set_digest_log(&digest_log_);
+  if (!scan.RecomputeDirty(nodes[0], err))
+    return false;
+  *dirty = nodes[0]->dirty();
+  return true;
+}
+
+bool BuildSession::Build(const vector<string>& targets, bool* up_to_date,
+                         string* err) {
+  vector<Node*> nodes;
+  if (!Prepare(targets, &nodes, err))
+    return false;
+  Builder builder(&state_, config_, &build_log_, &deps_log_,
+                  &disk_interface_);
+  builder.SetDigestLog(&digest_log_);
+  for (vector<Node*>::iterator i = nodes.begin(); i != nodes.end(); ++i) {
+    // An up-to-date target returns false without an error.
+    if (!builder.AddTarget(*i, err) && !err->empty())
+      return false;
+  }
+  if (up_to_date)
+    *up_to_date = builder.AlreadyUpToDate();
+  if (builder.AlreadyUpToDate())
+    return true;
+  bool success = builder.Build(err);
+  if (!build_log_.Flush() || !deps_log_.Flush()) {
+    if (success)
+      *err = string("writing logs: ") + strerror(errno);
+    return false;
+  }
+  return success;
+}
+
+void BuildSession::Close() {
+  build_log_.Close();
+  deps_log_.Close();
+  digest_log_.Close();
+  loaded_ = false;
+}
+
+bool BuildSession::IsPathDead(StringPiece s) const {
+  // As NinjaMain::IsPathDead(): keep entries of files still on disk.
+  Node* n = state_.LookupNode(s);
+  if (n && n->in_edge())
+    return false;
+  string err;
+  TimeStamp mtime = disk_interface_.Stat(s.AsString(), &err);
+  if (mtime == -1)
+    Error("%s", err.c_str());
+  return mtime == 0;
+}
+
+//
+// The C interface.
+//
+
+namespace {
+
+/// Forwards BuildObserver calls to the callbacks of a ninja_session.
+struct CallbackObserver : public BuildObserver {
+  CallbackObserver() : started(NULL), finished(NULL), data(NULL) {}
+
+  virtual void EdgeStarted(const Edge* edge, int started_edges, int total) {
+    if (started)
+      started(data, Describe(edge).c_str(), started_edges, total);
+  }
+
+  virtual void EdgeFinished(const Edge* edge, bool success,
+                            const string& output, int finished_edges,
+                            int total) {
+    if (finished)
+      finished(data, Describe(edge).c_str(), success, output.c_str(),
+               finished_edges, total);
+  }
+
+  /// The edge's description, or its command if it has none.
+  static string Describe(const Edge* edge) {
+    string description = edge->GetBinding("description");
+    return description.empty() ? edge->EvaluateCommand() : description;
+  }
+
+  ninja_edge_started_fn started;
+  ninja_edge_finished_fn finished;
+  void* data;
+};
+
+/// Set |*err|, if given, to a malloc()ed copy of |message|.
+void SetError(char** err, const string& message) {
+  if (err)
+    *err = strdup(message.c_str());
+}
+
+}  // anonymous namespace
+
+struct ninja_session {
+  ninja_session() : session(NULL) {}
+  ~ninja_session() { delete session; }
+
+  CallbackObserver observer;
+  BuildSession* session;
+};
+
+ninja_session* ninja_session_new(int parallelism) {
+  BuildConfig config;
+  config.verbosity = BuildConfig::QUIET;
+  config.parallelism = parallelism > 0 ? parallelism : GuessParallelism();
+  ninja_session* session = new ninja_session;
+  config.observer = &session->observer;
+  session->session = new BuildSession(config);
+  return session;
+}
+
+void ninja_session_free(ninja_session* session) {
+  delete session;
+}
+
+void ninja_session_set_callbacks(ninja_session* session,
+                                 ninja_edge_started_fn started,
+                                 ninja_edge_finished_fn finished,
+                                 void* data) {
+  session->observer.started = started;
+  session->observer.finished = finished;
+  session->observer.data = data;
+}
+
+int ninja_session_load(ninja_session* session, const char* manifest,
+                       char** err) {
+  string error;
+  if (!session->session->Load(manifest, &error)) {
+    SetError(err, error);
+    return 0;
+  }
+  return 1;
+}
+
+int ninja_session_needs_reload(ninja_session* session) {
+  return session->session->NeedsReload();
+}
+
+int ninja_session_is_dirty(ninja_session* session, const char* target,
+                           int* dirty, char** err) {
+  string error;
+  bool is_dirty;
+  if (!session->session->IsDirty(target, &is_dirty, &error)) {
+    SetError(err, error);
+    return 0;
+  }
+  *dirty = is_dirty;
+  return 1;
+}
+
+int ninja_session_build(ninja_session* session, const char* const* targets,
+                        int count, int* up_to_date, char** err) {
+  vector<string> names(targets, targets + count);
+  string error;
+  bool nothing_to_do;
+  if (!session->session->Build(names, &nothing_to_do, &error)) {
+    SetError(err, error);
+    return 0;
+  }
+  if (up_to_date)
+    *up_to_date = nothing_to_do;
+  return 1;
+}
@@ -0,0 +1,89 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_SESSION_H_
+#define NINJA_SESSION_H_
+
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "build.h"
+#include "build_log.h"
+#include "daemon.h"
+#include "deps_log.h"
+#include "digest_log.h"
+#include "disk_interface.h"
+#include "manifest_cache.h"
+#include "state.h"
+
+/// A build loaded once for a program to query and build repeatedly in its
+/// own process, as ninja would from the same directory: the manifest is
+/// parsed and the logs in its build directory are loaded and opened only
+/// once.  See session_c.h for the same from C.
+///
+/// Progress comes through BuildConfig::observer; with QUIET verbosity
+/// nothing is printed but errors and warnings.  The process works in the
+/// manifest's directory, like ninja.  Not thread-safe.
+struct BuildSession : public BuildLogUser {
+  explicit BuildSession(const BuildConfig& config);
+  virtual ~BuildSession();
+
+  /// Parse |manifest|, which is in the current directory, and open the
+  /// logs.  Only once per session.
+  bool Load(const string& manifest, string* err);
+
+  /// Whether the session is out of date and should make way for a new one:
+  /// a manifest file changed, or a dyndep file loaded by a build edited
+  /// the graph.  Queries and builds fail then.  A session doesn't rebuild
+  /// the manifest on its own; Build() it like any target, then check this.
+  bool NeedsReload() const;
+
+  /// Set |*dirty| to whether |target| is out of date.
+  bool IsDirty(const string& target, bool* dirty, string* err);
+
+  /// Bring |targets|, or the default targets if there are none, up to
+  /// date.  Sets |*up_to_date|, if given, to whether there was nothing to
+  /// do.
+  bool Build(const vector<string>& targets, bool* up_to_date, string* err);
+
+  /// Flush and close the logs; the session can't build after this.
+  void Close();
+
+  State* state() { return &state_; }
+  BuildConfig* config() { return &config_; }
+
+  // BuildLogUser
+  virtual bool IsPathDead(StringPiece s) const;
+
+ private:
+  /// Get the graph ready for another scan, and look up |targets|.
+  bool Prepare(const vector<string>& targets, vector<Node*>* nodes,
+               string* err);
+
+  BuildConfig config_;
+  RealDiskInterface disk_interface_;
+  ManifestFileRecorder manifest_files_;
+  State state_;
+  BuildLog build_log_;
+  DepsLog deps_log_;
+  DigestLog digest_log_;
+  /// The graph as loaded, without the deps that scans discover.
+  GraphSnapshot snapshot_;
+  bool loaded_;
+  /// Whether a scan or build ran since Load().
+  bool used_;
+};
+
+#endif  // NINJA_SESSION_H_
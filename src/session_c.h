@@ -0,0 +1,69 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NINJA_SESSION_C_H_
+#define NINJA_SESSION_C_H_
+
+/* The C interface to BuildSession (session.h): a build loaded once, then
+ * queried and built repeatedly in the calling process.  Functions that
+ * can fail return 1 on success and 0 on failure, when they set |*err|, if
+ * |err| isn't NULL, to a message for the caller to free(). */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ninja_session ninja_session;
+
+/* Called as an edge starts: its description (or command), and how many of
+ * the edges to run have started so far, out of how many. */
+typedef void (*ninja_edge_started_fn)(void* data, const char* description,
+                                      int started, int total);
+/* Called as an edge ends, with its output. */
+typedef void (*ninja_edge_finished_fn)(void* data, const char* description,
+                                       int success, const char* output,
+                                       int finished, int total);
+
+/* A session running |parallelism| commands at once, or as many as ninja
+ * would by default if it is 0.  It prints nothing but errors. */
+ninja_session* ninja_session_new(int parallelism);
+void ninja_session_free(ninja_session* session);
+
+/* Either callback may be NULL.  |data| is passed to both. */
+void ninja_session_set_callbacks(ninja_session* session,
+                                 ninja_edge_started_fn started,
+                                 ninja_edge_finished_fn finished,
+                                 void* data);
+
+/* Load |manifest|, in the current directory, and the logs. */
+int ninja_session_load(ninja_session* session, const char* manifest,
+                       char** err);
+
+/* Whether the manifest changed, and a new session must load it. */
+int ninja_session_needs_reload(ninja_session* session);
+
+int ninja_session_is_dirty(ninja_session* session, const char* target,
+                           int* dirty, char** err);
+
+/* Build the |count| |targets|, or the defaults if |count| is 0.  Sets
+ * |*up_to_date|, unless it is NULL, to whether there was nothing to do. */
+int ninja_session_build(ninja_session* session, const char* const* targets,
+                        int count, int* up_to_date, char** err);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* NINJA_SESSION_C_H_ */
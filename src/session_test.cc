@@ -0,0 +1,145 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "session.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "graph.h"
+#include "session_c.h"
+#include "test.h"
+
+namespace {
+
+#ifndef _WIN32
+
+struct RecordingObserver : public BuildObserver {
+  virtual void EdgeStarted(const Edge* edge, int /*started*/, int total) {
+    events.push_back("start " + edge->outputs_[0]->path());
+    last_total = total;
+  }
+  virtual void EdgeFinished(const Edge* edge, bool success,
+                            const string& output, int /*finished*/,
+                            int /*total*/) {
+    events.push_back(string(success ? "done " : "failed ") +
+                     edge->outputs_[0]->path() + ": " + output);
+  }
+
+  vector<string> events;
+  int last_total;
+};
+
+struct BuildSessionTest : public testing::Test {
+  virtual void SetUp() {
+    temp_dir_.CreateAndEnter("BuildSessionTest");
+    WriteFile("build.ninja",
+"rule cp\n"
+"  command = echo $out; cp $in $out\n"
+"build mid: cp in\n"
+"build out: cp mid\n");
+    WriteFile("in", "");
+    config_.verbosity = BuildConfig::QUIET;
+    config_.observer = &observer_;
+  }
+  virtual void TearDown() {
+    temp_dir_.Cleanup();
+  }
+
+  void WriteFile(const char* path, const char* contents) {
+    FILE* f = fopen(path, "w");
+    ASSERT_TRUE(f != NULL);
+    fputs(contents, f);
+    fclose(f);
+  }
+
+  ScopedTempDir temp_dir_;
+  BuildConfig config_;
+  RecordingObserver observer_;
+};
+
+TEST_F(BuildSessionTest, BuildsRepeatedly) {
+  BuildSession session(config_);
+  string err;
+  ASSERT_TRUE(session.Load("build.ninja", &err));
+  ASSERT_EQ("", err);
+
+  bool dirty = false;
+  EXPECT_TRUE(session.IsDirty("out", &dirty, &err));
+  EXPECT_TRUE(dirty);
+
+  bool up_to_date = true;
+  EXPECT_TRUE(session.Build(vector<string>(), &up_to_date, &err));
+  ASSERT_EQ("", err);
+  EXPECT_FALSE(up_to_date);
+  ASSERT_EQ(4u, observer_.events.size());
+  EXPECT_EQ("start mid", observer_.events[0]);
+  EXPECT_EQ("done mid: mid\n", observer_.events[1]);
+  EXPECT_EQ("start out", observer_.events[2]);
+  EXPECT_EQ(2, observer_.last_total);
+
+  // The same session sees what the build did, and what changed since.
+  EXPECT_TRUE(session.IsDirty("out", &dirty, &err));
+  EXPECT_FALSE(dirty);
+  EXPECT_TRUE(session.Build(vector<string>(1, "out"), &up_to_date, &err));
+  EXPECT_TRUE(up_to_date);
+
+  // Make sure the new mtime differs.
+  EXPECT_EQ(0, system("touch -d '+1 minute' in"));
+  EXPECT_TRUE(session.IsDirty("mid", &dirty, &err));
+  EXPECT_TRUE(dirty);
+  observer_.events.clear();
+  EXPECT_TRUE(session.Build(vector<string>(1, "mid"), &up_to_date, &err));
+  EXPECT_FALSE(up_to_date);
+  EXPECT_EQ(2u, observer_.events.size());
+
+  EXPECT_FALSE(session.Build(vector<string>(1, "nope"), NULL, &err));
+  EXPECT_EQ("unknown target 'nope'", err);
+  EXPECT_FALSE(session.NeedsReload());
+}
+
+void CountFinished(void* data, const char* /*description*/, int success,
+                   const char* /*output*/, int /*finished*/, int /*total*/) {
+  if (success)
+    ++*static_cast<int*>(data);
+}
+
+TEST_F(BuildSessionTest, CInterface) {
+  ninja_session* session = ninja_session_new(1);
+  int finished = 0;
+  ninja_session_set_callbacks(session, NULL, CountFinished, &finished);
+  char* err = NULL;
+  ASSERT_EQ(1, ninja_session_load(session, "build.ninja", &err));
+
+  const char* targets[] = { "out" };
+  int up_to_date = 1;
+  EXPECT_EQ(1, ninja_session_build(session, targets, 1, &up_to_date, &err));
+  EXPECT_EQ(0, up_to_date);
+  EXPECT_EQ(2, finished);
+  int dirty = 1;
+  EXPECT_EQ(1, ninja_session_is_dirty(session, "out", &dirty, &err));
+  EXPECT_EQ(0, dirty);
+
+  targets[0] = "nope";
+  EXPECT_EQ(0, ninja_session_build(session, targets, 1, NULL, &err));
+  ASSERT_TRUE(err != NULL);
+  EXPECT_EQ(string("unknown target 'nope'"), err);
+  free(err);
+
+  ninja_session_free(session);
+}
+
+#endif  // _WIN32
+
+}  // anonymous namespace
@@ -0,0 +1,178 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "shard.h"
+
+#include <algorithm>
+
+#include "build_log.h"
+#include "graph.h"
+
+using namespace std;
+
+namespace {
+
+bool ComparePaths(const pair<Node*, int>& a, const pair<Node*, int>& b) {
+  return a.first->path() < b.first->path();
+}
+
+}  // anonymous namespace
+
+void Sharder::AddTarget(Node* node) {
+  if (node->in_edge())
+    Visit(node->in_edge());
+}
+
+void Sharder::Visit(Edge* edge) {
+  if (!visited_.insert(edge).second)
+    return;
+  for (vector<Node*>::iterator i = edge->inputs_.begin();
+       i != edge->inputs_.end(); ++i) {
+    if ((*i)->in_edge())
+      Visit((*i)->in_edge());
+  }
+  if (!edge->is_phony())
+    edges_.push_back(edge);
+}
+
+void Sharder::AddMadeFiles(Node* node, set<Node*>* files) const {
+  Edge* edge = node->in_edge();
+  if (!edge)
+    return;
+  if (!edge->is_phony()) {
+    files->insert(node);
+    return;
+  }
+  for (vector<Node*>::iterator i = edge->inputs_.begin();
+       i != edge->inputs_.end(); ++i)
+    AddMadeFiles(*i, files);
+}
+
+void Sharder::Partition(int count) {
+  // What each edge took, in milliseconds, if it ran before.
+  vector<int64_t> weights(edges_.size(), -1);
+  int64_t known_total = 0;
+  size_t known = 0;
+  for (size_t i = 0; i < edges_.size(); ++i) {
+    BuildLog::LogEntry* entry = build_log_ ?
+        build_log_->LookupByNode(edges_[i]->outputs_[0]) : NULL;
+    if (!entry)
+      continue;
+    weights[i] = max(entry->end_time - entry->start_time, 1);
+    known_total += weights[i];
+    ++known;
+  }
+  int64_t guess = known ? max<int64_t>(known_total / known, 1) : 1;
+  int64_t total = 0;
+  for (size_t i = 0; i < weights.size(); ++i) {
+    if (weights[i] < 0)
+      weights[i] = guess;
+    total += weights[i];
+  }
+  int64_t capacity = (total + count - 1) / count;
+
+  shards_.clear();
+  loads_.assign(count, 0);
+  vector<int> made(count);
+  int current = 0;
+  for (size_t i = 0; i < edges_.size(); ++i) {
+    Edge* edge = edges_[i];
+    int64_t weight = weights[i];
+
+    set<Node*> inputs;
+    for (vector<Node*>::iterator n = edge->inputs_.begin();
+         n != edge->inputs_.end(); ++n)
+      AddMadeFiles(*n, &inputs);
+    fill(made.begin(), made.end(), 0);
+    for (set<Node*>::iterator n = inputs.begin(); n != inputs.end(); ++n) {
+      int s = ShardOf((*n)->in_edge());
+      if (s >= 0)
+        ++made[s];
+    }
+
+    // A shard has room for an edge if it stays within its share, or if it
+    // has nothing yet: an edge longer than a share has to go somewhere.
+    int best = -1;
+    for (int s = 0; s < count; ++s) {
+      bool fits = loads_[s] == 0 || loads_[s] + weight <= capacity;
+      if (fits && made[s] > 0 && (best < 0 || made[s] > made[best]))
+        best = s;
+    }
+    if (best < 0 && (loads_[current] == 0 ||
+                     loads_[current] + weight <= capacity))
+      best = current;
+    if (best < 0)
+      best = int(min_element(loads_.begin(), loads_.end()) - loads_.begin());
+
+    shards_[edge] = best;
+    loads_[best] += weight;
+    current = best;
+  }
+}
+
+bool Sharder::UsedIn(Node* node, int shard) const {
+  for (vector<Edge*>::const_iterator e = node->out_edges().begin();
+       e != node->out_edges().end(); ++e) {
+    if ((*e)->is_phony()) {
+      for (vector<Node*>::iterator o = (*e)->outputs_.begin();
+           o != (*e)->outputs_.end(); ++o) {
+        if (UsedIn(*o, shard))
+          return true;
+      }
+    } else if (ShardOf(*e) == shard) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int Sharder::ShardOf(Edge* edge) const {
+  map<Edge*, int>::const_iterator i = shards_.find(edge);
+  return i == shards_.end() ? -1 : i->second;
+}
+
+vector<Node*> Sharder::Targets(int shard) const {
+  vector<Node*> targets;
+  for (vector<Edge*>::const_iterator e = edges_.begin(); e != edges_.end();
+       ++e) {
+    if (ShardOf(*e) != shard)
+      continue;
+    for (vector<Node*>::iterator o = (*e)->outputs_.begin();
+         o != (*e)->outputs_.end(); ++o) {
+      if (!UsedIn(*o, shard))
+        targets.push_back(*o);
+    }
+  }
+  return targets;
+}
+
+vector<pair<Node*, int> > Sharder::Fetches(int shard) const {
+  set<Node*> inputs;
+  for (vector<Edge*>::const_iterator e = edges_.begin(); e != edges_.end();
+       ++e) {
+    if (ShardOf(*e) != shard)
+      continue;
+    for (vector<Node*>::iterator n = (*e)->inputs_.begin();
+         n != (*e)->inputs_.end(); ++n)
+      AddMadeFiles(*n, &inputs);
+  }
+  vector<pair<Node*, int> > fetches;
+  for (set<Node*>::iterator n = inputs.begin(); n != inputs.end(); ++n) {
+    int from = ShardOf((*n)->in_edge());
+    if (from != shard)
+      fetches.push_back(make_pair(*n, from));
+  }
+  sort(fetches.begin(), fetches.end(), ComparePaths);
+  return fetches;
+}
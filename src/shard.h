@@ -0,0 +1,81 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_SHARD_H_
+#define NINJA_SHARD_H_
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include <stdint.h>
+
+struct BuildLog;
+struct Edge;
+struct Node;
+
+/// Splits the edges needed for some targets among a number of machines
+/// that build the same graph, so each builds a share of similar length
+/// that needs little of what the others build.
+///
+/// Edges weigh what they took last time, from the build log, or the
+/// average of the edges that have run if they haven't.  They are taken
+/// inputs first, in the order a build would visit them, and each goes to
+/// the shard that made most of its inputs, or else the shard that took the
+/// edge before it, while that shard has room; otherwise to the least
+/// loaded shard.  Phony edges aren't assigned: they are seen through to
+/// the edges behind them.
+struct Sharder {
+  explicit Sharder(BuildLog* build_log) : build_log_(build_log) {}
+
+  /// Add the edges that |node| needs.
+  void AddTarget(Node* node);
+
+  /// Assign the edges added so far among |count| shards.
+  void Partition(int count);
+
+  /// The shard |edge| went to, or -1 if it isn't one of the added edges.
+  int ShardOf(Edge* edge) const;
+
+  /// The targets to build on |shard|: the outputs of its edges that no
+  /// other edge of it uses.  Building them builds all its edges.
+  std::vector<Node*> Targets(int shard) const;
+
+  /// The files that |shard| needs from other shards, and which shard
+  /// makes each one.
+  std::vector<std::pair<Node*, int> > Fetches(int shard) const;
+
+  /// The added edges, inputs before the edges that use them.
+  const std::vector<Edge*>& edges() const { return edges_; }
+  /// How long each shard should take, in milliseconds.
+  const std::vector<int64_t>& loads() const { return loads_; }
+
+ private:
+  void Visit(Edge* edge);
+
+  /// Add |node| to |files| if an added edge makes it, or else the files
+  /// behind it if a phony edge does.
+  void AddMadeFiles(Node* node, std::set<Node*>* files) const;
+
+  /// Whether an edge of |shard| uses |node|, through phony edges.
+  bool UsedIn(Node* node, int shard) const;
+
+  BuildLog* build_log_;
+  std::vector<Edge*> edges_;
+  std::set<Edge*> visited_;
+  std::map<Edge*, int> shards_;
+  std::vector<int64_t> loads_;
+};
+
+#endif  // NINJA_SHARD_H_
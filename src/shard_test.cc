@@ -0,0 +1,104 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "shard.h"
+
+#include "build_log.h"
+#include "graph.h"
+#include "test.h"
+
+namespace {
+
+struct ShardTest : public StateTestWithBuiltinRules {
+  /// Record that the edge making |path| took |duration| milliseconds.
+  void Took(const string& path, int duration) {
+    log_.RecordCommand(GetNode(path)->in_edge(), 0, duration);
+  }
+
+  BuildLog log_;
+};
+
+TEST_F(ShardTest, KeepsChainsTogether) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"build a1: cat a.in\n"
+"build a2: cat a1\n"
+"build b1: cat b.in\n"
+"build b2: cat b1\n"
+"build all: phony a2 b2\n"));
+  Took("a1", 10);
+  Took("a2", 10);
+  Took("b1", 10);
+  Took("b2", 10);
+
+  Sharder sharder(&log_);
+  sharder.AddTarget(GetNode("all"));
+  sharder.Partition(2);
+  ASSERT_EQ(4u, sharder.edges().size());
+
+  EXPECT_EQ(0, sharder.ShardOf(GetNode("a1")->in_edge()));
+  EXPECT_EQ(0, sharder.ShardOf(GetNode("a2")->in_edge()));
+  EXPECT_EQ(1, sharder.ShardOf(GetNode("b1")->in_edge()));
+  EXPECT_EQ(1, sharder.ShardOf(GetNode("b2")->in_edge()));
+  EXPECT_EQ(-1, sharder.ShardOf(GetNode("all")->in_edge()));
+  EXPECT_EQ(20, sharder.loads()[0]);
+  EXPECT_EQ(20, sharder.loads()[1]);
+
+  vector<Node*> targets = sharder.Targets(1);
+  ASSERT_EQ(1u, targets.size());
+  EXPECT_EQ("b2", targets[0]->path());
+  EXPECT_TRUE(sharder.Fetches(0).empty());
+  EXPECT_TRUE(sharder.Fetches(1).empty());
+}
+
+TEST_F(ShardTest, FetchesAcrossShards) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"build x: cat in\n"
+"build y: cat in\n"
+"build xy: phony x y\n"
+"build z: cat xy\n"
+"build w: cat in\n"));
+  Took("x", 100);
+  Took("y", 100);
+  Took("z", 10);
+  // w hasn't run; it weighs the average of the rest, 70.
+
+  Sharder sharder(&log_);
+  sharder.AddTarget(GetNode("z"));
+  sharder.AddTarget(GetNode("w"));
+  sharder.Partition(2);
+
+  // Each shard made an input of z; it goes to the first.
+  EXPECT_EQ(0, sharder.ShardOf(GetNode("x")->in_edge()));
+  EXPECT_EQ(1, sharder.ShardOf(GetNode("y")->in_edge()));
+  EXPECT_EQ(0, sharder.ShardOf(GetNode("z")->in_edge()));
+  EXPECT_EQ(1, sharder.ShardOf(GetNode("w")->in_edge()));
+  EXPECT_EQ(110, sharder.loads()[0]);
+  EXPECT_EQ(170, sharder.loads()[1]);
+
+  vector<pair<Node*, int> > fetches = sharder.Fetches(0);
+  ASSERT_EQ(1u, fetches.size());
+  EXPECT_EQ("y", fetches[0].first->path());
+  EXPECT_EQ(1, fetches[0].second);
+  EXPECT_TRUE(sharder.Fetches(1).empty());
+
+  vector<Node*> targets = sharder.Targets(0);
+  ASSERT_EQ(1u, targets.size());
+  EXPECT_EQ("z", targets[0]->path());
+  targets = sharder.Targets(1);
+  ASSERT_EQ(2u, targets.size());
+  EXPECT_EQ("y", targets[0]->path());
+  EXPECT_EQ("w", targets[1]->path());
+}
+
+}  // anonymous namespace
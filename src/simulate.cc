@@ -0,0 +1,130 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simulate.h"
+
+#include <algorithm>
+
+#include "build_log.h"
+#include "graph.h"
+#include "state.h"
+
+TimeStamp SimulatedDiskInterface::Stat(const string& path,
+                                       string* err) const {
+  if (clean_) {
+    Node* node = state_->LookupNode(path);
+    if (node && node->in_edge())
+      return 0;
+  }
+  return disk_->Stat(path, err);
+}
+
+SimulatedCommandRunner::SimulatedCommandRunner(const BuildConfig& config,
+                                               BuildLog* build_log)
+    : config_(config), build_log_(build_log), default_millis_(1),
+      now_millis_(0), rss_kib_(0), busy_millis_(0), cpu_micros_(0),
+      peak_rss_kib_(0), commands_(0), unknown_commands_(0) {
+  if (!build_log_)
+    return;
+  int64_t total = 0;
+  int known = 0;
+  const BuildLog::Entries& entries = build_log_->entries();
+  for (BuildLog::Entries::const_iterator i = entries.begin();
+       i != entries.end(); ++i) {
+    if (i->second->end_time >= i->second->start_time) {
+      total += i->second->end_time - i->second->start_time;
+      ++known;
+    }
+  }
+  if (known)
+    default_millis_ = max<int64_t>(total / known, 1);
+}
+
+int64_t SimulatedCommandRunner::MadeAt(const Node* node) const {
+  const Edge* edge = node->in_edge();
+  if (!edge)
+    return 0;
+  // Phony edges are done with as soon as what they stand for.
+  if (edge->is_phony()) {
+    int64_t made = 0;
+    for (vector<Node*>::const_iterator i = edge->inputs_.begin();
+         i != edge->inputs_.end(); ++i)
+      made = max(made, MadeAt(*i));
+    return made;
+  }
+  map<const Edge*, int64_t>::const_iterator made = finished_at_.find(edge);
+  return made != finished_at_.end() ? made->second : 0;
+}
+
+bool SimulatedCommandRunner::CanRunMore() const {
+  return running_.size() < (size_t)max(config_.parallelism, 1);
+}
+
+bool SimulatedCommandRunner::StartCommand(Edge* edge) {
+  BuildLog::LogEntry* entry = NULL;
+  if (build_log_ && !edge->outputs_.empty())
+    entry = build_log_->LookupByNode(edge->outputs_[0]);
+  int64_t millis = default_millis_;
+  Running running = { edge, 0 };
+  if (entry && entry->end_time >= entry->start_time) {
+    millis = entry->end_time - entry->start_time;
+    cpu_micros_ += entry->usage.user_micros + entry->usage.system_micros;
+    running.rss_kib = entry->usage.max_rss_kib;
+  } else {
+    ++unknown_commands_;
+  }
+  ++commands_;
+  busy_millis_ += millis;
+  rss_kib_ += running.rss_kib;
+  peak_rss_kib_ = max(peak_rss_kib_, rss_kib_);
+
+  // The command could have started once the last of its inputs was made.
+  int64_t ready_millis = 0;
+  for (vector<Node*>::iterator i = edge->inputs_.begin();
+       i != edge->inputs_.end(); ++i)
+    ready_millis = max(ready_millis, MadeAt(*i));
+  PoolWait& wait = pool_waits_[edge->pool()->name()];
+  ++wait.commands;
+  wait.wait_millis += now_millis_ - ready_millis;
+  wait.max_wait_millis = max(wait.max_wait_millis, now_millis_ - ready_millis);
+
+  running_.insert(make_pair(now_millis_ + millis, running));
+  return true;
+}
+
+bool SimulatedCommandRunner::WaitForCommand(Result* result,
+                                            int /*timeout_millis*/) {
+  if (running_.empty())
+    return false;
+  multimap<int64_t, Running>::iterator next = running_.begin();
+  now_millis_ = next->first;
+  result->edge = next->second.edge;
+  result->status = ExitSuccess;
+  rss_kib_ -= next->second.rss_kib;
+  finished_at_[result->edge] = now_millis_;
+  running_.erase(next);
+  return true;
+}
+
+bool SimulatedCommandRunner::HasFinishedCommand() const {
+  return !running_.empty();
+}
+
+vector<Edge*> SimulatedCommandRunner::GetActiveEdges() {
+  vector<Edge*> edges;
+  for (multimap<int64_t, Running>::iterator i = running_.begin();
+       i != running_.end(); ++i)
+    edges.push_back(i->second.edge);
+  return edges;
+}
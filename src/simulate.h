@@ -0,0 +1,133 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_SIMULATE_H_
+#define NINJA_SIMULATE_H_
+
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "build.h"
+#include "disk_interface.h"
+#include "util.h"  // int64_t
+
+struct BuildLog;
+struct Node;
+struct State;
+
+/// What a simulated build sees of the disk: |disk|, but only read from, and
+/// with the files that the edges of |state| make missing if |clean|, for
+/// all of them to run.
+struct SimulatedDiskInterface : public DiskInterface {
+  SimulatedDiskInterface(DiskInterface* disk, const State* state, bool clean)
+      : disk_(disk), state_(state), clean_(clean) {}
+
+  virtual TimeStamp Stat(const string& path, string* err) const;
+  virtual bool MakeDir(const string& path) { return true; }
+  virtual bool WriteFile(const string& path, const string& contents) {
+    return true;
+  }
+  virtual int RemoveFile(const string& path) { return 1; }
+  virtual Status ReadFile(const string& path, string* contents, string* err) {
+    return disk_->ReadFile(path, contents, err);
+  }
+  virtual Status Chdir(const string& path, string* err) {
+    return disk_->Chdir(path, err);
+  }
+  virtual Status Getcwd(string* path, string* err) {
+    return disk_->Getcwd(path, err);
+  }
+
+ private:
+  DiskInterface* disk_;
+  const State* state_;
+  bool clean_;
+};
+
+/// A CommandRunner that runs nothing, but has each command take as long
+/// as it did last time, from the build log, in a time of its own: what
+/// "-t simulate" replays a build through, with a dry run Builder, to see
+/// how long it takes with a BuildConfig.
+///
+/// Commands the log doesn't know take the average of those it does.  The
+/// time starts at 0 and moves on to the end of the next command to finish
+/// whenever the builder waits for one, however long it asked to wait, so
+/// the same graph and log always give the same build.
+struct SimulatedCommandRunner : public CommandRunner {
+  SimulatedCommandRunner(const BuildConfig& config, BuildLog* build_log);
+  virtual ~SimulatedCommandRunner() {}
+
+  // Overridden from CommandRunner:
+  virtual bool CanRunMore() const;
+  virtual bool StartCommand(Edge* edge);
+  virtual bool WaitForCommand(Result* result, int timeout_millis);
+  virtual bool HasFinishedCommand() const;
+  virtual vector<Edge*> GetActiveEdges();
+
+  /// How long the commands of a pool were ready to run, but didn't.
+  struct PoolWait {
+    PoolWait() : commands(0), wait_millis(0), max_wait_millis(0) {}
+    int commands;
+    int64_t wait_millis;
+    int64_t max_wait_millis;
+  };
+
+  /// When the last command finished.
+  int64_t now_millis() const { return now_millis_; }
+  /// How long the commands took together.
+  int64_t busy_millis() const { return busy_millis_; }
+  /// The CPU time they used together, where the log recorded it.
+  int64_t cpu_micros() const { return cpu_micros_; }
+  /// The most memory that the commands running at once needed, where the
+  /// log recorded it.
+  int64_t peak_rss_kib() const { return peak_rss_kib_; }
+  int commands() const { return commands_; }
+  /// The commands that the log didn't know.
+  int unknown_commands() const { return unknown_commands_; }
+  /// By the name of the pool.
+  const map<string, PoolWait>& pool_waits() const { return pool_waits_; }
+
+ private:
+  struct Running {
+    Edge* edge;
+    int64_t rss_kib;
+  };
+
+  /// When the commands that |node| needs had finished, as far as those run
+  /// here go.
+  int64_t MadeAt(const Node* node) const;
+
+  const BuildConfig& config_;
+  BuildLog* build_log_;
+  int64_t default_millis_;
+
+  int64_t now_millis_;
+  /// By the time each will finish; commands that finish at the same time
+  /// do so in the order they started.
+  multimap<int64_t, Running> running_;
+  /// When each command that ran finished.
+  map<const Edge*, int64_t> finished_at_;
+  int64_t rss_kib_;
+
+  int64_t busy_millis_;
+  int64_t cpu_micros_;
+  int64_t peak_rss_kib_;
+  int commands_;
+  int unknown_commands_;
+  map<string, PoolWait> pool_waits_;
+};
+
+#endif  // NINJA_SIMULATE_H_
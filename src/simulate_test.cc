@@ -0,0 +1,125 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "simulate.h"
+
+#include "build_log.h"
+#include "deps_log.h"
+#include "graph.h"
+#include "test.h"
+
+namespace {
+
+struct SimulateTest : public StateTestWithBuiltinRules {
+  virtual void SetUp() {
+    ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"pool one\n"
+"  depth = 1\n"
+"build a: cat in\n"
+"build b: cat a\n"
+"build c: cat in\n"
+"build x: cat in\n"
+"  pool = one\n"
+"build y: cat in\n"
+"  pool = one\n"
+"build all: phony b c x y\n"));
+    fs_.Create("in", "");
+    Took("a", 10);
+    Took("b", 30);
+    Took("c", 20);
+    Took("x", 10);
+    Took("y", 10);
+    config_.dry_run = true;
+    config_.verbosity = BuildConfig::QUIET;
+  }
+
+  /// Record that the edge making |path| took |duration| milliseconds, in a
+  /// build after the files had been made.
+  void Took(const string& path, int duration) {
+    log_.RecordCommand(GetNode(path)->in_edge(), 0, duration, 10);
+  }
+
+  /// Replay a build of "all" through |disk|, returning the runner.
+  SimulatedCommandRunner* Replay(Builder* builder, DiskInterface* disk) {
+    SimulatedCommandRunner* runner =
+        new SimulatedCommandRunner(config_, &log_);
+    builder->command_runner_.reset(runner);
+    string err;
+    EXPECT_TRUE(builder->AddTarget("all", &err));
+    EXPECT_EQ("", err);
+    EXPECT_TRUE(builder->Build(&err));
+    EXPECT_EQ("", err);
+    return runner;
+  }
+
+  VirtualFileSystem fs_;
+  BuildConfig config_;
+  BuildLog log_;
+  DepsLog deps_log_;
+};
+
+TEST_F(SimulateTest, Parallel) {
+  config_.parallelism = 2;
+  Builder builder(&state_, config_, &log_, &deps_log_, &fs_);
+  SimulatedCommandRunner* runner = Replay(&builder, &fs_);
+
+  // a and c start first, then b after a, and x and y in turn as c is done.
+  EXPECT_EQ(40, runner->now_millis());
+  EXPECT_EQ(80, runner->busy_millis());
+  EXPECT_EQ(5, runner->commands());
+  EXPECT_EQ(0, runner->unknown_commands());
+  const map<string, SimulatedCommandRunner::PoolWait>& waits =
+      runner->pool_waits();
+  ASSERT_EQ(2u, waits.size());
+  EXPECT_EQ(3, waits.find("")->second.commands);
+  EXPECT_EQ(0, waits.find("")->second.wait_millis);
+  EXPECT_EQ(2, waits.find("one")->second.commands);
+  EXPECT_EQ(50, waits.find("one")->second.wait_millis);
+  EXPECT_EQ(30, waits.find("one")->second.max_wait_millis);
+
+  // Nothing was written, or logged.
+  EXPECT_EQ(1u, fs_.files_created_.size());
+  EXPECT_EQ(30, log_.LookupByOutput("b")->end_time);
+}
+
+TEST_F(SimulateTest, Serial) {
+  config_.parallelism = 1;
+  Builder builder(&state_, config_, &log_, &deps_log_, &fs_);
+  EXPECT_EQ(80, Replay(&builder, &fs_)->now_millis());
+}
+
+TEST_F(SimulateTest, CleanBuild) {
+  // Everything is up to date, but all of it runs in a clean build.
+  fs_.Tick();
+  fs_.Create("a", "");
+  fs_.Create("b", "");
+  fs_.Create("c", "");
+  fs_.Create("x", "");
+  fs_.Create("y", "");
+  config_.parallelism = 10;
+  SimulatedDiskInterface disk(&fs_, &state_, true);
+  Builder builder(&state_, config_, &log_, &deps_log_, &disk);
+  SimulatedCommandRunner* runner = Replay(&builder, &disk);
+  EXPECT_EQ(40, runner->now_millis());
+  EXPECT_EQ(5, runner->commands());
+
+  SimulatedDiskInterface incremental(&fs_, &state_, false);
+  state_.Reset();
+  Builder up_to_date(&state_, config_, &log_, &deps_log_, &incremental);
+  string err;
+  EXPECT_TRUE(up_to_date.AddTarget("all", &err));
+  EXPECT_TRUE(up_to_date.AlreadyUpToDate());
+}
+
+}  // anonymous namespace
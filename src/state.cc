@@ -16,6 +16,10 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <new>
 
 #include "edit_distance.h"
 #include "graph.h"
@@ -38,13 +42,13 @@ void Pool::DelayEdge(Edge* edge) {
   delayed_.insert(edge);
 }
 
-void Pool::RetrieveReadyEdges(set<Edge*>* ready_queue) {
+void Pool::RetrieveReadyEdges(EdgePriorityQueue* ready_queue) {
   DelayedEdges::iterator it = delayed_.begin();
   while (it != delayed_.end()) {
     Edge* edge = *it;
     if (current_use_ + edge->weight() > depth_)
       break;
-    ready_queue->insert(edge);
+    ready_queue->push(edge);
     EdgeScheduled(*edge);
     ++it;
   }
@@ -66,14 +70,83 @@ bool Pool::WeightedEdgeCmp(const Edge* a, const Edge* b) {
   if (!a) return b;
   if (!b) return false;
   int weight_diff = a->weight() - b->weight();
-  return ((weight_diff < 0) || (weight_diff == 0 && a < b));
+  return ((weight_diff < 0) ||
+          (weight_diff == 0 && EdgePriorityLess()(a, b)));
+}
+
+bool EdgePriorityLess::operator()(const Edge* a, const Edge* b) const {
+  if (a->fail_first() != b->fail_first())
+    return a->fail_first();
+  if (a->critical_path_weight() != b->critical_path_weight())
+    return a->critical_path_weight() > b->critical_path_weight();
+  if (a->id() != b->id())
+    return a->id() < b->id();
+  return a < b;
+}
+
+void EdgePriorityQueue::set_policy(Policy policy) {
+  assert(empty());
+  policy_ = policy;
+  clear();
+}
+
+size_t EdgePriorityQueue::GroupFor(const Edge* edge) {
+  if (policy_ == kCriticalPath && !groups_.empty())
+    return 0;
+  string key;
+  if (policy_ == kRoundRobinSubprojects) {
+    const string& dir = edge->env_->AsString();
+    key = dir.substr(0, dir.find('/'));
+  } else if (policy_ == kRoundRobinPools) {
+    key = edge->pool()->name();
+  }
+  map<string, size_t>::iterator i = group_ids_.find(key);
+  if (i != group_ids_.end())
+    return i->second;
+  group_ids_[key] = groups_.size();
+  groups_.push_back(Heap());
+  return groups_.size() - 1;
+}
+
+size_t EdgePriorityQueue::Current() const {
+  size_t group = next_;
+  while (groups_[group].empty())
+    group = (group + 1) % groups_.size();
+  return group;
+}
+
+void EdgePriorityQueue::push(Edge* edge) {
+  groups_[GroupFor(edge)].push(edge);
+  ++size_;
+}
+
+Edge* EdgePriorityQueue::top() const {
+  assert(!empty());
+  return groups_[Current()].top();
+}
+
+void EdgePriorityQueue::pop() {
+  assert(!empty());
+  size_t group = Current();
+  groups_[group].pop();
+  --size_;
+  next_ = (group + 1) % groups_.size();
+}
+
+void EdgePriorityQueue::clear() {
+  groups_.clear();
+  group_ids_.clear();
+  size_ = 0;
+  next_ = 0;
 }
 
 Pool State::kDefaultPool("", 0);
-Pool State::kConsolePool("console", 1);
+Pool State::kConsolePool("console", 1, true);
 const Rule State::kPhonyRule("phony");
 
-State::State() {
+State::State()
+    : defer_dep_links_(false), node_count_(0), dir_index_built_(false),
+      spellcheck_index_built_(false) {
   bindings_.AddRule(&kPhonyRule);
   AddPool(&kDefaultPool);
   AddPool(&kConsolePool);
@@ -92,10 +165,11 @@ Pool* State::LookupPool(const string& pool_name) {
 }
 
 Edge* State::AddEdge(const Rule* rule) {
-  Edge* edge = new Edge();
+  Edge* edge = new (arena_.Allocate(sizeof(Edge))) Edge();
   edge->rule_ = rule;
   edge->pool_ = &State::kDefaultPool;
   edge->env_ = &bindings_;
+  edge->id_ = (int)edges_.size();
   edges_.push_back(edge);
   return edge;
 }
@@ -106,15 +180,32 @@ Node* State::GetNode(StringPiece path, BindingEnv* env, uint64_t slash_bits) {
     // Optimization: skip env->ApplyChdir() unless it is needed.
     node = LookupNode(path);
   } else {
-    node = LookupNode(env->ApplyChdir(path.AsString()));
+    chdir_path_.clear();
+    env->AppendChdir(path, &chdir_path_);
+    node = LookupNode(chdir_path_);
   }
   if (node)
     return node;
-  node = new Node(env, path.AsString(), slash_bits);
-  paths_[node->path()] = node;
+  node = NewNode(env, path.AsString(), slash_bits);
+  AddNode(node);
+  return node;
+}
+
+Node* State::NewNode(BindingEnv* env, const string& path,
+                     uint64_t slash_bits) {
+  Node* node = new (arena_.Allocate(sizeof(Node))) Node(env, path, slash_bits);
+  node->set_index(node_count_++);
   return node;
 }
 
+void State::AddNode(Node* node) {
+  paths_[node->path()] = node;
+  if (dir_index_built_)
+    AddToDirIndex(node);
+  if (spellcheck_index_built_)
+    AddToSpellcheckIndex(node);
+}
+
 Node* State::LookupNode(StringPiece path) const {
   METRIC_RECORD("lookup node");
   Paths::const_iterator i = paths_.find(path);
@@ -123,18 +214,79 @@ Node* State::LookupNode(StringPiece path) const {
   return NULL;
 }
 
+namespace {
+
+/// Counts of the characters of a path, folded into a few classes.  Every
+/// edit changes the counts by at most 2 in total, so half the difference of
+/// two histograms is a cheap lower bound for the edit distance.
+struct CharHistogram {
+  enum { kClasses = 32 };
+
+  explicit CharHistogram(const string& s) {
+    fill(counts, counts + kClasses, 0);
+    for (string::const_iterator c = s.begin(); c != s.end(); ++c)
+      ++counts[(unsigned char)*c % kClasses];
+  }
+
+  /// The lower bound for the edit distance between the two paths.
+  int MinDistance(const CharHistogram& other) const {
+    int difference = 0;
+    for (int i = 0; i < kClasses; ++i)
+      difference += abs(counts[i] - other.counts[i]);
+    return (difference + 1) / 2;
+  }
+
+  int counts[kClasses];
+};
+
+}  // anonymous namespace
+
+void State::AddToSpellcheckIndex(Node* node) {
+  size_t length = node->path().size();
+  if (spellcheck_index_.size() <= length)
+    spellcheck_index_.resize(length + 1);
+  spellcheck_index_[length].push_back(node);
+}
+
 Node* State::SpellcheckNode(const string& path) {
   const bool kAllowReplacements = true;
   const int kMaxValidEditDistance = 3;
 
+  if (!spellcheck_index_built_) {
+    for (Paths::iterator i = paths_.begin(); i != paths_.end(); ++i) {
+      if (i->second)
+        AddToSpellcheckIndex(i->second);
+    }
+    spellcheck_index_built_ = true;
+  }
+
+  // Each insertion or deletion changes the length by one, so only paths
+  // that many characters longer or shorter can be close enough.  Look at
+  // the nearest lengths first to tighten the bound sooner.
+  const CharHistogram histogram(path);
   int min_distance = kMaxValidEditDistance + 1;
   Node* result = NULL;
-  for (Paths::iterator i = paths_.begin(); i != paths_.end(); ++i) {
-    int distance = EditDistance(
-        i->first, path, kAllowReplacements, kMaxValidEditDistance);
-    if (distance < min_distance && i->second) {
-      min_distance = distance;
-      result = i->second;
+  for (int offset = 0; ; ++offset) {
+    int delta = (offset + 1) / 2;
+    if (delta >= min_distance)
+      break;
+    long length = (long)path.size() + (offset % 2 ? -delta : delta);
+    if (length < 0 || length >= (long)spellcheck_index_.size())
+      continue;
+    const vector<Node*>& nodes = spellcheck_index_[length];
+    for (vector<Node*>::const_iterator n = nodes.begin(); n != nodes.end();
+         ++n) {
+      const string& candidate = (*n)->path();
+      if (CharHistogram(candidate).MinDistance(histogram) >= min_distance)
+        continue;
+      // EditDistance() takes a limit of 0 as none at all.
+      int limit = min_distance - 1;
+      int distance = limit == 0 ? (candidate == path ? 0 : 1) :
+          EditDistance(candidate, path, kAllowReplacements, limit);
+      if (distance < min_distance) {
+        min_distance = distance;
+        result = *n;
+      }
     }
   }
   return result;
@@ -193,6 +345,30 @@ vector<Node*> State::DefaultNodes(string* err) const {
   return defaults_.empty() ? RootNodes(err) : defaults_;
 }
 
+void State::AddToDirIndex(Node* node) {
+  const string& path = node->path();
+  string::size_type slash = path.rfind('/');
+  if (slash != string::npos)
+    dir_index_[path.substr(0, slash + 1)].push_back(node);
+}
+
+void State::ResetEnvUnder(BindingEnv* env) {
+  if (!dir_index_built_) {
+    for (Paths::iterator i = paths_.begin(); i != paths_.end(); ++i)
+      AddToDirIndex(i->second);
+    dir_index_built_ = true;
+  }
+  // The directories below |dir| sort right after it.
+  const string& dir = env->AsString();
+  for (DirIndex::iterator i = dir_index_.lower_bound(dir);
+       i != dir_index_.end() && i->first.compare(0, dir.size(), dir) == 0;
+       ++i) {
+    for (vector<Node*>::iterator n = i->second.begin(); n != i->second.end();
+         ++n)
+      (*n)->ResetEnv(env);
+  }
+}
+
 void State::Reset() {
   for (Paths::iterator i = paths_.begin(); i != paths_.end(); ++i)
     i->second->ResetState();
@@ -200,6 +376,46 @@ void State::Reset() {
     (*e)->outputs_ready_ = false;
     (*e)->deps_loaded_ = false;
     (*e)->mark_ = Edge::VisitNone;
+    (*e)->ClearMemo();
+  }
+}
+
+void State::LinkDeps() {
+  for (vector<Edge*>::iterator e = edges_.begin(); e != edges_.end(); ++e)
+    (*e)->LinkDeps();
+}
+
+void State::ResetDependents(const vector<Node*>& nodes,
+                            vector<Edge*>* edges) {
+  // Edges that weren't scanned have nothing to reset, and an edge is
+  // reset at most once.
+  vector<Edge*> pending;
+  for (vector<Node*>::const_iterator n = nodes.begin(); n != nodes.end();
+       ++n) {
+    Edge* in_edge = (*n)->in_edge();
+    if (in_edge && in_edge->mark_ != Edge::VisitNone)
+      pending.push_back(in_edge);
+    else
+      (*n)->ResetState();
+    const vector<Edge*>& out_edges = (*n)->out_edges();
+    pending.insert(pending.end(), out_edges.begin(), out_edges.end());
+  }
+  while (!pending.empty()) {
+    Edge* edge = pending.back();
+    pending.pop_back();
+    if (edge->mark_ == Edge::VisitNone)
+      continue;
+    edge->outputs_ready_ = false;
+    edge->deps_loaded_ = false;
+    edge->mark_ = Edge::VisitNone;
+    edge->ClearMemo();
+    edges->push_back(edge);
+    for (vector<Node*>::iterator o = edge->outputs_.begin();
+         o != edge->outputs_.end(); ++o) {
+      (*o)->ResetState();
+      pending.insert(pending.end(), (*o)->out_edges().begin(),
+                     (*o)->out_edges().end());
+    }
   }
 }
 
@@ -16,11 +16,13 @@
 #define NINJA_STATE_H_
 
 #include <map>
+#include <queue>
 #include <set>
 #include <string>
 #include <vector>
 using namespace std;
 
+#include "arena.h"
 #include "eval_env.h"
 #include "hash_map.h"
 #include "util.h"
@@ -29,6 +31,63 @@ struct Edge;
 struct Node;
 struct Rule;
 
+/// Orders edges for scheduling: the edges that Edge::fail_first() come
+/// first, then the edge with the heaviest critical path, and ties are
+/// broken by id, so that the order is the same from one run to the next.
+struct EdgePriorityLess {
+  bool operator()(const Edge* a, const Edge* b) const;
+};
+
+/// Orders a heap so that its top is the edge EdgePriorityLess puts first.
+struct EdgePriorityGreater {
+  bool operator()(const Edge* a, const Edge* b) const {
+    return EdgePriorityLess()(b, a);
+  }
+};
+
+/// Edges ready to run; top() is the one to start next.  By default that
+/// is the edge EdgePriorityLess puts first.  Fair-share policies split the
+/// edges into groups that take turns, each offering its own first edge, so
+/// that a group with many ready edges can't hold up the others.
+struct EdgePriorityQueue {
+  enum Policy {
+    /// One group: the heaviest critical path first.
+    kCriticalPath,
+    /// A group for each top-level directory of the chdir scopes, and one
+    /// for the edges outside of them.
+    kRoundRobinSubprojects,
+    /// A group for each pool.
+    kRoundRobinPools,
+  };
+
+  EdgePriorityQueue() : policy_(kCriticalPath), size_(0), next_(0) {}
+
+  /// Change the policy; only while empty.
+  void set_policy(Policy policy);
+
+  void push(Edge* edge);
+  Edge* top() const;
+  void pop();
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+  void clear();
+
+ private:
+  typedef priority_queue<Edge*, vector<Edge*>, EdgePriorityGreater> Heap;
+
+  /// The group |edge| belongs to under policy_.
+  size_t GroupFor(const Edge* edge);
+  /// The group whose turn it is, which isn't empty if size_ isn't 0.
+  size_t Current() const;
+
+  Policy policy_;
+  size_t size_;
+  vector<Heap> groups_;
+  map<string, size_t> group_ids_;
+  /// The group to look at first for the next edge.
+  size_t next_;
+};
+
 /// A pool for delayed edges.
 /// Pools are scoped to a State. Edges within a State will share Pools. A Pool
 /// will keep a count of the total 'weight' of the currently scheduled edges. If
@@ -38,14 +97,27 @@ struct Rule;
 /// the total scheduled weight diminishes enough (i.e. when a scheduled edge
 /// completes).
 struct Pool {
-  Pool(const string& name, int depth)
-    : name_(name), current_use_(0), depth_(depth), delayed_(&WeightedEdgeCmp) {}
+  Pool(const string& name, int depth, bool local_only = false)
+    : name_(name), current_use_(0), depth_(depth), local_only_(local_only),
+      delayed_(&WeightedEdgeCmp) {}
 
   // A depth of 0 is infinite
   bool is_valid() const { return depth_ >= 0; }
   int depth() const { return depth_; }
+  /// Only while no edge is scheduled in the pool, as -t simulate does.
+  void set_depth(int depth) { depth_ = depth; }
+  /// What the depth was worked out from when it depends on the machine or
+  /// the -j of the build, as ManifestParser::EvaluatePoolDepth() takes it;
+  /// empty if it is just a number.
+  const string& depth_expression() const { return depth_expression_; }
+  void set_depth_expression(const string& expression) {
+    depth_expression_ = expression;
+  }
   const string& name() const { return name_; }
   int current_use() const { return current_use_; }
+  /// Whether the edges of this pool have to run on this machine even when
+  /// building with a RemoteLauncher.
+  bool local_only() const { return local_only_; }
 
   /// true if the Pool might delay this edge
   bool ShouldDelayEdge() const { return depth_ != 0; }
@@ -62,7 +134,7 @@ struct Pool {
   void DelayEdge(Edge* edge);
 
   /// Pool will add zero or more edges to the ready_queue
-  void RetrieveReadyEdges(set<Edge*>* ready_queue);
+  void RetrieveReadyEdges(EdgePriorityQueue* ready_queue);
 
   /// Dump the Pool and its edges (useful for debugging).
   void Dump() const;
@@ -74,6 +146,8 @@ struct Pool {
   /// currently scheduled in the Plan (i.e. the edges in Plan::ready_).
   int current_use_;
   int depth_;
+  string depth_expression_;
+  bool local_only_;
 
   static bool WeightedEdgeCmp(const Edge* a, const Edge* b);
 
@@ -96,16 +170,44 @@ struct State {
 
   Node* GetNode(StringPiece path, BindingEnv* env, uint64_t slash_bits);
   Node* LookupNode(StringPiece path) const;
+  /// Create a node in this State's arena, without adding it to paths_.
+  Node* NewNode(BindingEnv* env, const string& path, uint64_t slash_bits);
+  /// Add a node that was created elsewhere, such as in another State.
+  void AddNode(Node* node);
+  /// Take over the memory of |other|, whose nodes and edges this State now
+  /// refers to.
+  void AdoptArena(State* other) { arena_.Adopt(&other->arena_); }
+  /// What holds the nodes and edges, for how much memory they take.
+  const Arena& arena() const { return arena_; }
+  /// How many nodes were made, in paths_ or not.
+  int node_count() const { return node_count_; }
+  /// The node with the path closest to |path|, within a few edits, or NULL.
+  /// The first call indexes the paths, which later calls share.
   Node* SpellcheckNode(const string& path);
 
   void AddIn(Edge* edge, StringPiece path, uint64_t slash_bits);
   bool AddOut(Edge* edge, StringPiece path, uint64_t slash_bits);
   bool AddDefault(StringPiece path, BindingEnv* env, string* error);
 
+  /// Hand every node whose path is below the directory of |env|, a chdir
+  /// scope, over to |env|.  See Node::ResetEnv().
+  void ResetEnvUnder(BindingEnv* env);
+
   /// Reset state.  Keeps all nodes and edges, but restores them to the
   /// state where we haven't yet examined the disk for dirty state.
   void Reset();
 
+  /// Reset() only |nodes|, the edges that depend on them, and those edges'
+  /// outputs, transitively.  A node with an in-edge that was scanned is
+  /// reset along with its in-edge.  The edges reset are added to |edges|,
+  /// and so that the next scan can load their deps again, the caller must
+  /// take off them the deps they loaded; see GraphSnapshot::RestoreEdge().
+  void ResetDependents(const vector<Node*>& nodes, vector<Edge*>* edges);
+
+  /// Add every edge to the out-edges of the discovered deps it left out of
+  /// them; see |defer_dep_links_|.
+  void LinkDeps();
+
   /// Dump the nodes and Pools (useful for debugging).
   void Dump();
 
@@ -115,7 +217,7 @@ struct State {
   vector<Node*> DefaultNodes(string* error) const;
 
   /// Mapping of path -> Node.
-  typedef ExternalStringHashMap<Node*>::Type Paths;
+  typedef ExternalStringHashTable<Node*> Paths;
   Paths paths_;
 
   /// All the pools used in the graph.
@@ -126,6 +228,36 @@ struct State {
 
   BindingEnv bindings_;
   vector<Node*> defaults_;
+
+  /// Whether the deps that edges discover from depfiles and the deps log
+  /// are left out of the out-edges of the source files they name, until
+  /// LinkDeps().  A build only follows out-edges from what it builds, but
+  /// a popular header would otherwise have every object file as one.
+  bool defer_dep_links_;
+
+ private:
+  void AddToDirIndex(Node* node);
+  void AddToSpellcheckIndex(Node* node);
+
+  /// Holds the nodes and edges.  They are never destroyed individually.
+  Arena arena_;
+  /// How many nodes NewNode() made, which is the index of the next.
+  int node_count_;
+
+  /// Nodes in subdirectories by directory (with a trailing slash), so that
+  /// ResetEnvUnder() need not scan every path.  Only built once the first
+  /// chdir scope shows up.
+  typedef map<string, vector<Node*> > DirIndex;
+  DirIndex dir_index_;
+  bool dir_index_built_;
+
+  /// Nodes by the length of their path, so that SpellcheckNode() need only
+  /// look at paths of about the right length.  Built on its first call.
+  vector<vector<Node*> > spellcheck_index_;
+  bool spellcheck_index_built_;
+
+  /// Scratch space for GetNode() to put the path it looks up in.
+  string chdir_path_;
 };
 
 #endif  // NINJA_STATE_H_
@@ -43,4 +43,99 @@ TEST(State, Basic) {
   EXPECT_FALSE(state.GetNode("out", &state.bindings_, 0)->dirty());
 }
 
+TEST(State, ResetEnvUnder) {
+  State state;
+  Node* a = state.GetNode("a/x", &state.bindings_, 0);
+  Node* ab = state.GetNode("a/b/y", &state.bindings_, 0);
+  Node* other = state.GetNode("ab/z", &state.bindings_, 0);
+
+  BindingEnv* env_a = new BindingEnv(&state.bindings_, "a/", "a/");
+  state.ResetEnvUnder(env_a);
+  EXPECT_EQ(env_a, a->GetEnv());
+  EXPECT_EQ(env_a, ab->GetEnv());
+  EXPECT_EQ(&state.bindings_, other->GetEnv());
+
+  // Nodes added after the first chdir are found too.
+  Node* later = state.GetNode("a/b/c/w", &state.bindings_, 0);
+  BindingEnv* env_ab = new BindingEnv(env_a, "b/", "a/b/");
+  state.ResetEnvUnder(env_ab);
+  EXPECT_EQ(env_a, a->GetEnv());
+  EXPECT_EQ(env_ab, ab->GetEnv());
+  EXPECT_EQ(env_ab, later->GetEnv());
+  EXPECT_EQ("a/b/c/w", later->path());
+}
+
+TEST(State, GetNodeInChdir) {
+  State state;
+  BindingEnv* env = new BindingEnv(&state.bindings_, "a/b/", "a/b/");
+  Node* x = state.GetNode("x", env, 0);
+  EXPECT_EQ("a/b/x", x->path());
+  EXPECT_EQ(x, state.GetNode("a/b/x", &state.bindings_, 0));
+  Node* y = state.GetNode("../y", env, 0);
+  EXPECT_EQ("a/y", y->path());
+  EXPECT_EQ(y, state.GetNode("a/y", &state.bindings_, 0));
+  EXPECT_EQ("/abs", state.GetNode("/abs", env, 0)->path());
+
+  string out = "first ";
+  env->AppendChdir("../../z", &out);
+  EXPECT_EQ("first z", out);
+}
+
+TEST(State, SpellcheckNode) {
+  State state;
+  Node* foo = state.GetNode("out/foo.o", &state.bindings_, 0);
+  state.GetNode("out/bar.o", &state.bindings_, 0);
+  state.GetNode("out/foo/long/path.o", &state.bindings_, 0);
+
+  EXPECT_EQ(foo, state.SpellcheckNode("out/fo.o"));
+  EXPECT_EQ(foo, state.SpellcheckNode("out/fooo.o"));
+  EXPECT_EQ(foo, state.SpellcheckNode("out/oof.o"));
+  EXPECT_TRUE(state.SpellcheckNode("elsewhere/foo.o") == NULL);
+  EXPECT_TRUE(state.SpellcheckNode("") == NULL);
+
+  // Nodes added after the first call are found too, and the closest wins.
+  Node* later = state.GetNode("out/foox.o", &state.bindings_, 0);
+  EXPECT_EQ(later, state.SpellcheckNode("out/fooxx.o"));
+  EXPECT_EQ(foo, state.SpellcheckNode("out/foo.oo"));
+}
+
+TEST(State, EdgePriorityQueueRoundRobin) {
+  State state;
+  BindingEnv env_a(&state.bindings_, "a/", "a/");
+  BindingEnv env_ab(&env_a, "b/", "a/b/");
+  BindingEnv env_c(&state.bindings_, "c/", "c/");
+  BindingEnv* envs[] = {
+    &env_a, &env_ab, &env_a, &state.bindings_, &env_c, &env_c
+  };
+  vector<Edge*> edges;
+  for (size_t i = 0; i < sizeof(envs) / sizeof(envs[0]); ++i) {
+    edges.push_back(state.AddEdge(&State::kPhonyRule));
+    edges.back()->env_ = envs[i];
+  }
+
+  // By default, edges come out by id when their critical paths tie.
+  EdgePriorityQueue queue;
+  for (size_t i = edges.size(); i-- > 0; )
+    queue.push(edges[i]);
+  for (size_t i = 0; i < edges.size(); ++i) {
+    EXPECT_EQ(edges[i], queue.top());
+    queue.pop();
+  }
+  EXPECT_TRUE(queue.empty());
+
+  // Subprojects take turns, in the order they first had edges ready: a/
+  // (with a/b/), then c/, then the top level.
+  queue.set_policy(EdgePriorityQueue::kRoundRobinSubprojects);
+  int pushed[] = { 0, 1, 2, 4, 5, 3 };
+  for (size_t i = 0; i < edges.size(); ++i)
+    queue.push(edges[pushed[i]]);
+  EXPECT_EQ(6u, queue.size());
+  int expected[] = { 0, 4, 3, 1, 5, 2 };
+  for (size_t i = 0; i < edges.size(); ++i) {
+    EXPECT_EQ(edges[expected[i]], queue.top());
+    queue.pop();
+  }
+  EXPECT_TRUE(queue.empty());
+}
+
 }  // namespace
@@ -0,0 +1,149 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _WIN32
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#endif
+
+#include "status_events.h"
+
+#ifndef _WIN32
+#include <inttypes.h>
+#endif
+
+#include "graph.h"
+#include "metrics.h"
+#include "state.h"
+
+namespace {
+
+/// Append the field |name| with the number |value| to an event.
+void AppendNumber(const char* name, int64_t value, string* out) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), ",\"%s\":%" PRId64, name, value);
+  *out += buf;
+}
+
+}  // anonymous namespace
+
+void StatusEventWriter::BuildStarted() {
+  start_millis_ = GetTimeMillis();
+  building_ = true;
+  started_.clear();
+  string event;
+  StartEvent("build_started", false, &event);
+  Write(&event);
+  // The builder knows the total before it starts.
+  int total = total_;
+  total_ = -1;
+  if (total >= 0)
+    EdgesPlanned(total);
+}
+
+void StatusEventWriter::EdgesPlanned(int total) {
+  if (total == total_)
+    return;
+  total_ = total;
+  if (!building_)
+    return;
+  string event;
+  StartEvent("total", true, &event);
+  AppendNumber("total", total, &event);
+  Write(&event);
+}
+
+void StatusEventWriter::EdgeStarted(const Edge* edge, int /*started*/,
+                                    int total) {
+  EdgesPlanned(total);
+  int64_t now = Now();
+  started_[edge] = now;
+  string event;
+  StartEvent("edge_started", true, &event);
+  AppendNumber("id", edge->id(), &event);
+  event += ",\"pool\":";
+  AppendJSONString(edge->pool()->name(), &event);
+  event += ",\"description\":";
+  string description = edge->GetBinding("description");
+  AppendJSONString(description.empty() ? edge->EvaluateCommand()
+                                       : description, &event);
+  event += ",\"outputs\":[";
+  for (vector<Node*>::const_iterator o = edge->outputs_.begin();
+       o != edge->outputs_.end(); ++o) {
+    if (o != edge->outputs_.begin())
+      event += ',';
+    AppendJSONString((*o)->path(), &event);
+  }
+  event += ']';
+  Write(&event);
+}
+
+void StatusEventWriter::EdgeFinished(const Edge* edge, bool success,
+                                     const string& output, int /*finished*/,
+                                     int total) {
+  EdgesPlanned(total);
+  int64_t now = Now();
+  int64_t start = now;
+  map<const Edge*, int64_t>::iterator i = started_.find(edge);
+  if (i != started_.end()) {
+    start = i->second;
+    started_.erase(i);
+  }
+  string event;
+  StartEvent("edge_finished", true, &event);
+  AppendNumber("id", edge->id(), &event);
+  event += success ? ",\"success\":true" : ",\"success\":false";
+  AppendNumber("duration", now - start, &event);
+  if (!output.empty()) {
+    event += ",\"output\":";
+    AppendJSONString(output, &event);
+  }
+  Write(&event);
+}
+
+void StatusEventWriter::EdgeDiscarded(const Edge* edge) {
+  started_.erase(edge);
+  string event;
+  StartEvent("edge_discarded", true, &event);
+  AppendNumber("id", edge->id(), &event);
+  Write(&event);
+}
+
+void StatusEventWriter::BuildFinished() {
+  string event;
+  StartEvent("build_finished", true, &event);
+  Write(&event);
+  building_ = false;
+  total_ = -1;
+}
+
+int64_t StatusEventWriter::Now() const {
+  return GetTimeMillis() - start_millis_;
+}
+
+void StatusEventWriter::StartEvent(const char* name, bool timed,
+                                   string* out) const {
+  *out = "{\"event\":\"";
+  *out += name;
+  *out += '"';
+  if (timed)
+    AppendNumber("time", Now(), out);
+}
+
+void StatusEventWriter::Write(string* out) {
+  *out += "}\n";
+  fwrite(out->data(), 1, out->size(), file_);
+  fflush(file_);
+}
@@ -0,0 +1,74 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_STATUS_EVENTS_H_
+#define NINJA_STATUS_EVENTS_H_
+
+#include <stdio.h>
+
+#include <map>
+#include <string>
+using namespace std;
+
+#include "build.h"
+#include "util.h"  // int64_t
+
+/// A BuildObserver that writes how the build goes to |file| as JSON, one
+/// event a line, for a frontend to follow instead of the status lines:
+///   {"event":"build_started"}
+///   {"event":"total","time":T,"total":N}
+///   {"event":"edge_started","time":T,"id":ID,"pool":P,"description":D,
+///    "outputs":[...]}
+///   {"event":"edge_finished","time":T,"id":ID,"success":B,"duration":MS,
+///    "output":O}
+///   {"event":"edge_discarded","time":T,"id":ID}
+///   {"event":"build_finished","time":T}
+/// The times are in milliseconds since the build started, and "output"
+/// is only there if the command printed something.  An edge that is
+/// discarded starts again later.  Each event is written out as it happens.
+struct StatusEventWriter : public BuildObserver {
+  /// Write to |file|, which stays the caller's.
+  explicit StatusEventWriter(FILE* file)
+      : file_(file), start_millis_(0), building_(false), total_(-1) {}
+
+  // Overridden from BuildObserver:
+  virtual void BuildStarted();
+  virtual void EdgesPlanned(int total);
+  virtual void EdgeStarted(const Edge* edge, int started, int total);
+  virtual void EdgeFinished(const Edge* edge, bool success,
+                            const string& output, int finished, int total);
+  virtual void EdgeDiscarded(const Edge* edge);
+  virtual void BuildFinished();
+
+ private:
+  /// Start the event |name| in |*out|, with its time unless |timed| is
+  /// false.
+  void StartEvent(const char* name, bool timed, string* out) const;
+  /// End the event in |out| and write it out.
+  void Write(string* out);
+
+  /// Milliseconds since the build started.
+  int64_t Now() const;
+
+  FILE* file_;
+  int64_t start_millis_;
+  /// Whether BuildStarted() was called, and BuildFinished() wasn't since.
+  bool building_;
+  /// The total last told of, or -1.
+  int total_;
+  /// When each running edge started.
+  map<const Edge*, int64_t> started_;
+};
+
+#endif  // NINJA_STATUS_EVENTS_H_
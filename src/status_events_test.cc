@@ -0,0 +1,99 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "status_events.h"
+
+#include <stdio.h>
+
+#include "graph.h"
+#include "test.h"
+
+namespace {
+
+struct StatusEventWriterTest : public StateTestWithBuiltinRules {
+  virtual void SetUp() {
+    ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"pool link\n"
+"  depth = 1\n"
+"build out1 out2: cat in\n"
+"  description = CAT \"out\"\n"
+"build linked: cat out1\n"
+"  pool = link\n"));
+    file_ = tmpfile();
+    ASSERT_TRUE(file_ != NULL);
+  }
+  virtual void TearDown() {
+    fclose(file_);
+  }
+
+  /// What was written, with the times, which vary, as T.
+  string Events() {
+    string events;
+    rewind(file_);
+    char buf[1024];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), file_)) > 0)
+      events.append(buf, len);
+    const char* kTimes[] = { "\"time\":", "\"duration\":" };
+    for (size_t i = 0; i < sizeof(kTimes) / sizeof(kTimes[0]); ++i) {
+      string key = kTimes[i];
+      for (size_t at = events.find(key); at != string::npos;
+           at = events.find(key, at)) {
+        at += key.size();
+        size_t end = events.find_first_not_of("0123456789", at);
+        events.replace(at, end - at, "T");
+      }
+    }
+    return events;
+  }
+
+  FILE* file_;
+};
+
+TEST_F(StatusEventWriterTest, Build) {
+  StatusEventWriter events(file_);
+  Edge* out = GetNode("out1")->in_edge();
+  Edge* linked = GetNode("linked")->in_edge();
+
+  // The total is known before the build starts.
+  events.EdgesPlanned(2);
+  events.BuildStarted();
+  events.EdgeStarted(out, 1, 2);
+  events.EdgeFinished(out, true, "", 1, 2);
+  events.EdgeStarted(linked, 2, 2);
+  events.EdgeDiscarded(linked);
+  events.EdgesPlanned(3);
+  events.EdgeStarted(linked, 2, 3);
+  events.EdgeFinished(linked, false, "error: \"x\"\n", 2, 3);
+  events.BuildFinished();
+
+  EXPECT_EQ(
+"{\"event\":\"build_started\"}\n"
+"{\"event\":\"total\",\"time\":T,\"total\":2}\n"
+"{\"event\":\"edge_started\",\"time\":T,\"id\":0,\"pool\":\"\","
+    "\"description\":\"CAT \\\"out\\\"\",\"outputs\":[\"out1\",\"out2\"]}\n"
+"{\"event\":\"edge_finished\",\"time\":T,\"id\":0,\"success\":true,"
+    "\"duration\":T}\n"
+"{\"event\":\"edge_started\",\"time\":T,\"id\":1,\"pool\":\"link\","
+    "\"description\":\"cat out1 > linked\",\"outputs\":[\"linked\"]}\n"
+"{\"event\":\"edge_discarded\",\"time\":T,\"id\":1}\n"
+"{\"event\":\"total\",\"time\":T,\"total\":3}\n"
+"{\"event\":\"edge_started\",\"time\":T,\"id\":1,\"pool\":\"link\","
+    "\"description\":\"cat out1 > linked\",\"outputs\":[\"linked\"]}\n"
+"{\"event\":\"edge_finished\",\"time\":T,\"id\":1,\"success\":false,"
+    "\"duration\":T,\"output\":\"error: \\\"x\\\"\\u000a\"}\n"
+"{\"event\":\"build_finished\",\"time\":T}\n", Events());
+}
+
+}  // anonymous namespace
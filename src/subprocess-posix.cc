@@ -15,54 +15,94 @@
 #include "subprocess.h"
 
 #include <sys/select.h>
+#include <algorithm>
+#include <map>
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
 #include <spawn.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
 
 extern char** environ;
 
+#include "metrics.h"
 #include "util.h"
 
-Subprocess::Subprocess(bool use_console) : fd_(-1), pid_(-1),
-                                           use_console_(use_console) {
-}
+namespace {
+
+/// Shell builtins and keywords, which need a shell even in commands that
+/// look plain.  echo, printf and test are here because the builtins and
+/// the binaries don't always agree on options and escapes.
+const char* const kShellWords[] = {
+  ".", ":", "[", "alias", "bg", "break", "case", "cd", "command",
+  "continue", "declare", "do", "done", "echo", "elif", "else", "esac",
+  "eval", "exec", "exit", "export", "false", "fc", "fg", "fi", "for",
+  "function", "getopts", "hash", "if", "in", "jobs", "kill", "let", "local",
+  "newgrp", "printf", "pwd", "read", "readonly", "return", "select", "set",
+  "shift", "source", "test", "then", "time", "times", "trap", "true",
+  "type", "typeset", "ulimit", "umask", "unalias", "unset", "until", "wait",
+  "while", NULL
+};
+
+/// Restricts the calling thread to some processors for as long as it
+/// lives, so that the commands it spawns inherit that.  posix_spawn() has
+/// no attribute for it.
+struct ScopedAffinity {
+  explicit ScopedAffinity(const vector<int>& cpus) : set_(false) {
+#ifdef __linux__
+    if (cpus.empty() || sched_getaffinity(0, sizeof(old_), &old_) < 0)
+      return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (vector<int>::const_iterator c = cpus.begin(); c != cpus.end(); ++c) {
+      if (*c >= 0 && *c < CPU_SETSIZE)
+        CPU_SET(*c, &set);
+    }
+    // A processor that went offline just leaves the command unpinned.
+    set_ = sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+#endif
+  }
+  ~ScopedAffinity() {
+#ifdef __linux__
+    if (set_)
+      sched_setaffinity(0, sizeof(old_), &old_);
+#endif
+  }
 
-Subprocess::~Subprocess() {
-  if (fd_ >= 0)
-    close(fd_);
-  // Reap child if forgotten.
-  if (pid_ != -1)
-    Finish();
-}
+ private:
+  bool set_;
+#ifdef __linux__
+  cpu_set_t old_;
+#endif
+};
 
-bool Subprocess::Start(SubprocessSet* set, const string& command) {
-  int output_pipe[2];
-  if (pipe(output_pipe) < 0)
-    Fatal("pipe: %s", strerror(errno));
-  fd_ = output_pipe[0];
-#if !defined(USE_PPOLL)
-  // If available, we use ppoll in DoWork(); otherwise we use pselect
-  // and so must avoid overly-large FDs.
-  if (fd_ >= static_cast<int>(FD_SETSIZE))
-    Fatal("pipe: %s", strerror(EMFILE));
-#endif  // !USE_PPOLL
-  SetCloseOnExec(fd_);
+/// Spawn |command| with the signal mask |mask|, its stdout and stderr going
+/// to |output_fd| unless it runs on the console, on |cpus| if there are
+/// any.  Returns 0 and fills in |pid|, or returns an errno value.
+int SpawnCommand(const string& command, int output_fd, bool use_console,
+                 const sigset_t* mask, const vector<int>& cpus, pid_t* pid) {
+  ScopedAffinity affinity(cpus);
 
   posix_spawn_file_actions_t action;
   int err = posix_spawn_file_actions_init(&action);
   if (err != 0)
     Fatal("posix_spawn_file_actions_init: %s", strerror(err));
 
-  err = posix_spawn_file_actions_addclose(&action, output_pipe[0]);
-  if (err != 0)
-    Fatal("posix_spawn_file_actions_addclose: %s", strerror(err));
-
   posix_spawnattr_t attr;
   err = posix_spawnattr_init(&attr);
   if (err != 0)
@@ -71,14 +111,14 @@ bool Subprocess::Start(SubprocessSet* set, const string& command) {
   short flags = 0;
 
   flags |= POSIX_SPAWN_SETSIGMASK;
-  err = posix_spawnattr_setsigmask(&attr, &set->old_mask_);
+  err = posix_spawnattr_setsigmask(&attr, mask);
   if (err != 0)
     Fatal("posix_spawnattr_setsigmask: %s", strerror(err));
   // Signals which are set to be caught in the calling process image are set to
   // default action in the new process image, so no explicit
   // POSIX_SPAWN_SETSIGDEF parameter is needed.
 
-  if (!use_console_) {
+  if (!use_console) {
     // Put the child in its own process group, so ctrl-c won't reach it.
     flags |= POSIX_SPAWN_SETPGROUP;
     // No need to posix_spawnattr_setpgroup(&attr, 0), it's the default.
@@ -90,16 +130,16 @@ bool Subprocess::Start(SubprocessSet* set, const string& command) {
       Fatal("posix_spawn_file_actions_addopen: %s", strerror(err));
     }
 
-    err = posix_spawn_file_actions_adddup2(&action, output_pipe[1], 1);
+    err = posix_spawn_file_actions_adddup2(&action, output_fd, 1);
     if (err != 0)
       Fatal("posix_spawn_file_actions_adddup2: %s", strerror(err));
-    err = posix_spawn_file_actions_adddup2(&action, output_pipe[1], 2);
+    err = posix_spawn_file_actions_adddup2(&action, output_fd, 2);
     if (err != 0)
       Fatal("posix_spawn_file_actions_adddup2: %s", strerror(err));
-    err = posix_spawn_file_actions_addclose(&action, output_pipe[1]);
+    err = posix_spawn_file_actions_addclose(&action, output_fd);
     if (err != 0)
       Fatal("posix_spawn_file_actions_addclose: %s", strerror(err));
-    // In the console case, output_pipe is still inherited by the child and
+    // In the console case, output_fd is still inherited by the child and
     // closed when the subprocess finishes, which then notifies ninja.
   }
 #ifdef POSIX_SPAWN_USEVFORK
@@ -110,43 +150,386 @@ bool Subprocess::Start(SubprocessSet* set, const string& command) {
   if (err != 0)
     Fatal("posix_spawnattr_setflags: %s", strerror(err));
 
-  const char* spawned_args[] = { "/bin/sh", "-c", command.c_str(), NULL };
-  err = posix_spawn(&pid_, "/bin/sh", &action, &attr,
-        const_cast<char**>(spawned_args), environ);
-  if (err != 0)
-    Fatal("posix_spawn: %s", strerror(err));
+  // Plain commands are run directly, saving the exec of a shell.  If that
+  // fails the shell runs them after all, to report the error as usual.
+  vector<string> args;
+  err = -1;
+  if (Subprocess::SplitSimpleCommand(command, &args)) {
+    vector<char*> argv;
+    for (vector<string>::iterator i = args.begin(); i != args.end(); ++i)
+      argv.push_back(const_cast<char*>(i->c_str()));
+    argv.push_back(NULL);
+    err = posix_spawnp(pid, argv[0], &action, &attr, &argv[0], environ);
+  }
+  if (err != 0) {
+    const char* spawned_args[] = { "/bin/sh", "-c", command.c_str(), NULL };
+    err = posix_spawn(pid, "/bin/sh", &action, &attr,
+          const_cast<char**>(spawned_args), environ);
+  }
 
-  err = posix_spawnattr_destroy(&attr);
-  if (err != 0)
-    Fatal("posix_spawnattr_destroy: %s", strerror(err));
-  err = posix_spawn_file_actions_destroy(&action);
+  int destroy_err = posix_spawnattr_destroy(&attr);
+  if (destroy_err != 0)
+    Fatal("posix_spawnattr_destroy: %s", strerror(destroy_err));
+  destroy_err = posix_spawn_file_actions_destroy(&action);
+  if (destroy_err != 0)
+    Fatal("posix_spawn_file_actions_destroy: %s", strerror(destroy_err));
+  return err;
+}
+
+/// Read or write exactly |size| bytes, or die.  Returns false at the end
+/// of the file.
+bool ReadFully(int fd, void* data, size_t size) {
+  char* p = static_cast<char*>(data);
+  while (size > 0) {
+    ssize_t len = read(fd, p, size);
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len < 0)
+      Fatal("spawner: read: %s", strerror(errno));
+    if (len == 0)
+      return false;
+    p += len;
+    size -= len;
+  }
+  return true;
+}
+
+void WriteFully(int fd, const void* data, size_t size) {
+  const char* p = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t len = write(fd, p, size);
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len < 0)
+      Fatal("spawner: write: %s", strerror(errno));
+    p += len;
+    size -= len;
+  }
+}
+
+/// Asks the spawner to run a command.  The write end of the command's
+/// output pipe comes along as an SCM_RIGHTS message, the command after.
+struct SpawnRequest {
+  uint32_t command_size;
+  int32_t use_console;
+  /// How many processors to run it on, which follow the command.
+  uint32_t cpu_count;
+};
+
+/// What the spawner sends back: the result of each request in order, and
+/// interleaved with those, the exits of the commands it started.
+struct SpawnReply {
+  enum Kind { kSpawned, kExited };
+  int32_t kind;
+  pid_t pid;
+  /// The errno value of a failed spawn, or the wait status of an exit.
+  int32_t value;
+  struct rusage usage;
+};
+
+/// The socket to the spawner, or -1 if commands are spawned directly.
+int g_spawner_fd = -1;
+pid_t g_spawner_pid = -1;
+
+/// Exits the spawner reported while ninja waited for something else.
+map<pid_t, SpawnReply> g_spawner_exits;
+
+/// Written to by the spawner's SIGCHLD handler, to wake up its poll().
+int g_sigchld_pipe[2];
+
+void OnSigchld(int) {
+  int saved_errno = errno;
+  char c = 0;
+  if (write(g_sigchld_pipe[1], &c, 1) < 0) {}  // Already readable if full.
+  errno = saved_errno;
+}
+
+void OnSpawnerSignal(int) {}
+
+/// The spawner's main loop: run commands on request and report their
+/// exits, until ninja closes the socket.
+NORETURN void RunSpawner(int fd) {
+  if (pipe(g_sigchld_pipe) < 0)
+    Fatal("pipe: %s", strerror(errno));
+  for (int i = 0; i < 2; ++i) {
+    SetCloseOnExec(g_sigchld_pipe[i]);
+    fcntl(g_sigchld_pipe[i], F_SETFL,
+          fcntl(g_sigchld_pipe[i], F_GETFL) | O_NONBLOCK);
+  }
+  struct sigaction act;
+  memset(&act, 0, sizeof(act));
+  act.sa_handler = OnSigchld;
+  act.sa_flags = SA_NOCLDSTOP;
+  if (sigaction(SIGCHLD, &act, NULL) < 0)
+    Fatal("sigaction: %s", strerror(errno));
+  // Ninja decides what happens on ctrl-c; the commands get the signals'
+  // default actions back when they exec.
+  act.sa_handler = OnSpawnerSignal;
+  act.sa_flags = 0;
+  if (sigaction(SIGINT, &act, NULL) < 0 ||
+      sigaction(SIGTERM, &act, NULL) < 0 ||
+      sigaction(SIGHUP, &act, NULL) < 0)
+    Fatal("sigaction: %s", strerror(errno));
+  // A SubprocessSet may already block these in ninja; never in commands.
+  sigset_t mask;
+  if (sigprocmask(SIG_SETMASK, NULL, &mask) < 0)
+    Fatal("sigprocmask: %s", strerror(errno));
+  sigdelset(&mask, SIGINT);
+  sigdelset(&mask, SIGTERM);
+  sigdelset(&mask, SIGHUP);
+
+  string command;
+  vector<int> cpus;
+  for (;;) {
+    pollfd fds[2];
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = g_sigchld_pipe[0];
+    fds[1].events = POLLIN;
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      Fatal("poll: %s", strerror(errno));
+    }
+
+    if (fds[1].revents) {
+      char buf[64];
+      while (read(g_sigchld_pipe[0], buf, sizeof(buf)) > 0) {}
+      SpawnReply reply;
+      memset(&reply, 0, sizeof(reply));
+      reply.kind = SpawnReply::kExited;
+      int status;
+      while ((reply.pid = wait4(-1, &status, WNOHANG, &reply.usage)) > 0) {
+        reply.value = status;
+        WriteFully(fd, &reply, sizeof(reply));
+      }
+    }
+
+    if (fds[0].revents) {
+      SpawnRequest request;
+      char control[CMSG_SPACE(sizeof(int))];
+      iovec iov = { &request, sizeof(request) };
+      msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      ssize_t len;
+      do {
+        len = recvmsg(fd, &msg, 0);
+      } while (len < 0 && errno == EINTR);
+      if (len == 0)
+        _exit(0);
+      cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+      if (len < 0 || !cmsg || cmsg->cmsg_type != SCM_RIGHTS)
+        Fatal("spawner: bad request");
+      int output_fd;
+      memcpy(&output_fd, CMSG_DATA(cmsg), sizeof(output_fd));
+      // The SCM_RIGHTS message marks the start of the request; the rest of
+      // it may come separately.
+      if ((size_t)len < sizeof(request) &&
+          !ReadFully(fd, (char*)&request + len, sizeof(request) - len))
+        _exit(0);
+      command.resize(request.command_size);
+      if (!command.empty() && !ReadFully(fd, &command[0], command.size()))
+        _exit(0);
+      cpus.resize(request.cpu_count);
+      if (!cpus.empty() &&
+          !ReadFully(fd, &cpus[0], cpus.size() * sizeof(cpus[0])))
+        _exit(0);
+
+      SpawnReply reply;
+      memset(&reply, 0, sizeof(reply));
+      reply.kind = SpawnReply::kSpawned;
+      reply.value = SpawnCommand(command, output_fd, request.use_console != 0,
+                                 &mask, cpus, &reply.pid);
+      close(output_fd);
+      WriteFully(fd, &reply, sizeof(reply));
+    }
+  }
+}
+
+/// Read replies from the spawner until one of |kind| about |pid| (any pid
+/// for kSpawned) comes, setting earlier exits aside.
+SpawnReply WaitForSpawner(SpawnReply::Kind kind, pid_t pid) {
+  if (kind == SpawnReply::kExited) {
+    map<pid_t, SpawnReply>::iterator i = g_spawner_exits.find(pid);
+    if (i != g_spawner_exits.end()) {
+      SpawnReply reply = i->second;
+      g_spawner_exits.erase(i);
+      return reply;
+    }
+  }
+  for (;;) {
+    SpawnReply reply;
+    if (!ReadFully(g_spawner_fd, &reply, sizeof(reply)))
+      Fatal("spawner exited unexpectedly");
+    if (reply.kind == kind && (kind == SpawnReply::kSpawned ||
+                               reply.pid == pid))
+      return reply;
+    g_spawner_exits[reply.pid] = reply;
+  }
+}
+
+/// Have the spawner run |command|, returning 0 and filling in |pid| or
+/// returning an errno value like SpawnCommand().
+int SpawnWithSpawner(const string& command, int output_fd, bool use_console,
+                     const vector<int>& cpus, pid_t* pid) {
+  SpawnRequest request;
+  request.command_size = command.size();
+  request.use_console = use_console;
+  request.cpu_count = cpus.size();
+  char control[CMSG_SPACE(sizeof(int))];
+  memset(control, 0, sizeof(control));
+  iovec iov = { &request, sizeof(request) };
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &output_fd, sizeof(output_fd));
+  ssize_t len;
+  do {
+    len = sendmsg(g_spawner_fd, &msg, 0);
+  } while (len < 0 && errno == EINTR);
+  if (len < 0)
+    Fatal("spawner: sendmsg: %s", strerror(errno));
+  WriteFully(g_spawner_fd, (char*)&request + len, sizeof(request) - len);
+  WriteFully(g_spawner_fd, command.data(), command.size());
+  if (!cpus.empty())
+    WriteFully(g_spawner_fd, &cpus[0], cpus.size() * sizeof(cpus[0]));
+
+  SpawnReply reply = WaitForSpawner(SpawnReply::kSpawned, 0);
+  *pid = reply.pid;
+  return reply.value;
+}
+
+}  // namespace
+
+Subprocess::Subprocess(bool use_console) : spill_(NULL), fd_(-1), pid_(-1),
+                                           via_spawner_(false),
+#ifdef USE_EPOLL
+                                           epoll_fd_(-1),
+#endif
+                                           use_console_(use_console) {
+}
+
+Subprocess::~Subprocess() {
+  if (fd_ >= 0)
+    ClosePipe();
+  // Reap child if forgotten.
+  if (pid_ != -1)
+    Finish();
+  if (spill_)
+    fclose(spill_);
+}
+
+bool Subprocess::Start(SubprocessSet* set, const string& command,
+                       const vector<int>& cpus) {
+  METRIC_RECORD("subprocess spawn");
+  int output_pipe[2];
+  if (pipe(output_pipe) < 0)
+    Fatal("pipe: %s", strerror(errno));
+  fd_ = output_pipe[0];
+#if !defined(USE_EPOLL) && !defined(USE_PPOLL)
+  // If available, we use epoll or ppoll in DoWork(); otherwise we use pselect
+  // and so must avoid overly-large FDs.
+  if (fd_ >= static_cast<int>(FD_SETSIZE))
+    Fatal("pipe: %s", strerror(EMFILE));
+#endif  // !USE_EPOLL && !USE_PPOLL
+  SetCloseOnExec(fd_);
+  // OnPipeReady() reads until the pipe is empty.
+  fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+#ifdef USE_EPOLL
+  // Register the pipe once, for as long as it stays open.
+  epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.ptr = this;
+  if (epoll_ctl(set->epoll_fd_, EPOLL_CTL_ADD, fd_, &event) < 0)
+    Fatal("epoll_ctl: %s", strerror(errno));
+  epoll_fd_ = set->epoll_fd_;
+#endif
+
+  via_spawner_ = g_spawner_fd >= 0;
+  int err = via_spawner_ ?
+      SpawnWithSpawner(command, output_pipe[1], use_console_, cpus, &pid_) :
+      SpawnCommand(command, output_pipe[1], use_console_, &set->old_mask_,
+                   cpus, &pid_);
   if (err != 0)
-    Fatal("posix_spawn_file_actions_destroy: %s", strerror(err));
+    Fatal("posix_spawn: %s", strerror(err));
 
   close(output_pipe[1]);
   return true;
 }
 
 void Subprocess::OnPipeReady() {
+  // Drain everything available now rather than a buffer per wakeup.
   char buf[4 << 10];
-  ssize_t len = read(fd_, buf, sizeof(buf));
-  if (len > 0) {
-    buf_.append(buf, len);
-  } else {
-    if (len < 0)
+  for (;;) {
+    ssize_t len = read(fd_, buf, sizeof(buf));
+    if (len > 0) {
+      AppendOutput(buf, len, kMaxBufferedOutput, &buf_, &spill_);
+      if (len < (ssize_t)sizeof(buf))
+        return;
+      continue;
+    }
+    if (len < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return;
+      if (errno == EINTR)
+        continue;
       Fatal("read: %s", strerror(errno));
-    close(fd_);
-    fd_ = -1;
+    }
+    ClosePipe();
+    return;
   }
 }
 
+void Subprocess::ClosePipe() {
+#ifdef USE_EPOLL
+  // A child that is still in the middle of exec() may briefly share the
+  // pipe, and close() doesn't unregister a pipe that other processes hold.
+  if (epoll_fd_ >= 0)
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd_, NULL);
+#endif
+  close(fd_);
+  fd_ = -1;
+}
+
 ExitStatus Subprocess::Finish() {
   assert(pid_ != -1);
   int status;
-  if (waitpid(pid_, &status, 0) < 0)
-    Fatal("waitpid(%d): %s", pid_, strerror(errno));
+  struct rusage usage;
+  if (via_spawner_) {
+    SpawnReply reply = WaitForSpawner(SpawnReply::kExited, pid_);
+    status = reply.value;
+    usage = reply.usage;
+  } else if (wait4(pid_, &status, 0, &usage) < 0) {
+    Fatal("wait4(%d): %s", pid_, strerror(errno));
+  }
   pid_ = -1;
 
+  usage_.user_micros =
+      (int64_t)usage.ru_utime.tv_sec * 1000000 + usage.ru_utime.tv_usec;
+  usage_.system_micros =
+      (int64_t)usage.ru_stime.tv_sec * 1000000 + usage.ru_stime.tv_usec;
+#ifdef __APPLE__
+  usage_.max_rss_kib = usage.ru_maxrss / 1024;  // In bytes there.
+#else
+  usage_.max_rss_kib = usage.ru_maxrss;
+#endif
+  usage_.input_blocks = usage.ru_inblock;
+  usage_.output_blocks = usage.ru_oublock;
+  usage_.voluntary_switches = usage.ru_nvcsw;
+  usage_.involuntary_switches = usage.ru_nivcsw;
+
   if (WIFEXITED(status)) {
     int exit = WEXITSTATUS(status);
     if (exit == 0)
@@ -167,8 +550,89 @@ const string& Subprocess::GetOutput() const {
   return buf_;
 }
 
+void Subprocess::TakeOutput(string* output) {
+  output->clear();
+  output->swap(buf_);
+}
+
+FILE* Subprocess::TakeOutputSpill() {
+  FILE* spill = spill_;
+  spill_ = NULL;
+  if (spill)
+    rewind(spill);
+  return spill;
+}
+
+// static
+bool Subprocess::SplitSimpleCommand(const string& command,
+                                    vector<string>* args) {
+  args->clear();
+  string word;
+  for (size_t i = 0; i <= command.size(); ++i) {
+    char c = i < command.size() ? command[i] : ' ';
+    if (c == ' ' || c == '\t') {
+      if (!word.empty())
+        args->push_back(word);
+      word.clear();
+      continue;
+    }
+    // Anything else could be quoting, expansion, redirection, etc.
+    if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+          (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '+' ||
+          c == '.' || c == '/' || c == ',' || c == ':' || c == '@' ||
+          c == '%' || c == '='))
+      return false;
+    word += c;
+  }
+  if (args->empty() || (*args)[0].find('=') != string::npos)
+    return false;  // Variable assignments need a shell to take effect.
+  for (const char* const* w = kShellWords; *w; ++w) {
+    if ((*args)[0] == *w)
+      return false;
+  }
+  return true;
+}
+
 int SubprocessSet::interrupted_;
 
+// static
+bool SubprocessSet::StartSpawner(string* err) {
+  assert(g_spawner_fd < 0);
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+    *err = string("socketpair: ") + strerror(errno);
+    return false;
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    *err = string("fork: ") + strerror(errno);
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    SetCloseOnExec(fds[1]);
+    RunSpawner(fds[1]);
+  }
+  close(fds[1]);
+  SetCloseOnExec(fds[0]);
+  g_spawner_fd = fds[0];
+  g_spawner_pid = pid;
+  return true;
+}
+
+// static
+void SubprocessSet::StopSpawner() {
+  if (g_spawner_fd < 0)
+    return;
+  close(g_spawner_fd);
+  g_spawner_fd = -1;
+  waitpid(g_spawner_pid, NULL, 0);
+  g_spawner_pid = -1;
+  g_spawner_exits.clear();
+}
+
 void SubprocessSet::SetInterruptedFlag(int signum) {
   interrupted_ = signum;
 }
@@ -206,10 +670,19 @@ SubprocessSet::SubprocessSet() {
     Fatal("sigaction: %s", strerror(errno));
   if (sigaction(SIGHUP, &act, &old_hup_act_) < 0)
     Fatal("sigaction: %s", strerror(errno));
+
+#ifdef USE_EPOLL
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0)
+    Fatal("epoll_create1: %s", strerror(errno));
+#endif
 }
 
 SubprocessSet::~SubprocessSet() {
   Clear();
+#ifdef USE_EPOLL
+  close(epoll_fd_);
+#endif
 
   if (sigaction(SIGINT, &old_int_act_, 0) < 0)
     Fatal("sigaction: %s", strerror(errno));
@@ -221,9 +694,10 @@ SubprocessSet::~SubprocessSet() {
     Fatal("sigprocmask: %s", strerror(errno));
 }
 
-Subprocess *SubprocessSet::Add(const string& command, bool use_console) {
+Subprocess *SubprocessSet::Add(const string& command, bool use_console,
+                               const vector<int>& cpus) {
   Subprocess *subprocess = new Subprocess(use_console);
-  if (!subprocess->Start(this, command)) {
+  if (!subprocess->Start(this, command, cpus)) {
     delete subprocess;
     return 0;
   }
@@ -231,8 +705,38 @@ Subprocess *SubprocessSet::Add(const string& command, bool use_console) {
   return subprocess;
 }
 
-#ifdef USE_PPOLL
-bool SubprocessSet::DoWork() {
+#if defined(USE_EPOLL)
+bool SubprocessSet::DoWork(int timeout_millis) {
+  epoll_event events[64];
+  interrupted_ = 0;
+  int ret = epoll_pwait(epoll_fd_, events, sizeof(events) / sizeof(events[0]),
+                        timeout_millis, &old_mask_);
+  if (ret == -1) {
+    if (errno != EINTR) {
+      perror("ninja: epoll_pwait");
+      return false;
+    }
+    return IsInterrupted();
+  }
+
+  HandlePendingInterruption();
+  if (IsInterrupted())
+    return true;
+
+  for (int i = 0; i < ret; ++i) {
+    Subprocess* subproc = static_cast<Subprocess*>(events[i].data.ptr);
+    subproc->OnPipeReady();
+    if (subproc->Done()) {
+      finished_.push(subproc);
+      running_.erase(find(running_.begin(), running_.end(), subproc));
+    }
+  }
+
+  return IsInterrupted();
+}
+
+#elif defined(USE_PPOLL)
+bool SubprocessSet::DoWork(int timeout_millis) {
   vector<pollfd> fds;
   nfds_t nfds = 0;
 
@@ -246,8 +750,13 @@ bool SubprocessSet::DoWork() {
     ++nfds;
   }
 
+  timespec timeout;
+  timeout.tv_sec = timeout_millis / 1000;
+  timeout.tv_nsec = (timeout_millis % 1000) * 1000000L;
+
   interrupted_ = 0;
-  int ret = ppoll(&fds.front(), nfds, NULL, &old_mask_);
+  int ret = ppoll(&fds.front(), nfds, timeout_millis < 0 ? NULL : &timeout,
+                  &old_mask_);
   if (ret == -1) {
     if (errno != EINTR) {
       perror("ninja: ppoll");
@@ -281,8 +790,8 @@ bool SubprocessSet::DoWork() {
   return IsInterrupted();
 }
 
-#else  // !defined(USE_PPOLL)
-bool SubprocessSet::DoWork() {
+#else  // !defined(USE_EPOLL) && !defined(USE_PPOLL)
+bool SubprocessSet::DoWork(int timeout_millis) {
   fd_set set;
   int nfds = 0;
   FD_ZERO(&set);
@@ -297,8 +806,13 @@ bool SubprocessSet::DoWork() {
     }
   }
 
+  timespec timeout;
+  timeout.tv_sec = timeout_millis / 1000;
+  timeout.tv_nsec = (timeout_millis % 1000) * 1000000L;
+
   interrupted_ = 0;
-  int ret = pselect(nfds, &set, 0, 0, 0, &old_mask_);
+  int ret = pselect(nfds, &set, 0, 0, timeout_millis < 0 ? NULL : &timeout,
+                    &old_mask_);
   if (ret == -1) {
     if (errno != EINTR) {
       perror("ninja: pselect");
@@ -327,7 +841,7 @@ bool SubprocessSet::DoWork() {
 
   return IsInterrupted();
 }
-#endif  // !defined(USE_PPOLL)
+#endif  // !defined(USE_EPOLL) && !defined(USE_PPOLL)
 
 Subprocess* SubprocessSet::NextFinished() {
   if (finished_.empty())
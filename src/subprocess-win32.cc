@@ -19,9 +19,12 @@
 
 #include <algorithm>
 
+#include "metrics.h"
 #include "util.h"
 
-Subprocess::Subprocess(bool use_console) : child_(NULL) , overlapped_(),
+Subprocess::Subprocess(bool use_console) : spill_(NULL), child_(NULL),
+                                           job_(NULL),
+                                           overlapped_(),
                                            is_reading_(false),
                                            use_console_(use_console) {
 }
@@ -34,6 +37,8 @@ Subprocess::~Subprocess() {
   // Reap child if forgotten.
   if (child_)
     Finish();
+  if (spill_)
+    fclose(spill_);
 }
 
 HANDLE Subprocess::SetupPipe(HANDLE ioport) {
@@ -45,7 +50,7 @@ HANDLE Subprocess::SetupPipe(HANDLE ioport) {
                              PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED,
                              PIPE_TYPE_BYTE,
                              PIPE_UNLIMITED_INSTANCES,
-                             0, 0, INFINITE, NULL);
+                             0, sizeof(overlapped_buf_), INFINITE, NULL);
   if (pipe_ == INVALID_HANDLE_VALUE)
     Win32Fatal("CreateNamedPipe");
 
@@ -72,7 +77,9 @@ HANDLE Subprocess::SetupPipe(HANDLE ioport) {
   return output_write_child;
 }
 
-bool Subprocess::Start(SubprocessSet* set, const string& command) {
+bool Subprocess::Start(SubprocessSet* set, const string& command,
+                       const vector<int>& /*cpus*/) {
+  METRIC_RECORD("subprocess spawn");
   HANDLE child_pipe = SetupPipe(set->ioport_);
 
   SECURITY_ATTRIBUTES security_attributes;
@@ -103,7 +110,9 @@ bool Subprocess::Start(SubprocessSet* set, const string& command) {
   memset(&process_info, 0, sizeof(process_info));
 
   // Ninja handles ctrl-c, except for subprocesses in console pools.
-  DWORD process_flags = use_console_ ? 0 : CREATE_NEW_PROCESS_GROUP;
+  // Start suspended so the child is in its job before it can spawn anything.
+  DWORD process_flags = CREATE_SUSPENDED |
+      (use_console_ ? 0 : CREATE_NEW_PROCESS_GROUP);
 
   // Do not prepend 'cmd /c' on Windows, this breaks command
   // lines greater than 8,191 chars.
@@ -138,6 +147,15 @@ bool Subprocess::Start(SubprocessSet* set, const string& command) {
     CloseHandle(child_pipe);
   CloseHandle(nul);
 
+  // Failing to set up the job only costs us tree termination in Clear().
+  job_ = CreateJobObjectA(NULL, NULL);
+  if (job_ && !AssignProcessToJobObject(job_, process_info.hProcess)) {
+    CloseHandle(job_);
+    job_ = NULL;
+  }
+
+  if (ResumeThread(process_info.hThread) == (DWORD)-1)
+    Win32Fatal("ResumeThread");
   CloseHandle(process_info.hThread);
   child_ = process_info.hProcess;
 
@@ -156,7 +174,7 @@ void Subprocess::OnPipeReady() {
   }
 
   if (is_reading_ && bytes)
-    buf_.append(overlapped_buf_, bytes);
+    AppendOutput(overlapped_buf_, bytes, kMaxBufferedOutput, &buf_, &spill_);
 
   memset(&overlapped_, 0, sizeof(overlapped_));
   is_reading_ = true;
@@ -185,8 +203,28 @@ ExitStatus Subprocess::Finish() {
   DWORD exit_code = 0;
   GetExitCodeProcess(child_, &exit_code);
 
+  // Times come in units of 100ns.  The peak working set would need psapi,
+  // and context switches aren't counted per process.
+  FILETIME creation, exit_time, kernel, user;
+  if (GetProcessTimes(child_, &creation, &exit_time, &kernel, &user)) {
+    usage_.user_micros = (((int64_t)user.dwHighDateTime << 32) |
+                          user.dwLowDateTime) / 10;
+    usage_.system_micros = (((int64_t)kernel.dwHighDateTime << 32) |
+                            kernel.dwLowDateTime) / 10;
+  }
+  IO_COUNTERS io;
+  if (GetProcessIoCounters(child_, &io)) {
+    usage_.input_blocks = (int64_t)io.ReadOperationCount;
+    usage_.output_blocks = (int64_t)io.WriteOperationCount;
+  }
+
   CloseHandle(child_);
   child_ = NULL;
+  // Processes the child left behind keep running; only Clear() kills them.
+  if (job_) {
+    CloseHandle(job_);
+    job_ = NULL;
+  }
 
   return exit_code == 0              ? ExitSuccess :
          exit_code == CONTROL_C_EXIT ? ExitInterrupted :
@@ -201,6 +239,19 @@ const string& Subprocess::GetOutput() const {
   return buf_;
 }
 
+void Subprocess::TakeOutput(string* output) {
+  output->clear();
+  output->swap(buf_);
+}
+
+FILE* Subprocess::TakeOutputSpill() {
+  FILE* spill = spill_;
+  spill_ = NULL;
+  if (spill)
+    rewind(spill);
+  return spill;
+}
+
 HANDLE SubprocessSet::ioport_;
 
 SubprocessSet::SubprocessSet() {
@@ -228,9 +279,10 @@ BOOL WINAPI SubprocessSet::NotifyInterrupted(DWORD dwCtrlType) {
   return FALSE;
 }
 
-Subprocess *SubprocessSet::Add(const string& command, bool use_console) {
+Subprocess *SubprocessSet::Add(const string& command, bool use_console,
+                               const vector<int>& cpus) {
   Subprocess *subprocess = new Subprocess(use_console);
-  if (!subprocess->Start(this, command)) {
+  if (!subprocess->Start(this, command, cpus)) {
     delete subprocess;
     return 0;
   }
@@ -241,33 +293,47 @@ Subprocess *SubprocessSet::Add(const string& command, bool use_console) {
   return subprocess;
 }
 
-bool SubprocessSet::DoWork() {
-  DWORD bytes_read;
-  Subprocess* subproc;
-  OVERLAPPED* overlapped;
-
-  if (!GetQueuedCompletionStatus(ioport_, &bytes_read, (PULONG_PTR)&subproc,
-                                 &overlapped, INFINITE)) {
-    if (GetLastError() != ERROR_BROKEN_PIPE)
-      Win32Fatal("GetQueuedCompletionStatus");
+bool SubprocessSet::DoWork(int timeout_millis) {
+  // With -j in the dozens several pipes are often ready at once; drain them
+  // all per wakeup rather than going around the main loop for each.
+  OVERLAPPED_ENTRY entries[64];
+  ULONG removed = 0;
+
+  if (!GetQueuedCompletionStatusEx(ioport_, entries,
+                                   sizeof(entries) / sizeof(entries[0]),
+                                   &removed,
+                                   timeout_millis < 0 ? INFINITE
+                                                      : timeout_millis,
+                                   FALSE)) {
+    if (GetLastError() == WAIT_TIMEOUT)
+      return false;
+    Win32Fatal("GetQueuedCompletionStatusEx");
   }
 
-  if (!subproc) // A NULL subproc indicates that we were interrupted and is
-                // delivered by NotifyInterrupted above.
-    return true;
+  bool interrupted = false;
+  for (ULONG i = 0; i < removed; ++i) {
+    Subprocess* subproc = (Subprocess*)entries[i].lpCompletionKey;
+    if (!subproc) { // A NULL subproc indicates that we were interrupted and
+                    // is delivered by NotifyInterrupted above.
+      interrupted = true;
+      continue;
+    }
 
-  subproc->OnPipeReady();
+    // Failed reads (e.g. a broken pipe) are dequeued too; OnPipeReady picks
+    // up their status from GetOverlappedResult.
+    subproc->OnPipeReady();
 
-  if (subproc->Done()) {
-    vector<Subprocess*>::iterator end =
-        remove(running_.begin(), running_.end(), subproc);
-    if (running_.end() != end) {
-      finished_.push(subproc);
-      running_.resize(end - running_.begin());
+    if (subproc->Done()) {
+      vector<Subprocess*>::iterator end =
+          remove(running_.begin(), running_.end(), subproc);
+      if (running_.end() != end) {
+        finished_.push(subproc);
+        running_.resize(end - running_.begin());
+      }
     }
   }
 
-  return false;
+  return interrupted;
 }
 
 Subprocess* SubprocessSet::NextFinished() {
@@ -288,6 +354,11 @@ void SubprocessSet::Clear() {
                                     GetProcessId((*i)->child_))) {
         Win32Fatal("GenerateConsoleCtrlEvent");
       }
+      // The break only reaches processes attached to our console, and a tool
+      // may ignore it; terminating the job takes down the whole tree so the
+      // Finish() below doesn't wait on it.
+      if ((*i)->job_)
+        TerminateJobObject((*i)->job_, CONTROL_C_EXIT);
     }
   }
   for (vector<Subprocess*>::iterator i = running_.begin();
@@ -35,6 +35,7 @@ using namespace std;
 #endif
 
 #include "exit_status.h"
+#include "util.h"  // ResourceUsage
 
 /// Subprocess wraps a single async subprocess.  It is entirely
 /// passive: it expects the caller to notify it when its fds are ready
@@ -49,14 +50,40 @@ struct Subprocess {
 
   bool Done() const;
 
+  /// The output of the process, or the first kMaxBufferedOutput bytes of it
+  /// if the rest went to a temporary file; see TakeOutputSpill().
   const string& GetOutput() const;
+  /// Move GetOutput() into |output|, leaving it empty, rather than copy it.
+  void TakeOutput(string* output);
+
+  /// Take the temporary file with the output past GetOutput(), rewound to
+  /// its start, or NULL if there is none.  The caller must fclose() it.
+  FILE* TakeOutputSpill();
+
+  /// How much output is kept in memory before the rest goes to a file, so
+  /// that commands printing hundreds of MB don't hold it all at once.
+  static const size_t kMaxBufferedOutput = 1 << 20;
+
+#ifndef _WIN32
+  /// Split |command| into |args| if it can be run without a shell: if it
+  /// is just words of characters no shell treats specially, and the first
+  /// isn't a shell builtin, keyword or variable assignment.
+  /// Exposed for testing.
+  static bool SplitSimpleCommand(const string& command, vector<string>* args);
+#endif
+
+  /// What the process and its waited-for children used, once Finish()ed.
+  const ResourceUsage& usage() const { return usage_; }
 
  private:
   Subprocess(bool use_console);
-  bool Start(struct SubprocessSet* set, const string& command);
+  bool Start(struct SubprocessSet* set, const string& command,
+             const vector<int>& cpus);
   void OnPipeReady();
 
   string buf_;
+  FILE* spill_;
+  ResourceUsage usage_;
 
 #ifdef _WIN32
   /// Set up pipe_ as the parent-side pipe of the subprocess; return the
@@ -64,34 +91,66 @@ struct Subprocess {
   HANDLE SetupPipe(HANDLE ioport);
 
   HANDLE child_;
+  /// Job object holding child_ and everything it spawns, so Clear() can
+  /// take down the whole process tree.  NULL if the child couldn't be
+  /// assigned to a job (e.g. ninja itself runs in a job, pre-Windows 8).
+  HANDLE job_;
   HANDLE pipe_;
   OVERLAPPED overlapped_;
-  char overlapped_buf_[4 << 10];
+  char overlapped_buf_[64 << 10];
   bool is_reading_;
 #else
+  /// Close fd_, taking it out of the set's epoll instance first.
+  void ClosePipe();
+
   int fd_;
   pid_t pid_;
+  /// Whether pid_ is a child of the spawner rather than of ninja.
+  bool via_spawner_;
+#ifdef USE_EPOLL
+  /// The epoll instance of our SubprocessSet, or -1 until started.
+  int epoll_fd_;
+#endif
 #endif
   bool use_console_;
 
   friend struct SubprocessSet;
 };
 
-/// SubprocessSet runs a ppoll/pselect() loop around a set of Subprocesses.
+/// SubprocessSet runs an epoll/ppoll/pselect() loop around a set of
+/// Subprocesses.
 /// DoWork() waits for any state change in subprocesses; finished_
-/// is a queue of subprocesses as they finish.
+/// is a queue of subprocesses as they finish.  A non-negative
+/// |timeout_millis| bounds the wait so callers can do periodic work
+/// (like redrawing the status line) while commands run.
 struct SubprocessSet {
   SubprocessSet();
   ~SubprocessSet();
 
-  Subprocess* Add(const string& command, bool use_console = false);
-  bool DoWork();
+  /// Start |command|.  If |cpus| isn't empty it and what it starts only
+  /// run on those processors, on systems where ninja can tell them to
+  /// (Linux); elsewhere it has no effect.
+  Subprocess* Add(const string& command, bool use_console = false,
+                  const vector<int>& cpus = vector<int>());
+  bool DoWork(int timeout_millis = -1);
   Subprocess* NextFinished();
   void Clear();
 
   vector<Subprocess*> running_;
   queue<Subprocess*> finished_;
 
+#ifndef _WIN32
+  /// Fork a small helper process that spawns the commands of every
+  /// SubprocessSet from then on.  Spawning from ninja itself gets slower
+  /// as its address space grows, so this is best done before loading the
+  /// manifest.  The helper runs commands in the working directory it had
+  /// when started and with the environment it had then.
+  static bool StartSpawner(string* err);
+
+  /// Stop the helper once no commands it spawned are running.
+  static void StopSpawner();
+#endif
+
 #ifdef _WIN32
   static BOOL WINAPI NotifyInterrupted(DWORD dwCtrlType);
   static HANDLE ioport_;
@@ -108,6 +167,11 @@ struct SubprocessSet {
   struct sigaction old_term_act_;
   struct sigaction old_hup_act_;
   sigset_t old_mask_;
+#ifdef USE_EPOLL
+  /// Watches the output pipes of running_, which are registered once, when
+  /// each subprocess starts.
+  int epoll_fd_;
+#endif
 #endif
 };
 
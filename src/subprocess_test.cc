@@ -23,6 +23,9 @@
 #include <sys/resource.h>
 #include <unistd.h>
 #endif
+#ifdef __linux__
+#include <sched.h>
+#endif
 
 namespace {
 
@@ -70,8 +73,41 @@ TEST_F(SubprocessTest, NoSuchCommand) {
 #endif
 }
 
+// A bounded DoWork() returns even though nothing has happened yet.
+TEST_F(SubprocessTest, DoWorkTimeout) {
+#ifdef _WIN32
+  Subprocess* subproc = subprocs_.Add("cmd /c ping -n 3 127.0.0.1 > nul");
+#else
+  Subprocess* subproc = subprocs_.Add("sleep 1");
+#endif
+  ASSERT_NE((Subprocess *) 0, subproc);
+
+  EXPECT_FALSE(subprocs_.DoWork(10));
+  EXPECT_FALSE(subproc->Done());
+  EXPECT_EQ(1u, subprocs_.running_.size());
+
+  while (!subproc->Done()) {
+    subprocs_.DoWork();
+  }
+  EXPECT_EQ(ExitSuccess, subproc->Finish());
+}
+
 #ifndef _WIN32
 
+TEST_F(SubprocessTest, ResourceUsage) {
+  Subprocess* subproc = subprocs_.Add(
+      "i=0; while [ $i -lt 20000 ]; do i=$((i+1)); done");
+  ASSERT_NE((Subprocess *) 0, subproc);
+
+  while (!subproc->Done()) {
+    subprocs_.DoWork();
+  }
+
+  EXPECT_EQ(ExitSuccess, subproc->Finish());
+  EXPECT_GT(subproc->usage().user_micros + subproc->usage().system_micros, 0);
+  EXPECT_GT(subproc->usage().max_rss_kib, 0);
+}
+
 TEST_F(SubprocessTest, InterruptChild) {
   Subprocess* subproc = subprocs_.Add("kill -INT $$");
   ASSERT_NE((Subprocess *) 0, subproc);
@@ -214,7 +250,7 @@ TEST_F(SubprocessTest, SetWithMulti) {
   }
 }
 
-#if defined(USE_PPOLL)
+#if defined(USE_EPOLL) || defined(USE_PPOLL)
 TEST_F(SubprocessTest, SetWithLots) {
   // Arbitrary big number; needs to be over 1024 to confirm we're no longer
   // hostage to pselect.
@@ -258,4 +294,131 @@ TEST_F(SubprocessTest, ReadStdin) {
   ASSERT_EQ(ExitSuccess, subproc->Finish());
   ASSERT_EQ(1u, subprocs_.finished_.size());
 }
+
+// Verify that output much bigger than a pipe buffer arrives intact.
+TEST_F(SubprocessTest, LargeOutput) {
+  Subprocess* subproc = subprocs_.Add("head -c 1000000 /dev/zero");
+  while (!subproc->Done()) {
+    subprocs_.DoWork();
+  }
+  ASSERT_EQ(ExitSuccess, subproc->Finish());
+  EXPECT_EQ(1000000u, subproc->GetOutput().size());
+  EXPECT_TRUE(subproc->TakeOutputSpill() == NULL);
+}
+
+// Verify that output past kMaxBufferedOutput goes to a file, in order.
+TEST_F(SubprocessTest, SpilledOutput) {
+  Subprocess* subproc =
+      subprocs_.Add("head -c 1048575 /dev/zero; echo; echo tail");
+  while (!subproc->Done()) {
+    subprocs_.DoWork();
+  }
+  ASSERT_EQ(ExitSuccess, subproc->Finish());
+  size_t max_buffered = Subprocess::kMaxBufferedOutput;
+  ASSERT_EQ(max_buffered, subproc->GetOutput().size());
+  EXPECT_EQ('\n', subproc->GetOutput()[max_buffered - 1]);
+
+  FILE* spill = subproc->TakeOutputSpill();
+  ASSERT_TRUE(spill != NULL);
+  char buf[16];
+  size_t len = fread(buf, 1, sizeof(buf), spill);
+  fclose(spill);
+  EXPECT_EQ("tail\n", string(buf, len));
+  EXPECT_TRUE(subproc->TakeOutputSpill() == NULL);
+}
+
+TEST_F(SubprocessTest, SplitSimpleCommand) {
+  vector<string> args;
+  EXPECT_TRUE(Subprocess::SplitSimpleCommand(
+      "  g++ -c foo.cc\t-o out/foo.o -DX=1 -I../include", &args));
+  ASSERT_EQ(7u, args.size());
+  EXPECT_EQ("g++", args[0]);
+  EXPECT_EQ("foo.cc", args[2]);
+  EXPECT_EQ("-DX=1", args[5]);
+
+  EXPECT_FALSE(Subprocess::SplitSimpleCommand("", &args));
+  EXPECT_FALSE(Subprocess::SplitSimpleCommand("cc -c a.c > a.o", &args));
+  EXPECT_FALSE(Subprocess::SplitSimpleCommand("cc $CFLAGS a.c", &args));
+  EXPECT_FALSE(Subprocess::SplitSimpleCommand("cc 'a b.c'", &args));
+  EXPECT_FALSE(Subprocess::SplitSimpleCommand("cc a.c && ls", &args));
+  EXPECT_FALSE(Subprocess::SplitSimpleCommand("ls *.c", &args));
+  EXPECT_FALSE(Subprocess::SplitSimpleCommand("ls ~", &args));
+  EXPECT_FALSE(Subprocess::SplitSimpleCommand("CC=gcc make", &args));
+  EXPECT_FALSE(Subprocess::SplitSimpleCommand("cd out", &args));
+  EXPECT_FALSE(Subprocess::SplitSimpleCommand("echo hi", &args));
+  EXPECT_FALSE(Subprocess::SplitSimpleCommand("exit 1", &args));
+}
+
+// Commands run directly still fail like they do through the shell.
+TEST_F(SubprocessTest, DirectExecFailure) {
+  Subprocess* subproc = subprocs_.Add("ninja_no_such_command --flag");
+  while (!subproc->Done()) {
+    subprocs_.DoWork();
+  }
+  EXPECT_EQ(ExitFailure, subproc->Finish());
+  EXPECT_NE(string::npos, subproc->GetOutput().find("not found"));
+}
+
+TEST_F(SubprocessTest, Spawner) {
+  string err;
+  ASSERT_TRUE(SubprocessSet::StartSpawner(&err));
+
+  // Several commands at once, finishing out of order.
+  Subprocess* slow = subprocs_.Add("sleep 0.2; echo slow");
+  Subprocess* fast = subprocs_.Add("printf fast");
+  Subprocess* fail = subprocs_.Add("ninja_no_such_command");
+  ASSERT_NE((Subprocess *) 0, slow);
+  ASSERT_NE((Subprocess *) 0, fast);
+  ASSERT_NE((Subprocess *) 0, fail);
+  while (!slow->Done() || !fast->Done() || !fail->Done())
+    subprocs_.DoWork();
+
+  EXPECT_EQ(ExitSuccess, slow->Finish());
+  EXPECT_EQ("slow\n", slow->GetOutput());
+  EXPECT_EQ(ExitSuccess, fast->Finish());
+  EXPECT_EQ("fast", fast->GetOutput());
+  EXPECT_EQ(ExitFailure, fail->Finish());
+  EXPECT_NE("", fail->GetOutput());
+
+  // Their exit statuses come through intact.
+  Subprocess* interrupted = subprocs_.Add("kill -INT $$");
+  while (!interrupted->Done())
+    subprocs_.DoWork();
+  EXPECT_EQ(ExitInterrupted, interrupted->Finish());
+
+  SubprocessSet::StopSpawner();
+}
+
+#ifdef __linux__
+TEST_F(SubprocessTest, Affinity) {
+  cpu_set_t allowed;
+  ASSERT_EQ(0, sched_getaffinity(0, sizeof(allowed), &allowed));
+  int cpu = CPU_SETSIZE - 1;
+  while (cpu > 0 && !CPU_ISSET(cpu, &allowed))
+    --cpu;
+  char expected[64];
+  snprintf(expected, sizeof(expected), "Cpus_allowed_list:\t%d\n", cpu);
+
+  // Directly and through the spawner.
+  for (int i = 0; i < 2; ++i) {
+    string err;
+    if (i == 1)
+      ASSERT_TRUE(SubprocessSet::StartSpawner(&err));
+    Subprocess* subproc = subprocs_.Add(
+        "grep Cpus_allowed_list /proc/self/status", false,
+        vector<int>(1, cpu));
+    ASSERT_NE((Subprocess *) 0, subproc);
+    while (!subproc->Done())
+      subprocs_.DoWork();
+    EXPECT_EQ(ExitSuccess, subproc->Finish());
+    EXPECT_EQ(string(expected), subproc->GetOutput());
+  }
+  SubprocessSet::StopSpawner();
+
+  // Ninja itself is not held to it.
+  cpu_set_t after;
+  ASSERT_EQ(0, sched_getaffinity(0, sizeof(after), &after));
+  EXPECT_TRUE(CPU_EQUAL(&allowed, &after));
+}
+#endif  // __linux__
 #endif  // _WIN32
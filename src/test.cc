@@ -113,7 +113,7 @@ void AssertParse(State* state, const char* input,
   VerifyGraph(*state);
 }
 
-void AssertHash(const char* expected, uint64_t actual) {
+void AssertHash(const char* expected, Hash128 actual) {
   ASSERT_EQ(BuildLog::LogEntry::HashCommand(expected), actual);
 }
 
@@ -166,6 +166,15 @@ TimeStamp VirtualFileSystem::Stat(const string& path, string* err) const {
   return 0;
 }
 
+bool VirtualFileSystem::Identify(const string& path, FileIdentity* id) const {
+  FileMap::const_iterator i = files_.find(cwd_ + path);
+  if (i == files_.end() || i->second.mtime <= 0)
+    return false;
+  id->size = i->second.contents.size();
+  id->mtime = i->second.mtime;
+  return true;
+}
+
 bool VirtualFileSystem::WriteFile(const string& path, const string& contents) {
   Create(path, contents);
   return true;
@@ -245,6 +254,24 @@ FileReader::Status VirtualFileSystem::Getcwd(string* path, string* err) {
   return Okay;
 }
 
+int VirtualFileSystem::RemoveEmptyDir(const string& path) {
+  vector<string>::iterator dir =
+      find(directories_made_.begin(), directories_made_.end(), path);
+  if (dir == directories_made_.end())
+    return 1;
+  string prefix = path + "/";
+  FileMap::iterator i = files_.lower_bound(prefix);
+  if (i != files_.end() && i->first.compare(0, prefix.size(), prefix) == 0)
+    return 1;
+  for (vector<string>::iterator d = directories_made_.begin();
+       d != directories_made_.end(); ++d) {
+    if (d->compare(0, prefix.size(), prefix) == 0)
+      return 1;
+  }
+  directories_made_.erase(dir);
+  return 0;
+}
+
 int VirtualFileSystem::RemoveFile(const string& path) {
   if (find(directories_made_.begin(), directories_made_.end(), path)
       != directories_made_.end())
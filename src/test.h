@@ -125,7 +125,7 @@ struct StateTestWithBuiltinRules : public testing::Test {
 
 void AssertParse(State* state, const char* input,
                  ManifestParserOptions = ManifestParserOptions());
-void AssertHash(const char* expected, uint64_t actual);
+void AssertHash(const char* expected, Hash128 actual);
 void VerifyGraph(const State& state);
 
 /// An implementation of DiskInterface that uses an in-memory representation
@@ -151,6 +151,8 @@ struct VirtualFileSystem : public DiskInterface {
   virtual Status Chdir(const string& path, string* err);
   virtual Status Getcwd(string* path, string* err);
   virtual int RemoveFile(const string& path);
+  virtual int RemoveEmptyDir(const string& path);
+  virtual bool Identify(const string& path, FileIdentity* id) const;
 
   /// An entry for a single in-memory file.
   struct Entry {
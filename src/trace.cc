@@ -0,0 +1,204 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "trace.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "graph.h"
+#include "metrics.h"
+#include "state.h"
+#include "util.h"
+
+Trace* g_trace = NULL;
+
+namespace {
+
+/// The process ids the tracks are grouped under.
+const int kNinjaPid = 1;
+const int kCommandsPid = 2;
+
+/// A metadata event naming a process or thread.
+void AppendName(const char* kind, int pid, int tid, const string& name,
+                string* out) {
+  char buf[96];
+  snprintf(buf, sizeof(buf),
+           "{\"name\":\"%s_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+           "\"args\":{\"name\":", kind, pid, tid);
+  out->append(buf);
+  AppendJSONString(name, out);
+  out->append("}},\n");
+}
+
+}  // anonymous namespace
+
+Trace::Trace() : origin_(GetTimeMicros()) {
+  // The thread creating the trace is the main one.
+  ThreadTrack();
+}
+
+void Trace::EdgeStarted(const Edge* edge) {
+  int64_t now = GetTimeMicros();
+  ScopedLock lock(&lock_);
+  size_t slot = 0;
+  while (slot < slots_.size() && slots_[slot])
+    ++slot;
+  if (slot == slots_.size())
+    slots_.push_back(true);
+  slots_[slot] = true;
+  running_[edge] = make_pair((int)slot, now);
+}
+
+void Trace::EdgeFinished(const Edge* edge, bool success) {
+  int64_t now = GetTimeMicros();
+  ScopedLock lock(&lock_);
+  map<const Edge*, pair<int, int64_t> >::iterator i = running_.find(edge);
+  if (i == running_.end())
+    return;
+  Event event;
+  event.name = edge->outputs_.empty() ? edge->rule().name() :
+      edge->outputs_[0]->path();
+  event.category = "edge";
+  event.pid = kCommandsPid;
+  event.tid = i->second.first;
+  event.start = i->second.second;
+  event.duration = now - i->second.second;
+  event.args = "\"rule\":";
+  AppendJSONString(edge->rule().name(), &event.args);
+  if (!edge->pool()->name().empty()) {
+    event.args += ",\"pool\":";
+    AppendJSONString(edge->pool()->name(), &event.args);
+  }
+  if (!success)
+    event.args += ",\"failed\":true";
+  events_.push_back(event);
+  slots_[i->second.first] = false;
+  running_.erase(i);
+}
+
+void Trace::AddPhase(const char* name, int64_t start) {
+  int64_t now = GetTimeMicros();
+  ScopedLock lock(&lock_);
+  Event event;
+  event.name = name;
+  event.category = "ninja";
+  event.pid = kNinjaPid;
+  event.tid = ThreadTrack();
+  event.start = start;
+  event.duration = now - start;
+  events_.push_back(event);
+}
+
+void Trace::AddCounter(const char* name,
+                       const vector<pair<const char*, double> >& values) {
+  Event event;
+  event.name = name;
+  event.category = "ninja";
+  event.pid = kNinjaPid;
+  event.tid = 0;
+  event.start = GetTimeMicros();
+  event.duration = -1;
+  for (vector<pair<const char*, double> >::const_iterator v = values.begin();
+       v != values.end(); ++v) {
+    if (!event.args.empty())
+      event.args += ",";
+    AppendJSONString(v->first, &event.args);
+    char buf[32];
+    snprintf(buf, sizeof(buf), ":%.1f", v->second);
+    event.args += buf;
+  }
+  ScopedLock lock(&lock_);
+  events_.push_back(event);
+}
+
+int Trace::ThreadTrack() {
+#ifdef NINJA_HAVE_THREADS
+  std::thread::id id = std::this_thread::get_id();
+  map<std::thread::id, int>::iterator i = thread_tracks_.find(id);
+  if (i != thread_tracks_.end())
+    return i->second;
+  int track = (int)thread_tracks_.size();
+  thread_tracks_[id] = track;
+  return track;
+#else
+  return 0;
+#endif
+}
+
+bool Trace::Write(const string& path, string* err) {
+  ScopedLock lock(&lock_);
+  string out = "{\"traceEvents\":[\n";
+  AppendName("process", kNinjaPid, 0, "ninja", &out);
+  AppendName("process", kCommandsPid, 0, "commands", &out);
+  int threads = 1;
+#ifdef NINJA_HAVE_THREADS
+  threads = (int)thread_tracks_.size();
+#endif
+  for (int t = 0; t < threads; ++t) {
+    char name[32];
+    snprintf(name, sizeof(name), t ? "thread %d" : "main", t);
+    AppendName("thread", kNinjaPid, t, name, &out);
+  }
+  for (size_t s = 0; s < slots_.size(); ++s) {
+    char name[32];
+    snprintf(name, sizeof(name), "slot %d", (int)s + 1);
+    AppendName("thread", kCommandsPid, (int)s, name, &out);
+  }
+
+  for (vector<Event>::const_iterator e = events_.begin(); e != events_.end();
+       ++e) {
+    out += "{\"name\":";
+    AppendJSONString(e->name, &out);
+    char buf[160];
+    if (e->duration < 0) {
+      snprintf(buf, sizeof(buf),
+               ",\"cat\":\"%s\",\"ph\":\"C\",\"pid\":%d,\"tid\":%d,"
+               "\"ts\":%" PRId64 ",\"args\":{",
+               e->category, e->pid, e->tid, e->start - origin_);
+    } else {
+      snprintf(buf, sizeof(buf),
+               ",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+               "\"ts\":%" PRId64 ",\"dur\":%" PRId64 ",\"args\":{",
+               e->category, e->pid, e->tid, e->start - origin_, e->duration);
+    }
+    out += buf;
+    out += e->args;
+    out += "}},\n";
+  }
+  // Every event is followed by a comma, and there is at least one.
+  out.resize(out.size() - 2);
+  out += "\n]}\n";
+
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) {
+    *err = strerror(errno);
+    return false;
+  }
+  bool written = fwrite(out.data(), 1, out.size(), f) == out.size();
+  if (fclose(f) < 0 || !written) {
+    *err = strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+ScopedTracePhase::ScopedTracePhase(const char* name)
+    : name_(name), start_(g_trace ? GetTimeMicros() : 0) {}
+
+ScopedTracePhase::~ScopedTracePhase() {
+  if (g_trace)
+    g_trace->AddPhase(name_, start_);
+}
@@ -0,0 +1,98 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_TRACE_H_
+#define NINJA_TRACE_H_
+
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "parallel.h"
+#include "util.h"  // int64_t
+
+struct Edge;
+
+/// A timeline of the build, for the debug mode that writes it out in the
+/// Chrome Trace Event format, which chrome://tracing and Perfetto show.
+/// The commands appear on one track per slot of parallelism, in the order
+/// slots free up, and Ninja's own work appears on one track per thread
+/// doing it.  To add a phase of Ninja's work, see TRACE_PHASE below.
+/// May be used from several threads at once.
+struct Trace {
+  Trace();
+
+  void EdgeStarted(const Edge* edge);
+  void EdgeFinished(const Edge* edge, bool success);
+
+  /// Record a phase of Ninja's own work on the calling thread, from
+  /// |start| to now, as returned by GetTimeMicros().
+  void AddPhase(const char* name, int64_t start);
+
+  /// Record the |values| of a counter as of now, which the timeline shows
+  /// as a graph on the track of Ninja's work.
+  void AddCounter(const char* name,
+                  const vector<pair<const char*, double> >& values);
+
+  /// Write the events recorded so far to |path|.
+  bool Write(const string& path, string* err);
+
+ private:
+  struct Event {
+    string name;
+    const char* category;
+    int pid;
+    int tid;
+    int64_t start;
+    /// Or -1, for a counter.
+    int64_t duration;
+    /// The members of the "args" object, as JSON.
+    string args;
+  };
+
+  /// The track of the calling thread, allocated on first use.
+  int ThreadTrack();
+
+  Mutex lock_;
+  int64_t origin_;
+  vector<Event> events_;
+  /// For each running edge, its slot and when it started.
+  map<const Edge*, pair<int, int64_t> > running_;
+  /// Whether each slot is taken.
+  vector<bool> slots_;
+#ifdef NINJA_HAVE_THREADS
+  map<std::thread::id, int> thread_tracks_;
+#endif
+};
+
+/// A scoped object recording a phase across the body of a function.
+/// Used by the TRACE_PHASE macro.
+struct ScopedTracePhase {
+  explicit ScopedTracePhase(const char* name);
+  ~ScopedTracePhase();
+
+ private:
+  const char* name_;
+  int64_t start_;
+};
+
+/// Use TRACE_PHASE("foobar") at the top of a function to have each call of
+/// it appear on the timeline.  Meant for coarse phases, as every call is
+/// kept until the trace is written.
+#define TRACE_PHASE(name) ScopedTracePhase trace_h_phase(name)
+
+extern Trace* g_trace;
+
+#endif  // NINJA_TRACE_H_
@@ -0,0 +1,120 @@
+// Copyright 2019 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "trace.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "graph.h"
+#include "metrics.h"
+#include "state.h"
+#include "test.h"
+
+namespace {
+
+const char kTestFilename[] = "TraceTest-tempfile";
+
+struct TraceTest : public StateTestWithBuiltinRules {
+  virtual void TearDown() {
+    unlink(kTestFilename);
+  }
+
+  string Written(Trace* trace) {
+    string err, contents;
+    EXPECT_TRUE(trace->Write(kTestFilename, &err));
+    EXPECT_EQ("", err);
+    EXPECT_EQ(0, ReadFile(kTestFilename, &contents, &err));
+    return contents;
+  }
+
+  /// Whether |trace| has the event |name| on track |tid| of process |pid|.
+  bool HasEvent(const string& trace, const string& name, int pid, int tid) {
+    char track[64];
+    snprintf(track, sizeof(track), "\"ph\":\"X\",\"pid\":%d,\"tid\":%d,",
+             pid, tid);
+    size_t event = trace.find("{\"name\":\"" + name + "\"");
+    return event != string::npos &&
+        trace.find(track, event) == trace.find("\"ph\"", event);
+  }
+};
+
+TEST_F(TraceTest, EdgesTakeFreeSlots) {
+  ASSERT_NO_FATAL_FAILURE(AssertParse(&state_,
+"pool link_pool\n"
+"  depth = 1\n"
+"build a: cat in\n"
+"build b: cat in\n"
+"build c: cat a b\n"
+"  pool = link_pool\n"));
+  Trace trace;
+  trace.EdgeStarted(GetNode("a")->in_edge());
+  trace.EdgeStarted(GetNode("b")->in_edge());
+  trace.EdgeFinished(GetNode("a")->in_edge(), true);
+  trace.EdgeStarted(GetNode("c")->in_edge());
+  trace.EdgeFinished(GetNode("b")->in_edge(), true);
+  trace.EdgeFinished(GetNode("c")->in_edge(), false);
+
+  string written = Written(&trace);
+  EXPECT_TRUE(HasEvent(written, "a", 2, 0));
+  EXPECT_TRUE(HasEvent(written, "b", 2, 1));
+  // c reuses the slot a freed.
+  EXPECT_TRUE(HasEvent(written, "c", 2, 0));
+  EXPECT_NE(string::npos, written.find(
+      "\"args\":{\"rule\":\"cat\",\"pool\":\"link_pool\",\"failed\":true}"));
+  EXPECT_NE(string::npos, written.find(
+      "\"tid\":1,\"args\":{\"name\":\"slot 2\"}"));
+  EXPECT_EQ("{\"traceEvents\":[\n", written.substr(0, 17));
+  EXPECT_EQ("}\n]}\n", written.substr(written.size() - 5));
+}
+
+TEST_F(TraceTest, Phases) {
+  Trace trace;
+  Trace* old_trace = g_trace;
+  g_trace = &trace;
+  {
+    TRACE_PHASE("outer");
+    {
+      TRACE_PHASE("in\"ner");
+    }
+  }
+  trace.AddPhase("explicit", GetTimeMicros());
+  g_trace = old_trace;
+
+  string written = Written(&trace);
+  EXPECT_TRUE(HasEvent(written, "outer", 1, 0));
+  EXPECT_TRUE(HasEvent(written, "in\\\"ner", 1, 0));
+  EXPECT_TRUE(HasEvent(written, "explicit", 1, 0));
+  EXPECT_NE(string::npos, written.find(
+      "\"tid\":0,\"args\":{\"name\":\"main\"}"));
+}
+
+TEST_F(TraceTest, Counters) {
+  Trace trace;
+  vector<pair<const char*, double> > values;
+  values.push_back(make_pair("wait", 75.0));
+  values.push_back(make_pair("plan", 12.5));
+  trace.AddCounter("loop", values);
+
+  string written = Written(&trace);
+  size_t event = written.find("{\"name\":\"loop\",\"cat\":\"ninja\","
+                              "\"ph\":\"C\",\"pid\":1,\"tid\":0,");
+  ASSERT_NE(string::npos, event);
+  EXPECT_EQ(string::npos, written.find("\"dur\"", event));
+  EXPECT_NE(string::npos,
+            written.find("\"args\":{\"wait\":75.0,\"plan\":12.5}}", event));
+}
+
+}  // anonymous namespace
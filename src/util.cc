@@ -38,6 +38,8 @@
 #include <sys/time.h>
 #endif
 
+#include <algorithm>
+#include <math.h>
 #include <vector>
 
 #if defined(__APPLE__) || defined(__FreeBSD__)
@@ -110,6 +112,20 @@ static bool IsPathSeparator(char c) {
 #endif
 }
 
+/// The first path separator in [begin, end), or end if there is none.
+static inline const char* FindPathSeparator(const char* begin,
+                                            const char* end) {
+#ifdef _WIN32
+  while (begin != end && !IsPathSeparator(*begin))
+    ++begin;
+  return begin;
+#else
+  // memchr() looks at a word or a vector register's worth of bytes at once.
+  const void* separator = memchr(begin, '/', end - begin);
+  return separator ? static_cast<const char*>(separator) : end;
+#endif
+}
+
 bool CanonicalizePath(char* path, size_t* len, uint64_t* slash_bits,
                       string* err) {
   // WARNING: this function is performance-critical; please benchmark
@@ -177,9 +193,13 @@ bool CanonicalizePath(char* path, size_t* len, uint64_t* slash_bits,
     components[component_count] = dst;
     ++component_count;
 
-    while (src != end && !IsPathSeparator(*src))
-      *dst++ = *src++;
-    *dst++ = *src++;  // Copy '/' or final \0 character as well.
+    // Copy '/' or final \0 character as well.  Until a component is
+    // dropped, the path is already canonical and nothing needs moving.
+    size_t component_len = FindPathSeparator(src, end) - src + 1;
+    if (dst != src)
+      memmove(dst, src, component_len);
+    dst += component_len;
+    src += component_len;
   }
 
   if (dst == start) {
@@ -313,6 +333,24 @@ void GetWin32EscapedString(const string& input, string* result) {
   result->push_back(kQuote);
 }
 
+void AppendJSONString(const string& str, string* out) {
+  out->push_back('"');
+  for (size_t i = 0; i < str.size(); ++i) {
+    unsigned char c = str[i];
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out->append(buf);
+    } else {
+      out->push_back(c);
+    }
+  }
+  out->push_back('"');
+}
+
 int ReadFile(const string& path, string* contents, string* err) {
 #ifdef _WIN32
   // This makes a ninja run on a set of 1500 manifest files about 4% faster
@@ -389,6 +427,77 @@ void SetCloseOnExec(int fd) {
 #endif  // ! _WIN32
 }
 
+FILE* OpenTempFile(string* err) {
+#ifdef _WIN32
+  char dir[MAX_PATH + 1], path[MAX_PATH + 1];
+  if (!GetTempPathA(sizeof(dir), dir) ||
+      !GetTempFileNameA(dir, "nin", 0, path)) {
+    *err = GetLastErrorString();
+    return NULL;
+  }
+  HANDLE handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                              CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_TEMPORARY |
+                                  FILE_FLAG_DELETE_ON_CLOSE,
+                              NULL);
+  if (handle == INVALID_HANDLE_VALUE) {
+    *err = GetLastErrorString();
+    DeleteFileA(path);
+    return NULL;
+  }
+  int fd = _open_osfhandle((intptr_t)handle, _O_BINARY);
+  if (fd < 0) {
+    *err = strerror(errno);
+    CloseHandle(handle);
+    return NULL;
+  }
+  FILE* file = _fdopen(fd, "w+b");
+  if (!file) {
+    *err = strerror(errno);
+    _close(fd);
+  }
+  return file;
+#else
+  const char* dir = getenv("TMPDIR");
+  string path = string(dir && *dir ? dir : "/tmp") + "/ninja.XXXXXX";
+  int fd = mkstemp(&path[0]);
+  if (fd < 0) {
+    *err = strerror(errno);
+    return NULL;
+  }
+  unlink(path.c_str());
+  SetCloseOnExec(fd);
+  FILE* file = fdopen(fd, "w+");
+  if (!file) {
+    *err = strerror(errno);
+    close(fd);
+  }
+  return file;
+#endif
+}
+
+void AppendOutput(const char* data, size_t len, size_t limit, string* buf,
+                  FILE** spill) {
+  if (!*spill && buf->size() + len > limit) {
+    string err;
+    *spill = OpenTempFile(&err);
+    if (!*spill) {
+      // Only complain once per command.
+      if (buf->size() <= limit)
+        Warning("keeping command output in memory: %s", err.c_str());
+      limit = string::npos;
+    }
+  }
+  if (!*spill) {
+    buf->append(data, len);
+    return;
+  }
+  size_t head = buf->size() < limit ? min(limit - buf->size(), len) : 0;
+  buf->append(data, head);
+  if (fwrite(data + head, 1, len - head, *spill) != len - head)
+    Fatal("writing command output: %s", strerror(errno));
+}
+
 
 const char* SpellcheckStringV(const string& text,
                               const vector<const char*>& words) {
@@ -496,6 +605,18 @@ int GetProcessorCount() {
 #endif
 }
 
+int GuessParallelism() {
+  switch (int processors = GetProcessorCount()) {
+  case 0:
+  case 1:
+    return 2;
+  case 2:
+    return 3;
+  default:
+    return processors + 2;
+  }
+}
+
 #if defined(_WIN32) || defined(__CYGWIN__)
 static double CalculateProcessorLoad(uint64_t idle_ticks, uint64_t total_ticks)
 {
@@ -595,6 +716,224 @@ double GetLoadAverage() {
 }
 #endif // _WIN32
 
+#if defined(__linux__)
+namespace {
+
+/// Read the first number following |key| in |path|, or -1 if there is
+/// none.  |key| must match a whole line prefix, e.g. "MemAvailable:".
+int64_t ReadKeyedValue(const string& path, const char* key) {
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f)
+    return -1;
+  int64_t value = -1;
+  size_t key_len = strlen(key);
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    if (strncmp(line, key, key_len) == 0) {
+      value = strtoll(line + key_len, NULL, 10);
+      break;
+    }
+  }
+  fclose(f);
+  return value;
+}
+
+/// Read a cgroup file holding a single number, or -1 if it is missing or
+/// says "max".
+int64_t ReadCgroupValue(const string& path) {
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f)
+    return -1;
+  char line[64];
+  int64_t value = -1;
+  if (fgets(line, sizeof(line), f)) {
+    char* end;
+    value = strtoll(line, &end, 10);
+    if (end == line)
+      value = -1;
+  }
+  fclose(f);
+  return value;
+}
+
+/// The directory of our cgroup v2 in the unified hierarchy, or "" if we
+/// don't run in one.
+string GetCgroupDir() {
+  FILE* f = fopen("/proc/self/cgroup", "r");
+  if (!f)
+    return "";
+  string dir;
+  char line[4096];
+  while (fgets(line, sizeof(line), f)) {
+    if (strncmp(line, "0::", 3) == 0) {
+      dir = line + 3;
+      if (!dir.empty() && dir[dir.size() - 1] == '\n')
+        dir.resize(dir.size() - 1);
+      break;
+    }
+  }
+  fclose(f);
+  return dir;
+}
+
+/// The total in the "some" line of the pressure file |path|, or -1.
+int64_t ReadPressureTotal(const string& path) {
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f)
+    return -1;
+  int64_t total = -1;
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    const char* field = strstr(line, " total=");
+    if (strncmp(line, "some ", 5) == 0 && field) {
+      total = strtoll(field + 7, NULL, 10);
+      break;
+    }
+  }
+  fclose(f);
+  return total;
+}
+
+}  // anonymous namespace
+
+CpuPressure::CpuPressure()
+    : last_stall_micros_(-1), last_millis_(-1), smoothed_(-1) {
+  string cgroup = GetCgroupDir();
+  if (!cgroup.empty() &&
+      ReadPressureTotal("/sys/fs/cgroup" + cgroup + "/cpu.pressure") >= 0)
+    path_ = "/sys/fs/cgroup" + cgroup + "/cpu.pressure";
+  else if (ReadPressureTotal("/proc/pressure/cpu") >= 0)
+    path_ = "/proc/pressure/cpu";
+}
+
+double CpuPressure::Read() {
+  if (path_.empty())
+    return -1;
+  int64_t now = GetTimeMillis();
+  if (last_millis_ >= 0 && now - last_millis_ < kSampleMillis)
+    return smoothed_;
+  int64_t stall = ReadPressureTotal(path_);
+  if (stall < 0)
+    return smoothed_;
+  return Update(stall, now);
+}
+
+int64_t GetAvailableMemory() {
+  int64_t available = ReadKeyedValue("/proc/meminfo", "MemAvailable:");
+  if (available >= 0)
+    available *= 1024;
+
+  // Any cgroup between ours and the root may limit us.  Their usage counts
+  // page cache too, but inactive cache can be reclaimed before we'd run out.
+  static const string cgroup = GetCgroupDir();
+  if (cgroup.empty())
+    return available;
+  string dir = "/sys/fs/cgroup" + cgroup;
+  for (;;) {
+    int64_t max = ReadCgroupValue(dir + "/memory.max");
+    int64_t current = ReadCgroupValue(dir + "/memory.current");
+    if (max >= 0 && current >= 0) {
+      int64_t inactive = ReadKeyedValue(dir + "/memory.stat", "inactive_file ");
+      if (inactive > 0 && inactive < current)
+        current -= inactive;
+      int64_t left = max > current ? max - current : 0;
+      if (available < 0 || left < available)
+        available = left;
+    }
+    size_t slash = dir.rfind('/');
+    if (slash == string::npos || slash <= strlen("/sys/fs/cgroup"))
+      break;
+    dir.resize(slash);
+  }
+  return available;
+}
+
+int64_t GetTotalMemory() {
+  int64_t total = ReadKeyedValue("/proc/meminfo", "MemTotal:");
+  if (total >= 0)
+    total *= 1024;
+  static const string cgroup = GetCgroupDir();
+  if (cgroup.empty())
+    return total;
+  string dir = "/sys/fs/cgroup" + cgroup;
+  for (;;) {
+    int64_t max = ReadCgroupValue(dir + "/memory.max");
+    if (max >= 0 && (total < 0 || max < total))
+      total = max;
+    size_t slash = dir.rfind('/');
+    if (slash == string::npos || slash <= strlen("/sys/fs/cgroup"))
+      break;
+    dir.resize(slash);
+  }
+  return total;
+}
+#elif defined(_WIN32)
+int64_t GetAvailableMemory() {
+  MEMORYSTATUSEX status;
+  status.dwLength = sizeof(status);
+  if (!GlobalMemoryStatusEx(&status))
+    return -1;
+  return status.ullAvailPhys;
+}
+
+int64_t GetTotalMemory() {
+  MEMORYSTATUSEX status;
+  status.dwLength = sizeof(status);
+  if (!GlobalMemoryStatusEx(&status))
+    return -1;
+  return status.ullTotalPhys;
+}
+#else
+int64_t GetAvailableMemory() {
+  return -1;
+}
+
+int64_t GetTotalMemory() {
+#if defined(__APPLE__) || defined(__FreeBSD__)
+  int64_t total = 0;
+  size_t len = sizeof(total);
+  int mib[2] = { CTL_HW,
+#ifdef __APPLE__
+                 HW_MEMSIZE
+#else
+                 HW_PHYSMEM
+#endif
+  };
+  if (sysctl(mib, 2, &total, &len, NULL, 0) == 0 && len == sizeof(total))
+    return total;
+#endif
+  return -1;
+}
+#endif  // __linux__
+
+#if !defined(__linux__)
+CpuPressure::CpuPressure()
+    : last_stall_micros_(-1), last_millis_(-1), smoothed_(-1) {}
+
+double CpuPressure::Read() {
+  return -1;
+}
+#endif
+
+double CpuPressure::Update(int64_t stall_micros, int64_t now_millis) {
+  if (last_millis_ >= 0 && now_millis > last_millis_ &&
+      stall_micros >= last_stall_micros_) {
+    int64_t elapsed = now_millis - last_millis_;
+    double share = (stall_micros - last_stall_micros_) / (elapsed * 1000.0);
+    share = min(share, 1.0);
+    // Readings far apart weigh more, so that the time the smoothing takes
+    // doesn't depend on how often the pressure is read.
+    double weight = 1 - exp(-(double)elapsed / kSmoothingMillis);
+    if (smoothed_ < 0)
+      smoothed_ = share;
+    else
+      smoothed_ += weight * (share - smoothed_);
+  }
+  last_stall_micros_ = stall_micros;
+  last_millis_ = now_millis;
+  return smoothed_;
+}
+
 string ElideMiddle(const string& str, size_t width) {
   const int kMargin = 3;  // Space for "...".
   string result = str;
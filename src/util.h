@@ -68,6 +68,9 @@ bool CanonicalizePath(char* path, size_t* len, uint64_t* slash_bits,
 void GetShellEscapedString(const string& input, string* result);
 void GetWin32EscapedString(const string& input, string* result);
 
+/// Appends |str| to |*out| as a quoted JSON string.
+void AppendJSONString(const string& str, string* out);
+
 /// Read a file to a string (in text mode: with CRLF conversion
 /// on Windows).
 /// Returns -errno and fills in \a err on error.
@@ -76,6 +79,17 @@ int ReadFile(const string& path, string* contents, string* err);
 /// Mark a file descriptor to not be inherited on exec()s.
 void SetCloseOnExec(int fd);
 
+/// Open a temporary file for reading and writing that has no name, or loses
+/// it once closed, so that it never outlives the process.  Returns NULL and
+/// fills in \a err on error.
+FILE* OpenTempFile(string* err);
+
+/// Append |len| bytes of command output to |*buf| until it holds |limit|
+/// bytes, and the rest to |*spill|, a temporary file opened when first
+/// needed.  If that fails the output stays in memory.
+void AppendOutput(const char* data, size_t len, size_t limit, string* buf,
+                  FILE** spill);
+
 /// Given a misspelled string and a list of correct spellings, returns
 /// the closest match or NULL if there is no close enough match.
 const char* SpellcheckStringV(const string& text,
@@ -93,10 +107,71 @@ string StripAnsiEscapeCodes(const string& in);
 /// guess for how many jobs to run in parallel.  @return 0 on error.
 int GetProcessorCount();
 
+/// Choose a default value for the -j (parallelism) flag.
+int GuessParallelism();
+
 /// @return the load average of the machine. A negative value is returned
 /// on error.
 double GetLoadAverage();
 
+/// Follows how much of the time tasks wait for a CPU, from the pressure
+/// stall information of Linux for the cgroup v2 we run in, or else for the
+/// whole system: a measure of load that, unlike the load average, is fresh
+/// within a fraction of a second.
+struct CpuPressure {
+  CpuPressure();
+
+  /// The share of the time, from 0 to 1, that some runnable task waited
+  /// for a CPU lately, smoothed over about a second; negative if unknown,
+  /// which it is until two readings were taken.
+  double Read();
+
+  /// Take in a reading of |stall_micros|, the total time that tasks waited
+  /// as the kernel counts it, at |now_millis|, returning what Read() does.
+  double Update(int64_t stall_micros, int64_t now_millis);
+
+  /// Whether the pressure can be read at all.
+  bool available() const { return !path_.empty(); }
+
+ private:
+  /// How often the pressure is read at most, and how long it takes a
+  /// change to count for about two thirds.
+  static const int64_t kSampleMillis = 100;
+  static const int64_t kSmoothingMillis = 1000;
+
+  string path_;
+  int64_t last_stall_micros_;
+  int64_t last_millis_;
+  double smoothed_;
+};
+
+/// @return the number of bytes of memory that can still be allocated
+/// without swapping, taking into account the limits of the cgroup we run
+/// in.  A negative value is returned if it is unknown.
+int64_t GetAvailableMemory();
+
+/// @return the number of bytes of memory this machine has, or that the
+/// cgroups we run in limit us to if that is less, or a negative value if
+/// it is unknown.
+int64_t GetTotalMemory();
+
+/// The resources a command used, as far as the platform tells.  Unknown
+/// values are 0.
+struct ResourceUsage {
+  ResourceUsage()
+      : user_micros(0), system_micros(0), max_rss_kib(0), input_blocks(0),
+        output_blocks(0), voluntary_switches(0), involuntary_switches(0) {}
+
+  int64_t user_micros;
+  int64_t system_micros;
+  /// The peak resident set size of its largest process.
+  int64_t max_rss_kib;
+  int64_t input_blocks;
+  int64_t output_blocks;
+  int64_t voluntary_switches;
+  int64_t involuntary_switches;
+};
+
 /// Elide the given string @a str with '...' in the middle if the length
 /// exceeds @a width.
 string ElideMiddle(const string& str, size_t width);
@@ -428,3 +428,24 @@ TEST(ElideMiddle, ElideInTheMiddle) {
   EXPECT_EQ("012...789", elided);
   EXPECT_EQ("01234567...23456789", ElideMiddle(input, 19));
 }
+
+#if defined(__linux__) || defined(_WIN32)
+TEST(GetAvailableMemory, Known) {
+  EXPECT_GT(GetAvailableMemory(), 0);
+}
+#endif
+
+TEST(CpuPressure, Update) {
+  CpuPressure pressure;
+  // One reading says nothing yet.
+  EXPECT_LT(pressure.Update(1000000, 1000), 0);
+  // Tasks waited for a quarter of the next second, then are taken as
+  // they were over to begin with.
+  EXPECT_EQ(0.25, pressure.Update(1250000, 2000));
+  // A change counts for less the sooner the next reading comes.
+  double smoothed = pressure.Update(1350000, 2100);
+  EXPECT_GT(smoothed, 0.25);
+  EXPECT_LT(smoothed, 0.35);
+  // No more than all of the time, however the counts go.
+  EXPECT_LE(pressure.Update(9000000, 2200), 1);
+}
@@ -0,0 +1,295 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "watch.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "disk_interface.h"
+#include "util.h"
+
+namespace {
+
+/// How often to stat the watched files when polling.
+const int kPollIntervalMs = 500;
+/// How long to wait for more changes once one came.
+const int kSettleMs = 100;
+
+#ifdef __linux__
+const uint32_t kInotifyMask = IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE |
+    IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+#endif
+
+/// The directory of |path| with a trailing slash, or "" if it has none.
+string DirName(const string& path) {
+  string::size_type slash = path.rfind('/');
+  return slash == string::npos ? string() : path.substr(0, slash + 1);
+}
+
+/// |dir|, with a trailing slash as DirName() gives it, as the stat cache
+/// has it: without, but for the root.
+string CacheDir(const string& dir) {
+  if (dir.size() <= 1)
+    return dir;
+  return dir.substr(0, dir.size() - 1);
+}
+
+}  // anonymous namespace
+
+FileWatcher::FileWatcher(DiskInterface* disk_interface)
+    : disk_interface_(disk_interface), inotify_fd_(-1) {
+#ifdef __linux__
+  inotify_fd_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+  if (inotify_fd_ >= 0)
+    close(inotify_fd_);
+}
+
+void FileWatcher::Watch(const vector<string>& paths) {
+  paths_.clear();
+  paths_.insert(paths.begin(), paths.end());
+  if (!polling()) {
+    AddDirectoryWatches();
+    if (!polling())
+      return;
+  }
+
+  map<string, TimeStamp> mtimes;
+  for (set<string>::const_iterator i = paths_.begin(); i != paths_.end();
+       ++i) {
+    map<string, TimeStamp>::const_iterator old = mtimes_.find(*i);
+    if (old != mtimes_.end()) {
+      mtimes[*i] = old->second;
+    } else {
+      string err;
+      mtimes[*i] = disk_interface_->Stat(*i, &err);
+    }
+  }
+  mtimes_.swap(mtimes);
+}
+
+void FileWatcher::AddDirectoryWatches() {
+#ifdef __linux__
+  for (set<string>::const_iterator i = paths_.begin(); i != paths_.end();
+       ++i) {
+    string dir = DirName(*i);
+    if (!watched_dirs_.insert(dir).second)
+      continue;
+    int wd = inotify_add_watch(inotify_fd_, dir.empty() ? "." : dir.c_str(),
+                               kInotifyMask);
+    if (wd >= 0) {
+      dirs_.insert(make_pair(wd, dir));
+    } else if (errno != ENOENT && errno != ENOTDIR) {
+      // Most likely out of watches (fs.inotify.max_user_watches).
+      Warning("watching '%s': %s; polling for changes instead",
+              dir.empty() ? "." : dir.c_str(), strerror(errno));
+      close(inotify_fd_);
+      inotify_fd_ = -1;
+      dirs_.clear();
+      watched_dirs_.clear();
+      return;
+    }
+  }
+#endif
+}
+
+bool FileWatcher::ReadEvents(int timeout_ms, set<string>* changed,
+                             string* err) {
+  set<string> all, lost_dirs;
+  bool overflowed = false;
+  if (!ReadAllEvents(timeout_ms, &all, &lost_dirs, &overflowed, err))
+    return false;
+  // Lost directories are watched again by the next Watch().
+  for (set<string>::iterator i = all.begin(); i != all.end(); ++i) {
+    if (paths_.count(*i))
+      changed->insert(*i);
+  }
+  if (overflowed || !lost_dirs.empty()) {
+    // Take it that everything changed.
+    changed->insert(paths_.begin(), paths_.end());
+  }
+  return true;
+}
+
+bool FileWatcher::WatchDirectories(const set<string>& dirs,
+                                   vector<string>* fresh) {
+#ifdef __linux__
+  for (set<string>::const_iterator i = dirs.begin();
+       i != dirs.end() && !polling(); ++i) {
+    string dir = i->empty() || *i == "/" ? *i : *i + "/";
+    if (watched_dirs_.count(dir))
+      continue;
+    int wd = inotify_add_watch(inotify_fd_, dir.empty() ? "." : dir.c_str(),
+                               kInotifyMask | IN_ONLYDIR);
+    if (wd >= 0) {
+      watched_dirs_.insert(dir);
+      dirs_.insert(make_pair(wd, dir));
+    } else if (errno != ENOENT && errno != ENOTDIR) {
+      Warning("watching '%s': %s", dir.empty() ? "." : dir.c_str(),
+              strerror(errno));
+      close(inotify_fd_);
+      inotify_fd_ = -1;
+      dirs_.clear();
+      watched_dirs_.clear();
+    }
+    // Either way, whatever was known of it could be out of date.
+    fresh->push_back(*i);
+  }
+#endif
+  return !polling();
+}
+
+bool FileWatcher::TakeChanges(vector<string>* changed,
+                              vector<string>* lost_dirs, bool* overflowed,
+                              string* err) {
+  set<string> paths, dirs;
+  *overflowed = false;
+  while (ReadAllEvents(0, &paths, &dirs, overflowed, err)) {}
+  if (!err->empty())
+    return false;
+  changed->insert(changed->end(), paths.begin(), paths.end());
+  for (set<string>::iterator i = dirs.begin(); i != dirs.end(); ++i)
+    lost_dirs->push_back(CacheDir(*i));
+  return true;
+}
+
+void FileWatcher::ForgetDirectory(const string& dir, set<string>* lost_dirs) {
+#ifdef __linux__
+  set<int> wds;
+  for (multimap<int, string>::iterator i = dirs_.begin(); i != dirs_.end();
+       ++i) {
+    if (i->second.compare(0, dir.size(), dir) == 0)
+      wds.insert(i->first);
+  }
+  // The watch goes for every path that it was for.
+  for (set<int>::iterator wd = wds.begin(); wd != wds.end(); ++wd) {
+    inotify_rm_watch(inotify_fd_, *wd);
+    pair<multimap<int, string>::iterator, multimap<int, string>::iterator>
+        range = dirs_.equal_range(*wd);
+    for (multimap<int, string>::iterator i = range.first; i != range.second;
+         ++i) {
+      watched_dirs_.erase(i->second);
+      lost_dirs->insert(i->second);
+    }
+    dirs_.erase(range.first, range.second);
+  }
+#endif
+}
+
+bool FileWatcher::ReadAllEvents(int timeout_ms, set<string>* changed,
+                                set<string>* lost_dirs, bool* overflowed,
+                                string* err) {
+#ifdef __linux__
+  pollfd fd = { inotify_fd_, POLLIN, 0 };
+  int ret = poll(&fd, 1, timeout_ms);
+  if (ret < 0 && errno != EINTR) {
+    *err = string("poll: ") + strerror(errno);
+    return false;
+  }
+  if (ret <= 0)
+    return false;
+
+  char buffer[64 * 1024]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  for (;;) {
+    ssize_t len = read(inotify_fd_, buffer, sizeof(buffer));
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len <= 0)
+      return true;
+    for (char* p = buffer; p < buffer + len;) {
+      const inotify_event* event = (const inotify_event*)p;
+      p += sizeof(inotify_event) + event->len;
+      if (event->mask & IN_Q_OVERFLOW) {
+        *overflowed = true;
+        continue;
+      }
+      // One directory can be watched by several paths, such as "" and
+      // its absolute path, which share the watch.
+      vector<string> dirs;
+      pair<multimap<int, string>::iterator, multimap<int, string>::iterator>
+          range = dirs_.equal_range(event->wd);
+      for (multimap<int, string>::iterator i = range.first; i != range.second;
+           ++i)
+        dirs.push_back(i->second);
+      for (vector<string>::iterator dir = dirs.begin(); dir != dirs.end();
+           ++dir) {
+        if (!event->len) {
+          // The directory itself went, or moved: what is known of its
+          // path doesn't hold anymore.
+          if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+            ForgetDirectory(*dir, lost_dirs);
+          continue;
+        }
+        string path = *dir + event->name;
+        changed->insert(path);
+        if ((event->mask & IN_ISDIR) &&
+            (event->mask &
+             (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)))
+          ForgetDirectory(path + "/", lost_dirs);
+      }
+    }
+  }
+#else
+  return false;
+#endif
+}
+
+void FileWatcher::Poll(set<string>* changed) {
+  for (map<string, TimeStamp>::iterator i = mtimes_.begin();
+       i != mtimes_.end(); ++i) {
+    string err;
+    TimeStamp mtime = disk_interface_->Stat(i->first, &err);
+    if (mtime != i->second) {
+      i->second = mtime;
+      changed->insert(i->first);
+    }
+  }
+}
+
+bool FileWatcher::WaitForChanges(vector<string>* changed, string* err) {
+  set<string> paths;
+  if (polling()) {
+    while (paths.empty()) {
+      usleep(kPollIntervalMs * 1000);
+      Poll(&paths);
+    }
+    usleep(kSettleMs * 1000);
+    Poll(&paths);
+  } else {
+    while (paths.empty()) {
+      // Events for other files in the watched directories come through
+      // here too.
+      if (!ReadEvents(-1, &paths, err) && !err->empty())
+        return false;
+    }
+    while (ReadEvents(kSettleMs, &paths, err)) {}
+    if (!err->empty())
+      return false;
+  }
+  changed->assign(paths.begin(), paths.end());
+  return true;
+}
+
+#endif  // _WIN32
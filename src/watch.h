@@ -0,0 +1,93 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef NINJA_WATCH_H_
+#define NINJA_WATCH_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "timestamp.h"
+
+struct DiskInterface;
+
+#ifndef _WIN32
+/// Waits for files to change, for "ninja --watch".  On Linux it watches
+/// the directories of the files with inotify; elsewhere it polls their
+/// mtimes.
+struct FileWatcher {
+  explicit FileWatcher(DiskInterface* disk_interface);
+  ~FileWatcher();
+
+  /// Watch |paths| from now on, in place of the files watched before.
+  /// Changes to files watched before and still watched that happened in
+  /// between aren't lost.
+  void Watch(const vector<string>& paths);
+
+  /// Block until watched files change, then collect the changes that
+  /// follow shortly after, as editors and checkouts tend to make several.
+  bool WaitForChanges(vector<string>* changed, string* err);
+
+  /// Whether the watcher fell back to polling.
+  bool polling() const { return inotify_fd_ < 0; }
+
+  /// Also watch the directories |dirs|, as in "a/b", or "" for the current
+  /// one, for TakeChanges().  Adds to |fresh| those not watched so far,
+  /// whose changes until now aren't known.  Returns false, falling back to
+  /// polling, if one can't be watched, or if the watcher already polls.
+  bool WatchDirectories(const set<string>& dirs, vector<string>* fresh);
+
+  /// Collect, without waiting, what changed in the watched directories
+  /// since the last time: every file in them that did, watched or not, and
+  /// in |lost_dirs| the directories that were removed, moved or replaced,
+  /// which aren't watched anymore, nor is anything below them.  Sets
+  /// |*overflowed| if events were dropped, when anything may have changed.
+  bool TakeChanges(vector<string>* changed, vector<string>* lost_dirs,
+                   bool* overflowed, string* err);
+
+ private:
+  /// Watch the directories of |paths_| that aren't yet, falling back to
+  /// polling if that fails.
+  void AddDirectoryWatches();
+  /// Read the pending inotify events into |changed|, waiting up to
+  /// |timeout_ms| (or forever if negative) for the first.  Returns false
+  /// if none came.
+  bool ReadEvents(int timeout_ms, set<string>* changed, string* err);
+  /// ReadEvents() for any file in the watched directories: what changed,
+  /// with the directories lost in |lost_dirs|.
+  bool ReadAllEvents(int timeout_ms, set<string>* changed,
+                     set<string>* lost_dirs, bool* overflowed, string* err);
+  /// Stop watching the directory with trailing slash |dir| and those below
+  /// it, adding those that were watched to |lost_dirs|.
+  void ForgetDirectory(const string& dir, set<string>* lost_dirs);
+  /// Stat the watched files, and move those whose mtime changed into
+  /// |changed|.
+  void Poll(set<string>* changed);
+
+  DiskInterface* disk_interface_;
+  set<string> paths_;
+  /// When polling, the mtime of each watched file when last looked at.
+  map<string, TimeStamp> mtimes_;
+  int inotify_fd_;
+  /// The directories, with a trailing slash or empty for the current one,
+  /// for each inotify watch descriptor.
+  multimap<int, string> dirs_;
+  set<string> watched_dirs_;
+};
+#endif  // _WIN32
+
+#endif  // NINJA_WATCH_H_
@@ -0,0 +1,133 @@
+// Copyright 2026 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "watch.h"
+
+#include <stdio.h>
+
+#include "disk_interface.h"
+#include "test.h"
+
+#ifdef __linux__
+namespace {
+
+struct FileWatcherTest : public testing::Test {
+  virtual void SetUp() {
+    temp_dir_.CreateAndEnter("Ninja-FileWatcherTest");
+  }
+  virtual void TearDown() {
+    temp_dir_.Cleanup();
+  }
+
+  void Write(const string& path, const string& contents) {
+    FILE* f = fopen(path.c_str(), "w");
+    ASSERT_TRUE(f != NULL);
+    fputs(contents.c_str(), f);
+    fclose(f);
+  }
+
+  ScopedTempDir temp_dir_;
+  RealDiskInterface disk_;
+};
+
+TEST_F(FileWatcherTest, Changes) {
+  ASSERT_TRUE(disk_.MakeDir("sub"));
+  Write("a.c", "a");
+  Write("sub/b.h", "b");
+  Write("sub/other", "");
+
+  FileWatcher watcher(&disk_);
+  vector<string> paths;
+  paths.push_back("a.c");
+  paths.push_back("sub/b.h");
+  paths.push_back("missing/c.h");
+  watcher.Watch(paths);
+  EXPECT_FALSE(watcher.polling());
+
+  // Changes to files that aren't watched go unreported.
+  Write("sub/other", "x");
+  Write("sub/b.h", "bb");
+  vector<string> changed;
+  string err;
+  ASSERT_TRUE(watcher.WaitForChanges(&changed, &err));
+  EXPECT_EQ("", err);
+  ASSERT_EQ(1u, changed.size());
+  EXPECT_EQ("sub/b.h", changed[0]);
+
+  // Replacing and removing files count too.
+  Write("a.c.tmp", "aa");
+  ASSERT_EQ(0, rename("a.c.tmp", "a.c"));
+  ASSERT_EQ(0, disk_.RemoveFile("sub/b.h"));
+  changed.clear();
+  ASSERT_TRUE(watcher.WaitForChanges(&changed, &err));
+  ASSERT_EQ(2u, changed.size());
+  EXPECT_EQ("a.c", changed[0]);
+  EXPECT_EQ("sub/b.h", changed[1]);
+}
+
+TEST_F(FileWatcherTest, Directories) {
+  ASSERT_TRUE(disk_.MakeDir("sub"));
+  ASSERT_TRUE(disk_.MakeDir("sub/deeper"));
+  Write("a", "");
+
+  FileWatcher watcher(&disk_);
+  set<string> dirs;
+  dirs.insert("");
+  dirs.insert("sub");
+  dirs.insert("sub/deeper");
+  dirs.insert("missing");
+  vector<string> fresh;
+  ASSERT_TRUE(watcher.WatchDirectories(dirs, &fresh));
+  EXPECT_EQ(4u, fresh.size());
+  fresh.clear();
+  ASSERT_TRUE(watcher.WatchDirectories(dirs, &fresh));
+  EXPECT_EQ(1u, fresh.size());  // "missing", which can't be watched.
+
+  // Every file that changes in them is reported.
+  Write("a", "x");
+  Write("sub/deeper/b", "");
+  vector<string> changed, lost;
+  bool overflowed = true;
+  string err;
+  ASSERT_TRUE(watcher.TakeChanges(&changed, &lost, &overflowed, &err));
+  EXPECT_EQ("", err);
+  EXPECT_FALSE(overflowed);
+  ASSERT_EQ(2u, changed.size());
+  EXPECT_EQ("a", changed[0]);
+  EXPECT_EQ("sub/deeper/b", changed[1]);
+  EXPECT_TRUE(lost.empty());
+
+  // Moving a directory away loses it and those below it.
+  ASSERT_EQ(0, rename("sub", "moved"));
+  changed.clear();
+  ASSERT_TRUE(watcher.TakeChanges(&changed, &lost, &overflowed, &err));
+  ASSERT_EQ(2u, lost.size());
+  EXPECT_EQ("sub", lost[0]);
+  EXPECT_EQ("sub/deeper", lost[1]);
+  ASSERT_EQ(2u, changed.size());
+  EXPECT_EQ("moved", changed[0]);
+  EXPECT_EQ("sub", changed[1]);
+
+  // Which can be watched afresh.
+  ASSERT_TRUE(disk_.MakeDir("sub"));
+  fresh.clear();
+  dirs.erase("sub/deeper");
+  ASSERT_TRUE(watcher.WatchDirectories(dirs, &fresh));
+  ASSERT_EQ(2u, fresh.size());
+  EXPECT_EQ("missing", fresh[0]);
+  EXPECT_EQ("sub", fresh[1]);
+}
+
+}  // anonymous namespace
+#endif  // __linux__